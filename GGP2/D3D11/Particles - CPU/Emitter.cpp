@@ -1,8 +1,16 @@
 #include "Emitter.h"
 #include "Graphics.h"
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+
 using namespace DirectX;
 
+// Each emitter gets its own default seed, in creation order, so
+// emitters differ from each other but are the same every run
+static unsigned int nextDefaultSeed = 1;
+
 Emitter::Emitter(
 	int maxParticles,
 	int particlesPerSecond,
@@ -48,17 +56,36 @@ Emitter::Emitter(
 		spriteSheetSpeedScale(spriteSheetSpeedScale),
 		paused(paused),
 		visible(visible),
+		expandOnGPU(true),
+		closedForm(false),
+		forceField(-1),
+		forceFieldStrength(1.0f),
+		forceFieldMode(ForceFieldMode::Flow),
+		collide(false),
+		collisionResponse(CollisionResponse::Bounce),
+		restitution(0.5f),
+		friction(0.2f),
+		lastCollisionCount(0),
+		budgetRateScale(1.0f),
+		budgetSizeScale(1.0f),
+		budgetParticleLimit(INT_MAX),
+		localParticleVertices(0),
 		particles(0),
-		localParticleVertices(0)
+		sharedPool(false),
+		mappedRecords(0)
 {
 	transform = std::make_shared<Transform>();
 	this->transform->SetPosition(emitterPosition);
 
 	// Set up emission and lifetime stats
 	timeSinceLastEmit = 0;
+	totalEmitterTime = 0;
+	needsEvaluation = false;
+	culled = false;
 	livingParticleCount = 0;
 	firstAliveIndex = 0;
 	firstDeadIndex = 0;
+	SetRandomSeed(nextDefaultSeed++);
 
 	// Set up Default UVs
 	DefaultUVs[0] = XMFLOAT2(0, 0);
@@ -73,26 +100,39 @@ Emitter::Emitter(
 
 Emitter::~Emitter()
 {
-	delete[] particles;
+	EndParticleUpload();
+	ReleaseAllBlocks();
 	delete[] localParticleVertices;
 }
 
 std::shared_ptr<Transform> Emitter::GetTransform() { return transform; }
 std::shared_ptr<Material> Emitter::GetMaterial() { return material; }
 void Emitter::SetMaterial(std::shared_ptr<Material> material) { this->material = material; }
+void Emitter::SetExpansionVertexShader(std::shared_ptr<SimpleVertexShader> vs) { expansionVS = vs; }
 
 
 void Emitter::CreateParticlesAndGPUResources()
 {
 	// Delete and release existing resources
-	if (particles) delete[] particles;
+	EndParticleUpload();
 	if (localParticleVertices) delete[] localParticleVertices;
 	indexBuffer.Reset();
 	vertexBuffer.Reset();
+	particleRecordBuffer.Reset();
+	particleRecordSRV.Reset();
 
-	// Set up the particle array
-	particles = new Particle[maxParticles];
-	ZeroMemory(particles, sizeof(Particle) * maxParticles);
+	// Particle data lives in the pool, which hands out blocks as
+	// they're needed - so start with none
+	ReleaseAllBlocks();
+	blockTable.assign((maxParticles + ParticlePoolBlockSize - 1) / ParticlePoolBlockSize, -1);
+
+	// Until it's given a shared pool, the emitter has a pool of its
+	// own that's just big enough for all of its particles
+	if (!sharedPool)
+	{
+		pool = std::make_shared<ParticlePool>((int)blockTable.size());
+		particles = &pool->Storage;
+	}
 
 	// Create UV's here, as those will usually stay the same
 	localParticleVertices = new ParticleVertex[4 * maxParticles];
@@ -136,138 +176,442 @@ void Emitter::CreateParticlesAndGPUResources()
 	Graphics::Device->CreateBuffer(&ibDesc, &indexData, indexBuffer.GetAddressOf());
 
 	delete[] indices;
+
+	// DYNAMIC structured buffer of particle records for GPU
+	// expansion - only the living particles are copied each frame
+	D3D11_BUFFER_DESC recordDesc = {};
+	recordDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	recordDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	recordDesc.Usage = D3D11_USAGE_DYNAMIC;
+	recordDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	recordDesc.StructureByteStride = sizeof(ParticleRecord);
+	recordDesc.ByteWidth = sizeof(ParticleRecord) * maxParticles;
+	Graphics::Device->CreateBuffer(&recordDesc, 0, particleRecordBuffer.GetAddressOf());
+
+	// Create an SRV that points to the structured buffer of records
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = maxParticles;
+	Graphics::Device->CreateShaderResourceView(particleRecordBuffer.Get(), &srvDesc, particleRecordSRV.GetAddressOf());
 }
 
 
 
-void Emitter::Update(float dt)
+// --------------------------------------------------------
+// Simulates the emitter for one frame.  Only this emitter's
+// own data (and blocks from the lock-free pool) are touched,
+// so separate emitters can be updated on separate threads.
+//
+// dt   - Time since the last update
+// jobs - Splits a large emitter's particles into chunks that
+//        update as separate jobs (or 0 to do them all here)
+// --------------------------------------------------------
+void Emitter::Update(float dt, JobSystem* jobs)
 {
 	if (paused)
 		return;
 
-	// Update all particles - Check cyclic buffer first
-	if (firstAliveIndex < firstDeadIndex)
-	{
-		// First alive is BEFORE first dead, so the "living" particles are contiguous
-		// 
-		// 0 -------- FIRST ALIVE ----------- FIRST DEAD -------- MAX
-		// |    dead    |            alive       |         dead    |
+	// Add to the time
+	totalEmitterTime += dt;
+	timeSinceLastEmit += dt;
 
-		// First alive is before first dead, so no wrapping
-		for (int i = firstAliveIndex; i < firstDeadIndex; i++)
-			UpdateSingleParticle(dt, i);
+	if (closedForm)
+	{
+		// Nothing is simulated between spawn and draw, so all that's
+		// left is retiring particles whose lifetime has run out
+		RetireExpiredParticles();
+		needsEvaluation = true;
 	}
 	else
 	{
-		// First alive is AFTER first dead, so the "living" particles wrap around
-		// 
-		// 0 -------- FIRST DEAD ----------- FIRST ALIVE -------- MAX
-		// |    alive    |            dead       |         alive   |
+		// Particles are in the emitter's space, and fields are in world space
+		ForceField* field = GetActiveForceField();
+		XMFLOAT3 emitterPosition = transform->GetPosition();
+		ForceFieldParams fieldParams = {
+			.DeltaTime = dt,
+			.Strength = forceFieldStrength,
+			.Offset = { emitterPosition.x, emitterPosition.y, emitterPosition.z },
+			.Mode = forceFieldMode };
+
+		// Only the colliders near the emitter's bounds are worth testing
+		ParticleUpdateParams params = GetUpdateParams(dt);
+		bool collideThisFrame = FindNearbyColliders();
+		ParticleCollisionParams collisionParams = {
+			.Response = collisionResponse,
+			.Restitution = restitution,
+			.Friction = friction };
+		memcpy(collisionParams.Acceleration, params.Acceleration, sizeof(float) * 3);
+		if (collideThisFrame)
+		{
+			// Colliders are in world space, so particles go through the
+			// emitter's whole transform (rotation and scale too)
+			XMFLOAT4X4 world = transform->GetWorldMatrix();
+			XMFLOAT4X4 inverseWorld;
+			XMStoreFloat4x4(&inverseWorld, XMMatrixInverse(0, XMLoadFloat4x4(&world)));
+			for (int row = 0; row < 4; row++)
+			{
+				memcpy(collisionParams.World[row], world.m[row], sizeof(float) * 3);
+				memcpy(collisionParams.InverseWorld[row], inverseWorld.m[row], sizeof(float) * 3);
+			}
+		}
+
+		// Update all living particles, one contiguous piece at a time -
+		// since particles die in the order they were spawned, the kernel
+		// only needs to tell us how many died.  The force field moves
+		// their start positions first, so the update builds on those,
+		// and collisions then fix up wherever the update put them.
+		std::atomic<int> deadCount = 0;
+		std::atomic<int> collisionCount = 0;
+		ForEachChunk(firstAliveIndex, livingParticleCount, jobs, [&](int chunkStart, int chunkCount, int) {
+			int chunkDeadCount = 0;
+			int chunkCollisionCount = 0;
+			ForEachSegment(chunkStart, chunkCount, [&](int poolStart, int count, int) {
+				if (field)
+					ApplyForceField(*particles, poolStart, count, *field, fieldParams);
+				chunkDeadCount += UpdateParticles(*particles, poolStart, count, params);
+				if (collideThisFrame)
+					chunkCollisionCount += CollideParticles(*particles, poolStart, count, *colliders, nearbyColliders, collisionParams); });
+			deadCount += chunkDeadCount;
+			collisionCount += chunkCollisionCount; });
+		lastCollisionCount = collisionCount;
+
+		// Retire all of the dead particles by moving the alive index (and wrap)
+		firstAliveIndex = (firstAliveIndex + deadCount) % maxParticles;
+		livingParticleCount -= deadCount;
+	}
 
-		// Update first half (from firstAlive to max particles)
-		for (int i = firstAliveIndex; i < maxParticles; i++)
-			UpdateSingleParticle(dt, i);
+	// Enough time to emit?  Figure out how many, then spawn them all at once
+	float emitInterval = GetEmitInterval();
+	int spawnCount = 0;
+	while (timeSinceLastEmit > emitInterval)
+	{
+		spawnCount++;
+		timeSinceLastEmit -= emitInterval;
+	}
 
-		// Update second half (from 0 to first dead)
-		for (int i = 0; i < firstDeadIndex; i++)
-			UpdateSingleParticle(dt, i);
+	// The newest particle came due timeSinceLastEmit seconds ago
+	float firstSpawnTime = totalEmitterTime - timeSinceLastEmit - (spawnCount - 1) * emitInterval;
+	SpawnParticles(spawnCount, firstSpawnTime);
+
+	// Hand back any blocks the particles have moved out of
+	ReleaseUnusedBlocks();
+}
+
+
+// --------------------------------------------------------
+// Gathers the emitter-wide values the simulation needs
+// --------------------------------------------------------
+ParticleUpdateParams Emitter::GetUpdateParams(float dt)
+{
+	ParticleUpdateParams params{};
+	params.DeltaTime = dt;
+	params.Lifetime = lifetime;
+	params.StartSize = startSize * budgetSizeScale;
+	params.EndSize = endSize * budgetSizeScale;
+	memcpy(params.StartColor, &startColor, sizeof(float) * 4);
+	memcpy(params.EndColor, &endColor, sizeof(float) * 4);
+	memcpy(params.Acceleration, &emitterAcceleration, sizeof(float) * 3);
+	return params;
+}
+
+// The force field in use, if any (and if it can be used)
+ForceField* Emitter::GetActiveForceField()
+{
+	return closedForm ? 0 : ForceFields::Get(forceField);
+}
+
+
+// --------------------------------------------------------
+// Narrows the scene's colliders down to the ones inside the
+// emitter's bounds, returning false if there are none (or
+// collisions are off), so far away emitters skip them entirely
+// --------------------------------------------------------
+bool Emitter::FindNearbyColliders()
+{
+	if (!collide || closedForm || !colliders)
+	{
+		lastCollisionCount = 0;
+		return false;
 	}
 
-	// Add to the time
-	timeSinceLastEmit += dt;
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	CalculateWorldBounds().GetCorners(corners);
+	float boundsMin[3] = { corners[0].x, corners[0].y, corners[0].z };
+	float boundsMax[3] = { corners[0].x, corners[0].y, corners[0].z };
+	for (XMFLOAT3& corner : corners)
+	{
+		float* c = &corner.x;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			boundsMin[axis] = min(boundsMin[axis], c[axis]);
+			boundsMax[axis] = max(boundsMax[axis], c[axis]);
+		}
+	}
+
+	return colliders->FindNearby(boundsMin, boundsMax, nearbyColliders);
+}
+
+
+// --------------------------------------------------------
+// Retires particles based on their spawn times alone, which
+// only touches the particles that actually died.  They die
+// in the order they were spawned, so they're all at the front.
+// --------------------------------------------------------
+void Emitter::RetireExpiredParticles()
+{
+	while (livingParticleCount > 0 &&
+		totalEmitterTime - particles->SpawnTime[GetPoolIndex(firstAliveIndex)] >= lifetime)
+	{
+		firstAliveIndex = (firstAliveIndex + 1) % maxParticles;
+		livingParticleCount--;
+	}
+}
+
 
-	// Enough time to emit?
-	while (timeSinceLastEmit > secondsPerParticle)
+// --------------------------------------------------------
+// Moves the emitter to an arbitrary point in time.  Moving
+// forward is a fast-forward; moving backward restarts the
+// emitter (and its random streams) and fast-forwards from
+// the beginning, since particles can't be un-spawned.
+//
+// Particles are spawned with the emitter's current settings,
+// so the results match what would have happened by running
+// the emitter up to that time as long as its settings didn't
+// change along the way (and it never ran out of particles).
+// --------------------------------------------------------
+void Emitter::SetTime(float time)
+{
+	if (time < 0.0f)
+		time = 0.0f;
+
+	if (time < totalEmitterTime)
 	{
-		SpawnParticle();
-		timeSinceLastEmit -= secondsPerParticle;
+		timeSinceLastEmit = 0.0f;
+		totalEmitterTime = 0.0f;
+		livingParticleCount = 0;
+		firstAliveIndex = 0;
+		firstDeadIndex = 0;
+		SetRandomSeed(randomSeed);
 	}
+
+	FastForward(time - totalEmitterTime);
 }
 
-void Emitter::UpdateSingleParticle(float dt, int index)
+
+// --------------------------------------------------------
+// Jumps the emitter ahead in a single step.  Only particles
+// that are still alive at the end are spawned (the random
+// values of the rest are jumped over, which only costs more
+// with each doubling of their number), and everything is
+// then evaluated once at the new time, so this costs about
+// the same whether it skips one second or one hour.
+//
+// seconds - How far ahead to jump
+// --------------------------------------------------------
+void Emitter::FastForward(float seconds)
 {
-	// Check for valid particle age before doing anything
-	if (particles[index].Age >= lifetime)
+	if (seconds <= 0.0f)
 		return;
 
-	// Update and check for death
-	particles[index].Age += dt;
-	if (particles[index].Age >= lifetime)
+	// Particles already alive may not be by the end
+	totalEmitterTime += seconds;
+	RetireExpiredParticles();
+
+	// How many particles come due, and when the first one does
+	float emitInterval = GetEmitInterval();
+	timeSinceLastEmit += seconds;
+	long long dueCount = (long long)(timeSinceLastEmit / emitInterval);
+	timeSinceLastEmit -= dueCount * emitInterval;
+	float firstSpawnTime = totalEmitterTime - timeSinceLastEmit - (dueCount - 1) * emitInterval;
+
+	// Skip the ones that would already be dead, along with their random values
+	long long skipCount = 0;
+	float oldestAliveTime = totalEmitterTime - lifetime;
+	if (dueCount > 0 && firstSpawnTime <= oldestAliveTime)
+		skipCount = min(dueCount, (long long)((oldestAliveTime - firstSpawnTime) / emitInterval) + 1);
+
+	for (int i = 0; i < 3; i++)
 	{
-		// Recent death, so retire by moving alive count
-		firstAliveIndex++;
-		firstAliveIndex %= maxParticles;
-		livingParticleCount--;
+		positionRandom[i].Discard(skipCount);
+		velocityRandom[i].Discard(skipCount);
+	}
+	rotationStartRandom.Discard(skipCount);
+	rotationEndRandom.Discard(skipCount);
+
+	SpawnParticles((int)min(dueCount - skipCount, (long long)maxParticles), firstSpawnTime + skipCount * emitInterval);
+
+	// Bring every particle up to the new time at once
+	EvaluateLivingParticles();
+	ReleaseUnusedBlocks();
+}
+
+
+// --------------------------------------------------------
+// Evaluates every living particle at the current time from
+// its spawn data, retiring any that turn out to be dead
+// --------------------------------------------------------
+void Emitter::EvaluateLivingParticles(JobSystem* jobs)
+{
+	ParticleUpdateParams params = GetUpdateParams(0.0f);
+	std::atomic<int> deadCount = 0;
+	ForEachChunk(firstAliveIndex, livingParticleCount, jobs, [&](int chunkStart, int chunkCount, int) {
+		int chunkDeadCount = 0;
+		ForEachSegment(chunkStart, chunkCount, [&](int poolStart, int count, int) {
+			chunkDeadCount += EvaluateParticles(*particles, poolStart, count, totalEmitterTime, params); });
+		deadCount += chunkDeadCount; });
+
+	firstAliveIndex = (firstAliveIndex + deadCount) % maxParticles;
+	livingParticleCount -= deadCount;
+	needsEvaluation = false;
+}
+
+
+// --------------------------------------------------------
+// Spawns up to count new particles at once, starting with
+// the first dead particle (and wrapping if necessary)
+//
+// count          - How many particles came due
+// firstSpawnTime - When the first one came due (the rest
+//                  follow at the emission rate)
+// --------------------------------------------------------
+void Emitter::SpawnParticles(int count, float firstSpawnTime)
+{
+	// Only spawn as many as there's room for (within the budget)
+	int available = min(maxParticles, budgetParticleLimit) - livingParticleCount;
+	if (count > available)
+		count = available;
+	if (count <= 0)
 		return;
+
+	// Make sure there are blocks to spawn into - if the pool runs
+	// dry, spawn as many as fit in the blocks we did get
+	count = AcquireBlocks(firstDeadIndex, count);
+
+	// Spawn into each block's piece of the range
+	float emitInterval = GetEmitInterval();
+	ForEachSegment(firstDeadIndex, count, [&](int poolStart, int segmentCount, int offset) {
+		SpawnParticleRange(poolStart, segmentCount, firstSpawnTime + offset * emitInterval); });
+
+	// Increment and wrap
+	firstDeadIndex = (firstDeadIndex + count) % maxParticles;
+	livingParticleCount += count;
+}
+
+
+// --------------------------------------------------------
+// Resets a contiguous range of particles in the pool, filling
+// each randomized attribute for the whole range at once
+// --------------------------------------------------------
+void Emitter::SpawnParticleRange(int first, int count, float firstSpawnTime)
+{
+	float emitInterval = GetEmitInterval();
+	for (int i = first; i < first + count; i++)
+	{
+		particles->SpawnTime[i] = firstSpawnTime + (i - first) * emitInterval;
+		particles->Age[i] = 0;
+		particles->Size[i] = startSize * budgetSizeScale;
+		particles->ColorR[i] = startColor.x;
+		particles->ColorG[i] = startColor.y;
+		particles->ColorB[i] = startColor.z;
+		particles->ColorA[i] = startColor.w;
 	}
 
-	// Calculate age percentage for lerp
-	float agePercent = particles[index].Age / lifetime;
+	positionRandom[0].FillUniform(particles->StartPositionX + first, count, -positionRandomRange.x, positionRandomRange.x);
+	positionRandom[1].FillUniform(particles->StartPositionY + first, count, -positionRandomRange.y, positionRandomRange.y);
+	positionRandom[2].FillUniform(particles->StartPositionZ + first, count, -positionRandomRange.z, positionRandomRange.z);
 
-	// Interpolate the color
-	XMStoreFloat4(
-		&particles[index].Color,
-		XMVectorLerp(
-			XMLoadFloat4(&startColor),
-			XMLoadFloat4(&endColor),
-			agePercent));
+	velocityRandom[0].FillUniform(particles->StartVelocityX + first, count, startVelocity.x - velocityRandomRange.x, startVelocity.x + velocityRandomRange.x);
+	velocityRandom[1].FillUniform(particles->StartVelocityY + first, count, startVelocity.y - velocityRandomRange.y, startVelocity.y + velocityRandomRange.y);
+	velocityRandom[2].FillUniform(particles->StartVelocityZ + first, count, startVelocity.z - velocityRandomRange.z, startVelocity.z + velocityRandomRange.z);
 
-	// Interpolate the rotation
-	float rotStart = particles[index].RotationStart;
-	float rotEnd = particles[index].RotationEnd;
-	particles[index].Rotation = rotStart + agePercent * (rotEnd - rotStart);
+	rotationStartRandom.FillUniform(particles->RotationStart + first, count, rotationStartMinMax.x, rotationStartMinMax.y);
+	rotationEndRandom.FillUniform(particles->RotationEnd + first, count, rotationEndMinMax.x, rotationEndMinMax.y);
 
-	// Interpolate the size
-	particles[index].Size = startSize + agePercent * (endSize - startSize);
+	// Current values start out the same as the spawn values
+	memcpy(particles->PositionX + first, particles->StartPositionX + first, sizeof(float) * count);
+	memcpy(particles->PositionY + first, particles->StartPositionY + first, sizeof(float) * count);
+	memcpy(particles->PositionZ + first, particles->StartPositionZ + first, sizeof(float) * count);
+	memcpy(particles->Rotation + first, particles->RotationStart + first, sizeof(float) * count);
 
-	// Adjust the position
-	XMVECTOR startPos = XMLoadFloat3(&particles[index].StartPosition);
-	XMVECTOR startVel = XMLoadFloat3(&particles[index].StartVelocity);
-	XMVECTOR accel = XMLoadFloat3(&emitterAcceleration);
-	float t = particles[index].Age;
+	// Nothing built up from force fields yet
+	memset(particles->FieldVelocityX + first, 0, sizeof(float) * count);
+	memset(particles->FieldVelocityY + first, 0, sizeof(float) * count);
+	memset(particles->FieldVelocityZ + first, 0, sizeof(float) * count);
 
-	// Use constant acceleration function
-	XMStoreFloat3(
-		&particles[index].Position,
-		accel * t * t / 2.0f + startVel * t + startPos);
+	// Not killed by any collisions yet
+	std::fill(particles->Alive + first, particles->Alive + first + count, 1.0f);
 }
 
-void Emitter::SpawnParticle()
+// --------------------------------------------------------
+// Packs just the living particles (one compact record each,
+// rather than 4 full vertices) into the record buffer
+// --------------------------------------------------------
+void Emitter::CopyParticleRecordsToGPU()
 {
-	// Any left to spawn?
-	if (livingParticleCount == maxParticles)
-		return;
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	Graphics::Context->Map(particleRecordBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+
+	GetRing().PackRecords(*particles, firstAliveIndex, livingParticleCount, lifetime, (ParticleRecord*)mapped.pData);
 
-	// Reset the first dead particle
-	particles[firstDeadIndex].Age = 0;
-	particles[firstDeadIndex].Size = startSize;
-	particles[firstDeadIndex].Color = startColor;
+	Graphics::Context->Unmap(particleRecordBuffer.Get(), 0);
+}
 
-	particles[firstDeadIndex].StartPosition = XMFLOAT3(0,0,0);
-	particles[firstDeadIndex].StartPosition.x += (((float)rand() / RAND_MAX) * 2 - 1) * positionRandomRange.x;
-	particles[firstDeadIndex].StartPosition.y += (((float)rand() / RAND_MAX) * 2 - 1) * positionRandomRange.y;
-	particles[firstDeadIndex].StartPosition.z += (((float)rand() / RAND_MAX) * 2 - 1) * positionRandomRange.z;
 
-	particles[firstDeadIndex].Position = particles[firstDeadIndex].StartPosition;
+// --------------------------------------------------------
+// Maps the record buffer for the next Draw(), returning false
+// if there's nothing to upload (hidden, culled, empty or not
+// expanded on the GPU).  Mapping uses the graphics API, so
+// this needs to happen on the main thread.
+// --------------------------------------------------------
+bool Emitter::BeginParticleUpload(std::shared_ptr<Camera> camera)
+{
+	if (!visible || !expandOnGPU || !expansionVS || mappedRecords)
+		return false;
 
-	particles[firstDeadIndex].StartVelocity = startVelocity;
-	particles[firstDeadIndex].StartVelocity.x += (((float)rand() / RAND_MAX) * 2 - 1) * velocityRandomRange.x;
-	particles[firstDeadIndex].StartVelocity.y += (((float)rand() / RAND_MAX) * 2 - 1) * velocityRandomRange.y;
-	particles[firstDeadIndex].StartVelocity.z += (((float)rand() / RAND_MAX) * 2 - 1) * velocityRandomRange.z;
+	culled = livingParticleCount == 0 || !IsInView(camera);
+	if (culled)
+		return false;
 
-	float rotStartMin = rotationStartMinMax.x;
-	float rotStartMax = rotationStartMinMax.y;
-	particles[firstDeadIndex].RotationStart = ((float)rand() / RAND_MAX) * (rotStartMax - rotStartMin) + rotStartMin;
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	Graphics::Context->Map(particleRecordBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	mappedRecords = (ParticleRecord*)mapped.pData;
+	return true;
+}
 
-	float rotEndMin = rotationEndMinMax.x;
-	float rotEndMax = rotationEndMinMax.y;
-	particles[firstDeadIndex].RotationEnd = ((float)rand() / RAND_MAX) * (rotEndMax - rotEndMin) + rotEndMin;
 
-	// Increment and wrap
-	firstDeadIndex++;
-	firstDeadIndex %= maxParticles;
+// --------------------------------------------------------
+// Evaluates (if necessary) and packs the living particles into
+// the buffer mapped by BeginParticleUpload().  No graphics API
+// calls, so any thread can do this, and a large emitter can
+// split the work into chunks that write to separate parts of
+// the buffer at the same time.
+// --------------------------------------------------------
+void Emitter::WriteParticleUpload(JobSystem* jobs)
+{
+	if (!mappedRecords)
+		return;
 
-	livingParticleCount++;
+	if (closedForm && needsEvaluation)
+		EvaluateLivingParticles(jobs);
+
+	GetRing().PackRecords(*particles, firstAliveIndex, livingParticleCount, lifetime, mappedRecords, jobs);
+}
+
+
+// --------------------------------------------------------
+// Unmaps the record buffer, returning true if an upload was
+// in progress
+// --------------------------------------------------------
+bool Emitter::EndParticleUpload()
+{
+	if (!mappedRecords)
+		return false;
+
+	Graphics::Context->Unmap(particleRecordBuffer.Get(), 0);
+	mappedRecords = 0;
+	return true;
 }
 
 void Emitter::CopyParticlesToGPU(std::shared_ptr<Camera> camera)
@@ -303,22 +647,28 @@ void Emitter::CopyParticlesToGPU(std::shared_ptr<Camera> camera)
 void Emitter::CopyOneParticle(int index, std::shared_ptr<Camera> camera)
 {
 	int i = index * 4;
+	int p = GetPoolIndex(index);
 
 	localParticleVertices[i + 0].Position = CalcParticleVertexPosition(index, 0, camera);
 	localParticleVertices[i + 1].Position = CalcParticleVertexPosition(index, 1, camera);
 	localParticleVertices[i + 2].Position = CalcParticleVertexPosition(index, 2, camera);
 	localParticleVertices[i + 3].Position = CalcParticleVertexPosition(index, 3, camera);
 
-	localParticleVertices[i + 0].Color = particles[index].Color;
-	localParticleVertices[i + 1].Color = particles[index].Color;
-	localParticleVertices[i + 2].Color = particles[index].Color;
-	localParticleVertices[i + 3].Color = particles[index].Color;
+	XMFLOAT4 color(
+		particles->ColorR[p],
+		particles->ColorG[p],
+		particles->ColorB[p],
+		particles->ColorA[p]);
+	localParticleVertices[i + 0].Color = color;
+	localParticleVertices[i + 1].Color = color;
+	localParticleVertices[i + 2].Color = color;
+	localParticleVertices[i + 3].Color = color;
 
 	// If it's a spritesheet, we need to update UV coords as the particle ages
 	if (IsSpriteSheet())
 	{
 		// How old is this particle as a percentage
-		float agePercent = particles[index].Age / lifetime;
+		float agePercent = particles->Age[p] / lifetime;
 
 		// Which overall index?
 		int ssIndex = (int)floor(agePercent * (spriteSheetWidth * spriteSheetHeight));
@@ -341,6 +691,7 @@ void Emitter::CopyOneParticle(int index, std::shared_ptr<Camera> camera)
 
 XMFLOAT3 Emitter::CalcParticleVertexPosition(int particleIndex, int quadCornerIndex, std::shared_ptr<Camera> camera)
 {
+	int p = GetPoolIndex(particleIndex);
 	// Get the right and up vectors out of the view matrix
 	XMFLOAT4X4 view = camera->GetView();
 	XMVECTOR camRight = XMVectorSet(view._11, view._21, view._31, 0);
@@ -356,13 +707,18 @@ XMFLOAT3 Emitter::CalcParticleVertexPosition(int particleIndex, int quadCornerIn
 	// Load into a vector, which we'll assume is float3 with a Z of 0
 	// Create a Z rotation matrix and apply it to the offset
 	XMVECTOR offsetVec = XMLoadFloat2(&offset);
-	XMMATRIX rotMatrix = XMMatrixRotationZ(particles[particleIndex].Rotation);
+	XMMATRIX rotMatrix = XMMatrixRotationZ(particles->Rotation[p]);
 	offsetVec = XMVector3Transform(offsetVec, rotMatrix);
 
 	// Add and scale the camera up/right vectors to the position as necessary
-	XMVECTOR posVec = XMLoadFloat3(&particles[particleIndex].Position);
-	posVec += camRight * XMVectorGetX(offsetVec) * particles[particleIndex].Size;
-	posVec += camUp * XMVectorGetY(offsetVec) * particles[particleIndex].Size;
+	float size = particles->Size[p];
+	XMVECTOR posVec = XMVectorSet(
+		particles->PositionX[p],
+		particles->PositionY[p],
+		particles->PositionZ[p],
+		0);
+	posVec += camRight * XMVectorGetX(offsetVec) * size;
+	posVec += camUp * XMVectorGetY(offsetVec) * size;
 
 	// This position is all set
 	XMFLOAT3 pos;
@@ -374,9 +730,19 @@ XMFLOAT3 Emitter::CalcParticleVertexPosition(int particleIndex, int quadCornerIn
 
 void Emitter::Draw(std::shared_ptr<Camera> camera, bool debugWireframe)
 {
-	if (!visible)
+	// Finish the upload started by BeginParticleUpload(), if there was one
+	bool recordsUploaded = EndParticleUpload();
+
+	if (!visible || !PrepareParticlesForDraw(camera))
 		return;
 
+	// Let the GPU build the quads?
+	if (expandOnGPU && expansionVS)
+	{
+		DrawExpandedOnGPU(camera, debugWireframe, !recordsUploaded);
+		return;
+	}
+
 	// Copy to dynamic buffer
 	CopyParticlesToGPU(camera);
 
@@ -408,6 +774,274 @@ void Emitter::Draw(std::shared_ptr<Camera> camera, bool debugWireframe)
 }
 
 
+// --------------------------------------------------------
+// Draws the living particles by uploading one record per
+// particle and letting the vertex shader expand each one
+// into a camera-facing quad (no vertex buffer necessary)
+//
+// copyRecords - False if the records were already uploaded
+// --------------------------------------------------------
+void Emitter::DrawExpandedOnGPU(std::shared_ptr<Camera> camera, bool debugWireframe, bool copyRecords)
+{
+	if (livingParticleCount == 0)
+		return;
+
+	// Copy living particles to the structured buffer
+	if (copyRecords)
+		CopyParticleRecordsToGPU();
+
+	// Records are packed oldest first, so there's no wrapping to worry about
+	PrepareExpansionDraw(camera, debugWireframe);
+	Graphics::Context->DrawIndexed(livingParticleCount * 6, 0, 0);
+}
+
+
+// --------------------------------------------------------
+// Makes sure the particle data is ready to draw, returning
+// false if there's nothing to draw.  Emitters whose bounds are
+// outside the camera's frustum are skipped, and in closed-form
+// mode this is the only place particles are evaluated (once
+// per update, no matter how many times they're drawn).
+// --------------------------------------------------------
+bool Emitter::PrepareParticlesForDraw(std::shared_ptr<Camera> camera)
+{
+	culled = livingParticleCount == 0 || !IsInView(camera);
+	if (culled)
+		return false;
+
+	if (closedForm && needsEvaluation)
+	{
+		EvaluateLivingParticles();
+	}
+
+	return livingParticleCount > 0;
+}
+
+
+// --------------------------------------------------------
+// Calculates the emitter's world-space bounds, which cover
+// everywhere a particle could be over its whole lifetime, so
+// they only depend on the emitter's settings, not on its
+// particles
+// --------------------------------------------------------
+BoundingBox Emitter::CalculateWorldBounds()
+{
+	// Local bounds, one axis at a time
+	float startPos[3] = { positionRandomRange.x, positionRandomRange.y, positionRandomRange.z };
+	float startVel[3] = { startVelocity.x, startVelocity.y, startVelocity.z };
+	float velRange[3] = { velocityRandomRange.x, velocityRandomRange.y, velocityRandomRange.z };
+	float accel[3] = { emitterAcceleration.x, emitterAcceleration.y, emitterAcceleration.z };
+
+	float bounceReach = 0.0f;
+	if (collide && collisionResponse == CollisionResponse::Bounce && !closedForm)
+	{
+		float fastestSquared = 0.0f;
+		float accelSquared = 0.0f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float fastest = fabsf(startVel[axis]) + velRange[axis];
+			fastestSquared += fastest * fastest;
+			accelSquared += accel[axis] * accel[axis];
+		}
+		bounceReach = sqrtf(fastestSquared) * lifetime + sqrtf(accelSquared) * lifetime * lifetime * 0.5f;
+	}
+
+	XMFLOAT3 boundsMin, boundsMax;
+	float* mins = &boundsMin.x;
+	float* maxes = &boundsMax.x;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// Movement is linear in the starting velocity, so the extremes
+		// come from the fastest and slowest possible velocities, at the
+		// start or end of the lifetime, or where acceleration turns
+		// the particle around
+		float lo = 0.0f;
+		float hi = 0.0f;
+		for (float v : { startVel[axis] - velRange[axis], startVel[axis] + velRange[axis] })
+		{
+			float times[3] = { 0.0f, lifetime, 0.0f };
+			int timeCount = 2;
+			if (accel[axis] != 0.0f)
+			{
+				float turnaround = -v / accel[axis];
+				if (turnaround > 0.0f && turnaround < lifetime)
+					times[timeCount++] = turnaround;
+			}
+
+			for (int t = 0; t < timeCount; t++)
+			{
+				float offset = v * times[t] + accel[axis] * times[t] * times[t] * 0.5f;
+				lo = min(lo, offset);
+				hi = max(hi, offset);
+			}
+		}
+
+		// Bounces can turn particles in any direction, but never speed
+		// them up, so they can't go further than their fastest possible
+		// speed and the acceleration could take them
+		if (bounceReach > 0.0f)
+		{
+			lo = min(lo, -bounceReach);
+			hi = max(hi, bounceReach);
+		}
+
+		mins[axis] = lo - startPos[axis];
+		maxes[axis] = hi + startPos[axis];
+	}
+
+	// Quads can extend their size (rotated) in any direction
+	float sizeMargin = max(startSize, endSize) * budgetSizeScale * 1.4142136f;
+
+	// A force field could push particles in any direction, as far
+	// as its strongest vector could move them in a lifetime
+	ForceField* field = GetActiveForceField();
+	if (field)
+	{
+		float strongest = field->GetMaxMagnitude() * fabsf(forceFieldStrength);
+		sizeMargin += forceFieldMode == ForceFieldMode::Flow ?
+			strongest * lifetime :
+			strongest * lifetime * lifetime * 0.5f;
+	}
+	XMVECTOR margin = XMVectorReplicate(sizeMargin);
+	BoundingBox localBounds;
+	BoundingBox::CreateFromPoints(
+		localBounds,
+		XMLoadFloat3(&boundsMin) - margin,
+		XMLoadFloat3(&boundsMax) + margin);
+
+	XMFLOAT4X4 world = transform->GetWorldMatrix();
+	BoundingBox worldBounds;
+	localBounds.Transform(worldBounds, XMLoadFloat4x4(&world));
+	return worldBounds;
+}
+
+
+// --------------------------------------------------------
+// Checks the emitter's bounds against the camera's frustum
+// --------------------------------------------------------
+bool Emitter::IsInView(std::shared_ptr<Camera> camera)
+{
+	// Frustums are only built from perspective projections
+	if (camera->GetProjectionType() != CameraProjectionType::Perspective)
+		return true;
+
+	// Frustum in world space
+	XMFLOAT4X4 view = camera->GetView();
+	XMFLOAT4X4 proj = camera->GetProjection();
+	BoundingFrustum frustum;
+	BoundingFrustum::CreateFromMatrix(frustum, XMLoadFloat4x4(&proj));
+	frustum.Transform(frustum, XMMatrixInverse(0, XMLoadFloat4x4(&view)));
+
+	return frustum.Intersects(CalculateWorldBounds());
+}
+
+
+// --------------------------------------------------------
+// Sets up the pipeline for drawing records that have already
+// been uploaded, expanding them into quads on the GPU
+// --------------------------------------------------------
+void Emitter::PrepareExpansionDraw(std::shared_ptr<Camera> camera, bool debugWireframe)
+{
+	// No vertex buffer, but the regular index buffer still works,
+	// since it's already grouped into 4 vertices per particle
+	ID3D11Buffer* nullBuffer = 0;
+	UINT stride = 0;
+	UINT offset = 0;
+	Graphics::Context->IASetVertexBuffers(0, 1, &nullBuffer, &stride, &offset);
+	Graphics::Context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+
+	// Let the material set up the pixel shader and its resources,
+	// then swap in the expansion vertex shader
+	material->GetPixelShader()->SetInt("debugWireframe", (int)debugWireframe);
+	material->PrepareMaterial(transform, camera);
+
+	expansionVS->SetShader();
+	expansionVS->SetMatrix4x4("world", transform->GetWorldMatrix());
+	expansionVS->SetMatrix4x4("view", camera->GetView());
+	expansionVS->SetMatrix4x4("projection", camera->GetProjection());
+	expansionVS->SetFloat4("startColor", startColor);
+	expansionVS->SetFloat4("endColor", endColor);
+	expansionVS->SetInt("spriteSheetWidth", spriteSheetWidth);
+	expansionVS->SetInt("spriteSheetHeight", spriteSheetHeight);
+	expansionVS->SetFloat("spriteSheetFrameWidth", spriteSheetFrameWidth);
+	expansionVS->SetFloat("spriteSheetFrameHeight", spriteSheetFrameHeight);
+	expansionVS->SetInt("constrainYAxis", constrainYAxis);
+	expansionVS->CopyAllBufferData();
+	expansionVS->SetShaderResourceView("ParticleData", particleRecordSRV);
+}
+
+
+// --------------------------------------------------------
+// Adds this emitter's living particles to a (possibly
+// shared) sorter, using their depth from the given camera
+//
+// sorter       - The sorter to add particles to
+// emitterIndex - Identifies this emitter's particles once sorted
+// camera       - Camera whose view depth is used to sort
+// --------------------------------------------------------
+void Emitter::AddToSorter(ParticleSorter& sorter, unsigned int emitterIndex, std::shared_ptr<Camera> camera)
+{
+	// Sorted particles are always expanded on the GPU
+	if (!visible || !expansionVS || !PrepareParticlesForDraw(camera))
+		return;
+
+	// Particles are in the emitter's local space, so their view
+	// depth comes from the third column of world * view
+	XMFLOAT4X4 world = transform->GetWorldMatrix();
+	XMFLOAT4X4 view = camera->GetView();
+	XMFLOAT4X4 worldView;
+	XMStoreFloat4x4(&worldView, XMMatrixMultiply(XMLoadFloat4x4(&world), XMLoadFloat4x4(&view)));
+
+	float depthTransform[4] = { worldView._13, worldView._23, worldView._33, worldView._43 };
+	ForEachSegment(firstAliveIndex, livingParticleCount, [&](int poolStart, int count, int) {
+		sorter.AddParticles(*particles, poolStart, count, depthTransform, emitterIndex); });
+}
+
+
+// --------------------------------------------------------
+// Uploads this emitter's particles in the order the sorter
+// put them in (farthest first)
+// --------------------------------------------------------
+void Emitter::CopySortedParticleRecordsToGPU(const ParticleSorter& sorter, unsigned int emitterIndex)
+{
+	int count = sorter.GetEmitterParticleCount(emitterIndex);
+	if (count == 0)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	Graphics::Context->Map(particleRecordBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+
+	PackParticleRecordsInOrder(
+		*particles,
+		sorter.GetEmitterOrder(emitterIndex),
+		count,
+		lifetime,
+		(ParticleRecord*)mapped.pData);
+
+	Graphics::Context->Unmap(particleRecordBuffer.Get(), 0);
+}
+
+
+// --------------------------------------------------------
+// Draws a range of the sorted records uploaded by
+// CopySortedParticleRecordsToGPU().  When several emitters
+// overlap, each one is drawn in several pieces, interleaved
+// with the others' pieces, so every particle is drawn after
+// all of the particles behind it.
+//
+// firstRecord - Index of the first sorted record to draw
+// count       - How many records to draw
+// --------------------------------------------------------
+void Emitter::DrawSortedRange(std::shared_ptr<Camera> camera, bool debugWireframe, unsigned int firstRecord, unsigned int count)
+{
+	if (count == 0)
+		return;
+
+	PrepareExpansionDraw(camera, debugWireframe);
+	Graphics::Context->DrawIndexed(count * 6, firstRecord * 6, 0);
+}
+
+
 int Emitter::GetParticlesPerSecond()
 {
 	return particlesPerSecond;
@@ -436,7 +1070,171 @@ void Emitter::SetMaxParticles(int maxParticles)
 	firstDeadIndex = 0;
 }
 
+BoundingSphere Emitter::GetWorldBoundingSphere()
+{
+	BoundingSphere sphere;
+	BoundingSphere::CreateFromBoundingBox(sphere, CalculateWorldBounds());
+	return sphere;
+}
+
+// --------------------------------------------------------
+// Applies this frame's share of the global particle budget
+//
+// rateScale     - Multiplier for the emission rate
+// sizeScale     - Multiplier for particle sizes
+// particleLimit - Most particles allowed alive at once
+// --------------------------------------------------------
+void Emitter::SetBudget(float rateScale, float sizeScale, int particleLimit)
+{
+	budgetRateScale = rateScale;
+	budgetSizeScale = sizeScale;
+	budgetParticleLimit = particleLimit;
+}
+
+float Emitter::GetBudgetRateScale() { return budgetRateScale; }
+float Emitter::GetBudgetSizeScale() { return budgetSizeScale; }
+
+// Time between spawns, after the budget's adjustment
+float Emitter::GetEmitInterval()
+{
+	return secondsPerParticle / max(budgetRateScale, 0.01f);
+}
+
+float Emitter::GetTime()
+{
+	return totalEmitterTime;
+}
+
+bool Emitter::IsCulled()
+{
+	return culled;
+}
+
+int Emitter::GetLivingParticleCount()
+{
+	return livingParticleCount;
+}
+
 bool Emitter::IsSpriteSheet()
 {
 	return spriteSheetHeight > 1 || spriteSheetWidth > 1;
-}
\ No newline at end of file
+}
+unsigned int Emitter::GetRandomSeed()
+{
+	return randomSeed;
+}
+
+void Emitter::SetRandomSeed(unsigned int seed)
+{
+	randomSeed = seed;
+
+	// Each stream gets its own seed, derived from the emitter's
+	unsigned long long base = (unsigned long long)seed << 8;
+	positionRandom[0].Seed(base + 0);
+	positionRandom[1].Seed(base + 1);
+	positionRandom[2].Seed(base + 2);
+	velocityRandom[0].Seed(base + 3);
+	velocityRandom[1].Seed(base + 4);
+	velocityRandom[2].Seed(base + 5);
+	rotationStartRandom.Seed(base + 6);
+	rotationEndRandom.Seed(base + 7);
+}
+
+
+// --------------------------------------------------------
+// Switches to a (usually shared) pool.  Particles can't move
+// between pools, so the emitter starts over empty.
+// --------------------------------------------------------
+void Emitter::SetParticlePool(std::shared_ptr<ParticlePool> pool)
+{
+	if (!pool || pool == this->pool)
+		return;
+
+	ReleaseAllBlocks();
+	this->pool = pool;
+	particles = &pool->Storage;
+	sharedPool = true;
+
+	livingParticleCount = 0;
+	firstAliveIndex = 0;
+	firstDeadIndex = 0;
+}
+
+void Emitter::SetColliders(std::shared_ptr<ParticleColliders> colliders)
+{
+	this->colliders = colliders;
+}
+
+int Emitter::GetLastCollisionCount()
+{
+	return lastCollisionCount;
+}
+
+int Emitter::GetBlockCount()
+{
+	int count = 0;
+	for (int block : blockTable)
+		count += block >= 0 ? 1 : 0;
+	return count;
+}
+
+
+// --------------------------------------------------------
+// Makes sure every slot in a range of the ring has a block,
+// returning how many slots (from the start of the range) do
+// --------------------------------------------------------
+int Emitter::AcquireBlocks(int firstSlot, int count)
+{
+	for (int i = 0; i < count; )
+	{
+		int slot = (firstSlot + i) % maxParticles;
+		int& block = blockTable[slot / ParticlePoolBlockSize];
+		if (block < 0)
+		{
+			block = pool->AcquireBlock();
+			if (block < 0)
+				return i;
+		}
+
+		// On to the start of the next block (or the end of the ring)
+		int blockEnd = min((slot / ParticlePoolBlockSize + 1) * ParticlePoolBlockSize, maxParticles);
+		i += blockEnd - slot;
+	}
+	return count;
+}
+
+
+// --------------------------------------------------------
+// Returns blocks that no longer hold any living particles.
+// Living particles are contiguous in the ring, so a block is
+// still in use if its first slot is alive or the first living
+// particle is somewhere inside it.
+// --------------------------------------------------------
+void Emitter::ReleaseUnusedBlocks()
+{
+	for (int b = 0; b < (int)blockTable.size(); b++)
+	{
+		if (blockTable[b] < 0)
+			continue;
+
+		int firstSlot = b * ParticlePoolBlockSize;
+		int endSlot = min(firstSlot + ParticlePoolBlockSize, maxParticles);
+		bool firstSlotAlive = (firstSlot - firstAliveIndex + maxParticles) % maxParticles < livingParticleCount;
+		bool containsFirstAlive = firstAliveIndex >= firstSlot && firstAliveIndex < endSlot;
+		if (livingParticleCount > 0 && (firstSlotAlive || containsFirstAlive))
+			continue;
+
+		pool->ReleaseBlock(blockTable[b]);
+		blockTable[b] = -1;
+	}
+}
+
+void Emitter::ReleaseAllBlocks()
+{
+	for (int& block : blockTable)
+	{
+		if (block >= 0)
+			pool->ReleaseBlock(block);
+		block = -1;
+	}
+}
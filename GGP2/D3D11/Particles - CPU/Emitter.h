@@ -2,26 +2,24 @@
 
 #include <d3d11.h>
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include <wrl/client.h>
 #include <memory>
+#include <vector>
 
 #include "Camera.h"
 #include "Material.h"
 #include "Transform.h"
 #include "SimpleShader.h"
-
-struct Particle
-{
-	DirectX::XMFLOAT4 Color;
-	DirectX::XMFLOAT3 StartPosition;
-	DirectX::XMFLOAT3 Position;
-	DirectX::XMFLOAT3 StartVelocity;
-	float Size;
-	float Age;
-	float RotationStart;
-	float RotationEnd;
-	float Rotation;
-};
+#include "ParticleSimulation.h"
+#include "ParticleSort.h"
+#include "ParticleRandom.h"
+#include "ParticleBudget.h"
+#include "ParticlePool.h"
+#include "ParticleRing.h"
+#include "JobSystem.h"
+#include "ForceField.h"
+#include "ParticleCollision.h"
 
 struct ParticleVertex
 {
@@ -30,6 +28,38 @@ struct ParticleVertex
 	DirectX::XMFLOAT4 Color;
 };
 
+// Options for drawing all emitters, shared by the UI
+struct DemoParticleOptions
+{
+	bool SortParticles;		// Draw back to front, across all emitters
+	bool AlphaBlend;		// Regular alpha blending instead of additive
+	bool SixteenBitSortKeys;
+
+	// Results of the most recent sort
+	int SortedParticleCount;
+	int SortedDrawCount;
+	float SortTimeMS;
+
+	// Global budget, shared between emitters
+	bool UseBudget;
+	int BudgetMaxParticles;
+	float BudgetMaxSizeScale;
+
+	// Results of the most recent budget allocation
+	int LiveParticleCount;
+	int BudgetDemand;
+	int BudgetGranted;
+
+	// Shared particle pool usage
+	int PoolBlockCount;
+	int PoolFreeBlockCount;
+
+	// Updating and uploading emitters on the job system
+	bool ParallelUpdate;
+	int ThreadCount;
+	float UpdateTimeMS;
+};
+
 class Emitter
 {
 public:
@@ -58,14 +88,28 @@ public:
 	);
 	~Emitter();
 
-	void Update(float dt);
+	// Large emitters split their particles across jobs, if given a
+	// job system.  Separate emitters can update at the same time.
+	void Update(float dt, JobSystem* jobs = 0);
 	void Draw(
 		std::shared_ptr<Camera> camera,
 		bool debugWireframe);
 
+	// Uploading the particles for the next Draw() ahead of time, so
+	// every emitter's upload can be written in parallel.  Begin on
+	// the main thread (it maps the buffer), then write on any thread.
+	bool BeginParticleUpload(std::shared_ptr<Camera> camera);
+	void WriteParticleUpload(JobSystem* jobs = 0);
+
+	// Back-to-front sorted drawing, shared between emitters
+	void AddToSorter(ParticleSorter& sorter, unsigned int emitterIndex, std::shared_ptr<Camera> camera);
+	void CopySortedParticleRecordsToGPU(const ParticleSorter& sorter, unsigned int emitterIndex);
+	void DrawSortedRange(std::shared_ptr<Camera> camera, bool debugWireframe, unsigned int firstRecord, unsigned int count);
+
 	std::shared_ptr<Transform> GetTransform();
 	std::shared_ptr<Material> GetMaterial();
 	void SetMaterial(std::shared_ptr<Material> material);
+	void SetExpansionVertexShader(std::shared_ptr<SimpleVertexShader> vs);
 
 	// Lifetime and emission
 	float lifetime;
@@ -73,11 +117,51 @@ public:
 	void SetParticlesPerSecond(int particlesPerSecond);
 	int GetMaxParticles();
 	void SetMaxParticles(int maxParticles);
+	int GetLivingParticleCount();
+
+	// Seed for all of this emitter's randomization (restarts its
+	// random streams, so the same seed spawns the same particles)
+	unsigned int GetRandomSeed();
+	void SetRandomSeed(unsigned int seed);
+
+	// Emitter time, which can be scrubbed back and forth
+	float GetTime();
+	void SetTime(float time);
+	void FastForward(float seconds);
+
+	// Were the emitter's bounds outside the view last time it was drawn?
+	bool IsCulled();
+	DirectX::BoundingSphere GetWorldBoundingSphere();
+
+	// Particle memory, which can be shared between emitters
+	void SetParticlePool(std::shared_ptr<ParticlePool> pool);
+	int GetBlockCount();
+
+	// Share of the global particle budget
+	void SetBudget(float rateScale, float sizeScale, int particleLimit);
+	float GetBudgetRateScale();
+	float GetBudgetSizeScale();
 
 	// Emitter-level data (this is the same for all particles)
 	DirectX::XMFLOAT3 emitterAcceleration;
 	DirectX::XMFLOAT3 startVelocity;
 
+	// Force field pushing the particles around, by handle (see
+	// ForceFields), or -1 for none.  Fields need particles to be
+	// updated step by step, so they're ignored in closed-form mode.
+	int forceField;
+	float forceFieldStrength;
+	ForceFieldMode forceFieldMode;
+
+	// Collisions with the scene's colliders, which also need particles
+	// to be updated step by step (so they're skipped in closed-form mode)
+	void SetColliders(std::shared_ptr<ParticleColliders> colliders);
+	bool collide;
+	CollisionResponse collisionResponse;
+	float restitution;
+	float friction;
+	int GetLastCollisionCount();
+
 	// Particle visual data (interpolated
 	DirectX::XMFLOAT4 startColor;
 	DirectX::XMFLOAT4 endColor;
@@ -86,6 +170,8 @@ public:
 	bool constrainYAxis;
 	bool paused;
 	bool visible;
+	bool expandOnGPU;
+	bool closedForm;	// Evaluate particles from their spawn data only when drawn
 
 	// Particle randomization ranges
 	DirectX::XMFLOAT3 positionRandomRange;
@@ -103,6 +189,12 @@ private:
 	int maxParticles;
 	int particlesPerSecond;
 	float secondsPerParticle;
+	float GetEmitInterval();
+
+	// Budget adjustments
+	float budgetRateScale;
+	float budgetSizeScale;
+	int budgetParticleLimit;
 	float timeSinceLastEmit;
 	float totalEmitterTime;
 
@@ -114,11 +206,33 @@ private:
 
 	DirectX::XMFLOAT2 DefaultUVs[4];
 
-	// Particle array
-	Particle* particles;
+	// Particle data (structure of arrays) comes from a pool, in
+	// blocks.  The emitter's particles are still a ring of
+	// maxParticles slots, but each block-sized piece of the ring
+	// maps to whichever pool block it was given (or -1 for none).
+	std::shared_ptr<ParticlePool> pool;
+	ParticleStorage* particles;
+	bool sharedPool;
+	std::vector<int> blockTable;
+	int AcquireBlocks(int firstSlot, int count);
+	void ReleaseUnusedBlocks();
+	void ReleaseAllBlocks();
+
+	// The ring of slots, mapped through the block table (see ParticleRing.h)
+	ParticleRing GetRing() const { return ParticleRing(blockTable, maxParticles); }
+	int GetPoolIndex(int slot) const { return GetRing().GetPoolIndex(slot); }
+
+	template<typename Func>
+	void ForEachSegment(int firstSlot, int count, Func func) const { GetRing().ForEachSegment(firstSlot, count, func); }
+
+	template<typename Func>
+	void ForEachChunk(int firstSlot, int count, JobSystem* jobs, Func func) const { GetRing().ForEachChunk(firstSlot, count, jobs, func); }
+
 	int firstDeadIndex;
 	int firstAliveIndex;
 	int livingParticleCount;
+	bool needsEvaluation;
+	bool culled;
 	void CreateParticlesAndGPUResources();
 
 	// Rendering
@@ -126,17 +240,50 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
 
+	// Rendering with quads expanded on the GPU
+	Microsoft::WRL::ComPtr<ID3D11Buffer> particleRecordBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> particleRecordSRV;
+	ParticleRecord* mappedRecords;	// Set between BeginParticleUpload() and the next Draw()
+	bool EndParticleUpload();
+	std::shared_ptr<SimpleVertexShader> expansionVS;
+
+	// Colliders, and the ones near enough to matter this frame
+	std::shared_ptr<ParticleColliders> colliders;
+	NearbyColliders nearbyColliders;
+	int lastCollisionCount;
+
 	// Material & transform
 	std::shared_ptr<Transform> transform;
 	std::shared_ptr<Material> material;
 
+	// Randomization, with one stream per randomized attribute, so
+	// each particle's values don't depend on how spawns are batched
+	unsigned int randomSeed;
+	ParticleRandom positionRandom[3];
+	ParticleRandom velocityRandom[3];
+	ParticleRandom rotationStartRandom;
+	ParticleRandom rotationEndRandom;
+
 	// Update Methods
-	void UpdateSingleParticle(float dt, int index);
-	void SpawnParticle();
+	ParticleUpdateParams GetUpdateParams(float dt);
+	ForceField* GetActiveForceField();
+	bool FindNearbyColliders();
+	void RetireExpiredParticles();
+	void EvaluateLivingParticles(JobSystem* jobs = 0);
+	void SpawnParticles(int count, float firstSpawnTime);
+	void SpawnParticleRange(int first, int count, float firstSpawnTime);
 
 	// Copy methods
+	void CopyParticleRecordsToGPU();
 	void CopyParticlesToGPU(std::shared_ptr<Camera> camera);
 	void CopyOneParticle(int index, std::shared_ptr<Camera> camera);
 	DirectX::XMFLOAT3 CalcParticleVertexPosition(int particleIndex, int quadCornerIndex, std::shared_ptr<Camera> camera);
+
+	// Draw methods
+	bool PrepareParticlesForDraw(std::shared_ptr<Camera> camera);
+	bool IsInView(std::shared_ptr<Camera> camera);
+	DirectX::BoundingBox CalculateWorldBounds();
+	void DrawExpandedOnGPU(std::shared_ptr<Camera> camera, bool debugWireframe, bool copyRecords);
+	void PrepareExpansionDraw(std::shared_ptr<Camera> camera, bool debugWireframe);
 };
 
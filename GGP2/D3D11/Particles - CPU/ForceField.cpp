@@ -0,0 +1,560 @@
+#include "ForceField.h"
+#include "ParticleRandom.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+// --------------------------------------------------------
+// Binary field files are a header followed by the vectors,
+// 3 components per grid point in x-major order.  Components
+// are stored as signed 16-bit fractions of the header's
+// scale (the longest vector's length), which is half the
+// size of floats and plenty precise for forces.  Everything
+// is little-endian, as on x86/x64.
+// --------------------------------------------------------
+struct ForceFieldFileHeader
+{
+	char Magic[4];			// "VFLD"
+	unsigned int Version;
+	int Size[3];
+	float BoundsMin[3];
+	float BoundsMax[3];
+	float Scale;
+};
+
+static const char FileMagic[4] = { 'V', 'F', 'L', 'D' };
+static const unsigned int FileVersion = 1;
+
+// Limits on grid sizes (mostly to reject broken files)
+static const int MaxAxisSize = 512;
+static const long long MaxPointCount = 16 * 1024 * 1024;
+
+
+ForceField::ForceField() :
+	size{ 0, 0, 0 },
+	boundsMin{ 0, 0, 0 },
+	boundsMax{ 0, 0, 0 },
+	toGrid{ 0, 0, 0 },
+	maxMagnitude(0.0f)
+{
+}
+
+int ForceField::GetSizeX() const { return size[0]; }
+int ForceField::GetSizeY() const { return size[1]; }
+int ForceField::GetSizeZ() const { return size[2]; }
+float ForceField::GetMaxMagnitude() const { return maxMagnitude; }
+
+
+// --------------------------------------------------------
+// Sets up the grid, with every vector zeroed
+// --------------------------------------------------------
+void ForceField::Allocate(int sizeX, int sizeY, int sizeZ, const float boundsMin[3], const float boundsMax[3])
+{
+	int sizes[3] = { sizeX, sizeY, sizeZ };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		size[axis] = std::clamp(sizes[axis], 2, MaxAxisSize);
+		this->boundsMin[axis] = boundsMin[axis];
+		this->boundsMax[axis] = std::max(boundsMax[axis], boundsMin[axis] + 0.001f);
+		toGrid[axis] = (size[axis] - 1) / (this->boundsMax[axis] - this->boundsMin[axis]);
+	}
+
+	vectors.assign((size_t)size[0] * size[1] * size[2] * 4, 0.0f);
+	maxMagnitude = 0.0f;
+}
+
+void ForceField::SetVector(int x, int y, int z, const float vector[3])
+{
+	float* v = &vectors[GetIndex(x, y, z) * 4];
+	v[0] = vector[0];
+	v[1] = vector[1];
+	v[2] = vector[2];
+	maxMagnitude = std::max(maxMagnitude, std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]));
+}
+
+void ForceField::GetVector(int x, int y, int z, float vector[3]) const
+{
+	const float* v = &vectors[GetIndex(x, y, z) * 4];
+	vector[0] = v[0];
+	vector[1] = v[1];
+	vector[2] = v[2];
+}
+
+void ForceField::UpdateMaxMagnitude()
+{
+	maxMagnitude = 0.0f;
+	for (size_t i = 0; i < vectors.size(); i += 4)
+	{
+		float lengthSquared = vectors[i] * vectors[i] + vectors[i + 1] * vectors[i + 1] + vectors[i + 2] * vectors[i + 2];
+		maxMagnitude = std::max(maxMagnitude, std::sqrt(lengthSquared));
+	}
+}
+
+
+// --------------------------------------------------------
+// Improved Perlin noise, with its permutation shuffled by a
+// seed so separate seeds give unrelated noise
+// --------------------------------------------------------
+struct GradientNoise
+{
+	unsigned char perm[512];
+
+	GradientNoise(unsigned long long seed)
+	{
+		for (int i = 0; i < 256; i++)
+			perm[i] = (unsigned char)i;
+
+		ParticleRandom random(seed);
+		for (int i = 255; i > 0; i--)
+			std::swap(perm[i], perm[random.NextUInt() % (i + 1)]);
+
+		for (int i = 0; i < 256; i++)
+			perm[256 + i] = perm[i];
+	}
+
+	static float Fade(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+	static float Lerp(float a, float b, float t) { return a + t * (b - a); }
+	static float Gradient(int hash, float x, float y, float z)
+	{
+		int h = hash & 15;
+		float u = h < 8 ? x : y;
+		float v = h < 4 ? y : (h == 12 || h == 14 ? x : z);
+		return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+	}
+
+	float Noise(float x, float y, float z) const
+	{
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		float fz = std::floor(z);
+		int X = (int)fx & 255;
+		int Y = (int)fy & 255;
+		int Z = (int)fz & 255;
+		x -= fx;
+		y -= fy;
+		z -= fz;
+
+		float u = Fade(x);
+		float v = Fade(y);
+		float w = Fade(z);
+
+		int A = perm[X] + Y, AA = perm[A] + Z, AB = perm[A + 1] + Z;
+		int B = perm[X + 1] + Y, BA = perm[B] + Z, BB = perm[B + 1] + Z;
+
+		return Lerp(
+			Lerp(
+				Lerp(Gradient(perm[AA], x, y, z), Gradient(perm[BA], x - 1, y, z), u),
+				Lerp(Gradient(perm[AB], x, y - 1, z), Gradient(perm[BB], x - 1, y - 1, z), u), v),
+			Lerp(
+				Lerp(Gradient(perm[AA + 1], x, y, z - 1), Gradient(perm[BA + 1], x - 1, y, z - 1), u),
+				Lerp(Gradient(perm[AB + 1], x, y - 1, z - 1), Gradient(perm[BB + 1], x - 1, y - 1, z - 1), u), v),
+			w);
+	}
+};
+
+
+// --------------------------------------------------------
+// Bakes curl noise: three noise values at each grid point
+// form a "potential", and the field is that potential's curl
+// (measured across neighboring grid points).  A curl has no
+// sources or sinks, so particles swirl around rather than
+// bunching up or spreading out.
+//
+// frequency - Noise features per world unit
+// seed      - Which noise to use
+// --------------------------------------------------------
+void ForceField::BakeCurlNoise(float frequency, unsigned int seed)
+{
+	size_t pointCount = (size_t)size[0] * size[1] * size[2];
+	if (pointCount == 0)
+		return;
+
+	// One noise per potential component
+	std::vector<float> potential[3];
+	for (int c = 0; c < 3; c++)
+	{
+		GradientNoise noise(((unsigned long long)seed << 2) + c);
+		potential[c].resize(pointCount);
+		for (int z = 0; z < size[2]; z++)
+			for (int y = 0; y < size[1]; y++)
+				for (int x = 0; x < size[0]; x++)
+				{
+					float wx = boundsMin[0] + x / toGrid[0];
+					float wy = boundsMin[1] + y / toGrid[1];
+					float wz = boundsMin[2] + z / toGrid[2];
+					potential[c][GetIndex(x, y, z)] = noise.Noise(wx * frequency, wy * frequency, wz * frequency);
+				}
+	}
+
+	// Derivative of one potential component along one axis, using
+	// the neighbors on both sides (or one side at the edges)
+	auto derivative = [&](int c, int axis, int x, int y, int z)
+	{
+		int p[3] = { x, y, z };
+		int lo[3] = { x, y, z };
+		int hi[3] = { x, y, z };
+		lo[axis] = std::max(p[axis] - 1, 0);
+		hi[axis] = std::min(p[axis] + 1, size[axis] - 1);
+
+		float difference = potential[c][GetIndex(hi[0], hi[1], hi[2])] - potential[c][GetIndex(lo[0], lo[1], lo[2])];
+		return difference * toGrid[axis] / (hi[axis] - lo[axis]);
+	};
+
+	for (int z = 0; z < size[2]; z++)
+		for (int y = 0; y < size[1]; y++)
+			for (int x = 0; x < size[0]; x++)
+			{
+				float* v = &vectors[GetIndex(x, y, z) * 4];
+				v[0] = derivative(2, 1, x, y, z) - derivative(1, 2, x, y, z);
+				v[1] = derivative(0, 2, x, y, z) - derivative(2, 0, x, y, z);
+				v[2] = derivative(1, 0, x, y, z) - derivative(0, 1, x, y, z);
+				v[3] = 0.0f;
+			}
+
+	// Normalize so strength is up to the emitter
+	UpdateMaxMagnitude();
+	if (maxMagnitude > 0.0f)
+	{
+		float scale = 1.0f / maxMagnitude;
+		for (float& f : vectors)
+			f *= scale;
+		maxMagnitude = 1.0f;
+	}
+}
+
+
+// --------------------------------------------------------
+// Bakes a swirl around the vertical axis through the center
+// of the bounds.  Speed grows toward the edge of the bounds,
+// and the lift fades out toward it.
+//
+// lift - Upward speed at the center
+// --------------------------------------------------------
+void ForceField::BakeVortex(float lift)
+{
+	float centerX = (boundsMin[0] + boundsMax[0]) * 0.5f;
+	float centerZ = (boundsMin[2] + boundsMax[2]) * 0.5f;
+	float radius = std::max(boundsMax[0] - centerX, boundsMax[2] - centerZ);
+
+	for (int z = 0; z < size[2]; z++)
+		for (int y = 0; y < size[1]; y++)
+			for (int x = 0; x < size[0]; x++)
+			{
+				float dx = (boundsMin[0] + x / toGrid[0] - centerX) / radius;
+				float dz = (boundsMin[2] + z / toGrid[2] - centerZ) / radius;
+				float distance = std::sqrt(dx * dx + dz * dz);
+
+				float* v = &vectors[GetIndex(x, y, z) * 4];
+				v[0] = -dz;
+				v[1] = lift * std::max(1.0f - distance, 0.0f);
+				v[2] = dx;
+				v[3] = 0.0f;
+			}
+
+	UpdateMaxMagnitude();
+}
+
+
+// --------------------------------------------------------
+// Finds which grid cell a position is in along one axis, and
+// how far across the cell it is.  Positions are clamped to
+// the grid, and the last cell includes its far edge.  The SSE
+// kernel below performs exactly the same operations.
+// --------------------------------------------------------
+static inline void GridCoordinate(float position, float offset, float boundsMin, float toGrid, int size, int& cell, float& fraction)
+{
+	float u = (position + offset - boundsMin) * toGrid;
+	u = u > 0.0f ? u : 0.0f;
+	u = u < (float)(size - 1) ? u : (float)(size - 1);
+
+	float c = (float)(int)u;
+	c = c < (float)(size - 2) ? c : (float)(size - 2);
+
+	cell = (int)c;
+	fraction = u - c;
+}
+
+static inline float Lerp(float a, float b, float t) { return a + t * (b - a); }
+
+// Trilinear interpolation of one component between the 8 grid
+// points around a cell (strides are in floats)
+static inline float TrilinearScalar(const float* c, int strideY, int strideZ, float fx, float fy, float fz)
+{
+	float x00 = Lerp(c[0], c[4], fx);
+	float x10 = Lerp(c[strideY], c[strideY + 4], fx);
+	float x01 = Lerp(c[strideZ], c[strideZ + 4], fx);
+	float x11 = Lerp(c[strideY + strideZ], c[strideY + strideZ + 4], fx);
+	return Lerp(Lerp(x00, x10, fy), Lerp(x01, x11, fy), fz);
+}
+
+static inline __m128 LerpSSE(__m128 a, __m128 b, __m128 t) { return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a))); }
+
+// Same as above, for all 3 components (and padding) at once
+static inline __m128 TrilinearSSE(const float* c, int strideY, int strideZ, float fx, float fy, float fz)
+{
+	__m128 tx = _mm_set1_ps(fx);
+	__m128 x00 = LerpSSE(_mm_loadu_ps(c), _mm_loadu_ps(c + 4), tx);
+	__m128 x10 = LerpSSE(_mm_loadu_ps(c + strideY), _mm_loadu_ps(c + strideY + 4), tx);
+	__m128 x01 = LerpSSE(_mm_loadu_ps(c + strideZ), _mm_loadu_ps(c + strideZ + 4), tx);
+	__m128 x11 = LerpSSE(_mm_loadu_ps(c + strideY + strideZ), _mm_loadu_ps(c + strideY + strideZ + 4), tx);
+
+	__m128 ty = _mm_set1_ps(fy);
+	return LerpSSE(LerpSSE(x00, x10, ty), LerpSSE(x01, x11, ty), _mm_set1_ps(fz));
+}
+
+
+void ForceField::Sample(const float position[3], float result[3]) const
+{
+	if (vectors.empty())
+	{
+		result[0] = result[1] = result[2] = 0.0f;
+		return;
+	}
+
+	int cell[3];
+	float fraction[3];
+	for (int axis = 0; axis < 3; axis++)
+		GridCoordinate(position[axis], 0.0f, boundsMin[axis], toGrid[axis], size[axis], cell[axis], fraction[axis]);
+
+	const float* c = &vectors[GetIndex(cell[0], cell[1], cell[2]) * 4];
+	int strideY = size[0] * 4;
+	int strideZ = size[0] * size[1] * 4;
+	for (int i = 0; i < 3; i++)
+		result[i] = TrilinearScalar(c + i, strideY, strideZ, fraction[0], fraction[1], fraction[2]);
+}
+
+
+// --------------------------------------------------------
+// Moves one particle through the field by one step
+// --------------------------------------------------------
+static inline void ApplyToOneParticle(ParticleStorage& s, int i, const ForceField& field, const ForceFieldParams& p, float scale)
+{
+	float v[3];
+	float position[3] = { s.PositionX[i] + p.Offset[0], s.PositionY[i] + p.Offset[1], s.PositionZ[i] + p.Offset[2] };
+	field.Sample(position, v);
+
+	if (p.Mode == ForceFieldMode::Flow)
+	{
+		s.StartPositionX[i] = s.StartPositionX[i] + v[0] * scale;
+		s.StartPositionY[i] = s.StartPositionY[i] + v[1] * scale;
+		s.StartPositionZ[i] = s.StartPositionZ[i] + v[2] * scale;
+	}
+	else
+	{
+		s.FieldVelocityX[i] = s.FieldVelocityX[i] + v[0] * scale;
+		s.FieldVelocityY[i] = s.FieldVelocityY[i] + v[1] * scale;
+		s.FieldVelocityZ[i] = s.FieldVelocityZ[i] + v[2] * scale;
+		s.StartPositionX[i] = s.StartPositionX[i] + s.FieldVelocityX[i] * p.DeltaTime;
+		s.StartPositionY[i] = s.StartPositionY[i] + s.FieldVelocityY[i] * p.DeltaTime;
+		s.StartPositionZ[i] = s.StartPositionZ[i] + s.FieldVelocityZ[i] * p.DeltaTime;
+	}
+}
+
+void ApplyForceFieldScalar(ParticleStorage& storage, int first, int count, const ForceField& field, const ForceFieldParams& params)
+{
+	float scale = params.Strength * params.DeltaTime;
+	for (int i = first; i < first + count; i++)
+		ApplyToOneParticle(storage, i, field, params, scale);
+}
+
+
+// --------------------------------------------------------
+// SSE kernel.  Grid coordinates for 4 particles are found at
+// once, then each particle's 8 surrounding vectors are
+// blended with all 3 components side by side, and the 4
+// results are transposed back into x, y and z registers.
+// --------------------------------------------------------
+void ApplyForceField(ParticleStorage& storage, int first, int count, const ForceField& field, const ForceFieldParams& params)
+{
+	if (count <= 0 || field.vectors.empty())
+		return;
+
+	ParticleStorage& s = storage;
+	const ForceFieldParams& p = params;
+	float scale = p.Strength * p.DeltaTime;
+
+	int strideY = field.size[0] * 4;
+	int strideZ = field.size[0] * field.size[1] * 4;
+	const float* vectors = field.vectors.data();
+
+	float* positions[3] = { s.PositionX, s.PositionY, s.PositionZ };
+	float* starts[3] = { s.StartPositionX, s.StartPositionY, s.StartPositionZ };
+	float* velocities[3] = { s.FieldVelocityX, s.FieldVelocityY, s.FieldVelocityZ };
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 scale4 = _mm_set1_ps(scale);
+	__m128 dt4 = _mm_set1_ps(p.DeltaTime);
+
+	int end = first + count;
+	int i = first;
+	for (; i + 4 <= end; i += 4)
+	{
+		// Grid coordinates along each axis for all 4 particles
+		alignas(16) float cells[3][4];
+		alignas(16) float fractions[3][4];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128 u = _mm_add_ps(_mm_loadu_ps(positions[axis] + i), _mm_set1_ps(p.Offset[axis]));
+			u = _mm_mul_ps(_mm_sub_ps(u, _mm_set1_ps(field.boundsMin[axis])), _mm_set1_ps(field.toGrid[axis]));
+			u = _mm_max_ps(u, zero);
+			u = _mm_min_ps(u, _mm_set1_ps((float)(field.size[axis] - 1)));
+
+			__m128 c = _mm_cvtepi32_ps(_mm_cvttps_epi32(u));
+			c = _mm_min_ps(c, _mm_set1_ps((float)(field.size[axis] - 2)));
+
+			_mm_store_ps(cells[axis], c);
+			_mm_store_ps(fractions[axis], _mm_sub_ps(u, c));
+		}
+
+		// Blend each particle's surrounding vectors
+		__m128 v[4];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int index = field.GetIndex((int)cells[0][lane], (int)cells[1][lane], (int)cells[2][lane]);
+			v[lane] = TrilinearSSE(vectors + index * 4, strideY, strideZ, fractions[0][lane], fractions[1][lane], fractions[2][lane]);
+		}
+		_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+
+		// Move the particles
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128 start = _mm_loadu_ps(starts[axis] + i);
+			if (p.Mode == ForceFieldMode::Flow)
+			{
+				start = _mm_add_ps(start, _mm_mul_ps(v[axis], scale4));
+			}
+			else
+			{
+				__m128 velocity = _mm_add_ps(_mm_loadu_ps(velocities[axis] + i), _mm_mul_ps(v[axis], scale4));
+				_mm_storeu_ps(velocities[axis] + i, velocity);
+				start = _mm_add_ps(start, _mm_mul_ps(velocity, dt4));
+			}
+			_mm_storeu_ps(starts[axis] + i, start);
+		}
+	}
+
+	// Leftovers
+	for (; i < end; i++)
+		ApplyToOneParticle(s, i, field, p, scale);
+}
+
+
+// --------------------------------------------------------
+// Writes the field in the binary format described at the top
+// --------------------------------------------------------
+bool ForceField::Save(const std::filesystem::path& path) const
+{
+	if (vectors.empty())
+		return false;
+
+	ForceFieldFileHeader header = {};
+	memcpy(header.Magic, FileMagic, sizeof(FileMagic));
+	header.Version = FileVersion;
+	header.Scale = maxMagnitude > 0.0f ? maxMagnitude : 1.0f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		header.Size[axis] = size[axis];
+		header.BoundsMin[axis] = boundsMin[axis];
+		header.BoundsMax[axis] = boundsMax[axis];
+	}
+
+	// Quantize every component
+	size_t pointCount = vectors.size() / 4;
+	std::vector<short> quantized(pointCount * 3);
+	for (size_t i = 0; i < pointCount; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float q = std::round(vectors[i * 4 + c] / header.Scale * 32767.0f);
+			quantized[i * 3 + c] = (short)std::clamp(q, -32767.0f, 32767.0f);
+		}
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)quantized.data(), quantized.size() * sizeof(short));
+	return file.good();
+}
+
+
+// --------------------------------------------------------
+// Reads a field written by Save().  The field is left as it
+// was if the file is missing, isn't a field, or is cut short.
+// --------------------------------------------------------
+bool ForceField::Load(const std::filesystem::path& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	ForceFieldFileHeader header = {};
+	if (!file.read((char*)&header, sizeof(header)) ||
+		memcmp(header.Magic, FileMagic, sizeof(FileMagic)) != 0 ||
+		header.Version != FileVersion ||
+		!std::isfinite(header.Scale))
+		return false;
+
+	long long pointCount = 1;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (header.Size[axis] < 2 || header.Size[axis] > MaxAxisSize ||
+			!std::isfinite(header.BoundsMin[axis]) || !std::isfinite(header.BoundsMax[axis]) ||
+			header.BoundsMax[axis] <= header.BoundsMin[axis])
+			return false;
+		pointCount *= header.Size[axis];
+	}
+	if (pointCount > MaxPointCount)
+		return false;
+
+	std::vector<short> quantized((size_t)pointCount * 3);
+	if (!file.read((char*)quantized.data(), quantized.size() * sizeof(short)))
+		return false;
+
+	// Everything checks out - replace the current field
+	Allocate(header.Size[0], header.Size[1], header.Size[2], header.BoundsMin, header.BoundsMax);
+	for (size_t i = 0; i < (size_t)pointCount; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			vectors[i * 4 + c] = quantized[i * 3 + c] / 32767.0f * header.Scale;
+	}
+	UpdateMaxMagnitude();
+	return true;
+}
+
+
+namespace ForceFields
+{
+	// Annonymous namespace to hold variables
+	// only accessible in this file
+	namespace
+	{
+		struct NamedField
+		{
+			std::string Name;
+			std::shared_ptr<ForceField> Field;
+		};
+		std::vector<NamedField> fields;
+	}
+}
+
+int ForceFields::Add(const char* name, std::shared_ptr<ForceField> field)
+{
+	fields.push_back({ name, field });
+	return (int)fields.size() - 1;
+}
+
+ForceField* ForceFields::Get(int handle)
+{
+	return handle >= 0 && handle < (int)fields.size() ? fields[handle].Field.get() : 0;
+}
+
+const char* ForceFields::GetName(int handle)
+{
+	return handle >= 0 && handle < (int)fields.size() ? fields[handle].Name.c_str() : "None";
+}
+
+int ForceFields::GetCount() { return (int)fields.size(); }
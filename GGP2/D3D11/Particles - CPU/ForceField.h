@@ -0,0 +1,115 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "ParticleSimulation.h"
+
+// --------------------------------------------------------
+// A vector field baked into a 3D grid, for pushing CPU
+// particles around with more than a constant acceleration
+// (the CPU version of the compute demo's curl-noise flow).
+//
+// Grid points are spread evenly across the field's bounds,
+// with a vector at each one, and the field is sampled with
+// trilinear interpolation between the 8 nearest points.
+// Outside the bounds, the nearest edge of the grid is used.
+// Positions and bounds are in world space.
+//
+// Fields can be saved to and loaded from a compact binary
+// format (see ForceField.cpp), so expensive fields can be
+// baked once ahead of time.
+// --------------------------------------------------------
+
+// How particles respond to a force field
+enum class ForceFieldMode
+{
+	Flow,			// Field is a velocity - particles drift along it
+	Acceleration	// Field is a force - particles speed up along it
+};
+
+// Per-update values for ApplyForceField()
+struct ForceFieldParams
+{
+	float DeltaTime;
+	float Strength;			// Multiplier for the field's vectors
+	float Offset[3];		// Added to particle positions to get world positions
+	ForceFieldMode Mode;
+};
+
+class ForceField
+{
+public:
+	ForceField();
+
+	// Creates a grid of zero vectors (each axis needs at least 2 points)
+	void Allocate(int sizeX, int sizeY, int sizeZ, const float boundsMin[3], const float boundsMax[3]);
+
+	// Fills the grid with divergence-free curl noise, scaled so the
+	// longest vector has a length of 1
+	void BakeCurlNoise(float frequency, unsigned int seed);
+
+	// Fills the grid with a swirl around the vertical axis through the
+	// center of the bounds, with a bit of lift near the center
+	void BakeVortex(float lift);
+
+	// Direct access to one grid point's vector
+	void SetVector(int x, int y, int z, const float vector[3]);
+	void GetVector(int x, int y, int z, float vector[3]) const;
+
+	// Trilinear sample at a single world-space position (no SIMD)
+	void Sample(const float position[3], float result[3]) const;
+
+	// Binary files - returns false if the file couldn't be read or written
+	bool Save(const std::filesystem::path& path) const;
+	bool Load(const std::filesystem::path& path);
+
+	int GetSizeX() const;
+	int GetSizeY() const;
+	int GetSizeZ() const;
+	float GetMaxMagnitude() const;	// Length of the longest vector
+
+private:
+	friend void ApplyForceField(ParticleStorage&, int, int, const ForceField&, const ForceFieldParams&);
+
+	int size[3];
+	float boundsMin[3];
+	float boundsMax[3];
+	float toGrid[3];		// Scale from world units to grid points
+	float maxMagnitude;
+
+	// Vectors as (x, y, z, 0), so each one is a single SSE load, in
+	// x-major order (x changes fastest, then y, then z)
+	std::vector<float> vectors;
+
+	int GetIndex(int x, int y, int z) const { return x + size[0] * (y + size[1] * z); }
+	void UpdateMaxMagnitude();
+};
+
+// Moves count particles, starting at first (without wrapping),
+// through a field.  Flow fields move the particles' start
+// positions directly, as the compute demo does.  Acceleration
+// fields build up a velocity from the field (FieldVelocity), and
+// that moves the start positions.  Either way, the regular update
+// then adds the particles' own motion on top.
+//
+// Particles are sampled with SSE, 4 at a time.
+void ApplyForceField(ParticleStorage& storage, int first, int count, const ForceField& field, const ForceFieldParams& params);
+
+// Same as above, one particle at a time (no SIMD) - gives identical results
+void ApplyForceFieldScalar(ParticleStorage& storage, int first, int count, const ForceField& field, const ForceFieldParams& params);
+
+
+// --------------------------------------------------------
+// Fields shared by every emitter.  Emitters refer to fields
+// by handle (an index into this list, or -1 for none), so
+// they can be shown and swapped in the UI by name.
+// --------------------------------------------------------
+namespace ForceFields
+{
+	int Add(const char* name, std::shared_ptr<ForceField> field);
+	ForceField* Get(int handle);	// Null if there's no such field
+	const char* GetName(int handle);
+	int GetCount();
+}
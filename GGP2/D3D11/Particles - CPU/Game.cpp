@@ -26,6 +26,7 @@ using namespace DirectX;
 // Helper macro for getting a float between min and max
 #include <stdlib.h>     // For seeding random and rand()
 #include <time.h>       // For grabbing time (to seed random)
+#include <chrono>
 #define RandomRange(min, max) (float)rand() / RAND_MAX * (max - min) + min
 
 // --------------------------------------------------------
@@ -64,6 +65,27 @@ void Game::Initialize()
 		.AmbientColor = XMFLOAT3(0,0,0)
 	};
 
+	// Particles start out unsorted and additive
+	particleOptions = {
+		.SortParticles = false,
+		.AlphaBlend = false,
+		.SixteenBitSortKeys = false,
+		.SortedParticleCount = 0,
+		.SortedDrawCount = 0,
+		.SortTimeMS = 0.0f,
+		.UseBudget = false,
+		.BudgetMaxParticles = 2000,
+		.BudgetMaxSizeScale = 2.0f,
+		.LiveParticleCount = 0,
+		.BudgetDemand = 0,
+		.BudgetGranted = 0,
+		.PoolBlockCount = 0,
+		.PoolFreeBlockCount = 0,
+		.ParallelUpdate = true,
+		.ThreadCount = jobs.GetThreadCount(),
+		.UpdateTimeMS = 0.0f
+	};
+
 	// Set initial graphics API state
 	Graphics::Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
@@ -279,6 +301,7 @@ void Game::LoadAssetsAndCreateEntities()
 	// Grab loaded particle resources
 	std::shared_ptr<SimpleVertexShader> particleVS = std::make_shared<SimpleVertexShader>(Graphics::Device, Graphics::Context, FixPath(L"ParticleVS.cso").c_str());
 	std::shared_ptr<SimplePixelShader> particlePS = std::make_shared<SimplePixelShader>(Graphics::Device, Graphics::Context, FixPath(L"ParticlePS.cso").c_str());
+	std::shared_ptr<SimpleVertexShader> particleExpandVS = std::make_shared<SimpleVertexShader>(Graphics::Device, Graphics::Context, FixPath(L"ParticleExpandVS.cso").c_str());
 
 	// Create particle materials
 	std::shared_ptr<Material> fireParticle = std::make_shared<Material>("Fire Particle", particlePS, particleVS, XMFLOAT3(1, 1, 1));
@@ -380,6 +403,69 @@ void Game::LoadAssetsAndCreateEntities()
 		8,
 		8));
 
+	// Snowfall over the whole scene - the one emitter big enough
+	// (well past ParallelParticleThreshold) to have its particles
+	// split across the job system's threads
+	const int snowParticles = 40000;
+	emitters.push_back(std::make_shared<Emitter>(
+		snowParticles,					// Max particles
+		8000,							// Particles per second
+		5.0f,							// Particle lifetime
+		0.1f,							// Start size
+		0.1f,							// End size
+		false,							// Constrain Y Axis rotation
+		XMFLOAT4(0.6f, 0.6f, 0.7f, 1.0f),// Start color
+		XMFLOAT4(0.6f, 0.6f, 0.7f, 0.0f),// End color
+		XMFLOAT3(0, -2, 0),				// Start velocity
+		XMFLOAT3(0.5f, 0.2f, 0.5f),		// Velocity randomness range
+		XMFLOAT3(0, 8, 0),				// Emitter position
+		XMFLOAT3(10, 0, 10),			// Position randomness range
+		XMFLOAT2(-2, 2),				// Random rotation - startMin, startMax
+		XMFLOAT2(-2, 2),				// Random rotation - endMin, endMax
+		XMFLOAT3(0, -0.2f, 0),			// Constant acceleration
+		starParticle));
+
+	// Force fields that any emitter can be pushed through (chosen in
+	// the UI): curl noise, like the compute demo's flow, and a vortex
+	float fieldMin[3] = { -10, -10, -10 };
+	float fieldMax[3] = { 10, 10, 10 };
+	std::shared_ptr<ForceField> curlField = std::make_shared<ForceField>();
+	curlField->Allocate(40, 40, 40, fieldMin, fieldMax);
+	curlField->BakeCurlNoise(0.3f, 1);
+	ForceFields::Add("Curl Noise", curlField);
+
+	std::shared_ptr<ForceField> vortexField = std::make_shared<ForceField>();
+	vortexField->Allocate(24, 24, 24, fieldMin, fieldMax);
+	vortexField->BakeVortex(0.5f);
+	ForceFields::Add("Vortex", vortexField);
+
+	// Things particles can collide with (once it's turned on in the
+	// UI): the sphere entity, a floor, and some rolling terrain
+	particleColliders = std::make_shared<ParticleColliders>();
+	particleColliders->Spheres.push_back({ .Center = { -5, 0, 0 }, .Radius = 0.5f });
+	particleColliders->Planes.push_back({ .Normal = { 0, 1, 0 }, .Distance = -5.0f });
+
+	const int terrainSize = 41;
+	std::vector<float> terrainHeights(terrainSize * terrainSize);
+	for (int z = 0; z < terrainSize; z++)
+		for (int x = 0; x < terrainSize; x++)
+			terrainHeights[z * terrainSize + x] = 0.5f * sinf(x * 0.4f) * cosf(z * 0.3f);
+	float terrainPosition[3] = { 0, -3, 0 };
+	std::shared_ptr<Heightfield> terrain = std::make_shared<Heightfield>();
+	terrain->SetHeights(terrainHeights.data(), terrainSize, terrainSize, 0.5f, terrainPosition);
+	particleColliders->Heightfields.push_back(terrain);
+
+	// All emitters can expand their particles into quads on the GPU,
+	// and all of them share one pool of particle memory (with room
+	// for all of the snow, plus plenty to share between the rest)
+	particlePool = std::make_shared<ParticlePool>(64 + (snowParticles + ParticlePoolBlockSize - 1) / ParticlePoolBlockSize);
+	for (auto& e : emitters)
+	{
+		e->SetExpansionVertexShader(particleExpandVS);
+		e->SetParticlePool(particlePool);
+		e->SetColliders(particleColliders);
+	}
+
 	// Particle states ====
 
 	// A depth state for the particles
@@ -403,6 +489,12 @@ void Game::LoadAssetsAndCreateEntities()
 	blend.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
 	Graphics::Device->CreateBlendState(&blend, particleBlendState.GetAddressOf());
 
+	// Blend for sorted particles (regular alpha blending, which
+	// only looks right when particles are drawn back to front)
+	blend.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	blend.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+	Graphics::Device->CreateBlendState(&blend, particleAlphaBlendState.GetAddressOf());
+
 	// Debug rasterizer state for particles
 	D3D11_RASTERIZER_DESC rd = {};
 	rd.CullMode = D3D11_CULL_BACK;
@@ -531,7 +623,7 @@ void Game::Update(float deltaTime, float totalTime)
 	// this frame's interface.  Note that the building
 	// of the UI could happen at any point during update.
 	UINewFrame(deltaTime);
-	BuildUI(camera, meshes, entities, materials, emitters, lights, lightOptions);
+	BuildUI(camera, meshes, entities, materials, emitters, lights, lightOptions, particleOptions);
 
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::KeyDown(VK_ESCAPE))
@@ -546,10 +638,95 @@ void Game::Update(float deltaTime, float totalTime)
 	static bool firstFrame = true; // Only ever initialized once due to static
 	if (firstFrame) { deltaTime = 0.0f; firstFrame = false; }
 
-	// Update all emitters
+	// Share out the particle budget, then update all emitters
+	UpdateParticleBudget();
+	auto updateStart = std::chrono::high_resolution_clock::now();
+	ForEachEmitterInParallel([&](Emitter& e, JobSystem* emitterJobs) { e.Update(deltaTime, emitterJobs); });
+	auto updateEnd = std::chrono::high_resolution_clock::now();
+	particleOptions.UpdateTimeMS = std::chrono::duration<float, std::milli>(updateEnd - updateStart).count();
+}
+
+
+// --------------------------------------------------------
+// Runs some work on every emitter using the job system.  Most
+// emitters are small, so each one is a single job.  Large
+// emitters are worked on one at a time instead, with their
+// particles split across all of the threads.  Either way,
+// every emitter ends up with the same results it would have
+// had on one thread.
+// --------------------------------------------------------
+void Game::ForEachEmitterInParallel(const std::function<void(Emitter&, JobSystem*)>& work)
+{
+	if (!particleOptions.ParallelUpdate)
+	{
+		for (auto& e : emitters)
+			work(*e, 0);
+		return;
+	}
+
+	std::vector<Emitter*> smallEmitters;
+	for (auto& e : emitters)
+	{
+		if (e->GetLivingParticleCount() >= ParallelParticleThreshold)
+			work(*e, &jobs);
+		else
+			smallEmitters.push_back(e.get());
+	}
+
+	jobs.ParallelFor((int)smallEmitters.size(), [&](int i) { work(*smallEmitters[i], 0); });
+}
+
+
+// --------------------------------------------------------
+// Splits the global particle budget between the emitters
+// based on how much of the screen each one covers, or gives
+// every emitter everything it wants if the budget is off
+// --------------------------------------------------------
+void Game::UpdateParticleBudget()
+{
+	particleOptions.LiveParticleCount = 0;
 	for (auto& e : emitters)
+		particleOptions.LiveParticleCount += e->GetLivingParticleCount();
+	particleOptions.PoolBlockCount = particlePool->GetBlockCount();
+	particleOptions.PoolFreeBlockCount = particlePool->GetFreeBlockCount();
+
+	if (!particleOptions.UseBudget)
 	{
-		e->Update(deltaTime);
+		for (auto& e : emitters)
+			e->SetBudget(1.0f, 1.0f, e->GetMaxParticles());
+		particleOptions.BudgetDemand = 0;
+		particleOptions.BudgetGranted = 0;
+		return;
+	}
+
+	// Describe each emitter's needs and visibility
+	XMFLOAT3 camPos = camera->GetTransform()->GetPosition();
+	std::vector<ParticleBudgetRequest> requests(emitters.size());
+	std::vector<ParticleBudgetGrant> grants(emitters.size());
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		BoundingSphere bounds = emitters[i]->GetWorldBoundingSphere();
+		XMVECTOR toBounds = XMLoadFloat3(&bounds.Center) - XMLoadFloat3(&camPos);
+
+		requests[i].ParticlesPerSecond = (float)emitters[i]->GetParticlesPerSecond();
+		requests[i].Lifetime = emitters[i]->lifetime;
+		requests[i].MaxParticles = emitters[i]->GetMaxParticles();
+		requests[i].BoundsRadius = bounds.Radius;
+		requests[i].Distance = XMVectorGetX(XMVector3Length(toBounds));
+		requests[i].OnScreen = emitters[i]->visible && !emitters[i]->IsCulled();
+	}
+
+	ParticleBudgetSettings settings{};
+	settings.MaxLiveParticles = particleOptions.BudgetMaxParticles;
+	settings.MinRateScale = 0.1f;
+	settings.MaxSizeScale = particleOptions.BudgetMaxSizeScale;
+	particleOptions.BudgetGranted = AllocateParticleBudget(settings, requests.data(), grants.data(), (int)emitters.size());
+
+	particleOptions.BudgetDemand = 0;
+	for (size_t i = 0; i < emitters.size(); i++)
+	{
+		emitters[i]->SetBudget(grants[i].RateScale, grants[i].SizeScale, grants[i].ParticleLimit);
+		particleOptions.BudgetDemand += grants[i].Demand;
 	}
 }
 
@@ -632,22 +809,45 @@ void Game::DrawParticles()
 	{
 
 		// Particle states
-		Graphics::Context->OMSetBlendState(particleBlendState.Get(), 0, 0xffffffff);	// Additive blending
+		Graphics::Context->OMSetBlendState(
+			particleOptions.AlphaBlend ? particleAlphaBlendState.Get() : particleBlendState.Get(),	// Alpha or additive blending
+			0,
+			0xffffffff);
 		Graphics::Context->OMSetDepthStencilState(particleDepthState.Get(), 0);		// No depth WRITING
 
 		// Draw all of the emitters
-		for (auto& e : emitters)
+		if (particleOptions.SortParticles)
 		{
-			e->Draw(camera, false);
+			DrawSortedParticles(false);
+		}
+		else
+		{
+			// Mapping buffers needs the graphics API, so that happens
+			// here, but the particles are written to them in parallel
+			for (auto& e : emitters)
+				e->BeginParticleUpload(camera);
+			ForEachEmitterInParallel([](Emitter& e, JobSystem* emitterJobs) { e.WriteParticleUpload(emitterJobs); });
+
+			for (auto& e : emitters)
+			{
+				e->Draw(camera, false);
+			}
 		}
 
 		// Should we also draw them in wireframe?
 		if (Input::KeyDown('C'))
 		{
 			Graphics::Context->RSSetState(particleDebugRasterState.Get());
-			for (auto& e : emitters)
+			if (particleOptions.SortParticles)
+			{
+				DrawSortedParticles(true);
+			}
+			else
 			{
-				e->Draw(camera, true);
+				for (auto& e : emitters)
+				{
+					e->Draw(camera, true);
+				}
 			}
 		}
 
@@ -657,3 +857,44 @@ void Game::DrawParticles()
 		Graphics::Context->RSSetState(0);
 	}
 }
+
+
+// --------------------------------------------------------
+// Sorts the particles of all emitters together, farthest
+// first, and draws them in that order.  The sort only happens
+// for the regular (non-wireframe) pass, which uploads each
+// emitter's particles in sorted order; the wireframe pass
+// reuses those results.
+// --------------------------------------------------------
+void Game::DrawSortedParticles(bool debugWireframe)
+{
+	if (!debugWireframe)
+	{
+		auto sortStart = std::chrono::high_resolution_clock::now();
+
+		// Gather and sort every emitter's particles at once, so
+		// overlapping emitters interleave correctly
+		particleSorter.Clear();
+		for (unsigned int i = 0; i < emitters.size(); i++)
+			emitters[i]->AddToSorter(particleSorter, i, camera);
+		particleSorter.Sort(particleOptions.SixteenBitSortKeys ? 16 : 32);
+
+		auto sortEnd = std::chrono::high_resolution_clock::now();
+		particleOptions.SortTimeMS = std::chrono::duration<float, std::milli>(sortEnd - sortStart).count();
+		particleOptions.SortedParticleCount = particleSorter.GetCount();
+		particleOptions.SortedDrawCount = (int)particleSorter.GetRuns().size();
+
+		// Each emitter's records go up in its own part of the sorted order
+		for (unsigned int i = 0; i < particleSorter.GetEmitterCount(); i++)
+			emitters[i]->CopySortedParticleRecordsToGPU(particleSorter, i);
+	}
+
+	// Draw each run of same-emitter particles, keeping track of
+	// how far into each emitter's sorted records we are
+	std::vector<unsigned int> drawnPerEmitter(particleSorter.GetEmitterCount(), 0);
+	for (auto& run : particleSorter.GetRuns())
+	{
+		emitters[run.Emitter]->DrawSortedRange(camera, debugWireframe, drawnPerEmitter[run.Emitter], run.Count);
+		drawnPerEmitter[run.Emitter] += run.Count;
+	}
+}
@@ -4,6 +4,7 @@
 #include <wrl/client.h>
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include "Mesh.h"
 #include "GameEntity.h"
@@ -68,7 +69,16 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> particleDepthState;
 	Microsoft::WRL::ComPtr<ID3D11BlendState> particleBlendState;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> particleDebugRasterState;
+	Microsoft::WRL::ComPtr<ID3D11BlendState> particleAlphaBlendState;
 	std::vector<std::shared_ptr<Emitter>> emitters;
+	std::shared_ptr<ParticlePool> particlePool;
+	std::shared_ptr<ParticleColliders> particleColliders;
+	DemoParticleOptions particleOptions;
+	ParticleSorter particleSorter;
+	JobSystem jobs;
+	void ForEachEmitterInParallel(const std::function<void(Emitter&, JobSystem*)>& work);
+	void UpdateParticleBudget();
 	void DrawParticles();
+	void DrawSortedParticles(bool debugWireframe);
 };
 
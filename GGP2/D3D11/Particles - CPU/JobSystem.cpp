@@ -0,0 +1,110 @@
+#include "JobSystem.h"
+
+// Is this thread currently running jobs?
+static thread_local bool insideJob = false;
+
+
+// --------------------------------------------------------
+// Starts the workers, which sleep until there's a loop to run
+// --------------------------------------------------------
+JobSystem::JobSystem(int workerCount) :
+	job(0),
+	jobCount(0),
+	nextJob(0),
+	loopNumber(0),
+	busyWorkers(0),
+	quitting(false)
+{
+	if (workerCount < 0)
+		workerCount = (int)std::thread::hardware_concurrency() - 1;
+
+	for (int i = 0; i < workerCount; i++)
+		workers.emplace_back(&JobSystem::WorkerLoop, this);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wakeCondition.notify_all();
+
+	for (auto& w : workers)
+		w.join();
+}
+
+int JobSystem::GetThreadCount() const { return (int)workers.size() + 1; }
+
+
+// --------------------------------------------------------
+// Runs job(0) through job(count - 1) and waits for all of them.
+// The calling thread works through jobs alongside the workers
+// rather than just waiting.
+// --------------------------------------------------------
+void JobSystem::ParallelFor(int count, const std::function<void(int)>& job)
+{
+	if (count <= 0)
+		return;
+
+	// Nothing to gain (or nested inside another loop)?  Run it here
+	if (workers.empty() || count == 1 || insideJob)
+	{
+		for (int i = 0; i < count; i++)
+			job(i);
+		return;
+	}
+
+	// Set up the loop and wake everyone
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->job = &job;
+		jobCount = count;
+		nextJob.store(0, std::memory_order_relaxed);
+		busyWorkers = (int)workers.size();
+		loopNumber++;
+	}
+	wakeCondition.notify_all();
+
+	RunJobs();
+
+	// Every job has been claimed, but some may still be running
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [&] { return busyWorkers == 0; });
+	this->job = 0;
+}
+
+
+// --------------------------------------------------------
+// Each worker waits for a new loop, helps with it, and reports
+// back.  The caller doesn't return until every worker has
+// reported, so no worker can miss a loop.
+// --------------------------------------------------------
+void JobSystem::WorkerLoop()
+{
+	unsigned int lastLoop = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [&] { return quitting || loopNumber != lastLoop; });
+			if (quitting)
+				return;
+			lastLoop = loopNumber;
+		}
+
+		RunJobs();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busyWorkers == 0)
+			doneCondition.notify_one();
+	}
+}
+
+void JobSystem::RunJobs()
+{
+	insideJob = true;
+	for (int i = nextJob.fetch_add(1); i < jobCount; i = nextJob.fetch_add(1))
+		(*job)(i);
+	insideJob = false;
+}
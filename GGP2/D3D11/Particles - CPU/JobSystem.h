@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// A minimal job system: a fixed set of worker threads that
+// split up "parallel for" loops.
+//
+// ParallelFor(count, job) calls job(0) through job(count - 1),
+// spread across the workers and the calling thread, and only
+// returns once every call has finished.  Jobs are handed out
+// in order from a shared counter, so cheap and expensive jobs
+// balance out on their own.  Which thread runs which job isn't
+// fixed, so jobs should only write to their own data.
+//
+// Calling ParallelFor from inside a job just runs the loop on
+// that thread, so code that's sometimes run as a job can still
+// use it safely.
+// --------------------------------------------------------
+class JobSystem
+{
+public:
+	// Negative means one worker per extra hardware thread
+	JobSystem(int workerCount = -1);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Workers plus the calling thread
+	int GetThreadCount() const;
+
+	void ParallelFor(int count, const std::function<void(int)>& job);
+
+private:
+	std::vector<std::thread> workers;
+
+	// The current loop
+	const std::function<void(int)>* job;
+	int jobCount;
+	std::atomic<int> nextJob;
+
+	// Waking workers up for a new loop, and waiting for them to finish
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+	unsigned int loopNumber;
+	int busyWorkers;
+	bool quitting;
+
+	void WorkerLoop();
+	void RunJobs();
+};
@@ -0,0 +1,102 @@
+#include "ParticleBudget.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Off-screen emitters still get a sliver of the budget, so
+// they have particles ready when they come back into view
+static const float OffScreenWeight = 0.0001f;
+
+// --------------------------------------------------------
+// Approximate fraction of the view covered by an emitter,
+// based on the angle its bounds take up
+// --------------------------------------------------------
+static float ScreenCoverageWeight(const ParticleBudgetRequest& request)
+{
+	if (!request.OnScreen || request.BoundsRadius <= 0.0f)
+		return OffScreenWeight;
+
+	// Inside the bounds counts as covering everything
+	float distance = std::max(request.Distance, request.BoundsRadius);
+	float ratio = request.BoundsRadius / distance;
+	return std::max(ratio * ratio, OffScreenWeight);
+}
+
+
+// --------------------------------------------------------
+// Shares the budget out by weight ("water filling"): each
+// emitter's fair share is the remaining budget times its
+// fraction of the remaining weight.  Emitters are visited
+// from the least to the most demanding relative to their
+// weight, so any that need less than their share are fully
+// satisfied first and the leftovers flow to the rest.
+// --------------------------------------------------------
+int AllocateParticleBudget(
+	const ParticleBudgetSettings& settings,
+	const ParticleBudgetRequest* requests,
+	ParticleBudgetGrant* grants,
+	int count)
+{
+	if (count <= 0)
+		return 0;
+
+	float minRateScale = std::clamp(settings.MinRateScale, 0.0f, 1.0f);
+	float maxSizeScale = std::max(settings.MaxSizeScale, 1.0f);
+
+	// Work out demand and weight
+	long long totalDemand = 0;
+	double totalWeight = 0.0;
+	for (int i = 0; i < count; i++)
+	{
+		const ParticleBudgetRequest& r = requests[i];
+		float steadyState = std::ceil(std::max(r.ParticlesPerSecond, 0.0f) * std::max(r.Lifetime, 0.0f));
+
+		grants[i].Demand = (int)std::min((float)std::max(r.MaxParticles, 0), steadyState);
+		grants[i].Weight = ScreenCoverageWeight(r);
+		totalDemand += grants[i].Demand;
+		totalWeight += grants[i].Weight;
+	}
+
+	// Allocate in order of demand relative to weight
+	std::vector<int> order(count);
+	for (int i = 0; i < count; i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [grants](int a, int b) {
+		return (double)grants[a].Demand * grants[b].Weight < (double)grants[b].Demand * grants[a].Weight; });
+
+	double remainingBudget = std::max(settings.MaxLiveParticles, 0);
+	double remainingWeight = totalWeight;
+	bool fitsEntirely = totalDemand <= settings.MaxLiveParticles;
+	int totalGranted = 0;
+
+	for (int i : order)
+	{
+		ParticleBudgetGrant& g = grants[i];
+		double share = g.Demand;
+		if (!fitsEntirely)
+			share = remainingWeight > 0.0 ? remainingBudget * g.Weight / remainingWeight : remainingBudget;
+		remainingWeight -= g.Weight;
+
+		// Rounding down keeps the total under the global maximum
+		int granted = (int)std::min((double)g.Demand, std::floor(share));
+		remainingBudget -= granted;
+		totalGranted += granted;
+
+		g.ParticleLimit = granted;
+		if (g.Demand == 0 || granted >= g.Demand)
+		{
+			g.RateScale = 1.0f;
+			g.SizeScale = 1.0f;
+			continue;
+		}
+
+		// Fewer particles covering the same area need to be
+		// larger by the square root of the reduction
+		float fraction = (float)granted / g.Demand;
+		g.RateScale = std::max(fraction, minRateScale);
+		g.SizeScale = fraction > 0.0f ? std::min(1.0f / std::sqrt(fraction), maxSizeScale) : maxSizeScale;
+	}
+
+	return totalGranted;
+}
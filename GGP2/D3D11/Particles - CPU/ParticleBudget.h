@@ -0,0 +1,56 @@
+#pragma once
+
+// --------------------------------------------------------
+// Splits a global live-particle budget between emitters.
+//
+// Each emitter asks for as many particles as it would have
+// alive at its full emission rate.  If everything fits, every
+// emitter gets what it asked for.  Otherwise the budget is
+// shared out in proportion to each emitter's approximate
+// screen coverage (its bounds' size over its distance from
+// the camera, squared), with emitters that need less than
+// their share giving the remainder to the others.
+//
+// Emitters that get less than they asked for spawn more
+// slowly, and draw their particles larger to cover roughly
+// the same area with fewer of them.
+//
+// Nothing here touches the graphics API or the emitters
+// themselves, so the policy can be run on made-up data.
+// --------------------------------------------------------
+
+struct ParticleBudgetSettings
+{
+	int MaxLiveParticles;	// Across all emitters
+	float MinRateScale;		// Emitters never drop below this fraction of their rate
+	float MaxSizeScale;		// Limit on how much larger particles can get
+};
+
+// What one emitter would like, and how visible it is
+struct ParticleBudgetRequest
+{
+	float ParticlesPerSecond;
+	float Lifetime;
+	int MaxParticles;
+	float BoundsRadius;
+	float Distance;			// From the camera to the center of the bounds
+	bool OnScreen;			// False if culled (or hidden) last frame
+};
+
+// What one emitter is allowed
+struct ParticleBudgetGrant
+{
+	float Weight;			// Share of the budget this emitter competes with
+	int Demand;				// Particles alive at its full rate
+	int ParticleLimit;		// Maximum particles alive at once
+	float RateScale;		// Multiplier for its emission rate
+	float SizeScale;		// Multiplier for its particle sizes
+};
+
+// Fills in one grant per request and returns the total number
+// of particles granted, which never exceeds the global maximum
+int AllocateParticleBudget(
+	const ParticleBudgetSettings& settings,
+	const ParticleBudgetRequest* requests,
+	ParticleBudgetGrant* grants,
+	int count);
@@ -0,0 +1,530 @@
+#include "ParticleCollision.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+
+Heightfield::Heightfield() :
+	width(0),
+	depth(0),
+	spacing(1.0f),
+	origin{ 0, 0, 0 },
+	minHeight(0.0f),
+	maxHeight(0.0f)
+{
+}
+
+int Heightfield::GetWidth() const { return width; }
+int Heightfield::GetDepth() const { return depth; }
+
+
+// --------------------------------------------------------
+// Copies a grid of heights, centered on the given position
+// the same way TerrainMesh centers its vertices
+//
+// heights  - width * depth heights, in world units
+// xzScale  - Distance between grid points
+// position - Where the heightfield is in the world
+// --------------------------------------------------------
+void Heightfield::SetHeights(const float* heights, int width, int depth, float xzScale, const float position[3])
+{
+	if (width < 2 || depth < 2 || xzScale <= 0.0f)
+	{
+		this->heights.clear();
+		this->width = this->depth = 0;
+		return;
+	}
+
+	this->heights.assign(heights, heights + (size_t)width * depth);
+	this->width = width;
+	this->depth = depth;
+	spacing = xzScale;
+	origin[0] = position[0] - width / 2.0f * xzScale;
+	origin[1] = position[1];
+	origin[2] = position[2] - depth / 2.0f * xzScale;
+
+	auto range = std::minmax_element(this->heights.begin(), this->heights.end());
+	minHeight = *range.first;
+	maxHeight = *range.second;
+}
+
+
+// --------------------------------------------------------
+// Loads the same RAW files as TerrainMesh, with the same
+// scaling, so particles collide with exactly what's drawn
+// --------------------------------------------------------
+bool Heightfield::LoadRaw(const std::filesystem::path& path, int width, int depth, bool sixteenBit, float yScale, float xzScale, const float position[3])
+{
+	if (width < 2 || depth < 2)
+		return false;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	size_t count = (size_t)width * depth;
+	std::vector<float> values(count);
+	if (sixteenBit)
+	{
+		std::vector<unsigned short> raw(count);
+		if (!file.read((char*)raw.data(), count * 2))
+			return false;
+		for (size_t i = 0; i < count; i++)
+			values[i] = raw[i] / 65535.0f * yScale;
+	}
+	else
+	{
+		std::vector<unsigned char> raw(count);
+		if (!file.read((char*)raw.data(), count))
+			return false;
+		for (size_t i = 0; i < count; i++)
+			values[i] = raw[i] / 255.0f * yScale;
+	}
+
+	SetHeights(values.data(), width, depth, xzScale, position);
+	return true;
+}
+
+
+// --------------------------------------------------------
+// Interpolates across whichever of the grid square's two
+// triangles the position is over.  CollideParticles() does
+// the same thing, 4 particles at a time.
+// --------------------------------------------------------
+float Heightfield::GetHeight(float x, float z) const
+{
+	if (heights.empty())
+		return -FLT_MAX;
+
+	float u = (x - origin[0]) / spacing;
+	float w = (z - origin[2]) / spacing;
+	if (u < 0.0f || w < 0.0f || u > width - 1 || w > depth - 1)
+		return -FLT_MAX;
+
+	int cellX = std::min((int)u, width - 2);
+	int cellZ = std::min((int)w, depth - 2);
+	float fx = u - cellX;
+	float fz = w - cellZ;
+
+	const float* h = &heights[(size_t)cellZ * width + cellX];
+	float h00 = h[0];
+	float h10 = h[1];
+	float h01 = h[width];
+	float h11 = h[width + 1];
+
+	float height = fz > fx ?
+		h00 + fz * (h01 - h00) + fx * (h11 - h01) :
+		h00 + fx * (h10 - h00) + fz * (h11 - h10);
+	return height + origin[1];
+}
+
+void Heightfield::GetBounds(float boundsMin[3], float boundsMax[3]) const
+{
+	boundsMin[0] = origin[0];
+	boundsMin[1] = origin[1] + minHeight;
+	boundsMin[2] = origin[2];
+	boundsMax[0] = origin[0] + (width - 1) * spacing;
+	boundsMax[1] = origin[1] + maxHeight;
+	boundsMax[2] = origin[2] + (depth - 1) * spacing;
+}
+
+
+// --------------------------------------------------------
+// Keeps only the colliders that overlap the box.  Planes are
+// skipped if the whole box is in front of them, spheres if
+// the box's closest point is outside them, and heightfields
+// if the box misses them from the side or is entirely above
+// their highest point.
+// --------------------------------------------------------
+bool ParticleColliders::FindNearby(const float boundsMin[3], const float boundsMax[3], NearbyColliders& nearby) const
+{
+	nearby.Planes.clear();
+	nearby.Spheres.clear();
+	nearby.Heightfields.clear();
+
+	float center[3];
+	float extents[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		center[axis] = (boundsMin[axis] + boundsMax[axis]) * 0.5f;
+		extents[axis] = (boundsMax[axis] - boundsMin[axis]) * 0.5f;
+	}
+
+	for (int i = 0; i < (int)Planes.size(); i++)
+	{
+		const PlaneCollider& plane = Planes[i];
+		float centerDistance = 0.0f;
+		float reach = 0.0f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			centerDistance += plane.Normal[axis] * center[axis];
+			reach += fabsf(plane.Normal[axis]) * extents[axis];
+		}
+
+		if (centerDistance - plane.Distance - reach <= 0.0f)
+			nearby.Planes.push_back(i);
+	}
+
+	for (int i = 0; i < (int)Spheres.size(); i++)
+	{
+		const SphereCollider& sphere = Spheres[i];
+		float distanceSquared = 0.0f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float closest = std::clamp(sphere.Center[axis], boundsMin[axis], boundsMax[axis]);
+			distanceSquared += (closest - sphere.Center[axis]) * (closest - sphere.Center[axis]);
+		}
+
+		if (distanceSquared <= sphere.Radius * sphere.Radius)
+			nearby.Spheres.push_back(i);
+	}
+
+	for (int i = 0; i < (int)Heightfields.size(); i++)
+	{
+		if (!Heightfields[i] || Heightfields[i]->GetWidth() == 0)
+			continue;
+
+		float fieldMin[3];
+		float fieldMax[3];
+		Heightfields[i]->GetBounds(fieldMin, fieldMax);
+		if (boundsMax[0] >= fieldMin[0] && boundsMin[0] <= fieldMax[0] &&
+			boundsMax[2] >= fieldMin[2] && boundsMin[2] <= fieldMax[2] &&
+			boundsMin[1] <= fieldMax[1])
+			nearby.Heightfields.push_back(i);
+	}
+
+	return !nearby.IsEmpty();
+}
+
+
+// --------------------------------------------------------
+// The particle arrays the collision kernel works on, so it
+// can run on the storage itself or on a small copy
+// --------------------------------------------------------
+struct CollisionArrays
+{
+	float* Position[3];
+	float* StartPosition[3];
+	float* StartVelocity[3];
+	float* FieldVelocity[3];
+	float* Age;
+	float* Alive;
+};
+
+static inline __m128 Select(__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline __m128 Dot(const __m128 a[3], const __m128 b[3])
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+}
+
+// Multiplies 4 row vectors by a matrix (see ParticleCollisionParams),
+// adding its translation only for points - directions just rotate and scale
+static inline void Transform(const __m128 v[3], const float m[4][3], bool point, __m128 result[3])
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		result[axis] = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(v[0], _mm_set1_ps(m[0][axis])),
+			_mm_mul_ps(v[1], _mm_set1_ps(m[1][axis]))),
+			_mm_mul_ps(v[2], _mm_set1_ps(m[2][axis])));
+		if (point)
+			result[axis] = _mm_add_ps(result[axis], _mm_set1_ps(m[3][axis]));
+	}
+}
+
+
+// --------------------------------------------------------
+// State of 4 particles while they're tested against every
+// nearby collider, one after another
+// --------------------------------------------------------
+struct CollisionLanes
+{
+	__m128 Position[3];		// World space
+	__m128 Velocity[3];
+	__m128 Alive;			// All bits set for particles that can still collide
+	__m128 Hit;				// All bits set for particles that collided with anything
+	__m128 Killed;
+
+	// Moves the particles in the mask to the surface, and bounces
+	// the ones moving into it (or kills them)
+	void Respond(__m128 mask, const __m128 normal[3], const __m128 surface[3], const ParticleCollisionParams& params)
+	{
+		mask = _mm_and_ps(mask, Alive);
+		if (_mm_movemask_ps(mask) == 0)
+			return;
+
+		Hit = _mm_or_ps(Hit, mask);
+		for (int axis = 0; axis < 3; axis++)
+			Position[axis] = Select(mask, surface[axis], Position[axis]);
+
+		if (params.Response == CollisionResponse::Kill)
+		{
+			Killed = _mm_or_ps(Killed, mask);
+			Alive = _mm_andnot_ps(mask, Alive);
+			return;
+		}
+
+		// Split the velocity into parts along and into the surface, then
+		// slow the part along it and reverse the part going into it
+		__m128 normalSpeed = Dot(Velocity, normal);
+		__m128 approaching = _mm_and_ps(mask, _mm_cmplt_ps(normalSpeed, _mm_setzero_ps()));
+		__m128 tangentScale = _mm_set1_ps(1.0f - params.Friction);
+		__m128 normalScale = _mm_set1_ps(params.Restitution);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128 intoSurface = _mm_mul_ps(normalSpeed, normal[axis]);
+			__m128 alongSurface = _mm_sub_ps(Velocity[axis], intoSurface);
+			__m128 bounced = _mm_sub_ps(_mm_mul_ps(alongSurface, tangentScale), _mm_mul_ps(intoSurface, normalScale));
+			Velocity[axis] = Select(approaching, bounced, Velocity[axis]);
+		}
+	}
+
+	// Tests against the triangle under each particle (the same
+	// way Heightfield::GetHeight() does, but 4 at a time)
+	void CollideHeightfield(const Heightfield& field, const ParticleCollisionParams& params)
+	{
+		__m128 zero = _mm_setzero_ps();
+		__m128 invSpacing = _mm_set1_ps(1.0f / field.spacing);
+		__m128 lastX = _mm_set1_ps((float)(field.width - 1));
+		__m128 lastZ = _mm_set1_ps((float)(field.depth - 1));
+
+		__m128 u = _mm_mul_ps(_mm_sub_ps(Position[0], _mm_set1_ps(field.origin[0])), invSpacing);
+		__m128 w = _mm_mul_ps(_mm_sub_ps(Position[2], _mm_set1_ps(field.origin[2])), invSpacing);
+		__m128 over = _mm_and_ps(
+			_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, lastX)),
+			_mm_and_ps(_mm_cmpge_ps(w, zero), _mm_cmple_ps(w, lastZ)));
+		over = _mm_and_ps(over, Alive);
+		if (_mm_movemask_ps(over) == 0)
+			return;
+
+		// Grid square and position within it (particles that aren't over
+		// the field are clamped to it, then ignored)
+		u = _mm_min_ps(_mm_max_ps(u, zero), lastX);
+		w = _mm_min_ps(_mm_max_ps(w, zero), lastZ);
+		__m128 cellX = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(u)), _mm_set1_ps((float)(field.width - 2)));
+		__m128 cellZ = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(w)), _mm_set1_ps((float)(field.depth - 2)));
+		__m128 fx = _mm_sub_ps(u, cellX);
+		__m128 fz = _mm_sub_ps(w, cellZ);
+
+		// Gather each particle's 4 corner heights
+		alignas(16) float cellsX[4];
+		alignas(16) float cellsZ[4];
+		alignas(16) float corners[4][4];
+		_mm_store_ps(cellsX, cellX);
+		_mm_store_ps(cellsZ, cellZ);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			const float* h = &field.heights[(size_t)cellsZ[lane] * field.width + (size_t)cellsX[lane]];
+			corners[0][lane] = h[0];
+			corners[1][lane] = h[1];
+			corners[2][lane] = h[field.width];
+			corners[3][lane] = h[field.width + 1];
+		}
+		__m128 h00 = _mm_load_ps(corners[0]);
+		__m128 h10 = _mm_load_ps(corners[1]);
+		__m128 h01 = _mm_load_ps(corners[2]);
+		__m128 h11 = _mm_load_ps(corners[3]);
+
+		// Height and slopes of the triangle each particle is over
+		__m128 upperTriangle = _mm_cmpgt_ps(fz, fx);
+		__m128 slopeX = Select(upperTriangle, _mm_sub_ps(h11, h01), _mm_sub_ps(h10, h00));
+		__m128 slopeZ = Select(upperTriangle, _mm_sub_ps(h01, h00), _mm_sub_ps(h11, h10));
+		__m128 height = _mm_add_ps(_mm_add_ps(h00,
+			Select(upperTriangle, _mm_mul_ps(fz, slopeZ), _mm_mul_ps(fx, slopeX))),
+			Select(upperTriangle, _mm_mul_ps(fx, slopeX), _mm_mul_ps(fz, slopeZ)));
+		height = _mm_add_ps(height, _mm_set1_ps(field.origin[1]));
+
+		__m128 below = _mm_and_ps(over, _mm_cmplt_ps(Position[1], height));
+		if (_mm_movemask_ps(below) == 0)
+			return;
+
+		// The triangle's normal is (-dh/dx, 1, -dh/dz), normalized
+		__m128 normal[3] = {
+			_mm_mul_ps(slopeX, _mm_set1_ps(-1.0f / field.spacing)),
+			_mm_set1_ps(1.0f),
+			_mm_mul_ps(slopeZ, _mm_set1_ps(-1.0f / field.spacing)) };
+		__m128 invLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(Dot(normal, normal)));
+		for (int axis = 0; axis < 3; axis++)
+			normal[axis] = _mm_mul_ps(normal[axis], invLength);
+
+		// Particles go straight up onto the surface
+		__m128 surface[3] = { Position[0], height, Position[2] };
+		Respond(below, normal, surface, params);
+	}
+};
+
+
+// --------------------------------------------------------
+// Collides 4 particles (starting at index i of the arrays)
+// with every nearby collider, then writes back the ones
+// that hit anything
+// --------------------------------------------------------
+static int CollideBatch(const CollisionArrays& a, int i, const ParticleColliders& colliders, const NearbyColliders& nearby, const ParticleCollisionParams& p)
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 age = _mm_loadu_ps(a.Age + i);
+	__m128 accel[3];
+	__m128 localPosition[3];
+	__m128 localVelocity[3];
+
+	// Current position and velocity (the derivative of the update's
+	// position, plus anything a force field built up), moved into
+	// world space
+	CollisionLanes lanes;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		accel[axis] = _mm_set1_ps(p.Acceleration[axis]);
+		localPosition[axis] = _mm_loadu_ps(a.Position[axis] + i);
+		localVelocity[axis] = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(accel[axis], age), _mm_loadu_ps(a.StartVelocity[axis] + i)),
+			_mm_loadu_ps(a.FieldVelocity[axis] + i));
+	}
+	Transform(localPosition, p.World, true, lanes.Position);
+	Transform(localVelocity, p.World, false, lanes.Velocity);
+	lanes.Alive = _mm_cmpgt_ps(_mm_loadu_ps(a.Alive + i), zero);
+	lanes.Hit = zero;
+	lanes.Killed = zero;
+
+	// Planes
+	for (int index : nearby.Planes)
+	{
+		const PlaneCollider& plane = colliders.Planes[index];
+		__m128 normal[3] = { _mm_set1_ps(plane.Normal[0]), _mm_set1_ps(plane.Normal[1]), _mm_set1_ps(plane.Normal[2]) };
+		__m128 distance = _mm_sub_ps(Dot(normal, lanes.Position), _mm_set1_ps(plane.Distance));
+
+		__m128 surface[3];
+		for (int axis = 0; axis < 3; axis++)
+			surface[axis] = _mm_sub_ps(lanes.Position[axis], _mm_mul_ps(normal[axis], distance));
+		lanes.Respond(_mm_cmplt_ps(distance, zero), normal, surface, p);
+	}
+
+	// Spheres
+	for (int index : nearby.Spheres)
+	{
+		const SphereCollider& sphere = colliders.Spheres[index];
+		__m128 toParticle[3];
+		for (int axis = 0; axis < 3; axis++)
+			toParticle[axis] = _mm_sub_ps(lanes.Position[axis], _mm_set1_ps(sphere.Center[axis]));
+
+		__m128 radius = _mm_set1_ps(sphere.Radius);
+		__m128 distanceSquared = Dot(toParticle, toParticle);
+		__m128 inside = _mm_cmplt_ps(distanceSquared, _mm_mul_ps(radius, radius));
+		if (_mm_movemask_ps(_mm_and_ps(inside, lanes.Alive)) == 0)
+			continue;
+
+		// Push out along the direction from the center (or straight up
+		// from the exact center, where there is no direction)
+		__m128 distance = _mm_sqrt_ps(distanceSquared);
+		__m128 hasDirection = _mm_cmpgt_ps(distance, _mm_set1_ps(1e-6f));
+		__m128 invDistance = _mm_div_ps(_mm_set1_ps(1.0f), Select(hasDirection, distance, _mm_set1_ps(1.0f)));
+		__m128 up[3] = { zero, _mm_set1_ps(1.0f), zero };
+
+		__m128 normal[3];
+		__m128 surface[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			normal[axis] = Select(hasDirection, _mm_mul_ps(toParticle[axis], invDistance), up[axis]);
+			surface[axis] = _mm_add_ps(_mm_set1_ps(sphere.Center[axis]), _mm_mul_ps(normal[axis], radius));
+		}
+		lanes.Respond(inside, normal, surface, p);
+	}
+
+	// Heightfields
+	for (int index : nearby.Heightfields)
+		lanes.CollideHeightfield(*colliders.Heightfields[index], p);
+
+	int hitMask = _mm_movemask_ps(lanes.Hit);
+	if (hitMask == 0)
+		return 0;
+
+	// Back into the emitter's space, then restart the hit particles'
+	// curves from where they are now, so the update continues them
+	// with their new velocity:
+	//   startVelocity = velocity - accel * age
+	//   startPosition = position - accel * age^2 / 2 - startVelocity * age
+	Transform(lanes.Position, p.InverseWorld, true, localPosition);
+	Transform(lanes.Velocity, p.InverseWorld, false, localVelocity);
+	__m128 halfAgeSquared = _mm_mul_ps(_mm_mul_ps(age, age), _mm_set1_ps(0.5f));
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m128 position = localPosition[axis];
+		__m128 startVelocity = _mm_sub_ps(localVelocity[axis], _mm_mul_ps(accel[axis], age));
+		__m128 startPosition = _mm_sub_ps(_mm_sub_ps(position, _mm_mul_ps(accel[axis], halfAgeSquared)), _mm_mul_ps(startVelocity, age));
+
+		_mm_storeu_ps(a.Position[axis] + i, Select(lanes.Hit, position, _mm_loadu_ps(a.Position[axis] + i)));
+		_mm_storeu_ps(a.StartVelocity[axis] + i, Select(lanes.Hit, startVelocity, _mm_loadu_ps(a.StartVelocity[axis] + i)));
+		_mm_storeu_ps(a.StartPosition[axis] + i, Select(lanes.Hit, startPosition, _mm_loadu_ps(a.StartPosition[axis] + i)));
+		_mm_storeu_ps(a.FieldVelocity[axis] + i, _mm_andnot_ps(lanes.Hit, _mm_loadu_ps(a.FieldVelocity[axis] + i)));
+	}
+	_mm_storeu_ps(a.Alive + i, _mm_andnot_ps(lanes.Killed, _mm_loadu_ps(a.Alive + i)));
+
+	int count = 0;
+	for (; hitMask; hitMask &= hitMask - 1)
+		count++;
+	return count;
+}
+
+
+// --------------------------------------------------------
+// Runs the kernel over the range, 4 particles at a time.  The
+// last few particles are copied out into a batch of 4 (with
+// unused lanes marked dead so they're ignored) and back, so
+// they go through exactly the same code without touching any
+// particle outside the range.
+// --------------------------------------------------------
+int CollideParticles(
+	ParticleStorage& storage,
+	int first,
+	int count,
+	const ParticleColliders& colliders,
+	const NearbyColliders& nearby,
+	const ParticleCollisionParams& params)
+{
+	if (count <= 0 || nearby.IsEmpty())
+		return 0;
+
+	ParticleStorage& s = storage;
+	CollisionArrays arrays = {
+		{ s.PositionX, s.PositionY, s.PositionZ },
+		{ s.StartPositionX, s.StartPositionY, s.StartPositionZ },
+		{ s.StartVelocityX, s.StartVelocityY, s.StartVelocityZ },
+		{ s.FieldVelocityX, s.FieldVelocityY, s.FieldVelocityZ },
+		s.Age,
+		s.Alive };
+
+	int hits = 0;
+	int end = first + count;
+	int i = first;
+	for (; i + 4 <= end; i += 4)
+		hits += CollideBatch(arrays, i, colliders, nearby, params);
+
+	int leftover = end - i;
+	if (leftover > 0)
+	{
+		// 14 arrays of 4 floats, zeroed (so unused lanes are dead)
+		float batch[14][4] = {};
+		CollisionArrays batchArrays = {
+			{ batch[0], batch[1], batch[2] },
+			{ batch[3], batch[4], batch[5] },
+			{ batch[6], batch[7], batch[8] },
+			{ batch[9], batch[10], batch[11] },
+			batch[12],
+			batch[13] };
+
+		float* const* from = &arrays.Position[0];
+		float* const* to = &batchArrays.Position[0];
+		for (int a = 0; a < 14; a++)
+			for (int lane = 0; lane < leftover; lane++)
+				to[a][lane] = from[a][i + lane];
+
+		hits += CollideBatch(batchArrays, 0, colliders, nearby, params);
+
+		for (int a = 0; a < 14; a++)
+			for (int lane = 0; lane < leftover; lane++)
+				from[a][i + lane] = to[a][lane];
+	}
+
+	return hits;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "ParticleSimulation.h"
+
+// --------------------------------------------------------
+// Collisions between CPU particles and simple scene shapes:
+// planes, spheres and terrain heightfields.
+//
+// Particles that end up inside a collider after an update
+// are pushed back out to its surface and either bounce off
+// or are killed.  Since particles move along a curve defined
+// by their start position and velocity, a bounce rewrites
+// those so the curve continues from the collision point with
+// the new velocity.
+//
+// Killed particles can't be retired early (particles always
+// retire in the order they were spawned), so they're marked
+// as no longer alive instead, which shrinks them to nothing
+// until their lifetime runs out.
+//
+// Colliders are in world space and particles are in their
+// emitter's space, so each batch of 4 particles (tested
+// together with SSE) goes through the emitter's full world
+// matrix - rotation and scale included - on the way in, and
+// the ones that hit anything come back through its inverse.
+// --------------------------------------------------------
+
+class ParticleColliders;
+struct NearbyColliders;
+struct ParticleCollisionParams;
+
+// Solid on the side the normal points away from
+struct PlaneCollider
+{
+	float Normal[3];	// Must be normalized
+	float Distance;		// Plane is everywhere dot(Normal, p) == Distance
+};
+
+// Solid inside
+struct SphereCollider
+{
+	float Center[3];
+	float Radius;
+};
+
+// --------------------------------------------------------
+// Terrain heights on a regular grid, solid below.  Grid
+// points and triangles match TerrainMesh exactly: grid point
+// (x, z) is at ((x - width / 2) * xzScale, height, (z - depth
+// / 2) * xzScale), offset by the heightfield's position, and
+// each grid square is split from (x, z) to (x + 1, z + 1).
+// --------------------------------------------------------
+class Heightfield
+{
+public:
+	Heightfield();
+
+	// Heights in world units, one row of width values per z
+	void SetHeights(const float* heights, int width, int depth, float xzScale, const float position[3]);
+
+	// Reads an 8 or 16-bit RAW heightmap the same way TerrainMesh does
+	bool LoadRaw(const std::filesystem::path& path, int width, int depth, bool sixteenBit, float yScale, float xzScale, const float position[3]);
+
+	// Height of the surface at a world position, or -FLT_MAX outside the grid
+	float GetHeight(float x, float z) const;
+
+	// World-space box around the whole surface
+	void GetBounds(float boundsMin[3], float boundsMax[3]) const;
+
+	int GetWidth() const;
+	int GetDepth() const;
+
+private:
+	friend struct CollisionLanes;	// The SIMD collision test (ParticleCollision.cpp)
+
+	std::vector<float> heights;
+	int width;
+	int depth;
+	float spacing;
+	float origin[3];		// World position of grid point (0, 0)
+	float minHeight;
+	float maxHeight;
+};
+
+// Indices of the colliders close enough to an emitter to matter
+struct NearbyColliders
+{
+	std::vector<int> Planes;
+	std::vector<int> Spheres;
+	std::vector<int> Heightfields;
+
+	bool IsEmpty() const { return Planes.empty() && Spheres.empty() && Heightfields.empty(); }
+};
+
+// Every collider in a scene
+class ParticleColliders
+{
+public:
+	std::vector<PlaneCollider> Planes;
+	std::vector<SphereCollider> Spheres;
+	std::vector<std::shared_ptr<Heightfield>> Heightfields;
+
+	// Finds the colliders that something inside the given world-space
+	// box could touch, returning false if there aren't any (so a far
+	// away emitter can skip collisions entirely)
+	bool FindNearby(const float boundsMin[3], const float boundsMax[3], NearbyColliders& nearby) const;
+};
+
+// What happens to particles that hit something
+enum class CollisionResponse
+{
+	Bounce,		// Reflect off the surface (no restitution means slide along it)
+	Kill		// Disappear
+};
+
+struct ParticleCollisionParams
+{
+	CollisionResponse Response;
+	float Restitution;		// Fraction of the speed into the surface kept by a bounce
+	float Friction;			// Fraction of the speed along the surface lost by a bounce
+	float Acceleration[3];	// The emitter's constant acceleration, in its own space
+
+	// The emitter's world matrix and its inverse, as rows (the same
+	// layout as DirectXMath), minus the last column - a particle's
+	// world position is x * World[0] + y * World[1] + z * World[2] + World[3]
+	float World[4][3];
+	float InverseWorld[4][3];
+};
+
+// Collides count particles, starting at first (without wrapping),
+// with the given nearby colliders, and returns how many collisions
+// there were
+int CollideParticles(
+	ParticleStorage& storage,
+	int first,
+	int count,
+	const ParticleColliders& colliders,
+	const NearbyColliders& nearby,
+	const ParticleCollisionParams& params);
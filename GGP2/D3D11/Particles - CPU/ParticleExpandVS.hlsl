@@ -0,0 +1,99 @@
+#include "ShaderStructs.hlsli"
+
+// Constant buffer for C++ data being passed in
+cbuffer externalData : register(b0)
+{
+	matrix world;
+	matrix view;
+	matrix projection;
+
+	float4 startColor;
+	float4 endColor;
+
+	int spriteSheetWidth;
+	int spriteSheetHeight;
+	float spriteSheetFrameWidth;
+	float spriteSheetFrameHeight;
+
+	int constrainYAxis;
+};
+
+// One living particle, as packed by the CPU
+// Note: Must match ParticleRecord in ParticleSimulation.h!
+struct ParticleRecord
+{
+	float3 Position;
+	float Size;
+	float Rotation;
+	float AgePercent;
+};
+
+// Buffer of living particles, oldest first
+StructuredBuffer<ParticleRecord> ParticleData : register(t0);
+
+
+// The entry point for our vertex shader - there is no vertex
+// buffer, as each group of 4 vertices expands ONE particle
+VertexToPixel_Particle main(uint id : SV_VertexID)
+{
+	// Set up output
+	VertexToPixel_Particle output;
+
+	// Get id info
+	uint particleID = id / 4;
+	uint cornerID = id % 4; // 0,1,2,3 = the corner of the particle "quad"
+
+	// Grab one particle
+	ParticleRecord p = ParticleData.Load(particleID);
+
+	// Offsets for the 4 corners of a quad - we'll only
+	// use one for each vertex, but which one depends
+	// on the cornerID above.
+	float2 offsets[4];
+	offsets[0] = float2(-1.0f, +1.0f);  // TL
+	offsets[1] = float2(+1.0f, +1.0f);  // TR
+	offsets[2] = float2(+1.0f, -1.0f);  // BR
+	offsets[3] = float2(-1.0f, -1.0f);  // BL
+
+	// Rotate the offset for this corner and apply size
+	float s, c;
+	sincos(p.Rotation, s, c);
+	float2x2 rot =
+	{
+		c, s,
+		-s, c
+	};
+	float2 rotatedOffset = mul(offsets[cornerID], rot) * p.Size;
+
+	// Billboarding!
+	// Offset the position based on the camera's right and up vectors
+	float3 pos = p.Position;
+	pos += float3(view._11, view._12, view._13) * rotatedOffset.x; // RIGHT
+	pos += (constrainYAxis ? float3(0, 1, 0) : float3(view._21, view._22, view._23)) * rotatedOffset.y; // UP
+
+	// Calculate output position
+	matrix wvp = mul(projection, mul(view, world));
+	output.screenPosition = mul(wvp, float4(pos, 1.0f));
+
+	// Sprite sheet frame based on the particle's age, where a regular
+	// texture is just a sprite sheet with exactly one frame
+	uint ssIndex = (uint)floor(p.AgePercent * (spriteSheetWidth * spriteSheetHeight));
+	uint uIndex = ssIndex % spriteSheetWidth;
+	uint vIndex = ssIndex / spriteSheetWidth; // Integer division is important here!
+
+	// Convert to a top-left corner in uv space (0-1)
+	float u = uIndex / (float)spriteSheetWidth;
+	float v = vIndex / (float)spriteSheetHeight;
+
+	float2 uvs[4];
+	/* TL */ uvs[0] = float2(u, v);
+	/* TR */ uvs[1] = float2(u + spriteSheetFrameWidth, v);
+	/* BR */ uvs[2] = float2(u + spriteSheetFrameWidth, v + spriteSheetFrameHeight);
+	/* BL */ uvs[3] = float2(u, v + spriteSheetFrameHeight);
+
+	// Finalize output
+	output.uv = saturate(uvs[cornerID]);
+	output.color = lerp(startColor, endColor, p.AgePercent);
+
+	return output;
+}
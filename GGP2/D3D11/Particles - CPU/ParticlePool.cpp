@@ -0,0 +1,79 @@
+#include "ParticlePool.h"
+
+// Block index stored in the head when the stack is empty
+static const unsigned int EmptyStack = 0xFFFFFFFF;
+
+// Packs a block index and tag into a stack head
+static unsigned long long MakeHead(unsigned int block, unsigned long long tag)
+{
+	return (tag << 32) | block;
+}
+
+
+// --------------------------------------------------------
+// Creates the storage and puts every block on the free
+// stack, with block 0 on top
+// --------------------------------------------------------
+ParticlePool::ParticlePool(int blockCount) :
+	blockCount(blockCount > 0 ? blockCount : 1),
+	head(MakeHead(EmptyStack, 0)),
+	freeCount(0)
+{
+	Storage.Allocate(this->blockCount * ParticlePoolBlockSize);
+
+	next = std::make_unique<std::atomic<int>[]>(this->blockCount);
+	for (int b = this->blockCount - 1; b >= 0; b--)
+		ReleaseBlock(b);
+}
+
+int ParticlePool::GetBlockCount() const { return blockCount; }
+int ParticlePool::GetFreeBlockCount() const { return freeCount.load(std::memory_order_relaxed); }
+
+
+// --------------------------------------------------------
+// Pops the top block off the free stack.  The acquire order
+// on success makes the previous owner's writes visible.
+// --------------------------------------------------------
+int ParticlePool::AcquireBlock()
+{
+	unsigned long long oldHead = head.load(std::memory_order_acquire);
+	while (true)
+	{
+		unsigned int block = (unsigned int)oldHead;
+		if (block == EmptyStack)
+			return -1;
+
+		// If another thread pops this block first, this read may be
+		// stale - but then the tag will have changed and the exchange
+		// below fails, so the stale value is never used
+		unsigned int below = (unsigned int)next[block].load(std::memory_order_relaxed);
+		unsigned long long newHead = MakeHead(below, (oldHead >> 32) + 1);
+		if (head.compare_exchange_weak(oldHead, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			freeCount.fetch_sub(1, std::memory_order_relaxed);
+			return (int)block;
+		}
+	}
+}
+
+
+// --------------------------------------------------------
+// Pushes a block back on the free stack.  The release order
+// publishes this owner's writes to the next one.
+// --------------------------------------------------------
+void ParticlePool::ReleaseBlock(int block)
+{
+	if (block < 0 || block >= blockCount)
+		return;
+
+	unsigned long long oldHead = head.load(std::memory_order_relaxed);
+	while (true)
+	{
+		next[block].store((int)(unsigned int)oldHead, std::memory_order_relaxed);
+		unsigned long long newHead = MakeHead((unsigned int)block, (oldHead >> 32) + 1);
+		if (head.compare_exchange_weak(oldHead, newHead, std::memory_order_release, std::memory_order_relaxed))
+			break;
+	}
+
+	freeCount.fetch_add(1, std::memory_order_relaxed);
+}
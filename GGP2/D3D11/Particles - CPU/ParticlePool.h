@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "ParticleSimulation.h"
+
+// Particles per block - a multiple of the SIMD width, so every
+// block starts on a SIMD boundary
+const int ParticlePoolBlockSize = 64;
+
+// --------------------------------------------------------
+// Particle storage shared by any number of emitters, handed
+// out in fixed-size blocks.
+//
+// Free blocks are kept on a lock-free stack (the CPU version
+// of the compute demo's dead list), so emitters on different
+// threads can grab and return blocks at the same time without
+// a lock.  The stack's head packs the top block's index with
+// a counter that changes on every push and pop, so a thread
+// that was interrupted mid-pop can't be fooled by the same
+// block being popped and pushed back in the meantime (the
+// "ABA" problem).
+//
+// A block belongs to exactly one emitter between acquiring and
+// releasing it, so its particle data needs no synchronization.
+// --------------------------------------------------------
+class ParticlePool
+{
+public:
+	ParticlePool(int blockCount);
+	ParticlePool(const ParticlePool&) = delete;
+	ParticlePool& operator=(const ParticlePool&) = delete;
+
+	// Returns a free block's index, or -1 if there are none
+	int AcquireBlock();
+	void ReleaseBlock(int block);
+
+	int GetBlockCount() const;
+	int GetFreeBlockCount() const;
+
+	// Index of a block's first particle in the storage
+	static int GetBlockStart(int block) { return block * ParticlePoolBlockSize; }
+
+	// Every block's particles, one after another
+	ParticleStorage Storage;
+
+private:
+	int blockCount;
+	std::atomic<unsigned long long> head;	// (tag << 32) | top block (or 0xFFFFFFFF if empty)
+	std::unique_ptr<std::atomic<int>[]> next;	// Next free block below each block
+	std::atomic<int> freeCount;
+};
@@ -0,0 +1,311 @@
+#include "ParticleRandom.h"
+
+#include <emmintrin.h>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// Converts the top 24 bits of a random integer to a float in [0, 1)
+static const float UIntToUnitFloat = 1.0f / 16777216.0f;
+
+// --------------------------------------------------------
+// Largest value a [min, max) float may take.  Scaling a unit
+// float into the range can round up to max itself (when the
+// range is small next to min), so results are clamped to the
+// float just below it.  Empty or reversed ranges are left alone.
+// --------------------------------------------------------
+static float RangeUpperBound(float min, float max)
+{
+	return max > min ? std::nextafter(max, min) : FLT_MAX;
+}
+
+// Skips shorter than this many steps just step, which is cheaper
+// than the (up to) one jump per bit of the distance
+static const long long MinJumpSteps = 8192;
+
+// Jumps are precomputed for every power of two up to this
+static const int JumpMatrixCount = 62;
+
+// --------------------------------------------------------
+// SplitMix64, used to spread a single seed out into all of
+// the xoshiro state words (as its authors recommend)
+// --------------------------------------------------------
+static unsigned long long SplitMix64(unsigned long long& x)
+{
+	unsigned long long z = (x += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// --------------------------------------------------------
+// One step of xoshiro128+ in all 4 lanes at once, returning
+// one new 32-bit value per lane
+// --------------------------------------------------------
+static __m128i Xoshiro128PlusStep(__m128i& s0, __m128i& s1, __m128i& s2, __m128i& s3)
+{
+	__m128i result = _mm_add_epi32(s0, s3);
+	__m128i t = _mm_slli_epi32(s1, 9);
+
+	s2 = _mm_xor_si128(s2, s0);
+	s3 = _mm_xor_si128(s3, s1);
+	s1 = _mm_xor_si128(s1, s2);
+	s0 = _mm_xor_si128(s0, s3);
+	s2 = _mm_xor_si128(s2, t);
+	s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21)); // Rotate left by 11
+
+	return result;
+}
+
+
+// --------------------------------------------------------
+// The same step for a single lane, on its 4 state words
+// --------------------------------------------------------
+static void Xoshiro128Step(unsigned int s[4])
+{
+	unsigned int t = s[1] << 9;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 11) | (s[3] >> 21);
+}
+
+
+// --------------------------------------------------------
+// Jumping ahead.  A xoshiro step only shifts, rotates and
+// XORs its 128 state bits, so any number of steps is a fixed
+// linear map on those bits.  The map for 2^k steps is stored
+// as what each of the 128 state bits turns into (XOR those
+// together for every bit that's set to jump a state), and
+// the map for 2^(k+1) steps is the one for 2^k applied twice.
+// --------------------------------------------------------
+struct JumpMatrix
+{
+	alignas(16) unsigned int Columns[128][4];
+};
+
+static void ApplyJump(const JumpMatrix& jump, const unsigned int in[4], unsigned int out[4])
+{
+	// Each bit becomes an all-ones or all-zeros mask, so there are
+	// no branches on the (random) state bits
+	__m128i result = _mm_setzero_si128();
+	for (int bit = 0; bit < 128; bit++)
+	{
+		__m128i mask = _mm_set1_epi32(-(int)((in[bit / 32] >> (bit % 32)) & 1));
+		__m128i column = _mm_load_si128((const __m128i*)jump.Columns[bit]);
+		result = _mm_xor_si128(result, _mm_and_si128(mask, column));
+	}
+
+	_mm_storeu_si128((__m128i*)out, result);
+}
+
+// The jump for each power of two number of steps, built the first time
+// it's needed (which is thread safe, as a function static)
+static const std::vector<JumpMatrix>& GetJumpMatrices()
+{
+	static const std::vector<JumpMatrix> matrices = []() {
+		std::vector<JumpMatrix> m(JumpMatrixCount);
+
+		// One step: just step each single-bit state
+		for (int bit = 0; bit < 128; bit++)
+		{
+			unsigned int* column = m[0].Columns[bit];
+			for (int word = 0; word < 4; word++)
+				column[word] = 0;
+			column[bit / 32] = 1u << (bit % 32);
+			Xoshiro128Step(column);
+		}
+
+		// Each power of two is the previous one twice
+		for (int k = 1; k < JumpMatrixCount; k++)
+		{
+			for (int bit = 0; bit < 128; bit++)
+				ApplyJump(m[k - 1], m[k - 1].Columns[bit], m[k].Columns[bit]);
+		}
+		return m;
+	}();
+	return matrices;
+}
+
+
+ParticleRandom::ParticleRandom(unsigned long long seed)
+{
+	Seed(seed);
+}
+
+
+void ParticleRandom::Seed(unsigned long long seed)
+{
+	unsigned long long x = seed;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		// Fill this lane's 4 words, making sure they're
+		// not all zero (the one state xoshiro can't leave)
+		unsigned int any = 0;
+		for (int word = 0; word < 4; word += 2)
+		{
+			unsigned long long bits = SplitMix64(x);
+			state[word][lane] = (unsigned int)bits;
+			state[word + 1][lane] = (unsigned int)(bits >> 32);
+			any |= state[word][lane] | state[word + 1][lane];
+		}
+		if (any == 0)
+			state[0][lane] = 1;
+	}
+
+	// Nothing buffered yet
+	bufferIndex = 4;
+}
+
+
+void ParticleRandom::StepToBuffer()
+{
+	__m128i s0 = _mm_load_si128((const __m128i*)state[0]);
+	__m128i s1 = _mm_load_si128((const __m128i*)state[1]);
+	__m128i s2 = _mm_load_si128((const __m128i*)state[2]);
+	__m128i s3 = _mm_load_si128((const __m128i*)state[3]);
+
+	_mm_store_si128((__m128i*)buffer, Xoshiro128PlusStep(s0, s1, s2, s3));
+
+	_mm_store_si128((__m128i*)state[0], s0);
+	_mm_store_si128((__m128i*)state[1], s1);
+	_mm_store_si128((__m128i*)state[2], s2);
+	_mm_store_si128((__m128i*)state[3], s3);
+	bufferIndex = 0;
+}
+
+
+unsigned int ParticleRandom::NextUInt()
+{
+	if (bufferIndex == 4)
+		StepToBuffer();
+	return buffer[bufferIndex++];
+}
+
+float ParticleRandom::NextFloat()
+{
+	// The low bits of xoshiro128+ are its weakest, so use the top 24
+	return (float)(NextUInt() >> 8) * UIntToUnitFloat;
+}
+
+float ParticleRandom::NextFloat(float min, float max)
+{
+	float value = min + NextFloat() * (max - min);
+	float upper = RangeUpperBound(min, max);
+	return value < upper ? value : upper;
+}
+
+
+// --------------------------------------------------------
+// Fills an array with random floats, 4 at a time.  Leftover
+// values from earlier calls are used up first, and any extra
+// values from the last step are kept for later.
+//
+// values - Array to fill
+// count  - Number of values to write
+// min    - Smallest possible value
+// max    - Largest possible value (exclusive)
+// --------------------------------------------------------
+void ParticleRandom::FillUniform(float* values, int count, float min, float max)
+{
+	int i = 0;
+
+	// Use up anything left over from earlier
+	for (; i < count && bufferIndex < 4; i++)
+		values[i] = NextFloat(min, max);
+
+	// Whole steps, straight into the array
+	if (i + 4 <= count)
+	{
+		__m128i s0 = _mm_load_si128((const __m128i*)state[0]);
+		__m128i s1 = _mm_load_si128((const __m128i*)state[1]);
+		__m128i s2 = _mm_load_si128((const __m128i*)state[2]);
+		__m128i s3 = _mm_load_si128((const __m128i*)state[3]);
+
+		__m128 scale = _mm_set1_ps(UIntToUnitFloat);
+		__m128 vMin = _mm_set1_ps(min);
+		__m128 vRange = _mm_set1_ps(max - min);
+		__m128 vUpper = _mm_set1_ps(RangeUpperBound(min, max));
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i bits = Xoshiro128PlusStep(s0, s1, s2, s3);
+			__m128 unit = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(bits, 8)), scale);
+			_mm_storeu_ps(values + i, _mm_min_ps(_mm_add_ps(vMin, _mm_mul_ps(unit, vRange)), vUpper));
+		}
+
+		_mm_store_si128((__m128i*)state[0], s0);
+		_mm_store_si128((__m128i*)state[1], s1);
+		_mm_store_si128((__m128i*)state[2], s2);
+		_mm_store_si128((__m128i*)state[3], s3);
+	}
+
+	// Ragged end, keeping the rest of the step for next time
+	for (; i < count; i++)
+		values[i] = NextFloat(min, max);
+}
+
+
+// --------------------------------------------------------
+// Skips over values, keeping the stream in the same place it
+// would be had the values actually been used.  Every lane
+// moves the same number of steps, so short skips just step
+// all 4 at once, and longer ones jump each lane ahead one
+// power of two at a time - at most one jump per bit of the
+// distance, so skipping a billion values costs about the
+// same as skipping a thousand.
+// --------------------------------------------------------
+void ParticleRandom::Discard(long long count)
+{
+	// Use up anything left over from earlier
+	while (count > 0 && bufferIndex < 4)
+	{
+		bufferIndex++;
+		count--;
+	}
+	if (count <= 0)
+		return;
+
+	// Whole steps
+	long long steps = count / 4;
+	count -= steps * 4;
+	if (steps >= MinJumpSteps)
+	{
+		const std::vector<JumpMatrix>& jumps = GetJumpMatrices();
+		for (int lane = 0; lane < 4; lane++)
+		{
+			unsigned int laneState[4] = { state[0][lane], state[1][lane], state[2][lane], state[3][lane] };
+			for (int k = 0; k < JumpMatrixCount; k++)
+			{
+				if ((steps >> k) & 1)
+					ApplyJump(jumps[k], laneState, laneState);
+			}
+
+			for (int word = 0; word < 4; word++)
+				state[word][lane] = laneState[word];
+		}
+	}
+	else
+	{
+		__m128i s0 = _mm_load_si128((const __m128i*)state[0]);
+		__m128i s1 = _mm_load_si128((const __m128i*)state[1]);
+		__m128i s2 = _mm_load_si128((const __m128i*)state[2]);
+		__m128i s3 = _mm_load_si128((const __m128i*)state[3]);
+		for (long long i = 0; i < steps; i++)
+			Xoshiro128PlusStep(s0, s1, s2, s3);
+		_mm_store_si128((__m128i*)state[0], s0);
+		_mm_store_si128((__m128i*)state[1], s1);
+		_mm_store_si128((__m128i*)state[2], s2);
+		_mm_store_si128((__m128i*)state[3], s3);
+	}
+
+	// Partial step, keeping the rest for later
+	if (count > 0)
+	{
+		StepToBuffer();
+		bufferIndex = (int)count;
+	}
+}
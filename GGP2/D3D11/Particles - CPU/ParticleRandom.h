@@ -0,0 +1,51 @@
+#pragma once
+
+// --------------------------------------------------------
+// A small, fast random number generator for spawning
+// particles, meant to replace the global rand().
+//
+// This is xoshiro128+ running 4 independent generators side
+// by side, one per SSE lane, so a batch of random floats can
+// be made 4 at a time.  The lanes are interleaved into one
+// stream (lane 0, 1, 2, 3, then lane 0 again, ...), and values
+// left over from a partial batch are kept for the next call,
+// so the sequence of values only depends on the seed - not
+// on how they were requested.
+//
+// Each generator is its own object with its own state, so
+// separate generators can be used from separate threads, and
+// the same seed always produces the same values.
+// --------------------------------------------------------
+class ParticleRandom
+{
+public:
+	ParticleRandom(unsigned long long seed = 0);
+
+	// Restarts the stream from the given seed
+	void Seed(unsigned long long seed);
+
+	// Single values
+	unsigned int NextUInt();
+	float NextFloat();						// [0, 1)
+	float NextFloat(float min, float max);	// [min, max)
+
+	// Fills an array with count values in [min, max), in the same
+	// order they'd come out of NextFloat(min, max)
+	void FillUniform(float* values, int count, float min, float max);
+
+	// Skips ahead in the stream, as if count values had been used.
+	// Long skips jump ahead rather than stepping, so this costs
+	// (at most) a little more for every doubling of count.
+	void Discard(long long count);
+
+private:
+	// State words for all 4 lanes, with each word's lanes together
+	// so they can be loaded straight into an SSE register
+	alignas(16) unsigned int state[4][4];
+
+	// Results of the most recent step that haven't been used yet
+	alignas(16) unsigned int buffer[4];
+	int bufferIndex;
+
+	void StepToBuffer();
+};
@@ -0,0 +1,15 @@
+#include "ParticleRing.h"
+
+
+// --------------------------------------------------------
+// Packs a range of the ring into records.  Each chunk writes
+// only its own part of the records, so chunks can run at the
+// same time, and each block's piece of a chunk is contiguous
+// in the pool, so it packs in one go.
+// --------------------------------------------------------
+void ParticleRing::PackRecords(const ParticleStorage& storage, int firstSlot, int count, float lifetime, ParticleRecord* records, JobSystem* jobs) const
+{
+	ForEachChunk(firstSlot, count, jobs, [&](int chunkStart, int chunkCount, int chunkOffset) {
+		ForEachSegment(chunkStart, chunkCount, [&](int poolStart, int segmentCount, int offset) {
+			PackParticleRecords(storage, poolStart, segmentCount, lifetime, records + chunkOffset + offset); }); });
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+#include "ParticlePool.h"
+#include "JobSystem.h"
+
+// Emitters with at least this many living particles split their
+// work into chunks of ParallelChunkSize particles, run as separate jobs
+const int ParallelParticleThreshold = 8192;
+const int ParallelChunkSize = 4096;
+
+// --------------------------------------------------------
+// An emitter's particles seen as a ring of slots, oldest
+// first, with each block-sized piece of the ring living in
+// whichever pool block the emitter was given (see the block
+// table in Emitter.h).
+//
+// This is just a view of the emitter's block table, so it's
+// cheap to make whenever it's needed.  Nothing here touches
+// the graphics API, so walking and packing an emitter's
+// living particles can be tested on its own.
+// --------------------------------------------------------
+class ParticleRing
+{
+public:
+	// blockTable - Pool block for each block-sized piece of the ring (-1 for none)
+	// size       - Slots in the ring (the emitter's max particles)
+	ParticleRing(const std::vector<int>& blockTable, int size) :
+		blockTable(blockTable),
+		size(size)
+	{
+	}
+
+	int GetSize() const { return size; }
+
+	// Index in the pool's storage of one slot in the ring
+	int GetPoolIndex(int slot) const
+	{
+		return ParticlePool::GetBlockStart(blockTable[slot / ParticlePoolBlockSize]) + slot % ParticlePoolBlockSize;
+	}
+
+	// Calls func(poolStart, count, offset) for each contiguous piece
+	// of a range of the ring, split where it wraps and at the edges
+	// of blocks, where offset is the piece's position in the range
+	template<typename Func>
+	void ForEachSegment(int firstSlot, int count, Func func) const
+	{
+		int offset = 0;
+		while (offset < count)
+		{
+			int slot = (firstSlot + offset) % size;
+			int blockEnd = (slot / ParticlePoolBlockSize + 1) * ParticlePoolBlockSize;
+			int segmentEnd = blockEnd < size ? blockEnd : size;
+			int segmentCount = segmentEnd - slot < count - offset ? segmentEnd - slot : count - offset;
+
+			func(GetPoolIndex(slot), segmentCount, offset);
+			offset += segmentCount;
+		}
+	}
+
+	// Splits a range of the ring into chunks that run as separate
+	// jobs, calling func(firstSlot, count, offset) for each - or just
+	// once for the whole range, if it's too small to be worth it
+	template<typename Func>
+	void ForEachChunk(int firstSlot, int count, JobSystem* jobs, Func func) const
+	{
+		if (!jobs || count < ParallelParticleThreshold)
+		{
+			func(firstSlot, count, 0);
+			return;
+		}
+
+		int chunkCount = (count + ParallelChunkSize - 1) / ParallelChunkSize;
+		jobs->ParallelFor(chunkCount, [&](int chunk) {
+			int offset = chunk * ParallelChunkSize;
+			int chunkSize = count - offset < ParallelChunkSize ? count - offset : ParallelChunkSize;
+			func((firstSlot + offset) % size, chunkSize, offset);
+		});
+	}
+
+	// Packs count particles starting at the given slot into consecutive
+	// records, oldest first, splitting large ranges between jobs
+	void PackRecords(const ParticleStorage& storage, int firstSlot, int count, float lifetime, ParticleRecord* records, JobSystem* jobs = 0) const;
+
+private:
+	const std::vector<int>& blockTable;
+	int size;
+};
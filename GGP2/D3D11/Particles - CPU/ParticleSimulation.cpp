@@ -0,0 +1,414 @@
+#include "ParticleSimulation.h"
+
+#include <immintrin.h>
+#include <cstring>
+#include <new>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX_FUNCTION
+#else
+#define AVX_FUNCTION __attribute__((target("avx")))
+#endif
+
+// Number of float arrays in the storage, and their alignment
+static const int AttributeCount = 23;
+static const size_t ArrayAlignment = 32;
+
+// --------------------------------------------------------
+// Checks for AVX support in both the CPU and the OS (which
+// has to save the wider registers on a context switch)
+// --------------------------------------------------------
+static bool CPUSupportsAVX()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx)
+		return false;
+
+	// Are the SSE and AVX register states enabled?
+	return (_xgetbv(0) & 0x6) == 0x6;
+#else
+	return __builtin_cpu_supports("avx");
+#endif
+}
+
+static const bool useAVX = CPUSupportsAVX();
+
+const char* GetParticleKernelName() { return useAVX ? "AVX" : "SSE"; }
+
+// Number of bits set in a (small) comparison mask
+static int CountBits(int mask)
+{
+	int count = 0;
+	for (; mask; mask &= mask - 1)
+		count++;
+	return count;
+}
+
+
+ParticleStorage::ParticleStorage() :
+	SpawnTime(0), Age(0), StartPositionX(0), StartPositionY(0), StartPositionZ(0),
+	StartVelocityX(0), StartVelocityY(0), StartVelocityZ(0),
+	RotationStart(0), RotationEnd(0),
+	FieldVelocityX(0), FieldVelocityY(0), FieldVelocityZ(0),
+	Alive(0),
+	PositionX(0), PositionY(0), PositionZ(0),
+	ColorR(0), ColorG(0), ColorB(0), ColorA(0),
+	Size(0), Rotation(0),
+	capacity(0),
+	memory(0)
+{
+}
+
+ParticleStorage::~ParticleStorage()
+{
+	if (memory)
+		operator delete[](memory, std::align_val_t(ArrayAlignment));
+}
+
+int ParticleStorage::GetCapacity() const { return capacity; }
+
+
+// --------------------------------------------------------
+// Allocates every array from a single block of memory.  Each
+// array is padded to a multiple of the SIMD width, so every
+// array starts on a 32-byte boundary.
+//
+// capacity - Maximum number of particles
+// --------------------------------------------------------
+void ParticleStorage::Allocate(int capacity)
+{
+	if (memory)
+		operator delete[](memory, std::align_val_t(ArrayAlignment));
+
+	this->capacity = capacity > 0 ? capacity : 1;
+	size_t stride = (this->capacity + ParticleSimdWidth - 1) / ParticleSimdWidth * ParticleSimdWidth;
+	size_t sizeInBytes = sizeof(float) * stride * AttributeCount;
+
+	memory = (float*)operator new[](sizeInBytes, std::align_val_t(ArrayAlignment));
+	memset(memory, 0, sizeInBytes);
+
+	float** arrays[AttributeCount] = {
+		&SpawnTime, &Age, &StartPositionX, &StartPositionY, &StartPositionZ,
+		&StartVelocityX, &StartVelocityY, &StartVelocityZ,
+		&RotationStart, &RotationEnd,
+		&FieldVelocityX, &FieldVelocityY, &FieldVelocityZ,
+		&Alive,
+		&PositionX, &PositionY, &PositionZ,
+		&ColorR, &ColorG, &ColorB, &ColorA,
+		&Size, &Rotation };
+	for (int i = 0; i < AttributeCount; i++)
+		*arrays[i] = memory + stride * i;
+}
+
+
+// --------------------------------------------------------
+// Updates a single particle, returning 1 if it died.  The
+// SIMD kernels below perform exactly the same operations,
+// in the same order, so they produce identical results.
+// --------------------------------------------------------
+static inline int UpdateOneParticle(ParticleStorage& s, int i, const ParticleUpdateParams& p, float invLifetime)
+{
+	// Age the particle and get its age as a percentage for lerps
+	float age = s.Age[i] + p.DeltaTime;
+	float agePercent = age * invLifetime;
+	s.Age[i] = age;
+
+	// Interpolate the color, rotation and size (no size once killed)
+	s.ColorR[i] = p.StartColor[0] + agePercent * (p.EndColor[0] - p.StartColor[0]);
+	s.ColorG[i] = p.StartColor[1] + agePercent * (p.EndColor[1] - p.StartColor[1]);
+	s.ColorB[i] = p.StartColor[2] + agePercent * (p.EndColor[2] - p.StartColor[2]);
+	s.ColorA[i] = p.StartColor[3] + agePercent * (p.EndColor[3] - p.StartColor[3]);
+	s.Rotation[i] = s.RotationStart[i] + agePercent * (s.RotationEnd[i] - s.RotationStart[i]);
+	s.Size[i] = (p.StartSize + agePercent * (p.EndSize - p.StartSize)) * s.Alive[i];
+
+	// Constant acceleration function: a * t^2 / 2 + v * t + p
+	float halfAgeSquared = age * age * 0.5f;
+	s.PositionX[i] = p.Acceleration[0] * halfAgeSquared + s.StartVelocityX[i] * age + s.StartPositionX[i];
+	s.PositionY[i] = p.Acceleration[1] * halfAgeSquared + s.StartVelocityY[i] * age + s.StartPositionY[i];
+	s.PositionZ[i] = p.Acceleration[2] * halfAgeSquared + s.StartVelocityZ[i] * age + s.StartPositionZ[i];
+
+	return age >= p.Lifetime ? 1 : 0;
+}
+
+
+// --------------------------------------------------------
+// AVX kernel - 8 particles per iteration.  The range must
+// start and end on a multiple of 8.
+// --------------------------------------------------------
+AVX_FUNCTION static int UpdateBlocksAVX(ParticleStorage& s, int begin, int end, const ParticleUpdateParams& p)
+{
+	const __m256 dt = _mm256_set1_ps(p.DeltaTime);
+	const __m256 lifetime = _mm256_set1_ps(p.Lifetime);
+	const __m256 invLifetime = _mm256_set1_ps(1.0f / p.Lifetime);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 startR = _mm256_set1_ps(p.StartColor[0]);
+	const __m256 startG = _mm256_set1_ps(p.StartColor[1]);
+	const __m256 startB = _mm256_set1_ps(p.StartColor[2]);
+	const __m256 startA = _mm256_set1_ps(p.StartColor[3]);
+	const __m256 deltaR = _mm256_set1_ps(p.EndColor[0] - p.StartColor[0]);
+	const __m256 deltaG = _mm256_set1_ps(p.EndColor[1] - p.StartColor[1]);
+	const __m256 deltaB = _mm256_set1_ps(p.EndColor[2] - p.StartColor[2]);
+	const __m256 deltaA = _mm256_set1_ps(p.EndColor[3] - p.StartColor[3]);
+	const __m256 startSize = _mm256_set1_ps(p.StartSize);
+	const __m256 deltaSize = _mm256_set1_ps(p.EndSize - p.StartSize);
+	const __m256 accelX = _mm256_set1_ps(p.Acceleration[0]);
+	const __m256 accelY = _mm256_set1_ps(p.Acceleration[1]);
+	const __m256 accelZ = _mm256_set1_ps(p.Acceleration[2]);
+
+	int dead = 0;
+	for (int i = begin; i < end; i += 8)
+	{
+		__m256 age = _mm256_add_ps(_mm256_load_ps(s.Age + i), dt);
+		__m256 agePercent = _mm256_mul_ps(age, invLifetime);
+		_mm256_store_ps(s.Age + i, age);
+
+		_mm256_store_ps(s.ColorR + i, _mm256_add_ps(startR, _mm256_mul_ps(agePercent, deltaR)));
+		_mm256_store_ps(s.ColorG + i, _mm256_add_ps(startG, _mm256_mul_ps(agePercent, deltaG)));
+		_mm256_store_ps(s.ColorB + i, _mm256_add_ps(startB, _mm256_mul_ps(agePercent, deltaB)));
+		_mm256_store_ps(s.ColorA + i, _mm256_add_ps(startA, _mm256_mul_ps(agePercent, deltaA)));
+
+		__m256 rotStart = _mm256_load_ps(s.RotationStart + i);
+		__m256 rotDelta = _mm256_sub_ps(_mm256_load_ps(s.RotationEnd + i), rotStart);
+		_mm256_store_ps(s.Rotation + i, _mm256_add_ps(rotStart, _mm256_mul_ps(agePercent, rotDelta)));
+		_mm256_store_ps(s.Size + i, _mm256_mul_ps(
+			_mm256_add_ps(startSize, _mm256_mul_ps(agePercent, deltaSize)),
+			_mm256_load_ps(s.Alive + i)));
+
+		__m256 halfAgeSquared = _mm256_mul_ps(_mm256_mul_ps(age, age), half);
+		_mm256_store_ps(s.PositionX + i, _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(accelX, halfAgeSquared),
+			_mm256_mul_ps(_mm256_load_ps(s.StartVelocityX + i), age)),
+			_mm256_load_ps(s.StartPositionX + i)));
+		_mm256_store_ps(s.PositionY + i, _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(accelY, halfAgeSquared),
+			_mm256_mul_ps(_mm256_load_ps(s.StartVelocityY + i), age)),
+			_mm256_load_ps(s.StartPositionY + i)));
+		_mm256_store_ps(s.PositionZ + i, _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(accelZ, halfAgeSquared),
+			_mm256_mul_ps(_mm256_load_ps(s.StartVelocityZ + i), age)),
+			_mm256_load_ps(s.StartPositionZ + i)));
+
+		// Count this block's deaths all at once
+		dead += CountBits(_mm256_movemask_ps(_mm256_cmp_ps(age, lifetime, _CMP_GE_OQ)));
+	}
+
+	return dead;
+}
+
+
+// --------------------------------------------------------
+// SSE kernel - 8 particles per iteration, as two sets of 4.
+// The range must start and end on a multiple of 8.
+// --------------------------------------------------------
+static int UpdateBlocksSSE(ParticleStorage& s, int begin, int end, const ParticleUpdateParams& p)
+{
+	const __m128 dt = _mm_set1_ps(p.DeltaTime);
+	const __m128 lifetime = _mm_set1_ps(p.Lifetime);
+	const __m128 invLifetime = _mm_set1_ps(1.0f / p.Lifetime);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 startR = _mm_set1_ps(p.StartColor[0]);
+	const __m128 startG = _mm_set1_ps(p.StartColor[1]);
+	const __m128 startB = _mm_set1_ps(p.StartColor[2]);
+	const __m128 startA = _mm_set1_ps(p.StartColor[3]);
+	const __m128 deltaR = _mm_set1_ps(p.EndColor[0] - p.StartColor[0]);
+	const __m128 deltaG = _mm_set1_ps(p.EndColor[1] - p.StartColor[1]);
+	const __m128 deltaB = _mm_set1_ps(p.EndColor[2] - p.StartColor[2]);
+	const __m128 deltaA = _mm_set1_ps(p.EndColor[3] - p.StartColor[3]);
+	const __m128 startSize = _mm_set1_ps(p.StartSize);
+	const __m128 deltaSize = _mm_set1_ps(p.EndSize - p.StartSize);
+	const __m128 accelX = _mm_set1_ps(p.Acceleration[0]);
+	const __m128 accelY = _mm_set1_ps(p.Acceleration[1]);
+	const __m128 accelZ = _mm_set1_ps(p.Acceleration[2]);
+
+	int dead = 0;
+	for (int block = begin; block < end; block += 8)
+	{
+		for (int i = block; i < block + 8; i += 4)
+		{
+			__m128 age = _mm_add_ps(_mm_load_ps(s.Age + i), dt);
+			__m128 agePercent = _mm_mul_ps(age, invLifetime);
+			_mm_store_ps(s.Age + i, age);
+
+			_mm_store_ps(s.ColorR + i, _mm_add_ps(startR, _mm_mul_ps(agePercent, deltaR)));
+			_mm_store_ps(s.ColorG + i, _mm_add_ps(startG, _mm_mul_ps(agePercent, deltaG)));
+			_mm_store_ps(s.ColorB + i, _mm_add_ps(startB, _mm_mul_ps(agePercent, deltaB)));
+			_mm_store_ps(s.ColorA + i, _mm_add_ps(startA, _mm_mul_ps(agePercent, deltaA)));
+
+			__m128 rotStart = _mm_load_ps(s.RotationStart + i);
+			__m128 rotDelta = _mm_sub_ps(_mm_load_ps(s.RotationEnd + i), rotStart);
+			_mm_store_ps(s.Rotation + i, _mm_add_ps(rotStart, _mm_mul_ps(agePercent, rotDelta)));
+			_mm_store_ps(s.Size + i, _mm_mul_ps(
+				_mm_add_ps(startSize, _mm_mul_ps(agePercent, deltaSize)),
+				_mm_load_ps(s.Alive + i)));
+
+			__m128 halfAgeSquared = _mm_mul_ps(_mm_mul_ps(age, age), half);
+			_mm_store_ps(s.PositionX + i, _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(accelX, halfAgeSquared),
+				_mm_mul_ps(_mm_load_ps(s.StartVelocityX + i), age)),
+				_mm_load_ps(s.StartPositionX + i)));
+			_mm_store_ps(s.PositionY + i, _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(accelY, halfAgeSquared),
+				_mm_mul_ps(_mm_load_ps(s.StartVelocityY + i), age)),
+				_mm_load_ps(s.StartPositionY + i)));
+			_mm_store_ps(s.PositionZ + i, _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(accelZ, halfAgeSquared),
+				_mm_mul_ps(_mm_load_ps(s.StartVelocityZ + i), age)),
+				_mm_load_ps(s.StartPositionZ + i)));
+
+			dead += CountBits(_mm_movemask_ps(_mm_cmpge_ps(age, lifetime)));
+		}
+	}
+
+	return dead;
+}
+
+
+// --------------------------------------------------------
+// Updates a contiguous (non-wrapping) range.  Whole blocks
+// of 8 go through the SIMD kernel, while any partial blocks
+// at either end are updated one particle at a time, so no
+// particle outside the range is ever touched.
+// --------------------------------------------------------
+static int UpdateRange(ParticleStorage& s, int begin, int end, const ParticleUpdateParams& p, bool simd)
+{
+	float invLifetime = 1.0f / p.Lifetime;
+	int dead = 0;
+
+	int blockBegin = (begin + ParticleSimdWidth - 1) / ParticleSimdWidth * ParticleSimdWidth;
+	int blockEnd = end / ParticleSimdWidth * ParticleSimdWidth;
+	if (!simd || blockBegin >= blockEnd)
+	{
+		for (int i = begin; i < end; i++)
+			dead += UpdateOneParticle(s, i, p, invLifetime);
+		return dead;
+	}
+
+	for (int i = begin; i < blockBegin; i++)
+		dead += UpdateOneParticle(s, i, p, invLifetime);
+
+	dead += useAVX ?
+		UpdateBlocksAVX(s, blockBegin, blockEnd, p) :
+		UpdateBlocksSSE(s, blockBegin, blockEnd, p);
+
+	for (int i = blockEnd; i < end; i++)
+		dead += UpdateOneParticle(s, i, p, invLifetime);
+
+	return dead;
+}
+
+// Splits a (possibly wrapping) range into at most two contiguous ones
+static int UpdateRing(ParticleStorage& storage, int first, int count, const ParticleUpdateParams& params, bool simd)
+{
+	int capacity = storage.GetCapacity();
+	if (count <= 0 || capacity == 0)
+		return 0;
+	if (count > capacity)
+		count = capacity;
+
+	int end = first + count;
+	if (end <= capacity)
+		return UpdateRange(storage, first, end, params, simd);
+
+	return
+		UpdateRange(storage, first, capacity, params, simd) +
+		UpdateRange(storage, 0, end - capacity, params, simd);
+}
+
+int UpdateParticles(ParticleStorage& storage, int first, int count, const ParticleUpdateParams& params)
+{
+	return UpdateRing(storage, first, count, params, true);
+}
+
+int UpdateParticlesScalar(ParticleStorage& storage, int first, int count, const ParticleUpdateParams& params)
+{
+	return UpdateRing(storage, first, count, params, false);
+}
+
+
+// --------------------------------------------------------
+// Evaluates a (possibly wrapping) range of particles at an
+// arbitrary time, using only their spawn-time data.  Ages
+// are set first, then the regular kernel runs with no time
+// step, so the results match the incremental update.
+// --------------------------------------------------------
+int EvaluateParticles(ParticleStorage& storage, int first, int count, float time, const ParticleUpdateParams& params)
+{
+	int capacity = storage.GetCapacity();
+	if (count <= 0 || capacity == 0)
+		return 0;
+	if (count > capacity)
+		count = capacity;
+
+	// Ages come straight from the spawn times (split at the end of the storage)
+	first %= capacity;
+	int firstPart = count < capacity - first ? count : capacity - first;
+	for (int i = first; i < first + firstPart; i++)
+		storage.Age[i] = time - storage.SpawnTime[i];
+	for (int i = 0; i < count - firstPart; i++)
+		storage.Age[i] = time - storage.SpawnTime[i];
+
+	ParticleUpdateParams evalParams = params;
+	evalParams.DeltaTime = 0.0f;
+	return UpdateParticles(storage, first, count, evalParams);
+}
+
+
+// --------------------------------------------------------
+// Gathers the render-relevant attributes of a (possibly
+// wrapping) range of particles into one compact array, so
+// only living particles ever need to be uploaded
+// --------------------------------------------------------
+int PackParticleRecords(const ParticleStorage& storage, int first, int count, float lifetime, ParticleRecord* records)
+{
+	int capacity = storage.GetCapacity();
+	if (count <= 0 || capacity == 0)
+		return 0;
+	if (count > capacity)
+		count = capacity;
+
+	float invLifetime = 1.0f / lifetime;
+	int index = first % capacity;
+	for (int r = 0; r < count; r++)
+	{
+		ParticleRecord& record = records[r];
+		record.Position[0] = storage.PositionX[index];
+		record.Position[1] = storage.PositionY[index];
+		record.Position[2] = storage.PositionZ[index];
+		record.Size = storage.Size[index];
+		record.Rotation = storage.Rotation[index];
+		record.AgePercent = storage.Age[index] * invLifetime;
+
+		// Wrap around the end of the storage
+		if (++index == capacity)
+			index = 0;
+	}
+
+	return count;
+}
+
+
+// --------------------------------------------------------
+// Same as above, but gathers particles from an arbitrary
+// list of indices rather than a contiguous range
+// --------------------------------------------------------
+void PackParticleRecordsInOrder(const ParticleStorage& storage, const unsigned int* indices, int count, float lifetime, ParticleRecord* records)
+{
+	float invLifetime = 1.0f / lifetime;
+	for (int r = 0; r < count; r++)
+	{
+		unsigned int index = indices[r];
+
+		ParticleRecord& record = records[r];
+		record.Position[0] = storage.PositionX[index];
+		record.Position[1] = storage.PositionY[index];
+		record.Position[2] = storage.PositionZ[index];
+		record.Size = storage.Size[index];
+		record.Rotation = storage.Rotation[index];
+		record.AgePercent = storage.Age[index] * invLifetime;
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+// --------------------------------------------------------
+// CPU particle simulation, stored as a structure of arrays
+// (SoA) rather than an array of Particle structs.
+//
+// Each particle attribute lives in its own tightly packed
+// array, so the update kernel can load 8 particles' worth of
+// any single attribute with one instruction.  The kernel uses
+// AVX when the CPU supports it, and SSE otherwise (which all
+// x64 CPUs do), with a plain scalar version for the ragged
+// ends of each range and as a reference.
+//
+// Nothing here touches the graphics API, so the simulation
+// can be run (and timed) on its own.
+// --------------------------------------------------------
+
+// Arrays are padded out to a multiple of this many particles
+const int ParticleSimdWidth = 8;
+
+// Emitter-wide values needed to update particles
+struct ParticleUpdateParams
+{
+	float DeltaTime;
+	float Lifetime;
+	float StartSize;
+	float EndSize;
+	float StartColor[4];
+	float EndColor[4];
+	float Acceleration[3];
+};
+
+// A single particle as uploaded to the GPU, which expands it into a
+// camera-facing quad.  Must match ParticleExpandVS.hlsl!
+struct ParticleRecord
+{
+	float Position[3];
+	float Size;
+	float Rotation;
+	float AgePercent;
+};
+
+class ParticleStorage
+{
+public:
+	ParticleStorage();
+	~ParticleStorage();
+	ParticleStorage(const ParticleStorage&) = delete;
+	ParticleStorage& operator=(const ParticleStorage&) = delete;
+
+	// Creates (or recreates) the arrays, zeroing all particle data
+	void Allocate(int capacity);
+	int GetCapacity() const;
+
+	// Spawn-time data
+	float* SpawnTime;
+	float* Age;
+	float* StartPositionX;
+	float* StartPositionY;
+	float* StartPositionZ;
+	float* StartVelocityX;
+	float* StartVelocityY;
+	float* StartVelocityZ;
+	float* RotationStart;
+	float* RotationEnd;
+
+	// Velocity built up from a force field (see ForceField.h)
+	float* FieldVelocityX;
+	float* FieldVelocityY;
+	float* FieldVelocityZ;
+
+	// 1 normally, 0 once a collision kills the particle (which hides
+	// it until its lifetime runs out - see ParticleCollision.h)
+	float* Alive;
+
+	// Data calculated by the update
+	float* PositionX;
+	float* PositionY;
+	float* PositionZ;
+	float* ColorR;
+	float* ColorG;
+	float* ColorB;
+	float* ColorA;
+	float* Size;
+	float* Rotation;
+
+private:
+	int capacity;
+	float* memory;
+};
+
+// Updates count particles starting at the given index, wrapping
+// around the end of the storage, and returns how many of them
+// reached the end of their lifetime.  Particles must be in the
+// order they were spawned, so the ones that die are always the
+// first ones in the range.
+int UpdateParticles(ParticleStorage& storage, int first, int count, const ParticleUpdateParams& params);
+
+// Same as above, one particle at a time (no SIMD)
+int UpdateParticlesScalar(ParticleStorage& storage, int first, int count, const ParticleUpdateParams& params);
+
+// Closed-form evaluation: sets each particle's age from its spawn time
+// and the given time, then calculates everything else from the age,
+// exactly as UpdateParticles() would (DeltaTime is ignored).  Returns
+// how many of the particles are dead at that time.
+int EvaluateParticles(ParticleStorage& storage, int first, int count, float time, const ParticleUpdateParams& params);
+
+// Which SIMD kernel UpdateParticles() uses on this CPU ("AVX" or "SSE")
+const char* GetParticleKernelName();
+
+// Packs count particles starting at the given index (wrapping around
+// the end of the storage) into consecutive records, oldest first, and
+// returns the number of records written
+int PackParticleRecords(const ParticleStorage& storage, int first, int count, float lifetime, ParticleRecord* records);
+
+// Packs the particles at the given storage indices into consecutive
+// records, in the order given (such as a back-to-front sort order)
+void PackParticleRecordsInOrder(const ParticleStorage& storage, const unsigned int* indices, int count, float lifetime, ParticleRecord* records);
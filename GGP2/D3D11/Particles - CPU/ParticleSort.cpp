@@ -0,0 +1,279 @@
+#include "ParticleSort.h"
+
+#include <immintrin.h>
+#include <cstring>
+
+// The radix sort handles 8 bits of the key per pass
+static const int RadixBits = 8;
+static const int RadixSize = 1 << RadixBits;
+
+// --------------------------------------------------------
+// Turns the bits of a float depth into a key that sorts the
+// depths from largest to smallest as unsigned integers.
+//
+// Positive floats already sort correctly as integers once the
+// sign bit is set, and negative ones do once all of their bits
+// are flipped.  Flipping the result again reverses the order,
+// so: negatives stay as they are, positives flip all but the sign.
+// --------------------------------------------------------
+static unsigned int DepthToKey(float depth)
+{
+	unsigned int bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	unsigned int mask = (unsigned int)((int)bits >> 31);
+	return bits ^ (~mask & 0x7FFFFFFF);
+}
+
+// Same as above, 4 at a time
+static __m128i DepthToKey4(__m128 depth)
+{
+	__m128i bits = _mm_castps_si128(depth);
+	__m128i mask = _mm_srai_epi32(bits, 31);
+	return _mm_xor_si128(bits, _mm_andnot_si128(mask, _mm_set1_epi32(0x7FFFFFFF)));
+}
+
+
+ParticleSorter::ParticleSorter() :
+	count(0),
+	emitterCount(0)
+{
+}
+
+int ParticleSorter::GetCount() const { return count; }
+unsigned int ParticleSorter::GetEmitterCount() const { return emitterCount; }
+const std::vector<ParticleSortRun>& ParticleSorter::GetRuns() const { return runs; }
+
+const unsigned int* ParticleSorter::GetEmitterOrder(unsigned int emitterIndex) const
+{
+	if (emitterIndex >= emitterCount || emitterCounts[emitterIndex] == 0)
+		return 0;
+	return emitterOrders[emitterIndex].data();
+}
+
+int ParticleSorter::GetEmitterParticleCount(unsigned int emitterIndex) const
+{
+	return emitterIndex < emitterCount ? emitterCounts[emitterIndex] : 0;
+}
+
+
+void ParticleSorter::Clear()
+{
+	count = 0;
+	emitterCount = 0;
+	runs.clear();
+}
+
+
+// --------------------------------------------------------
+// Adds a (possibly wrapping) range of one emitter's living
+// particles to the list to be sorted
+// --------------------------------------------------------
+void ParticleSorter::AddParticles(
+	const ParticleStorage& storage,
+	int first,
+	int count,
+	const float depthTransform[4],
+	unsigned int emitterIndex)
+{
+	int capacity = storage.GetCapacity();
+	if (count <= 0 || capacity == 0 || emitterIndex >= ParticleSortMaxEmitters)
+		return;
+	if (count > capacity)
+		count = capacity;
+	if (capacity > (int)ParticleSortMaxParticles)
+		return;
+
+	// Grow the arrays if necessary (they never shrink, so this
+	// stops allocating after the first few frames)
+	size_t total = (size_t)this->count + count;
+	if (keys.size() < total)
+	{
+		keys.resize(total);
+		values.resize(total);
+	}
+
+	if (emitterIndex >= emitterCount)
+		emitterCount = emitterIndex + 1;
+
+	// Split the range at the end of the storage
+	first %= capacity;
+	int firstPart = count < capacity - first ? count : capacity - first;
+	GenerateKeys(storage, first, firstPart, depthTransform, emitterIndex);
+	if (firstPart < count)
+		GenerateKeys(storage, 0, count - firstPart, depthTransform, emitterIndex);
+}
+
+
+// --------------------------------------------------------
+// Calculates the view depth and sort key of a contiguous
+// range of particles, appending the keys and their values
+// --------------------------------------------------------
+void ParticleSorter::GenerateKeys(const ParticleStorage& storage, int first, int rangeCount, const float depthTransform[4], unsigned int emitterIndex)
+{
+	const float* px = storage.PositionX + first;
+	const float* py = storage.PositionY + first;
+	const float* pz = storage.PositionZ + first;
+	unsigned int* outKeys = keys.data() + count;
+	unsigned int* outValues = values.data() + count;
+	unsigned int valueBase = (emitterIndex << 24) | (unsigned int)first;
+
+	__m128 mx = _mm_set1_ps(depthTransform[0]);
+	__m128 my = _mm_set1_ps(depthTransform[1]);
+	__m128 mz = _mm_set1_ps(depthTransform[2]);
+	__m128 mw = _mm_set1_ps(depthTransform[3]);
+	__m128i value = _mm_add_epi32(_mm_set1_epi32((int)valueBase), _mm_setr_epi32(0, 1, 2, 3));
+	__m128i four = _mm_set1_epi32(4);
+
+	int i = 0;
+	for (; i + 4 <= rangeCount; i += 4)
+	{
+		__m128 depth = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(px + i), mx), _mm_mul_ps(_mm_loadu_ps(py + i), my)),
+			_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(pz + i), mz), mw));
+
+		_mm_storeu_si128((__m128i*)(outKeys + i), DepthToKey4(depth));
+		_mm_storeu_si128((__m128i*)(outValues + i), value);
+		value = _mm_add_epi32(value, four);
+	}
+
+	// Leftovers, with exactly the same math as above
+	for (; i < rangeCount; i++)
+	{
+		float depth =
+			(px[i] * depthTransform[0] + py[i] * depthTransform[1]) +
+			(pz[i] * depthTransform[2] + depthTransform[3]);
+
+		outKeys[i] = DepthToKey(depth);
+		outValues[i] = valueBase + i;
+	}
+
+	count += rangeCount;
+}
+
+
+// --------------------------------------------------------
+// Sorts all particles farthest first and splits the results
+// back up by emitter
+//
+// keyBits - 16 or 32; how many bits of each depth to sort on
+// --------------------------------------------------------
+void ParticleSorter::Sort(int keyBits)
+{
+	runs.clear();
+	if (count == 0)
+		return;
+
+	RadixSort(keyBits == 16 ? 16 : 32);
+	SplitByEmitter();
+}
+
+
+// --------------------------------------------------------
+// Least-significant-digit radix sort of the keys (and their
+// values), one 8-bit digit per pass.  The histograms for every
+// pass are built up front in a single read of the keys, and any
+// pass where all keys share the same digit is skipped, since it
+// wouldn't change the order.
+// --------------------------------------------------------
+void ParticleSorter::RadixSort(int keyBits)
+{
+	const int passCount = 32 / RadixBits;
+	const int firstPass = (32 - keyBits) / RadixBits;
+
+	if (tempKeys.size() < (size_t)count)
+	{
+		tempKeys.resize(count);
+		tempValues.resize(count);
+	}
+
+	// Count every digit of every key
+	unsigned int histograms[passCount][RadixSize];
+	memset(histograms, 0, sizeof(histograms));
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int key = keys[i];
+		for (int p = firstPass; p < passCount; p++)
+			histograms[p][(key >> (p * RadixBits)) & (RadixSize - 1)]++;
+	}
+
+	unsigned int* srcKeys = keys.data();
+	unsigned int* srcValues = values.data();
+	unsigned int* dstKeys = tempKeys.data();
+	unsigned int* dstValues = tempValues.data();
+
+	for (int p = firstPass; p < passCount; p++)
+	{
+		int shift = p * RadixBits;
+
+		// Skip passes that wouldn't move anything
+		unsigned int firstDigit = (srcKeys[0] >> shift) & (RadixSize - 1);
+		if (histograms[p][firstDigit] == (unsigned int)count)
+			continue;
+
+		// Turn the counts into starting offsets
+		unsigned int offsets[RadixSize];
+		unsigned int sum = 0;
+		for (int d = 0; d < RadixSize; d++)
+		{
+			offsets[d] = sum;
+			sum += histograms[p][d];
+		}
+
+		// Scatter, in order, so equal digits keep their relative order
+		for (int i = 0; i < count; i++)
+		{
+			unsigned int key = srcKeys[i];
+			unsigned int dst = offsets[(key >> shift) & (RadixSize - 1)]++;
+			dstKeys[dst] = key;
+			dstValues[dst] = srcValues[i];
+		}
+
+		unsigned int* swapKeys = srcKeys; srcKeys = dstKeys; dstKeys = swapKeys;
+		unsigned int* swapValues = srcValues; srcValues = dstValues; dstValues = swapValues;
+	}
+
+	// Make sure the results end up in the main arrays
+	if (srcKeys != keys.data())
+	{
+		memcpy(keys.data(), srcKeys, sizeof(unsigned int) * count);
+		memcpy(values.data(), srcValues, sizeof(unsigned int) * count);
+	}
+}
+
+
+// --------------------------------------------------------
+// Splits the sorted values into per-emitter index lists and
+// runs of consecutive particles from the same emitter
+// --------------------------------------------------------
+void ParticleSorter::SplitByEmitter()
+{
+	if (emitterOrders.size() < emitterCount)
+	{
+		emitterOrders.resize(emitterCount);
+		emitterCounts.resize(emitterCount);
+	}
+	for (unsigned int e = 0; e < emitterCount; e++)
+		emitterCounts[e] = 0;
+
+	// Count each emitter's particles to size its list
+	for (int i = 0; i < count; i++)
+		emitterCounts[values[i] >> 24]++;
+	for (unsigned int e = 0; e < emitterCount; e++)
+	{
+		if (emitterOrders[e].size() < (size_t)emitterCounts[e])
+			emitterOrders[e].resize(emitterCounts[e]);
+		emitterCounts[e] = 0;
+	}
+
+	// Distribute the particles and find the runs
+	for (int i = 0; i < count; i++)
+	{
+		unsigned int emitter = values[i] >> 24;
+		emitterOrders[emitter][emitterCounts[emitter]++] = values[i] & (ParticleSortMaxParticles - 1);
+
+		if (!runs.empty() && runs.back().Emitter == emitter)
+			runs.back().Count++;
+		else
+			runs.push_back({ emitter, 1 });
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "ParticleSimulation.h"
+
+// --------------------------------------------------------
+// Sorts living particles back to front by view depth, so
+// they can be drawn with regular alpha blending.
+//
+// Particles from any number of emitters are added to one
+// list, so overlapping emitters sort against each other
+// rather than one emitter's particles all being drawn over
+// the other's.  Each particle gets an integer sort key made
+// from its view-space depth (computed 4 at a time with SSE),
+// and the keys are sorted with an LSD radix sort, which is
+// linear in the particle count and stable, so particles at
+// exactly the same depth keep the order they were added in.
+//
+// The sorted order is then split back into one list of
+// storage indices per emitter (used to pack that emitter's
+// records in draw order) and a list of "runs" of consecutive
+// particles from the same emitter (each run is one draw).
+//
+// Nothing here touches the graphics API.
+// --------------------------------------------------------
+
+// Limits of the packed (emitter, particle) sort values
+const unsigned int ParticleSortMaxEmitters = 256;
+const unsigned int ParticleSortMaxParticles = 1 << 24;
+
+// A run of consecutive particles, in sorted order, that
+// all belong to the same emitter
+struct ParticleSortRun
+{
+	unsigned int Emitter;
+	unsigned int Count;
+};
+
+class ParticleSorter
+{
+public:
+	ParticleSorter();
+
+	// Removes all particles, keeping memory for the next frame
+	void Clear();
+
+	// Adds count particles starting at the given index (wrapping
+	// around the end of the storage).  The depth transform is the
+	// third column of the emitter's world * view matrix, so a
+	// particle's view depth is dot(float4(position, 1), transform).
+	void AddParticles(
+		const ParticleStorage& storage,
+		int first,
+		int count,
+		const float depthTransform[4],
+		unsigned int emitterIndex);
+
+	// Sorts everything added so far, farthest first.  16-bit keys
+	// only use the top half of each depth's bits, so they take half
+	// as many passes but can't tell apart particles at very similar
+	// depths (which then keep the order they were added in).
+	void Sort(int keyBits = 32);
+
+	int GetCount() const;
+	unsigned int GetEmitterCount() const;
+
+	// Storage indices of one emitter's particles, in draw order
+	const unsigned int* GetEmitterOrder(unsigned int emitterIndex) const;
+	int GetEmitterParticleCount(unsigned int emitterIndex) const;
+
+	// Runs of particles from the same emitter, in draw order
+	const std::vector<ParticleSortRun>& GetRuns() const;
+
+private:
+	int count;
+	unsigned int emitterCount;
+
+	// Sort keys and packed (emitter << 24 | particle) values, plus
+	// scratch space for the radix sort to ping-pong between
+	std::vector<unsigned int> keys;
+	std::vector<unsigned int> values;
+	std::vector<unsigned int> tempKeys;
+	std::vector<unsigned int> tempValues;
+
+	// Results, split back up by emitter
+	std::vector<std::vector<unsigned int>> emitterOrders;
+	std::vector<int> emitterCounts;
+	std::vector<ParticleSortRun> runs;
+
+	void GenerateKeys(const ParticleStorage& storage, int first, int count, const float depthTransform[4], unsigned int emitterIndex);
+	void RadixSort(int keyBits);
+	void SplitByEmitter();
+};
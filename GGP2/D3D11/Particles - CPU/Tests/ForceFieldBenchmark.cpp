@@ -0,0 +1,79 @@
+#include "ForceField.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// --------------------------------------------------------
+// Particles per second through ApplyForceField() (SSE) and
+// ApplyForceFieldScalar(), plus single Sample() calls, for
+// curl noise grids small enough to stay in cache and large
+// enough not to.  Particles are scattered across the whole
+// field, so larger grids mean more scattered reads.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+static void Time(const char* label, ParticleStorage& storage, int count, int frames, const ForceField& field, ForceFieldMode mode,
+	void (*apply)(ParticleStorage&, int, int, const ForceField&, const ForceFieldParams&))
+{
+	// Strength zero, so nothing moves and every frame does the same work
+	ForceFieldParams params = { 1.0f / 60.0f, 0.0f, { 0.0f, 0.0f, 0.0f }, mode };
+
+	// Warm up
+	apply(storage, 0, count, field, params);
+
+	auto start = Clock::now();
+	for (int frame = 0; frame < frames; frame++)
+		apply(storage, 0, count, field, params);
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	double particles = (double)count * frames;
+	std::printf("  %-14s %8.1f M particles/s, %6.2f ns per particle\n", label, particles / seconds / 1e6, seconds * 1e9 / particles);
+}
+
+int main()
+{
+	const float boundsMin[3] = { -10.0f, -10.0f, -10.0f };
+	const float boundsMax[3] = { 10.0f, 10.0f, 10.0f };
+	const int gridSizes[] = { 8, 32, 64, 128 };
+	const int count = 1000000;
+
+	ParticleStorage storage;
+	storage.Allocate(count);
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> inside(-10.0f, 10.0f);
+	for (int i = 0; i < count; i++)
+	{
+		storage.PositionX[i] = storage.StartPositionX[i] = inside(rng);
+		storage.PositionY[i] = storage.StartPositionY[i] = inside(rng);
+		storage.PositionZ[i] = storage.StartPositionZ[i] = inside(rng);
+	}
+
+	for (int size : gridSizes)
+	{
+		ForceField field;
+		field.Allocate(size, size, size, boundsMin, boundsMax);
+		field.BakeCurlNoise(0.3f, 1);
+		std::printf("%d^3 grid (%.1f MB), %d particles:\n", size, size * size * size * 16.0 / (1024 * 1024), count);
+
+		Time("SSE flow", storage, count, 20, field, ForceFieldMode::Flow, ApplyForceField);
+		Time("Scalar flow", storage, count, 20, field, ForceFieldMode::Flow, ApplyForceFieldScalar);
+		Time("SSE accel", storage, count, 20, field, ForceFieldMode::Acceleration, ApplyForceField);
+		Time("Scalar accel", storage, count, 20, field, ForceFieldMode::Acceleration, ApplyForceFieldScalar);
+
+		// Single samples, summed so they can't be skipped
+		float sum = 0.0f;
+		auto start = Clock::now();
+		for (int i = 0; i < count; i++)
+		{
+			float position[3] = { storage.PositionX[i], storage.PositionY[i], storage.PositionZ[i] };
+			float v[3];
+			field.Sample(position, v);
+			sum += v[0] + v[1] + v[2];
+		}
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		std::printf("  %-14s %8.1f M samples/s,   %6.2f ns per sample (sum %.1f)\n", "Sample()", count / seconds / 1e6, seconds * 1e9 / count, sum);
+	}
+	return 0;
+}
@@ -0,0 +1,308 @@
+#include "ForceField.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// --------------------------------------------------------
+// Particles pushed through fields whose trajectories are
+// known in closed form: a vortex (which trilinear sampling
+// reproduces exactly, being linear) stepped in flow mode, and
+// a constant force in acceleration mode.  The SSE and scalar
+// kernels must agree bit for bit and both follow the golden
+// path, before and after the field makes a trip through
+// Save() and Load().  Broken files must be rejected without
+// touching the field they were loaded into.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static const float BoundsMin[3] = { -10.0f, -10.0f, -10.0f };
+static const float BoundsMax[3] = { 10.0f, 10.0f, 10.0f };
+
+// Enough to cover the SSE loop and its leftovers
+static const int ParticleCount = 11;
+
+// The arrays ApplyForceField() reads and writes
+static std::vector<float*> Arrays(ParticleStorage& s)
+{
+	return {
+		s.StartPositionX, s.StartPositionY, s.StartPositionZ,
+		s.FieldVelocityX, s.FieldVelocityY, s.FieldVelocityZ,
+		s.PositionX, s.PositionY, s.PositionZ };
+}
+
+static bool Identical(ParticleStorage& a, ParticleStorage& b)
+{
+	std::vector<float*> arraysA = Arrays(a);
+	std::vector<float*> arraysB = Arrays(b);
+	for (size_t i = 0; i < arraysA.size(); i++)
+		if (memcmp(arraysA[i], arraysB[i], sizeof(float) * ParticleCount) != 0)
+			return false;
+	return true;
+}
+
+// Takes a number of steps through a field, with the particles'
+// positions standing in for what the regular update would give
+// (they have no velocity of their own)
+static void Step(ParticleStorage& s, const ForceField& field, const ForceFieldParams& params, int steps, bool simd)
+{
+	for (int step = 0; step < steps; step++)
+	{
+		if (simd)
+			ApplyForceField(s, 0, ParticleCount, field, params);
+		else
+			ApplyForceFieldScalar(s, 0, ParticleCount, field, params);
+
+		memcpy(s.PositionX, s.StartPositionX, sizeof(float) * ParticleCount);
+		memcpy(s.PositionY, s.StartPositionY, sizeof(float) * ParticleCount);
+		memcpy(s.PositionZ, s.StartPositionZ, sizeof(float) * ParticleCount);
+	}
+}
+
+// Particles (in emitter space) placed around a circle in world space
+static void PlaceOnCircle(ParticleStorage& s, const float offset[3])
+{
+	s.Allocate(ParticleCount);
+	for (int i = 0; i < ParticleCount; i++)
+	{
+		float radius = 2.0f + 0.5f * i;
+		float angle = 0.6f * i;
+		s.StartPositionX[i] = s.PositionX[i] = radius * std::cos(angle) - offset[0];
+		s.StartPositionY[i] = s.PositionY[i] = 0.3f * i - 1.0f - offset[1];
+		s.StartPositionZ[i] = s.PositionZ[i] = radius * std::sin(angle) - offset[2];
+	}
+}
+
+// Flow through the vortex (-z, 0, x) / 10 is a rotation about the y
+// axis.  Each forward Euler step of size h turns by atan(h / 10) and
+// grows the radius by sqrt(1 + (h / 10)^2), so after n steps every
+// particle is exactly where this says it should be.
+static void CheckVortexTrajectory(const ForceField& field, float tolerance)
+{
+	ForceFieldParams params = { 1.0f / 60.0f, 3.0f, { 2.0f, 0.5f, -1.0f }, ForceFieldMode::Flow };
+	const int steps = 600;
+
+	ParticleStorage simd;
+	ParticleStorage scalar;
+	PlaceOnCircle(simd, params.Offset);
+	PlaceOnCircle(scalar, params.Offset);
+	Step(simd, field, params, steps, true);
+	Step(scalar, field, params, steps, false);
+	CHECK(Identical(simd, scalar));
+
+	double h = (double)params.Strength * params.DeltaTime / 10.0;
+	double turn = steps * std::atan(h);
+	double growth = std::pow(1.0 + h * h, steps * 0.5);
+	for (int i = 0; i < ParticleCount; i++)
+	{
+		double radius = (2.0 + 0.5 * i) * growth;
+		double angle = 0.6 * i + turn;
+		double expected[3] = {
+			radius * std::cos(angle) - params.Offset[0],
+			0.3 * i - 1.0 - params.Offset[1],
+			radius * std::sin(angle) - params.Offset[2] };
+		CHECK(std::abs(simd.StartPositionX[i] - expected[0]) < tolerance);
+		CHECK(std::abs(simd.StartPositionY[i] - expected[1]) < tolerance);
+		CHECK(std::abs(simd.StartPositionZ[i] - expected[2]) < tolerance);
+	}
+}
+
+static void VortexFlow()
+{
+	ForceField field;
+	field.Allocate(9, 5, 17, BoundsMin, BoundsMax);
+	field.BakeVortex(0.0f);
+	CheckVortexTrajectory(field, 1e-3f);
+
+	// Quantized to 16 bits on disk, so the path drifts a little
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "ForceFieldTests_Vortex.vfld";
+	CHECK(field.Save(path));
+	ForceField loaded;
+	CHECK(loaded.Load(path));
+	CheckVortexTrajectory(loaded, 5e-3f);
+	std::filesystem::remove(path);
+}
+
+// A constant force g gives velocity n * s * g after n steps of
+// size dt (s being the strength, times dt), and the position
+// moves by the sum of those, times dt
+static void ConstantAcceleration()
+{
+	const float force[3] = { 0.25f, -1.0f, 0.5f };
+	ForceField field;
+	field.Allocate(3, 4, 2, BoundsMin, BoundsMax);
+	for (int z = 0; z < 2; z++)
+		for (int y = 0; y < 4; y++)
+			for (int x = 0; x < 3; x++)
+				field.SetVector(x, y, z, force);
+	CHECK(field.GetMaxMagnitude() == std::sqrt(0.25f * 0.25f + 1.0f + 0.5f * 0.5f));
+
+	ForceFieldParams params = { 1.0f / 50.0f, 2.0f, { 0.0f, 0.0f, 0.0f }, ForceFieldMode::Acceleration };
+	const int steps = 100;
+
+	ParticleStorage simd;
+	ParticleStorage scalar;
+	PlaceOnCircle(simd, params.Offset);
+	PlaceOnCircle(scalar, params.Offset);
+	std::vector<float> start[3] = {
+		std::vector<float>(simd.StartPositionX, simd.StartPositionX + ParticleCount),
+		std::vector<float>(simd.StartPositionY, simd.StartPositionY + ParticleCount),
+		std::vector<float>(simd.StartPositionZ, simd.StartPositionZ + ParticleCount) };
+
+	// Particles fly out of the bounds, where the edge is used instead
+	Step(simd, field, params, steps, true);
+	Step(scalar, field, params, steps, false);
+	CHECK(Identical(simd, scalar));
+
+	double s = (double)params.Strength * params.DeltaTime;
+	double distance = s * params.DeltaTime * steps * (steps + 1) / 2.0;
+	for (int i = 0; i < ParticleCount; i++)
+	{
+		const float* velocity[3] = { simd.FieldVelocityX, simd.FieldVelocityY, simd.FieldVelocityZ };
+		const float* position[3] = { simd.StartPositionX, simd.StartPositionY, simd.StartPositionZ };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			CHECK(std::abs(velocity[axis][i] - steps * s * force[axis]) < 1e-4);
+			CHECK(std::abs(position[axis][i] - (start[axis][i] + distance * force[axis])) < 1e-3);
+		}
+	}
+}
+
+static void SampleClampsToEdges()
+{
+	// Field is (x, y, z) at each point, which sampling reproduces inside
+	ForceField field;
+	field.Allocate(5, 5, 5, BoundsMin, BoundsMax);
+	for (int z = 0; z < 5; z++)
+		for (int y = 0; y < 5; y++)
+			for (int x = 0; x < 5; x++)
+			{
+				float v[3] = { -10.0f + 5.0f * x, -10.0f + 5.0f * y, -10.0f + 5.0f * z };
+				field.SetVector(x, y, z, v);
+			}
+
+	float inside[3] = { 1.25f, -7.5f, 9.0f };
+	float result[3];
+	field.Sample(inside, result);
+	for (int axis = 0; axis < 3; axis++)
+		CHECK(std::abs(result[axis] - inside[axis]) < 1e-5f);
+
+	float outside[3] = { 25.0f, -100.0f, 3.0f };
+	field.Sample(outside, result);
+	CHECK(result[0] == 10.0f);
+	CHECK(result[1] == -10.0f);
+	CHECK(std::abs(result[2] - 3.0f) < 1e-5f);
+
+	// Nothing to sample yet
+	ForceField empty;
+	empty.Sample(inside, result);
+	CHECK(result[0] == 0.0f && result[1] == 0.0f && result[2] == 0.0f);
+}
+
+static void SaveLoadRoundTrip()
+{
+	ForceField field;
+	float boundsMin[3] = { -3.0f, 0.0f, 5.0f };
+	float boundsMax[3] = { 4.0f, 2.5f, 9.0f };
+	field.Allocate(17, 9, 13, boundsMin, boundsMax);
+	field.BakeCurlNoise(0.7f, 42);
+	CHECK(field.GetMaxMagnitude() == 1.0f);
+
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "ForceFieldTests_Curl.vfld";
+	CHECK(field.Save(path));
+
+	// Loading replaces whatever was there
+	ForceField loaded;
+	loaded.Allocate(2, 2, 2, BoundsMin, BoundsMax);
+	CHECK(loaded.Load(path));
+	CHECK(loaded.GetSizeX() == 17 && loaded.GetSizeY() == 9 && loaded.GetSizeZ() == 13);
+	CHECK(std::abs(loaded.GetMaxMagnitude() - 1.0f) < 1e-4f);
+
+	// Within half a step of the 16-bit quantization
+	float worstError = 0.0f;
+	for (int z = 0; z < 13; z++)
+		for (int y = 0; y < 9; y++)
+			for (int x = 0; x < 17; x++)
+			{
+				float a[3];
+				float b[3];
+				field.GetVector(x, y, z, a);
+				loaded.GetVector(x, y, z, b);
+				for (int c = 0; c < 3; c++)
+					worstError = std::max(worstError, std::abs(a[c] - b[c]));
+			}
+	CHECK(worstError <= 0.5f / 32767.0f + 1e-7f);
+
+	// Same bounds, so the same positions sample the same places
+	float position[3] = { 0.3f, 1.1f, 7.7f };
+	float a[3];
+	float b[3];
+	field.Sample(position, a);
+	loaded.Sample(position, b);
+	for (int c = 0; c < 3; c++)
+		CHECK(std::abs(a[c] - b[c]) < 1e-4f);
+
+	// Saving what was loaded gives back a file of the same shape
+	// (the scale is the loaded field's longest vector, which can
+	// land a hair off the original, so the bytes may not match)
+	std::filesystem::path again = std::filesystem::temp_directory_path() / "ForceFieldTests_Again.vfld";
+	CHECK(loaded.Save(again));
+	std::ifstream fileA(path, std::ios::binary);
+	std::ifstream fileB(again, std::ios::binary);
+	std::vector<char> bytesA((std::istreambuf_iterator<char>(fileA)), std::istreambuf_iterator<char>());
+	std::vector<char> bytesB((std::istreambuf_iterator<char>(fileB)), std::istreambuf_iterator<char>());
+	CHECK(!bytesA.empty() && bytesA.size() == bytesB.size());
+	fileA.close();
+	fileB.close();
+
+	// A file cut short, or with the wrong magic, leaves the field alone
+	std::filesystem::path broken = std::filesystem::temp_directory_path() / "ForceFieldTests_Broken.vfld";
+	{
+		std::ofstream file(broken, std::ios::binary);
+		file.write(bytesA.data(), bytesA.size() / 2);
+	}
+	ForceField untouched;
+	untouched.Allocate(3, 3, 3, BoundsMin, BoundsMax);
+	CHECK(!untouched.Load(broken));
+	CHECK(untouched.GetSizeX() == 3 && untouched.GetSizeY() == 3 && untouched.GetSizeZ() == 3);
+	{
+		std::vector<char> wrongMagic = bytesA;
+		wrongMagic[0] = 'X';
+		std::ofstream file(broken, std::ios::binary);
+		file.write(wrongMagic.data(), wrongMagic.size());
+	}
+	CHECK(!untouched.Load(broken));
+	CHECK(untouched.GetSizeX() == 3);
+	CHECK(!untouched.Load(std::filesystem::temp_directory_path() / "ForceFieldTests_Missing.vfld"));
+
+	// Nothing to save
+	CHECK(!ForceField().Save(broken));
+
+	std::filesystem::remove(path);
+	std::filesystem::remove(again);
+	std::filesystem::remove(broken);
+}
+
+int main()
+{
+	VortexFlow();
+	ConstantAcceleration();
+	SampleClampsToEdges();
+	SaveLoadRoundTrip();
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All force field tests passed\n");
+	return 0;
+}
@@ -0,0 +1,184 @@
+#include "JobSystem.h"
+#include "ParticleRing.h"
+#include "ParticleSimulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// How the per-frame emitter update scales with 1 to N threads
+// (N from the command line, or the hardware thread count).
+// Each scene is a few hundred emitters living in one shared
+// pool, updated the way Game::ForEachEmitterInParallel does
+// it: emitters past ParallelParticleThreshold are split into
+// chunks one at a time, and all the small ones are handed out
+// as one job each.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+struct BenchEmitter
+{
+	std::vector<int> BlockTable;
+	int MaxParticles;
+	int FirstAlive;
+	int LivingCount;
+};
+
+struct Scene
+{
+	const char* Name;
+	ParticleStorage Storage;
+	std::vector<BenchEmitter> Emitters;
+	long long ParticleCount = 0;
+};
+
+// Carves each emitter's blocks out of one storage, like the pool,
+// and fills them with random particles that never die
+static void BuildScene(Scene& scene, const std::vector<int>& sizes, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	int blockCount = 0;
+	for (int size : sizes)
+	{
+		BenchEmitter e;
+		e.MaxParticles = size + 37; // Room to spare, so the living range wraps
+		e.FirstAlive = (int)(rng() % e.MaxParticles);
+		e.LivingCount = size;
+		int blocks = (e.MaxParticles + ParticlePoolBlockSize - 1) / ParticlePoolBlockSize;
+		for (int b = 0; b < blocks; b++)
+			e.BlockTable.push_back(blockCount + b);
+		blockCount += blocks;
+		scene.ParticleCount += size;
+		scene.Emitters.push_back(std::move(e));
+	}
+
+	// Shuffle the blocks, since a real pool hands them out in any order
+	std::vector<int> remap(blockCount);
+	for (int b = 0; b < blockCount; b++)
+		remap[b] = b;
+	std::shuffle(remap.begin(), remap.end(), rng);
+	for (BenchEmitter& e : scene.Emitters)
+		for (int& b : e.BlockTable)
+			b = remap[b];
+
+	int capacity = blockCount * ParticlePoolBlockSize;
+	scene.Storage.Allocate(capacity);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (int i = 0; i < capacity; i++)
+	{
+		scene.Storage.StartPositionX[i] = unit(rng);
+		scene.Storage.StartPositionY[i] = unit(rng);
+		scene.Storage.StartPositionZ[i] = unit(rng);
+		scene.Storage.StartVelocityX[i] = unit(rng);
+		scene.Storage.StartVelocityY[i] = unit(rng);
+		scene.Storage.StartVelocityZ[i] = unit(rng);
+		scene.Storage.Alive[i] = 1.0f;
+	}
+}
+
+static void UpdateEmitter(ParticleStorage& storage, const BenchEmitter& e, const ParticleUpdateParams& params, JobSystem* jobs)
+{
+	ParticleRing ring(e.BlockTable, e.MaxParticles);
+	ring.ForEachChunk(e.FirstAlive, e.LivingCount, jobs, [&](int chunkStart, int chunkCount, int) {
+		ring.ForEachSegment(chunkStart, chunkCount, [&](int poolStart, int count, int) {
+			UpdateParticles(storage, poolStart, count, params); }); });
+}
+
+// Same split as Game::ForEachEmitterInParallel
+static void UpdateScene(Scene& scene, const ParticleUpdateParams& params, JobSystem& jobs)
+{
+	std::vector<const BenchEmitter*> smallEmitters;
+	for (const BenchEmitter& e : scene.Emitters)
+	{
+		if (e.LivingCount >= ParallelParticleThreshold)
+			UpdateEmitter(scene.Storage, e, params, &jobs);
+		else
+			smallEmitters.push_back(&e);
+	}
+
+	jobs.ParallelFor((int)smallEmitters.size(), [&](int i) { UpdateEmitter(scene.Storage, *smallEmitters[i], params, 0); });
+}
+
+static void Run(Scene& scene, int maxThreads)
+{
+	ParticleUpdateParams params{};
+	params.DeltaTime = 1.0f / 60.0f;
+	params.Lifetime = 1e6f; // Nothing dies, so every frame does the same work
+	params.StartSize = 1.0f;
+	params.EndSize = 2.0f;
+	params.EndColor[3] = 1.0f;
+	params.Acceleration[1] = -9.8f;
+
+	std::printf("%s: %d emitters, %lld particles\n", scene.Name, (int)scene.Emitters.size(), scene.ParticleCount);
+
+	// Roughly the same number of particles per run
+	int frames = (int)std::max(20LL, 200000000LL / scene.ParticleCount);
+	double oneThread = 0.0;
+	for (int threadCount = 1; threadCount <= maxThreads; threadCount++)
+	{
+		JobSystem jobs(threadCount - 1);
+
+		// Warm up
+		UpdateScene(scene, params, jobs);
+
+		auto start = Clock::now();
+		for (int frame = 0; frame < frames; frame++)
+			UpdateScene(scene, params, jobs);
+		double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / frames;
+
+		if (threadCount == 1)
+			oneThread = ms;
+		std::printf("  %2d thread(s): %8.3f ms per frame, %5.2fx speedup, %5.1f%% efficiency\n",
+			threadCount, ms, oneThread / ms, 100.0 * oneThread / ms / threadCount);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int maxThreads = argc > 1 ? std::atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+	if (maxThreads < 1) maxThreads = 1;
+
+	std::mt19937 rng(11);
+
+	// Hundreds of small emitters, each a single job
+	{
+		Scene scene;
+		scene.Name = "Small emitters";
+		std::vector<int> sizes(400);
+		for (int& s : sizes)
+			s = 200 + (int)(rng() % 3000);
+		BuildScene(scene, sizes, 1);
+		Run(scene, maxThreads);
+	}
+
+	// Same, plus a few big ones that get split into chunks
+	{
+		Scene scene;
+		scene.Name = "Mixed emitters";
+		std::vector<int> sizes(400);
+		for (int& s : sizes)
+			s = 200 + (int)(rng() % 3000);
+		for (int i = 0; i < 4; i++)
+			sizes.push_back(250000);
+		BuildScene(scene, sizes, 2);
+		Run(scene, maxThreads);
+	}
+
+	// Lots of emitters with very little work each, where handing
+	// out jobs costs about as much as the work itself
+	{
+		Scene scene;
+		scene.Name = "Tiny emitters";
+		std::vector<int> sizes(800, 64);
+		BuildScene(scene, sizes, 3);
+		Run(scene, maxThreads);
+	}
+
+	return 0;
+}
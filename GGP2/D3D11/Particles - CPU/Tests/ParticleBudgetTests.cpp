@@ -0,0 +1,193 @@
+#include "ParticleBudget.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// AllocateParticleBudget() on made-up emitters: the total
+// granted never passes the cap, the whole cap is handed out
+// whenever demand exceeds it, no emitter gets more than it
+// asked for, the rate and size scales stay within their
+// limits, and (all else being equal) nearer and on-screen
+// emitters get a bigger share than farther or hidden ones.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// An emitter that wants 1000 particles alive
+static ParticleBudgetRequest Request(float distance, bool onScreen = true)
+{
+	return { 500.0f, 2.0f, 5000, 1.0f, distance, onScreen };
+}
+
+static int Allocate(const ParticleBudgetSettings& settings, std::vector<ParticleBudgetRequest>& requests, std::vector<ParticleBudgetGrant>& grants)
+{
+	grants.assign(requests.size(), {});
+	return AllocateParticleBudget(settings, requests.data(), grants.data(), (int)requests.size());
+}
+
+// Checks every limit that holds no matter what was asked for
+static void CheckLimits(const ParticleBudgetSettings& settings, const std::vector<ParticleBudgetGrant>& grants, int totalGranted)
+{
+	long long demand = 0;
+	long long sum = 0;
+	for (const ParticleBudgetGrant& g : grants)
+	{
+		demand += g.Demand;
+		sum += g.ParticleLimit;
+		CHECK(g.ParticleLimit >= 0 && g.ParticleLimit <= g.Demand);
+
+		// Full grants are untouched; partial ones are floored and capped
+		if (g.ParticleLimit == g.Demand)
+		{
+			CHECK(g.RateScale == 1.0f && g.SizeScale == 1.0f);
+		}
+		else
+		{
+			CHECK(g.RateScale >= settings.MinRateScale && g.RateScale <= 1.0f);
+			CHECK(g.SizeScale >= 1.0f && g.SizeScale <= settings.MaxSizeScale);
+		}
+	}
+
+	CHECK(sum == totalGranted);
+	CHECK(totalGranted <= settings.MaxLiveParticles);
+
+	// Rounding each share down may leave less than one particle per emitter
+	if (demand > settings.MaxLiveParticles)
+		CHECK(totalGranted >= settings.MaxLiveParticles - (int)grants.size());
+	else
+		CHECK(totalGranted == demand);
+}
+
+static void EverythingFits()
+{
+	ParticleBudgetSettings settings = { 10000, 0.1f, 4.0f };
+	std::vector<ParticleBudgetRequest> requests = { Request(5.0f), Request(50.0f), Request(500.0f, false) };
+	std::vector<ParticleBudgetGrant> grants;
+	int total = Allocate(settings, requests, grants);
+
+	CHECK(total == 3000);
+	for (const ParticleBudgetGrant& g : grants)
+		CHECK(g.Demand == 1000 && g.ParticleLimit == 1000);
+	CheckLimits(settings, grants, total);
+}
+
+static void NearerAndOnScreenWin()
+{
+	ParticleBudgetSettings settings = { 2000, 0.0f, 100.0f };
+	std::vector<ParticleBudgetRequest> requests = {
+		Request(40.0f), Request(10.0f), Request(20.0f), Request(5.0f, false), Request(80.0f) };
+	std::vector<ParticleBudgetGrant> grants;
+	int total = Allocate(settings, requests, grants);
+	CheckLimits(settings, grants, total);
+
+	// Same emitter, so closer should mean at least as many particles
+	CHECK(grants[1].ParticleLimit >= grants[2].ParticleLimit);
+	CHECK(grants[2].ParticleLimit >= grants[0].ParticleLimit);
+	CHECK(grants[0].ParticleLimit >= grants[4].ParticleLimit);
+	CHECK(grants[1].ParticleLimit > grants[4].ParticleLimit);
+
+	// Hidden loses to everything on screen, even though it's closest
+	for (int i : { 0, 1, 2, 4 })
+		CHECK(grants[3].ParticleLimit < grants[i].ParticleLimit);
+
+	// And the less an emitter gets, the bigger its particles
+	CHECK(grants[4].SizeScale >= grants[0].SizeScale);
+}
+
+static void RateFloorAndSizeLimit()
+{
+	// Ten emitters sharing room for one emitter's worth
+	ParticleBudgetSettings settings = { 1000, 0.25f, 1.5f };
+	std::vector<ParticleBudgetRequest> requests;
+	for (int i = 0; i < 10; i++)
+		requests.push_back(Request(10.0f + i));
+	std::vector<ParticleBudgetGrant> grants;
+	int total = Allocate(settings, requests, grants);
+	CheckLimits(settings, grants, total);
+
+	// Each gets about a tenth, but never spawns slower than a quarter
+	// of its rate, and its size stops growing at 1.5x (not 3.2x)
+	for (const ParticleBudgetGrant& g : grants)
+	{
+		CHECK(g.ParticleLimit < g.Demand / 4);
+		CHECK(g.RateScale == 0.25f);
+		CHECK(g.SizeScale == 1.5f);
+	}
+
+	// Out of range settings are clamped rather than trusted
+	ParticleBudgetSettings odd = { 1000, 2.0f, 0.5f };
+	total = Allocate(odd, requests, grants);
+	for (const ParticleBudgetGrant& g : grants)
+	{
+		CHECK(g.RateScale <= 1.0f);
+		CHECK(g.SizeScale == 1.0f);
+	}
+}
+
+static void FullCapUsedWhenSomeNeedLittle()
+{
+	// Two tiny emitters and a huge one: the tiny ones are fully
+	// satisfied and the huge one gets everything that's left
+	ParticleBudgetSettings settings = { 10000, 0.1f, 4.0f };
+	std::vector<ParticleBudgetRequest> requests = {
+		{ 10.0f, 1.0f, 100, 1.0f, 5.0f, true },
+		{ 10.0f, 2.0f, 100, 1.0f, 5.0f, true },
+		{ 100000.0f, 1.0f, 1000000, 1.0f, 50.0f, true } };
+	std::vector<ParticleBudgetGrant> grants;
+	int total = Allocate(settings, requests, grants);
+	CheckLimits(settings, grants, total);
+
+	CHECK(grants[0].ParticleLimit == 10);
+	CHECK(grants[1].ParticleLimit == 20);
+	CHECK(grants[2].ParticleLimit >= 10000 - 30 - 1);
+	CHECK(total >= 9999);
+}
+
+static void RandomRequests(unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> rate(0.0f, 5000.0f);
+	std::uniform_real_distribution<float> lifetime(0.0f, 6.0f);
+	std::uniform_real_distribution<float> radius(0.0f, 20.0f);
+	std::uniform_real_distribution<float> distance(0.0f, 300.0f);
+
+	for (int round = 0; round < 200; round++)
+	{
+		ParticleBudgetSettings settings = { (int)(rng() % 200000), (rng() % 100) / 100.0f, 1.0f + (rng() % 80) / 10.0f };
+		std::vector<ParticleBudgetRequest> requests(1 + rng() % 64);
+		for (ParticleBudgetRequest& r : requests)
+			r = { rate(rng), lifetime(rng), (int)(rng() % 20000), radius(rng), distance(rng), rng() % 5 != 0 };
+
+		std::vector<ParticleBudgetGrant> grants;
+		int total = Allocate(settings, requests, grants);
+		CheckLimits(settings, grants, total);
+
+		// Demand is what it'd have alive at full rate, up to its maximum
+		for (size_t i = 0; i < requests.size(); i++)
+			CHECK(grants[i].Demand <= requests[i].MaxParticles);
+	}
+}
+
+int main()
+{
+	EverythingFits();
+	NearerAndOnScreenWin();
+	RateFloorAndSizeLimit();
+	FullCapUsedWhenSomeNeedLittle();
+	for (unsigned int seed = 1; seed <= 10; seed++)
+		RandomRequests(seed);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All particle budget tests passed\n");
+	return 0;
+}
@@ -0,0 +1,587 @@
+#include "ParticleCollision.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks CollideParticles() against a one-particle-at-a-time
+// reference written from the descriptions in
+// ParticleCollision.h: planes, spheres and heightfields, on
+// their own and together, with bouncing (with and without
+// restitution and friction) and killing, for emitters with
+// and without rotation and scale.
+//
+// Ranges start at an odd index and cover every length of
+// leftover tail, so the padded SIMD batch is checked too,
+// along with the particles either side of the range (which
+// must be left alone).
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// Particles either side of the range being collided
+static const int Padding = 3;
+
+// The 14 arrays the collision reads or writes, in a fixed order
+static const int ArrayCount = 14;
+static float* GetArray(ParticleStorage& s, int index)
+{
+	float* arrays[ArrayCount] = {
+		s.PositionX, s.PositionY, s.PositionZ,
+		s.StartPositionX, s.StartPositionY, s.StartPositionZ,
+		s.StartVelocityX, s.StartVelocityY, s.StartVelocityZ,
+		s.FieldVelocityX, s.FieldVelocityY, s.FieldVelocityZ,
+		s.Age, s.Alive };
+	return arrays[index];
+}
+
+static float Dot3(const float a[3], const float b[3]) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+
+// Row vector times matrix, with or without the translation
+static void TransformScalar(const float v[3], const float m[4][3], bool point, float result[3])
+{
+	for (int axis = 0; axis < 3; axis++)
+		result[axis] = v[0] * m[0][axis] + v[1] * m[1][axis] + v[2] * m[2][axis] + (point ? m[3][axis] : 0.0f);
+}
+
+// Fills in World and InverseWorld from a scale, a rotation around
+// an axis and a translation (scale first, like Transform does)
+static void SetEmitterTransform(ParticleCollisionParams& params, const float scale[3], const float axis[3], float angle, const float translation[3])
+{
+	double length = std::sqrt((double)Dot3(axis, axis));
+	double x = axis[0] / length, y = axis[1] / length, z = axis[2] / length;
+	double c = std::cos(angle), s = std::sin(angle), t = 1.0 - c;
+
+	// Rows of the rotation (row vector convention)
+	double rotation[3][3] = {
+		{ t * x * x + c,     t * x * y + s * z, t * x * z - s * y },
+		{ t * x * y - s * z, t * y * y + c,     t * y * z + s * x },
+		{ t * x * z + s * y, t * y * z - s * x, t * z * z + c } };
+
+	double m[3][3];
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 3; col++)
+			m[row][col] = scale[row] * rotation[row][col];
+
+	// Inverse of scale * rotation is rotation^T * scale^-1
+	double inverse[3][3];
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 3; col++)
+			inverse[row][col] = rotation[col][row] / scale[col];
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 3; col++)
+		{
+			params.World[row][col] = (float)m[row][col];
+			params.InverseWorld[row][col] = (float)inverse[row][col];
+		}
+	for (int col = 0; col < 3; col++)
+	{
+		params.World[3][col] = translation[col];
+		params.InverseWorld[3][col] = (float)-(translation[0] * inverse[0][col] + translation[1] * inverse[1][col] + translation[2] * inverse[2][col]);
+	}
+}
+
+static void SetIdentityTransform(ParticleCollisionParams& params)
+{
+	float one[3] = { 1, 1, 1 };
+	float up[3] = { 0, 1, 0 };
+	float zero[3] = { 0, 0, 0 };
+	SetEmitterTransform(params, one, up, 0.0f, zero);
+}
+
+
+// --------------------------------------------------------
+// The reference: one particle, one collider at a time
+// --------------------------------------------------------
+struct ReferenceParticle
+{
+	float Position[3];
+	float Velocity[3];
+	bool Alive;
+	bool Hit;
+	bool Killed;
+
+	void Respond(const float normal[3], const float surface[3], const ParticleCollisionParams& params)
+	{
+		if (!Alive)
+			return;
+
+		Hit = true;
+		for (int axis = 0; axis < 3; axis++)
+			Position[axis] = surface[axis];
+
+		if (params.Response == CollisionResponse::Kill)
+		{
+			Killed = true;
+			Alive = false;
+			return;
+		}
+
+		float normalSpeed = Dot3(Velocity, normal);
+		if (normalSpeed >= 0.0f)
+			return;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float intoSurface = normalSpeed * normal[axis];
+			float alongSurface = Velocity[axis] - intoSurface;
+			Velocity[axis] = alongSurface * (1.0f - params.Friction) - intoSurface * params.Restitution;
+		}
+	}
+};
+
+// Finds the grid triangle under a point the way TerrainMesh splits
+// its squares, then its height and normal from the triangle's corners
+static bool ReferenceHeightfield(const float* heights, int width, int depth, float spacing, const float position[3], float x, float z, float& height, float normal[3])
+{
+	float originX = position[0] - width / 2.0f * spacing;
+	float originZ = position[2] - depth / 2.0f * spacing;
+	float u = (x - originX) / spacing;
+	float w = (z - originZ) / spacing;
+	if (u < 0.0f || w < 0.0f || u > width - 1 || w > depth - 1)
+		return false;
+
+	int cellX = std::min((int)u, width - 2);
+	int cellZ = std::min((int)w, depth - 2);
+	auto corner = [&](int cx, int cz, float p[3]) {
+		p[0] = originX + cx * spacing;
+		p[1] = heights[cz * width + cx] + position[1];
+		p[2] = originZ + cz * spacing; };
+
+	// (x, z) -> (x, z + 1) -> (x + 1, z + 1), or (x, z) -> (x + 1, z + 1) -> (x + 1, z)
+	float a[3], b[3], c[3];
+	corner(cellX, cellZ, a);
+	if (w - cellZ > u - cellX)
+	{
+		corner(cellX, cellZ + 1, b);
+		corner(cellX + 1, cellZ + 1, c);
+	}
+	else
+	{
+		corner(cellX + 1, cellZ + 1, b);
+		corner(cellX + 1, cellZ, c);
+	}
+
+	float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+	normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+	normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+	float length = std::sqrt(Dot3(normal, normal));
+	for (int axis = 0; axis < 3; axis++)
+		normal[axis] /= length;
+
+	height = a[1] - (normal[0] * (x - a[0]) + normal[2] * (z - a[2])) / normal[1];
+	return true;
+}
+
+// The heightfield's data, kept for the reference
+struct TestHeightfield
+{
+	std::vector<float> Heights;
+	int Width;
+	int Depth;
+	float Spacing;
+	float Position[3];
+};
+
+static int ReferenceCollide(
+	ParticleStorage& s, int first, int count,
+	const ParticleColliders& colliders,
+	const NearbyColliders& nearby,
+	const std::vector<TestHeightfield>& fields,
+	const ParticleCollisionParams& params)
+{
+	int hits = 0;
+	for (int i = first; i < first + count; i++)
+	{
+		const float* accel = params.Acceleration;
+		float age = s.Age[i];
+		float localPosition[3] = { s.PositionX[i], s.PositionY[i], s.PositionZ[i] };
+		float localVelocity[3] = {
+			accel[0] * age + s.StartVelocityX[i] + s.FieldVelocityX[i],
+			accel[1] * age + s.StartVelocityY[i] + s.FieldVelocityY[i],
+			accel[2] * age + s.StartVelocityZ[i] + s.FieldVelocityZ[i] };
+
+		ReferenceParticle p;
+		TransformScalar(localPosition, params.World, true, p.Position);
+		TransformScalar(localVelocity, params.World, false, p.Velocity);
+		p.Alive = s.Alive[i] > 0.0f;
+		p.Hit = false;
+		p.Killed = false;
+
+		for (int index : nearby.Planes)
+		{
+			const PlaneCollider& plane = colliders.Planes[index];
+			float distance = Dot3(plane.Normal, p.Position) - plane.Distance;
+			if (distance >= 0.0f)
+				continue;
+			float surface[3];
+			for (int axis = 0; axis < 3; axis++)
+				surface[axis] = p.Position[axis] - plane.Normal[axis] * distance;
+			p.Respond(plane.Normal, surface, params);
+		}
+
+		for (int index : nearby.Spheres)
+		{
+			const SphereCollider& sphere = colliders.Spheres[index];
+			float toParticle[3];
+			for (int axis = 0; axis < 3; axis++)
+				toParticle[axis] = p.Position[axis] - sphere.Center[axis];
+			float distance = std::sqrt(Dot3(toParticle, toParticle));
+			if (distance >= sphere.Radius)
+				continue;
+
+			float normal[3] = { 0, 1, 0 };
+			if (distance > 1e-6f)
+				for (int axis = 0; axis < 3; axis++)
+					normal[axis] = toParticle[axis] / distance;
+			float surface[3];
+			for (int axis = 0; axis < 3; axis++)
+				surface[axis] = sphere.Center[axis] + normal[axis] * sphere.Radius;
+			p.Respond(normal, surface, params);
+		}
+
+		for (int index : nearby.Heightfields)
+		{
+			const TestHeightfield& field = fields[index];
+			float height;
+			float normal[3];
+			if (!ReferenceHeightfield(field.Heights.data(), field.Width, field.Depth, field.Spacing, field.Position, p.Position[0], p.Position[2], height, normal))
+				continue;
+			if (p.Position[1] >= height)
+				continue;
+			float surface[3] = { p.Position[0], height, p.Position[2] };
+			p.Respond(normal, surface, params);
+		}
+
+		if (!p.Hit)
+			continue;
+		hits++;
+
+		TransformScalar(p.Position, params.InverseWorld, true, localPosition);
+		TransformScalar(p.Velocity, params.InverseWorld, false, localVelocity);
+		float* position[3] = { s.PositionX, s.PositionY, s.PositionZ };
+		float* startPosition[3] = { s.StartPositionX, s.StartPositionY, s.StartPositionZ };
+		float* startVelocity[3] = { s.StartVelocityX, s.StartVelocityY, s.StartVelocityZ };
+		float* fieldVelocity[3] = { s.FieldVelocityX, s.FieldVelocityY, s.FieldVelocityZ };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float v = localVelocity[axis] - accel[axis] * age;
+			position[axis][i] = localPosition[axis];
+			startVelocity[axis][i] = v;
+			startPosition[axis][i] = localPosition[axis] - accel[axis] * age * age * 0.5f - v * age;
+			fieldVelocity[axis][i] = 0.0f;
+		}
+		if (p.Killed)
+			s.Alive[i] = 0.0f;
+	}
+	return hits;
+}
+
+
+// --------------------------------------------------------
+// A scene with every kind of collider, and particles spread
+// through the space around them
+// --------------------------------------------------------
+struct Scene
+{
+	ParticleColliders Colliders;
+	std::vector<TestHeightfield> Fields;
+};
+
+static Scene MakeScene()
+{
+	Scene scene;
+	scene.Colliders.Planes.push_back({ { 0, 1, 0 }, -4.0f });
+	float tilted[3] = { 0.3f, 0.9f, -0.2f };
+	float length = std::sqrt(Dot3(tilted, tilted));
+	scene.Colliders.Planes.push_back({ { tilted[0] / length, tilted[1] / length, tilted[2] / length }, -6.0f });
+	scene.Colliders.Spheres.push_back({ { -3, 0, 2 }, 1.5f });
+	scene.Colliders.Spheres.push_back({ { 4, 1, -3 }, 2.0f });
+
+	TestHeightfield field;
+	field.Width = 33;
+	field.Depth = 25;
+	field.Spacing = 0.5f;
+	field.Position[0] = 1.0f;
+	field.Position[1] = -2.0f;
+	field.Position[2] = 0.5f;
+	field.Heights.resize(field.Width * field.Depth);
+	for (int z = 0; z < field.Depth; z++)
+		for (int x = 0; x < field.Width; x++)
+			field.Heights[z * field.Width + x] = 1.5f * std::sin(x * 0.4f) * std::cos(z * 0.3f);
+
+	auto heightfield = std::make_shared<Heightfield>();
+	heightfield->SetHeights(field.Heights.data(), field.Width, field.Depth, field.Spacing, field.Position);
+	scene.Colliders.Heightfields.push_back(heightfield);
+	scene.Fields.push_back(field);
+	return scene;
+}
+
+// Random particle state, with positions picked in world space (so
+// plenty of them end up inside something) and moved into the
+// emitter's space
+static void FillParticles(ParticleStorage& s, const ParticleCollisionParams& params, const float sphereCenter[3], std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> spread(-9.0f, 9.0f);
+	std::uniform_real_distribution<float> height(-7.0f, 3.0f);
+	std::uniform_real_distribution<float> speed(-3.0f, 3.0f);
+	std::uniform_real_distribution<float> age(0.0f, 2.0f);
+	for (int i = 0; i < s.GetCapacity(); i++)
+	{
+		float world[3] = { spread(rng), height(rng), spread(rng) };
+		float local[3];
+		TransformScalar(world, params.InverseWorld, true, local);
+		s.PositionX[i] = local[0];
+		s.PositionY[i] = local[1];
+		s.PositionZ[i] = local[2];
+		s.StartPositionX[i] = spread(rng);
+		s.StartPositionY[i] = spread(rng);
+		s.StartPositionZ[i] = spread(rng);
+		s.StartVelocityX[i] = speed(rng);
+		s.StartVelocityY[i] = speed(rng);
+		s.StartVelocityZ[i] = speed(rng);
+		s.FieldVelocityX[i] = speed(rng) * 0.1f;
+		s.FieldVelocityY[i] = speed(rng) * 0.1f;
+		s.FieldVelocityZ[i] = speed(rng) * 0.1f;
+		s.Age[i] = age(rng);
+		s.Alive[i] = rng() % 8 == 0 ? 0.0f : 1.0f;
+	}
+
+	// One right at the center of a sphere, which has no direction
+	// to be pushed out along
+	if (s.GetCapacity() > Padding)
+	{
+		float local[3];
+		TransformScalar(sphereCenter, params.InverseWorld, true, local);
+		s.PositionX[Padding] = local[0];
+		s.PositionY[Padding] = local[1];
+		s.PositionZ[Padding] = local[2];
+		s.Alive[Padding] = 1.0f;
+	}
+}
+
+static bool Close(float a, float b)
+{
+	return std::fabs(a - b) <= 2e-4f * (1.0f + std::fabs(a) + std::fabs(b));
+}
+
+static int totalHits = 0;
+
+static void CheckAgainstReference(const Scene& scene, const NearbyColliders& nearby, const ParticleCollisionParams& params, int count, unsigned int seed, const char* label)
+{
+	int capacity = Padding + count + Padding;
+	ParticleStorage actual;
+	ParticleStorage expected;
+	actual.Allocate(capacity);
+	expected.Allocate(capacity);
+
+	std::mt19937 rng(seed);
+	FillParticles(actual, params, scene.Colliders.Spheres[0].Center, rng);
+	for (int a = 0; a < ArrayCount; a++)
+		for (int i = 0; i < capacity; i++)
+			GetArray(expected, a)[i] = GetArray(actual, a)[i];
+
+	int hits = CollideParticles(actual, Padding, count, scene.Colliders, nearby, params);
+	int expectedHits = ReferenceCollide(expected, Padding, count, scene.Colliders, nearby, scene.Fields, params);
+	totalHits += hits;
+
+	if (hits != expectedHits)
+	{
+		std::printf("%s, count %d: %d hits, expected %d\n", label, count, hits, expectedHits);
+		failures++;
+	}
+
+	for (int a = 0; a < ArrayCount; a++)
+	{
+		const float* got = GetArray(actual, a);
+		const float* want = GetArray(expected, a);
+		for (int i = 0; i < capacity; i++)
+		{
+			// Outside the range nothing may change at all
+			bool inRange = i >= Padding && i < Padding + count;
+			if (inRange ? Close(got[i], want[i]) : got[i] == want[i])
+				continue;
+			std::printf("%s, count %d: array %d, particle %d is %g, expected %g\n", label, count, a, i, got[i], want[i]);
+			failures++;
+			return;
+		}
+	}
+}
+
+
+// --------------------------------------------------------
+// Simple cases where the right answer is known outright
+// --------------------------------------------------------
+static void CheckKnownBounces()
+{
+	ParticleColliders colliders;
+	colliders.Planes.push_back({ { 0, 1, 0 }, 0.0f });
+	NearbyColliders nearby;
+	nearby.Planes.push_back(0);
+
+	// Straight onto a floor: pushed up to it, the speed into it
+	// scaled by restitution and the speed along it by 1 - friction
+	{
+		ParticleCollisionParams params = { CollisionResponse::Bounce, 0.5f, 0.25f, { 0, 0, 0 }, {}, {} };
+		SetIdentityTransform(params);
+
+		ParticleStorage s;
+		s.Allocate(1);
+		s.PositionY[0] = -0.1f;
+		s.StartVelocityX[0] = 2.0f;
+		s.StartVelocityY[0] = -4.0f;
+		s.Alive[0] = 1.0f;
+
+		CHECK(CollideParticles(s, 0, 1, colliders, nearby, params) == 1);
+		CHECK(s.PositionY[0] == 0.0f);
+		CHECK(Close(s.StartVelocityX[0], 1.5f));
+		CHECK(Close(s.StartVelocityY[0], 2.0f));
+		CHECK(s.Alive[0] == 1.0f);
+
+		// Moving away already: pushed out, but the velocity's kept
+		s.PositionY[0] = -0.1f;
+		CHECK(CollideParticles(s, 0, 1, colliders, nearby, params) == 1);
+		CHECK(Close(s.StartVelocityY[0], 2.0f));
+	}
+
+	// A rotated and scaled emitter: the particle has to end up on
+	// the world floor, wherever that is in the emitter's space, and
+	// its curve has to continue from there
+	{
+		ParticleCollisionParams params = { CollisionResponse::Bounce, 1.0f, 0.0f, { 0, -1, 0 }, {}, {} };
+		float scale[3] = { 2.0f, 0.5f, 1.0f };
+		float axis[3] = { 0.2f, 0.4f, 1.0f };
+		float translation[3] = { 1.0f, 3.0f, -2.0f };
+		SetEmitterTransform(params, scale, axis, 1.1f, translation);
+
+		float worldStart[3] = { 0.5f, -0.25f, 0.75f };
+		float local[3];
+		TransformScalar(worldStart, params.InverseWorld, true, local);
+
+		ParticleStorage s;
+		s.Allocate(1);
+		s.PositionX[0] = local[0];
+		s.PositionY[0] = local[1];
+		s.PositionZ[0] = local[2];
+		s.StartVelocityY[0] = -1.0f;
+		s.Age[0] = 0.5f;
+		s.Alive[0] = 1.0f;
+
+		CHECK(CollideParticles(s, 0, 1, colliders, nearby, params) == 1);
+		float position[3] = { s.PositionX[0], s.PositionY[0], s.PositionZ[0] };
+		float world[3];
+		TransformScalar(position, params.World, true, world);
+		CHECK(std::fabs(world[0] - worldStart[0]) < 1e-5f);
+		CHECK(std::fabs(world[1]) < 1e-5f);
+		CHECK(std::fabs(world[2] - worldStart[2]) < 1e-5f);
+
+		// The restarted curve passes through the new position at the particle's age
+		float age = s.Age[0];
+		float curve[3] = {
+			s.StartPositionX[0] + s.StartVelocityX[0] * age + params.Acceleration[0] * age * age * 0.5f,
+			s.StartPositionY[0] + s.StartVelocityY[0] * age + params.Acceleration[1] * age * age * 0.5f,
+			s.StartPositionZ[0] + s.StartVelocityZ[0] * age + params.Acceleration[2] * age * age * 0.5f };
+		for (int a = 0; a < 3; a++)
+			CHECK(Close(curve[a], position[a]));
+
+		// And the world velocity now points up, away from the floor
+		float velocity[3] = {
+			s.StartVelocityX[0] + params.Acceleration[0] * age,
+			s.StartVelocityY[0] + params.Acceleration[1] * age,
+			s.StartVelocityZ[0] + params.Acceleration[2] * age };
+		float worldVelocity[3];
+		TransformScalar(velocity, params.World, false, worldVelocity);
+		CHECK(worldVelocity[1] > 0.0f);
+	}
+
+	// Killed particles stop being alive, and don't collide again
+	{
+		ParticleCollisionParams params = { CollisionResponse::Kill, 0.5f, 0.5f, { 0, 0, 0 }, {}, {} };
+		SetIdentityTransform(params);
+		ParticleStorage s;
+		s.Allocate(1);
+		s.PositionY[0] = -1.0f;
+		s.Alive[0] = 1.0f;
+		CHECK(CollideParticles(s, 0, 1, colliders, nearby, params) == 1);
+		CHECK(s.Alive[0] == 0.0f);
+		s.PositionY[0] = -1.0f;
+		CHECK(CollideParticles(s, 0, 1, colliders, nearby, params) == 0);
+	}
+}
+
+int main()
+{
+	CheckKnownBounces();
+
+	Scene scene = MakeScene();
+	NearbyColliders all;
+	float boundsMin[3] = { -100, -100, -100 };
+	float boundsMax[3] = { 100, 100, 100 };
+	CHECK(scene.Colliders.FindNearby(boundsMin, boundsMax, all));
+	CHECK(all.Planes.size() == 2 && all.Spheres.size() == 2 && all.Heightfields.size() == 1);
+
+	NearbyColliders planes;
+	planes.Planes = all.Planes;
+	NearbyColliders spheres;
+	spheres.Spheres = all.Spheres;
+	NearbyColliders heightfields;
+	heightfields.Heightfields = all.Heightfields;
+
+	struct { const char* Name; const NearbyColliders* Nearby; } colliderSets[] = {
+		{ "planes", &planes },
+		{ "spheres", &spheres },
+		{ "heightfield", &heightfields },
+		{ "everything", &all } };
+
+	struct { const char* Name; CollisionResponse Response; float Restitution; float Friction; } responses[] = {
+		{ "bounce", CollisionResponse::Bounce, 0.6f, 0.25f },
+		{ "slide", CollisionResponse::Bounce, 0.0f, 0.0f },
+		{ "kill", CollisionResponse::Kill, 0.5f, 0.5f } };
+
+	// Every tail length, plus longer ranges
+	int counts[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 64, 1001 };
+
+	unsigned int seed = 1;
+	for (int transformed = 0; transformed < 2; transformed++)
+		for (auto& set : colliderSets)
+			for (auto& response : responses)
+			{
+				ParticleCollisionParams params = { response.Response, response.Restitution, response.Friction, { 0.5f, -9.8f, 0.25f }, {}, {} };
+				if (transformed)
+				{
+					float scale[3] = { 1.5f, 0.75f, 1.25f };
+					float axis[3] = { 0.3f, 1.0f, -0.2f };
+					float translation[3] = { 0.5f, 1.0f, -0.75f };
+					SetEmitterTransform(params, scale, axis, 0.7f, translation);
+				}
+				else
+					SetIdentityTransform(params);
+
+				char label[64];
+				std::snprintf(label, sizeof(label), "%s, %s%s", set.Name, response.Name, transformed ? ", transformed" : "");
+				for (int count : counts)
+					CheckAgainstReference(scene, *set.Nearby, params, count, seed++, label);
+			}
+
+	// Make sure the comparisons weren't all of particles that missed
+	CHECK(totalHits > 3000);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All particle collision tests passed (%d collisions compared)\n", totalHits);
+	return 0;
+}
@@ -0,0 +1,106 @@
+#include "ParticleSimulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+// --------------------------------------------------------
+// The two ways an emitter can move its particles forward:
+// incrementally (UpdateParticles() every frame) and closed
+// form (EvaluateParticles() from spawn data, only when the
+// emitter is drawn).  Times a visible frame of each, then
+// fast-forwarding 10 seconds - 600 incremental steps versus
+// a single evaluation - along with how far apart the two
+// end up (incremental ages are a running sum of time steps,
+// closed-form ones are a single subtraction).
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+template<typename Func>
+static double TimeMs(Func func, int repeats)
+{
+	auto start = Clock::now();
+	for (int r = 0; r < repeats; r++)
+		func();
+	return std::chrono::duration<double>(Clock::now() - start).count() * 1e3 / repeats;
+}
+
+// A full ring of particles, one spawned every emitInterval
+// seconds, with the oldest at first (so the range wraps)
+static void Spawn(ParticleStorage& s, int count, int first, float emitInterval, float time)
+{
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	s.Allocate(count);
+	for (int n = 0; n < count; n++)
+	{
+		int i = (first + n) % count;
+		s.SpawnTime[i] = time - (count - n) * emitInterval;
+		s.Age[i] = time - s.SpawnTime[i];
+		s.StartPositionX[i] = unit(rng);
+		s.StartPositionY[i] = unit(rng);
+		s.StartPositionZ[i] = unit(rng);
+		s.StartVelocityX[i] = unit(rng);
+		s.StartVelocityY[i] = unit(rng) + 3.0f;
+		s.StartVelocityZ[i] = unit(rng);
+		s.RotationEnd[i] = unit(rng) * 3.0f;
+		s.Alive[i] = 1.0f;
+	}
+}
+
+int main()
+{
+	const float dt = 1.0f / 60.0f;
+	const int fastForwardFrames = 600;
+
+	ParticleUpdateParams params{};
+	params.Lifetime = 1000.0f; // Nothing dies, so every frame does the same work
+	params.StartSize = 0.5f;
+	params.EndSize = 2.0f;
+	params.EndColor[0] = 1.0f;
+	params.EndColor[3] = 1.0f;
+	params.Acceleration[1] = -9.8f;
+
+	std::printf("Kernel: %s\n", GetParticleKernelName());
+	for (int count : { 10000, 100000, 1000000 })
+	{
+		int first = count / 3;
+		int repeats = std::max(1, 20000000 / count);
+		float emitInterval = 20.0f / count;
+		float time = 20.0f;
+
+		// One visible frame of each
+		ParticleStorage incremental;
+		Spawn(incremental, count, first, emitInterval, time);
+		params.DeltaTime = dt;
+		double updateMs = TimeMs([&]() { UpdateParticles(incremental, first, count, params); }, repeats);
+
+		ParticleStorage closedForm;
+		Spawn(closedForm, count, first, emitInterval, time);
+		double evaluateMs = TimeMs([&]() { EvaluateParticles(closedForm, first, count, time, params); }, repeats);
+
+		// Fast-forwarding 10 seconds
+		ParticleStorage stepped;
+		Spawn(stepped, count, first, emitInterval, time);
+		double steppedMs = TimeMs([&]() {
+			for (int f = 0; f < fastForwardFrames; f++)
+				UpdateParticles(stepped, first, count, params);
+		}, 1);
+
+		ParticleStorage jumped;
+		Spawn(jumped, count, first, emitInterval, time);
+		float endTime = time + fastForwardFrames * dt;
+		double jumpedMs = TimeMs([&]() { EvaluateParticles(jumped, first, count, endTime, params); }, 1);
+
+		float maxDifference = 0.0f;
+		for (int i = 0; i < count; i++)
+			maxDifference = std::max(maxDifference, std::abs(stepped.PositionY[i] - jumped.PositionY[i]));
+
+		std::printf("%8d particles: frame %7.3f ms incremental, %7.3f ms closed form | 10 s ahead %8.2f ms stepped, %6.3f ms evaluated (%.0fx), max drift %.2g\n",
+			count, updateMs, evaluateMs, steppedMs, jumpedMs, steppedMs / jumpedMs, maxDifference);
+	}
+	return 0;
+}
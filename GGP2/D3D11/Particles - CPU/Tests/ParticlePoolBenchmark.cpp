@@ -0,0 +1,53 @@
+#include "ParticlePool.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Acquire/release throughput of the pool's lock-free free
+// stack with 1 to N threads hammering it at once (N from
+// the command line, or the hardware thread count).  Each
+// thread holds a few blocks at a time, like an emitter
+// growing and shrinking.
+// --------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+	int maxThreads = argc > 1 ? std::atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+	if (maxThreads < 1) maxThreads = 1;
+
+	const int operationsPerThread = 2000000;
+	const int heldPerThread = 8;
+
+	for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+	{
+		ParticlePool pool(threadCount * heldPerThread * 2);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<std::thread> threads;
+		for (int t = 0; t < threadCount; t++)
+		{
+			threads.emplace_back([&]() {
+				int held[heldPerThread];
+				for (int op = 0; op < operationsPerThread; op += heldPerThread * 2)
+				{
+					for (int i = 0; i < heldPerThread; i++)
+						held[i] = pool.AcquireBlock();
+					for (int i = 0; i < heldPerThread; i++)
+						pool.ReleaseBlock(held[i]);
+				}
+			});
+		}
+		for (std::thread& thread : threads)
+			thread.join();
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		double operations = (double)operationsPerThread * threadCount;
+		std::printf("%2d thread(s): %6.1f M operations/s total, %5.1f ns per operation per thread\n",
+			threadCount, operations / seconds / 1e6, seconds * 1e9 / operationsPerThread);
+	}
+	return 0;
+}
@@ -0,0 +1,157 @@
+#include "ParticlePool.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Stress test for the pool's lock-free free stack: several
+// threads acquire and release blocks as fast as they can,
+// and each block's owner is tracked on the side, so the test
+// catches a block handed to two threads at once, a block
+// lost or duplicated on the stack, and (through the block's
+// particle data) writes that aren't published to the next
+// owner.  Meant to be run under ThreadSanitizer too (see
+// CMakeLists.txt).
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static const int NoOwner = -1;
+
+static void Stress(int blockCount, int threadCount, int operationsPerThread, int maxHeldPerThread)
+{
+	ParticlePool pool(blockCount);
+	std::unique_ptr<std::atomic<int>[]> owners = std::make_unique<std::atomic<int>[]>(blockCount);
+	for (int b = 0; b < blockCount; b++)
+		owners[b] = NoOwner;
+
+	std::atomic<int> doubleIssues = 0;
+	std::atomic<int> staleData = 0;
+	std::atomic<int> badIndices = 0;
+
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([&, t]() {
+			std::vector<int> held;
+			unsigned int rng = 0x9E3779B9u * (t + 1);
+			for (int op = 0; op < operationsPerThread; op++)
+			{
+				rng = rng * 1664525u + 1013904223u;
+				bool acquire = held.empty() || ((rng >> 16) & 1 && (int)held.size() < maxHeldPerThread);
+				if (acquire)
+				{
+					int block = pool.AcquireBlock();
+					if (block < 0)
+						continue;
+					if (block >= blockCount)
+					{
+						badIndices++;
+						continue;
+					}
+
+					// Nobody else may own it
+					int expected = NoOwner;
+					if (!owners[block].compare_exchange_strong(expected, t))
+						doubleIssues++;
+
+					// Write through the block's particles, like an emitter would
+					int start = ParticlePool::GetBlockStart(block);
+					for (int i = 0; i < ParticlePoolBlockSize; i++)
+						pool.Storage.Age[start + i] = (float)(t * 1000 + op % 1000);
+					held.push_back(block);
+				}
+				else
+				{
+					size_t pick = (rng >> 8) % held.size();
+					int block = held[pick];
+					held[pick] = held.back();
+					held.pop_back();
+
+					// Data must be what this thread wrote
+					int start = ParticlePool::GetBlockStart(block);
+					float mine = pool.Storage.Age[start];
+					for (int i = 1; i < ParticlePoolBlockSize; i++)
+					{
+						if (pool.Storage.Age[start + i] != mine)
+							staleData++;
+					}
+					if ((int)mine / 1000 != t)
+						staleData++;
+
+					int expected = t;
+					if (!owners[block].compare_exchange_strong(expected, NoOwner))
+						doubleIssues++;
+					pool.ReleaseBlock(block);
+				}
+			}
+
+			for (int block : held)
+			{
+				owners[block] = NoOwner;
+				pool.ReleaseBlock(block);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	CHECK(doubleIssues == 0);
+	CHECK(staleData == 0);
+	CHECK(badIndices == 0);
+
+	// Conservation: every block is back, exactly once
+	CHECK(pool.GetFreeBlockCount() == blockCount);
+	std::vector<int> seen(blockCount, 0);
+	int drained = 0;
+	int block;
+	while ((block = pool.AcquireBlock()) >= 0)
+	{
+		CHECK(block < blockCount);
+		if (block < blockCount)
+			seen[block]++;
+		drained++;
+	}
+	CHECK(drained == blockCount);
+	for (int b = 0; b < blockCount; b++)
+		CHECK(seen[b] == 1);
+	CHECK(pool.GetFreeBlockCount() == 0);
+
+	if (failures > 0)
+		std::printf("Failed with %d blocks, %d threads\n", blockCount, threadCount);
+}
+
+int main()
+{
+	// Roomy pool, and one small enough that threads keep running it dry
+	Stress(256, 4, 200000, 64);
+	Stress(8, 8, 100000, 4);
+
+	// Single-threaded order: block 0 on top, and last released comes back first
+	{
+		ParticlePool pool(4);
+		CHECK(pool.AcquireBlock() == 0);
+		CHECK(pool.AcquireBlock() == 1);
+		pool.ReleaseBlock(0);
+		CHECK(pool.AcquireBlock() == 0);
+		pool.ReleaseBlock(-1);
+		pool.ReleaseBlock(4);
+		CHECK(pool.GetFreeBlockCount() == 2);
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All ParticlePool tests passed\n");
+	return 0;
+}
@@ -0,0 +1,184 @@
+#include "ParticleRandom.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks that ParticleRandom::Discard() leaves the stream
+// exactly where using the values one at a time would, for
+// short skips (stepped) and long ones (jumped), and that
+// the cost of a skip grows with its number of bits, not its
+// length.  Also checks that FillUniform() gives the same
+// values as NextFloat() and that they really are uniform:
+// always in range, with the right mean and variance, and
+// evenly spread over the range.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// Compares the next few values of two streams
+static bool SameNextValues(ParticleRandom& a, ParticleRandom& b)
+{
+	for (int i = 0; i < 17; i++)
+	{
+		if (a.NextUInt() != b.NextUInt())
+			return false;
+	}
+	return true;
+}
+
+// Discard(count) against count calls to NextUInt(), starting with
+// some values already used (so a partial step is buffered)
+static void CheckAgainstStepping(unsigned long long seed, int alreadyUsed, long long count)
+{
+	ParticleRandom stepped(seed);
+	ParticleRandom skipped(seed);
+	for (int i = 0; i < alreadyUsed; i++)
+	{
+		stepped.NextUInt();
+		skipped.NextUInt();
+	}
+
+	for (long long i = 0; i < count; i++)
+		stepped.NextUInt();
+	skipped.Discard(count);
+
+	if (!SameNextValues(stepped, skipped))
+	{
+		std::printf("Discard(%lld) after %d values doesn't match stepping (seed %llu)\n", count, alreadyUsed, seed);
+		failures++;
+	}
+}
+
+// FillUniform() against the same number of NextFloat() calls, in
+// pieces of awkward sizes so leftovers get carried between calls
+static void FillMatchesNextFloat(unsigned long long seed)
+{
+	ParticleRandom filled(seed);
+	ParticleRandom single(seed);
+	std::vector<float> values(1000);
+	for (int count : { 1, 3, 4, 7, 13, 64, 101, 2, 999 })
+	{
+		filled.FillUniform(values.data(), count, -2.5f, 7.0f);
+		bool same = true;
+		for (int i = 0; i < count; i++)
+			same = same && values[i] == single.NextFloat(-2.5f, 7.0f);
+		CHECK(same);
+	}
+	CHECK(SameNextValues(filled, single));
+}
+
+// Range, mean, variance and a chi-squared test of evenness over
+// a few million values (the limits are about 5 standard deviations)
+static void FillIsUniform(unsigned long long seed, float min, float max)
+{
+	const int count = 1 << 22;
+	const int bins = 64;
+	std::vector<float> values(count);
+	ParticleRandom random(seed);
+	random.FillUniform(values.data(), count, min, max);
+
+	bool inRange = true;
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	std::vector<int> histogram(bins, 0);
+	for (float v : values)
+	{
+		inRange = inRange && v >= min && v < max;
+		sum += v;
+		sumSquares += (double)v * v;
+		int bin = (int)((v - min) / (max - min) * bins);
+		histogram[bin < 0 ? 0 : bin >= bins ? bins - 1 : bin]++;
+	}
+	CHECK(inRange);
+
+	double range = (double)max - min;
+	double mean = sum / count;
+	double variance = sumSquares / count - mean * mean;
+	double expectedMean = (min + (double)max) / 2.0;
+	double expectedVariance = range * range / 12.0;
+	CHECK(std::abs(mean - expectedMean) < 5.0 * std::sqrt(expectedVariance / count));
+	CHECK(std::abs(variance / expectedVariance - 1.0) < 5.0 * std::sqrt(0.8 / count));
+
+	// 63 degrees of freedom: mean 63, standard deviation ~11.2
+	double expected = (double)count / bins;
+	double chiSquared = 0.0;
+	for (int b = 0; b < bins; b++)
+		chiSquared += (histogram[b] - expected) * (histogram[b] - expected) / expected;
+	CHECK(chiSquared < 63.0 + 5.0 * 11.2);
+
+	std::printf("FillUniform [%g, %g): mean %.5f (expected %.5f), variance %.5f (expected %.5f), chi-squared %.1f\n",
+		min, max, mean, expectedMean, variance, expectedVariance, chiSquared);
+}
+
+int main()
+{
+	for (unsigned long long seed : { 1ull, 42ull, 0xDEADBEEFull })
+		FillMatchesNextFloat(seed);
+	FillIsUniform(1, 0.0f, 1.0f);
+	FillIsUniform(2, -3.0f, 5.0f);
+	FillIsUniform(3, 100.0f, 100.5f);
+
+	// Short skips, and around the point where stepping turns into jumping
+	for (int used = 0; used < 4; used++)
+		for (long long count : { 0ll, 1ll, 3ll, 4ll, 5ll, 1000ll, 32767ll, 32768ll, 32769ll, 32771ll, 40001ll })
+			CheckAgainstStepping(12345, used, count);
+
+	// Long skips, still short enough to step through
+	CheckAgainstStepping(1, 0, 1 << 20);
+	CheckAgainstStepping(2, 3, 12345679);
+	CheckAgainstStepping(3, 1, 100000002);
+
+	// Skips far too long to step: one jump should match two halves, and
+	// a jump then a step should match a step then a jump
+	{
+		const long long huge = 1ll << 50;
+		ParticleRandom whole(7), halves(7);
+		whole.Discard(huge + 6);
+		halves.Discard(huge / 2 + 3);
+		halves.Discard(huge / 2 + 3);
+		CHECK(SameNextValues(whole, halves));
+
+		ParticleRandom jumpFirst(8), stepFirst(8);
+		jumpFirst.Discard(huge);
+		jumpFirst.Discard(5);
+		stepFirst.Discard(5);
+		stepFirst.Discard(huge);
+		CHECK(SameNextValues(jumpFirst, stepFirst));
+	}
+
+	// Cost should only grow with the number of bits in the skip:
+	// doubling them (rather than squaring the distance) should take
+	// about twice as long, not a billion times as long
+	{
+		ParticleRandom random(9);
+		random.Discard(1 << 20); // Builds the jump tables
+
+		const int repeats = 1000;
+		double seconds[2] = {};
+		long long counts[2] = { 1ll << 30, 1ll << 60 };
+		for (int c = 0; c < 2; c++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int r = 0; r < repeats; r++)
+				random.Discard(counts[c] - 1);
+			seconds[c] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			std::printf("Discard(%lld): %.2f us\n", counts[c] - 1, seconds[c] * 1e6 / repeats);
+		}
+		CHECK(seconds[1] < seconds[0] * 8.0);
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All ParticleRandom tests passed\n");
+	return 0;
+}
@@ -0,0 +1,71 @@
+#include "ParticleSimulation.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+// --------------------------------------------------------
+// Particles per second through UpdateParticles() (the SIMD
+// kernel) and UpdateParticlesScalar(), for emitters small
+// enough to stay in cache and large enough not to.  The
+// larger ranges start off a block boundary and wrap, the
+// way a ring of living particles usually does.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+static void Time(const char* label, ParticleStorage& storage, int first, int count, int frames, int (*update)(ParticleStorage&, int, int, const ParticleUpdateParams&))
+{
+	ParticleUpdateParams params{};
+	params.DeltaTime = 1.0f / 60.0f;
+	params.Lifetime = 1e6f; // Nothing dies, so every frame does the same work
+	params.StartSize = 1.0f;
+	params.EndSize = 2.0f;
+	params.EndColor[3] = 1.0f;
+	params.Acceleration[1] = -9.8f;
+
+	// Warm up
+	int dead = update(storage, first, count, params);
+
+	auto start = Clock::now();
+	for (int frame = 0; frame < frames; frame++)
+		dead += update(storage, first, count, params);
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	double particles = (double)count * frames;
+	std::printf("%-8s %9d particles: %8.1f M particles/s, %6.2f ns per particle%s\n",
+		label, count, particles / seconds / 1e6, seconds * 1e9 / particles, dead ? " (some died!)" : "");
+}
+
+int main()
+{
+	std::printf("Kernel: %s\n", GetParticleKernelName());
+
+	const int counts[] = { 1000, 10000, 100000, 1000000, 4000000 };
+	for (int count : counts)
+	{
+		// A little room to spare, like an emitter's ring that isn't full
+		int capacity = count + 13;
+		ParticleStorage storage;
+		storage.Allocate(capacity);
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		for (int i = 0; i < capacity; i++)
+		{
+			storage.StartPositionX[i] = unit(rng);
+			storage.StartPositionY[i] = unit(rng);
+			storage.StartPositionZ[i] = unit(rng);
+			storage.StartVelocityX[i] = unit(rng);
+			storage.StartVelocityY[i] = unit(rng);
+			storage.StartVelocityZ[i] = unit(rng);
+			storage.Alive[i] = 1.0f;
+		}
+
+		// Roughly the same number of particles per run
+		int frames = (int)(50000000LL / count);
+		int first = capacity - 61; // Starts off a block, and wraps
+		Time("SIMD", storage, first, count, frames, UpdateParticles);
+		Time("Scalar", storage, first, count, frames, UpdateParticlesScalar);
+	}
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include "ParticleSimulation.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// UpdateParticles() (AVX or SSE, plus scalar ends) against
+// UpdateParticlesScalar() on identical random storage, for
+// ranges that start and end off the 8-wide blocks and rings
+// that wrap around the end of the storage.  Both must write
+// bit-identical results, report the same number of deaths,
+// and leave every particle outside the range untouched.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// Every array, in storage order, so two storages can be compared
+static std::vector<float*> Arrays(ParticleStorage& s)
+{
+	return {
+		s.SpawnTime, s.Age, s.StartPositionX, s.StartPositionY, s.StartPositionZ,
+		s.StartVelocityX, s.StartVelocityY, s.StartVelocityZ,
+		s.RotationStart, s.RotationEnd,
+		s.FieldVelocityX, s.FieldVelocityY, s.FieldVelocityZ,
+		s.Alive,
+		s.PositionX, s.PositionY, s.PositionZ,
+		s.ColorR, s.ColorG, s.ColorB, s.ColorA,
+		s.Size, s.Rotation };
+}
+
+// Random spawn data and ages, with some particles killed by
+// collisions and some about to reach the end of their lifetime
+static void Fill(ParticleStorage& s, int capacity, float lifetime, unsigned int seed)
+{
+	s.Allocate(capacity);
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> age(0.0f, lifetime * 1.05f);
+	for (float* a : Arrays(s))
+		for (int i = 0; i < capacity; i++)
+			a[i] = unit(rng) * 10.0f;
+	for (int i = 0; i < capacity; i++)
+	{
+		s.Age[i] = age(rng);
+		s.Alive[i] = rng() % 5 == 0 ? 0.0f : 1.0f;
+	}
+}
+
+static ParticleUpdateParams TestParams()
+{
+	ParticleUpdateParams p{};
+	p.DeltaTime = 1.0f / 60.0f;
+	p.Lifetime = 2.5f;
+	p.StartSize = 0.25f;
+	p.EndSize = 1.5f;
+	float start[4] = { 1.0f, 0.5f, 0.25f, 1.0f };
+	float end[4] = { 0.1f, 0.2f, 0.9f, 0.0f };
+	std::memcpy(p.StartColor, start, sizeof(start));
+	std::memcpy(p.EndColor, end, sizeof(end));
+	p.Acceleration[0] = 0.5f;
+	p.Acceleration[1] = -9.8f;
+	p.Acceleration[2] = 1.25f;
+	return p;
+}
+
+static bool InRange(int i, int first, int count, int capacity)
+{
+	return (i - first + capacity) % capacity < count;
+}
+
+static void CompareKernels(int capacity, int first, int count, int steps, unsigned int seed)
+{
+	ParticleUpdateParams params = TestParams();
+	ParticleStorage simd;
+	ParticleStorage scalar;
+	ParticleStorage original;
+	Fill(simd, capacity, params.Lifetime, seed);
+	Fill(scalar, capacity, params.Lifetime, seed);
+	Fill(original, capacity, params.Lifetime, seed);
+
+	for (int step = 0; step < steps; step++)
+	{
+		// Deaths are whatever has aged past the lifetime
+		int expectedDead = 0;
+		for (int i = 0; i < count && i < capacity; i++)
+			if (scalar.Age[(first + i) % capacity] + params.DeltaTime >= params.Lifetime)
+				expectedDead++;
+
+		int simdDead = UpdateParticles(simd, first, count, params);
+		int scalarDead = UpdateParticlesScalar(scalar, first, count, params);
+		CHECK(simdDead == scalarDead);
+		CHECK(scalarDead == expectedDead);
+	}
+
+	std::vector<float*> a = Arrays(simd);
+	std::vector<float*> b = Arrays(scalar);
+	std::vector<float*> o = Arrays(original);
+	for (size_t array = 0; array < a.size(); array++)
+	{
+		for (int i = 0; i < capacity; i++)
+		{
+			// Same bits, not just close
+			bool same = std::memcmp(&a[array][i], &b[array][i], sizeof(float)) == 0;
+			bool untouched = std::memcmp(&a[array][i], &o[array][i], sizeof(float)) == 0;
+			CHECK(same);
+			if (!InRange(i, first, count, capacity))
+				CHECK(untouched);
+			if (!same || (!InRange(i, first, count, capacity) && !untouched))
+			{
+				std::printf("  capacity %d, first %d, count %d: array %zu, particle %d\n", capacity, first, count, array, i);
+				return;
+			}
+		}
+	}
+}
+
+int main()
+{
+	std::printf("Kernel: %s\n", GetParticleKernelName());
+
+	// Ranges inside a single block, and ones with ragged ends
+	const int counts[] = { 1, 3, 7, 8, 9, 15, 17, 63, 100, 1001 };
+	const int firsts[] = { 0, 1, 5, 8, 13 };
+	for (int count : counts)
+		for (int first : firsts)
+			CompareKernels(1024, first, count, 3, count * 31 + first);
+
+	// Rings that wrap around the end, including capacities that
+	// aren't a multiple of 8 (so the padding must stay untouched)
+	const int capacities[] = { 64, 1003, 4096 };
+	for (int capacity : capacities)
+	{
+		CompareKernels(capacity, capacity - 5, 21, 4, capacity);
+		CompareKernels(capacity, capacity - 8, capacity - 3, 4, capacity + 1);
+		CompareKernels(capacity, capacity / 2 + 3, capacity, 4, capacity + 2);
+	}
+
+	// Counts past the capacity clamp to the whole ring
+	CompareKernels(100, 37, 250, 2, 9);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All particle simulation tests passed\n");
+	return 0;
+}
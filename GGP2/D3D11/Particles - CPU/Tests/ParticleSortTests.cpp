@@ -0,0 +1,198 @@
+#include "ParticleSort.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// ParticleSorter against std::stable_sort of the same
+// particles, for several emitters whose living ranges wrap
+// around the end of their storage.  With 32-bit keys the
+// order must be exactly "farthest first, ties in the order
+// added"; with 16-bit keys it must match a stable sort on
+// the top half of each key.  The per-emitter orders and the
+// runs must both agree with the sorted list.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// One particle, as the reference sees it
+struct ReferenceParticle
+{
+	float Depth;
+	unsigned int Key;
+	unsigned int Emitter;
+	unsigned int Index;
+};
+
+// Same float-to-key mapping as ParticleSort.cpp (larger depths sort first)
+static unsigned int DepthToKey(float depth)
+{
+	unsigned int bits;
+	std::memcpy(&bits, &depth, sizeof(bits));
+	unsigned int mask = (unsigned int)((int)bits >> 31);
+	return bits ^ (~mask & 0x7FFFFFFF);
+}
+
+struct TestEmitter
+{
+	ParticleStorage Storage;
+	int First;
+	int Count;
+	float DepthTransform[4];
+};
+
+static void RunSort(unsigned int emitterCount, int keyBits, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> capacityDist(1, 3000);
+
+	std::vector<TestEmitter> emitters(emitterCount);
+	std::vector<ReferenceParticle> reference;
+	ParticleSorter sorter;
+
+	for (unsigned int e = 0; e < emitterCount; e++)
+	{
+		TestEmitter& em = emitters[e];
+		int capacity = capacityDist(rng);
+		em.Storage.Allocate(capacity);
+		em.First = (int)(rng() % capacity);
+		em.Count = (int)(rng() % (capacity + 1));
+
+		// Some emitters share a plane of exactly equal depths,
+		// which is where stability matters
+		bool flat = rng() % 4 == 0;
+		for (int i = 0; i < capacity; i++)
+		{
+			em.Storage.PositionX[i] = unit(rng) * 50.0f;
+			em.Storage.PositionY[i] = unit(rng) * 50.0f;
+			em.Storage.PositionZ[i] = flat ? 2.0f : unit(rng) * 50.0f;
+		}
+
+		// A rotation and translation, third column only
+		float angle = unit(rng) * 3.14159f;
+		em.DepthTransform[0] = std::sin(angle);
+		em.DepthTransform[1] = 0.0f;
+		em.DepthTransform[2] = flat ? 1.0f : std::cos(angle);
+		em.DepthTransform[3] = unit(rng) * 20.0f;
+		if (flat)
+			em.DepthTransform[0] = 0.0f;
+
+		sorter.AddParticles(em.Storage, em.First, em.Count, em.DepthTransform, e);
+
+		// Same math as the sorter's leftovers loop
+		for (int i = 0; i < em.Count; i++)
+		{
+			int index = (em.First + i) % capacity;
+			const float* t = em.DepthTransform;
+			float depth =
+				(em.Storage.PositionX[index] * t[0] + em.Storage.PositionY[index] * t[1]) +
+				(em.Storage.PositionZ[index] * t[2] + t[3]);
+			reference.push_back({ depth, DepthToKey(depth), e, (unsigned int)index });
+		}
+	}
+
+	CHECK(sorter.GetCount() == (int)reference.size());
+	sorter.Sort(keyBits);
+
+	if (keyBits == 32)
+	{
+		std::stable_sort(reference.begin(), reference.end(),
+			[](const ReferenceParticle& a, const ReferenceParticle& b) { return a.Depth > b.Depth; });
+	}
+	else
+	{
+		std::stable_sort(reference.begin(), reference.end(),
+			[](const ReferenceParticle& a, const ReferenceParticle& b) { return (a.Key >> 16) < (b.Key >> 16); });
+	}
+
+	// Walk the runs, pulling each particle from its emitter's order
+	std::vector<int> taken(emitterCount, 0);
+	size_t position = 0;
+	bool matches = true;
+	for (const ParticleSortRun& run : sorter.GetRuns())
+	{
+		CHECK(run.Count > 0);
+		const unsigned int* order = sorter.GetEmitterOrder(run.Emitter);
+		for (unsigned int i = 0; i < run.Count && matches; i++, position++)
+		{
+			matches =
+				position < reference.size() &&
+				reference[position].Emitter == run.Emitter &&
+				order[taken[run.Emitter]++] == reference[position].Index;
+		}
+	}
+	CHECK(matches);
+	CHECK(position == reference.size());
+
+	// Neighbouring runs always belong to different emitters
+	const std::vector<ParticleSortRun>& runs = sorter.GetRuns();
+	for (size_t r = 1; r < runs.size(); r++)
+		CHECK(runs[r].Emitter != runs[r - 1].Emitter);
+
+	for (unsigned int e = 0; e < emitterCount; e++)
+		CHECK(sorter.GetEmitterParticleCount(e) == taken[e]);
+
+	if (!matches)
+		std::printf("  %u emitters, %d-bit keys, seed %u: differs at %zu\n", emitterCount, keyBits, seed, position);
+}
+
+// Sorting again after Clear() must not see the last frame's particles
+static void ClearStartsOver()
+{
+	ParticleStorage storage;
+	storage.Allocate(16);
+	for (int i = 0; i < 16; i++)
+		storage.PositionZ[i] = (float)i;
+	float depthTransform[4] = { 0, 0, 1, 0 };
+
+	ParticleSorter sorter;
+	sorter.AddParticles(storage, 0, 16, depthTransform, 3);
+	sorter.Sort();
+	CHECK(sorter.GetCount() == 16);
+	CHECK(sorter.GetEmitterCount() == 4);
+	CHECK(sorter.GetEmitterOrder(3) && sorter.GetEmitterOrder(3)[0] == 15);
+
+	sorter.Clear();
+	sorter.AddParticles(storage, 14, 4, depthTransform, 0);
+	sorter.Sort();
+	CHECK(sorter.GetCount() == 4);
+	CHECK(sorter.GetEmitterCount() == 1);
+	CHECK(sorter.GetRuns().size() == 1);
+
+	// Wrapped: 14, 15, 0, 1 sorted farthest first
+	const unsigned int* order = sorter.GetEmitterOrder(0);
+	CHECK(order[0] == 15 && order[1] == 14 && order[2] == 1 && order[3] == 0);
+	CHECK(sorter.GetEmitterOrder(3) == 0);
+}
+
+int main()
+{
+	ClearStartsOver();
+
+	const unsigned int emitterCounts[] = { 1, 2, 7, 64, 256 };
+	for (unsigned int emitterCount : emitterCounts)
+	{
+		for (unsigned int seed = 1; seed <= 5; seed++)
+		{
+			RunSort(emitterCount, 32, seed);
+			RunSort(emitterCount, 16, seed);
+		}
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All particle sort tests passed\n");
+	return 0;
+}
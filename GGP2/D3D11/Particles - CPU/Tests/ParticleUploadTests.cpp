@@ -0,0 +1,152 @@
+#include "ParticleRing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks how an emitter's living particles are packed into
+// the record buffer it maps for GPU expansion: the same
+// ParticleRing::PackRecords() call Emitter::WriteParticleUpload()
+// makes, against a one-particle-at-a-time reference.
+//
+// Rings are mapped onto pool blocks in a shuffled order (as
+// they are once emitters share a pool), and ranges cover the
+// unwrapped, wrapped, empty and full cases, with and without
+// the job system splitting them into chunks.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// Marks written past the end of the range
+static const float Sentinel = -12345.0f;
+
+struct TestRing
+{
+	std::unique_ptr<ParticlePool> Pool;
+	std::vector<int> BlockTable;
+	int Size;
+};
+
+// A ring whose blocks come from the pool in a shuffled order, with
+// every slot's data telling which slot it is
+static TestRing MakeRing(int size, unsigned int seed)
+{
+	TestRing ring;
+	ring.Size = size;
+	int blockCount = (size + ParticlePoolBlockSize - 1) / ParticlePoolBlockSize;
+
+	// Spare blocks, so the ring doesn't simply get the pool in order
+	ring.Pool = std::make_unique<ParticlePool>(blockCount * 2);
+	std::vector<int> blocks;
+	int block;
+	while ((block = ring.Pool->AcquireBlock()) >= 0)
+		blocks.push_back(block);
+
+	std::mt19937 rng(seed);
+	std::shuffle(blocks.begin(), blocks.end(), rng);
+	ring.BlockTable.assign(blocks.begin(), blocks.begin() + blockCount);
+
+	ParticleRing view(ring.BlockTable, size);
+	ParticleStorage& storage = ring.Pool->Storage;
+	for (int slot = 0; slot < size; slot++)
+	{
+		int p = view.GetPoolIndex(slot);
+		storage.PositionX[p] = (float)slot;
+		storage.PositionY[p] = (float)slot * 2.0f;
+		storage.PositionZ[p] = (float)slot * -3.0f;
+		storage.Size[p] = 1.0f + slot % 7;
+		storage.Rotation[p] = 0.01f * (slot % 13);
+		storage.Age[p] = 0.001f * (slot % 997);
+		storage.Alive[p] = slot % 5 == 0 ? 0.0f : 1.0f;
+	}
+	return ring;
+}
+
+static void CheckRange(const TestRing& ring, int firstSlot, int count, JobSystem* jobs)
+{
+	const float lifetime = 2.0f;
+	ParticleRing view(ring.BlockTable, ring.Size);
+	const ParticleStorage& storage = ring.Pool->Storage;
+
+	// One extra record to catch writes past the end
+	std::vector<ParticleRecord> records(count + 1);
+	for (ParticleRecord& r : records)
+		r.Size = Sentinel;
+
+	view.PackRecords(storage, firstSlot, count, lifetime, records.data(), jobs);
+
+	for (int i = 0; i < count; i++)
+	{
+		int slot = (firstSlot + i) % ring.Size;
+
+		ParticleRecord expected;
+		PackParticleRecords(storage, view.GetPoolIndex(slot), 1, lifetime, &expected);
+		if (std::memcmp(&records[i], &expected, sizeof(ParticleRecord)) != 0)
+		{
+			std::printf("Record %d (slot %d) wrong for ring %d, first %d, count %d\n", i, slot, ring.Size, firstSlot, count);
+			failures++;
+			return;
+		}
+
+		// Oldest first: the record's position says which slot it came from
+		CHECK(records[i].Position[0] == (float)slot);
+	}
+	CHECK(records[count].Size == Sentinel);
+}
+
+int main()
+{
+	JobSystem jobs(3);
+
+	// Ring sizes: less than a block, a block multiple, and ragged
+	for (int size : { 10, 64, 1000, 4099 })
+	{
+		TestRing ring = MakeRing(size, (unsigned int)size);
+
+		// Empty
+		CheckRange(ring, 0, 0, 0);
+		CheckRange(ring, size - 1, 0, 0);
+
+		// Unwrapped: from the start, in the middle, up to the end
+		CheckRange(ring, 0, size / 2, 0);
+		CheckRange(ring, size / 3, size / 2, 0);
+		CheckRange(ring, size - size / 4, size / 4, 0);
+
+		// Wrapped: across the end of the ring, starting in the last slot
+		CheckRange(ring, size - size / 4, size / 2, 0);
+		CheckRange(ring, size - 1, size / 2 + 1, 0);
+
+		// Full, from the start and from the middle of a block
+		CheckRange(ring, 0, size, 0);
+		CheckRange(ring, size / 2 + 1, size, 0);
+	}
+
+	// Large enough to be split into chunks on the job system, including
+	// a chunk that starts right before the wrap
+	{
+		const int size = ParallelParticleThreshold * 3 + 37;
+		TestRing ring = MakeRing(size, 99);
+		CheckRange(ring, 0, size, &jobs);
+		CheckRange(ring, 100, size - 200, &jobs);
+		CheckRange(ring, size - ParallelChunkSize - 1, size, &jobs);
+		CheckRange(ring, size / 2, ParallelParticleThreshold, &jobs);
+		CheckRange(ring, size / 2, ParallelParticleThreshold - 1, &jobs);
+		CheckRange(ring, 5, 0, &jobs);
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All particle upload tests passed\n");
+	return 0;
+}
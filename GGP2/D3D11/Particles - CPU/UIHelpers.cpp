@@ -45,7 +45,8 @@ void BuildUI(
 	std::vector<std::shared_ptr<Material>>& materials,
 	std::vector<std::shared_ptr<Emitter>>& emitters,
 	std::vector<Light>& lights,
-	DemoLightingOptions& lightOptions)
+	DemoLightingOptions& lightOptions,
+	DemoParticleOptions& particleOptions)
 {
 	// A static variable to track whether or not the demo window should be shown.  
 	//  - Static in this context means that the variable is created once 
@@ -277,7 +278,35 @@ void BuildUI(
 		// === Emitters ===
 		if (ImGui::TreeNode("Particle Emitters"))
 		{
-			
+			ImGui::Text("Simulation Kernel: %s", GetParticleKernelName());
+
+			ImGui::Text("Live Particles: %d", particleOptions.LiveParticleCount);
+			ImGui::Text("Pool Blocks Free: %d / %d (%d particles each)",
+				particleOptions.PoolFreeBlockCount,
+				particleOptions.PoolBlockCount,
+				ParticlePoolBlockSize);
+			ImGui::Checkbox("Parallel Update", &particleOptions.ParallelUpdate);
+			ImGui::SameLine();
+			ImGui::Text("(%d threads)", particleOptions.ThreadCount);
+			ImGui::Text("Update Time: %.3f ms", particleOptions.UpdateTimeMS);
+			ImGui::Checkbox("Global Particle Budget", &particleOptions.UseBudget);
+			if (particleOptions.UseBudget)
+			{
+				ImGui::DragInt("Budget", &particleOptions.BudgetMaxParticles, 10.0f, 0, 100000);
+				ImGui::SliderFloat("Max Size Scale", &particleOptions.BudgetMaxSizeScale, 1.0f, 4.0f);
+				ImGui::Text("Demand: %d, Granted: %d", particleOptions.BudgetDemand, particleOptions.BudgetGranted);
+			}
+
+			ImGui::Checkbox("Alpha Blending", &particleOptions.AlphaBlend);
+			ImGui::Checkbox("Sort Back to Front", &particleOptions.SortParticles);
+			if (particleOptions.SortParticles)
+			{
+				ImGui::Checkbox("16-bit Sort Keys", &particleOptions.SixteenBitSortKeys);
+				ImGui::Text("Sorted %d particles in %.3fms", particleOptions.SortedParticleCount, particleOptions.SortTimeMS);
+				ImGui::Text("Draw calls: %d", particleOptions.SortedDrawCount);
+				ImGui::Text("(Sorted particles are always expanded on the GPU)");
+			}
+
 			for (int i = 0; i < emitters.size(); i++)
 			{
 				// New node for each light
@@ -479,6 +508,8 @@ void UIEmitter(std::shared_ptr<Emitter> emitter)
 		ImGui::Indent(5.0f);
 
 		ImGui::Checkbox("Paused", &emitter->paused);
+		ImGui::Text("Living Particles: %d", emitter->GetLivingParticleCount());
+		ImGui::Text("Pool Blocks Held: %d", emitter->GetBlockCount());
 
 		int maxPart = emitter->GetMaxParticles();
 		if (ImGui::DragInt("Max Particles", &maxPart, 1.0f, 1, 2000))
@@ -490,6 +521,20 @@ void UIEmitter(std::shared_ptr<Emitter> emitter)
 
 		ImGui::SliderFloat("Lifetime", &emitter->lifetime, 0.1f, 25.0f);
 
+		int seed = (int)emitter->GetRandomSeed();
+		if (ImGui::InputInt("Random Seed", &seed))
+			emitter->SetRandomSeed((unsigned int)seed);
+
+		ImGui::Checkbox("Closed-Form Evaluation", &emitter->closedForm);
+		float time = emitter->GetTime();
+		if (ImGui::DragFloat("Emitter Time", &time, 0.05f, 0.0f, FLT_MAX))
+			emitter->SetTime(time);
+		if (ImGui::Button("Fast Forward 10s"))
+			emitter->FastForward(10.0f);
+		ImGui::SameLine();
+		ImGui::Text(emitter->IsCulled() ? "(Culled)" : "(In View)");
+		ImGui::Text("Budget: %.0f%% rate, %.2fx size", emitter->GetBudgetRateScale() * 100.0f, emitter->GetBudgetSizeScale());
+
 		ImGui::Indent(-5.0f);
 	}
 
@@ -508,6 +553,47 @@ void UIEmitter(std::shared_ptr<Emitter> emitter)
 		ImGui::DragFloat3("Velocity Randomness", &emitter->velocityRandomRange.x, 0.05f);
 
 		ImGui::DragFloat3("Acceleration", &emitter->emitterAcceleration.x, 0.05f);
+
+		// Force field choice, by handle
+		if (ImGui::BeginCombo("Force Field", ForceFields::GetName(emitter->forceField)))
+		{
+			for (int f = -1; f < ForceFields::GetCount(); f++)
+			{
+				if (ImGui::Selectable(ForceFields::GetName(f), emitter->forceField == f))
+					emitter->forceField = f;
+			}
+			ImGui::EndCombo();
+		}
+		if (emitter->forceField >= 0)
+		{
+			if (ImGui::RadioButton("Flow", emitter->forceFieldMode == ForceFieldMode::Flow))
+				emitter->forceFieldMode = ForceFieldMode::Flow;
+			ImGui::SameLine();
+			if (ImGui::RadioButton("Acceleration", emitter->forceFieldMode == ForceFieldMode::Acceleration))
+				emitter->forceFieldMode = ForceFieldMode::Acceleration;
+			ImGui::SliderFloat("Field Strength", &emitter->forceFieldStrength, 0.0f, 10.0f);
+			if (emitter->closedForm)
+				ImGui::Text("(Fields are ignored in closed-form mode)");
+		}
+
+		// Collisions with the scene's colliders
+		ImGui::Checkbox("Collide", &emitter->collide);
+		if (emitter->collide)
+		{
+			if (ImGui::RadioButton("Bounce", emitter->collisionResponse == CollisionResponse::Bounce))
+				emitter->collisionResponse = CollisionResponse::Bounce;
+			ImGui::SameLine();
+			if (ImGui::RadioButton("Kill", emitter->collisionResponse == CollisionResponse::Kill))
+				emitter->collisionResponse = CollisionResponse::Kill;
+			if (emitter->collisionResponse == CollisionResponse::Bounce)
+			{
+				ImGui::SliderFloat("Restitution", &emitter->restitution, 0.0f, 1.0f);
+				ImGui::SliderFloat("Friction", &emitter->friction, 0.0f, 1.0f);
+			}
+			ImGui::Text("Collisions Last Frame: %d", emitter->GetLastCollisionCount());
+			if (emitter->closedForm)
+				ImGui::Text("(Collisions are ignored in closed-form mode)");
+		}
 		ImGui::Indent(-5.0f);
 	}
 
@@ -517,6 +603,7 @@ void UIEmitter(std::shared_ptr<Emitter> emitter)
 	{
 		ImGui::Indent(5.0f);
 		ImGui::Checkbox("Visible", &emitter->visible);
+		ImGui::Checkbox("Expand Quads on GPU", &emitter->expandOnGPU);
 
 
 		ImGui::ColorEdit4("Starting Color", &emitter->startColor.x);
@@ -58,6 +58,14 @@ namespace Graphics
 	// Resource creation
 	Microsoft::WRL::ComPtr<ID3D12Resource> CreateStaticBuffer(size_t dataStride, size_t dataCount, void* data);
 
+	// Placed resources (sub-allocated from large heaps)
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreatePlacedResource(
+		D3D12_HEAP_TYPE heapType,
+		const D3D12_RESOURCE_DESC& desc,
+		D3D12_RESOURCE_STATES initialState,
+		const D3D12_CLEAR_VALUE* clearValue = 0);
+	void ReleasePlacedResource(Microsoft::WRL::ComPtr<ID3D12Resource>& resource);
+
 	// Command list & synchronization
 	void ResetAllocatorAndCommandList();
 	void CloseAndExecuteCommandList();
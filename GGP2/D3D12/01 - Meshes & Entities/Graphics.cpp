@@ -1,4 +1,7 @@
 #include "Graphics.h"
+#include "PlacedResourceHeaps.h"
+
+#include <memory>
 
 // Tell the drivers to use high-performance GPU in multi-GPU systems (like laptops)
 extern "C"
@@ -22,6 +25,10 @@ namespace Graphics
 
 		unsigned int currentBackBufferIndex = 0;
 
+		// Buffers and textures are placed within a few large heaps
+		// rather than each getting a committed heap of its own
+		std::unique_ptr<PlacedResourceHeaps> placedResources;
+
 		// Descriptor heap management
 		SIZE_T cbvSrvDescriptorHeapIncrementSize = 0;
 		unsigned int cbvDescriptorOffset = 0;
@@ -187,6 +194,9 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		WaitFenceCounter = 0;
 	}
 
+	// Set up the (empty) pools of heaps for placed resources
+	placedResources = std::make_unique<PlacedResourceHeaps>(Device);
+
 	// Overall API has been initialized
 	apiInitialized = true;
 
@@ -237,14 +247,6 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		// This offset changes as we use more CBs, and wraps around when full
 		cbUploadHeapOffsetInBytes = 0;
 
-		// Create the upload heap for our constant buffer
-		D3D12_HEAP_PROPERTIES heapProps = {};
-		heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		heapProps.CreationNodeMask = 1;
-		heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		heapProps.Type = D3D12_HEAP_TYPE_UPLOAD; // Upload heap since we'll be copying often!
-		heapProps.VisibleNodeMask = 1;
-
 		// Fill out description
 		D3D12_RESOURCE_DESC resDesc = {};
 		resDesc.Alignment = 0;
@@ -259,14 +261,12 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		resDesc.SampleDesc.Quality = 0;
 		resDesc.Width = cbUploadHeapSizeInBytes; // Must be 256 byte aligned!
 
-		// Create a constant buffer resource heap
-		Device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&resDesc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			0,
-			IID_PPV_ARGS(CBUploadHeap.GetAddressOf()));
+		// Create the constant buffer upload heap, placed in one of
+		// our large upload heaps
+		CBUploadHeap = CreatePlacedResource(
+			D3D12_HEAP_TYPE_UPLOAD,
+			resDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ);
 
 		// Keep mapped!
 		D3D12_RANGE range{ 0, 0 };
@@ -348,7 +348,10 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 
 	// Reset the depth buffer and create it again
 	{
-		DepthBuffer.Reset();
+		// The GPU is idle, so the old buffer's heap space
+		// can be reused right away
+		placedResources->Release(DepthBuffer, WaitFenceCounter);
+		placedResources->ProcessPendingReleases(WaitFenceCounter);
 
 		// Describe the depth stencil buffer resource
 		D3D12_RESOURCE_DESC depthBufferDesc = {};
@@ -371,23 +374,12 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 		clear.DepthStencil.Depth = 1.0f;
 		clear.DepthStencil.Stencil = 0;
 
-		// Describe the memory heap that will house this resource
-		D3D12_HEAP_PROPERTIES props = {};
-		props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		props.CreationNodeMask = 1;
-		props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		props.Type = D3D12_HEAP_TYPE_DEFAULT;
-		props.VisibleNodeMask = 1;
-
-		// Actually create the resource, and the heap in which it
-		// will reside, and map the resource to that heap
-		Device->CreateCommittedResource(
-			&props,
-			D3D12_HEAP_FLAG_NONE,
-			&depthBufferDesc,
+		// Place the resource in one of our render target/depth heaps
+		DepthBuffer = CreatePlacedResource(
+			D3D12_HEAP_TYPE_DEFAULT,
+			depthBufferDesc,
 			D3D12_RESOURCE_STATE_DEPTH_WRITE,
-			&clear,
-			IID_PPV_ARGS(DepthBuffer.GetAddressOf()));
+			&clear);
 
 		// Now recreate the depth stencil view
 		DSVHandle = DSVHeap->GetCPUDescriptorHandleForHeapStart();
@@ -454,14 +446,7 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	// The overall buffer we'll be creating
 	Microsoft::WRL::ComPtr<ID3D12Resource> finalBuffer;
 
-	// Describes the final heap
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.VisibleNodeMask = 1;
-
+	// Describes the final buffer
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Alignment = 0;
 	desc.DepthOrArraySize = 1;
@@ -479,30 +464,19 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	// state, it will be implicitly transitioned to the "copy destination" state
 	// when used for a copy operation below.  For more info, see:
 	// https://learn.microsoft.com/en-us/windows/win32/direct3d12/user-mode-heap-synchronization#multi-queue-resource-access
-	Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COMMON, // Must start in "common" state to avoid warning
-		0,
-		IID_PPV_ARGS(finalBuffer.GetAddressOf()));
-
-	// Now create an intermediate upload heap for copying initial data
-	D3D12_HEAP_PROPERTIES uploadProps = {};
-	uploadProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	uploadProps.CreationNodeMask = 1;
-	uploadProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	uploadProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-	uploadProps.VisibleNodeMask = 1;
-
-	Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap;
-	Device->CreateCommittedResource(
-		&uploadProps,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		0,
-		IID_PPV_ARGS(uploadHeap.GetAddressOf()));
+	// Note: This is placed in one of our large default heaps rather than
+	//       getting an entire committed heap of its own
+	finalBuffer = CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_COMMON); // Must start in "common" state to avoid warning
+
+	// Now create an intermediate upload buffer for copying initial data,
+	// also placed (in an upload heap) so its memory can be reused later
+	Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap = CreatePlacedResource(
+		D3D12_HEAP_TYPE_UPLOAD,
+		desc,
+		D3D12_RESOURCE_STATE_GENERIC_READ);
 
 	// Do a straight map/memcpy/unmap
 	void* gpuAddress = 0;
@@ -529,11 +503,49 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	ID3D12CommandList* list[] = { localList.Get() };
 	CommandQueue->ExecuteCommandLists(1, list);
 
+	// The upload buffer is no longer needed once the copy is
+	// done, which the wait below guarantees
+	ReleasePlacedResource(uploadHeap);
+
 	WaitForGPU();
 	return finalBuffer;
 }
 
 
+// --------------------------------------------------------
+// Creates a resource placed within one of our large heaps
+// rather than a committed resource with its own implicit heap
+// 
+// heapType     - Default, upload or readback
+// desc         - Description of the resource to create
+// initialState - The resource's starting state
+// clearValue   - Optimized clear value for render targets (or null)
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreatePlacedResource(
+	D3D12_HEAP_TYPE heapType,
+	const D3D12_RESOURCE_DESC& desc,
+	D3D12_RESOURCE_STATES initialState,
+	const D3D12_CLEAR_VALUE* clearValue)
+{
+	return placedResources->Create(heapType, desc, initialState, clearValue);
+}
+
+
+// --------------------------------------------------------
+// Releases a placed resource.  The GPU may still be using it,
+// so its range in the heap is only freed once the GPU has
+// passed the next fence value we signal.
+// 
+// Note: Placed resources that are simply Reset() instead of
+//       released here will keep their heap space until the
+//       end of the program.
+// --------------------------------------------------------
+void Graphics::ReleasePlacedResource(Microsoft::WRL::ComPtr<ID3D12Resource>& resource)
+{
+	placedResources->Release(resource, WaitFenceCounter + 1);
+}
+
+
 // --------------------------------------------------------
 // Copies the given data into the next "unused" spot in
 // the CBV upload heap (wrapping at the end, since we treat
@@ -660,6 +672,9 @@ void Graphics::WaitForGPU()
 		WaitFence->SetEventOnCompletion(WaitFenceCounter, WaitFenceEvent);
 		WaitForSingleObject(WaitFenceEvent, INFINITE);
 	}
+
+	// Nothing is in flight, so all released placed resources can go
+	placedResources->ProcessPendingReleases(WaitFenceCounter);
 }
 
 
@@ -408,13 +408,6 @@ void Game::CreateGeometry()
 RWTextureDetails Game::CreateRWTexture(std::string name, unsigned int width, unsigned int height)
 {
 	// Create the texture
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.VisibleNodeMask = 1;
-
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Alignment = 0;
 	desc.DepthOrArraySize = 1;
@@ -428,14 +421,10 @@ RWTextureDetails Game::CreateRWTexture(std::string name, unsigned int width, uns
 	desc.SampleDesc.Quality = 0;
 	desc.Width = width;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> rwTexture;
-	Graphics::Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-		0,
-		IID_PPV_ARGS(rwTexture.GetAddressOf()));
+	Microsoft::WRL::ComPtr<ID3D12Resource> rwTexture = Graphics::CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
 	// Set up details
 	RWTextureDetails details{};
@@ -81,6 +81,8 @@ void Game::Initialize()
 	indirectLightingEnabled = true;
 	currentSky = 0;
 	previewIrradiance = false;
+	screenshotRequested = false;
+	screenshotCount = 0;
 }
 
 
@@ -600,7 +602,7 @@ void Game::Draw(float deltaTime, float totalTime)
 			psFrame.irradianceIndex = skies[currentSky]->GetIrradianceMapDescriptorIndex();
 			psFrame.specularIndex = skies[currentSky]->GetSpecularMapDescriptorIndex();
 			psFrame.IndirectLightingEnabled = indirectLightingEnabled;
-			psFrame.UseSH = skies[currentSky]->GetUseSH();
+			psFrame.UseSH = skies[currentSky]->GetUseSH() && skies[currentSky]->GetSHReady();
 			float* sh = skies[currentSky]->GetSHIrradianceValues();
 			for (int i = 0; i < 9; i++)
 			{
@@ -645,7 +647,7 @@ void Game::Draw(float deltaTime, float totalTime)
 			{
 				EnvPreviewData psData = {};
 				psData.SkyboxDescriptorIndex = skies[currentSky]->GetIrradianceMapDescriptorIndex();
-				psData.UseSH = skies[currentSky]->GetUseSH();
+				psData.UseSH = skies[currentSky]->GetUseSH() && skies[currentSky]->GetSHReady();
 				float* sh = skies[currentSky]->GetSHIrradianceValues();
 				for (int i = 0; i < 9; i++)
 				{
@@ -755,6 +757,17 @@ void Game::Draw(float deltaTime, float totalTime)
 		ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), Graphics::CommandList.Get());
 	}
 
+	// Capture the finished frame (UI included) if requested - the
+	// readback and PNG encoding both happen without stalling
+	if (screenshotRequested)
+	{
+		Graphics::SaveTextureToPNGAsync(
+			currentBackBuffer,
+			L"Screenshot" + std::to_wstring(screenshotCount++) + L".png",
+			D3D12_RESOURCE_STATE_RENDER_TARGET);
+		screenshotRequested = false;
+	}
+
 	// Present
 	{
 		// Transition back to present
@@ -834,6 +847,9 @@ void Game::BuildUI()
 			if (ImGui::Button(showUIDemoWindow ? "Hide ImGui Demo Window" : "Show ImGui Demo Window"))
 				showUIDemoWindow = !showUIDemoWindow;
 
+			if (ImGui::Button("Save Screenshot"))
+				screenshotRequested = true;
+
 			ImGui::Spacing();
 
 			// Finalize the tree node
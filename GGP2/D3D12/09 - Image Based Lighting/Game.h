@@ -41,6 +41,8 @@ private:
 	void BuildUI(); 
 	void ImageWithHover(unsigned int descriptorIndex, const ImVec2& size);
 	bool showUIDemoWindow;
+	bool screenshotRequested;
+	unsigned int screenshotCount;
 
 	// Pipeline
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> rootSignature;
@@ -1,10 +1,17 @@
 #include "Graphics.h"
+#include "PlacedResourceHeaps.h"
 
 #include "WICTextureLoader.h"
 #include "DDSTextureLoader.h"
 #include "ResourceUploadBatch.h"
+#include "ReadbackRing.h"
 
 #include <vector>
+#include <deque>
+#include <memory>
+#include <wincodec.h>
+
+#pragma comment(lib, "windowscodecs.lib")
 
 // Tell the drivers to use high-performance GPU in multi-GPU systems (like laptops)
 extern "C"
@@ -41,6 +48,128 @@ namespace Graphics
 		// Textures
 		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> textures;
 		std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> cpuSideTextureDescriptorHeaps;
+
+		// Buffers and textures are placed within a few large heaps
+		// rather than each getting a committed heap of its own
+		std::unique_ptr<PlacedResourceHeaps> placedResources;
+
+		// Asynchronous readbacks
+		ReadbackRing readbackRing(ReadbackRingSizeInBytes);
+		Microsoft::WRL::ComPtr<ID3D12Resource> readbackRingBuffer;
+		void* readbackRingStartAddress = 0;
+
+		struct PendingReadback
+		{
+			unsigned int ID = 0;
+			Microsoft::WRL::ComPtr<ID3D12Resource> Texture;			// Kept alive until the copy is done
+			Microsoft::WRL::ComPtr<ID3D12Resource> ExternalBuffer;	// Only when the ring had no room
+			std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Footprints;
+			unsigned int NumRows = 0;
+			ReadbackResult Result;
+			std::function<void(ReadbackResult&)> Callback;
+		};
+		std::deque<PendingReadback> pendingReadbacks; // Same order as the ring's requests
+
+		// Image encoding happening on worker threads
+		std::vector<std::future<void>> encodeJobs;
+
+		// Helper for rounding a value up to a multiple of alignment
+		UINT64 AlignUp(UINT64 value, UINT64 alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		// Creates a buffer the CPU can read from once the GPU copies into it
+		Microsoft::WRL::ComPtr<ID3D12Resource> CreateReadbackBuffer(UINT64 sizeInBytes)
+		{
+			D3D12_RESOURCE_DESC desc = {};
+			desc.Alignment = 0;
+			desc.DepthOrArraySize = 1;
+			desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+			desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+			desc.Format = DXGI_FORMAT_UNKNOWN;
+			desc.Height = 1;
+			desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+			desc.MipLevels = 1;
+			desc.SampleDesc.Count = 1;
+			desc.SampleDesc.Quality = 0;
+			desc.Width = sizeInBytes;
+
+			// Placed in one of the readback heaps
+			return CreatePlacedResource(
+				D3D12_HEAP_TYPE_READBACK,
+				desc,
+				D3D12_RESOURCE_STATE_COPY_DEST);
+		}
+
+		// Creates the shared ring buffer and leaves it mapped
+		// for the life of the program (like the CB upload heap)
+		void CreateReadbackRingBuffer()
+		{
+			readbackRingBuffer = CreateReadbackBuffer(ReadbackRingSizeInBytes);
+			readbackRingBuffer->Map(0, 0, &readbackRingStartAddress);
+		}
+
+		// Encodes the first array slice of an RGBA8 or BGRA8 image
+		// as a PNG using WIC.  Meant to run on a worker thread.
+		bool WritePNG(const std::wstring& filename, const ReadbackResult& image)
+		{
+			bool isBGRA = false;
+			switch (image.Format)
+			{
+			case DXGI_FORMAT_R8G8B8A8_UNORM:
+			case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+				break;
+
+			case DXGI_FORMAT_B8G8R8A8_UNORM:
+			case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+				isBGRA = true;
+				break;
+
+			default: return false;
+			}
+
+			// WIC is COM-based, so this thread needs COM initialized
+			HRESULT comResult = CoInitializeEx(0, COINIT_MULTITHREADED);
+
+			// Swizzle to BGRA, which every WIC PNG encoder accepts
+			UINT stride = image.Width * 4;
+			std::vector<unsigned char> pixels(image.PixelData.begin(), image.PixelData.begin() + (size_t)stride * image.Height);
+			if (!isBGRA)
+			{
+				for (size_t i = 0; i < pixels.size(); i += 4)
+					std::swap(pixels[i + 0], pixels[i + 2]);
+			}
+
+			bool success = false;
+			{
+				Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+				Microsoft::WRL::ComPtr<IWICStream> stream;
+				Microsoft::WRL::ComPtr<IWICBitmapEncoder> encoder;
+				Microsoft::WRL::ComPtr<IWICBitmapFrameEncode> frame;
+				WICPixelFormatGUID format = GUID_WICPixelFormat32bppBGRA;
+
+				success =
+					SUCCEEDED(CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()))) &&
+					SUCCEEDED(factory->CreateStream(stream.GetAddressOf())) &&
+					SUCCEEDED(stream->InitializeFromFilename(filename.c_str(), GENERIC_WRITE)) &&
+					SUCCEEDED(factory->CreateEncoder(GUID_ContainerFormatPng, 0, encoder.GetAddressOf())) &&
+					SUCCEEDED(encoder->Initialize(stream.Get(), WICBitmapEncoderNoCache)) &&
+					SUCCEEDED(encoder->CreateNewFrame(frame.GetAddressOf(), 0)) &&
+					SUCCEEDED(frame->Initialize(0)) &&
+					SUCCEEDED(frame->SetSize(image.Width, image.Height)) &&
+					SUCCEEDED(frame->SetPixelFormat(&format)) &&
+					format == GUID_WICPixelFormat32bppBGRA &&
+					SUCCEEDED(frame->WritePixels(image.Height, stride, (UINT)pixels.size(), pixels.data())) &&
+					SUCCEEDED(frame->Commit()) &&
+					SUCCEEDED(encoder->Commit());
+			}
+
+			if (SUCCEEDED(comResult))
+				CoUninitialize();
+
+			return success;
+		}
 	}
 }
 
@@ -202,6 +331,9 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		GPUCounter = 0;
 	}
 
+	// Set up the (empty) pools of heaps for placed resources
+	placedResources = std::make_unique<PlacedResourceHeaps>(Device);
+
 	// Overall API has been initialized
 	apiInitialized = true;
 
@@ -253,14 +385,6 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		// This offset changes as we use more CBs, and wraps around when full
 		cbUploadHeapOffsetInBytes = 0;
 
-		// Create the upload heap for our constant buffer
-		D3D12_HEAP_PROPERTIES heapProps = {};
-		heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		heapProps.CreationNodeMask = 1;
-		heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		heapProps.Type = D3D12_HEAP_TYPE_UPLOAD; // Upload heap since we'll be copying often!
-		heapProps.VisibleNodeMask = 1;
-
 		// Fill out description
 		D3D12_RESOURCE_DESC resDesc = {};
 		resDesc.Alignment = 0;
@@ -275,14 +399,12 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		resDesc.SampleDesc.Quality = 0;
 		resDesc.Width = cbUploadHeapSizeInBytes; // Must be 256 byte aligned!
 
-		// Create a constant buffer resource heap
-		Device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&resDesc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			0,
-			IID_PPV_ARGS(CBUploadHeap.GetAddressOf()));
+		// Create the constant buffer upload heap, placed in one of
+		// our large upload heaps
+		CBUploadHeap = CreatePlacedResource(
+			D3D12_HEAP_TYPE_UPLOAD,
+			resDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ);
 
 		// Keep mapped!
 		D3D12_RANGE range{ 0, 0 };
@@ -305,6 +427,10 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 // --------------------------------------------------------
 void Graphics::ShutDown()
 {
+	// Let any images finish saving
+	for (auto& job : encodeJobs)
+		job.wait();
+	encodeJobs.clear();
 }
 
 
@@ -325,6 +451,16 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 	if (!apiInitialized)
 		return;
 
+	// Readbacks recorded since the last submit only exist in the
+	// open command list, which is reset below.  Execute it first so
+	// their copies actually happen (and their callbacks still fire).
+	if (readbackRing.GetUnsubmittedCount() > 0)
+	{
+		CloseAndExecuteCommandList();
+		WaitForGPU();
+		ResetAllocatorAndCommandList(currentBackBufferIndex);
+	}
+
 	// Wait for the GPU to finish all work, since we'll
 	// be destroying and recreating resources
 	WaitForGPU();
@@ -364,7 +500,10 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 
 	// Reset the depth buffer and create it again
 	{
-		DepthBuffer.Reset();
+		// The GPU is idle, so the old buffer's heap space
+		// can be reused right away
+		placedResources->Release(DepthBuffer, CPUCounter);
+		placedResources->ProcessPendingReleases(CPUCounter);
 
 		// Describe the depth stencil buffer resource
 		D3D12_RESOURCE_DESC depthBufferDesc = {};
@@ -387,23 +526,12 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 		clear.DepthStencil.Depth = 1.0f;
 		clear.DepthStencil.Stencil = 0;
 
-		// Describe the memory heap that will house this resource
-		D3D12_HEAP_PROPERTIES props = {};
-		props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		props.CreationNodeMask = 1;
-		props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		props.Type = D3D12_HEAP_TYPE_DEFAULT;
-		props.VisibleNodeMask = 1;
-
-		// Actually create the resource, and the heap in which it
-		// will reside, and map the resource to that heap
-		Device->CreateCommittedResource(
-			&props,
-			D3D12_HEAP_FLAG_NONE,
-			&depthBufferDesc,
+		// Place the resource in one of our render target/depth heaps
+		DepthBuffer = CreatePlacedResource(
+			D3D12_HEAP_TYPE_DEFAULT,
+			depthBufferDesc,
 			D3D12_RESOURCE_STATE_DEPTH_WRITE,
-			&clear,
-			IID_PPV_ARGS(DepthBuffer.GetAddressOf()));
+			&clear);
 
 		// Now recreate the depth stencil view
 		DSVHandle = DSVHeap->GetCPUDescriptorHandleForHeapStart();
@@ -457,6 +585,12 @@ void Graphics::AdvanceSwapChainIndex()
 		GPUCounter++;
 	}
 
+	// Deliver any finished readbacks
+	ProcessReadbacks();
+
+	// Free up heap space from any placed resources the GPU is done with
+	placedResources->ProcessPendingReleases(WaitFence->GetCompletedValue());
+
 	// Update the current back buffer index
 	currentBackBufferIndex++;
 	currentBackBufferIndex %= NumBackBuffers;
@@ -562,13 +696,6 @@ TextureDetails Graphics::CreateCubemap(const wchar_t* right, const wchar_t* left
 	D3D12_RESOURCE_DESC faceDesc = faces[0]->GetDesc();
 
 	// Create the new, final texture
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.VisibleNodeMask = 1;
-
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Alignment = 0;
 	desc.DepthOrArraySize = 6; // Cube map
@@ -582,14 +709,10 @@ TextureDetails Graphics::CreateCubemap(const wchar_t* right, const wchar_t* left
 	desc.SampleDesc.Quality = 0;
 	desc.Width = faceDesc.Width;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> cubeMap;
-	Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COPY_DEST, // Copying into immediately
-		0,
-		IID_PPV_ARGS(cubeMap.GetAddressOf()));
+	Microsoft::WRL::ComPtr<ID3D12Resource> cubeMap = CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_COPY_DEST); // Copying into immediately
 
 	// Copy all faces to the proper subresource of the cube map
 	for (int f = 0; f < 6; f++)
@@ -668,14 +791,7 @@ TextureDetails Graphics::CreateTexture(
 	D3D12_RESOURCE_FLAGS flags, 
 	DXGI_FORMAT colorFormat)
 {
-	// Set up the heap and then resource itself
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.VisibleNodeMask = 1;
-
+	// Set up the resource itself
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Alignment = 0;
 	desc.DepthOrArraySize = arraySize;
@@ -689,14 +805,10 @@ TextureDetails Graphics::CreateTexture(
 	desc.SampleDesc.Quality = 0;
 	desc.Width = width;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> texture;
-	Graphics::Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COMMON,
-		0,
-		IID_PPV_ARGS(texture.GetAddressOf()));
+	Microsoft::WRL::ComPtr<ID3D12Resource> texture = CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_COMMON);
 
 	// Fill out texture details
 	TextureDetails details;
@@ -740,14 +852,7 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	// The overall buffer we'll be creating
 	Microsoft::WRL::ComPtr<ID3D12Resource> finalBuffer;
 
-	// Describes the final heap
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.VisibleNodeMask = 1;
-
+	// Describes the final buffer
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Alignment = 0;
 	desc.DepthOrArraySize = 1;
@@ -765,30 +870,19 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	// state, it will be implicitly transitioned to the "copy destination" state
 	// when used for a copy operation below.  For more info, see:
 	// https://learn.microsoft.com/en-us/windows/win32/direct3d12/user-mode-heap-synchronization#multi-queue-resource-access
-	Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COMMON, // Must start in "common" state to avoid warning
-		0,
-		IID_PPV_ARGS(finalBuffer.GetAddressOf()));
-
-	// Now create an intermediate upload heap for copying initial data
-	D3D12_HEAP_PROPERTIES uploadProps = {};
-	uploadProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	uploadProps.CreationNodeMask = 1;
-	uploadProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	uploadProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-	uploadProps.VisibleNodeMask = 1;
-
-	Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap;
-	Device->CreateCommittedResource(
-		&uploadProps,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		0,
-		IID_PPV_ARGS(uploadHeap.GetAddressOf()));
+	// Note: This is placed in one of our large default heaps rather than
+	//       getting an entire committed heap of its own
+	finalBuffer = CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_COMMON); // Must start in "common" state to avoid warning
+
+	// Now create an intermediate upload buffer for copying initial data,
+	// also placed (in an upload heap) so its memory can be reused later
+	Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap = CreatePlacedResource(
+		D3D12_HEAP_TYPE_UPLOAD,
+		desc,
+		D3D12_RESOURCE_STATE_GENERIC_READ);
 
 	// Do a straight map/memcpy/unmap
 	void* gpuAddress = 0;
@@ -815,136 +909,271 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	ID3D12CommandList* list[] = { localList.Get() };
 	CommandQueue->ExecuteCommandLists(1, list);
 
+	// The upload buffer is no longer needed once the copy is
+	// done, which the wait below guarantees
+	ReleasePlacedResource(uploadHeap);
+
 	WaitForGPU();
 	return finalBuffer;
 }
 
-// Only gets the FIRST MIP LEVEL and ASSUMES RGBA or BGRA format
-void Graphics::ReadTextureDataFromGPU(Microsoft::WRL::ComPtr<ID3D12Resource> texture, std::vector<unsigned char>& pixelData)
-{
-	// Create a temporary command list and allocator
-	Microsoft::WRL::ComPtr<ID3D12CommandAllocator> localAllocator;
-	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> localList;
 
-	Device->CreateCommandAllocator(
-		D3D12_COMMAND_LIST_TYPE_DIRECT,
-		IID_PPV_ARGS(localAllocator.GetAddressOf()));
+// --------------------------------------------------------
+// Creates a resource placed within one of our large heaps
+// rather than a committed resource with its own implicit heap
+// 
+// heapType     - Default, upload or readback
+// desc         - Description of the resource to create
+// initialState - The resource's starting state
+// clearValue   - Optimized clear value for render targets (or null)
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreatePlacedResource(
+	D3D12_HEAP_TYPE heapType,
+	const D3D12_RESOURCE_DESC& desc,
+	D3D12_RESOURCE_STATES initialState,
+	const D3D12_CLEAR_VALUE* clearValue)
+{
+	return placedResources->Create(heapType, desc, initialState, clearValue);
+}
 
-	Device->CreateCommandList(
-		0,								// Which physical GPU will handle these tasks?  0 for single GPU setup
-		D3D12_COMMAND_LIST_TYPE_DIRECT,	// Type of command list - direct is for standard API calls
-		localAllocator.Get(),			// The allocator for this list (to start)
-		0,								// Initial pipeline state - none for now
-		IID_PPV_ARGS(localList.GetAddressOf()));
 
-	D3D12_RESOURCE_DESC textureDesc{};
-	textureDesc = texture->GetDesc();
+// --------------------------------------------------------
+// Releases a placed resource.  The GPU may still be using it,
+// so its range in the heap is only freed once the GPU has
+// passed the next fence value we signal.
+// 
+// Note: Placed resources that are simply Reset() instead of
+//       released here will keep their heap space until the
+//       end of the program.
+// --------------------------------------------------------
+void Graphics::ReleasePlacedResource(Microsoft::WRL::ComPtr<ID3D12Resource>& resource)
+{
+	placedResources->Release(resource, CPUCounter + 1);
+}
 
-	// Need to read back the contents of the texture
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_READBACK;
-	props.VisibleNodeMask = 1;
+// --------------------------------------------------------
+// Starts an asynchronous read of a texture's FIRST MIP LEVEL
+// (of each array slice) back to the CPU.  The copy is recorded
+// into the current command list, and the results are handed
+// to the callback once the GPU has finished the copy, which
+// is usually a few frames later.  Nothing here waits on the GPU.
+//
+// texture      - The texture to read back
+// callback     - Function to call (on the main thread) with the results
+// currentState - The state the texture is in (and will be left in)
+// --------------------------------------------------------
+void Graphics::ReadTextureDataFromGPUAsync(
+	Microsoft::WRL::ComPtr<ID3D12Resource> texture,
+	std::function<void(ReadbackResult&)> callback,
+	D3D12_RESOURCE_STATES currentState)
+{
+	D3D12_RESOURCE_DESC textureDesc = texture->GetDesc();
+	if (textureDesc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D)
+		return;
 
-	unsigned int formatSize = 0;
-	switch (textureDesc.Format)
+	PendingReadback readback;
+	readback.Texture = texture;
+	readback.Callback = callback;
+	readback.Result.Width = (unsigned int)textureDesc.Width;
+	readback.Result.Height = textureDesc.Height;
+	readback.Result.ArraySize = textureDesc.DepthOrArraySize;
+	readback.Result.Format = textureDesc.Format;
+
+	// Lay out the first mip of each array slice one after another,
+	// each starting at the alignment required for texture copies
+	readback.Footprints.resize(textureDesc.DepthOrArraySize);
+	UINT64 totalSizeInBytes = 0;
+	for (unsigned int arrayElement = 0; arrayElement < textureDesc.DepthOrArraySize; arrayElement++)
 	{
-	case DXGI_FORMAT_R8G8B8A8_UNORM:
-	case DXGI_FORMAT_B8G8R8A8_UNORM:
-		formatSize = sizeof(unsigned char) * 4;
-		break;
-
-	default: return;
+		UINT64 sliceSizeInBytes = 0;
+		Device->GetCopyableFootprints(
+			&textureDesc,
+			arrayElement * textureDesc.MipLevels, // First mip of this slice
+			1,
+			0,
+			&readback.Footprints[arrayElement],
+			&readback.NumRows,
+			&readback.Result.RowPitch,
+			&sliceSizeInBytes);
+
+		totalSizeInBytes = AlignUp(totalSizeInBytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+		readback.Footprints[arrayElement].Offset = totalSizeInBytes;
+		totalSizeInBytes += sliceSizeInBytes;
 	}
 
-	// Readback must be through a BUFFER
-	unsigned long long rowPitch = textureDesc.Width * formatSize;
-	unsigned long long bufferSizeInBytes =
-		rowPitch *
-		textureDesc.Height *
-		textureDesc.DepthOrArraySize;
+	// Grab space in the ring if possible
+	if (!readbackRingBuffer)
+		CreateReadbackRingBuffer();
 
-	D3D12_RESOURCE_DESC desc = {};
-	desc.Alignment = 0;
-	desc.DepthOrArraySize = 1;
-	desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-	desc.Format = DXGI_FORMAT_UNKNOWN;
-	desc.Height = 1;
-	desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-	desc.MipLevels = 1;
-	desc.SampleDesc.Count = 1;
-	desc.SampleDesc.Quality = 0;
-	desc.Width = bufferSizeInBytes;
+	ReadbackRingEntry entry = readbackRing.Allocate(totalSizeInBytes, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	readback.ID = entry.ID;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> readback;
-	Graphics::Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COPY_DEST,
-		0,
-		IID_PPV_ARGS(readback.GetAddressOf()));
+	ID3D12Resource* destination = readbackRingBuffer.Get();
+	if (entry.InRing)
+	{
+		// Shift footprints to our spot in the ring
+		for (auto& fp : readback.Footprints)
+			fp.Offset += entry.Offset;
+	}
+	else
+	{
+		// No room, so this one gets its own buffer (still without waiting)
+		readback.ExternalBuffer = CreateReadbackBuffer(totalSizeInBytes);
+		destination = readback.ExternalBuffer.Get();
+	}
 
 	// Transition source to proper state
 	D3D12_RESOURCE_BARRIER tr{};
 	tr.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
 	tr.Transition.pResource = texture.Get();
-	tr.Transition.StateBefore = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE; // Default state after load
+	tr.Transition.StateBefore = currentState;
 	tr.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_SOURCE;
 	tr.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-	localList->ResourceBarrier(1, &tr);
+	if (currentState != D3D12_RESOURCE_STATE_COPY_SOURCE)
+		CommandList->ResourceBarrier(1, &tr);
 
-	// Copy data from original texture to readback texture
+	// Copy each slice into the readback buffer
 	for (unsigned int arrayElement = 0; arrayElement < textureDesc.DepthOrArraySize; arrayElement++)
 	{
-		// Set up destination
 		D3D12_TEXTURE_COPY_LOCATION destLoc{};
-		destLoc.pResource = readback.Get();
+		destLoc.pResource = destination;
 		destLoc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		destLoc.PlacedFootprint = readback.Footprints[arrayElement];
 
-		// Use helper function to fill out "footprint" of the buffer
-		Device->GetCopyableFootprints(&textureDesc, arrayElement, 1, 100, &destLoc.PlacedFootprint, 0, 0, 0);
-
-		// Adjust the offset based on the overall byte size (and the face)
-		destLoc.PlacedFootprint.Offset = 
-			destLoc.PlacedFootprint.Footprint.RowPitch * 
-			destLoc.PlacedFootprint.Footprint.Height * 
-			arrayElement;
-
-		// Set up source
 		D3D12_TEXTURE_COPY_LOCATION srcLoc{};
 		srcLoc.pResource = texture.Get();
-		srcLoc.SubresourceIndex = arrayElement;
+		srcLoc.SubresourceIndex = arrayElement * textureDesc.MipLevels;
 		srcLoc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
 
-		// Copy the subresource
-		//unsigned int destOffset = footprint.Footprint.RowPitch * footprint.Footprint.Height * arrayElement;
-		localList->CopyTextureRegion(&destLoc, 0, 0, 0, &srcLoc, 0);
+		CommandList->CopyTextureRegion(&destLoc, 0, 0, 0, &srcLoc, 0);
 	}
 
 	// Transition original texture back
 	tr.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_SOURCE;
-	tr.Transition.StateAfter = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-	localList->ResourceBarrier(1, &tr);
+	tr.Transition.StateAfter = currentState;
+	if (currentState != D3D12_RESOURCE_STATE_COPY_SOURCE)
+		CommandList->ResourceBarrier(1, &tr);
 
-	// Perform copy
-	localList->Close();
-	ID3D12CommandList* list[] = { localList.Get() };
-	CommandQueue->ExecuteCommandLists(1, list);
-	WaitForGPU();
+	// Results are gathered once the command list is executed and
+	// its fence value is reached (see ProcessReadbacks())
+	pendingReadbacks.push_back(std::move(readback));
+}
+
+
+// --------------------------------------------------------
+// Same as above, but delivers the results through a future.
+// The future is fulfilled by ProcessReadbacks() on the main
+// thread, so check it with wait_for(0) rather than blocking.
+// --------------------------------------------------------
+std::future<ReadbackResult> Graphics::ReadTextureDataFromGPUAsync(
+	Microsoft::WRL::ComPtr<ID3D12Resource> texture,
+	D3D12_RESOURCE_STATES currentState)
+{
+	std::shared_ptr<std::promise<ReadbackResult>> promise = std::make_shared<std::promise<ReadbackResult>>();
+	std::future<ReadbackResult> future = promise->get_future();
 
-	// Resize the vector
-	pixelData.resize(bufferSizeInBytes);
-	unsigned long long offset = 0;
+	ReadTextureDataFromGPUAsync(
+		texture,
+		[promise](ReadbackResult& result) { promise->set_value(std::move(result)); },
+		currentState);
 
-	// Map and copy the data from the buffer
-	void* mapped;
-	readback->Map(0, 0, &mapped);
-	memcpy(pixelData.data(), mapped, bufferSizeInBytes);
-	readback->Unmap(0, 0);
+	return future;
+}
+
+
+// --------------------------------------------------------
+// Reads a texture back asynchronously and then encodes the
+// first array slice to a PNG file on a worker thread, so
+// neither the GPU nor the file I/O stalls the frame.  Only
+// RGBA8 and BGRA8 textures are supported.
+// --------------------------------------------------------
+void Graphics::SaveTextureToPNGAsync(
+	Microsoft::WRL::ComPtr<ID3D12Resource> texture,
+	const std::wstring& filename,
+	D3D12_RESOURCE_STATES currentState)
+{
+	ReadTextureDataFromGPUAsync(
+		texture,
+		[filename](ReadbackResult& result)
+		{
+			// Hand the pixels off to a worker thread for encoding
+			std::shared_ptr<ReadbackResult> image = std::make_shared<ReadbackResult>(std::move(result));
+			encodeJobs.push_back(std::async(std::launch::async, [filename, image]() { WritePNG(filename, *image); }));
+		},
+		currentState);
+}
+
+
+// --------------------------------------------------------
+// Delivers the results of any readbacks the GPU has finished.
+// This is called automatically whenever we advance the swap
+// chain or wait for the GPU, so callbacks always happen on
+// the main thread.
+// --------------------------------------------------------
+void Graphics::ProcessReadbacks()
+{
+	if (!WaitFence)
+		return;
+
+	// Clean up any encoding jobs that are done
+	for (size_t i = 0; i < encodeJobs.size();)
+	{
+		if (encodeJobs[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			encodeJobs[i] = std::move(encodeJobs.back());
+			encodeJobs.pop_back();
+		}
+		else i++;
+	}
+
+	// Which requests has the GPU finished?
+	std::vector<ReadbackRingEntry> completed;
+	readbackRing.Poll(WaitFence->GetCompletedValue(), completed);
+	if (completed.empty())
+		return;
+
+	// Copy everything out before running any callbacks, since
+	// retired ring space can be reused by the very next request
+	std::vector<PendingReadback> finished;
+	for (auto& entry : completed)
+	{
+		PendingReadback readback = std::move(pendingReadbacks.front());
+		pendingReadbacks.pop_front();
+
+		void* mapped = readbackRingStartAddress;
+		if (!entry.InRing)
+			readback.ExternalBuffer->Map(0, 0, &mapped);
+
+		// Remove the row padding as we copy
+		ReadbackResult& result = readback.Result;
+		result.PixelData.resize(result.RowPitch * readback.NumRows * result.ArraySize);
+		unsigned char* dest = result.PixelData.data();
+		for (auto& fp : readback.Footprints)
+		{
+			unsigned char* src = (unsigned char*)mapped + fp.Offset;
+			for (unsigned int row = 0; row < readback.NumRows; row++)
+			{
+				memcpy(dest, src, result.RowPitch);
+				dest += result.RowPitch;
+				src += fp.Footprint.RowPitch;
+			}
+		}
+
+		if (!entry.InRing)
+			readback.ExternalBuffer->Unmap(0, 0);
+
+		// Done with the GPU resources
+		ReleasePlacedResource(readback.ExternalBuffer);
+		readback.Texture.Reset();
+		finished.push_back(std::move(readback));
+	}
+
+	// Now deliver the results
+	for (auto& readback : finished)
+	{
+		if (readback.Callback)
+			readback.Callback(readback.Result);
+	}
 }
 
 
@@ -1082,6 +1311,10 @@ void Graphics::CloseAndExecuteCommandList()
 	CommandList->Close();
 	ID3D12CommandList* lists[] = { CommandList.Get() };
 	CommandQueue->ExecuteCommandLists(1, lists);
+
+	// Any readbacks recorded into this list will be finished once
+	// the next fence value is reached (it is always signaled after this)
+	readbackRing.Submit(CPUCounter + 1);
 }
 
 
@@ -1108,6 +1341,12 @@ void Graphics::WaitForGPU()
 
 	// We're fully caught up
 	GPUCounter = CPUCounter;
+
+	// Deliver any finished readbacks
+	ProcessReadbacks();
+
+	// Nothing is in flight, so all released placed resources can go
+	placedResources->ProcessPendingReleases(CPUCounter);
 }
 
 
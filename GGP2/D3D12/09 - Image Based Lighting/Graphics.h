@@ -6,6 +6,8 @@
 #include <string>
 #include <wrl/client.h>
 #include <vector>
+#include <functional>
+#include <future>
 
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "dxgi.lib")
@@ -24,6 +26,19 @@ struct TextureDetails
 	DescriptorDetails UAV;
 };
 
+// Pixel data from an asynchronous readback.  Rows are tightly
+// packed (no GPU row pitch padding), with each array slice's
+// first mip one after another.
+struct ReadbackResult
+{
+	std::vector<unsigned char> PixelData;
+	unsigned int Width = 0;
+	unsigned int Height = 0;
+	unsigned int ArraySize = 0;
+	unsigned long long RowPitch = 0;
+	DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+};
+
 namespace Graphics
 {
 	// --- CONSTANTS ---
@@ -43,6 +58,11 @@ namespace Graphics
 	//       constant ensures we (hopefully) never run out of room.
 	const unsigned int MaxTextureDescriptors = 100;
 
+	// Size of the readback buffer shared by all asynchronous
+	// readbacks.  Requests that don't fit (or are made while
+	// it's full) get their own temporary buffer instead.
+	const unsigned long long ReadbackRingSizeInBytes = 64 * 1024 * 1024;
+
 	// --- GLOBAL VARS ---
 
 	// Primary D3D12 API objects
@@ -105,7 +125,31 @@ namespace Graphics
 		D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE,
 		DXGI_FORMAT colorFormat = DXGI_FORMAT_R8G8B8A8_UNORM);
 	Microsoft::WRL::ComPtr<ID3D12Resource> CreateStaticBuffer(size_t dataStride, size_t dataCount, void* data);
-	void ReadTextureDataFromGPU(Microsoft::WRL::ComPtr<ID3D12Resource> texture, std::vector<unsigned char>& pixelData);
+
+	// Placed resources (sub-allocated from large heaps)
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreatePlacedResource(
+		D3D12_HEAP_TYPE heapType,
+		const D3D12_RESOURCE_DESC& desc,
+		D3D12_RESOURCE_STATES initialState,
+		const D3D12_CLEAR_VALUE* clearValue = 0);
+	void ReleasePlacedResource(Microsoft::WRL::ComPtr<ID3D12Resource>& resource);
+
+	// Asynchronous readback - copies are recorded into the current command
+	// list and results are delivered (on the main thread) a few frames later,
+	// once the GPU has actually finished the copy.  Note: futures are fulfilled
+	// by ProcessReadbacks(), so don't block on one from the main thread.
+	void ReadTextureDataFromGPUAsync(
+		Microsoft::WRL::ComPtr<ID3D12Resource> texture,
+		std::function<void(ReadbackResult&)> callback,
+		D3D12_RESOURCE_STATES currentState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	std::future<ReadbackResult> ReadTextureDataFromGPUAsync(
+		Microsoft::WRL::ComPtr<ID3D12Resource> texture,
+		D3D12_RESOURCE_STATES currentState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	void SaveTextureToPNGAsync(
+		Microsoft::WRL::ComPtr<ID3D12Resource> texture,
+		const std::wstring& filename,
+		D3D12_RESOURCE_STATES currentState = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	void ProcessReadbacks();
 
 	// Resource usage
 	D3D12_GPU_DESCRIPTOR_HANDLE FillNextConstantBufferAndGetGPUDescriptorHandle(
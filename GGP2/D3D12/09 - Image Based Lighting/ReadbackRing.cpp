@@ -0,0 +1,144 @@
+#include "ReadbackRing.h"
+
+// Helper for rounding a value up to a multiple of alignment
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// --------------------------------------------------------
+// Creates a ring that manages the offset range [0, size)
+// --------------------------------------------------------
+ReadbackRing::ReadbackRing(uint64_t size) :
+	size(size),
+	head(0),
+	tail(0),
+	inRingCount(0),
+	nextID(0)
+{
+}
+
+uint64_t ReadbackRing::GetSize() const { return size; }
+unsigned int ReadbackRing::GetPendingCount() const { return (unsigned int)pending.size(); }
+
+unsigned int ReadbackRing::GetUnsubmittedCount() const
+{
+	// Unsubmitted requests are always at the back
+	unsigned int count = 0;
+	for (auto it = pending.rbegin(); it != pending.rend() && it->FenceValue == ReadbackUnsubmitted; it++)
+		count++;
+	return count;
+}
+
+uint64_t ReadbackRing::GetUsedSize() const
+{
+	if (inRingCount == 0)
+		return 0;
+
+	// Has the used range wrapped around the end?
+	return head > tail ? head - tail : size - tail + head;
+}
+
+
+// --------------------------------------------------------
+// Finds space for a request at the head of the ring.  The
+// ring never splits a request, so if it doesn't fit before
+// the end, the rest of the ring is skipped and we try again
+// at the start (as long as that doesn't run into the tail).
+//
+// size      - Size of the data to read back
+// alignment - Required alignment of the offset
+// --------------------------------------------------------
+ReadbackRingEntry ReadbackRing::Allocate(uint64_t size, uint64_t alignment)
+{
+	if (size == 0) size = 1;
+	if (alignment == 0) alignment = 1;
+
+	ReadbackRingEntry entry;
+	entry.ID = nextID++;
+	entry.Size = size;
+
+	// Start fresh if everything has been retired
+	if (inRingCount == 0)
+	{
+		head = 0;
+		tail = 0;
+	}
+
+	bool fits = false;
+	uint64_t offset = AlignUp(head, alignment);
+	if (inRingCount == 0 || head > tail)
+	{
+		// Free space is [head, end) and [0, tail)
+		if (offset + size <= this->size)
+		{
+			fits = true;
+		}
+		else if (size <= tail)
+		{
+			offset = 0;
+			fits = true;
+		}
+	}
+	else if (head < tail)
+	{
+		// Already wrapped, so free space is just [head, tail)
+		fits = offset + size <= tail;
+	}
+
+	// Note: head == tail with requests in the ring means it's full
+	if (fits)
+	{
+		entry.InRing = true;
+		entry.Offset = offset;
+		entry.SpanStart = head;
+		entry.SpanEnd = offset + size;
+		head = entry.SpanEnd;
+		inRingCount++;
+	}
+
+	pending.push_back(entry);
+	return entry;
+}
+
+
+// --------------------------------------------------------
+// Tags all unsubmitted requests with the given fence value.
+// Fence values must not decrease between calls.
+// --------------------------------------------------------
+void ReadbackRing::Submit(uint64_t fenceValue)
+{
+	// Unsubmitted requests are always at the back
+	for (auto it = pending.rbegin(); it != pending.rend(); it++)
+	{
+		if (it->FenceValue != ReadbackUnsubmitted)
+			break;
+
+		it->FenceValue = fenceValue;
+	}
+}
+
+
+// --------------------------------------------------------
+// Retires finished requests from the front of the ring.
+// Since fence values only increase, we can stop at the
+// first request that isn't finished.
+// --------------------------------------------------------
+void ReadbackRing::Poll(uint64_t completedFenceValue, std::vector<ReadbackRingEntry>& completed)
+{
+	while (!pending.empty())
+	{
+		ReadbackRingEntry& entry = pending.front();
+		if (entry.FenceValue == ReadbackUnsubmitted || entry.FenceValue > completedFenceValue)
+			break;
+
+		if (entry.InRing)
+		{
+			tail = entry.SpanEnd;
+			inRingCount--;
+		}
+
+		completed.push_back(entry);
+		pending.pop_front();
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// --------------------------------------------------------
+// Bookkeeping for asynchronous GPU readbacks.
+//
+// Space for each request is carved out of a single, large
+// readback buffer that is used as a ring: requests are
+// allocated at the head and retired from the tail in the
+// same order they were made.  Each request is tagged with
+// the fence value that will be signaled once the GPU has
+// finished copying into it, so retiring is simply a matter
+// of comparing against the fence's completed value.
+//
+// The ring never maps the readback buffer or waits on the
+// fence itself; Graphics does both and hands over the
+// completed fence value when polling.  That keeps the ring
+// testable with a fake fence (see Tests/ReadbackRingTests).
+//
+// Requests too large for the ring (or made while the ring is
+// full) can still be tracked as "external" requests, which
+// take no ring space but are retired in order like any other.
+// --------------------------------------------------------
+
+// Fence value of requests that haven't been submitted yet
+const uint64_t ReadbackUnsubmitted = UINT64_MAX;
+
+// A single readback request
+struct ReadbackRingEntry
+{
+	unsigned int ID = 0;
+	uint64_t Offset = 0;		// Where the data lives in the ring (if InRing)
+	uint64_t Size = 0;
+	uint64_t FenceValue = ReadbackUnsubmitted;
+	bool InRing = false;
+
+	// Ring space covered by this request, including any
+	// alignment padding or skipped space at the end of the ring
+	uint64_t SpanStart = 0;
+	uint64_t SpanEnd = 0;
+};
+
+class ReadbackRing
+{
+public:
+	ReadbackRing(uint64_t size);
+
+	// Reserves space for a request, returning its ID.  If there isn't
+	// room, the request is tracked as external instead (check InRing).
+	ReadbackRingEntry Allocate(uint64_t size, uint64_t alignment = 1);
+
+	// Tags every request made since the last submit with the fence
+	// value that will be signaled once their copies are executed
+	void Submit(uint64_t fenceValue);
+
+	// Retires (in order) all submitted requests whose fence value has
+	// been reached, appending them to the given list.  Once retired,
+	// their ring space may be handed out again, so the caller must
+	// copy the data out before allocating anything else.
+	void Poll(uint64_t completedFenceValue, std::vector<ReadbackRingEntry>& completed);
+
+	uint64_t GetSize() const;
+	uint64_t GetUsedSize() const;
+	unsigned int GetPendingCount() const;
+	unsigned int GetUnsubmittedCount() const;
+
+private:
+	uint64_t size;
+	uint64_t head;	// Where the next allocation starts
+	uint64_t tail;	// Start of the oldest allocation still in the ring
+	unsigned int inRingCount;
+	unsigned int nextID;
+
+	// Requests in the order they were made
+	std::deque<ReadbackRingEntry> pending;
+};
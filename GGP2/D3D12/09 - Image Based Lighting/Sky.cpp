@@ -19,7 +19,8 @@ Sky::Sky(
 	skyCubeMap(skyCubeDetails),
 	skyMesh(mesh),
 	useSHForIrradiance(false),
-	shCalculated(false)
+	shCalculated(false),
+	shPending(false)
 {
 	// Init render states and compute IBL resources from environment map
 	InitRenderStates();
@@ -33,7 +34,8 @@ Sky::Sky(
 	:
 	skyMesh(mesh),
 	useSHForIrradiance(false),
-	shCalculated(false)
+	shCalculated(false),
+	shPending(false)
 {
 	// Init render states
 	InitRenderStates();
@@ -57,7 +59,8 @@ Sky::Sky(
 	:
 	skyMesh(mesh),
 	useSHForIrradiance(false),
-	shCalculated(false)
+	shCalculated(false),
+	shPending(false)
 {
 	// Init render states
 	InitRenderStates();
@@ -80,7 +83,8 @@ Sky::Sky(
 	skyMesh(mesh),
 	totalSpecMipLevels(totalSpecMipLevels),
 	useSHForIrradiance(false),
-	shCalculated(false)
+	shCalculated(false),
+	shPending(false)
 {
 	// Init render states
 	InitRenderStates();
@@ -106,15 +110,17 @@ unsigned int Sky::GetTotalSpecularMipLevels() { return totalSpecMipLevels; }
 float* Sky::GetSHIrradianceValues() { return shIrradiance; }
 
 bool Sky::GetUseSH() { return useSHForIrradiance; }
+bool Sky::GetSHReady() { return shCalculated; }
 void Sky::SetUseSH(bool useSH) { useSHForIrradiance = useSH; if(useSH) CalculateSphericalHarmonics(); }
 
 void Sky::CalculateSphericalHarmonics()
 {
-	if (shCalculated)
+	if (shCalculated || shPending)
 		return;
 
+	// The results arrive a few frames from now
 	CreateIBLIrradianceSphericalHarmonics();
-	shCalculated = true;
+	shPending = true;
 }
 
 void Sky::InitRenderStates()
@@ -496,29 +502,46 @@ void Sky::CreateIBLIrradianceMap()
 
 void Sky::CreateIBLIrradianceSphericalHarmonics()
 {
-	// Grab the pixel data from the skybox cube map on the GPU
-	std::vector<unsigned char> pixelData;
-	Graphics::ReadTextureDataFromGPU(skyCubeMap.Texture, pixelData);
+	// Request the pixel data from the skybox cube map on the GPU,
+	// which will be projected onto SH once it's available
+	Graphics::ReadTextureDataFromGPUAsync(
+		skyCubeMap.Texture,
+		[this](ReadbackResult& result)
+		{
+			ProjectOntoSphericalHarmonics(result);
+			shPending = false;
+			shCalculated = true;
+		});
+}
+
+void Sky::ProjectOntoSphericalHarmonics(const ReadbackResult& result)
+{
+	// Only RGBA or BGRA data is supported
+	if (result.RowPitch != result.Width * 4)
+		return;
+
+	const std::vector<unsigned char>& pixelData = result.PixelData;
 
 	// Reset SH
 	for (int i = 0; i < 9 * 3; i++)
 		shIrradiance[i] = 0.0f;
 
-	// Grab texture description (for width & height)
-	D3D12_RESOURCE_DESC desc = skyCubeMap.Texture->GetDesc();
+	// Grab texture dimensions
+	unsigned int width = result.Width;
+	unsigned int height = result.Height;
 
 	// Loop through the pixels of the texture
 	float totalWeight = 0;
 	for (unsigned int face = 0; face < 6; face++)
 	{
-		for (unsigned int y = 0; y < desc.Height; y++)
+		for (unsigned int y = 0; y < height; y++)
 		{
-			for (unsigned int x = 0; x < desc.Width; x++)
+			for (unsigned int x = 0; x < width; x++)
 			{
 				// Index for the first of 4 pixel values
 				unsigned long long index =
-					face * desc.Width * desc.Height + // Skip to correct face
-					x + (y * desc.Width); // Get specific pixel
+					face * width * height + // Skip to correct face
+					x + (y * width); // Get specific pixel
 
 				index *= 4; // 4 values per pixel
 
@@ -536,8 +559,8 @@ void Sky::CreateIBLIrradianceSphericalHarmonics()
 
 				// Calculate a 3D direction from x/y/face
 				XMFLOAT3 dir{};
-				float dx = x / (float)desc.Width * 2 - 1;
-				float dy = y / (float)desc.Height * 2 - 1;
+				float dx = x / (float)width * 2 - 1;
+				float dy = y / (float)height * 2 - 1;
 				switch (face)
 				{
 				case 0: dir = XMFLOAT3(+1, -dy, -dx); break;
@@ -552,8 +575,8 @@ void Sky::CreateIBLIrradianceSphericalHarmonics()
 				
 				// Cube maps are flat, so we need to calculate
 				// the texel's projected area on the sphere
-				float u = ((x + 0.5f) / (float)desc.Width) * 2 - 1;
-				float v = ((y + 0.5f) / (float)desc.Height) * 2 - 1;
+				float u = ((x + 0.5f) / (float)width) * 2 - 1;
+				float v = ((y + 0.5f) / (float)height) * 2 - 1;
 				float dist_sq = u * u + v * v + 1.0f; // Dist^2 from center to texel = x^2 + y^2 + z^2 (z == 1)
 				float projWeight = 4.0f / (float)sqrt(dist_sq) * dist_sq;
 
@@ -91,6 +91,7 @@ public:
 
 	bool GetUseSH();
 	void SetUseSH(bool useSH);
+	bool GetSHReady();
 
 	void CalculateSphericalHarmonics();
 
@@ -118,6 +119,7 @@ private:
 	void CreateIBLSpecularMap();
 	void CreateIBLIrradianceMap();
 	void CreateIBLIrradianceSphericalHarmonics();
+	void ProjectOntoSphericalHarmonics(const ReadbackResult& result);
 	Microsoft::WRL::ComPtr<ID3D12RootSignature> computeRootSig;
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> brdfLookUpTablePSO;
 	Microsoft::WRL::ComPtr<ID3D12PipelineState> specularMapPSO;
@@ -129,6 +131,7 @@ private:
 
 	bool useSHForIrradiance;
 	bool shCalculated;
+	bool shPending; // Waiting on the cube map readback
 	float shIrradiance[9 * 3]; // 9 coefficients * 3 color channels
 };
 
@@ -0,0 +1,254 @@
+#include "ReadbackRing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// ReadbackRing driven by a fake fence, the same way Graphics
+// drives it: requests are allocated while a "command list"
+// is recorded, submitted with the next fence value when it's
+// executed, and polled with whatever the fence has reached.
+// In-ring requests must never overlap another live request,
+// and everything must retire in the order it was made.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// Stand-in for the fence and its counters in Graphics.cpp
+struct MockFence
+{
+	uint64_t Submitted = 0;
+	uint64_t Completed = 0;
+
+	// Executing a list signals the next value
+	uint64_t Execute() { return ++Submitted; }
+
+	// The GPU catches up by some number of submissions
+	void Advance(uint64_t count) { Completed = std::min(Completed + count, Submitted); }
+};
+
+static bool Overlaps(const ReadbackRingEntry& a, const ReadbackRingEntry& b)
+{
+	return a.Offset < b.Offset + b.Size && b.Offset < a.Offset + a.Size;
+}
+
+static void WrapAround()
+{
+	ReadbackRing ring(1000);
+	MockFence fence;
+	std::vector<ReadbackRingEntry> completed;
+
+	ReadbackRingEntry a = ring.Allocate(400);
+	ReadbackRingEntry b = ring.Allocate(400);
+	ring.Submit(fence.Execute());
+	CHECK(a.InRing && a.Offset == 0);
+	CHECK(b.InRing && b.Offset == 400);
+
+	// Retire both
+	fence.Advance(1);
+	ring.Poll(fence.Completed, completed);
+	CHECK(completed.size() == 2);
+	completed.clear();
+
+	// Nothing live, so the ring starts over
+	ReadbackRingEntry c = ring.Allocate(600);
+	ReadbackRingEntry d = ring.Allocate(300);
+	ring.Submit(fence.Execute());
+	CHECK(c.InRing && c.Offset == 0);
+	CHECK(d.InRing && d.Offset == 600);
+
+	// Too big for the 100 left at the end, so it must wrap
+	// to the start, which is still in use by c
+	ReadbackRingEntry e = ring.Allocate(200);
+	CHECK(!e.InRing);
+	ring.Submit(fence.Execute());
+
+	// Retire c and d, which empties the ring again
+	fence.Advance(1);
+	ring.Poll(fence.Completed, completed);
+	CHECK(completed.size() == 2);
+	completed.clear();
+
+	ReadbackRingEntry f = ring.Allocate(900);
+	ReadbackRingEntry g = ring.Allocate(50);
+	ring.Submit(fence.Execute());
+	CHECK(f.InRing && f.Offset == 0);
+	CHECK(g.InRing && g.Offset == 900);
+
+	fence.Advance(1);
+	ring.Poll(fence.Completed, completed);
+	CHECK(completed.size() == 1); // Just e (external)
+
+	// f is still live, so there's no room at the end or the start
+	ReadbackRingEntry h = ring.Allocate(60);
+	CHECK(!h.InRing);
+	ring.Submit(fence.Execute());
+	fence.Advance(2);
+	completed.clear();
+	ring.Poll(fence.Completed, completed);
+	CHECK(completed.size() == 3);
+	CHECK(ring.GetUsedSize() == 0);
+	CHECK(ring.GetPendingCount() == 0);
+}
+
+static void FullRing()
+{
+	ReadbackRing ring(256);
+	MockFence fence;
+
+	// Exactly fill the ring
+	for (int i = 0; i < 4; i++)
+		CHECK(ring.Allocate(64).InRing);
+	CHECK(ring.GetUsedSize() == 256);
+
+	// head == tail, but full rather than empty
+	CHECK(!ring.Allocate(1).InRing);
+	ring.Submit(fence.Execute());
+	CHECK(ring.GetUsedSize() == 256);
+
+	// Nothing finishes until the fence says so
+	std::vector<ReadbackRingEntry> completed;
+	ring.Poll(fence.Completed, completed);
+	CHECK(completed.empty());
+	CHECK(!ring.Allocate(1).InRing);
+	ring.Submit(fence.Execute());
+
+	fence.Advance(1);
+	ring.Poll(fence.Completed, completed);
+	CHECK(completed.size() == 5);
+	CHECK(ring.GetUsedSize() == 0);
+}
+
+static void ExternalRequests()
+{
+	ReadbackRing ring(1024);
+	MockFence fence;
+	std::vector<ReadbackRingEntry> completed;
+
+	// Bigger than the whole ring
+	ReadbackRingEntry big = ring.Allocate(4096);
+	CHECK(!big.InRing);
+	CHECK(big.Size == 4096);
+	CHECK(ring.GetUsedSize() == 0);
+
+	// Later in-ring requests still fit and retire after it
+	ReadbackRingEntry small = ring.Allocate(100, 512);
+	CHECK(small.InRing && small.Offset % 512 == 0);
+	CHECK(ring.GetUnsubmittedCount() == 2);
+	ring.Submit(fence.Execute());
+	CHECK(ring.GetUnsubmittedCount() == 0);
+
+	fence.Advance(1);
+	ring.Poll(fence.Completed, completed);
+	CHECK(completed.size() == 2);
+	CHECK(completed.size() == 2 && completed[0].ID == big.ID && completed[1].ID == small.ID);
+
+	// Zero-sized requests still get a unique, retirable entry
+	ReadbackRingEntry zero = ring.Allocate(0);
+	CHECK(zero.InRing && zero.Size == 1);
+}
+
+static void UnsubmittedNeverRetire()
+{
+	ReadbackRing ring(1024);
+	MockFence fence;
+	std::vector<ReadbackRingEntry> completed;
+
+	ring.Allocate(100);
+	ring.Submit(fence.Execute());
+	ring.Allocate(100); // Recorded, not executed
+
+	fence.Advance(1);
+	ring.Poll(UINT64_MAX - 1, completed);
+	CHECK(completed.size() == 1);
+	CHECK(ring.GetUnsubmittedCount() == 1);
+	CHECK(ring.GetPendingCount() == 1);
+}
+
+// Random requests of random sizes, several per "frame", with
+// the GPU lagging a few frames behind, checked against a list
+// of what should still be live
+static void RandomFrames(unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<uint64_t> sizeDist(1, 3000);
+	std::uniform_int_distribution<int> countDist(0, 4);
+	std::uniform_int_distribution<int> lagDist(0, 3);
+	const uint64_t alignments[] = { 1, 256, 512 };
+
+	ReadbackRing ring(8192);
+	MockFence fence;
+	std::deque<ReadbackRingEntry> live;
+	unsigned int nextExpectedID = 0;
+
+	for (int frame = 0; frame < 2000; frame++)
+	{
+		int count = countDist(rng);
+		for (int i = 0; i < count; i++)
+		{
+			uint64_t alignment = alignments[rng() % 3];
+			ReadbackRingEntry e = ring.Allocate(sizeDist(rng), alignment);
+			if (e.InRing)
+			{
+				CHECK(e.Offset % alignment == 0);
+				CHECK(e.Offset + e.Size <= ring.GetSize());
+				for (const ReadbackRingEntry& other : live)
+					if (other.InRing)
+						CHECK(!Overlaps(e, other));
+			}
+			live.push_back(e);
+		}
+
+		uint64_t fenceValue = fence.Execute();
+		ring.Submit(fenceValue);
+		for (ReadbackRingEntry& e : live)
+			if (e.FenceValue == ReadbackUnsubmitted)
+				e.FenceValue = fenceValue;
+
+		// The GPU falls behind by a few frames at most
+		if (fence.Submitted - fence.Completed > 3)
+			fence.Advance(fence.Submitted - fence.Completed - 3);
+		fence.Advance(lagDist(rng));
+
+		std::vector<ReadbackRingEntry> completed;
+		ring.Poll(fence.Completed, completed);
+		for (const ReadbackRingEntry& e : completed)
+		{
+			// In order, and only once finished
+			CHECK(e.ID == nextExpectedID);
+			CHECK(e.FenceValue <= fence.Completed);
+			nextExpectedID = e.ID + 1;
+			live.pop_front();
+		}
+
+		// Everything left must still be waiting on the GPU
+		CHECK(live.empty() || live.front().FenceValue > fence.Completed);
+		CHECK(ring.GetPendingCount() == live.size());
+		CHECK(ring.GetUsedSize() <= ring.GetSize());
+	}
+}
+
+int main()
+{
+	WrapAround();
+	FullRing();
+	ExternalRequests();
+	UnsubmittedNeverRetire();
+	for (unsigned int seed = 1; seed <= 10; seed++)
+		RandomFrames(seed);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All readback ring tests passed\n");
+	return 0;
+}
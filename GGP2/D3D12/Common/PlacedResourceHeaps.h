@@ -0,0 +1,119 @@
+#pragma once
+
+#include <d3d12.h>
+#include <wrl/client.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "TLSFAllocator.h"
+
+// Summary of one pool of placed resource heaps, including how
+// much work it would take to defragment it
+struct HeapPoolReport
+{
+	const char* Name;
+	unsigned int HeapCount;
+	unsigned int AllocationCount;
+	unsigned int FreeBlockCount;
+	UINT64 TotalSizeInBytes;
+	UINT64 UsedSizeInBytes;
+	UINT64 LargestFreeBlockInBytes;
+	float Fragmentation;
+	unsigned int DefragMoveCount;
+	UINT64 DefragBytesToMove;
+};
+
+// --------------------------------------------------------
+// Places resources within a handful of large ID3D12Heaps
+// rather than giving each one a committed heap of its own.
+//
+// Heaps are grouped into pools by heap type and by what
+// resource heap tier 1 hardware allows to share a heap
+// (buffers, textures, render targets, MSAA), and a
+// TLSFAllocator per heap picks where each resource goes.
+// A resource too big for a standard heap gets a dedicated
+// heap that goes away when the resource does.
+//
+// Releasing is deferred: the caller says which fence value
+// the GPU must pass before the range can be reused, and
+// ProcessPendingReleases() frees whatever it has passed.
+// Every method takes an internal lock, so resources can be
+// created and released from any thread.
+// --------------------------------------------------------
+class PlacedResourceHeaps
+{
+public:
+	// Size of each standard heap
+	static const UINT64 DefaultHeapSize = 64 * 1024 * 1024;
+
+	PlacedResourceHeaps(Microsoft::WRL::ComPtr<ID3D12Device> device, UINT64 heapSize = DefaultHeapSize);
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> Create(
+		D3D12_HEAP_TYPE heapType,
+		const D3D12_RESOURCE_DESC& desc,
+		D3D12_RESOURCE_STATES initialState,
+		const D3D12_CLEAR_VALUE* clearValue = 0);
+	void Release(Microsoft::WRL::ComPtr<ID3D12Resource>& resource, UINT64 fenceValue);
+	void ProcessPendingReleases(UINT64 completedFenceValue);
+
+	UINT64 GetHeapSize() const;
+	std::vector<HeapPoolReport> GetReports();
+
+private:
+	struct PlacedHeap
+	{
+		Microsoft::WRL::ComPtr<ID3D12Heap> Heap;
+		TLSFAllocator Allocator;
+		bool Dedicated; // Created for one oversized resource?
+
+		PlacedHeap(UINT64 size) : Allocator(size), Dedicated(false) {}
+	};
+
+	struct HeapPool
+	{
+		const char* Name;
+		D3D12_HEAP_TYPE Type;
+		D3D12_HEAP_FLAGS Flags;
+		UINT64 Alignment;
+		std::vector<std::unique_ptr<PlacedHeap>> Heaps;
+	};
+
+	enum HeapPoolIndex
+	{
+		POOL_DEFAULT_BUFFERS,
+		POOL_DEFAULT_TEXTURES,
+		POOL_DEFAULT_RT_DS_TEXTURES,
+		POOL_DEFAULT_MSAA_TEXTURES,
+		POOL_UPLOAD_BUFFERS,
+		POOL_READBACK_BUFFERS,
+		POOL_COUNT
+	};
+
+	// Where each placed resource lives, so we can free its range later
+	struct PlacedAllocation
+	{
+		unsigned int Pool;
+		PlacedHeap* Heap;
+		TLSFAllocation Allocation;
+	};
+
+	// A released resource the GPU might still be using, along
+	// with the fence value that makes it safe to reuse its range
+	struct PendingRelease
+	{
+		UINT64 FenceValue;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Device> device;
+	UINT64 heapSize;
+
+	HeapPool pools[POOL_COUNT];
+	std::unordered_map<ID3D12Resource*, PlacedAllocation> allocations;
+	std::vector<PendingRelease> pendingReleases;
+	std::mutex mutex;
+
+	static unsigned int ChoosePool(D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC& desc);
+};
@@ -0,0 +1,106 @@
+#include "TLSFAllocator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Times allocate/free pairs and reports how fragmented a
+// 64MB heap gets under churn that looks like the hybrid
+// demo's placed resources: mostly small buffers at 64KB
+// placement alignment, some 4KB-aligned small textures and
+// the occasional multi-megabyte texture.
+// --------------------------------------------------------
+
+static uint64_t RandomResourceSize(std::mt19937& rng, uint64_t& alignment)
+{
+	unsigned int kind = rng() % 100;
+	if (kind < 60)
+	{
+		alignment = 65536;
+		return 256 + rng() % (256 * 1024);
+	}
+	if (kind < 90)
+	{
+		alignment = 4096;
+		return 4096 * (1 + rng() % 16);
+	}
+	alignment = 65536;
+	return (1 + rng() % 4) << 20;
+}
+
+static void Report(const char* label, const TLSFAllocator& allocator)
+{
+	TLSFStats stats = allocator.GetStats();
+	std::vector<TLSFMove> moves;
+	allocator.BuildDefragmentationPlan(moves);
+
+	uint64_t moveBytes = 0;
+	for (const TLSFMove& move : moves)
+		moveBytes += move.Size;
+
+	std::printf("%-22s used %6.2f MB in %5u allocations, %5u free blocks, largest free %6.2f MB, fragmentation %.3f, defrag %4zu moves / %6.2f MB\n",
+		label,
+		stats.UsedSize / (1024.0 * 1024.0),
+		stats.AllocationCount,
+		stats.FreeBlockCount,
+		stats.LargestFreeBlock / (1024.0 * 1024.0),
+		stats.Fragmentation(),
+		moves.size(),
+		moveBytes / (1024.0 * 1024.0));
+}
+
+int main()
+{
+	const uint64_t heapSize = 64ull << 20;
+	TLSFAllocator allocator(heapSize);
+	std::mt19937 rng(1234);
+
+	// Fill to around 75%
+	std::vector<TLSFAllocation> live;
+	while (allocator.GetStats().UsedSize < heapSize * 3 / 4)
+	{
+		uint64_t alignment;
+		uint64_t size = RandomResourceSize(rng, alignment);
+		TLSFAllocation alloc = allocator.Allocate(size, alignment);
+		if (!alloc.IsValid())
+			break;
+		live.push_back(alloc);
+	}
+	Report("After fill", allocator);
+
+	// Churn: free a random resource, allocate a new one in its place
+	const unsigned int rounds = 5;
+	const unsigned int pairsPerRound = 200000;
+	unsigned int failed = 0;
+	double totalSeconds = 0.0;
+	for (unsigned int round = 0; round < rounds; round++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		for (unsigned int i = 0; i < pairsPerRound; i++)
+		{
+			size_t pick = rng() % live.size();
+			allocator.Free(live[pick]);
+
+			uint64_t alignment;
+			uint64_t size = RandomResourceSize(rng, alignment);
+			// A slot that didn't fit stays empty (freeing it is a no-op)
+			// until it's picked again, so the heap stays about as full
+			live[pick] = allocator.Allocate(size, alignment);
+			if (!live[pick].IsValid())
+				failed++;
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		totalSeconds += std::chrono::duration<double>(end - start).count();
+
+		char label[32];
+		std::snprintf(label, sizeof(label), "After churn round %u", round + 1);
+		Report(label, allocator);
+	}
+
+	double pairs = (double)rounds * pairsPerRound;
+	std::printf("%.0f free/allocate pairs in %.3f s: %.1f ns per pair, %u allocations didn't fit\n",
+		pairs, totalSeconds, totalSeconds * 1e9 / pairs, failed);
+	return 0;
+}
@@ -0,0 +1,234 @@
+#include "TLSFAllocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Random allocate/free sequences run against TLSFAllocator
+// and a plain map of live ranges.  After every step the
+// allocator's stats must agree with the gaps between the
+// live ranges in the map (frees merge immediately, so every
+// gap should be exactly one free block).
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+struct ReferenceAllocation
+{
+	TLSFAllocation Allocation;
+	uint64_t Alignment;
+};
+
+// Live ranges, keyed by offset
+typedef std::map<uint64_t, ReferenceAllocation> ReferenceMap;
+
+// Free gaps between the live ranges
+static std::vector<uint64_t> Gaps(const ReferenceMap& live, uint64_t totalSize)
+{
+	std::vector<uint64_t> gaps;
+	uint64_t cursor = 0;
+	for (auto& [offset, ref] : live)
+	{
+		if (offset > cursor) gaps.push_back(offset - cursor);
+		cursor = offset + ref.Allocation.Size;
+	}
+	if (totalSize > cursor) gaps.push_back(totalSize - cursor);
+	return gaps;
+}
+
+static void CheckAgainstReference(const TLSFAllocator& allocator, const ReferenceMap& live)
+{
+	uint64_t used = 0;
+	uint64_t cursor = 0;
+	for (auto& [offset, ref] : live)
+	{
+		CHECK(offset >= cursor); // No overlaps
+		cursor = offset + ref.Allocation.Size;
+		used += ref.Allocation.Size;
+	}
+	CHECK(cursor <= allocator.GetSize());
+
+	std::vector<uint64_t> gaps = Gaps(live, allocator.GetSize());
+	uint64_t largest = gaps.empty() ? 0 : *std::max_element(gaps.begin(), gaps.end());
+
+	TLSFStats stats = allocator.GetStats();
+	CHECK(stats.TotalSize == allocator.GetSize());
+	CHECK(stats.UsedSize == used);
+	CHECK(stats.FreeSize == allocator.GetSize() - used);
+	CHECK(stats.AllocationCount == live.size());
+	CHECK(stats.FreeBlockCount == gaps.size());
+	CHECK(stats.LargestFreeBlock == largest);
+}
+
+// Applies a defragmentation plan to a copy of the live ranges and
+// checks the result is packed, aligned and still doesn't overlap
+static void CheckDefragmentationPlan(const TLSFAllocator& allocator, const ReferenceMap& live)
+{
+	std::vector<TLSFMove> moves;
+	allocator.BuildDefragmentationPlan(moves);
+
+	std::map<unsigned int, uint64_t> destinations;
+	for (const TLSFMove& move : moves)
+	{
+		auto it = live.find(move.SourceOffset);
+		CHECK(it != live.end());
+		if (it == live.end())
+			continue;
+
+		CHECK(it->second.Allocation.BlockIndex == move.BlockIndex);
+		CHECK(it->second.Allocation.Size == move.Size);
+		CHECK(move.DestOffset < move.SourceOffset); // Only ever moves down
+		CHECK(move.DestOffset % it->second.Alignment == 0);
+		destinations[move.BlockIndex] = move.DestOffset;
+	}
+
+	// Walk in the original order, which compaction preserves
+	uint64_t cursor = 0;
+	for (auto& [offset, ref] : live)
+	{
+		auto moved = destinations.find(ref.Allocation.BlockIndex);
+		uint64_t dest = moved == destinations.end() ? offset : moved->second;
+		CHECK(dest >= cursor);
+		CHECK(dest - cursor < ref.Alignment); // Only alignment padding left behind
+		cursor = dest + ref.Allocation.Size;
+	}
+}
+
+static void RandomSequence(uint64_t heapSize, uint64_t maxSize, const std::vector<uint64_t>& alignments, unsigned int steps, unsigned int seed)
+{
+	TLSFAllocator allocator(heapSize);
+	ReferenceMap live;
+	std::vector<uint64_t> liveOffsets;
+
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<uint64_t> sizeDist(1, maxSize);
+	std::uniform_int_distribution<size_t> alignDist(0, alignments.size() - 1);
+
+	for (unsigned int step = 0; step < steps; step++)
+	{
+		// Lean toward allocating until things are fairly full
+		bool allocate = liveOffsets.empty() || (rng() % 100) < 55;
+		if (allocate)
+		{
+			uint64_t size = sizeDist(rng);
+			uint64_t alignment = alignments[alignDist(rng)];
+			std::vector<uint64_t> gaps = Gaps(live, heapSize);
+
+			TLSFAllocation alloc = allocator.Allocate(size, alignment);
+			if (!alloc.IsValid())
+			{
+				// Good fit may round a request up to the next bucket
+				// (1/16th of its power of two), but it must never fail
+				// when a gap could hold that with worst-case padding
+				uint64_t needed = size + alignment - 1;
+				needed += needed / 16 + 16;
+				for (uint64_t gap : gaps)
+					CHECK(gap < needed);
+				continue;
+			}
+
+			CHECK(alloc.Offset % alignment == 0);
+			CHECK(alloc.Size >= size);
+			CHECK(alloc.Offset + alloc.Size <= heapSize);
+			CHECK(live.find(alloc.Offset) == live.end());
+
+			live[alloc.Offset] = { alloc, alignment };
+			liveOffsets.push_back(alloc.Offset);
+		}
+		else
+		{
+			size_t pick = rng() % liveOffsets.size();
+			uint64_t offset = liveOffsets[pick];
+			liveOffsets[pick] = liveOffsets.back();
+			liveOffsets.pop_back();
+
+			TLSFAllocation alloc = live[offset].Allocation;
+			live.erase(offset);
+			allocator.Free(alloc);
+		}
+
+		CheckAgainstReference(allocator, live);
+		if (step % 64 == 0)
+			CheckDefragmentationPlan(allocator, live);
+
+		if (failures > 0)
+		{
+			std::printf("Failed in sequence with seed %u at step %u\n", seed, step);
+			return;
+		}
+	}
+
+	// Everything freed should merge back into one block
+	for (auto& [offset, ref] : live)
+		allocator.Free(ref.Allocation);
+	live.clear();
+
+	TLSFStats stats = allocator.GetStats();
+	CHECK(stats.UsedSize == 0);
+	CHECK(stats.AllocationCount == 0);
+	CHECK(stats.FreeBlockCount == 1);
+	CHECK(stats.LargestFreeBlock == heapSize);
+	CHECK(stats.Fragmentation() == 0.0f);
+}
+
+static void DoubleFreeIsIgnored()
+{
+	TLSFAllocator allocator(1024);
+	TLSFAllocation a = allocator.Allocate(100);
+	TLSFAllocation b = allocator.Allocate(100);
+	allocator.Free(a);
+	allocator.Free(a);
+	allocator.Free(TLSFAllocation{});
+
+	TLSFStats stats = allocator.GetStats();
+	CHECK(stats.AllocationCount == 1);
+	CHECK(stats.UsedSize == b.Size);
+}
+
+static void ExactFitAndExhaustion()
+{
+	// The whole range, then nothing more
+	TLSFAllocator allocator(1 << 20);
+	TLSFAllocation all = allocator.Allocate(1 << 20);
+	CHECK(all.IsValid() && all.Offset == 0 && all.Size == (1 << 20));
+	CHECK(!allocator.Allocate(1).IsValid());
+
+	allocator.Free(all);
+	CHECK(allocator.GetStats().LargestFreeBlock == (1 << 20));
+
+	// Reset drops everything
+	allocator.Allocate(1000);
+	allocator.Allocate(5000, 256);
+	allocator.Reset();
+	TLSFStats stats = allocator.GetStats();
+	CHECK(stats.AllocationCount == 0 && stats.FreeBlockCount == 1);
+}
+
+int main()
+{
+	DoubleFreeIsIgnored();
+	ExactFitAndExhaustion();
+
+	// Small range with odd sizes and non power of two alignments
+	for (unsigned int seed = 1; seed <= 20; seed++)
+		RandomSequence(64 * 1024, 3000, { 1, 3, 16, 48, 256 }, 4000, seed);
+
+	// Shaped like the demo's heaps: 64MB with buffer and texture alignments
+	for (unsigned int seed = 100; seed <= 104; seed++)
+		RandomSequence(64ull << 20, 4ull << 20, { 256, 4096, 65536 }, 4000, seed);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All TLSFAllocator tests passed\n");
+	return 0;
+}
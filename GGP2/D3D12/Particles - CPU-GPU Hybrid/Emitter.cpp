@@ -1,6 +1,7 @@
 #include "Emitter.h"
 #include "Graphics.h"
 #include "PathHelpers.h"
+#include "FramePacket.h"
 
 // Needed for a helper function to load pre-compiled shader files
 #pragma comment(lib, "d3dcompiler.lib")
@@ -79,15 +80,21 @@ Emitter::~Emitter()
 {
 	// Clean up the particle array
 	delete[] particles;
+
+	// Return our placed buffers to their heaps
+	Graphics::ReleasePlacedResource(indexBuffer);
+	for (unsigned int i = 0; i < Graphics::MaxFramesInFlight; i++)
+		Graphics::ReleasePlacedResource(particleDataBuffer[i]);
 }
 
 std::shared_ptr<Transform> Emitter::GetTransform() { return transform; }
 
 void Emitter::CreateParticlesAndGPUResources()
 {
-	// Delete and release existing resources
+	// Delete and release existing resources (the GPU might still be using
+	// the placed buffers from a previous frame, so they're released safely)
 	if (particles) delete[] particles;
-	indexBuffer.Reset();
+	Graphics::ReleasePlacedResource(indexBuffer);
 
 	// Set up the particle array
 	particles = new Particle[maxParticles];
@@ -118,13 +125,6 @@ void Emitter::CreateParticlesAndGPUResources()
 	ibv.Format = DXGI_FORMAT_R32_UINT;
 
 	// Describe the upload buffers to hold particle data on the GPU
-	D3D12_HEAP_PROPERTIES heapProps = {};
-	heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapProps.CreationNodeMask = 1;
-	heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapProps.Type = D3D12_HEAP_TYPE_UPLOAD; // Upload heap since we'll be copying often!
-	heapProps.VisibleNodeMask = 1;
-
 	D3D12_RESOURCE_DESC resDesc = {};
 	resDesc.Alignment = 0;
 	resDesc.DepthOrArraySize = 1;
@@ -140,19 +140,16 @@ void Emitter::CreateParticlesAndGPUResources()
 
 	// Make a number of buffers and associated descriptors for each
 	// possible frame in flight
-	for (unsigned int i = 0; i < Graphics::NumBackBuffers; i++)
+	for (unsigned int i = 0; i < Graphics::MaxFramesInFlight; i++)
 	{
-		// Reset if necessary
-		particleDataBuffer[i].Reset();
-
-		// Create the buffer
-		Graphics::Device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&resDesc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			0,
-			IID_PPV_ARGS(particleDataBuffer[i].GetAddressOf()));
+		// Release if necessary
+		Graphics::ReleasePlacedResource(particleDataBuffer[i]);
+
+		// Create the buffer, placed in an upload heap since we'll be copying often!
+		particleDataBuffer[i] = Graphics::CreatePlacedResource(
+			D3D12_HEAP_TYPE_UPLOAD,
+			resDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ);
 
 		// Keep mapped!
 		D3D12_RANGE range{ 0, 0 };
@@ -407,12 +404,64 @@ void Emitter::EmitParticle(float currentTime)
 	livingParticleCount++;
 }
 
-void Emitter::Draw(std::shared_ptr<Camera> camera, float currentTime, bool debugWireframe)
+// --------------------------------------------------------
+// Copies this frame's emitter settings and living particles
+// into a draw item, so the emitter can keep simulating while
+// the frame is rendered
+//
+// arena - Per-frame memory for the particle copy
+// item  - The draw item to fill in
+// --------------------------------------------------------
+void Emitter::Snapshot(FrameArena& arena, EmitterDrawItem& item)
+{
+	item.Source = this;
+	item.TextureIndex = textureDescriptorIndex;
+	item.Particles = 0;
+	item.ParticleCount = visible ? livingParticleCount : 0;
+
+	// Emitter-wide constants (view & projection are set at draw time)
+	ParticleVSConstantBuffer& cb = item.Constants;
+	cb = {};
+	cb.CurrentTime = totalEmitterTime;
+	cb.Lifetime = lifetime;
+	cb.Acceleration = emitterAcceleration;
+	cb.StartSize = startSize;
+	cb.EndSize = endSize;
+	cb.StartColor = startColor;
+	cb.EndColor = endColor;
+	cb.ColorTint = XMFLOAT3(1, 1, 1);
+	cb.ConstrainYAxis = constrainYAxis;
+	cb.SpriteSheetWidth = spriteSheetWidth;
+	cb.SpriteSheetHeight = spriteSheetHeight;
+	cb.SpriteSheetFrameWidth = spriteSheetFrameWidth;
+	cb.SpriteSheetFrameHeight = spriteSheetFrameHeight;
+	cb.SpriteSheetSpeedScale = spriteSheetSpeedScale;
+
+	// Living particles, copied into one contiguous chunk
+	if (item.ParticleCount > 0)
+	{
+		item.Particles = arena.AllocateArray<Particle>(item.ParticleCount);
+		CopyLivingParticles(item.Particles);
+	}
+}
+
+// --------------------------------------------------------
+// Draws a snapshot of this emitter - called on the render
+// thread, so only the draw item (and not the emitter's own
+// simulation state) is used here
+// --------------------------------------------------------
+void Emitter::Draw(
+	const EmitterDrawItem& item,
+	const XMFLOAT4X4& view,
+	const XMFLOAT4X4& projection,
+	bool debugWireframe)
 {
-	if (!visible)
+	if (item.ParticleCount == 0)
 		return;
 
-	CopyParticlesToGPU();
+	// Copy the snapshot into this frame slot's upload buffer
+	unsigned int frame = Graphics::FrameIndex();
+	memcpy(particleDataBufferAddress[frame], item.Particles, sizeof(Particle) * item.ParticleCount);
 
 	// Set render details
 	Graphics::CommandList->SetPipelineState(debugWireframe ? psoWireframe.Get() : pso.Get());
@@ -421,28 +470,14 @@ void Emitter::Draw(std::shared_ptr<Camera> camera, float currentTime, bool debug
 	// Overall draw data
 	ParticleDrawData drawData{};
 	drawData.DebugWireframe = debugWireframe;
-	drawData.ParticleTextureIndex = textureDescriptorIndex;
-	drawData.ParticleDataIndex = Graphics::GetDescriptorIndex(particleDataGPUHandle[Graphics::SwapChainIndex()]);
+	drawData.ParticleTextureIndex = item.TextureIndex;
+	drawData.ParticleDataIndex = Graphics::GetDescriptorIndex(particleDataGPUHandle[frame]);
 
 	// Set up VS constant buffer data
 	{
-		ParticleVSConstantBuffer cb{};
-		cb.View = camera->GetView();
-		cb.Projection = camera->GetProjection();
-		cb.CurrentTime = totalEmitterTime;
-		cb.Lifetime = lifetime;
-		cb.Acceleration = emitterAcceleration;
-		cb.StartSize = startSize;
-		cb.EndSize = endSize;
-		cb.StartColor = startColor;
-		cb.EndColor = endColor;
-		cb.ColorTint = XMFLOAT3(1, 1, 1);
-		cb.ConstrainYAxis = constrainYAxis;
-		cb.SpriteSheetWidth = spriteSheetWidth;
-		cb.SpriteSheetHeight = spriteSheetHeight;
-		cb.SpriteSheetFrameWidth = spriteSheetFrameWidth;
-		cb.SpriteSheetFrameHeight = spriteSheetFrameHeight;
-		cb.SpriteSheetSpeedScale = spriteSheetSpeedScale;
+		ParticleVSConstantBuffer cb = item.Constants;
+		cb.View = view;
+		cb.Projection = projection;
 
 		D3D12_GPU_DESCRIPTOR_HANDLE cbHandle = Graphics::FillNextConstantBufferAndGetGPUDescriptorHandle(
 			(void*)(&cb), sizeof(ParticleVSConstantBuffer));
@@ -462,23 +497,20 @@ void Emitter::Draw(std::shared_ptr<Camera> camera, float currentTime, bool debug
 	// we can simply draw the correct amount of living particle indices.
 	// Each particle = 4 vertices = 6 indices for a quad
 	Graphics::CommandList->IASetIndexBuffer(&ibv);
-	Graphics::CommandList->DrawIndexedInstanced(livingParticleCount * 6, 1, 0, 0, 0);
+	Graphics::CommandList->DrawIndexedInstanced(item.ParticleCount * 6, 1, 0, 0, 0);
 }
 
-void Emitter::CopyParticlesToGPU()
+void Emitter::CopyLivingParticles(Particle* destination)
 {
 	// Now that we have emit and updated all particles for this frame, 
-	// we can copy them to the GPU as either one big chunk or two smaller chunks
-
-	// Which frame are we on?
-	unsigned int frame = Graphics::SwapChainIndex();
+	// we can copy them out as either one big chunk or two smaller chunks
 
 	// How are living particles arranged in the buffer?
 	if (firstAliveIndex < firstDeadIndex)
 	{
 		// Only copy from FirstAlive -> FirstDead
 		memcpy(
-			particleDataBufferAddress[frame], // Destination = start of particle buffer
+			destination, // Destination = start of the copy
 			particles + firstAliveIndex, // Source = particle array, offset to first living particle
 			sizeof(Particle) * livingParticleCount); // Amount = number of particles (measured in BYTES!)
 	}
@@ -486,13 +518,13 @@ void Emitter::CopyParticlesToGPU()
 	{
 		// Copy from 0 -> FirstDead 
 		memcpy(
-			particleDataBufferAddress[frame], // Destination = start of particle buffer
+			destination, // Destination = start of the copy
 			particles, // Source = start of particle array
 			sizeof(Particle) * firstDeadIndex); // Amount = particles up to first dead (measured in BYTES!)
 
 		// ALSO copy from FirstAlive -> End
 		memcpy(
-			(void*)((Particle*)particleDataBufferAddress[frame] + firstDeadIndex), // Destination = particle buffer, AFTER the data we copied in previous memcpy()
+			destination + firstDeadIndex, // Destination = AFTER the data we copied in previous memcpy()
 			particles + firstAliveIndex,  // Source = particle array, offset to first living particle
 			sizeof(Particle) * (maxParticles - firstAliveIndex)); // Amount = number of living particles at end of array (measured in BYTES!)
 	}
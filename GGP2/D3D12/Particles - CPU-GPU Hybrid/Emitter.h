@@ -9,6 +9,9 @@
 #include "Camera.h"
 #include "Transform.h"
 
+struct EmitterDrawItem;
+class FrameArena;
+
 // We'll be mimicking this in HLSL
 // so we need to care about alignment!
 struct Particle
@@ -85,9 +88,14 @@ public:
 	~Emitter();
 
 	void Update(float dt, float currentTime);
+
+	// Copies everything needed to draw this frame into a draw item
+	// (particles go into the arena), then draws from that copy
+	void Snapshot(FrameArena& arena, EmitterDrawItem& item);
 	void Draw(
-		std::shared_ptr<Camera> camera,
-		float currentTime,
+		const EmitterDrawItem& item,
+		const DirectX::XMFLOAT4X4& view,
+		const DirectX::XMFLOAT4X4& projection,
 		bool debugWireframe);
 
 	std::shared_ptr<Transform> GetTransform();
@@ -147,10 +155,10 @@ private:
 	void CreateRootSigAndPipelineState();
 
 	// Rendering
-	Microsoft::WRL::ComPtr<ID3D12Resource> particleDataBuffer[Graphics::NumBackBuffers];
-	void* particleDataBufferAddress[Graphics::NumBackBuffers]{};
-	D3D12_CPU_DESCRIPTOR_HANDLE particleDataCPUHandle[Graphics::NumBackBuffers]{};
-	D3D12_GPU_DESCRIPTOR_HANDLE particleDataGPUHandle[Graphics::NumBackBuffers]{};
+	Microsoft::WRL::ComPtr<ID3D12Resource> particleDataBuffer[Graphics::MaxFramesInFlight];
+	void* particleDataBufferAddress[Graphics::MaxFramesInFlight]{};
+	D3D12_CPU_DESCRIPTOR_HANDLE particleDataCPUHandle[Graphics::MaxFramesInFlight]{};
+	D3D12_GPU_DESCRIPTOR_HANDLE particleDataGPUHandle[Graphics::MaxFramesInFlight]{};
 	
 	Microsoft::WRL::ComPtr<ID3D12Resource> indexBuffer;
 	D3D12_INDEX_BUFFER_VIEW ibv;
@@ -163,7 +171,7 @@ private:
 	std::shared_ptr<Transform> transform;
 
 	// Creation and copy methods
-	void CopyParticlesToGPU();
+	void CopyLivingParticles(Particle* destination);
 
 	// Simulation methods
 	void UpdateSingleParticle(float currentTime, int index);
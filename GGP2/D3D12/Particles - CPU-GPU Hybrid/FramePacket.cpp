@@ -0,0 +1,154 @@
+#include "FramePacket.h"
+
+// Helper for rounding a value up to a multiple of alignment
+static size_t AlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// --------------------------------------------------------
+// Creates an empty arena - the first block is allocated
+// when it's first needed
+// --------------------------------------------------------
+FrameArena::FrameArena(size_t blockSize) :
+	blockSize(blockSize > 0 ? blockSize : 1),
+	currentBlock(0),
+	currentOffset(0),
+	usedSize(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+	for (auto& b : blocks)
+		delete[] b.Memory;
+}
+
+size_t FrameArena::GetUsedSize() const { return usedSize; }
+
+size_t FrameArena::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (auto& b : blocks)
+		capacity += b.Size;
+	return capacity;
+}
+
+
+// --------------------------------------------------------
+// Bumps the offset within the current block, moving on to
+// the next block (or creating a new one) if there's no room.
+// Requests larger than the block size get a block of their own.
+//
+// size      - Size of the allocation in bytes
+// alignment - Required alignment of the returned pointer
+// --------------------------------------------------------
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	if (size == 0) size = 1;
+	if (alignment == 0) alignment = 1;
+
+	while (true)
+	{
+		// Does it fit in the current block?
+		if (currentBlock < blocks.size())
+		{
+			Block& block = blocks[currentBlock];
+			size_t address = (size_t)block.Memory + currentOffset;
+			size_t aligned = AlignUp(address, alignment);
+			size_t end = aligned - (size_t)block.Memory + size;
+			if (end <= block.Size)
+			{
+				usedSize += end - currentOffset;
+				currentOffset = end;
+				return (void*)aligned;
+			}
+
+			// Try the next block, if there is one
+			if (currentBlock + 1 < blocks.size())
+			{
+				currentBlock++;
+				currentOffset = 0;
+				continue;
+			}
+		}
+
+		// Out of blocks, so add one that's big enough (including alignment slack)
+		Block block{};
+		block.Size = size + alignment > blockSize ? size + alignment : blockSize;
+		block.Memory = new unsigned char[block.Size];
+		blocks.push_back(block);
+		currentBlock = (unsigned int)blocks.size() - 1;
+		currentOffset = 0;
+	}
+}
+
+
+// --------------------------------------------------------
+// Frees every allocation at once, keeping the blocks around
+// for the next frame
+// --------------------------------------------------------
+void FrameArena::Reset()
+{
+	currentBlock = 0;
+	currentOffset = 0;
+	usedSize = 0;
+}
+
+
+FramePacket::~FramePacket()
+{
+	Reset();
+}
+
+
+// --------------------------------------------------------
+// Releases the previous frame's data so the packet can be
+// filled in again
+// --------------------------------------------------------
+void FramePacket::Reset()
+{
+	// The UI draw lists were cloned, so they're ours to free
+	for (int i = 0; i < UIDrawData.CmdLists.Size; i++)
+		IM_DELETE(UIDrawData.CmdLists[i]);
+	UIDrawData.Clear();
+	HasUI = false;
+
+	Lights = 0;
+	LightCount = 0;
+	Entities = 0;
+	EntityCount = 0;
+	Emitters = 0;
+	EmitterCount = 0;
+	DrawEmitterWireframe = false;
+
+	Arena.Reset();
+}
+
+
+// --------------------------------------------------------
+// Copies ImGui's draw data, cloning each draw list so the
+// render thread isn't affected by the next ImGui frame
+//
+// drawData - Draw data from ImGui::GetDrawData(), after Render()
+// --------------------------------------------------------
+void FramePacket::CopyUIDrawData(ImDrawData* drawData)
+{
+	if (!drawData || !drawData->Valid)
+		return;
+
+	UIDrawData.Valid = true;
+	UIDrawData.TotalIdxCount = drawData->TotalIdxCount;
+	UIDrawData.TotalVtxCount = drawData->TotalVtxCount;
+	UIDrawData.DisplayPos = drawData->DisplayPos;
+	UIDrawData.DisplaySize = drawData->DisplaySize;
+	UIDrawData.FramebufferScale = drawData->FramebufferScale;
+	UIDrawData.OwnerViewport = drawData->OwnerViewport;
+	UIDrawData.Textures = drawData->Textures;
+
+	for (int i = 0; i < drawData->CmdLists.Size; i++)
+		UIDrawData.CmdLists.push_back(drawData->CmdLists[i]->CloneOutput());
+	UIDrawData.CmdListsCount = UIDrawData.CmdLists.Size;
+
+	HasUI = true;
+}
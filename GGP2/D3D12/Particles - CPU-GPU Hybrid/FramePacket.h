@@ -0,0 +1,123 @@
+#pragma once
+
+#include <d3d12.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "BufferStructs.h"
+#include "Lights.h"
+#include "Emitter.h"
+#include "ImGui/imgui.h"
+
+// --------------------------------------------------------
+// A simple linear allocator for per-frame data.  Memory is
+// handed out from large blocks by bumping an offset, and
+// everything is freed at once with Reset().  Blocks are never
+// moved or freed until the arena is destroyed, so pointers
+// stay valid until the next Reset() and, once warmed up, the
+// arena itself makes no heap allocations (though the UI draw
+// lists copied into a packet are still cloned on the heap).
+// --------------------------------------------------------
+class FrameArena
+{
+public:
+	FrameArena(size_t blockSize = 64 * 1024);
+	~FrameArena();
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	void* Allocate(size_t size, size_t alignment = 16);
+	void Reset();
+
+	// Allocates (uninitialized) room for count objects of type T
+	template<typename T>
+	T* AllocateArray(size_t count)
+	{
+		return (T*)Allocate(sizeof(T) * count, alignof(T));
+	}
+
+	size_t GetUsedSize() const;
+	size_t GetCapacity() const;
+
+private:
+	struct Block
+	{
+		unsigned char* Memory;
+		size_t Size;
+	};
+
+	size_t blockSize;
+	std::vector<Block> blocks;
+	unsigned int currentBlock;
+	size_t currentOffset;
+	size_t usedSize;
+};
+
+// Everything needed to draw a single entity, copied out
+// of its transform, material and mesh
+struct EntityDrawItem
+{
+	VertexShaderPerObjectData VSData;
+	PixelShaderPerObjectData PSData;
+	ID3D12PipelineState* PipelineState;
+	unsigned int IndexCount;
+	unsigned int FirstIndex;
+	unsigned int BaseVertex;
+};
+
+// Everything needed to draw a single emitter.  The view and
+// projection matrices are filled in from the packet at draw time.
+struct EmitterDrawItem
+{
+	Emitter* Source;
+	ParticleVSConstantBuffer Constants;
+	unsigned int TextureIndex;
+	Particle* Particles;		// Living particles, oldest first
+	unsigned int ParticleCount;
+};
+
+// --------------------------------------------------------
+// An immutable snapshot of one frame, built by the game
+// thread at the end of Update() and consumed by the render
+// thread.  All variable-length data lives in the packet's
+// own arena, so nothing here points back into game state
+// that may change while the frame is being rendered (other
+// than long-lived GPU objects, like pipeline states).
+// --------------------------------------------------------
+struct FramePacket
+{
+	FramePacket() = default;
+	~FramePacket();
+	FramePacket(const FramePacket&) = delete;
+	FramePacket& operator=(const FramePacket&) = delete;
+
+	// Frees everything from the previous use of this packet
+	void Reset();
+
+	// Deep copies ImGui's draw data, which is only valid until
+	// ImGui's next frame begins (ImGui clones each draw list, so
+	// this allocates every frame the UI is shown)
+	void CopyUIDrawData(ImDrawData* drawData);
+
+	// Camera
+	DirectX::XMFLOAT4X4 View{};
+	DirectX::XMFLOAT4X4 Projection{};
+	DirectX::XMFLOAT3 CameraPosition{};
+
+	// Lights
+	Light* Lights = 0;
+	int LightCount = 0;
+
+	// Scene
+	EntityDrawItem* Entities = 0;
+	unsigned int EntityCount = 0;
+	EmitterDrawItem* Emitters = 0;
+	unsigned int EmitterCount = 0;
+	bool DrawEmitterWireframe = false;
+
+	// UI (the draw lists are owned by this packet)
+	ImDrawData UIDrawData;
+	bool HasUI = false;
+
+	FrameArena Arena;
+};
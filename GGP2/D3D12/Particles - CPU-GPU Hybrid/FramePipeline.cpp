@@ -0,0 +1,190 @@
+#include "FramePipeline.h"
+
+// --------------------------------------------------------
+// Creates a pipeline with the given number of slots.  The
+// render thread isn't started until Start() is called.
+// --------------------------------------------------------
+FramePipeline::FramePipeline(unsigned int slotCount) :
+	slotCount(slotCount > 0 ? slotCount : 1),
+	acquiredFrames(0),
+	submittedFrames(0),
+	renderedFrames(0),
+	running(false),
+	stopRequested(false)
+{
+}
+
+FramePipeline::~FramePipeline()
+{
+	Stop();
+}
+
+unsigned int FramePipeline::GetSlotCount() const { return slotCount; }
+
+bool FramePipeline::IsRunning()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return running;
+}
+
+uint64_t FramePipeline::GetSubmittedFrameCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return submittedFrames;
+}
+
+uint64_t FramePipeline::GetRenderedFrameCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return renderedFrames;
+}
+
+uint64_t FramePipeline::GetUnrenderedFrameCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return acquiredFrames - renderedFrames;
+}
+
+
+// --------------------------------------------------------
+// Sets the function used to render a slot.  Only change
+// this while the render thread is stopped.
+// --------------------------------------------------------
+void FramePipeline::SetRenderFunction(RenderFunction render)
+{
+	this->render = render;
+}
+
+
+// --------------------------------------------------------
+// Starts the render thread, if it isn't already running
+// --------------------------------------------------------
+void FramePipeline::Start()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (running)
+		return;
+
+	running = true;
+	stopRequested = false;
+	renderThread = std::thread(&FramePipeline::RenderThreadMain, this);
+}
+
+
+// --------------------------------------------------------
+// Stops the render thread once it has rendered everything
+// submitted so far.  Later submissions render inline.
+// --------------------------------------------------------
+void FramePipeline::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!running)
+			return;
+
+		stopRequested = true;
+	}
+
+	frameSubmitted.notify_all();
+	renderThread.join();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	running = false;
+}
+
+
+// --------------------------------------------------------
+// Waits until the next slot is free, meaning the frame that
+// last used it has been rendered, and returns its index
+// --------------------------------------------------------
+unsigned int FramePipeline::AcquireSlot()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Frame F reuses the slot from frame F - slotCount
+	uint64_t frame = acquiredFrames;
+	frameRendered.wait(lock, [&] { return renderedFrames + slotCount > frame; });
+
+	acquiredFrames++;
+	return (unsigned int)(frame % slotCount);
+}
+
+
+// --------------------------------------------------------
+// Queues a slot for the render thread, or renders it right
+// away if the render thread isn't running.  Slots must be
+// submitted in the order they were acquired.
+//
+// slot - The slot most recently returned by AcquireSlot()
+// --------------------------------------------------------
+void FramePipeline::Submit(unsigned int slot)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Ignore anything that wasn't acquired (or is out of order)
+	if (submittedFrames >= acquiredFrames ||
+		slot != submittedFrames % slotCount)
+		return;
+
+	submittedFrames++;
+
+	if (running)
+	{
+		lock.unlock();
+		frameSubmitted.notify_one();
+		return;
+	}
+
+	// No render thread, so render it here (without holding the lock)
+	lock.unlock();
+	if (render)
+		render(slot);
+
+	lock.lock();
+	renderedFrames++;
+	lock.unlock();
+	frameRendered.notify_all();
+}
+
+
+// --------------------------------------------------------
+// Blocks until every submitted frame has been rendered
+// --------------------------------------------------------
+void FramePipeline::WaitForIdle()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	frameRendered.wait(lock, [&] { return renderedFrames == submittedFrames; });
+}
+
+bool FramePipeline::IsIdle()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return renderedFrames == submittedFrames;
+}
+
+
+// --------------------------------------------------------
+// The render thread itself - renders submitted slots in
+// order until asked to stop (and nothing is left to render)
+// --------------------------------------------------------
+void FramePipeline::RenderThreadMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		frameSubmitted.wait(lock, [&] { return stopRequested || renderedFrames < submittedFrames; });
+
+		// Only stop once everything has been drained
+		if (renderedFrames == submittedFrames)
+			break;
+
+		unsigned int slot = (unsigned int)(renderedFrames % slotCount);
+		lock.unlock();
+		if (render)
+			render(slot);
+		lock.lock();
+
+		renderedFrames++;
+		frameRendered.notify_all();
+	}
+}
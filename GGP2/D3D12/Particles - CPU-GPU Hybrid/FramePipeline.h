@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// --------------------------------------------------------
+// Hands finished frames from the game thread to a dedicated
+// render thread.
+//
+// The game thread fills in a "slot" (whatever per-frame data
+// the caller keeps, usually a frame packet) and submits it;
+// the render thread then consumes slots in the order they
+// were submitted.  With two slots, the game thread can build
+// frame N+1 while the render thread is still recording frame
+// N, but never gets more than one frame ahead - acquiring a
+// slot blocks until the render thread is done with it.
+//
+// What "rendering a slot" means is entirely up to the render
+// function the caller supplies, so the hand-off can be
+// exercised with a renderer that records nothing at all.
+//
+// If the render thread isn't running, submitted slots are
+// simply rendered right away on the calling thread.
+// --------------------------------------------------------
+class FramePipeline
+{
+public:
+	// Called with the index of the slot to render
+	typedef std::function<void(unsigned int)> RenderFunction;
+
+	FramePipeline(unsigned int slotCount = 2);
+	~FramePipeline();
+	FramePipeline(const FramePipeline&) = delete;
+	FramePipeline& operator=(const FramePipeline&) = delete;
+
+	// Render thread management
+	void SetRenderFunction(RenderFunction render);
+	void Start();
+	void Stop();
+	bool IsRunning();
+
+	// Game thread - waits until the next slot is free, returns its index
+	unsigned int AcquireSlot();
+
+	// Game thread - queues the acquired slot for rendering
+	void Submit(unsigned int slot);
+
+	// Blocks until every submitted slot has been rendered, after which
+	// the game thread may safely touch anything the renderer uses
+	void WaitForIdle();
+	bool IsIdle();
+
+	// Frames acquired so far that haven't finished rendering, each of
+	// which still has to end (and signal its fence) on the renderer
+	uint64_t GetUnrenderedFrameCount();
+
+	unsigned int GetSlotCount() const;
+	uint64_t GetSubmittedFrameCount();
+	uint64_t GetRenderedFrameCount();
+
+private:
+	void RenderThreadMain();
+
+	unsigned int slotCount;
+	RenderFunction render;
+
+	// Frames are counted rather than tracked individually: frame
+	// number F always lives in slot (F % slotCount)
+	uint64_t acquiredFrames;
+	uint64_t submittedFrames;
+	uint64_t renderedFrames;
+
+	bool running;
+	bool stopRequested;
+	std::thread renderThread;
+	std::mutex mutex;
+	std::condition_variable frameSubmitted;
+	std::condition_variable frameRendered;
+};
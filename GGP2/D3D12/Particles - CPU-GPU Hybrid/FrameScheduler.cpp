@@ -0,0 +1,74 @@
+#include "FrameScheduler.h"
+
+// --------------------------------------------------------
+// Creates a scheduler with room for up to the given number
+// of frames in flight, starting with the requested amount
+// --------------------------------------------------------
+FrameScheduler::FrameScheduler(unsigned int maxFramesInFlight, unsigned int framesInFlight) :
+	maxFramesInFlight(maxFramesInFlight > 0 ? maxFramesInFlight : 1),
+	framesInFlight(1),
+	requestedFramesInFlight(1),
+	frameIndex(0)
+{
+	slotFenceValues.resize(this->maxFramesInFlight, 0);
+
+	// Apply the starting count right away
+	SetFramesInFlight(framesInFlight);
+	Reset();
+}
+
+unsigned int FrameScheduler::GetFramesInFlight() const { return framesInFlight; }
+unsigned int FrameScheduler::GetMaxFramesInFlight() const { return maxFramesInFlight; }
+unsigned int FrameScheduler::GetFrameIndex() const { return frameIndex; }
+
+
+// --------------------------------------------------------
+// Requests a new number of frames in flight (clamped to the
+// valid range), which is applied at the end of this frame
+// --------------------------------------------------------
+void FrameScheduler::SetFramesInFlight(unsigned int count)
+{
+	if (count < 1) count = 1;
+	if (count > maxFramesInFlight) count = maxFramesInFlight;
+	requestedFramesInFlight = count;
+}
+
+
+// --------------------------------------------------------
+// Ends the current frame and moves to the next slot
+//
+// fenceValue - Value that will be signaled once the GPU
+//              finishes all of this frame's work
+// --------------------------------------------------------
+uint64_t FrameScheduler::EndFrame(uint64_t fenceValue)
+{
+	slotFenceValues[frameIndex] = fenceValue;
+
+	// Changing the number of slots?  Every slot's resources might
+	// be reassigned, so wait for this (the latest) frame to finish
+	if (requestedFramesInFlight != framesInFlight)
+	{
+		framesInFlight = requestedFramesInFlight;
+		for (auto& value : slotFenceValues)
+			value = 0;
+		frameIndex = 0;
+		return fenceValue;
+	}
+
+	// Next slot can be used once its previous frame is done
+	frameIndex = (frameIndex + 1) % framesInFlight;
+	return slotFenceValues[frameIndex];
+}
+
+
+// --------------------------------------------------------
+// Starts over at the first slot, applying any requested
+// change to the number of frames in flight
+// --------------------------------------------------------
+void FrameScheduler::Reset()
+{
+	framesInFlight = requestedFramesInFlight;
+	for (auto& value : slotFenceValues)
+		value = 0;
+	frameIndex = 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// Decides when the CPU may start recording another frame.
+//
+// Each frame "in flight" gets a slot, which owns any per-frame
+// resources (command allocators, constant buffer space, dynamic
+// upload buffers, etc.).  When a frame ends, the fence value that
+// marks its completion is stored in its slot and we move to the
+// next one - which can only be reused once the GPU has reached
+// that slot's fence value.  More frames in flight means more
+// CPU/GPU overlap (throughput), fewer means less latency.
+//
+// The scheduler only hands back fence values; waiting on the
+// fence is left to Graphics.  Tests/FrameSchedulerTests plays
+// the GPU with a simulated timeline instead.
+//
+// Changing the number of frames in flight takes effect at the end
+// of the current frame, at which point the GPU must be drained so
+// every slot can safely be reassigned.
+// --------------------------------------------------------
+class FrameScheduler
+{
+public:
+	FrameScheduler(unsigned int maxFramesInFlight, unsigned int framesInFlight);
+
+	// Records that the current frame is done once the given fence value
+	// is reached, then moves to the next slot.  Returns the fence value
+	// the CPU must wait for before using that slot (0 means no wait).
+	uint64_t EndFrame(uint64_t fenceValue);
+
+	// Forgets all fence values and starts over at slot zero.  Only
+	// valid once the GPU is known to be idle.
+	void Reset();
+
+	void SetFramesInFlight(unsigned int count);
+	unsigned int GetFramesInFlight() const;
+	unsigned int GetMaxFramesInFlight() const;
+	unsigned int GetFrameIndex() const;
+
+private:
+	unsigned int maxFramesInFlight;
+	unsigned int framesInFlight;
+	unsigned int requestedFramesInFlight;
+	unsigned int frameIndex;
+
+	// Fence value that marks the completion of each slot's last frame
+	std::vector<uint64_t> slotFenceValues;
+};
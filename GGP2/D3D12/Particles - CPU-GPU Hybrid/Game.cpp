@@ -6,6 +6,7 @@
 #include "Window.h"
 #include "BufferStructs.h"
 #include "AssetPath.h"
+#include "GeometryPool.h"
 
 #include "ImGui/imgui.h"
 #include "ImGui/imgui_impl_dx12.h"
@@ -49,7 +50,7 @@ void Game::Initialize()
 		info.DSVFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 		info.LegacySingleSrvCpuDescriptor = cpuHandle;
 		info.LegacySingleSrvGpuDescriptor = gpuHandle;
-		info.NumFramesInFlight = Graphics::NumBackBuffers;
+		info.NumFramesInFlight = Graphics::MaxFramesInFlight;
 		info.RTVFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
 		info.SrvDescriptorHeap = Graphics::CBVSRVDescriptorHeap.Get();
 
@@ -63,6 +64,9 @@ void Game::Initialize()
 	GenerateLights();
 
 	CreateRootSigAndPipelineState();
+
+	// All meshes share one big vertex & index buffer
+	GeometryPool::Initialize();
 	CreateGeometry();
 
 	// Create the camera
@@ -75,6 +79,12 @@ void Game::Initialize()
 		0.01f,					// Near clip
 		100.0f,					// Far clip
 		CameraProjectionType::Perspective);
+
+	// Frames are drawn from packets, ideally on their own thread
+	framePipeline.SetRenderFunction([this](unsigned int slot) { RenderFramePacket(slot); });
+	Graphics::SetFramePipeline(&framePipeline);
+	if (useRenderThread)
+		framePipeline.Start();
 }
 
 
@@ -86,8 +96,16 @@ void Game::Initialize()
 // --------------------------------------------------------
 Game::~Game()
 {
-	// Wait for the GPU before we shut down
+	// Let the render thread finish any queued frames,
+	// then wait for the GPU before we shut down
+	framePipeline.Stop();
+	Graphics::SetFramePipeline(0);
 	Graphics::WaitForGPU();
+	GeometryPool::ShutDown();
+
+	// Packets may still hold copies of ImGui's draw lists
+	for (auto& p : framePackets)
+		p.Reset();
 
 	// ImGui clean up
 	ImGui_ImplDX12_Shutdown();
@@ -462,6 +480,11 @@ void Game::GenerateLights()
 // --------------------------------------------------------
 void Game::OnResize()
 {
+	// The render thread can't be using the swap chain (or the
+	// viewport) while they change, so let it finish first
+	framePipeline.WaitForIdle();
+	Graphics::ResizeBuffers(Window::Width(), Window::Height());
+
 	// Resize the viewport and scissor rectangle
 	{
 		// Set up the viewport so we render into the correct
@@ -499,9 +522,16 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	// Handle anything last frame's UI asked for that can't
+	// happen while the render thread is busy
+	ApplyPendingChanges();
+
 	// Set up the new frame for ImGui, then build this frame's UI
-	UINewFrame(deltaTime);
-	BuildUI();
+	{
+		std::lock_guard<std::mutex> lock(uiMutex);
+		UINewFrame(deltaTime);
+		BuildUI();
+	}
 
 	// Example input checking: Quit if the escape key is pressed
 	if (Input::KeyDown(VK_ESCAPE))
@@ -514,14 +544,134 @@ void Game::Update(float deltaTime, float totalTime)
 
 	for (auto& e : emitters)
 		e->Update(deltaTime, totalTime);
+
+	// Snapshot everything needed to draw this frame
+	BuildFramePacket();
+}
+
+
+// --------------------------------------------------------
+// Applies changes requested by the UI that touch the GPU (or
+// the render thread itself) directly, which is only safe once
+// the render thread has drawn everything it was given
+// --------------------------------------------------------
+void Game::ApplyPendingChanges()
+{
+	bool toggleRenderThread = useRenderThread != framePipeline.IsRunning();
+	if (!compactGeometryRequested && requestedFramesInFlight == 0 && !toggleRenderThread)
+		return;
+
+	framePipeline.WaitForIdle();
+
+	if (compactGeometryRequested)
+	{
+		GeometryPool::Compact();
+		compactGeometryRequested = false;
+	}
+
+	if (requestedFramesInFlight > 0)
+	{
+		Graphics::SetFramesInFlight(requestedFramesInFlight);
+		requestedFramesInFlight = 0;
+	}
+
+	if (toggleRenderThread)
+	{
+		if (useRenderThread)
+			framePipeline.Start();
+		else
+			framePipeline.Stop();
+	}
+}
+
+
+// --------------------------------------------------------
+// Copies this frame's camera, lights, entities, emitters and
+// UI into the next free frame packet.  After this, the render
+// thread doesn't need any of the game's own (mutable) state,
+// so the next Update() can run while this frame is drawn.
+// --------------------------------------------------------
+void Game::BuildFramePacket()
+{
+	// Grab the next packet - this waits if the render thread
+	// is still drawing the last frame that used it, which
+	// keeps us at most one frame ahead
+	currentPacketSlot = framePipeline.AcquireSlot();
+	FramePacket& packet = framePackets[currentPacketSlot];
+
+	// Finish the UI first, since ImGui needs the lock
+	{
+		std::lock_guard<std::mutex> lock(uiMutex);
+		packet.Reset();
+		ImGui::Render();
+		packet.CopyUIDrawData(ImGui::GetDrawData());
+	}
+
+	// Camera
+	packet.View = camera->GetView();
+	packet.Projection = camera->GetProjection();
+	packet.CameraPosition = camera->GetTransform()->GetPosition();
+
+	// Lights
+	packet.LightCount = lightCount;
+	packet.Lights = packet.Arena.AllocateArray<Light>(lightCount);
+	memcpy(packet.Lights, &lights[0], sizeof(Light) * lightCount);
+
+	// Entities
+	packet.EntityCount = (unsigned int)entities.size();
+	packet.Entities = packet.Arena.AllocateArray<EntityDrawItem>(packet.EntityCount);
+	for (unsigned int i = 0; i < packet.EntityCount; i++)
+	{
+		std::shared_ptr<GameEntity> e = entities[i];
+		std::shared_ptr<Material> mat = e->GetMaterial();
+		std::shared_ptr<Mesh> mesh = e->GetMesh();
+
+		EntityDrawItem& item = packet.Entities[i];
+		item.VSData.world = e->GetTransform()->GetWorldMatrix();
+		item.VSData.worldInverseTranspose = e->GetTransform()->GetWorldInverseTransposeMatrix();
+		item.PSData.uvScale = mat->GetUVScale();
+		item.PSData.uvOffset = mat->GetUVOffset();
+		item.PSData.albedoIndex = mat->GetAlbedoIndex();
+		item.PSData.normalMapIndex = mat->GetNormalMapIndex();
+		item.PSData.roughnessIndex = mat->GetRoughnessIndex();
+		item.PSData.metalnessIndex = mat->GetMetalnessIndex();
+		item.PipelineState = mat->GetPipelineState().Get();
+		item.IndexCount = (unsigned int)mesh->GetIndexCount();
+		item.FirstIndex = mesh->GetFirstIndex();
+		item.BaseVertex = mesh->GetBaseVertex();
+	}
+
+	// Emitters
+	packet.EmitterCount = (unsigned int)emitters.size();
+	packet.Emitters = packet.Arena.AllocateArray<EmitterDrawItem>(packet.EmitterCount);
+	for (unsigned int i = 0; i < packet.EmitterCount; i++)
+		emitters[i]->Snapshot(packet.Arena, packet.Emitters[i]);
+
+	// Debug wireframe
+	packet.DrawEmitterWireframe = Input::KeyDown('V');
 }
 
 
 // --------------------------------------------------------
-// Clear the screen, redraw everything, present to the user
+// Hands the packet built at the end of Update() off to the
+// render thread, which draws it while the next Update() runs.
+// Without the render thread, it's simply drawn right here.
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
+	framePipeline.Submit(currentPacketSlot);
+}
+
+
+// --------------------------------------------------------
+// Clear the screen, redraw everything, present to the user.
+// This runs on the render thread, so everything it needs
+// comes from the frame packet rather than the game itself.
+// --------------------------------------------------------
+void Game::RenderFramePacket(unsigned int slot)
+{
+	FramePacket& packet = framePackets[slot];
+
 	// Grab the current back buffer for this frame
 	Microsoft::WRL::ComPtr<ID3D12Resource> currentBackBuffer = Graphics::BackBuffers[Graphics::SwapChainIndex()];
 
@@ -580,8 +730,8 @@ void Game::Draw(float deltaTime, float totalTime)
 		// Per-frame vertex data
 		{
 			VertexShaderPerFrameData vsFrame{};
-			vsFrame.view = camera->GetView();
-			vsFrame.projection = camera->GetProjection();
+			vsFrame.view = packet.View;
+			vsFrame.projection = packet.Projection;
 
 			D3D12_GPU_DESCRIPTOR_HANDLE cbHandleVS = Graphics::FillNextConstantBufferAndGetGPUDescriptorHandle(
 				(void*)(&vsFrame), sizeof(VertexShaderPerFrameData));
@@ -592,9 +742,9 @@ void Game::Draw(float deltaTime, float totalTime)
 		// Per-frame pixel data
 		{
 			PixelShaderPerFrameData psFrame{};
-			psFrame.cameraPosition = camera->GetTransform()->GetPosition();
-			psFrame.lightCount = lightCount;
-			memcpy(psFrame.lights, &lights[0], sizeof(Light) * lightCount);
+			psFrame.cameraPosition = packet.CameraPosition;
+			psFrame.lightCount = packet.LightCount;
+			memcpy(psFrame.lights, packet.Lights, sizeof(Light) * packet.LightCount);
 
 			D3D12_GPU_DESCRIPTOR_HANDLE cbHandlePS = Graphics::FillNextConstantBufferAndGetGPUDescriptorHandle(
 				(void*)(&psFrame), sizeof(PixelShaderPerFrameData));
@@ -602,47 +752,38 @@ void Game::Draw(float deltaTime, float totalTime)
 			drawData.psPerFrameCBIndex = Graphics::GetDescriptorIndex(cbHandlePS);
 		}
 
+		// Every mesh lives in the shared geometry pool, so the
+		// index buffer and vertex buffer SRV only need to be set once
+		D3D12_INDEX_BUFFER_VIEW ibv = GeometryPool::GetIndexBufferView();
+		Graphics::CommandList->IASetIndexBuffer(&ibv);
+		drawData.vsVertexBufferIndex = Graphics::GetDescriptorIndex(GeometryPool::GetVertexBufferDescriptorHandle());
+
 		// Loop through the entities
-		for (auto& e : entities)
+		for (unsigned int i = 0; i < packet.EntityCount; i++)
 		{
-			// Grab the material for this entity
-			std::shared_ptr<Material> mat = e->GetMaterial();
+			const EntityDrawItem& item = packet.Entities[i];
 
 			// Set the pipeline state for this material
 			{
-				Graphics::CommandList->SetPipelineState(mat->GetPipelineState().Get());
+				Graphics::CommandList->SetPipelineState(item.PipelineState);
 			}
 
-			drawData.vsVertexBufferIndex = Graphics::GetDescriptorIndex(e->GetMesh()->GetVertexBufferDescriptorHandle());
-
 			// Set up the data we intend to use for drawing this entity
 			{
-				VertexShaderPerObjectData vsData = {};
-				vsData.world = e->GetTransform()->GetWorldMatrix();
-				vsData.worldInverseTranspose = e->GetTransform()->GetWorldInverseTransposeMatrix();
-
 				// Send this to a chunk of the constant buffer heap
 				// and grab the GPU handle for it so we can set it for this draw
 				D3D12_GPU_DESCRIPTOR_HANDLE cbHandleVS = Graphics::FillNextConstantBufferAndGetGPUDescriptorHandle(
-					(void*)(&vsData), sizeof(VertexShaderPerObjectData));
+					(void*)(&item.VSData), sizeof(VertexShaderPerObjectData));
 
 				drawData.vsPerObjectCBIndex = Graphics::GetDescriptorIndex(cbHandleVS);
 			}
 
 			// Pixel shader data and cbuffer setup
 			{
-				PixelShaderPerObjectData psData = {};
-				psData.uvScale = mat->GetUVScale();
-				psData.uvOffset = mat->GetUVOffset();
-				psData.albedoIndex = mat->GetAlbedoIndex();
-				psData.normalMapIndex = mat->GetNormalMapIndex();
-				psData.roughnessIndex = mat->GetRoughnessIndex();
-				psData.metalnessIndex = mat->GetMetalnessIndex();
-
 				// Send this to a chunk of the constant buffer heap
 				// and grab the GPU handle for it so we can set it for this draw
 				D3D12_GPU_DESCRIPTOR_HANDLE cbHandlePS = Graphics::FillNextConstantBufferAndGetGPUDescriptorHandle(
-					(void*)(&psData), sizeof(PixelShaderPerObjectData));
+					(void*)(&item.PSData), sizeof(PixelShaderPerObjectData));
 
 				drawData.psPerObjectCBIndex = Graphics::GetDescriptorIndex(cbHandlePS);
 			}
@@ -653,34 +794,43 @@ void Game::Draw(float deltaTime, float totalTime)
 				&drawData,
 				0);
 
-			// Grab the mesh and its buffer views
-			std::shared_ptr<Mesh> mesh = e->GetMesh();
-			D3D12_INDEX_BUFFER_VIEW  ibv = mesh->GetIndexBufferView();
-
-			// Set the geometry
-			Graphics::CommandList->IASetIndexBuffer(&ibv);
-
-			// Draw
-			Graphics::CommandList->DrawIndexedInstanced((UINT)mesh->GetIndexCount(), 1, 0, 0, 0);
+			// Draw this mesh's range of the pool
+			Graphics::CommandList->DrawIndexedInstanced(
+				item.IndexCount,
+				1,
+				item.FirstIndex,
+				item.BaseVertex,
+				0);
 		}
 	}
 
 	// Skybox after opaque objects
-	sky->Draw(camera);
+	sky->Draw(packet.View, packet.Projection);
 
 	// Draw all emitters after the sky
-	for (auto& e : emitters)
-		e->Draw(camera, totalTime, false);
+	for (unsigned int i = 0; i < packet.EmitterCount; i++)
+	{
+		const EmitterDrawItem& item = packet.Emitters[i];
+		item.Source->Draw(item, packet.View, packet.Projection, false);
+	}
 
 	// Debug wireframe
-	if (Input::KeyDown('V'))
-		for (auto& e : emitters)
-			e->Draw(camera, totalTime, true);
+	if (packet.DrawEmitterWireframe)
+	{
+		for (unsigned int i = 0; i < packet.EmitterCount; i++)
+		{
+			const EmitterDrawItem& item = packet.Emitters[i];
+			item.Source->Draw(item, packet.View, packet.Projection, true);
+		}
+	}
 
 	// ImGui Render after all other scene objects
+	// - The backend may update ImGui's textures here, so this
+	//   can't overlap with the game thread's use of ImGui
+	if (packet.HasUI)
 	{
-		ImGui::Render();
-		ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), Graphics::CommandList.Get());
+		std::lock_guard<std::mutex> lock(uiMutex);
+		ImGui_ImplDX12_RenderDrawData(&packet.UIDrawData, Graphics::CommandList.Get());
 	}
 
 	// Present
@@ -706,7 +856,7 @@ void Game::Draw(float deltaTime, float totalTime)
 
 		// Reset the command list & allocator for the upcoming frame
 		Graphics::AdvanceSwapChainIndex();
-		Graphics::ResetAllocatorAndCommandList(Graphics::SwapChainIndex());
+		Graphics::ResetAllocatorAndCommandList(Graphics::FrameIndex());
 	}
 }
 
@@ -758,6 +908,15 @@ void Game::BuildUI()
 			ImGui::Text("Frame rate: %f fps", ImGui::GetIO().Framerate);
 			ImGui::Text("Window Client Size: %dx%d", Window::Width(), Window::Height());
 
+			// More frames in flight = more CPU/GPU overlap, but more latency
+			int framesInFlight = (int)Graphics::FramesInFlight();
+			if (ImGui::SliderInt("Frames In Flight", &framesInFlight, 1, Graphics::MaxFramesInFlight))
+				requestedFramesInFlight = (unsigned int)framesInFlight;
+
+			// Draw on a separate thread, overlapping with the next Update()?
+			ImGui::Checkbox("Render Thread", &useRenderThread);
+			ImGui::Text("Frame Packet: %.2f KB", framePackets[currentPacketSlot].Arena.GetUsedSize() / 1024.0f);
+
 			// Should we show the demo window?
 			if (ImGui::Button(showUIDemoWindow ? "Hide ImGui Demo Window" : "Show ImGui Demo Window"))
 				showUIDemoWindow = !showUIDemoWindow;
@@ -767,6 +926,52 @@ void Game::BuildUI()
 			// Finalize the tree node
 			ImGui::TreePop();
 		}
+
+		// === GPU memory ===
+		if (ImGui::TreeNode("GPU Memory (Placed Resources)"))
+		{
+			ImGui::Spacing();
+
+			// One entry per heap pool, with usage & fragmentation details
+			std::vector<HeapPoolReport> reports = Graphics::GetHeapPoolReports();
+			for (auto& r : reports)
+			{
+				if (r.HeapCount == 0)
+					continue;
+
+				if (ImGui::TreeNode(r.Name))
+				{
+					ImGui::Text("Heaps: %u", r.HeapCount);
+					ImGui::Text("Resources: %u", r.AllocationCount);
+					ImGui::Text("Used: %.2f / %.2f MB",
+						r.UsedSizeInBytes / (1024.0f * 1024.0f),
+						r.TotalSizeInBytes / (1024.0f * 1024.0f));
+					ImGui::Text("Free blocks: %u (largest %.2f MB)",
+						r.FreeBlockCount,
+						r.LargestFreeBlockInBytes / (1024.0f * 1024.0f));
+					ImGui::Text("Fragmentation: %.1f%%", r.Fragmentation * 100.0f);
+					ImGui::Text("Defrag: %u moves, %.2f MB to copy",
+						r.DefragMoveCount,
+						r.DefragBytesToMove / (1024.0f * 1024.0f));
+					ImGui::TreePop();
+				}
+			}
+
+			// Shared geometry pool usage
+			ImGui::Spacing();
+			ImGui::Text("Geometry Pool Vertices: %u / %u",
+				GeometryPool::GetUsedVertexCount(),
+				GeometryPool::GetVertexCapacity());
+			ImGui::Text("Geometry Pool Indices: %u / %u",
+				GeometryPool::GetUsedIndexCount(),
+				GeometryPool::GetIndexCapacity());
+			ImGui::Text("Geometry Pool Fragmentation: %.1f%%", GeometryPool::GetFragmentation() * 100.0f);
+			if (ImGui::Button("Compact Geometry Pool"))
+				compactGeometryRequested = true;
+
+			ImGui::Spacing();
+			ImGui::TreePop();
+		}
 	}
 	ImGui::End();
 }
@@ -7,11 +7,14 @@
 #include "Lights.h"
 #include "Sky.h"
 #include "Emitter.h"
+#include "FramePacket.h"
+#include "FramePipeline.h"
 
 #include <d3d12.h>
 #include <wrl/client.h>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 class Game
 {
@@ -35,6 +38,11 @@ private:
 	void CreateGeometry();
 	void GenerateLights();
 
+	// Frame packet helpers
+	void BuildFramePacket();
+	void RenderFramePacket(unsigned int slot);
+	void ApplyPendingChanges();
+
 	// UI functions and variables
 	void UINewFrame(float deltaTime);
 	void BuildUI();
@@ -55,5 +63,20 @@ private:
 	// Other graphics data
 	D3D12_VIEWPORT viewport{};
 	D3D12_RECT scissorRect{};
+
+	// Frame packets, built by Update() and drawn by the render thread
+	static const unsigned int FramePacketCount = 2;
+	FramePacket framePackets[FramePacketCount];
+	FramePipeline framePipeline{ FramePacketCount };
+	unsigned int currentPacketSlot = 0;
+	bool useRenderThread = true;
+
+	// ImGui isn't thread safe, and the UI being drawn on the render
+	// thread shares textures with the UI being built for the next frame
+	std::mutex uiMutex;
+
+	// Changes requested by the UI that need the render thread to be idle
+	bool compactGeometryRequested = false;
+	unsigned int requestedFramesInFlight = 0;
 };
 
@@ -0,0 +1,226 @@
+#include "GeometryAllocator.h"
+
+#include <algorithm>
+
+// --------------------------------------------------------
+// Sets up empty ranges of the given capacities (in vertices
+// and indices, not bytes).  The uploader's buffers must
+// already be at least that big.
+// --------------------------------------------------------
+GeometryAllocator::GeometryAllocator(GeometryUploader& uploader, unsigned int vertexCapacity, unsigned int indexCapacity) :
+	uploader(uploader),
+	vertexAllocator(std::make_unique<TLSFAllocator>(vertexCapacity)),
+	indexAllocator(std::make_unique<TLSFAllocator>(indexCapacity))
+{
+}
+
+
+// --------------------------------------------------------
+// Finds room for a piece of geometry and uploads it,
+// compacting and then growing the pool if there's no room
+//
+// vertices    - The vertex data (its layout is up to the uploader)
+// vertexCount - Number of vertices
+// indices     - Indices relative to the geometry, NOT the pool
+// indexCount  - Number of indices
+// --------------------------------------------------------
+GeometryHandle GeometryAllocator::Add(const void* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount)
+{
+	ProcessPendingRemovals(uploader.GetCompletedFenceValue());
+
+	Entry e{};
+	e.Active = true;
+	e.VertexCount = vertexCount;
+	e.IndexCount = indexCount;
+
+	// Find space, first by compacting and then by growing
+	if (!TryAllocate(e))
+	{
+		Compact();
+		while (!TryAllocate(e))
+		{
+			Rebuild(
+				std::max(GetVertexCapacity() * 2, GetUsedVertexCount() + vertexCount),
+				std::max(GetIndexCapacity() * 2, GetUsedIndexCount() + indexCount));
+		}
+	}
+
+	// Grab a handle for this entry
+	GeometryHandle handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+		entries[handle] = e;
+	}
+	else
+	{
+		handle = (GeometryHandle)entries.size();
+		entries.push_back(e);
+	}
+
+	uploader.Upload(GetRange(handle), vertices, indices);
+	return handle;
+}
+
+
+// --------------------------------------------------------
+// Removes geometry.  Its ranges are actually freed once
+// the GPU passes the given fence value, since frames that
+// are still in flight may draw it.
+// --------------------------------------------------------
+void GeometryAllocator::Remove(GeometryHandle handle, uint64_t fenceValue)
+{
+	if (handle >= entries.size() || !entries[handle].Active)
+		return;
+
+	// Already on its way out?
+	for (const PendingRemoval& p : pendingRemovals)
+		if (p.Geometry == handle)
+			return;
+
+	pendingRemovals.push_back({ fenceValue, handle });
+}
+
+
+// --------------------------------------------------------
+// Frees the ranges of removed geometry the GPU is done with
+// --------------------------------------------------------
+void GeometryAllocator::ProcessPendingRemovals(uint64_t completedFenceValue)
+{
+	for (size_t i = 0; i < pendingRemovals.size();)
+	{
+		if (pendingRemovals[i].FenceValue > completedFenceValue)
+		{
+			i++;
+			continue;
+		}
+
+		Entry& e = entries[pendingRemovals[i].Geometry];
+		vertexAllocator->Free(e.Vertices);
+		indexAllocator->Free(e.Indices);
+		e = {};
+		freeHandles.push_back(pendingRemovals[i].Geometry);
+
+		pendingRemovals[i] = pendingRemovals.back();
+		pendingRemovals.pop_back();
+	}
+}
+
+
+// --------------------------------------------------------
+// Packs all geometry toward the front of the buffers,
+// if there are any gaps to close
+// --------------------------------------------------------
+void GeometryAllocator::Compact()
+{
+	// Any work to do?
+	std::vector<TLSFMove> vertexMoves;
+	std::vector<TLSFMove> indexMoves;
+	vertexAllocator->BuildDefragmentationPlan(vertexMoves);
+	indexAllocator->BuildDefragmentationPlan(indexMoves);
+	if (vertexMoves.empty() && indexMoves.empty() && pendingRemovals.empty())
+		return;
+
+	// Same capacity, just tightly packed
+	Rebuild(GetVertexCapacity(), GetIndexCapacity());
+}
+
+
+// --------------------------------------------------------
+// Attempts to allocate both ranges for an entry, leaving
+// nothing allocated if either one fails
+// --------------------------------------------------------
+bool GeometryAllocator::TryAllocate(Entry& e)
+{
+	e.Vertices = vertexAllocator->Allocate(e.VertexCount);
+	e.Indices = indexAllocator->Allocate(e.IndexCount);
+	if (e.Vertices.IsValid() && e.Indices.IsValid())
+		return true;
+
+	if (e.Vertices.IsValid()) vertexAllocator->Free(e.Vertices);
+	if (e.Indices.IsValid()) indexAllocator->Free(e.Indices);
+	e.Vertices = {};
+	e.Indices = {};
+	return false;
+}
+
+
+// --------------------------------------------------------
+// Moves all active geometry, in its current order, to the front
+// of a brand new pair of buffers of the given capacities.  This
+// handles both compaction and growth.
+// --------------------------------------------------------
+void GeometryAllocator::Rebuild(unsigned int newVertexCapacity, unsigned int newIndexCapacity)
+{
+	// Everything must be finished with the old buffers first,
+	// which also lets every pending removal go
+	uploader.WaitForIdle();
+	ProcessPendingRemovals(uploader.GetCompletedFenceValue());
+
+	std::unique_ptr<TLSFAllocator> newVertexAllocator = std::make_unique<TLSFAllocator>(newVertexCapacity);
+	std::unique_ptr<TLSFAllocator> newIndexAllocator = std::make_unique<TLSFAllocator>(newIndexCapacity);
+
+	// Gather active entries
+	std::vector<GeometryHandle> active;
+	for (GeometryHandle h = 0; h < entries.size(); h++)
+		if (entries[h].Active)
+			active.push_back(h);
+
+	// Vertices: allocating in old-offset order from an empty
+	// allocator packs every range tightly toward the front
+	std::vector<GeometryCopy> vertexCopies;
+	std::sort(active.begin(), active.end(), [this](GeometryHandle a, GeometryHandle b) {
+		return entries[a].Vertices.Offset < entries[b].Vertices.Offset; });
+	for (GeometryHandle h : active)
+	{
+		TLSFAllocation newRange = newVertexAllocator->Allocate(entries[h].VertexCount);
+		vertexCopies.push_back({ (unsigned int)entries[h].Vertices.Offset, (unsigned int)newRange.Offset, entries[h].VertexCount });
+		entries[h].Vertices = newRange;
+	}
+
+	// Same for indices (which may be in a different order)
+	std::vector<GeometryCopy> indexCopies;
+	std::sort(active.begin(), active.end(), [this](GeometryHandle a, GeometryHandle b) {
+		return entries[a].Indices.Offset < entries[b].Indices.Offset; });
+	for (GeometryHandle h : active)
+	{
+		TLSFAllocation newRange = newIndexAllocator->Allocate(entries[h].IndexCount);
+		indexCopies.push_back({ (unsigned int)entries[h].Indices.Offset, (unsigned int)newRange.Offset, entries[h].IndexCount });
+		entries[h].Indices = newRange;
+	}
+
+	uploader.Rebuild(newVertexCapacity, newIndexCapacity, vertexCopies, indexCopies);
+	vertexAllocator = std::move(newVertexAllocator);
+	indexAllocator = std::move(newIndexAllocator);
+}
+
+
+// --------------------------------------------------------
+// Getters
+// --------------------------------------------------------
+GeometryRange GeometryAllocator::GetRange(GeometryHandle handle) const
+{
+	GeometryRange r{};
+	if (handle >= entries.size())
+		return r;
+
+	r.BaseVertex = (unsigned int)entries[handle].Vertices.Offset;
+	r.VertexCount = entries[handle].VertexCount;
+	r.FirstIndex = (unsigned int)entries[handle].Indices.Offset;
+	r.IndexCount = entries[handle].IndexCount;
+	return r;
+}
+
+unsigned int GeometryAllocator::GetVertexCapacity() const { return (unsigned int)vertexAllocator->GetSize(); }
+unsigned int GeometryAllocator::GetIndexCapacity() const { return (unsigned int)indexAllocator->GetSize(); }
+unsigned int GeometryAllocator::GetUsedVertexCount() const { return (unsigned int)vertexAllocator->GetStats().UsedSize; }
+unsigned int GeometryAllocator::GetUsedIndexCount() const { return (unsigned int)indexAllocator->GetStats().UsedSize; }
+unsigned int GeometryAllocator::GetPendingRemovalCount() const { return (unsigned int)pendingRemovals.size(); }
+
+float GeometryAllocator::GetFragmentation() const
+{
+	return std::max(
+		vertexAllocator->GetStats().Fragmentation(),
+		indexAllocator->GetStats().Fragmentation());
+}
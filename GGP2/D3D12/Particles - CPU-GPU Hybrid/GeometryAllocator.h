@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "TLSFAllocator.h"
+
+// Handle to a piece of geometry's ranges within the pool
+typedef unsigned int GeometryHandle;
+const GeometryHandle GeometryInvalidHandle = 0xFFFFFFFF;
+
+// Where a piece of geometry's data lives within the pool
+struct GeometryRange
+{
+	unsigned int BaseVertex;
+	unsigned int VertexCount;
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+};
+
+// One range to copy from the old buffers to the new ones
+// when the pool is rebuilt (measured in elements, not bytes)
+struct GeometryCopy
+{
+	unsigned int SourceOffset;
+	unsigned int DestOffset;
+	unsigned int Count;
+};
+
+// --------------------------------------------------------
+// Everything the allocator needs done to the actual buffers.
+// GeometryPool implements this with D3D12 copies, and the
+// tests implement it with plain arrays.
+// --------------------------------------------------------
+class GeometryUploader
+{
+public:
+	virtual ~GeometryUploader() = default;
+
+	// Latest fence value the GPU has passed
+	virtual uint64_t GetCompletedFenceValue() = 0;
+
+	// Blocks until the GPU is done with the current buffers
+	virtual void WaitForIdle() = 0;
+
+	// Copies one piece of geometry's data into its ranges
+	virtual void Upload(
+		const GeometryRange& range,
+		const void* vertices,
+		const unsigned int* indices) = 0;
+
+	// Creates a new pair of buffers with the given capacities,
+	// copies the listed ranges from the current pair into it,
+	// and then uses the new pair from then on
+	virtual void Rebuild(
+		unsigned int vertexCapacity,
+		unsigned int indexCapacity,
+		const std::vector<GeometryCopy>& vertexCopies,
+		const std::vector<GeometryCopy>& indexCopies) = 0;
+};
+
+// --------------------------------------------------------
+// The bookkeeping half of the geometry pool: TLSF ranges
+// for vertices and indices, the handle to range table,
+// fence-deferred removal, and the list of copies that
+// compaction and growth need.  The buffers themselves
+// are behind a GeometryUploader, so none of this touches
+// the graphics API.
+//
+// Removed geometry keeps its ranges until the GPU passes
+// the fence value given with the removal.  When a new
+// piece doesn't fit, the pool is compacted and then, if
+// that's not enough, grown (at least doubled).
+// --------------------------------------------------------
+class GeometryAllocator
+{
+public:
+	GeometryAllocator(GeometryUploader& uploader, unsigned int vertexCapacity, unsigned int indexCapacity);
+
+	GeometryHandle Add(const void* vertices, unsigned int vertexCount, const unsigned int* indices, unsigned int indexCount);
+	void Remove(GeometryHandle handle, uint64_t fenceValue);
+	void ProcessPendingRemovals(uint64_t completedFenceValue);
+	void Compact();
+
+	GeometryRange GetRange(GeometryHandle handle) const;
+	unsigned int GetVertexCapacity() const;
+	unsigned int GetIndexCapacity() const;
+	unsigned int GetUsedVertexCount() const;
+	unsigned int GetUsedIndexCount() const;
+	unsigned int GetPendingRemovalCount() const;
+	float GetFragmentation() const;
+
+private:
+	// One entry per handle
+	struct Entry
+	{
+		bool Active;
+		unsigned int VertexCount;
+		unsigned int IndexCount;
+		TLSFAllocation Vertices;
+		TLSFAllocation Indices;
+	};
+
+	// Geometry that was removed but might still be drawn
+	// by a frame the GPU hasn't finished yet
+	struct PendingRemoval
+	{
+		uint64_t FenceValue;
+		GeometryHandle Geometry;
+	};
+
+	GeometryUploader& uploader;
+
+	// Range allocators, measured in vertices and indices
+	std::unique_ptr<TLSFAllocator> vertexAllocator;
+	std::unique_ptr<TLSFAllocator> indexAllocator;
+
+	std::vector<Entry> entries;
+	std::vector<GeometryHandle> freeHandles;
+	std::vector<PendingRemoval> pendingRemovals;
+
+	bool TryAllocate(Entry& e);
+	void Rebuild(unsigned int newVertexCapacity, unsigned int newIndexCapacity);
+};
@@ -0,0 +1,317 @@
+#include "GeometryPool.h"
+#include "Graphics.h"
+
+#include <cassert>
+#include <vector>
+#include <memory>
+
+namespace GeometryPool
+{
+	// Annonymous namespace to hold variables
+	// only accessible in this file
+	namespace
+	{
+		bool poolInitialized = false;
+
+		// The shared buffers and their views
+		Microsoft::WRL::ComPtr<ID3D12Resource> vertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D12Resource> indexBuffer;
+		D3D12_CPU_DESCRIPTOR_HANDLE vbCPUDescriptorHandle{};
+		D3D12_GPU_DESCRIPTOR_HANDLE vbGPUDescriptorHandle{};
+		D3D12_INDEX_BUFFER_VIEW ibView{};
+
+		// Creates one of the two big buffers
+		Microsoft::WRL::ComPtr<ID3D12Resource> CreatePoolBuffer(UINT64 sizeInBytes)
+		{
+			D3D12_RESOURCE_DESC desc = {};
+			desc.Alignment = 0;
+			desc.DepthOrArraySize = 1;
+			desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+			desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+			desc.Format = DXGI_FORMAT_UNKNOWN;
+			desc.Height = 1;
+			desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+			desc.MipLevels = 1;
+			desc.SampleDesc.Count = 1;
+			desc.SampleDesc.Quality = 0;
+			desc.Width = sizeInBytes;
+
+			// Buffers are implicitly promoted from the common state
+			// to whatever we need (copy dest, index buffer, etc.)
+			return Graphics::CreatePlacedResource(
+				D3D12_HEAP_TYPE_DEFAULT,
+				desc,
+				D3D12_RESOURCE_STATE_COMMON);
+		}
+
+		// (Re)creates the views of the current buffers, reusing the
+		// same descriptor slot so existing descriptor indices stay valid
+		void CreateViews(unsigned int vertexCapacity, unsigned int indexCapacity)
+		{
+			if (vbCPUDescriptorHandle.ptr == 0)
+				Graphics::ReserveDescriptorHeapSlot(&vbCPUDescriptorHandle, &vbGPUDescriptorHandle);
+
+			D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+			srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+			srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+			srvDesc.Buffer.FirstElement = 0;
+			srvDesc.Buffer.NumElements = vertexCapacity;
+			srvDesc.Buffer.StructureByteStride = sizeof(Vertex);
+			srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+			Graphics::Device->CreateShaderResourceView(vertexBuffer.Get(), &srvDesc, vbCPUDescriptorHandle);
+
+			ibView.Format = DXGI_FORMAT_R32_UINT;
+			ibView.SizeInBytes = (UINT)(sizeof(unsigned int) * indexCapacity);
+			ibView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
+		}
+
+		// Temporary command allocator & list for copies, so we don't
+		// interfere with the frame's list (similar to CreateStaticBuffer())
+		void CreateLocalCommandList(
+			Microsoft::WRL::ComPtr<ID3D12CommandAllocator>& localAllocator,
+			Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>& localList)
+		{
+			Graphics::Device->CreateCommandAllocator(
+				D3D12_COMMAND_LIST_TYPE_DIRECT,
+				IID_PPV_ARGS(localAllocator.GetAddressOf()));
+
+			Graphics::Device->CreateCommandList(
+				0,
+				D3D12_COMMAND_LIST_TYPE_DIRECT,
+				localAllocator.Get(),
+				0,
+				IID_PPV_ARGS(localList.GetAddressOf()));
+		}
+
+		// Transitions a freshly-copied buffer to generic read
+		void CopyDestToGenericRead(ID3D12GraphicsCommandList* list, ID3D12Resource* buffer)
+		{
+			D3D12_RESOURCE_BARRIER rb = {};
+			rb.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+			rb.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+			rb.Transition.pResource = buffer;
+			rb.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+			rb.Transition.StateAfter = D3D12_RESOURCE_STATE_GENERIC_READ;
+			rb.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+			list->ResourceBarrier(1, &rb);
+		}
+
+		// Does the allocator's copies with D3D12, each one on a
+		// local command list that's waited on before returning
+		class D3D12GeometryUploader : public GeometryUploader
+		{
+		public:
+			uint64_t GetCompletedFenceValue() override
+			{
+				return Graphics::WaitFence->GetCompletedValue();
+			}
+
+			void WaitForIdle() override
+			{
+				Graphics::WaitForGPU();
+			}
+
+			void Upload(const GeometryRange& range, const void* vertices, const unsigned int* indices) override
+			{
+				// Stage both vertices and indices in a single upload buffer
+				UINT64 vertexBytes = (UINT64)sizeof(Vertex) * range.VertexCount;
+				UINT64 indexBytes = (UINT64)sizeof(unsigned int) * range.IndexCount;
+
+				D3D12_RESOURCE_DESC desc = {};
+				desc.Alignment = 0;
+				desc.DepthOrArraySize = 1;
+				desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+				desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+				desc.Format = DXGI_FORMAT_UNKNOWN;
+				desc.Height = 1;
+				desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+				desc.MipLevels = 1;
+				desc.SampleDesc.Count = 1;
+				desc.SampleDesc.Quality = 0;
+				desc.Width = vertexBytes + indexBytes;
+
+				Microsoft::WRL::ComPtr<ID3D12Resource> uploadBuffer = Graphics::CreatePlacedResource(
+					D3D12_HEAP_TYPE_UPLOAD,
+					desc,
+					D3D12_RESOURCE_STATE_GENERIC_READ);
+
+				void* mapped = 0;
+				uploadBuffer->Map(0, 0, &mapped);
+				memcpy(mapped, vertices, vertexBytes);
+				memcpy((char*)mapped + vertexBytes, indices, indexBytes);
+				uploadBuffer->Unmap(0, 0);
+
+				// Copy into each range of the pool
+				Microsoft::WRL::ComPtr<ID3D12CommandAllocator> localAllocator;
+				Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> localList;
+				CreateLocalCommandList(localAllocator, localList);
+
+				localList->CopyBufferRegion(
+					vertexBuffer.Get(), (UINT64)range.BaseVertex * sizeof(Vertex),
+					uploadBuffer.Get(), 0,
+					vertexBytes);
+				localList->CopyBufferRegion(
+					indexBuffer.Get(), (UINT64)range.FirstIndex * sizeof(unsigned int),
+					uploadBuffer.Get(), vertexBytes,
+					indexBytes);
+
+				CopyDestToGenericRead(localList.Get(), vertexBuffer.Get());
+				CopyDestToGenericRead(localList.Get(), indexBuffer.Get());
+
+				localList->Close();
+				ID3D12CommandList* list[] = { localList.Get() };
+				Graphics::CommandQueue->ExecuteCommandLists(1, list);
+
+				// Upload buffer is freed once the copy is done
+				Graphics::ReleasePlacedResource(uploadBuffer);
+				Graphics::WaitForGPU();
+			}
+
+			void Rebuild(
+				unsigned int vertexCapacity,
+				unsigned int indexCapacity,
+				const std::vector<GeometryCopy>& vertexCopies,
+				const std::vector<GeometryCopy>& indexCopies) override
+			{
+				Microsoft::WRL::ComPtr<ID3D12Resource> newVertexBuffer = CreatePoolBuffer((UINT64)sizeof(Vertex) * vertexCapacity);
+				Microsoft::WRL::ComPtr<ID3D12Resource> newIndexBuffer = CreatePoolBuffer((UINT64)sizeof(unsigned int) * indexCapacity);
+
+				Microsoft::WRL::ComPtr<ID3D12CommandAllocator> localAllocator;
+				Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> localList;
+				CreateLocalCommandList(localAllocator, localList);
+
+				for (const GeometryCopy& c : vertexCopies)
+				{
+					localList->CopyBufferRegion(
+						newVertexBuffer.Get(), (UINT64)c.DestOffset * sizeof(Vertex),
+						vertexBuffer.Get(), (UINT64)c.SourceOffset * sizeof(Vertex),
+						(UINT64)c.Count * sizeof(Vertex));
+				}
+				for (const GeometryCopy& c : indexCopies)
+				{
+					localList->CopyBufferRegion(
+						newIndexBuffer.Get(), (UINT64)c.DestOffset * sizeof(unsigned int),
+						indexBuffer.Get(), (UINT64)c.SourceOffset * sizeof(unsigned int),
+						(UINT64)c.Count * sizeof(unsigned int));
+				}
+
+				CopyDestToGenericRead(localList.Get(), newVertexBuffer.Get());
+				CopyDestToGenericRead(localList.Get(), newIndexBuffer.Get());
+
+				localList->Close();
+				ID3D12CommandList* list[] = { localList.Get() };
+				Graphics::CommandQueue->ExecuteCommandLists(1, list);
+
+				// Swap to the new buffers; the old ones are freed after the wait
+				Graphics::ReleasePlacedResource(vertexBuffer);
+				Graphics::ReleasePlacedResource(indexBuffer);
+				Graphics::WaitForGPU();
+
+				vertexBuffer = newVertexBuffer;
+				indexBuffer = newIndexBuffer;
+				CreateViews(vertexCapacity, indexCapacity);
+			}
+		};
+
+		// The ranges within the buffers, and the uploader they use
+		D3D12GeometryUploader uploader;
+		std::unique_ptr<GeometryAllocator> allocator;
+	}
+}
+
+
+// --------------------------------------------------------
+// Creates the shared buffers with the given starting
+// capacities (in vertices and indices, not bytes)
+// --------------------------------------------------------
+void GeometryPool::Initialize(unsigned int vertexCapacity, unsigned int indexCapacity)
+{
+	// Only initialize once
+	if (poolInitialized)
+		return;
+
+	vertexBuffer = CreatePoolBuffer((UINT64)sizeof(Vertex) * vertexCapacity);
+	indexBuffer = CreatePoolBuffer((UINT64)sizeof(unsigned int) * indexCapacity);
+	CreateViews(vertexCapacity, indexCapacity);
+	allocator = std::make_unique<GeometryAllocator>(uploader, vertexCapacity, indexCapacity);
+
+	poolInitialized = true;
+}
+
+
+// --------------------------------------------------------
+// Releases the shared buffers and all bookkeeping
+// --------------------------------------------------------
+void GeometryPool::ShutDown()
+{
+	Graphics::ReleasePlacedResource(vertexBuffer);
+	Graphics::ReleasePlacedResource(indexBuffer);
+	allocator.reset();
+	poolInitialized = false;
+}
+
+
+// --------------------------------------------------------
+// Copies geometry into the pool, returning a handle that
+// can be used to look up its location.  If there's no room,
+// the pool is compacted and, if that's not enough, grown.
+//
+// vertArray  - An array of vertices
+// numVerts   - The number of verts in the array
+// indexArray - An array of indices into the vertex array
+//              (relative to the mesh, NOT the pool)
+// numIndices - The number of indices in the index array
+// --------------------------------------------------------
+GeometryPool::Handle GeometryPool::Add(Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices)
+{
+	// Lazy init in case nobody did it explicitly
+	if (!poolInitialized)
+		Initialize();
+
+	// Uploading (and growing) waits on the GPU from this thread
+	assert(Graphics::RenderThreadIdle());
+	return allocator->Add(vertArray, (unsigned int)numVerts, indexArray, (unsigned int)numIndices);
+}
+
+
+// --------------------------------------------------------
+// Removes geometry from the pool.  Its ranges are actually
+// freed once the GPU is done with any frame that drew it.
+// --------------------------------------------------------
+void GeometryPool::Remove(Handle handle)
+{
+	if (!poolInitialized)
+		return;
+
+	// Frames still queued for the render thread may draw it too
+	allocator->Remove(handle, Graphics::ReleaseFenceValue());
+}
+
+
+// --------------------------------------------------------
+// Packs all geometry toward the front of the buffers,
+// if there are any gaps to close
+// --------------------------------------------------------
+void GeometryPool::Compact()
+{
+	if (!poolInitialized)
+		return;
+
+	// Compaction moves geometry queued frames may still draw
+	assert(Graphics::RenderThreadIdle());
+	allocator->Compact();
+}
+
+
+// --------------------------------------------------------
+// Getters
+// --------------------------------------------------------
+GeometryPool::Range GeometryPool::GetRange(Handle handle) { return allocator ? allocator->GetRange(handle) : Range{}; }
+D3D12_INDEX_BUFFER_VIEW GeometryPool::GetIndexBufferView() { return ibView; }
+D3D12_GPU_DESCRIPTOR_HANDLE GeometryPool::GetVertexBufferDescriptorHandle() { return vbGPUDescriptorHandle; }
+unsigned int GeometryPool::GetVertexCapacity() { return allocator ? allocator->GetVertexCapacity() : 0; }
+unsigned int GeometryPool::GetIndexCapacity() { return allocator ? allocator->GetIndexCapacity() : 0; }
+unsigned int GeometryPool::GetUsedVertexCount() { return allocator ? allocator->GetUsedVertexCount() : 0; }
+unsigned int GeometryPool::GetUsedIndexCount() { return allocator ? allocator->GetUsedIndexCount() : 0; }
+float GeometryPool::GetFragmentation() { return allocator ? allocator->GetFragmentation() : 0.0f; }
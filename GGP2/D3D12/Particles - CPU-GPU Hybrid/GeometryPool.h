@@ -0,0 +1,64 @@
+#pragma once
+
+#include <d3d12.h>
+#include <wrl/client.h>
+
+#include "Vertex.h"
+#include "GeometryAllocator.h"
+
+// --------------------------------------------------------
+// A single, global pair of vertex & index buffers shared
+// by all static meshes.  Each mesh is sub-allocated a range
+// of vertices and a range of indices within these buffers,
+// so drawing only needs the pool bound once per frame and
+// each mesh simply supplies its own offsets.
+//
+// The ranges themselves are tracked by a GeometryAllocator
+// (TLSF ranges measured in elements, not bytes, which can
+// be compacted when they become fragmented); this is the
+// D3D12 side that owns the buffers and does the copies.
+//
+// The pool belongs to the game thread: geometry is only
+// added, removed or compacted there, and the render thread
+// never touches the allocators, so the getters below are
+// safe to call from the game thread's UI.  Adding and
+// compacting wait on the GPU, so they assert the render
+// thread is idle; removal may happen any time, since it
+// waits for every queued frame's fence value.
+// --------------------------------------------------------
+namespace GeometryPool
+{
+	// --- CONSTANTS ---
+
+	// Starting capacity - the pool grows if these are exceeded
+	const unsigned int DefaultVertexCapacity = 256 * 1024;
+	const unsigned int DefaultIndexCapacity = 1024 * 1024;
+
+	// Handle to a mesh's ranges within the pool, and where they are
+	typedef GeometryHandle Handle;
+	typedef GeometryRange Range;
+	const Handle InvalidHandle = GeometryInvalidHandle;
+
+	// --- FUNCTIONS ---
+
+	// General functions
+	void Initialize(
+		unsigned int vertexCapacity = DefaultVertexCapacity,
+		unsigned int indexCapacity = DefaultIndexCapacity);
+	void ShutDown();
+
+	// Adding and removing geometry
+	Handle Add(Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices);
+	void Remove(Handle handle);
+	void Compact();
+
+	// Getters
+	Range GetRange(Handle handle);
+	D3D12_INDEX_BUFFER_VIEW GetIndexBufferView();
+	D3D12_GPU_DESCRIPTOR_HANDLE GetVertexBufferDescriptorHandle();
+	unsigned int GetVertexCapacity();
+	unsigned int GetIndexCapacity();
+	unsigned int GetUsedVertexCount();
+	unsigned int GetUsedIndexCount();
+	float GetFragmentation();
+}
@@ -1,10 +1,16 @@
 #include "Graphics.h"
+#include "PlacedResourceHeaps.h"
+#include "FrameScheduler.h"
+#include "FramePipeline.h"
 
 #include "WICTextureLoader.h"
 #include "DDSTextureLoader.h"
 #include "ResourceUploadBatch.h"
 
+#include <cassert>
 #include <vector>
+#include <memory>
+#include <mutex>
 
 // Tell the drivers to use high-performance GPU in multi-GPU systems (like laptops)
 extern "C"
@@ -28,25 +34,46 @@ namespace Graphics
 
 		unsigned int currentBackBufferIndex = 0;
 
+		// Decides which frame slot we're recording and when we
+		// need to wait for the GPU before reusing a slot
+		FrameScheduler frameScheduler(MaxFramesInFlight, DefaultFramesInFlight);
+
 		// Descriptor heap management
 		SIZE_T cbvSrvDescriptorHeapIncrementSize = 0;
-		unsigned int cbvDescriptorOffset = 0;
-		unsigned int srvDescriptorOffset = MaxConstantBuffers; // Assume first SRV will be after all possible CBVs
+		unsigned int cbvDescriptorOffset = 0; // Relative to the current frame's section
+		unsigned int srvDescriptorOffset = MaxConstantBuffers * MaxFramesInFlight; // Assume first SRV will be after all possible CBVs
 
 		// CB upload heap management
 		UINT64 cbUploadHeapSizeInBytes = 0;
-		UINT64 cbUploadHeapOffsetInBytes = 0;
+		UINT64 cbUploadHeapOffsetInBytes = 0; // Relative to the current frame's section
+		UINT64 cbUploadHeapFrameSizeInBytes = 0;
+		const unsigned int cbvDescriptorsPerFrame = MaxConstantBuffers;
 		void* cbUploadHeapStartAddress = 0;
 
 		// Textures
 		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> textures;
 		std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> cpuSideTextureDescriptorHeaps;
+
+		// Buffers and textures are placed within a few large heaps
+		// rather than each getting a committed heap of its own
+		std::unique_ptr<PlacedResourceHeaps> placedResources;
+
+		// The render thread bumps the fence counter (when advancing
+		// frames) while the game thread may be releasing resources,
+		// which reads it, so every bump and read happens under this lock
+		std::mutex fenceCounterMutex;
+
+		// The game's frame pipeline, if any, whose queued frames
+		// will each signal one more fence value
+		FramePipeline* framePipeline = 0;
 	}
 }
 
 // Getters
 bool Graphics::VsyncState() { return vsyncDesired || !supportsTearing || isFullscreen; }
 unsigned int Graphics::SwapChainIndex() { return currentBackBufferIndex; }
+unsigned int Graphics::FrameIndex() { return frameScheduler.GetFrameIndex(); }
+unsigned int Graphics::FramesInFlight() { return frameScheduler.GetFramesInFlight(); }
 std::wstring Graphics::APIName()
 {
 	switch (featureLevel)
@@ -144,7 +171,7 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 	// which are necessary pieces for issuing standard API calls
 	{
 		// Set up allocators (one per possible frame "in flight")
-		for (unsigned int i = 0; i < NumBackBuffers; i++)
+		for (unsigned int i = 0; i < MaxFramesInFlight; i++)
 		{
 			Device->CreateCommandAllocator(
 				D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -202,6 +229,9 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		GPUCounter = 0;
 	}
 
+	// Set up the (empty) pools of heaps for placed resources
+	placedResources = std::make_unique<PlacedResourceHeaps>(Device);
+
 	// Overall API has been initialized
 	apiInitialized = true;
 
@@ -232,35 +262,29 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		D3D12_DESCRIPTOR_HEAP_DESC dhDesc = {};
 		dhDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE; // Shaders can see these!
 		dhDesc.NodeMask = 0; // Node here means physical GPU - we only have 1 so its index is 0
-		dhDesc.NumDescriptors = MaxConstantBuffers + MaxTextureDescriptors; // How many descriptors will we need?  **Now including texture descriptors (SRVs)!**
+		dhDesc.NumDescriptors = MaxConstantBuffers * MaxFramesInFlight + MaxTextureDescriptors; // How many descriptors will we need?  **Now including texture descriptors (SRVs)!**
 		dhDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV; // This heap can store CBVs, SRVs and UAVs
 
 		Device->CreateDescriptorHeap(&dhDesc, IID_PPV_ARGS(CBVSRVDescriptorHeap.GetAddressOf()));
 
 		// Assume the first CBV will be at the beginning of the heap
-		// This will increase as we use more CBVs and will wrap back to 0
+		// This will increase as we use more CBVs, going back to 0 each frame
 		cbvDescriptorOffset = 0;
 	}
 
 	// Create an upload heap for constant buffer data
 	{
 		// This heap MUST have a size that is a multiple of 256
-		// We'll support up to the max number of CBs if they're
-		// all 256 bytes or less, or fewer overall CBs if they're larger
-		cbUploadHeapSizeInBytes = (UINT64)MaxConstantBuffers * 256;
+		// Each possible frame in flight gets its own section, so we
+		// never overwrite data a previous frame is still using, and
+		// each section holds a full frame's worth of CBs
+		cbUploadHeapFrameSizeInBytes = MaxConstantBufferBytes;
+		cbUploadHeapSizeInBytes = cbUploadHeapFrameSizeInBytes * MaxFramesInFlight;
 
 		// Assume the first CB will start at the beginning of the heap
-		// This offset changes as we use more CBs, and wraps around when full
+		// This offset changes as we use more CBs, going back to 0 each frame
 		cbUploadHeapOffsetInBytes = 0;
 
-		// Create the upload heap for our constant buffer
-		D3D12_HEAP_PROPERTIES heapProps = {};
-		heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		heapProps.CreationNodeMask = 1;
-		heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		heapProps.Type = D3D12_HEAP_TYPE_UPLOAD; // Upload heap since we'll be copying often!
-		heapProps.VisibleNodeMask = 1;
-
 		// Fill out description
 		D3D12_RESOURCE_DESC resDesc = {};
 		resDesc.Alignment = 0;
@@ -275,14 +299,12 @@ HRESULT Graphics::Initialize(unsigned int windowWidth, unsigned int windowHeight
 		resDesc.SampleDesc.Quality = 0;
 		resDesc.Width = cbUploadHeapSizeInBytes; // Must be 256 byte aligned!
 
-		// Create a constant buffer resource heap
-		Device->CreateCommittedResource(
-			&heapProps,
-			D3D12_HEAP_FLAG_NONE,
-			&resDesc,
-			D3D12_RESOURCE_STATE_GENERIC_READ,
-			0,
-			IID_PPV_ARGS(CBUploadHeap.GetAddressOf()));
+		// Create the constant buffer upload heap, placed in one of
+		// our large upload heaps
+		CBUploadHeap = CreatePlacedResource(
+			D3D12_HEAP_TYPE_UPLOAD,
+			resDesc,
+			D3D12_RESOURCE_STATE_GENERIC_READ);
 
 		// Keep mapped!
 		D3D12_RANGE range{ 0, 0 };
@@ -364,7 +386,10 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 
 	// Reset the depth buffer and create it again
 	{
-		DepthBuffer.Reset();
+		// The GPU is idle, so the old buffer's heap space
+		// can be reused right away
+		placedResources->Release(DepthBuffer, CPUCounter);
+		placedResources->ProcessPendingReleases(CPUCounter);
 
 		// Describe the depth stencil buffer resource
 		D3D12_RESOURCE_DESC depthBufferDesc = {};
@@ -387,23 +412,12 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 		clear.DepthStencil.Depth = 1.0f;
 		clear.DepthStencil.Stencil = 0;
 
-		// Describe the memory heap that will house this resource
-		D3D12_HEAP_PROPERTIES props = {};
-		props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		props.CreationNodeMask = 1;
-		props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		props.Type = D3D12_HEAP_TYPE_DEFAULT;
-		props.VisibleNodeMask = 1;
-
-		// Actually create the resource, and the heap in which it
-		// will reside, and map the resource to that heap
-		Device->CreateCommittedResource(
-			&props,
-			D3D12_HEAP_FLAG_NONE,
-			&depthBufferDesc,
+		// Place the resource in one of our render target/depth heaps
+		DepthBuffer = CreatePlacedResource(
+			D3D12_HEAP_TYPE_DEFAULT,
+			depthBufferDesc,
 			D3D12_RESOURCE_STATE_DEPTH_WRITE,
-			&clear,
-			IID_PPV_ARGS(DepthBuffer.GetAddressOf()));
+			&clear);
 
 		// Now recreate the depth stencil view
 		DSVHandle = DSVHeap->GetCPUDescriptorHandleForHeapStart();
@@ -416,15 +430,19 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 	// Are we in a fullscreen state?
 	SwapChain->GetFullscreenState(&isFullscreen, 0);
 
-	// Reset back to the first buffer
+	// Reset back to the first buffer and frame slot (the
+	// GPU is idle, so no slot is still in use)
 	currentBackBufferIndex = 0;
+	frameScheduler.Reset();
+	cbUploadHeapOffsetInBytes = 0;
+	cbvDescriptorOffset = 0;
 
 	// Close the command list (just in case), reset all allocators and 
 	// set the command list back to the first allocator.  This is 
 	// necessary to handle occasional 1-frame allocator errors after
 	// a resize.
 	CommandList->Close();
-	for (unsigned int i = 0; i < NumBackBuffers; i++)
+	for (unsigned int i = 0; i < MaxFramesInFlight; i++)
 		CommandAllocator[i]->Reset();
 	CommandList->Reset(CommandAllocator[0].Get(), 0);
 }
@@ -432,37 +450,60 @@ void Graphics::ResizeBuffers(unsigned int width, unsigned int height)
 
 // --------------------------------------------------------
 // Advances the swap chain back buffer index by 1, wrapping
-// back to zero when necessary.  This should occur after
-// presenting the current frame.
+// back to zero when necessary, and moves to the next frame
+// slot - waiting for the GPU only if that slot is still in
+// use.  This should occur after presenting the current frame.
 // --------------------------------------------------------
 void Graphics::AdvanceSwapChainIndex()
 {
 	// Increment our CPU-side counter and place "this frame" into the queue
-	CPUCounter++;
-	CommandQueue->Signal(WaitFence.Get(), CPUCounter);
-
-	// How far "ahead" are we?
-	UINT64 frames = CPUCounter - GPUCounter;
-	if (frames >= NumBackBuffers)
+	// (under the counter lock, since releases read the counter)
 	{
-		// Too far ahead, so wait for the next GPU counter (current + 1)
-		if (WaitFence->GetCompletedValue() < GPUCounter + 1)
-		{
-			// Not completed, so we wait
-			WaitFence->SetEventOnCompletion(GPUCounter + 1, WaitFenceEvent);
-			WaitForSingleObject(WaitFenceEvent, INFINITE);
-		}
+		std::lock_guard<std::mutex> lock(fenceCounterMutex);
+		CPUCounter++;
+		CommandQueue->Signal(WaitFence.Get(), CPUCounter);
+	}
 
-		// GPU has caught up one frame
-		GPUCounter++;
+	// Move to the next frame slot, which the GPU might still be
+	// using if we're too far "ahead" (based on frames in flight)
+	UINT64 waitValue = frameScheduler.EndFrame(CPUCounter);
+	if (WaitFence->GetCompletedValue() < waitValue)
+	{
+		// Not completed, so we wait
+		WaitFence->SetEventOnCompletion(waitValue, WaitFenceEvent);
+		WaitForSingleObject(WaitFenceEvent, INFINITE);
 	}
 
+	// GPU has caught up to (at least) this point
+	if (waitValue > GPUCounter)
+		GPUCounter = waitValue;
+
+	// New frame starts at the beginning of its section of the CB ring
+	cbUploadHeapOffsetInBytes = 0;
+	cbvDescriptorOffset = 0;
+
+	// Free up heap space from any placed resources the GPU is done with
+	placedResources->ProcessPendingReleases(WaitFence->GetCompletedValue());
+
 	// Update the current back buffer index
 	currentBackBufferIndex++;
 	currentBackBufferIndex %= NumBackBuffers;
 }
 
 
+// --------------------------------------------------------
+// Changes how many frames the CPU may record ahead of the
+// GPU.  This takes effect at the end of the current frame
+// (which drains the GPU once so every slot can be reused).
+// 
+// count - New number of frames in flight (1 to MaxFramesInFlight)
+// --------------------------------------------------------
+void Graphics::SetFramesInFlight(unsigned int count)
+{
+	frameScheduler.SetFramesInFlight(count);
+}
+
+
 // --------------------------------------------------------
 // Loads a texture using the DirectX Toolkit and creates an
 // SRV in the overall CBV/SRV descriptor heap, returning its
@@ -564,13 +605,6 @@ unsigned int Graphics::CreateCubemap(
 	D3D12_RESOURCE_DESC faceDesc = faces[0]->GetDesc();
 
 	// Create the new, final texture
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.VisibleNodeMask = 1;
-
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Alignment = 0;
 	desc.DepthOrArraySize = 6; // Cube map
@@ -584,14 +618,10 @@ unsigned int Graphics::CreateCubemap(
 	desc.SampleDesc.Quality = 0;
 	desc.Width = faceDesc.Width;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> cubeMap;
-	Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COPY_DEST, // Copying into immediately
-		0,
-		IID_PPV_ARGS(cubeMap.GetAddressOf()));
+	Microsoft::WRL::ComPtr<ID3D12Resource> cubeMap = CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_COPY_DEST); // Copying into immediately
 
 	// Copy all faces to the proper subresource of the cube map
 	for (int f = 0; f < 6; f++)
@@ -693,14 +723,7 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	// The overall buffer we'll be creating
 	Microsoft::WRL::ComPtr<ID3D12Resource> finalBuffer;
 
-	// Describes the final heap
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.VisibleNodeMask = 1;
-
+	// Describes the final buffer
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Alignment = 0;
 	desc.DepthOrArraySize = 1;
@@ -718,30 +741,19 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	// state, it will be implicitly transitioned to the "copy destination" state
 	// when used for a copy operation below.  For more info, see:
 	// https://learn.microsoft.com/en-us/windows/win32/direct3d12/user-mode-heap-synchronization#multi-queue-resource-access
-	Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COMMON, // Must start in "common" state to avoid warning
-		0,
-		IID_PPV_ARGS(finalBuffer.GetAddressOf()));
-
-	// Now create an intermediate upload heap for copying initial data
-	D3D12_HEAP_PROPERTIES uploadProps = {};
-	uploadProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	uploadProps.CreationNodeMask = 1;
-	uploadProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	uploadProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-	uploadProps.VisibleNodeMask = 1;
-
-	Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap;
-	Device->CreateCommittedResource(
-		&uploadProps,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		0,
-		IID_PPV_ARGS(uploadHeap.GetAddressOf()));
+	// Note: This is placed in one of our large default heaps rather than
+	//       getting an entire committed heap of its own
+	finalBuffer = CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_COMMON); // Must start in "common" state to avoid warning
+
+	// Now create an intermediate upload buffer for copying initial data,
+	// also placed (in an upload heap) so its memory can be reused later
+	Microsoft::WRL::ComPtr<ID3D12Resource> uploadHeap = CreatePlacedResource(
+		D3D12_HEAP_TYPE_UPLOAD,
+		desc,
+		D3D12_RESOURCE_STATE_GENERIC_READ);
 
 	// Do a straight map/memcpy/unmap
 	void* gpuAddress = 0;
@@ -768,18 +780,116 @@ Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreateStaticBuffer(size_t dataS
 	ID3D12CommandList* list[] = { localList.Get() };
 	CommandQueue->ExecuteCommandLists(1, list);
 
+	// The upload buffer is no longer needed once the copy is
+	// done, which the wait below guarantees
+	ReleasePlacedResource(uploadHeap);
+
 	WaitForGPU();
 	return finalBuffer;
 }
 
 
+// --------------------------------------------------------
+// Creates a resource placed within one of our large heaps
+// rather than a committed resource with its own implicit heap
+// 
+// heapType     - Default, upload or readback
+// desc         - Description of the resource to create
+// initialState - The resource's starting state
+// clearValue   - Optimized clear value for render targets (or null)
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D12Resource> Graphics::CreatePlacedResource(
+	D3D12_HEAP_TYPE heapType,
+	const D3D12_RESOURCE_DESC& desc,
+	D3D12_RESOURCE_STATES initialState,
+	const D3D12_CLEAR_VALUE* clearValue)
+{
+	return placedResources->Create(heapType, desc, initialState, clearValue);
+}
+
+
+// --------------------------------------------------------
+// Releases a placed resource.  The GPU may still be using it
+// from a previous frame, so its range in the heap is only
+// freed once the GPU has passed the current fence value.
+// 
+// Note: Placed resources that are simply Reset() instead of
+//       released here will keep their heap space until the
+//       end of the program.
+// --------------------------------------------------------
+void Graphics::ReleasePlacedResource(Microsoft::WRL::ComPtr<ID3D12Resource>& resource)
+{
+	placedResources->Release(resource, ReleaseFenceValue());
+}
+
+
+// --------------------------------------------------------
+// The fence value after which nothing recorded or queued so
+// far can still be using a resource released right now.
+//
+// Every frame acquired from the pipeline but not yet rendered
+// may reference it, and each one signals exactly one more
+// fence value when it ends (AdvanceSwapChainIndex), on top of
+// the next value for work already in the open command list.
+// Anything else that signals (WaitForGPU) only happens while
+// the render thread is idle.
+//
+// The queued count is read before the counter: frames that
+// finish in between only make the result later, never early.
+// --------------------------------------------------------
+UINT64 Graphics::ReleaseFenceValue()
+{
+	UINT64 queuedFrames = framePipeline ? framePipeline->GetUnrenderedFrameCount() : 0;
+
+	std::lock_guard<std::mutex> lock(fenceCounterMutex);
+	return CPUCounter + queuedFrames + 1;
+}
+
+
+// --------------------------------------------------------
+// Sets (or clears, with null) the pipeline whose queued
+// frames are accounted for by ReleaseFenceValue().  Clear
+// it before the pipeline is destroyed.
+// --------------------------------------------------------
+void Graphics::SetFramePipeline(FramePipeline* pipeline)
+{
+	framePipeline = pipeline;
+}
+
+
+// --------------------------------------------------------
+// Is the render thread done with everything submitted to it?
+// Always true if there's no pipeline (or it isn't running).
+// --------------------------------------------------------
+bool Graphics::RenderThreadIdle()
+{
+	return !framePipeline || framePipeline->IsIdle();
+}
+
+
+// --------------------------------------------------------
+// Gathers usage, fragmentation and defragmentation details
+// for each pool of placed resource heaps.  Safe to call from
+// the game thread while the render thread is advancing frames.
+// --------------------------------------------------------
+std::vector<HeapPoolReport> Graphics::GetHeapPoolReports()
+{
+	return placedResources->GetReports();
+}
+
+
 // --------------------------------------------------------
 // Copies the given data into the next "unused" spot in
-// the CBV upload heap (wrapping at the end, since we treat
-// it like a ring buffer).  Then creates a CBV in the next
-// "unused" spot in the CBV heap that points to the 
-// aforementioned spot in the upload heap and returns that 
-// CBV (a GPU descriptor handle)
+// this frame's section of the CBV upload heap.  Then creates
+// a CBV in the next "unused" spot in this frame's section
+// of the CBV heap that points to the aforementioned spot
+// in the upload heap and returns that CBV (a GPU
+// descriptor handle)
+//
+// Running out of room in a frame's section is a bug (raise
+// MaxConstantBuffers): it asserts, and in release builds
+// reports it once and hands back the frame's last CBV
+// rather than overwriting data earlier draws are using.
 // 
 // data - The data to copy to the GPU
 // dataSizeInBytes - The byte size of the data to copy
@@ -792,28 +902,44 @@ D3D12_GPU_DESCRIPTOR_HANDLE Graphics::FillNextConstantBufferAndGetGPUDescriptorH
 	SIZE_T reservationSize = (SIZE_T)dataSizeInBytes;
 	reservationSize = (reservationSize + 255) / 256 * 256; // Integer division trick
 
-	// Ensure this upload will fit in the remaining space.  If not, reset to beginning.
-	if (cbUploadHeapOffsetInBytes + reservationSize >= cbUploadHeapSizeInBytes)
-		cbUploadHeapOffsetInBytes = 0;
+	// Ensure this upload will fit in the remaining space of this frame's
+	// section of the heap.  Wrapping would overwrite constants that draws
+	// earlier in this frame still point to, so never do that.
+	if (cbUploadHeapOffsetInBytes + reservationSize > cbUploadHeapFrameSizeInBytes ||
+		cbvDescriptorOffset >= cbvDescriptorsPerFrame)
+	{
+		assert(false && "Too many constant buffers in one frame - raise MaxConstantBuffers");
+
+		static bool reported = false;
+		if (!reported)
+		{
+			printf("\x1B[91mOut of constant buffer space this frame - raise MaxConstantBuffers\n\x1B[0m");
+			reported = true;
+		}
+
+		unsigned int lastIndex = cbvDescriptorsPerFrame * FrameIndex() + (cbvDescriptorOffset > 0 ? cbvDescriptorOffset - 1 : 0);
+		D3D12_GPU_DESCRIPTOR_HANDLE lastHandle = CBVSRVDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
+		lastHandle.ptr += (SIZE_T)lastIndex * cbvSrvDescriptorHeapIncrementSize;
+		return lastHandle;
+	}
 
 	// Where in the upload heap will this data go?
+	UINT64 frameStartInBytes = cbUploadHeapFrameSizeInBytes * FrameIndex();
 	D3D12_GPU_VIRTUAL_ADDRESS virtualGPUAddress =
-		CBUploadHeap->GetGPUVirtualAddress() + cbUploadHeapOffsetInBytes;
+		CBUploadHeap->GetGPUVirtualAddress() + frameStartInBytes + cbUploadHeapOffsetInBytes;
 
 	// === Copy data to the upload heap ===
 	{
 		// Calculate the actual upload address (which we got from mapping the buffer)
 		// Note that this is different than the GPU virtual address needed for the CBV below
-		void* uploadAddress = reinterpret_cast<void*>((SIZE_T)cbUploadHeapStartAddress + cbUploadHeapOffsetInBytes);
+		void* uploadAddress = reinterpret_cast<void*>((SIZE_T)cbUploadHeapStartAddress + frameStartInBytes + cbUploadHeapOffsetInBytes);
 
 		// Perform the mem copy to put new data into this part of the heap
 		memcpy(uploadAddress, data, dataSizeInBytes);
 
-		// Increment the offset and loop back to the beginning if necessary,
-		// allowing us to treat the upload heap like a ring buffer
+		// Move past this data (the offset goes back to the start
+		// of the section when the frame ends)
 		cbUploadHeapOffsetInBytes += reservationSize;
-		if (cbUploadHeapOffsetInBytes >= cbUploadHeapSizeInBytes)
-			cbUploadHeapOffsetInBytes = 0;
 	}
 
 	// Create a CBV for this section of the heap
@@ -825,8 +951,9 @@ D3D12_GPU_DESCRIPTOR_HANDLE Graphics::FillNextConstantBufferAndGetGPUDescriptorH
 		// Offset each by based on how many descriptors we've used
 		// Note: cbvDescriptorOffset is a COUNT of descriptors, not bytes
 		//       so we need to calculate the size
-		cpuHandle.ptr += (SIZE_T)cbvDescriptorOffset * cbvSrvDescriptorHeapIncrementSize;
-		gpuHandle.ptr += (SIZE_T)cbvDescriptorOffset * cbvSrvDescriptorHeapIncrementSize;
+		unsigned int descriptorIndex = cbvDescriptorsPerFrame * FrameIndex() + cbvDescriptorOffset;
+		cpuHandle.ptr += (SIZE_T)descriptorIndex * cbvSrvDescriptorHeapIncrementSize;
+		gpuHandle.ptr += (SIZE_T)descriptorIndex * cbvSrvDescriptorHeapIncrementSize;
 
 		// Describe the constant buffer view that points to
 		// our latest chunk of the CB upload heap
@@ -837,11 +964,8 @@ D3D12_GPU_DESCRIPTOR_HANDLE Graphics::FillNextConstantBufferAndGetGPUDescriptorH
 		// Create the CBV, which is a lightweight operation in DX12
 		Device->CreateConstantBufferView(&cbvDesc, cpuHandle);
 
-		// Increment the offset and loop back to the beginning if necessary
-		// which allows us to treat the descriptor heap as a ring buffer
+		// Move to the next descriptor in this frame's section
 		cbvDescriptorOffset++;
-		if (cbvDescriptorOffset >= MaxConstantBuffers)
-			cbvDescriptorOffset = 0;
 
 		// Now that the CBV is ready, we return the GPU handle to it
 		// so it can be set as part of the root signature during drawing
@@ -887,10 +1011,10 @@ unsigned int Graphics::GetDescriptorIndex(D3D12_GPU_DESCRIPTOR_HANDLE handle)
 // Always wait before reseting command allocator, as it should not
 // be reset while the GPU is processing a command list
 // --------------------------------------------------------
-void Graphics::ResetAllocatorAndCommandList(unsigned int swapChainIndex)
+void Graphics::ResetAllocatorAndCommandList(unsigned int frameIndex)
 {
-	CommandAllocator[swapChainIndex]->Reset();
-	CommandList->Reset(CommandAllocator[swapChainIndex].Get(), 0);
+	CommandAllocator[frameIndex]->Reset();
+	CommandList->Reset(CommandAllocator[frameIndex].Get(), 0);
 }
 
 
@@ -916,10 +1040,17 @@ void Graphics::CloseAndExecuteCommandList()
 // --------------------------------------------------------
 void Graphics::WaitForGPU()
 {
+	// Signaling here would throw off the fence values that queued
+	// frames will signal (see ReleaseFenceValue())
+	assert(RenderThreadIdle());
+
 	// Update our ongoing fence value (a unique index for each "stop sign")
 	// and then place that value into the GPU's command queue
-	CPUCounter++;
-	CommandQueue->Signal(WaitFence.Get(), CPUCounter);
+	{
+		std::lock_guard<std::mutex> lock(fenceCounterMutex);
+		CPUCounter++;
+		CommandQueue->Signal(WaitFence.Get(), CPUCounter);
+	}
 
 	// Check to see if the most recently completed fence value
 	// is less than the one we just set.
@@ -933,6 +1064,9 @@ void Graphics::WaitForGPU()
 
 	// We're fully caught up
 	GPUCounter = CPUCounter;
+
+	// Nothing is in flight, so all released placed resources can go
+	placedResources->ProcessPendingReleases(CPUCounter);
 }
 
 
@@ -4,20 +4,34 @@
 #include <d3d12.h>
 #include <dxgi1_6.h>
 #include <string>
+#include <vector>
 #include <wrl/client.h>
 
+#include "PlacedResourceHeaps.h"
+
 #pragma comment(lib, "d3d12.lib")
 #pragma comment(lib, "dxgi.lib")
 
+class FramePipeline;
+
 namespace Graphics
 {
 	// --- CONSTANTS ---
 	const unsigned int NumBackBuffers = 2;
 
-	// Maximum number of constant buffers, assuming each buffer
-	// is 256 bytes or less.  Larger buffers are fine, but will
-	// result in fewer buffers in use at any time
+	// Frames the CPU may record ahead of the GPU.  The actual number
+	// can be changed at run time (up to the max), trading latency
+	// for CPU/GPU overlap.  Per-frame resources are sized for the max.
+	const unsigned int MaxFramesInFlight = 4;
+	const unsigned int DefaultFramesInFlight = 2;
+
+	// Maximum number of constant buffers filled in a single frame,
+	// assuming each buffer is 256 bytes or less.  Larger buffers are
+	// fine, but will result in fewer buffers per frame.  Each possible
+	// frame in flight gets this many, so nothing a frame the GPU is
+	// still reading is overwritten.
 	const unsigned int MaxConstantBuffers = 1000;
+	const unsigned int MaxConstantBufferBytes = MaxConstantBuffers * 256;
 
 	// Maximum number of texture descriptors (SRVs) we can have.
 	// Each material will have a chunk of this, plus any 
@@ -35,7 +49,7 @@ namespace Graphics
 	inline Microsoft::WRL::ComPtr<IDXGISwapChain>	SwapChain;
 
 	// Command submission
-	inline Microsoft::WRL::ComPtr<ID3D12CommandAllocator>		CommandAllocator[NumBackBuffers];
+	inline Microsoft::WRL::ComPtr<ID3D12CommandAllocator>		CommandAllocator[MaxFramesInFlight];
 	inline Microsoft::WRL::ComPtr<ID3D12CommandQueue>			CommandQueue;
 	inline Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList>	CommandList;
 
@@ -65,6 +79,8 @@ namespace Graphics
 	// Getters
 	bool VsyncState();
 	unsigned int SwapChainIndex();
+	unsigned int FrameIndex();
+	unsigned int FramesInFlight();
 	std::wstring APIName();
 
 	// General functions
@@ -72,6 +88,7 @@ namespace Graphics
 	void ShutDown();
 	void ResizeBuffers(unsigned int width, unsigned int height);
 	void AdvanceSwapChainIndex();
+	void SetFramesInFlight(unsigned int count);
 
 	// Resource creation
 	unsigned int LoadTexture(const wchar_t* file, bool generateMips = true);
@@ -84,6 +101,16 @@ namespace Graphics
 		const wchar_t* back);
 	Microsoft::WRL::ComPtr<ID3D12Resource> CreateStaticBuffer(size_t dataStride, size_t dataCount, void* data);
 
+	// Placed resources (sub-allocated from large heaps) - these may be
+	// called from either thread, as frees happen when frames advance
+	Microsoft::WRL::ComPtr<ID3D12Resource> CreatePlacedResource(
+		D3D12_HEAP_TYPE heapType,
+		const D3D12_RESOURCE_DESC& desc,
+		D3D12_RESOURCE_STATES initialState,
+		const D3D12_CLEAR_VALUE* clearValue = 0);
+	void ReleasePlacedResource(Microsoft::WRL::ComPtr<ID3D12Resource>& resource);
+	std::vector<HeapPoolReport> GetHeapPoolReports();
+
 	// Resource usage
 	D3D12_GPU_DESCRIPTOR_HANDLE FillNextConstantBufferAndGetGPUDescriptorHandle(
 		void* data,
@@ -96,10 +123,16 @@ namespace Graphics
 	unsigned int GetDescriptorIndex(D3D12_GPU_DESCRIPTOR_HANDLE handle);
 
 	// Command list & synchronization
-	void ResetAllocatorAndCommandList(unsigned int swapChainIndex);
+	void ResetAllocatorAndCommandList(unsigned int frameIndex);
 	void CloseAndExecuteCommandList();
 	void WaitForGPU();
 
+	// Frames queued for the render thread haven't signaled their fence
+	// values yet, so releases need to know about them (null if none)
+	void SetFramePipeline(FramePipeline* pipeline);
+	UINT64 ReleaseFenceValue();
+	bool RenderThreadIdle();
+
 	// Debug Layer
 	void PrintDebugMessages();
 }
\ No newline at end of file
@@ -19,8 +19,7 @@ using namespace DirectX;
 // --------------------------------------------------------
 Mesh::Mesh(const char* name, Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices) :
 	name(name),
-	vbView{},
-	ibView{}
+	poolHandle(GeometryPool::InvalidHandle)
 {
 	CreateBuffers(vertArray, numVerts, indexArray, numIndices);
 }
@@ -32,9 +31,7 @@ Mesh::Mesh(const char* name, Vertex* vertArray, size_t numVerts, unsigned int* i
 // --------------------------------------------------------
 Mesh::Mesh(const char* name, const std::wstring& objFile) :
 	name(name),
-	vbView{},
-	ibView{},
-	vbGPUDescriptorHandle{}
+	poolHandle(GeometryPool::InvalidHandle)
 {
 	// Set indicies to 0 in the event the file reading fails
 	numIndices = 0;
@@ -265,30 +262,36 @@ Mesh::Mesh(const char* name, const std::wstring& objFile) :
 
 
 // --------------------------------------------------------
-// Destructor doesn't have much to do since we're using ComPtrs
+// Destructor gives our ranges back to the geometry pool
 // --------------------------------------------------------
-Mesh::~Mesh() { }
+Mesh::~Mesh()
+{
+	GeometryPool::Remove(poolHandle);
+}
 
 
 // --------------------------------------------------------
 // Getters for private variables
 // --------------------------------------------------------
-D3D12_VERTEX_BUFFER_VIEW Mesh::GetVertexBufferView() { return vbView; }
-D3D12_GPU_DESCRIPTOR_HANDLE Mesh::GetVertexBufferDescriptorHandle() { return vbGPUDescriptorHandle; }
-D3D12_INDEX_BUFFER_VIEW Mesh::GetIndexBufferView() { return ibView; }
+D3D12_GPU_DESCRIPTOR_HANDLE Mesh::GetVertexBufferDescriptorHandle() { return GeometryPool::GetVertexBufferDescriptorHandle(); }
+D3D12_INDEX_BUFFER_VIEW Mesh::GetIndexBufferView() { return GeometryPool::GetIndexBufferView(); }
 const char* Mesh::GetName() { return name; }
 size_t Mesh::GetIndexCount() { return numIndices; }
 size_t Mesh::GetVertexCount() { return numVertices; }
 
+// Offsets within the pool are looked up each time, as
+// they can change when the pool is compacted or grown
+unsigned int Mesh::GetBaseVertex() { return GeometryPool::GetRange(poolHandle).BaseVertex; }
+unsigned int Mesh::GetFirstIndex() { return GeometryPool::GetRange(poolHandle).FirstIndex; }
+
 
 // --------------------------------------------------------
-// Helper for creating the actually D3D buffers
+// Helper for placing the geometry into the shared pool
 // 
 // vertArray  - An array of vertices
 // numVerts   - The number of verts in the array
 // indexArray - An array of indices into the vertex array
 // numIndices - The number of indices in the index array
-// device     - The D3D device to use for buffer creation
 // --------------------------------------------------------
 void Mesh::CreateBuffers(Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices)
 {
@@ -299,32 +302,8 @@ void Mesh::CreateBuffers(Vertex* vertArray, size_t numVerts, unsigned int* index
 	// Calculate the tangents before copying to buffer
 	CalculateTangents(vertArray, numVerts, indexArray, numIndices);
 
-	// Create the two buffers
-	vertexBuffer = Graphics::CreateStaticBuffer(sizeof(Vertex), numVerts, vertArray);
-	indexBuffer = Graphics::CreateStaticBuffer(sizeof(unsigned int), numIndices, indexArray);
-
-	// Set up the views
-	vbView.StrideInBytes = (UINT)sizeof(Vertex);
-	vbView.SizeInBytes = (UINT)(sizeof(Vertex) * numVerts);
-	vbView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
-
-	ibView.Format = DXGI_FORMAT_R32_UINT;
-	ibView.SizeInBytes = (UINT)(sizeof(unsigned int) * numIndices);
-	ibView.BufferLocation = indexBuffer->GetGPUVirtualAddress();
-
-	// Set up an SRV for the vertex buffer
-	D3D12_CPU_DESCRIPTOR_HANDLE vbCPU; // Need this for creating the SRV below
-	Graphics::ReserveDescriptorHeapSlot(&vbCPU, &vbGPUDescriptorHandle);
-
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc{};
-	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Buffer.FirstElement = 0;
-	srvDesc.Buffer.NumElements = (unsigned int)numVerts;
-	srvDesc.Buffer.StructureByteStride = sizeof(Vertex);
-	srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
-	Graphics::Device->CreateShaderResourceView(vertexBuffer.Get(), &srvDesc, vbCPU);
+	// Copy the data into the shared geometry pool
+	poolHandle = GeometryPool::Add(vertArray, numVerts, indexArray, numIndices);
 }
 
 
@@ -5,6 +5,7 @@
 #include <string>
 
 #include "Vertex.h"
+#include "GeometryPool.h"
 
 
 class Mesh
@@ -14,22 +15,20 @@ public:
 	Mesh(const char* name, const std::wstring& objFile);
 	~Mesh();
 
-	// Getters for mesh data
-	D3D12_VERTEX_BUFFER_VIEW GetVertexBufferView();
+	// Getters for mesh data - note that the buffer views are
+	// for the shared geometry pool, so draws must also use
+	// this mesh's base vertex and first index
 	D3D12_GPU_DESCRIPTOR_HANDLE GetVertexBufferDescriptorHandle();
 	D3D12_INDEX_BUFFER_VIEW GetIndexBufferView();
 	const char* GetName();
 	size_t GetIndexCount();
 	size_t GetVertexCount();
+	unsigned int GetBaseVertex();
+	unsigned int GetFirstIndex();
 
 private:
-	// D3D buffers
-	D3D12_VERTEX_BUFFER_VIEW vbView;
-	D3D12_GPU_DESCRIPTOR_HANDLE vbGPUDescriptorHandle;
-	Microsoft::WRL::ComPtr<ID3D12Resource> vertexBuffer;
-
-	D3D12_INDEX_BUFFER_VIEW ibView;
-	Microsoft::WRL::ComPtr<ID3D12Resource> indexBuffer;
+	// Our ranges within the shared geometry pool
+	GeometryPool::Handle poolHandle;
 
 	// Total indices & vertices in this mesh
 	size_t numIndices;
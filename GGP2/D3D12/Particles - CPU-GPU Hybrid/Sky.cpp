@@ -174,6 +174,11 @@ void Sky::InitRenderStates()
 }
 
 void Sky::Draw(std::shared_ptr<Camera> camera)
+{
+	Draw(camera->GetView(), camera->GetProjection());
+}
+
+void Sky::Draw(const XMFLOAT4X4& view, const XMFLOAT4X4& projection)
 {
 	// Set pipeline stuff (assuming we're using the heap from Game)
 	Graphics::CommandList->SetPipelineState(pipelineState.Get());
@@ -187,8 +192,8 @@ void Sky::Draw(std::shared_ptr<Camera> camera)
 	// Per frame data
 	{
 		VertexShaderPerFrameData vsFrame{};
-		vsFrame.view = camera->GetView();
-		vsFrame.projection = camera->GetProjection();
+		vsFrame.view = view;
+		vsFrame.projection = projection;
 
 		D3D12_GPU_DESCRIPTOR_HANDLE cbHandleVS = Graphics::FillNextConstantBufferAndGetGPUDescriptorHandle(
 			(void*)(&vsFrame), sizeof(VertexShaderPerFrameData));
@@ -203,12 +208,18 @@ void Sky::Draw(std::shared_ptr<Camera> camera)
 		&drawData,
 		0);
 
-	// Grab the mesh and its buffer views
+	// Grab the pool's index buffer view (the same one Game uses,
+	// but set here too so the sky doesn't rely on draw order)
 	D3D12_INDEX_BUFFER_VIEW ibv = skyMesh->GetIndexBufferView();
 
 	// Set the geometry
 	Graphics::CommandList->IASetIndexBuffer(&ibv);
 
-	// Draw
-	Graphics::CommandList->DrawIndexedInstanced((UINT)skyMesh->GetIndexCount(), 1, 0, 0, 0);
+	// Draw our range of the shared geometry pool
+	Graphics::CommandList->DrawIndexedInstanced(
+		(UINT)skyMesh->GetIndexCount(),
+		1,
+		skyMesh->GetFirstIndex(),
+		skyMesh->GetBaseVertex(),
+		0);
 }
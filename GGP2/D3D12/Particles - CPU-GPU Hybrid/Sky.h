@@ -43,6 +43,7 @@ public:
 	~Sky();
 
 	void Draw(std::shared_ptr<Camera> camera);
+	void Draw(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection);
 
 	unsigned int GetSkyboxDescriptorIndex();
 
@@ -0,0 +1,217 @@
+#include "FramePipeline.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Runs FramePipeline with a null renderer: packets are just
+// a frame number and a list of "resources" the frame draws,
+// and rendering a packet checks it, then signals a fake fence
+// the way Graphics::AdvanceSwapChainIndex does.  Meanwhile the
+// game thread releases resources with the fence value from
+// Graphics::ReleaseFenceValue() and frees them once the fence
+// passes it.  A queued packet must never see one of its
+// resources freed, and a slot must never be handed back to
+// the game thread while it's still being rendered.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// What a frame packet boils down to here
+struct TestPacket
+{
+	uint64_t Frame = 0;
+	std::vector<unsigned int> Resources;
+};
+
+// Stand-in for the fence counter in Graphics.cpp
+struct FakeFence
+{
+	std::mutex Mutex;
+	uint64_t Counter = 0;
+
+	void Signal()
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		Counter++;
+	}
+
+	uint64_t Read()
+	{
+		std::lock_guard<std::mutex> lock(Mutex);
+		return Counter;
+	}
+};
+
+// Same order of reads as Graphics::ReleaseFenceValue()
+static uint64_t ReleaseFenceValue(FramePipeline& pipeline, FakeFence& fence)
+{
+	uint64_t queued = pipeline.GetUnrenderedFrameCount();
+	return fence.Read() + queued + 1;
+}
+
+struct PendingRelease
+{
+	uint64_t FenceValue;
+	unsigned int Resource;
+};
+
+static void ReleasesOutliveQueuedFrames(bool renderThread, unsigned int slotCount, unsigned int seed)
+{
+	const unsigned int resourceCount = 4096;
+	const uint64_t frameCount = 3000;
+
+	std::mt19937 rng(seed);
+	FramePipeline pipeline(slotCount);
+	std::vector<TestPacket> packets(slotCount);
+	std::vector<std::atomic<bool>> slotBusy(slotCount);
+	std::vector<std::atomic<bool>> freed(resourceCount);
+	FakeFence fence;
+	std::atomic<uint64_t> nextRenderedFrame = 0;
+
+	pipeline.SetRenderFunction([&](unsigned int slot)
+		{
+			slotBusy[slot] = true;
+			TestPacket& packet = packets[slot];
+
+			// In order, one frame at a time
+			CHECK(packet.Frame == nextRenderedFrame);
+			nextRenderedFrame = packet.Frame + 1;
+
+			// Take a little while, so the game thread gets ahead
+			if (packet.Frame % 3 == 0)
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+
+			for (unsigned int r : packet.Resources)
+				CHECK(!freed[r]);
+
+			slotBusy[slot] = false;
+			fence.Signal();
+		});
+
+	if (renderThread)
+		pipeline.Start();
+
+	std::vector<unsigned int> live;
+	std::vector<PendingRelease> pending;
+	unsigned int nextResource = 0;
+
+	for (uint64_t frame = 0; frame < frameCount; frame++)
+	{
+		// Free anything the fence has passed (the fake
+		// GPU finishes a frame the moment it's signaled)
+		uint64_t completed = fence.Read();
+		for (size_t i = 0; i < pending.size();)
+		{
+			if (pending[i].FenceValue <= completed)
+			{
+				freed[pending[i].Resource] = true;
+				pending[i] = pending.back();
+				pending.pop_back();
+			}
+			else i++;
+		}
+
+		// Create and release a few resources
+		while (live.size() < 8 && nextResource < resourceCount)
+			live.push_back(nextResource++);
+		if (rng() % 2 == 0 && !live.empty())
+		{
+			size_t i = rng() % live.size();
+			pending.push_back({ ReleaseFenceValue(pipeline, fence), live[i] });
+			live[i] = live.back();
+			live.pop_back();
+		}
+
+		// Build this frame's packet from whatever is live
+		unsigned int slot = pipeline.AcquireSlot();
+		CHECK(!slotBusy[slot]);
+		TestPacket& packet = packets[slot];
+		packet.Frame = frame;
+		packet.Resources = live;
+
+		// Releasing after the packet is built is the case that
+		// needs the queued frames counted, since it's drawn
+		if (rng() % 4 == 0 && !live.empty())
+		{
+			pending.push_back({ ReleaseFenceValue(pipeline, fence), live.back() });
+			live.pop_back();
+		}
+
+		pipeline.Submit(slot);
+		CHECK(pipeline.GetUnrenderedFrameCount() <= slotCount);
+	}
+
+	pipeline.WaitForIdle();
+	CHECK(pipeline.IsIdle());
+	CHECK(pipeline.GetUnrenderedFrameCount() == 0);
+	CHECK(pipeline.GetRenderedFrameCount() == frameCount);
+	CHECK(fence.Read() == frameCount);
+	pipeline.Stop();
+}
+
+static void StopDrainsAndRendersInline()
+{
+	FramePipeline pipeline(2);
+	std::vector<uint64_t> rendered;
+	std::vector<uint64_t> frames(2);
+	pipeline.SetRenderFunction([&](unsigned int slot) { rendered.push_back(frames[slot]); });
+
+	pipeline.Start();
+	CHECK(pipeline.IsRunning());
+	for (uint64_t f = 0; f < 2; f++)
+	{
+		unsigned int slot = pipeline.AcquireSlot();
+		frames[slot] = f;
+		pipeline.Submit(slot);
+	}
+
+	// Everything submitted is rendered before the thread exits
+	pipeline.Stop();
+	CHECK(!pipeline.IsRunning());
+	CHECK(rendered.size() == 2);
+
+	// Without the thread, submitting renders right away
+	unsigned int slot = pipeline.AcquireSlot();
+	frames[slot] = 2;
+	CHECK(pipeline.GetUnrenderedFrameCount() == 1);
+	pipeline.Submit(slot);
+	CHECK(rendered.size() == 3);
+	CHECK(pipeline.IsIdle());
+	CHECK(pipeline.GetUnrenderedFrameCount() == 0);
+	for (uint64_t f = 0; f < rendered.size(); f++)
+		CHECK(rendered[f] == f);
+
+	// Out of order submissions are ignored
+	pipeline.Submit(1 - slot);
+	CHECK(pipeline.GetSubmittedFrameCount() == 3);
+}
+
+int main()
+{
+	StopDrainsAndRendersInline();
+
+	for (unsigned int seed = 1; seed <= 4; seed++)
+	{
+		ReleasesOutliveQueuedFrames(true, 2, seed);
+		ReleasesOutliveQueuedFrames(true, 3, seed);
+		ReleasesOutliveQueuedFrames(false, 2, seed);
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All frame pipeline tests passed\n");
+	return 0;
+}
@@ -0,0 +1,217 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Drives FrameScheduler the way Graphics::AdvanceSwapChainIndex
+// does, against a simulated GPU timeline: every frame costs
+// some CPU time to record and some GPU time to execute, the
+// GPU works through frames in submission order, and the CPU
+// blocks until the fence value the scheduler hands back has
+// been reached.  A slot must never be reused while the GPU is
+// still executing its previous frame, the CPU must never get
+// more than the requested number of frames ahead, and more
+// frames in flight should hide whichever side is faster.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// A fence whose values complete at known (simulated) times
+class SimulatedGPU
+{
+public:
+	// Queues a frame submitted at the given time, returning its fence value
+	uint64_t Submit(double submitTime, double gpuCost)
+	{
+		double start = std::max(submitTime, busyUntil);
+		busyUntil = start + gpuCost;
+		finishTimes.push_back(busyUntil);
+		return finishTimes.size();
+	}
+
+	// Latest fence value completed by the given time
+	uint64_t CompletedValue(double time) const
+	{
+		uint64_t value = 0;
+		while (value < finishTimes.size() && finishTimes[value] <= time)
+			value++;
+		return value;
+	}
+
+	// When the given fence value completes (zero is always done)
+	double FinishTime(uint64_t fenceValue) const
+	{
+		return fenceValue == 0 ? 0.0 : finishTimes[fenceValue - 1];
+	}
+
+	uint64_t SubmittedValue() const { return finishTimes.size(); }
+
+private:
+	double busyUntil = 0.0;
+	std::vector<double> finishTimes;
+};
+
+// Runs a number of frames with fixed costs, returning the total time
+static double RunFrames(unsigned int framesInFlight, unsigned int frameCount, double cpuCost, double gpuCost)
+{
+	FrameScheduler scheduler(4, framesInFlight);
+	SimulatedGPU gpu;
+	std::vector<uint64_t> slotFences(scheduler.GetMaxFramesInFlight(), 0);
+	double time = 0.0;
+
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		// The slot we're about to record into must be free
+		unsigned int slot = scheduler.GetFrameIndex();
+		CHECK(slot < framesInFlight);
+		CHECK(gpu.CompletedValue(time) >= slotFences[slot]);
+
+		// Including this one, never more than N frames on the GPU
+		CHECK(gpu.SubmittedValue() - gpu.CompletedValue(time) < framesInFlight);
+
+		time += cpuCost;
+		uint64_t fence = gpu.Submit(time, gpuCost);
+		slotFences[slot] = fence;
+
+		uint64_t waitValue = scheduler.EndFrame(fence);
+		CHECK(waitValue <= fence);
+		time = std::max(time, gpu.FinishTime(waitValue));
+	}
+
+	// Count the time until the GPU finishes the last frame
+	return gpu.FinishTime(gpu.SubmittedValue());
+}
+
+static void OneFrameInFlightSerializes()
+{
+	// CPU and GPU never overlap
+	double total = RunFrames(1, 100, 2.0, 3.0);
+	CHECK(total == 100 * 5.0);
+}
+
+static void MoreFramesHideTheFasterSide()
+{
+	// GPU-bound: the GPU should never sit idle after the first frame
+	double gpuBound = RunFrames(2, 100, 2.0, 5.0);
+	CHECK(gpuBound == 2.0 + 100 * 5.0);
+
+	// CPU-bound: the CPU should never wait
+	double cpuBound = RunFrames(2, 100, 5.0, 2.0);
+	CHECK(cpuBound == 100 * 5.0 + 2.0);
+
+	// Three frames buys nothing more with steady costs
+	CHECK(RunFrames(3, 100, 2.0, 5.0) == gpuBound);
+}
+
+static void FirstFramesNeverWait()
+{
+	FrameScheduler scheduler(3, 3);
+	CHECK(scheduler.EndFrame(1) == 0);
+	CHECK(scheduler.EndFrame(2) == 0);
+	CHECK(scheduler.GetFrameIndex() == 2);
+
+	// Back to slot zero, which has frame 1's fence value
+	CHECK(scheduler.EndFrame(3) == 1);
+	CHECK(scheduler.GetFrameIndex() == 0);
+}
+
+static void ChangingFramesInFlightDrains()
+{
+	FrameScheduler scheduler(4, 3);
+	scheduler.EndFrame(1);
+	scheduler.EndFrame(2);
+	CHECK(scheduler.GetFrameIndex() == 2);
+
+	// Takes effect at the end of this frame, by waiting on it
+	scheduler.SetFramesInFlight(2);
+	CHECK(scheduler.GetFramesInFlight() == 3);
+	CHECK(scheduler.EndFrame(3) == 3);
+	CHECK(scheduler.GetFramesInFlight() == 2);
+	CHECK(scheduler.GetFrameIndex() == 0);
+
+	// The GPU is idle, so nothing left to wait for
+	CHECK(scheduler.EndFrame(4) == 0);
+	CHECK(scheduler.EndFrame(5) == 4);
+
+	// Out of range requests are clamped
+	scheduler.SetFramesInFlight(0);
+	scheduler.EndFrame(6);
+	CHECK(scheduler.GetFramesInFlight() == 1);
+	scheduler.SetFramesInFlight(100);
+	scheduler.EndFrame(7);
+	CHECK(scheduler.GetFramesInFlight() == 4);
+}
+
+// Random costs and random changes to the number of frames
+// in flight, checked against the simulated timeline
+static void RandomTimeline(unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> costDist(0.5, 8.0);
+	std::uniform_int_distribution<unsigned int> countDist(1, 4);
+
+	FrameScheduler scheduler(4, countDist(rng));
+	SimulatedGPU gpu;
+	std::vector<uint64_t> slotFences(scheduler.GetMaxFramesInFlight(), 0);
+	double time = 0.0;
+
+	for (int frame = 0; frame < 2000; frame++)
+	{
+		unsigned int slot = scheduler.GetFrameIndex();
+		unsigned int framesInFlight = scheduler.GetFramesInFlight();
+		CHECK(slot < framesInFlight);
+		CHECK(gpu.CompletedValue(time) >= slotFences[slot]);
+		CHECK(gpu.SubmittedValue() - gpu.CompletedValue(time) < framesInFlight);
+
+		// Occasionally ask for a different number of frames
+		unsigned int requested = framesInFlight;
+		if (rng() % 50 == 0)
+		{
+			requested = countDist(rng);
+			scheduler.SetFramesInFlight(requested);
+		}
+
+		time += costDist(rng);
+		uint64_t fence = gpu.Submit(time, costDist(rng));
+		slotFences[slot] = fence;
+
+		uint64_t waitValue = scheduler.EndFrame(fence);
+		time = std::max(time, gpu.FinishTime(waitValue));
+
+		// A change applies now, and drains the GPU so every slot is free
+		CHECK(scheduler.GetFramesInFlight() == requested);
+		if (requested != framesInFlight)
+		{
+			CHECK(waitValue == fence);
+			CHECK(scheduler.GetFrameIndex() == 0);
+			CHECK(gpu.CompletedValue(time) == fence);
+			std::fill(slotFences.begin(), slotFences.end(), 0);
+		}
+	}
+}
+
+int main()
+{
+	OneFrameInFlightSerializes();
+	MoreFramesHideTheFasterSide();
+	FirstFramesNeverWait();
+	ChangingFramesInFlightDrains();
+
+	for (unsigned int seed = 1; seed <= 10; seed++)
+		RandomTimeline(seed);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All frame scheduler tests passed\n");
+	return 0;
+}
@@ -0,0 +1,366 @@
+#include "GeometryAllocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Runs GeometryAllocator against a mock uploader whose
+// "buffers" are plain arrays of tagged elements, so every
+// upload, compaction and growth can be checked by reading
+// each piece of geometry back out of wherever its range
+// says it is.  The mock also plays the GPU's fence, so
+// removals can be checked to wait for it.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// Every element says which geometry it belongs to and where
+static uint32_t VertexTag(unsigned int id, unsigned int i) { return (id << 16) | i; }
+static uint32_t IndexTag(unsigned int id, unsigned int i) { return ((id << 16) | i) ^ 0x5A5A5A5A; }
+
+class MockUploader : public GeometryUploader
+{
+public:
+	std::vector<uint32_t> Vertices;
+	std::vector<uint32_t> Indices;
+	uint64_t SubmittedFence = 0;
+	uint64_t CompletedFence = 0;
+	unsigned int RebuildCount = 0;
+
+	MockUploader(unsigned int vertexCapacity, unsigned int indexCapacity) :
+		Vertices(vertexCapacity, 0xFFFFFFFF),
+		Indices(indexCapacity, 0xFFFFFFFF) {}
+
+	uint64_t GetCompletedFenceValue() override { return CompletedFence; }
+
+	// Like Graphics::WaitForGPU(), signals one more fence value and waits for it
+	void WaitForIdle() override { CompletedFence = ++SubmittedFence; }
+
+	void Upload(const GeometryRange& range, const void* vertices, const unsigned int* indices) override
+	{
+		CHECK(range.BaseVertex + range.VertexCount <= Vertices.size());
+		CHECK(range.FirstIndex + range.IndexCount <= Indices.size());
+		if (range.BaseVertex + range.VertexCount > Vertices.size() || range.FirstIndex + range.IndexCount > Indices.size())
+			return;
+
+		std::copy_n((const uint32_t*)vertices, range.VertexCount, Vertices.begin() + range.BaseVertex);
+		std::copy_n(indices, range.IndexCount, Indices.begin() + range.FirstIndex);
+	}
+
+	void Rebuild(
+		unsigned int vertexCapacity,
+		unsigned int indexCapacity,
+		const std::vector<GeometryCopy>& vertexCopies,
+		const std::vector<GeometryCopy>& indexCopies) override
+	{
+		// The old buffers can't still be in use
+		CHECK(CompletedFence == SubmittedFence);
+		RebuildCount++;
+
+		Vertices = Apply(Vertices, vertexCapacity, vertexCopies);
+		Indices = Apply(Indices, indexCapacity, indexCopies);
+	}
+
+private:
+	static std::vector<uint32_t> Apply(const std::vector<uint32_t>& old, unsigned int capacity, const std::vector<GeometryCopy>& copies)
+	{
+		std::vector<uint32_t> result(capacity, 0xFFFFFFFF);
+		std::vector<bool> written(capacity, false);
+		for (const GeometryCopy& c : copies)
+		{
+			CHECK(c.SourceOffset + c.Count <= old.size());
+			CHECK(c.DestOffset + c.Count <= capacity);
+			if (c.SourceOffset + c.Count > old.size() || c.DestOffset + c.Count > capacity)
+				continue;
+
+			for (unsigned int i = 0; i < c.Count; i++)
+			{
+				CHECK(!written[c.DestOffset + i]); // Copies never overlap
+				written[c.DestOffset + i] = true;
+				result[c.DestOffset + i] = old[c.SourceOffset + i];
+			}
+		}
+		return result;
+	}
+};
+
+// What the test expects to find in the pool
+struct LiveGeometry
+{
+	GeometryHandle Handle;
+	unsigned int ID;
+	unsigned int VertexCount;
+	unsigned int IndexCount;
+};
+
+static GeometryHandle AddTagged(GeometryAllocator& allocator, unsigned int id, unsigned int vertexCount, unsigned int indexCount)
+{
+	std::vector<uint32_t> vertices(vertexCount);
+	std::vector<unsigned int> indices(indexCount);
+	for (unsigned int i = 0; i < vertexCount; i++) vertices[i] = VertexTag(id, i);
+	for (unsigned int i = 0; i < indexCount; i++) indices[i] = IndexTag(id, i);
+	return allocator.Add(vertices.data(), vertexCount, indices.data(), indexCount);
+}
+
+// Every live piece of geometry is where its range says, intact,
+// inside the buffers and not overlapping any other
+static void CheckContents(const GeometryAllocator& allocator, const MockUploader& uploader, const std::vector<LiveGeometry>& live)
+{
+	CHECK(uploader.Vertices.size() == allocator.GetVertexCapacity());
+	CHECK(uploader.Indices.size() == allocator.GetIndexCapacity());
+
+	std::vector<std::pair<unsigned int, unsigned int>> vertexSpans;
+	std::vector<std::pair<unsigned int, unsigned int>> indexSpans;
+	unsigned int usedVertices = 0;
+	unsigned int usedIndices = 0;
+	for (const LiveGeometry& g : live)
+	{
+		GeometryRange r = allocator.GetRange(g.Handle);
+		CHECK(r.VertexCount == g.VertexCount && r.IndexCount == g.IndexCount);
+		CHECK(r.BaseVertex + r.VertexCount <= uploader.Vertices.size());
+		CHECK(r.FirstIndex + r.IndexCount <= uploader.Indices.size());
+		if (r.BaseVertex + r.VertexCount > uploader.Vertices.size() || r.FirstIndex + r.IndexCount > uploader.Indices.size())
+			continue;
+
+		int wrong = 0;
+		for (unsigned int i = 0; i < g.VertexCount; i++)
+			wrong += uploader.Vertices[r.BaseVertex + i] != VertexTag(g.ID, i);
+		for (unsigned int i = 0; i < g.IndexCount; i++)
+			wrong += uploader.Indices[r.FirstIndex + i] != IndexTag(g.ID, i);
+		CHECK(wrong == 0);
+
+		vertexSpans.push_back({ r.BaseVertex, r.BaseVertex + r.VertexCount });
+		indexSpans.push_back({ r.FirstIndex, r.FirstIndex + r.IndexCount });
+		usedVertices += g.VertexCount;
+		usedIndices += g.IndexCount;
+	}
+
+	for (auto* spans : { &vertexSpans, &indexSpans })
+	{
+		std::sort(spans->begin(), spans->end());
+		for (size_t i = 1; i < spans->size(); i++)
+			CHECK((*spans)[i].first >= (*spans)[i - 1].second);
+	}
+
+	// Blocks can be a little bigger than asked for, never smaller
+	CHECK(allocator.GetUsedVertexCount() >= usedVertices);
+	CHECK(allocator.GetUsedIndexCount() >= usedIndices);
+}
+
+// After compaction everything sits back to back from the front
+// (a block can hold a few spare elements, if what was left over
+// when it was allocated was too small to bother splitting off)
+static void CheckPacked(const GeometryAllocator& allocator, const std::vector<LiveGeometry>& live)
+{
+	std::vector<std::pair<unsigned int, unsigned int>> vertexSpans;
+	std::vector<std::pair<unsigned int, unsigned int>> indexSpans;
+	for (const LiveGeometry& g : live)
+	{
+		GeometryRange r = allocator.GetRange(g.Handle);
+		vertexSpans.push_back({ r.BaseVertex, r.VertexCount });
+		indexSpans.push_back({ r.FirstIndex, r.IndexCount });
+	}
+
+	for (auto* spans : { &vertexSpans, &indexSpans })
+	{
+		std::sort(spans->begin(), spans->end());
+		unsigned int cursor = 0;
+		for (auto& [offset, count] : *spans)
+		{
+			CHECK(offset >= cursor && offset - cursor < 16);
+			cursor = offset + count;
+		}
+	}
+
+	CHECK(allocator.GetPendingRemovalCount() == 0);
+	CHECK(allocator.GetFragmentation() == 0.0f);
+}
+
+static void RemovalWaitsForFence()
+{
+	MockUploader uploader(1000, 3000);
+	GeometryAllocator allocator(uploader, 1000, 3000);
+
+	std::vector<LiveGeometry> live;
+	GeometryHandle a = AddTagged(allocator, 1, 100, 300);
+	GeometryHandle b = AddTagged(allocator, 2, 100, 300);
+	live.push_back({ b, 2, 100, 300 });
+	GeometryRange aRange = allocator.GetRange(a);
+
+	// Frame 5 might still draw A
+	uploader.SubmittedFence = 5;
+	uploader.CompletedFence = 4;
+	allocator.Remove(a, 5);
+	allocator.Remove(a, 5); // Removing twice is harmless
+	CHECK(allocator.GetPendingRemovalCount() == 1);
+
+	// New geometry can't land on A's ranges yet, and A is untouched
+	GeometryHandle c = AddTagged(allocator, 3, 100, 300);
+	live.push_back({ c, 3, 100, 300 });
+	GeometryRange cRange = allocator.GetRange(c);
+	CHECK(c != a);
+	CHECK(cRange.BaseVertex >= aRange.BaseVertex + aRange.VertexCount || cRange.BaseVertex + cRange.VertexCount <= aRange.BaseVertex);
+	CHECK(cRange.FirstIndex >= aRange.FirstIndex + aRange.IndexCount || cRange.FirstIndex + cRange.IndexCount <= aRange.FirstIndex);
+	CHECK(uploader.Vertices[aRange.BaseVertex] == VertexTag(1, 0));
+	CHECK(allocator.GetUsedVertexCount() >= 300);
+	CheckContents(allocator, uploader, live);
+
+	// Once the GPU passes frame 5, A's ranges and handle are free again
+	uploader.CompletedFence = 5;
+	allocator.ProcessPendingRemovals(uploader.GetCompletedFenceValue());
+	CHECK(allocator.GetPendingRemovalCount() == 0);
+	CHECK(allocator.GetUsedVertexCount() < 300);
+	GeometryHandle d = AddTagged(allocator, 4, 50, 150);
+	live.push_back({ d, 4, 50, 150 });
+	CHECK(d == a);
+	CheckContents(allocator, uploader, live);
+
+	// Bad handles are ignored
+	allocator.Remove(GeometryInvalidHandle, 6);
+	allocator.Remove(1000, 6);
+	CHECK(allocator.GetPendingRemovalCount() == 0);
+	CHECK(allocator.GetRange(GeometryInvalidHandle).VertexCount == 0);
+}
+
+static void CompactionClosesGaps()
+{
+	MockUploader uploader(20000, 60000);
+	GeometryAllocator allocator(uploader, 20000, 60000);
+
+	std::vector<LiveGeometry> live;
+	for (unsigned int id = 0; id < 40; id++)
+		live.push_back({ AddTagged(allocator, id, 100 + id * 7, 300 + id * 11), id, 100 + id * 7, 300 + id * 11 });
+
+	// Remove every other one, some still in flight when compacting
+	uploader.SubmittedFence = 10;
+	std::vector<LiveGeometry> kept;
+	for (size_t i = 0; i < live.size(); i++)
+	{
+		if (i % 2 == 0)
+			allocator.Remove(live[i].Handle, 8 + i % 3);
+		else
+			kept.push_back(live[i]);
+	}
+	uploader.CompletedFence = 8;
+	allocator.ProcessPendingRemovals(uploader.GetCompletedFenceValue());
+	CHECK(allocator.GetFragmentation() > 0.0f);
+
+	// Compaction waits for the GPU, so nothing is left pending
+	unsigned int capacity = allocator.GetVertexCapacity();
+	allocator.Compact();
+	CHECK(uploader.RebuildCount == 1);
+	CHECK(allocator.GetVertexCapacity() == capacity);
+	CheckContents(allocator, uploader, kept);
+	CheckPacked(allocator, kept);
+
+	// Nothing to do the second time
+	allocator.Compact();
+	CHECK(uploader.RebuildCount == 1);
+}
+
+static void GrowsWhenFull()
+{
+	MockUploader uploader(1000, 2000);
+	GeometryAllocator allocator(uploader, 1000, 2000);
+
+	// Fill it, leaving holes too small for what comes next
+	std::vector<LiveGeometry> live;
+	for (unsigned int id = 0; id < 9; id++)
+		live.push_back({ AddTagged(allocator, id, 100, 200), id, 100, 200 });
+	allocator.Remove(live[3].Handle, 0);
+	allocator.Remove(live[6].Handle, 0);
+	live.erase(live.begin() + 6);
+	live.erase(live.begin() + 3);
+
+	// Fits once compacted (without growing)
+	live.push_back({ AddTagged(allocator, 20, 250, 500), 20, 250, 500 });
+	CHECK(allocator.GetVertexCapacity() == 1000);
+	CHECK(uploader.RebuildCount == 1);
+	CheckContents(allocator, uploader, live);
+
+	// Doesn't fit at all: at least doubles
+	live.push_back({ AddTagged(allocator, 21, 600, 900), 21, 600, 900 });
+	CHECK(allocator.GetVertexCapacity() >= 2000);
+	CHECK(allocator.GetIndexCapacity() >= 4000);
+	CheckContents(allocator, uploader, live);
+
+	// Far bigger than double: grows to fit in one go
+	unsigned int rebuilds = uploader.RebuildCount;
+	live.push_back({ AddTagged(allocator, 22, 10000, 100), 22, 10000, 100 });
+	CHECK(allocator.GetVertexCapacity() >= allocator.GetUsedVertexCount());
+	CHECK(uploader.RebuildCount <= rebuilds + 2);
+	CheckContents(allocator, uploader, live);
+}
+
+static void RandomSequence(unsigned int steps, unsigned int seed)
+{
+	MockUploader uploader(4096, 8192);
+	GeometryAllocator allocator(uploader, 4096, 8192);
+
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<unsigned int> countDist(1, 700);
+	std::vector<LiveGeometry> live;
+	unsigned int nextID = 1;
+
+	for (unsigned int step = 0; step < steps; step++)
+	{
+		unsigned int action = rng() % 100;
+		if (action < 50 || live.empty())
+		{
+			unsigned int vertexCount = countDist(rng);
+			unsigned int indexCount = countDist(rng) * 3;
+			live.push_back({ AddTagged(allocator, nextID, vertexCount, indexCount), nextID, vertexCount, indexCount });
+			nextID++;
+		}
+		else if (action < 90)
+		{
+			// Drawn by the frame being recorded, so wait for that one
+			size_t pick = rng() % live.size();
+			allocator.Remove(live[pick].Handle, uploader.SubmittedFence + 1);
+			live[pick] = live.back();
+			live.pop_back();
+		}
+		else if (action < 98)
+		{
+			// A frame goes by, and the GPU catches up some
+			uploader.SubmittedFence++;
+			uploader.CompletedFence += rng() % (uploader.SubmittedFence - uploader.CompletedFence + 1);
+		}
+		else
+		{
+			allocator.Compact();
+			CheckPacked(allocator, live);
+		}
+
+		CheckContents(allocator, uploader, live);
+		if (failures > 0)
+		{
+			std::printf("Failed in sequence with seed %u at step %u\n", seed, step);
+			return;
+		}
+	}
+}
+
+int main()
+{
+	RemovalWaitsForFence();
+	CompactionClosesGaps();
+	GrowsWhenFull();
+
+	for (unsigned int seed = 1; seed <= 10; seed++)
+		RandomSequence(2000, seed);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All geometry allocator tests passed\n");
+	return 0;
+}
@@ -294,8 +294,9 @@ LRESULT Window::ProcessMessage(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPara
 		windowWidth = LOWORD(lParam);
 		windowHeight = HIWORD(lParam);
 
-		// Let other systems know
-		Graphics::ResizeBuffers(windowWidth, windowHeight);
+		// Let other systems know - the callback resizes the
+		// graphics buffers itself, since the render thread
+		// has to be idle before the swap chain changes
 		if (onResize)
 			onResize();
 
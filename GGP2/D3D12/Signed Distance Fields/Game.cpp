@@ -344,17 +344,10 @@ void Game::CreateGeometry()
 
 void Game::CreateOutputTexture(unsigned int width, unsigned int height)
 {
-	// Reset
-	ComputeOutputTexture.Reset();
+	// Release the old one (its heap space is reused once the GPU is done with it)
+	Graphics::ReleasePlacedResource(ComputeOutputTexture);
 
 	// Create the texture
-	D3D12_HEAP_PROPERTIES props = {};
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.CreationNodeMask = 1;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.VisibleNodeMask = 1;
-
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Alignment = 0;
 	desc.DepthOrArraySize = 1;
@@ -368,13 +361,10 @@ void Game::CreateOutputTexture(unsigned int width, unsigned int height)
 	desc.SampleDesc.Quality = 0;
 	desc.Width = width;
 
-	Graphics::Device->CreateCommittedResource(
-		&props,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-		0,
-		IID_PPV_ARGS(ComputeOutputTexture.GetAddressOf()));
+	ComputeOutputTexture = Graphics::CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
 	// Reserve a slot (only once)
 	if (!ComputeOutputCPUHandle.ptr && !ComputeOutputGPUHandle.ptr)
@@ -460,14 +460,6 @@ void RayTracing::CreateShaderTables()
 // --------------------------------------------------------
 void RayTracing::CreateRaytracingOutputUAV(unsigned int width, unsigned int height)
 {
-	// Default heap for output buffer
-	D3D12_HEAP_PROPERTIES heapDesc = {};
-	heapDesc.Type = D3D12_HEAP_TYPE_DEFAULT;
-	heapDesc.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapDesc.CreationNodeMask = 0;
-	heapDesc.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapDesc.VisibleNodeMask = 0;
-
 	// Describe the final output resource (UAV)
 	D3D12_RESOURCE_DESC desc = {};
 	desc.DepthOrArraySize = 1;
@@ -481,13 +473,11 @@ void RayTracing::CreateRaytracingOutputUAV(unsigned int width, unsigned int heig
 	desc.SampleDesc.Count = 1;
 	desc.SampleDesc.Quality = 0;
 
-	DXRDevice->CreateCommittedResource(
-		&heapDesc,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COMMON,
-		0,
-		IID_PPV_ARGS(RaytracingOutput.GetAddressOf()));
+	// Placed in one of the default texture heaps
+	RaytracingOutput = Graphics::CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_COMMON);
 
 	// Do we have a UAV alrady?
 	if (!RaytracingOutputUAV_GPU.ptr)
@@ -523,8 +513,8 @@ void RayTracing::ResizeOutputUAV(
 	// Wait for the GPU to be done
 	Graphics::WaitForGPU();
 
-	// Reset and re-created the buffer
-	RaytracingOutput.Reset();
+	// Release and re-create the buffer
+	Graphics::ReleasePlacedResource(RaytracingOutput);
 	CreateRaytracingOutputUAV(outputWidth, outputHeight);
 }
 
@@ -636,6 +626,9 @@ MeshRayTracingData RayTracing::CreateBottomLevelAccelerationStructureForMesh(Mes
 	Graphics::WaitForGPU();
 	Graphics::ResetAllocatorAndCommandList(0);
 
+	// The scratch buffer was only needed for the build
+	Graphics::ReleasePlacedResource(BLASScratchBuffer);
+
 	// Pass back the raytracing data for this mesh
 	return rayTracingData;
 }
@@ -695,8 +688,8 @@ void RayTracing::CreateTopLevelAccelerationStructureForScene(std::shared_ptr<Gam
 	// there ourselves (and keep the pointer long enough to finish the work)
 	if (sizeof(D3D12_RAYTRACING_INSTANCE_DESC) > tlasInstanceDataSizeInBytes[frameIndex])
 	{
-		// Reset and save the new size
-		TLASInstanceDescBuffer[frameIndex].Reset();
+		// Release (once the GPU is done with it) and save the new size
+		Graphics::ReleasePlacedResource(TLASInstanceDescBuffer[frameIndex]);
 		tlasInstanceDataSizeInBytes[frameIndex] = sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
 
 		// Create a new buffer to hold instance descriptions on the GPU
@@ -730,8 +723,8 @@ void RayTracing::CreateTopLevelAccelerationStructureForScene(std::shared_ptr<Gam
 	// Create a scratch buffer so the device has a place to temporarily store data
 	if (accelStructPrebuildInfo.ScratchDataSizeInBytes > tlasScratchSizeInBytes)
 	{
-		// Reset and save current size
-		TLASScratchBuffer.Reset();
+		// Release (once the GPU is done with it) and save current size
+		Graphics::ReleasePlacedResource(TLASScratchBuffer);
 		tlasScratchSizeInBytes = accelStructPrebuildInfo.ScratchDataSizeInBytes;
 
 		// Create the new buffer
@@ -746,7 +739,7 @@ void RayTracing::CreateTopLevelAccelerationStructureForScene(std::shared_ptr<Gam
 	if (accelStructPrebuildInfo.ResultDataMaxSizeInBytes > tlasBufferSizeInBytes)
 	{
 		// Create a new tlas buffer
-		TLAS.Reset();
+		Graphics::ReleasePlacedResource(TLAS);
 		tlasBufferSizeInBytes = accelStructPrebuildInfo.ResultDataMaxSizeInBytes;
 
 		TLAS = Graphics::CreateBuffer(
@@ -102,9 +102,9 @@ void RayTracing::CreateEntityDataBuffer(std::vector<std::shared_ptr<GameEntity>>
 	// How big will the buffer actually need to be?
 	UINT64 bufferSize = sizeof(RayTracingEntityData) * entityData.size();
 
-	// Reset the buffer if necessary, then create 
+	// Release the buffer if necessary, then create 
 	// the new one and copy into it
-	EntityDataStructuredBuffer.Reset();
+	Graphics::ReleasePlacedResource(EntityDataStructuredBuffer);
 	EntityDataStructuredBuffer = Graphics::CreateBuffer(
 		bufferSize,
 		D3D12_HEAP_TYPE_DEFAULT,
@@ -413,14 +413,6 @@ void RayTracing::CreateShaderTables()
 // --------------------------------------------------------
 void RayTracing::CreateRaytracingOutputUAV(unsigned int width, unsigned int height)
 {
-	// Default heap for output buffer
-	D3D12_HEAP_PROPERTIES heapDesc = {};
-	heapDesc.Type = D3D12_HEAP_TYPE_DEFAULT;
-	heapDesc.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	heapDesc.CreationNodeMask = 0;
-	heapDesc.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-	heapDesc.VisibleNodeMask = 0;
-
 	// Describe the final output resource (UAV)
 	D3D12_RESOURCE_DESC desc = {};
 	desc.DepthOrArraySize = 1;
@@ -434,13 +426,11 @@ void RayTracing::CreateRaytracingOutputUAV(unsigned int width, unsigned int heig
 	desc.SampleDesc.Count = 1;
 	desc.SampleDesc.Quality = 0;
 
-	DXRDevice->CreateCommittedResource(
-		&heapDesc,
-		D3D12_HEAP_FLAG_NONE,
-		&desc,
-		D3D12_RESOURCE_STATE_COMMON,
-		0,
-		IID_PPV_ARGS(RaytracingOutput.GetAddressOf()));
+	// Placed in one of the default texture heaps
+	RaytracingOutput = Graphics::CreatePlacedResource(
+		D3D12_HEAP_TYPE_DEFAULT,
+		desc,
+		D3D12_RESOURCE_STATE_COMMON);
 
 	// Do we have a UAV alrady?
 	if (!RaytracingOutputUAV_GPU.ptr)
@@ -476,8 +466,8 @@ void RayTracing::ResizeOutputUAV(
 	// Wait for the GPU to be done
 	Graphics::WaitForGPU();
 
-	// Reset and re-created the buffer
-	RaytracingOutput.Reset();
+	// Release and re-create the buffer
+	Graphics::ReleasePlacedResource(RaytracingOutput);
 	CreateRaytracingOutputUAV(outputWidth, outputHeight);
 }
 
@@ -586,6 +576,9 @@ MeshRayTracingData RayTracing::CreateBottomLevelAccelerationStructureForMesh(Mes
 	Graphics::WaitForGPU();
 	Graphics::ResetAllocatorAndCommandList(0);
 
+	// The scratch buffer was only needed for the build
+	Graphics::ReleasePlacedResource(BLASScratchBuffer);
+
 	// Pass back the raytracing data for this mesh
 	return rayTracingData;
 }
@@ -631,7 +624,7 @@ void RayTracing::CreateTopLevelAccelerationStructureForScene(std::vector<std::sh
 	{
 		// Create a new buffer to hold instance descriptions, since they
 		// need to actually be on the GPU
-		TLASInstanceDescBuffer[frameIndex].Reset();
+		Graphics::ReleasePlacedResource(TLASInstanceDescBuffer[frameIndex]);
 		tlasInstanceDataSizeInBytes[frameIndex] = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * instanceDescs.size();
 
 		TLASInstanceDescBuffer[frameIndex] = Graphics::CreateBuffer(
@@ -665,7 +658,7 @@ void RayTracing::CreateTopLevelAccelerationStructureForScene(std::vector<std::sh
 	if (accelStructPrebuildInfo.ScratchDataSizeInBytes > tlasScratchSizeInBytes)
 	{
 		// Create a new scratch buffer
-		TLASScratchBuffer.Reset();
+		Graphics::ReleasePlacedResource(TLASScratchBuffer);
 		tlasScratchSizeInBytes = accelStructPrebuildInfo.ScratchDataSizeInBytes;
 
 		TLASScratchBuffer = Graphics::CreateBuffer(
@@ -680,7 +673,7 @@ void RayTracing::CreateTopLevelAccelerationStructureForScene(std::vector<std::sh
 	if (accelStructPrebuildInfo.ResultDataMaxSizeInBytes > tlasBufferSizeInBytes)
 	{
 		// Create a new tlas buffer
-		TLAS.Reset();
+		Graphics::ReleasePlacedResource(TLAS);
 		tlasBufferSizeInBytes = accelStructPrebuildInfo.ResultDataMaxSizeInBytes;
 
 		TLAS = Graphics::CreateBuffer(
@@ -0,0 +1,260 @@
+#include "PlacedResourceHeaps.h"
+
+#include <algorithm>
+
+// --------------------------------------------------------
+// Sets up (empty) pools for each category of resource.
+// No heaps are created until something needs placing.
+//
+// device   - Device to create heaps and resources with
+// heapSize - Size of each standard (non-dedicated) heap
+// --------------------------------------------------------
+PlacedResourceHeaps::PlacedResourceHeaps(Microsoft::WRL::ComPtr<ID3D12Device> device, UINT64 heapSize) :
+	device(device),
+	heapSize(heapSize),
+	pools{
+		{ "Default Buffers", D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT },
+		{ "Default Textures", D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT },
+		{ "Default RT/DS Textures", D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT },
+		{ "Default MSAA Textures", D3D12_HEAP_TYPE_DEFAULT, D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES, D3D12_DEFAULT_MSAA_RESOURCE_PLACEMENT_ALIGNMENT },
+		{ "Upload Buffers", D3D12_HEAP_TYPE_UPLOAD, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT },
+		{ "Readback Buffers", D3D12_HEAP_TYPE_READBACK, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT },
+	}
+{
+}
+
+UINT64 PlacedResourceHeaps::GetHeapSize() const { return heapSize; }
+
+
+// --------------------------------------------------------
+// Which pool does a resource belong in?  Upload and readback
+// heaps only ever hold buffers, while default heaps are split
+// by what tier 1 hardware allows to share a heap
+// --------------------------------------------------------
+unsigned int PlacedResourceHeaps::ChoosePool(D3D12_HEAP_TYPE heapType, const D3D12_RESOURCE_DESC& desc)
+{
+	bool isTexture = desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER;
+	bool isRTDS = (desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0;
+
+	if (heapType == D3D12_HEAP_TYPE_UPLOAD) return POOL_UPLOAD_BUFFERS;
+	if (heapType == D3D12_HEAP_TYPE_READBACK) return POOL_READBACK_BUFFERS;
+	if (isTexture && desc.SampleDesc.Count > 1) return POOL_DEFAULT_MSAA_TEXTURES;
+	if (isTexture && isRTDS) return POOL_DEFAULT_RT_DS_TEXTURES;
+	if (isTexture) return POOL_DEFAULT_TEXTURES;
+	return POOL_DEFAULT_BUFFERS;
+}
+
+
+// --------------------------------------------------------
+// Creates a resource placed within one of the pool's heaps.
+// The heap's TLSF allocator picks the spot, and a new heap
+// is created when no existing heap in the pool has room.
+// Returns null if the heap or resource can't be created.
+//
+// heapType     - Default, upload or readback
+// desc         - Description of the resource to create
+// initialState - The resource's starting state
+// clearValue   - Optimized clear value for render targets (or null)
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D12Resource> PlacedResourceHeaps::Create(
+	D3D12_HEAP_TYPE heapType,
+	const D3D12_RESOURCE_DESC& desc,
+	D3D12_RESOURCE_STATES initialState,
+	const D3D12_CLEAR_VALUE* clearValue)
+{
+	unsigned int poolIndex = ChoosePool(heapType, desc);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	HeapPool& pool = pools[poolIndex];
+
+	// Small textures can use a tighter alignment, so ask for that first
+	// and fall back to the default if the device says no
+	D3D12_RESOURCE_DESC placedDesc = desc;
+	D3D12_RESOURCE_ALLOCATION_INFO info{};
+	if (poolIndex == POOL_DEFAULT_TEXTURES)
+	{
+		placedDesc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+		info = device->GetResourceAllocationInfo(0, 1, &placedDesc);
+		if (info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+			placedDesc.Alignment = 0;
+	}
+	if (placedDesc.Alignment == 0)
+		info = device->GetResourceAllocationInfo(0, 1, &placedDesc);
+
+	// Find a heap in this pool with room for the resource
+	PlacedHeap* heap = 0;
+	TLSFAllocation allocation;
+	for (auto& h : pool.Heaps)
+	{
+		if (h->Dedicated)
+			continue;
+
+		allocation = h->Allocator.Allocate(info.SizeInBytes, info.Alignment);
+		if (allocation.IsValid())
+		{
+			heap = h.get();
+			break;
+		}
+	}
+
+	// No room anywhere, so make a new heap - either a standard
+	// sized one or a dedicated one if this resource is huge
+	if (!heap)
+	{
+		bool dedicated = info.SizeInBytes > heapSize;
+		UINT64 newHeapSize = dedicated ?
+			(info.SizeInBytes + pool.Alignment - 1) / pool.Alignment * pool.Alignment :
+			heapSize;
+
+		D3D12_HEAP_DESC heapDesc = {};
+		heapDesc.SizeInBytes = newHeapSize;
+		heapDesc.Alignment = pool.Alignment;
+		heapDesc.Flags = pool.Flags;
+		heapDesc.Properties.Type = pool.Type;
+		heapDesc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+		heapDesc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+		heapDesc.Properties.CreationNodeMask = 1;
+		heapDesc.Properties.VisibleNodeMask = 1;
+
+		std::unique_ptr<PlacedHeap> newHeap = std::make_unique<PlacedHeap>(newHeapSize);
+		newHeap->Dedicated = dedicated;
+		if (FAILED(device->CreateHeap(&heapDesc, IID_PPV_ARGS(newHeap->Heap.GetAddressOf()))))
+			return 0;
+
+		allocation = newHeap->Allocator.Allocate(info.SizeInBytes, info.Alignment);
+		heap = newHeap.get();
+		pool.Heaps.push_back(std::move(newHeap));
+	}
+
+	// Actually place the resource within the heap
+	Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+	HRESULT hr = device->CreatePlacedResource(
+		heap->Heap.Get(),
+		allocation.Offset,
+		&placedDesc,
+		initialState,
+		clearValue,
+		IID_PPV_ARGS(resource.GetAddressOf()));
+	if (FAILED(hr))
+	{
+		heap->Allocator.Free(allocation);
+		return 0;
+	}
+
+	// Remember where it lives for when it's released
+	allocations[resource.Get()] = { poolIndex, heap, allocation };
+	return resource;
+}
+
+
+// --------------------------------------------------------
+// Releases a placed resource (and resets the caller's ComPtr).
+// Its range in the heap is only reused once the GPU has
+// passed the given fence value, since it may still be in use.
+//
+// Note: Placed resources that are simply Reset() instead of
+//       released here keep their heap space until this
+//       object is destroyed.
+// --------------------------------------------------------
+void PlacedResourceHeaps::Release(Microsoft::WRL::ComPtr<ID3D12Resource>& resource, UINT64 fenceValue)
+{
+	if (!resource)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	pendingReleases.push_back({ fenceValue, resource });
+	resource.Reset();
+}
+
+
+// --------------------------------------------------------
+// Frees the heap ranges of any released resources the GPU
+// has finished with
+//
+// completedFenceValue - Latest fence value the GPU has passed
+// --------------------------------------------------------
+void PlacedResourceHeaps::ProcessPendingReleases(UINT64 completedFenceValue)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i = 0; i < pendingReleases.size();)
+	{
+		// Still potentially in use?
+		if (pendingReleases[i].FenceValue > completedFenceValue)
+		{
+			i++;
+			continue;
+		}
+
+		// Return the range to its heap's allocator
+		auto it = allocations.find(pendingReleases[i].Resource.Get());
+		if (it != allocations.end())
+		{
+			PlacedAllocation& placed = it->second;
+			placed.Heap->Allocator.Free(placed.Allocation);
+
+			// Dedicated heaps only ever hold one resource, so toss the heap, too
+			if (placed.Heap->Dedicated)
+			{
+				std::vector<std::unique_ptr<PlacedHeap>>& heaps = pools[placed.Pool].Heaps;
+				for (size_t h = 0; h < heaps.size(); h++)
+				{
+					if (heaps[h].get() == placed.Heap)
+					{
+						heaps.erase(heaps.begin() + h);
+						break;
+					}
+				}
+			}
+
+			allocations.erase(it);
+		}
+
+		// Swap-and-pop, which releases the resource itself
+		pendingReleases[i] = pendingReleases.back();
+		pendingReleases.pop_back();
+	}
+}
+
+
+// --------------------------------------------------------
+// Gathers usage, fragmentation and defragmentation details
+// for each pool of heaps
+// --------------------------------------------------------
+std::vector<HeapPoolReport> PlacedResourceHeaps::GetReports()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<HeapPoolReport> reports;
+	std::vector<TLSFMove> moves;
+	for (unsigned int p = 0; p < POOL_COUNT; p++)
+	{
+		HeapPoolReport report{};
+		report.Name = pools[p].Name;
+		report.HeapCount = (unsigned int)pools[p].Heaps.size();
+
+		// Sum the stats across all heaps in the pool
+		UINT64 freeSize = 0;
+		for (auto& h : pools[p].Heaps)
+		{
+			TLSFStats stats = h->Allocator.GetStats();
+			report.AllocationCount += stats.AllocationCount;
+			report.FreeBlockCount += stats.FreeBlockCount;
+			report.TotalSizeInBytes += stats.TotalSize;
+			report.UsedSizeInBytes += stats.UsedSize;
+			report.LargestFreeBlockInBytes = std::max<UINT64>(report.LargestFreeBlockInBytes, stats.LargestFreeBlock);
+			freeSize += stats.FreeSize;
+
+			// How many resources would need to move to compact this heap?
+			h->Allocator.BuildDefragmentationPlan(moves);
+			report.DefragMoveCount += (unsigned int)moves.size();
+			for (auto& m : moves)
+				report.DefragBytesToMove += m.Size;
+		}
+
+		report.Fragmentation = freeSize == 0 ? 0.0f :
+			1.0f - (float)((double)report.LargestFreeBlockInBytes / (double)freeSize);
+
+		reports.push_back(report);
+	}
+
+	return reports;
+}
@@ -0,0 +1,390 @@
+#include "TLSFAllocator.h"
+
+#include <bit>
+
+// Helper for rounding a value up to a multiple of alignment
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// --------------------------------------------------------
+// Creates an allocator that manages the offset range [0, size)
+// --------------------------------------------------------
+TLSFAllocator::TLSFAllocator(uint64_t size) :
+	size(size)
+{
+	Reset();
+}
+
+uint64_t TLSFAllocator::GetSize() const { return size; }
+
+
+// --------------------------------------------------------
+// Frees everything at once, returning the allocator to a
+// single free block covering the entire range
+// --------------------------------------------------------
+void TLSFAllocator::Reset()
+{
+	blocks.clear();
+	unusedBlockRecords.clear();
+	usedSize = 0;
+	allocationCount = 0;
+
+	// Clear all free lists
+	flBitmap = 0;
+	for (unsigned int fl = 0; fl < FLCount; fl++)
+	{
+		slBitmap[fl] = 0;
+		for (unsigned int sl = 0; sl < SLCount; sl++)
+			freeHeads[fl][sl] = TLSFInvalidIndex;
+	}
+
+	// One big free block to start
+	firstBlock = CreateBlockRecord(0, size);
+	InsertFreeBlock(firstBlock);
+}
+
+
+// --------------------------------------------------------
+// Finds space for the requested size at the requested
+// alignment.  Returns an invalid allocation if no free
+// block is large enough.
+//
+// size      - Size of the range to allocate
+// alignment - Required alignment of the offset (power of two not required)
+// --------------------------------------------------------
+TLSFAllocation TLSFAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+	if (size == 0) size = 1;
+	if (alignment == 0) alignment = 1;
+
+	// First look for a block big enough for just the size; if the
+	// one we find happens to be aligned (common when everything in
+	// the range shares an alignment) then we don't need to pad
+	unsigned int index = FindSuitableBlock(size);
+	if (index == TLSFInvalidIndex ||
+		AlignUp(blocks[index].Offset, alignment) + size > blocks[index].Offset + blocks[index].Size)
+	{
+		// Worst-case padding to guarantee an aligned fit
+		index = FindSuitableBlock(size + alignment - 1);
+		if (index == TLSFInvalidIndex)
+			return TLSFAllocation{};
+	}
+
+	RemoveFreeBlock(index);
+
+	// Split off any leading padding, which stays free
+	uint64_t padding = AlignUp(blocks[index].Offset, alignment) - blocks[index].Offset;
+	if (padding > 0)
+	{
+		unsigned int aligned = SplitBlock(index, padding);
+		InsertFreeBlock(index);
+		index = aligned;
+	}
+
+	// Split off the remainder, unless it's too tiny to be useful
+	if (blocks[index].Size - size >= MinBlockSize)
+	{
+		unsigned int remainder = SplitBlock(index, size);
+		InsertFreeBlock(remainder);
+	}
+
+	// Block is now in use
+	blocks[index].Free = false;
+	blocks[index].Alignment = alignment;
+	usedSize += blocks[index].Size;
+	allocationCount++;
+
+	TLSFAllocation alloc;
+	alloc.Offset = blocks[index].Offset;
+	alloc.Size = blocks[index].Size;
+	alloc.BlockIndex = index;
+	return alloc;
+}
+
+
+// --------------------------------------------------------
+// Returns an allocation's range to the allocator, merging
+// it with any free neighbors
+// --------------------------------------------------------
+void TLSFAllocator::Free(const TLSFAllocation& allocation)
+{
+	unsigned int index = allocation.BlockIndex;
+	if (index >= blocks.size() || !blocks[index].InUse || blocks[index].Free)
+		return;
+
+	usedSize -= blocks[index].Size;
+	allocationCount--;
+	blocks[index].Free = true;
+
+	// Merge with the next block if it's free
+	unsigned int next = blocks[index].NextPhysical;
+	if (next != TLSFInvalidIndex && blocks[next].Free)
+	{
+		RemoveFreeBlock(next);
+		MergeWithNext(index);
+	}
+
+	// Merge into the previous block if it's free
+	unsigned int prev = blocks[index].PrevPhysical;
+	if (prev != TLSFInvalidIndex && blocks[prev].Free)
+	{
+		RemoveFreeBlock(prev);
+		MergeWithNext(prev);
+		index = prev;
+	}
+
+	InsertFreeBlock(index);
+}
+
+
+// --------------------------------------------------------
+// Walks the entire range to gather overall statistics.
+// This is O(blocks), so it's meant for reporting, not for
+// calling on every allocation.
+// --------------------------------------------------------
+TLSFStats TLSFAllocator::GetStats() const
+{
+	TLSFStats stats;
+	stats.TotalSize = size;
+	stats.UsedSize = usedSize;
+	stats.FreeSize = size - usedSize;
+	stats.AllocationCount = allocationCount;
+
+	for (unsigned int i = firstBlock; i != TLSFInvalidIndex; i = blocks[i].NextPhysical)
+	{
+		if (!blocks[i].Free)
+			continue;
+
+		stats.FreeBlockCount++;
+		if (blocks[i].Size > stats.LargestFreeBlock)
+			stats.LargestFreeBlock = blocks[i].Size;
+	}
+
+	return stats;
+}
+
+
+// --------------------------------------------------------
+// Determines where each allocation would end up if the range
+// were compacted toward offset zero (preserving order and
+// alignment).  Only allocations that would actually move
+// are added to the list.
+// --------------------------------------------------------
+void TLSFAllocator::BuildDefragmentationPlan(std::vector<TLSFMove>& moves) const
+{
+	moves.clear();
+
+	uint64_t cursor = 0;
+	for (unsigned int i = firstBlock; i != TLSFInvalidIndex; i = blocks[i].NextPhysical)
+	{
+		if (blocks[i].Free)
+			continue;
+
+		uint64_t dest = AlignUp(cursor, blocks[i].Alignment);
+		if (dest != blocks[i].Offset)
+			moves.push_back({ i, blocks[i].Offset, dest, blocks[i].Size });
+
+		cursor = dest + blocks[i].Size;
+	}
+}
+
+
+// --------------------------------------------------------
+// Calculates the first and second level indices for the
+// free list that a block of the given size belongs in
+// --------------------------------------------------------
+void TLSFAllocator::Mapping(uint64_t size, unsigned int& fl, unsigned int& sl)
+{
+	if (size < SLCount)
+	{
+		// Small sizes all live in the first level, one list per size
+		fl = 0;
+		sl = (unsigned int)size;
+		return;
+	}
+
+	unsigned int log2 = (unsigned int)std::bit_width(size) - 1;
+	fl = log2 - SLBits + 1;
+	sl = (unsigned int)(size >> (log2 - SLBits)) - SLCount;
+}
+
+
+// --------------------------------------------------------
+// Like Mapping(), but rounds the size up to the next list
+// boundary first, so that ANY block found in the resulting
+// list is guaranteed to be large enough
+// --------------------------------------------------------
+void TLSFAllocator::MappingSearch(uint64_t size, unsigned int& fl, unsigned int& sl)
+{
+	if (size >= SLCount)
+	{
+		unsigned int log2 = (unsigned int)std::bit_width(size) - 1;
+		size += (1ull << (log2 - SLBits)) - 1;
+	}
+
+	Mapping(size, fl, sl);
+}
+
+
+// --------------------------------------------------------
+// Uses the bitmaps to find the first non-empty free list
+// that can hold the given size.  Returns the head of that
+// list, or an invalid index if nothing fits.
+// --------------------------------------------------------
+unsigned int TLSFAllocator::FindSuitableBlock(uint64_t size)
+{
+	unsigned int fl, sl;
+	MappingSearch(size, fl, sl);
+	if (fl >= FLCount)
+		return TLSFInvalidIndex;
+
+	// Any lists at this first level with large enough blocks?
+	uint32_t slMap = sl < SLCount ? slBitmap[fl] & (~0u << sl) : 0;
+	if (slMap == 0)
+	{
+		// Nope, so look at larger first levels
+		uint64_t flMap = fl + 1 < FLCount ? flBitmap & (~0ull << (fl + 1)) : 0;
+		if (flMap == 0)
+			return TLSFInvalidIndex;
+
+		fl = (unsigned int)std::countr_zero(flMap);
+		slMap = slBitmap[fl];
+	}
+
+	sl = (unsigned int)std::countr_zero(slMap);
+	return freeHeads[fl][sl];
+}
+
+
+// --------------------------------------------------------
+// Grabs a block record, recycling an old one if possible
+// --------------------------------------------------------
+unsigned int TLSFAllocator::CreateBlockRecord(uint64_t offset, uint64_t size)
+{
+	unsigned int index;
+	if (!unusedBlockRecords.empty())
+	{
+		index = unusedBlockRecords.back();
+		unusedBlockRecords.pop_back();
+	}
+	else
+	{
+		index = (unsigned int)blocks.size();
+		blocks.push_back({});
+	}
+
+	Block& b = blocks[index];
+	b.Offset = offset;
+	b.Size = size;
+	b.Alignment = 1;
+	b.PrevPhysical = TLSFInvalidIndex;
+	b.NextPhysical = TLSFInvalidIndex;
+	b.PrevFree = TLSFInvalidIndex;
+	b.NextFree = TLSFInvalidIndex;
+	b.Free = true;
+	b.InUse = true;
+	return index;
+}
+
+void TLSFAllocator::ReleaseBlockRecord(unsigned int index)
+{
+	blocks[index].InUse = false;
+	unusedBlockRecords.push_back(index);
+}
+
+
+// --------------------------------------------------------
+// Pushes a free block onto the front of its free list
+// --------------------------------------------------------
+void TLSFAllocator::InsertFreeBlock(unsigned int index)
+{
+	unsigned int fl, sl;
+	Mapping(blocks[index].Size, fl, sl);
+
+	unsigned int head = freeHeads[fl][sl];
+	blocks[index].Free = true;
+	blocks[index].PrevFree = TLSFInvalidIndex;
+	blocks[index].NextFree = head;
+	if (head != TLSFInvalidIndex)
+		blocks[head].PrevFree = index;
+
+	freeHeads[fl][sl] = index;
+	flBitmap |= 1ull << fl;
+	slBitmap[fl] |= 1u << sl;
+}
+
+
+// --------------------------------------------------------
+// Unlinks a free block from its free list, clearing the
+// bitmaps if that list is now empty
+// --------------------------------------------------------
+void TLSFAllocator::RemoveFreeBlock(unsigned int index)
+{
+	unsigned int fl, sl;
+	Mapping(blocks[index].Size, fl, sl);
+
+	unsigned int prev = blocks[index].PrevFree;
+	unsigned int next = blocks[index].NextFree;
+	if (prev != TLSFInvalidIndex) blocks[prev].NextFree = next;
+	if (next != TLSFInvalidIndex) blocks[next].PrevFree = prev;
+
+	if (freeHeads[fl][sl] == index)
+	{
+		freeHeads[fl][sl] = next;
+		if (next == TLSFInvalidIndex)
+		{
+			slBitmap[fl] &= ~(1u << sl);
+			if (slBitmap[fl] == 0)
+				flBitmap &= ~(1ull << fl);
+		}
+	}
+
+	blocks[index].PrevFree = TLSFInvalidIndex;
+	blocks[index].NextFree = TLSFInvalidIndex;
+}
+
+
+// --------------------------------------------------------
+// Shrinks the given block to the requested size and creates
+// a new block for the remainder, returning the new block's
+// index.  Neither block is placed in a free list here.
+// --------------------------------------------------------
+unsigned int TLSFAllocator::SplitBlock(unsigned int index, uint64_t size)
+{
+	unsigned int remainder = CreateBlockRecord(
+		blocks[index].Offset + size,
+		blocks[index].Size - size);
+
+	// Note: CreateBlockRecord() may have resized the vector, so
+	// we index into it again rather than holding a reference
+	blocks[index].Size = size;
+
+	unsigned int next = blocks[index].NextPhysical;
+	blocks[remainder].PrevPhysical = index;
+	blocks[remainder].NextPhysical = next;
+	if (next != TLSFInvalidIndex)
+		blocks[next].PrevPhysical = remainder;
+	blocks[index].NextPhysical = remainder;
+
+	return remainder;
+}
+
+
+// --------------------------------------------------------
+// Absorbs the physically-next block into the given block.
+// The next block must already be out of its free list.
+// --------------------------------------------------------
+void TLSFAllocator::MergeWithNext(unsigned int index)
+{
+	unsigned int next = blocks[index].NextPhysical;
+	blocks[index].Size += blocks[next].Size;
+
+	unsigned int nextNext = blocks[next].NextPhysical;
+	blocks[index].NextPhysical = nextNext;
+	if (nextNext != TLSFInvalidIndex)
+		blocks[nextNext].PrevPhysical = index;
+
+	ReleaseBlockRecord(next);
+}
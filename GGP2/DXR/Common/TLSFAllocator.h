@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// A Two-Level Segregated Fit (TLSF) range allocator.
+//
+// This class never touches actual memory - it simply hands
+// out offsets within a range of a given size.  That keeps it
+// completely API-agnostic, so the same policy can manage
+// D3D12 heaps, sub-ranges of a large buffer, etc.
+//
+// Allocation and freeing are both O(1): free blocks are
+// stored in lists bucketed by size (first level = power of
+// two, second level = linear subdivision of that power), and
+// two bitmaps let us find a suitable non-empty bucket with
+// a couple of bit scans.  Neighboring free blocks are merged
+// immediately when freed.
+//
+// It lives in Common so every demo can place its resources
+// with it (through PlacedResourceHeaps).  The standalone
+// tests and benchmark are in the D3D12 Common/Tests folder.
+// --------------------------------------------------------
+
+// Represents "no block" in block indices
+const unsigned int TLSFInvalidIndex = 0xFFFFFFFF;
+
+// Handle to a single allocation, returned by Allocate()
+struct TLSFAllocation
+{
+	uint64_t Offset = 0;
+	uint64_t Size = 0;
+	unsigned int BlockIndex = TLSFInvalidIndex;
+
+	bool IsValid() const { return BlockIndex != TLSFInvalidIndex; }
+};
+
+// Overall stats, useful for reporting fragmentation
+struct TLSFStats
+{
+	uint64_t TotalSize = 0;
+	uint64_t UsedSize = 0;
+	uint64_t FreeSize = 0;
+	uint64_t LargestFreeBlock = 0;
+	unsigned int AllocationCount = 0;
+	unsigned int FreeBlockCount = 0;
+
+	// 0 when all free space is one contiguous block, approaching 1
+	// as free space gets split into many small, unusable pieces
+	float Fragmentation() const
+	{
+		return FreeSize == 0 ? 0.0f : 1.0f - (float)((double)LargestFreeBlock / (double)FreeSize);
+	}
+};
+
+// A single step in a defragmentation plan: move the
+// allocation at SourceOffset down to DestOffset
+struct TLSFMove
+{
+	unsigned int BlockIndex;
+	uint64_t SourceOffset;
+	uint64_t DestOffset;
+	uint64_t Size;
+};
+
+class TLSFAllocator
+{
+public:
+	TLSFAllocator(uint64_t size);
+
+	TLSFAllocation Allocate(uint64_t size, uint64_t alignment = 1);
+	void Free(const TLSFAllocation& allocation);
+	void Reset();
+
+	uint64_t GetSize() const;
+	TLSFStats GetStats() const;
+
+	// Defragmentation reporting: builds the list of moves that would
+	// pack every allocation toward the start of the range, in order.
+	// Nothing is actually moved - the caller decides what to do with it.
+	void BuildDefragmentationPlan(std::vector<TLSFMove>& moves) const;
+
+private:
+	// Second level subdivisions (as a power of two)
+	static const unsigned int SLBits = 4;
+	static const unsigned int SLCount = 1 << SLBits;
+	static const unsigned int FLCount = 64;
+
+	// Smallest size we bother bucketing precisely
+	static const uint64_t MinBlockSize = 1 << SLBits;
+
+	struct Block
+	{
+		uint64_t Offset;
+		uint64_t Size;
+		uint64_t Alignment; // Alignment requested when allocated (for defrag planning)
+		unsigned int PrevPhysical;
+		unsigned int NextPhysical;
+		unsigned int PrevFree;
+		unsigned int NextFree;
+		bool Free;
+		bool InUse; // Is this record part of the range, or sitting in the unused record pool?
+	};
+
+	uint64_t size;
+	uint64_t usedSize;
+	unsigned int allocationCount;
+	unsigned int firstBlock; // Block at offset zero (start of the physical list)
+
+	// Block records and a list of unused records we can recycle
+	std::vector<Block> blocks;
+	std::vector<unsigned int> unusedBlockRecords;
+
+	// Free list heads and the bitmaps that summarize them
+	uint64_t flBitmap;
+	uint32_t slBitmap[FLCount];
+	unsigned int freeHeads[FLCount][SLCount];
+
+	// Helpers
+	static void Mapping(uint64_t size, unsigned int& fl, unsigned int& sl);
+	static void MappingSearch(uint64_t size, unsigned int& fl, unsigned int& sl);
+	unsigned int FindSuitableBlock(uint64_t size);
+	unsigned int CreateBlockRecord(uint64_t offset, uint64_t size);
+	void ReleaseBlockRecord(unsigned int index);
+	void InsertFreeBlock(unsigned int index);
+	void RemoveFreeBlock(unsigned int index);
+	unsigned int SplitBlock(unsigned int index, uint64_t size);
+	void MergeWithNext(unsigned int index);
+};
@@ -0,0 +1,185 @@
+#include "ChunkedTerrain.h"
+#include "TerrainGridLayout.h"
+
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+
+// --------------------------------------------------------
+// Builds the quadtree and the GPU resources for drawing it
+//
+// heightmap - Heights to draw (must stay the same size)
+// terrainVS - The patch vertex shader (TerrainVS)
+// device - DX device for resource creation
+// context - DX context for drawing
+// patchSize - Quads across each patch (a power of 2)
+// --------------------------------------------------------
+ChunkedTerrain::ChunkedTerrain(
+	std::shared_ptr<Heightmap> heightmap,
+	std::shared_ptr<SimpleVertexShader> terrainVS,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int patchSize)
+	:
+	heightmap(heightmap),
+	terrainVS(terrainVS),
+	device(device),
+	context(context),
+	patchSize(patchSize),
+	triangleCount(0),
+	quadrantIndexCount(0),
+	wireframe(false)
+{
+	quadtree.Build(*heightmap, patchSize);
+	this->patchSize = quadtree.GetPatchSize();
+
+	// Start with the closest LOD ranges that still hide all seams
+	lodSettings.DetailDistance = quadtree.GetMinimumDetailDistance();
+	lodSettings.MorphStartRatio = 0.66f;
+
+	CreateHeightTexture();
+	CreatePatchGrid();
+
+	D3D11_RASTERIZER_DESC rastDesc = {};
+	rastDesc.FillMode = D3D11_FILL_WIREFRAME;
+	rastDesc.CullMode = D3D11_CULL_BACK;
+	rastDesc.DepthClipEnable = true;
+	device->CreateRasterizerState(&rastDesc, wireframeState.GetAddressOf());
+}
+
+
+// --------------------------------------------------------
+// Copies the heights into a single-channel float texture
+// --------------------------------------------------------
+void ChunkedTerrain::CreateHeightTexture()
+{
+	D3D11_TEXTURE2D_DESC texDesc = {};
+	texDesc.Width = heightmap->GetWidth();
+	texDesc.Height = heightmap->GetHeight();
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = heightmap->GetData();
+	data.SysMemPitch = sizeof(float) * heightmap->GetWidth();
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	device->CreateTexture2D(&texDesc, &data, texture.GetAddressOf());
+	device->CreateShaderResourceView(texture.Get(), 0, heightSRV.GetAddressOf());
+
+	// Bilinear, so morphing vertices (which sit between grid
+	// points) follow the surface smoothly
+	D3D11_SAMPLER_DESC sampDesc = {};
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	device->CreateSamplerState(&sampDesc, heightSampler.GetAddressOf());
+}
+
+
+// --------------------------------------------------------
+// Creates the grid every patch is drawn with: a vertex per
+// grid point (just its integer coordinates), and triangles
+// arranged like TerrainMesh's, in Morton order.  That keeps
+// the vertex cache warm, and since the patch is a power of
+// 2 across, each quarter of the indices is one quadrant.
+// The vertices are stored in the order they're first used.
+// --------------------------------------------------------
+void ChunkedTerrain::CreatePatchGrid()
+{
+	unsigned int pointsAcross = patchSize + 1;
+	std::vector<unsigned int> indices;
+	std::vector<unsigned int> vertexOrder;
+	BuildTerrainGridIndices(pointsAcross, pointsAcross, TerrainGridOrder::Morton, indices, &vertexOrder);
+	quadrantIndexCount = (unsigned int)indices.size() / 4;
+
+	std::vector<XMFLOAT2> verts;
+	for (unsigned int v : vertexOrder)
+		verts.push_back(XMFLOAT2((float)(v % pointsAcross), (float)(v / pointsAcross)));
+
+	D3D11_BUFFER_DESC vbd = {};
+	vbd.Usage = D3D11_USAGE_IMMUTABLE;
+	vbd.ByteWidth = sizeof(XMFLOAT2) * (unsigned int)verts.size();
+	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA initialVertexData = {};
+	initialVertexData.pSysMem = verts.data();
+	device->CreateBuffer(&vbd, &initialVertexData, gridVB.GetAddressOf());
+
+	D3D11_BUFFER_DESC ibd = {};
+	ibd.Usage = D3D11_USAGE_IMMUTABLE;
+	ibd.ByteWidth = sizeof(unsigned int) * (unsigned int)indices.size();
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA initialIndexData = {};
+	initialIndexData.pSysMem = indices.data();
+	device->CreateBuffer(&ibd, &initialIndexData, gridIB.GetAddressOf());
+}
+
+
+// --------------------------------------------------------
+// Picks the patches (frustum culled against the camera)
+// and draws each one as all or a quarter of the grid
+// --------------------------------------------------------
+void ChunkedTerrain::Draw(std::shared_ptr<Camera> camera, std::shared_ptr<Material> material)
+{
+	XMFLOAT4X4 view = camera->GetView();
+	XMFLOAT4X4 proj = camera->GetProjection();
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj)));
+	TerrainFrustum frustum = TerrainFrustum::FromViewProjection(&viewProj._11);
+
+	XMFLOAT3 cameraPos = camera->GetTransform()->GetPosition();
+	quadtree.Select(&cameraPos.x, &frustum, lodSettings, patches);
+
+	// Pixel shader and textures from the material, then our own vertex shader
+	Transform identity;
+	material->PrepareMaterial(&identity, camera);
+
+	terrainVS->SetShader();
+	terrainVS->SetMatrix4x4("view", view);
+	terrainVS->SetMatrix4x4("projection", proj);
+	terrainVS->SetFloat3("cameraPosition", cameraPos);
+	terrainVS->SetFloat("xzScale", heightmap->GetXZScale());
+	terrainVS->SetFloat2("heightmapSize", XMFLOAT2((float)heightmap->GetWidth(), (float)heightmap->GetHeight()));
+	terrainVS->SetFloat("patchGridSize", (float)patchSize);
+	terrainVS->CopyBufferData("ExternalData");
+	terrainVS->SetShaderResourceView("Heightmap", heightSRV);
+	terrainVS->SetSamplerState("HeightSampler", heightSampler);
+
+	UINT stride = sizeof(XMFLOAT2);
+	UINT offset = 0;
+	context->IASetVertexBuffers(0, 1, gridVB.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(gridIB.Get(), DXGI_FORMAT_R32_UINT, 0);
+	if (wireframe)
+		context->RSSetState(wireframeState.Get());
+
+	triangleCount = 0;
+	for (auto& patch : patches)
+	{
+		terrainVS->SetFloat2("patchOrigin", XMFLOAT2((float)patch.X, (float)patch.Z));
+		terrainVS->SetFloat("patchScale", (float)(1u << patch.LOD));
+		terrainVS->SetFloat2("morphRange", XMFLOAT2(patch.MorphStart, patch.MorphEnd));
+		terrainVS->CopyBufferData("PerPatch");
+
+		// Whole grid, or one quadrant's range of it
+		unsigned int indexCount = patch.Quadrant < 0 ? quadrantIndexCount * 4 : quadrantIndexCount;
+		unsigned int firstIndex = patch.Quadrant < 0 ? 0 : quadrantIndexCount * patch.Quadrant;
+		context->DrawIndexed(indexCount, firstIndex, 0);
+		triangleCount += indexCount / 3;
+	}
+
+	if (wireframe)
+		context->RSSetState(0);
+}
+
+TerrainLODSettings& ChunkedTerrain::GetLODSettings() { return lodSettings; }
+void ChunkedTerrain::SetWireframe(bool wireframe) { this->wireframe = wireframe; }
+bool ChunkedTerrain::GetWireframe() { return wireframe; }
+unsigned int ChunkedTerrain::GetPatchCount() { return (unsigned int)patches.size(); }
+unsigned int ChunkedTerrain::GetTriangleCount() { return triangleCount; }
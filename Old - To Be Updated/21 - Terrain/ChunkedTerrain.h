@@ -0,0 +1,72 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+
+#include "Camera.h"
+#include "Heightmap.h"
+#include "Material.h"
+#include "SimpleShader.h"
+#include "TerrainQuadtree.h"
+
+// --------------------------------------------------------
+// Draws a heightmap with chunked LOD (see TerrainQuadtree).
+//
+// Rather than one huge mesh, there's a single small grid of
+// patchSize x patchSize quads, drawn once per selected patch.
+// The heights live in a texture, which the vertex shader
+// (TerrainVS) reads to place and morph each vertex, so the
+// same grid works for every patch at every LOD.
+// --------------------------------------------------------
+class ChunkedTerrain
+{
+public:
+	ChunkedTerrain(
+		std::shared_ptr<Heightmap> heightmap,
+		std::shared_ptr<SimpleVertexShader> terrainVS,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int patchSize = 32);
+
+	// Selects this frame's patches and draws them with the material's
+	// pixel shader and textures (its vertex shader is replaced)
+	void Draw(std::shared_ptr<Camera> camera, std::shared_ptr<Material> material);
+
+	TerrainLODSettings& GetLODSettings();
+	void SetWireframe(bool wireframe);
+	bool GetWireframe();
+
+	// Stats from the last Draw()
+	unsigned int GetPatchCount();
+	unsigned int GetTriangleCount();
+
+private:
+	void CreateHeightTexture();
+	void CreatePatchGrid();
+
+	std::shared_ptr<Heightmap> heightmap;
+	TerrainQuadtree quadtree;
+	TerrainLODSettings lodSettings;
+	std::vector<TerrainPatch> patches;
+	unsigned int patchSize;
+	unsigned int triangleCount;
+
+	// The shared patch grid.  Indices are ordered one quadrant
+	// at a time, so each quarter is a contiguous range.
+	Microsoft::WRL::ComPtr<ID3D11Buffer> gridVB;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> gridIB;
+	unsigned int quadrantIndexCount;
+
+	// Heights, one float per grid point
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> heightSRV;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> heightSampler;
+
+	bool wireframe;
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> wireframeState;
+
+	std::shared_ptr<SimpleVertexShader> terrainVS;
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+};
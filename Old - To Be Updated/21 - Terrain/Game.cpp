@@ -2,13 +2,16 @@
 #include "Vertex.h"
 #include "Input.h"
 #include "Assets.h"
+#include "TerrainGenerator.h"
 #include "TerrainMesh.h"
+#include "TerrainOcclusionBaker.h"
 #include "PathHelpers.h"
 
 #include "WICTextureLoader.h"
 
 #include <stdlib.h>     // For seeding random and rand()
 #include <time.h>       // For grabbing time (to seed random)
+#include <cmath>
 
 
 // Needed for a helper function to read compiled shader files from the hard drive
@@ -21,15 +24,23 @@ using namespace DirectX;
 // Helper macro for getting a float between min and max
 #define RandomRange(min, max) (float)rand() / RAND_MAX * (max - min) + min
 
+// Direction of the first light, which the terrain's shadows are baked for
+static const XMFLOAT3 SunDirection(1, -1, 1);
+
+// Roughly how far the tree model's trunk spreads at its base
+static const float TreeBaseRadius = 1.5f;
+
 // --------------------------------------------------------
 // Constructor
 //
 // DXCore (base class) constructor will set up underlying fields.
 // DirectX itself, and our window, are not ready yet!
 //
-// hInstance - the application's OS-level handle (unique ID)
+// hInstance       - the application's OS-level handle (unique ID)
+// generateTerrain - generate the terrain's heights rather than
+//                   loading them from the heightmap asset
 // --------------------------------------------------------
-Game::Game(HINSTANCE hInstance)
+Game::Game(HINSTANCE hInstance, bool generateTerrain)
 	: DXCore(
 		hInstance,			// The application's handle
 		L"DirectX Game",	// Text for the window's title bar (as a wide-character string)
@@ -39,7 +50,11 @@ Game::Game(HINSTANCE hInstance)
 		true),				// Show extra stats (fps) in title bar?
 	ambientColor(0, 0, 0), // Ambient is zero'd out since it's not physically-based
 	lightCount(3),
-	drawLights(true)
+	drawLights(true),
+	generateTerrain(generateTerrain),
+	terrainDrawMode(TerrainDrawMode::LODPatches),
+	useTerrainVirtualTexture(false),
+	keepCameraAboveTerrain(true)
 {
 
 #if defined(DEBUG) || defined(_DEBUG)
@@ -93,9 +108,10 @@ void Game::Init()
 		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	}
 
-	// Create the camera
+	// Create the camera, a little above the terrain
+	TerrainPlacement cameraStart = terrainPlacer->Place(0.0f, -200.0f);
 	camera = std::make_shared<Camera>(
-		0.0f, 30.0f, -200.0f,	// Position
+		0.0f, cameraStart.Position.y + 10.0f, -200.0f,	// Position
 		5.0f,				// Move speed
 		0.002f,				// Look speed
 		XM_PIDIV4,			// Field of view
@@ -146,18 +162,68 @@ void Game::LoadAssetsAndCreateEntities()
 		context);
 
 
-	// Load terrain mesh
+	// Load terrain heights
 	// Note: You need to know the bit-depth of the heightmap, as well as
 	//       the pixel dimensions, since RAW files do not contain this
 	//       information!  If you get it wrong, things won't look right!
-	std::shared_ptr<TerrainMesh> terrainMesh = std::make_shared<TerrainMesh>(
-		device,
-		FixPath(L"../../../Assets/Heightmaps/terrain_513x513.r16").c_str(),
-		513,
-		513,
-		TerrainBitDepth::BitDepth_16,
-		100.0f,
-		0.75f);
+	std::shared_ptr<Heightmap> heightmap = std::make_shared<Heightmap>();
+	if (!generateTerrain)
+	{
+		heightmap->Load(
+			FixPath(L"../../../Assets/Heightmaps/terrain_513x513.r16"),
+			513,
+			513,
+			TerrainBitDepth::BitDepth_16,
+			100.0f,
+			0.75f);
+	}
+	else
+	{
+		// Or generate the same size and height range: warped fBm
+		// hills, worn down a little by erosion
+		GenerateHeightmap(
+			*heightmap,
+			513,
+			513,
+			{ .Seed = 1234, .Octaves = 7, .Frequency = 1.0f / 256, .Lacunarity = 2.0f, .Gain = 0.5f, .Ridged = false,
+			  .WarpStrength = 40.0f, .WarpFrequency = 1.0f / 512, .WarpOctaves = 3, .HeightScale = 100.0f },
+			{ .ThermalIterations = 20, .TalusSlope = 0.6f, .ThermalRate = 0.4f,
+			  .HydraulicIterations = 30, .Rain = 0.01f, .Solubility = 0.05f, .Capacity = 0.05f, .Evaporation = 0.1f },
+			0.75f);
+	}
+
+	// The whole terrain as one mesh, in Hilbert order for the vertex cache
+	std::shared_ptr<TerrainMesh> terrainMesh = std::make_shared<TerrainMesh>(device, *heightmap, TerrainGridOrder::Hilbert);
+
+	// The same heights, drawn with chunked LOD
+	terrain = std::make_shared<ChunkedTerrain>(heightmap, assets.GetVertexShader(L"TerrainVS"), device, context);
+	terrainHeightfield = std::make_shared<Heightfield>(heightmap);
+	terrainPlacer = std::make_shared<TerrainPlacer>(terrainHeightfield);
+
+	// And packed down to a height (and normal) per vertex
+	packedTerrain = std::make_shared<PackedTerrain>(heightmap, FixPath(L"PackedTerrainVS.cso"), device, context);
+
+	// And as a tiled heightmap (converted the first time), streamed in around the camera
+	std::wstring tiledHeightmapPath = FixPath(generateTerrain ? L"generated_513x513.thm" : L"terrain_513x513.thm");
+	if (generateTerrain)
+	{
+		// Regenerated every run, so it always matches the settings above
+		TiledHeightmap::ConvertHeightmap(*heightmap, tiledHeightmapPath, 64, 100.0f);
+	}
+	else if (!std::filesystem::exists(tiledHeightmapPath))
+	{
+		TiledHeightmap::ConvertRaw(
+			FixPath(L"../../../Assets/Heightmaps/terrain_513x513.r16"),
+			513,
+			513,
+			TerrainBitDepth::BitDepth_16,
+			tiledHeightmapPath,
+			64,
+			100.0f,
+			0.75f);
+	}
+	terrainStreamer = std::make_shared<TerrainStreamer>();
+	terrainStreamer->Open(tiledHeightmapPath, { .Radius = 50.0f, .Budget = 512 * 1024 });
 	
 	// Create terrain material
 	std::shared_ptr<SimpleVertexShader> vertexShader = assets.GetVertexShader(L"VertexShader");
@@ -181,10 +247,118 @@ void Game::LoadAssetsAndCreateEntities()
 	terrainMat->AddTextureSRV("NormalMap2", assets.GetTexture(L"Textures/PBR/rock_normals"));
 	terrainMat->AddTextureSRV("RoughnessMap2", assets.GetTexture(L"Textures/PBR/rock_roughness"));
 	terrainMat->AddTextureSRV("MetalMap2", assets.GetTexture(L"Textures/PBR/rock_metal"));
+	terrainSplatMat = terrainMat;
 
+	// The same material, blended ahead of time on the CPU into pages of a
+	// virtual texture (baked around the camera as it moves)
+	{
+		std::shared_ptr<TerrainSplatCompositor> compositor = std::make_shared<TerrainSplatCompositor>();
+		compositor->SetBlendMap(TerrainVirtualTexture::ReadTexture(terrainMat->GetTextureSRV("BlendMap"), device, context));
+		for (int i = 0; i < 3; i++)
+		{
+			std::string index = std::to_string(i);
+			TerrainSplatLayer layer;
+			layer.Albedo = TerrainVirtualTexture::ReadTexture(terrainMat->GetTextureSRV("Albedo" + index), device, context);
+			layer.Normals = TerrainVirtualTexture::ReadTexture(terrainMat->GetTextureSRV("NormalMap" + index), device, context);
+			layer.Roughness = TerrainVirtualTexture::ReadTexture(terrainMat->GetTextureSRV("RoughnessMap" + index), device, context);
+			layer.Metal = TerrainVirtualTexture::ReadTexture(terrainMat->GetTextureSRV("MetalMap" + index), device, context);
+			compositor->AddLayer(layer);
+		}
 
-	std::shared_ptr<GameEntity> terrain = std::make_shared<GameEntity>(terrainMesh, terrainMat);
-	entities.push_back(terrain);
+		XMFLOAT2 uvScale = terrainMat->GetUVScale();
+		XMFLOAT2 uvOffset = terrainMat->GetUVOffset();
+		compositor->SetUVTransform(uvScale.x, uvScale.y, uvOffset.x, uvOffset.y);
+
+		terrainPages = std::make_shared<TerrainPageCache>();
+		terrainPages->Init(compositor, *heightmap, {
+			.PageSize = 128,
+			.PageBorder = 4,
+			.PagesAcross = 64,
+			.LevelCount = 7,
+			.AtlasPagesAcross = 16,
+			.LevelDistance = 16.0f,
+			.MaxBakesPerUpdate = 4 });
+		terrainVirtualTexture = std::make_shared<TerrainVirtualTexture>(terrainPages, device, context);
+
+		terrainVirtualMat = std::make_shared<Material>(assets.GetPixelShader(L"TerrainVirtualPS"), vertexShader, XMFLOAT3(1, 1, 1));
+		terrainVirtualMat->AddSampler("BasicSampler", sampler);
+		terrainVirtualTexture->AddToMaterial(terrainVirtualMat);
+	}
+
+	// Bake ambient occlusion and sun shadows from the heights
+	{
+		TerrainOcclusionBaker occlusionBaker;
+		occlusionBaker.Bake(*heightmap, { .DirectionCount = 16, .MaxDistance = 100.0f, .SunDirection = SunDirection, .ShadowSoftness = 0.05f });
+
+		D3D11_TEXTURE2D_DESC texDesc = {};
+		texDesc.Width = occlusionBaker.GetWidth();
+		texDesc.Height = occlusionBaker.GetHeight();
+		texDesc.MipLevels = 1;
+		texDesc.ArraySize = 1;
+		texDesc.Format = DXGI_FORMAT_R8G8_UNORM;
+		texDesc.SampleDesc.Count = 1;
+		texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		D3D11_SUBRESOURCE_DATA data = {};
+		data.pSysMem = occlusionBaker.GetTexels().data();
+		data.SysMemPitch = 2 * occlusionBaker.GetWidth();
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> occlusionTexture;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> occlusionSRV;
+		device->CreateTexture2D(&texDesc, &data, occlusionTexture.GetAddressOf());
+		device->CreateShaderResourceView(occlusionTexture.Get(), 0, occlusionSRV.GetAddressOf());
+		terrainMat->AddTextureSRV("OcclusionMap", occlusionSRV);
+		terrainVirtualMat->AddTextureSRV("OcclusionMap", occlusionSRV);
+	}
+
+
+	terrainEntity = std::make_shared<GameEntity>(terrainMesh, terrainMat);
+
+	// Scatter trees across the lower, gentler parts of the terrain
+	{
+		std::shared_ptr<SimplePixelShader> pbrPS = assets.GetPixelShader(L"PixelShaderPBR");
+		std::shared_ptr<Material> barkMat = std::make_shared<Material>(pbrPS, vertexShader, XMFLOAT3(1, 1, 1), XMFLOAT2(2, 1));
+		barkMat->AddSampler("BasicSampler", sampler);
+		barkMat->AddTextureSRV("Albedo", assets.GetTexture(L"Textures/bark_albedo"));
+		barkMat->AddTextureSRV("NormalMap", assets.GetTexture(L"Textures/PBR/rough_normals"));
+		barkMat->AddTextureSRV("RoughnessMap", assets.GetTexture(L"Textures/PBR/rough_roughness"));
+		barkMat->AddTextureSRV("MetalMap", assets.GetTexture(L"Textures/PBR/paint_metal"));
+
+		std::shared_ptr<Material> leafMat = std::make_shared<Material>(pbrPS, vertexShader, XMFLOAT3(1, 1, 1));
+		leafMat->AddSampler("BasicSampler", sampler);
+		leafMat->AddTextureSRV("Albedo", assets.GetTexture(L"Textures/leaves_albedo"));
+		leafMat->AddTextureSRV("NormalMap", assets.GetTexture(L"Textures/leaves_normals"));
+		leafMat->AddTextureSRV("RoughnessMap", assets.GetTexture(L"Textures/leaves_rough"));
+		leafMat->AddTextureSRV("MetalMap", assets.GetTexture(L"Textures/PBR/paint_metal"));
+
+		std::shared_ptr<Mesh> trunkMesh = assets.GetMesh(L"Models/tree_trunk");
+		std::shared_ptr<Mesh> leafMesh = assets.GetMesh(L"Models/tree_leaves");
+		std::vector<TerrainPlacement> trees = terrainPlacer->Scatter({
+			.Spacing = 10.0f,
+			.MinHeight = 2.0f,
+			.MaxHeight = 40.0f,
+			.MaxSlope = XM_PI / 6,
+			.Attempts = 30,
+			.Seed = 1 });
+		for (const TerrainPlacement& tree : trees)
+		{
+			// Sunk far enough that the uphill side of the trunk's base is buried
+			float scale = RandomRange(0.8f, 1.3f);
+			float slope = std::sqrt(1.0f - tree.Normal.y * tree.Normal.y) / tree.Normal.y;
+			float sink = TreeBaseRadius * scale * slope;
+			float yaw = RandomRange(0.0f, XM_2PI);
+
+			for (std::shared_ptr<Mesh> mesh : { trunkMesh, leafMesh })
+			{
+				std::shared_ptr<GameEntity> entity = std::make_shared<GameEntity>(mesh, mesh == trunkMesh ? barkMat : leafMat);
+				entity->GetTransform()->SetScale(scale);
+				entity->GetTransform()->SetRotation(0, yaw, 0);
+				entity->GetTransform()->SetPosition(tree.Position.x, tree.Position.y - sink, tree.Position.z);
+				entities.push_back(entity);
+			}
+		}
+	}
 }
 
 
@@ -196,7 +370,7 @@ void Game::GenerateLights()
 	// Setup directional lights
 	Light dir1 = {};
 	dir1.Type = LIGHT_TYPE_DIRECTIONAL;
-	dir1.Direction = XMFLOAT3(1, -1, 1);
+	dir1.Direction = SunDirection;
 	dir1.Color = XMFLOAT3(1, 1, 1);
 	dir1.Intensity = 1.0f;
 
@@ -217,12 +391,18 @@ void Game::GenerateLights()
 	lights.push_back(dir2);
 	lights.push_back(dir3);
 
-	// Create the rest of the lights
-	while (lights.size() < MAX_LIGHTS)
+	// Create the rest of the lights, floating above the terrain
+	std::vector<XMFLOAT2> lightSpots(MAX_LIGHTS - lights.size());
+	for (XMFLOAT2& spot : lightSpots)
+		spot = XMFLOAT2(RandomRange(-200.0f, 200.0f), RandomRange(-200.0f, 200.0f));
+
+	std::vector<TerrainPlacement> ground(lightSpots.size());
+	terrainPlacer->Place(lightSpots.data(), ground.data(), lightSpots.size());
+	for (const TerrainPlacement& spot : ground)
 	{
 		Light point = {};
 		point.Type = LIGHT_TYPE_POINT;
-		point.Position = XMFLOAT3(RandomRange(-200.0f, 200.0f), RandomRange(0.0f, 20.0f), RandomRange(-200.0f, 200.0f));
+		point.Position = XMFLOAT3(spot.Position.x, spot.Position.y + RandomRange(2.0f, 20.0f), spot.Position.z);
 		point.Color = XMFLOAT3(RandomRange(0, 1), RandomRange(0, 1), RandomRange(0, 1));
 		point.Range = RandomRange(50.0f, 100.0f);
 		point.Intensity = RandomRange(0.1f, 3.0f);
@@ -275,6 +455,40 @@ void Game::Update(float deltaTime, float totalTime)
 	if (input.KeyDown(VK_DOWN)) lightCount--;
 	lightCount = max(1, min(MAX_LIGHTS, lightCount));
 
+	// Terrain options
+	if (input.KeyPress('T')) terrainDrawMode = (TerrainDrawMode)(((int)terrainDrawMode + 1) % 3);
+	if (input.KeyPress('G')) terrain->SetWireframe(!terrain->GetWireframe());
+	if (input.KeyPress('F')) keepCameraAboveTerrain = !keepCameraAboveTerrain;
+	if (input.KeyPress('V'))
+	{
+		useTerrainVirtualTexture = !useTerrainVirtualTexture;
+		terrainEntity->SetMaterial(useTerrainVirtualTexture ? terrainVirtualMat : terrainSplatMat);
+	}
+
+	// Don't let the camera go underground
+	if (keepCameraAboveTerrain)
+	{
+		XMFLOAT3 pos = camera->GetTransform()->GetPosition();
+		float minHeight = terrainHeightfield->GetHeight(pos.x, pos.z) + 1.0f;
+		if (pos.y < minHeight)
+		{
+			camera->GetTransform()->SetPosition(pos.x, minHeight, pos.z);
+			camera->UpdateViewMatrix();
+		}
+	}
+
+	// Stream in the terrain tiles around the camera
+	XMFLOAT3 cameraPos = camera->GetTransform()->GetPosition();
+	terrainStreamer->Update(&cameraPos.x);
+
+	// Queue the virtual texture pages the camera needs for baking, and upload
+	// the ones baked since last frame (only while it's in use)
+	if (useTerrainVirtualTexture)
+	{
+		terrainPages->Update(&cameraPos.x);
+		terrainVirtualTexture->Upload();
+	}
+
 	// Move lights
 	for (int i = 0; i < lightCount; i++)
 	{
@@ -320,6 +534,22 @@ void Game::Draw(float deltaTime, float totalTime)
 		e->Draw(context, camera);
 	}
 
+	// Draw the terrain, as LOD patches, the whole mesh or packed chunks
+	{
+		std::shared_ptr<Material> terrainMat = terrainEntity->GetMaterial();
+		std::shared_ptr<SimplePixelShader> ps = terrainMat->GetPixelShader();
+		ps->SetFloat3("ambientColor", ambientColor);
+		ps->SetData("lights", &lights[0], sizeof(Light) * (int)lights.size());
+		ps->SetInt("lightCount", lightCount);
+
+		switch (terrainDrawMode)
+		{
+		case TerrainDrawMode::LODPatches: terrain->Draw(camera, terrainMat); break;
+		case TerrainDrawMode::FullMesh: terrainEntity->Draw(context, camera); break;
+		case TerrainDrawMode::PackedChunks: packedTerrain->Draw(camera, terrainMat); break;
+		}
+	}
+
 	// Draw the sky after all regular entities
 	sky->Draw(camera);
 
@@ -436,6 +666,55 @@ void Game::DrawUI()
 	fontArial12->DrawString(spriteBatch.get(), L" (TAB) Randomize lights", XMVectorSet(10, h + 80, 0, 0));
 	fontArial12->DrawString(spriteBatch.get(), L" (R) Reset light count", XMVectorSet(10, h + 100, 0, 0));
 	fontArial12->DrawString(spriteBatch.get(), L" (L) Draw lights", XMVectorSet(10, h + 120, 0, 0));
+	fontArial12->DrawString(spriteBatch.get(), L" (T) Cycle terrain drawing (LOD patches, full mesh, packed chunks)", XMVectorSet(10, h + 140, 0, 0));
+	fontArial12->DrawString(spriteBatch.get(), L" (G) Toggle terrain wireframe", XMVectorSet(10, h + 160, 0, 0));
+	fontArial12->DrawString(spriteBatch.get(), L" (F) Toggle keeping the camera above the terrain", XMVectorSet(10, h + 180, 0, 0));
+	fontArial12->DrawString(spriteBatch.get(), L" (V) Toggle the terrain's virtual texture (pre-blended splat layers)", XMVectorSet(10, h + 200, 0, 0));
+
+	// Terrain stats
+	const PackedTerrainChunks& packedChunks = packedTerrain->GetChunks();
+	std::wstring terrainStats;
+	switch (terrainDrawMode)
+	{
+	case TerrainDrawMode::LODPatches:
+		terrainStats = L"Terrain LOD: " + std::to_wstring(terrain->GetPatchCount()) + L" patches, " + std::to_wstring(terrain->GetTriangleCount()) + L" triangles";
+		break;
+	case TerrainDrawMode::FullMesh:
+		terrainStats = L"Terrain LOD: off (full mesh, " + std::to_wstring(terrainEntity->GetMesh()->GetIndexCount() / 3) + L" triangles, " +
+			std::to_wstring(packedChunks.GetMeshSize() / 1024) + L" KB)";
+		break;
+	case TerrainDrawMode::PackedChunks:
+		terrainStats = L"Terrain LOD: off (packed, " + std::to_wstring(packedTerrain->GetDrawnChunkCount()) + L" of " +
+			std::to_wstring(packedChunks.GetChunks().size()) + L" chunks, " + std::to_wstring(packedChunks.GetPackedSize() / 1024) + L" KB)";
+		break;
+	}
+	fontArial12->DrawString(spriteBatch.get(), terrainStats.c_str(), XMVectorSet(10, h + 220, 0, 0));
+
+	TerrainStreamingStats streamingStats = terrainStreamer->GetStats();
+	std::wstring streamingText =
+		L"Terrain streaming: " + std::to_wstring(streamingStats.ResidentTiles) + L" tiles (" +
+		std::to_wstring(streamingStats.ResidentBytes / 1024) + L" KB), " +
+		std::to_wstring(streamingStats.PendingTiles) + L" pending, fetch avg " +
+		std::to_wstring(streamingStats.AverageFetchMs) + L" ms";
+	fontArial12->DrawString(spriteBatch.get(), streamingText.c_str(), XMVectorSet(10, h + 240, 0, 0));
+
+	TerrainPageCacheStats pageStats = terrainPages->GetStats();
+	std::wstring textureText = !useTerrainVirtualTexture ? L"Terrain texture: splat layers" :
+		L"Terrain texture: virtual, " + std::to_wstring(pageStats.ResidentPages) + L" pages resident, " +
+		std::to_wstring(pageStats.PendingPages) + L" pending, bake avg " +
+		std::to_wstring(pageStats.AverageBakeMs) + L" ms";
+	fontArial12->DrawString(spriteBatch.get(), textureText.c_str(), XMVectorSet(10, h + 260, 0, 0));
+
+	// What the camera is looking at
+	HeightfieldRay lookRay = {};
+	lookRay.Origin = camera->GetTransform()->GetPosition();
+	lookRay.Direction = camera->GetTransform()->GetForward();
+	lookRay.MaxDistance = camera->GetFarClip();
+	HeightfieldHit lookHit = terrainHeightfield->Raycast(lookRay);
+	std::wstring lookText = lookHit.Hit ?
+		L"Looking at terrain " + std::to_wstring((int)lookHit.Distance) + L" units away, at height " + std::to_wstring((int)lookHit.Position.y) :
+		L"Looking at terrain: none";
+	fontArial12->DrawString(spriteBatch.get(), lookText.c_str(), XMVectorSet(10, h + 280, 0, 0));
 	
 
 	spriteBatch->End();
@@ -8,6 +8,12 @@
 #include "SimpleShader.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "ChunkedTerrain.h"
+#include "Heightfield.h"
+#include "PackedTerrain.h"
+#include "TerrainPlacer.h"
+#include "TerrainStreamer.h"
+#include "TerrainVirtualTexture.h"
 
 #include "SpriteBatch.h"
 #include "SpriteFont.h"
@@ -16,12 +22,20 @@
 #include <DirectXMath.h>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 
+// Ways of drawing the terrain, cycled with T
+enum class TerrainDrawMode
+{
+	LODPatches,
+	FullMesh,
+	PackedChunks
+};
+
 class Game 
 	: public DXCore
 {
 
 public:
-	Game(HINSTANCE hInstance);
+	Game(HINSTANCE hInstance, bool generateTerrain = false);
 	~Game();
 
 	// Overridden setup and game loop methods, which
@@ -50,6 +64,29 @@ private:
 	// Scene
 	std::vector<std::shared_ptr<GameEntity>> entities;
 
+	// Terrain, drawn with chunked LOD, as one full mesh or as packed chunks,
+	// from the heightmap asset or (started with -generate) procedural heights
+	bool generateTerrain;
+	std::shared_ptr<ChunkedTerrain> terrain;
+	std::shared_ptr<GameEntity> terrainEntity;
+	std::shared_ptr<PackedTerrain> packedTerrain;
+	TerrainDrawMode terrainDrawMode;
+
+	// The terrain's splat material, and the same material pre-blended into virtual texture pages
+	std::shared_ptr<Material> terrainSplatMat;
+	std::shared_ptr<Material> terrainVirtualMat;
+	std::shared_ptr<TerrainPageCache> terrainPages;
+	std::shared_ptr<TerrainVirtualTexture> terrainVirtualTexture;
+	bool useTerrainVirtualTexture;
+
+	// Height and raycast queries against the terrain, and batched placement on it
+	std::shared_ptr<Heightfield> terrainHeightfield;
+	std::shared_ptr<TerrainPlacer> terrainPlacer;
+	bool keepCameraAboveTerrain;
+
+	// Tiles of the terrain around the camera, streamed from a tiled heightmap
+	std::shared_ptr<TerrainStreamer> terrainStreamer;
+
 	// Lights
 	std::vector<Light> lights;
 	DirectX::XMFLOAT3 ambientColor;
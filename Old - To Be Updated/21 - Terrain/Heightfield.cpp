@@ -0,0 +1,478 @@
+#include "Heightfield.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+using namespace DirectX;
+
+// Positions below this many aren't worth another thread
+static const size_t MinPositionsPerThread = 16 * 1024;
+
+
+// --------------------------------------------------------
+// Stores each grid point's height alongside its normal,
+// from the heights on either side (one-sided at the edges,
+// like BuildHeightfieldVertices), then builds the pyramid
+// of maximum heights for raycasts
+// --------------------------------------------------------
+Heightfield::Heightfield(std::shared_ptr<Heightmap> heightmap) :
+	heightmap(heightmap),
+	width(heightmap->GetWidth()),
+	height(heightmap->GetHeight()),
+	xzScale(heightmap->GetXZScale())
+{
+	if (width < 2 || height < 2)
+		return;
+
+	surface.resize((size_t)width * height * 4);
+	for (unsigned int z = 0; z < height; z++)
+	{
+		unsigned int down = z > 0 ? z - 1 : 0;
+		unsigned int up = std::min(z + 1, height - 1);
+		for (unsigned int x = 0; x < width; x++)
+		{
+			unsigned int left = x > 0 ? x - 1 : 0;
+			unsigned int right = std::min(x + 1, width - 1);
+
+			float slopeX = (heightmap->GetValue(right, z) - heightmap->GetValue(left, z)) / ((right - left) * xzScale);
+			float slopeZ = (heightmap->GetValue(x, up) - heightmap->GetValue(x, down)) / ((up - down) * xzScale);
+			float scale = 1.0f / std::sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+
+			float* point = &surface[((size_t)z * width + x) * 4];
+			point[0] = heightmap->GetValue(x, z);
+			point[1] = -slopeX * scale;
+			point[2] = scale;
+			point[3] = -slopeZ * scale;
+		}
+	}
+
+	// Level 0: the highest corner of each grid square
+	unsigned int squaresX = width - 1;
+	unsigned int squaresZ = height - 1;
+	std::vector<float> level(squaresX * squaresZ);
+	for (unsigned int z = 0; z < squaresZ; z++)
+	{
+		for (unsigned int x = 0; x < squaresX; x++)
+		{
+			level[z * squaresX + x] = std::max(
+				std::max(heightmap->GetValue(x, z), heightmap->GetValue(x + 1, z)),
+				std::max(heightmap->GetValue(x, z + 1), heightmap->GetValue(x + 1, z + 1)));
+		}
+	}
+	maxHeights.push_back(std::move(level));
+	levelWidths.push_back(squaresX);
+	levelHeights.push_back(squaresZ);
+
+	// Each level after: the highest of (up to) 2x2 squares of the last
+	while (squaresX > 1 || squaresZ > 1)
+	{
+		const std::vector<float>& below = maxHeights.back();
+		unsigned int belowX = squaresX;
+		unsigned int belowZ = squaresZ;
+		squaresX = (squaresX + 1) / 2;
+		squaresZ = (squaresZ + 1) / 2;
+
+		std::vector<float> next(squaresX * squaresZ);
+		for (unsigned int z = 0; z < squaresZ; z++)
+		{
+			unsigned int z0 = z * 2;
+			unsigned int z1 = std::min(z0 + 1, belowZ - 1);
+			for (unsigned int x = 0; x < squaresX; x++)
+			{
+				unsigned int x0 = x * 2;
+				unsigned int x1 = std::min(x0 + 1, belowX - 1);
+				next[z * squaresX + x] = std::max(
+					std::max(below[z0 * belowX + x0], below[z0 * belowX + x1]),
+					std::max(below[z1 * belowX + x0], below[z1 * belowX + x1]));
+			}
+		}
+		maxHeights.push_back(std::move(next));
+		levelWidths.push_back(squaresX);
+		levelHeights.push_back(squaresZ);
+	}
+}
+
+std::shared_ptr<Heightmap> Heightfield::GetHeightmap() const { return heightmap; }
+unsigned int Heightfield::GetLevelCount() const { return (unsigned int)maxHeights.size(); }
+
+// Height of a grid point, clamped to the map
+float Heightfield::GetPoint(int x, int z) const
+{
+	x = std::clamp(x, 0, (int)width - 1);
+	z = std::clamp(z, 0, (int)height - 1);
+	return heightmap->GetValue(x, z);
+}
+
+XMFLOAT3 Heightfield::GetPointNormal(unsigned int x, unsigned int z) const
+{
+	const float* point = &surface[((size_t)z * width + x) * 4];
+	return XMFLOAT3(point[1], point[2], point[3]);
+}
+
+
+// --------------------------------------------------------
+// Samples four positions at once:
+//  - Their grid squares and bilinear weights are worked out
+//    side by side
+//  - Each one's four corners are loaded (height and normal
+//    together) and weighted
+//  - The results are transposed back to heights, normal x,
+//    y and z, so the normals are normalized side by side
+// --------------------------------------------------------
+void Heightfield::SampleGroup(const XMFLOAT2* positions, float* heights, XMFLOAT3* normals) const
+{
+	// Pull the x's and z's apart
+	__m128 xz01 = _mm_loadu_ps(&positions[0].x);
+	__m128 xz23 = _mm_loadu_ps(&positions[2].x);
+	__m128 x = _mm_shuffle_ps(xz01, xz23, _MM_SHUFFLE(2, 0, 2, 0));
+	__m128 z = _mm_shuffle_ps(xz01, xz23, _MM_SHUFFLE(3, 1, 3, 1));
+
+	// Grid space, clamped to the map (the clamps also turn NaNs into 0)
+	__m128 scale = _mm_set1_ps(xzScale);
+	__m128 zero = _mm_setzero_ps();
+	__m128 gridX = _mm_add_ps(_mm_div_ps(x, scale), _mm_set1_ps(width / 2.0f));
+	__m128 gridZ = _mm_add_ps(_mm_div_ps(z, scale), _mm_set1_ps(height / 2.0f));
+	gridX = _mm_min_ps(_mm_max_ps(gridX, zero), _mm_set1_ps(width - 1.0f));
+	gridZ = _mm_min_ps(_mm_max_ps(gridZ, zero), _mm_set1_ps(height - 1.0f));
+
+	// Corner of each grid square (the last square at the far edges) and the weights within it
+	__m128 cornerX = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gridX)), _mm_set1_ps(width - 2.0f));
+	__m128 cornerZ = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gridZ)), _mm_set1_ps(height - 2.0f));
+	__m128 fx = _mm_sub_ps(gridX, cornerX);
+	__m128 fz = _mm_sub_ps(gridZ, cornerZ);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 gx = _mm_sub_ps(one, fx);
+	__m128 gz = _mm_sub_ps(one, fz);
+
+	alignas(16) float corners[2][4];
+	alignas(16) float weights[4][4];
+	_mm_store_ps(corners[0], cornerX);
+	_mm_store_ps(corners[1], cornerZ);
+	_mm_store_ps(weights[0], _mm_mul_ps(gx, gz));
+	_mm_store_ps(weights[1], _mm_mul_ps(fx, gz));
+	_mm_store_ps(weights[2], _mm_mul_ps(gx, fz));
+	_mm_store_ps(weights[3], _mm_mul_ps(fx, fz));
+
+	__m128 results[4];
+	size_t rowStride = (size_t)width * 4;
+	for (int i = 0; i < 4; i++)
+	{
+		const float* corner = &surface[((size_t)corners[1][i] * width + (size_t)corners[0][i]) * 4];
+		__m128 result = _mm_mul_ps(_mm_loadu_ps(corner), _mm_set1_ps(weights[0][i]));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(corner + 4), _mm_set1_ps(weights[1][i])));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(corner + rowStride), _mm_set1_ps(weights[2][i])));
+		result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(corner + rowStride + 4), _mm_set1_ps(weights[3][i])));
+		results[i] = result;
+	}
+
+	// Now heights, then normal x, y and z
+	_MM_TRANSPOSE4_PS(results[0], results[1], results[2], results[3]);
+	__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(results[1], results[1]),
+		_mm_mul_ps(results[2], results[2])),
+		_mm_mul_ps(results[3], results[3])));
+
+	alignas(16) float out[3][4];
+	_mm_storeu_ps(heights, results[0]);
+	_mm_store_ps(out[0], _mm_div_ps(results[1], length));
+	_mm_store_ps(out[1], _mm_div_ps(results[2], length));
+	_mm_store_ps(out[2], _mm_div_ps(results[3], length));
+	for (int i = 0; i < 4; i++)
+		normals[i] = XMFLOAT3(out[0][i], out[1][i], out[2][i]);
+}
+
+// --------------------------------------------------------
+// Samples one position, with the same steps as SampleGroup
+// (so it gets exactly the same answers), but just the one
+// position's corners, as height and normal together
+// --------------------------------------------------------
+XMFLOAT4 Heightfield::SamplePoint(float worldX, float worldZ) const
+{
+	if (surface.empty())
+		return XMFLOAT4(0, 0, 1, 0);
+
+	// Grid space, clamped to the map (written so NaNs become 0, like _mm_max_ps)
+	float gridX = worldX / xzScale + width / 2.0f;
+	float gridZ = worldZ / xzScale + height / 2.0f;
+	gridX = gridX > 0.0f ? gridX : 0.0f;
+	gridZ = gridZ > 0.0f ? gridZ : 0.0f;
+	gridX = std::min(gridX, width - 1.0f);
+	gridZ = std::min(gridZ, height - 1.0f);
+
+	float cornerX = std::min((float)(int)gridX, width - 2.0f);
+	float cornerZ = std::min((float)(int)gridZ, height - 2.0f);
+	float fx = gridX - cornerX;
+	float fz = gridZ - cornerZ;
+	float gx = 1.0f - fx;
+	float gz = 1.0f - fz;
+
+	const float* corner = &surface[((size_t)cornerZ * width + (size_t)cornerX) * 4];
+	size_t rowStride = (size_t)width * 4;
+	__m128 result = _mm_mul_ps(_mm_loadu_ps(corner), _mm_set1_ps(gx * gz));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(corner + 4), _mm_set1_ps(fx * gz)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(corner + rowStride), _mm_set1_ps(gx * fz)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_loadu_ps(corner + rowStride + 4), _mm_set1_ps(fx * fz)));
+
+	alignas(16) float sample[4];
+	_mm_store_ps(sample, result);
+	float length = std::sqrt(sample[1] * sample[1] + sample[2] * sample[2] + sample[3] * sample[3]);
+	return XMFLOAT4(sample[0], sample[1] / length, sample[2] / length, sample[3] / length);
+}
+
+// --------------------------------------------------------
+// Samples a range four at a time, and any left over one at
+// a time.  Either output can be 0 if it isn't wanted.
+// --------------------------------------------------------
+void Heightfield::SampleRange(const XMFLOAT2* positions, float* heights, XMFLOAT3* normals, size_t count) const
+{
+	size_t i = 0;
+	if (!surface.empty())
+	{
+		for (; i + 4 <= count; i += 4)
+		{
+			float groupHeights[4];
+			XMFLOAT3 groupNormals[4];
+			SampleGroup(positions + i, groupHeights, groupNormals);
+			if (heights)
+				std::copy(groupHeights, groupHeights + 4, heights + i);
+			if (normals)
+				std::copy(groupNormals, groupNormals + 4, normals + i);
+		}
+	}
+
+	for (; i < count; i++)
+	{
+		XMFLOAT4 sample = SamplePoint(positions[i].x, positions[i].y);
+		if (heights)
+			heights[i] = sample.x;
+		if (normals)
+			normals[i] = XMFLOAT3(sample.y, sample.z, sample.w);
+	}
+}
+
+
+float Heightfield::GetHeight(float worldX, float worldZ) const
+{
+	return SamplePoint(worldX, worldZ).x;
+}
+
+XMFLOAT3 Heightfield::GetNormal(float worldX, float worldZ) const
+{
+	XMFLOAT4 sample = SamplePoint(worldX, worldZ);
+	return XMFLOAT3(sample.y, sample.z, sample.w);
+}
+
+
+// --------------------------------------------------------
+// Finds where a ray first hits the terrain by marching
+// through the pyramid of maximum heights:
+//  - If the ray stays above a square's maximum, skip to
+//    where it leaves the square, and climb back up to the
+//    largest square it has just entered
+//  - Otherwise, look at the square's four children instead
+//  - At the bottom level, intersect the square's bilinear
+//    surface exactly
+//
+// The march works in grid space (x and z in grid points,
+// y in world units), with t in world units along the ray.
+// --------------------------------------------------------
+HeightfieldHit Heightfield::Raycast(const HeightfieldRay& ray) const
+{
+	HeightfieldHit hit = {};
+	double length = std::sqrt(
+		(double)ray.Direction.x * ray.Direction.x +
+		(double)ray.Direction.y * ray.Direction.y +
+		(double)ray.Direction.z * ray.Direction.z);
+	if (maxHeights.empty() || length == 0.0)
+		return hit;
+
+	double origin[3] = { ray.Origin.x / xzScale + width / 2.0, ray.Origin.y, ray.Origin.z / xzScale + height / 2.0 };
+	double direction[3] = { ray.Direction.x / length / xzScale, ray.Direction.y / length, ray.Direction.z / length / xzScale };
+
+	// Only the part of the ray over the map matters
+	double tStart = 0.0;
+	double tEnd = ray.MaxDistance;
+	double extents[3] = { width - 1.0, 0.0, height - 1.0 };
+	for (int axis = 0; axis < 3; axis += 2)
+	{
+		if (direction[axis] == 0.0)
+		{
+			if (origin[axis] < 0.0 || origin[axis] > extents[axis])
+				return hit;
+			continue;
+		}
+
+		double t0 = (0.0 - origin[axis]) / direction[axis];
+		double t1 = (extents[axis] - origin[axis]) / direction[axis];
+		tStart = std::max(tStart, std::min(t0, t1));
+		tEnd = std::min(tEnd, std::max(t0, t1));
+	}
+	if (tStart > tEnd)
+		return hit;
+
+	// Which square at a level holds a grid space position
+	auto squareAt = [](double position, unsigned int level, unsigned int count)
+		{
+			double square = std::floor(position / (1u << level));
+			return (unsigned int)std::clamp(square, 0.0, count - 1.0);
+		};
+
+	// Steps past square edges are nudged a tiny distance
+	// further, so the next square is always a new one
+	double nudge = 1e-7 / std::max({ std::abs(direction[0]), std::abs(direction[2]), 1e-7 });
+
+	unsigned int top = (unsigned int)maxHeights.size() - 1;
+	unsigned int level = top;
+	double t = tStart;
+	unsigned int steps = 0;
+	unsigned int maxSteps = 4 * (width + height) * (top + 1);
+	while (t <= tEnd && steps++ < maxSteps)
+	{
+		double x = origin[0] + direction[0] * t;
+		double z = origin[2] + direction[2] * t;
+		unsigned int squareX = squareAt(x, level, levelWidths[level]);
+		unsigned int squareZ = squareAt(z, level, levelHeights[level]);
+
+		// Where the ray leaves this square
+		double size = (double)(1u << level);
+		double tExit = tEnd;
+		if (direction[0] != 0.0)
+			tExit = std::min(tExit, ((direction[0] > 0 ? squareX + 1 : squareX) * size - origin[0]) / direction[0]);
+		if (direction[2] != 0.0)
+			tExit = std::min(tExit, ((direction[2] > 0 ? squareZ + 1 : squareZ) * size - origin[2]) / direction[2]);
+		tExit = std::max(tExit, t);
+
+		// Lowest the ray gets over the square
+		double lowest = origin[1] + direction[1] * (direction[1] < 0 ? tExit : t);
+		bool below = lowest <= maxHeights[level][squareZ * levelWidths[level] + squareX];
+		if (below && level > 0)
+		{
+			level--;
+			continue;
+		}
+
+		double tHit;
+		if (below && IntersectSquare(squareX, squareZ, origin, direction, t, tExit, tHit))
+		{
+			XMFLOAT3 position(
+				ray.Origin.x + (float)(ray.Direction.x / length * tHit),
+				ray.Origin.y + (float)(ray.Direction.y / length * tHit),
+				ray.Origin.z + (float)(ray.Direction.z / length * tHit));
+
+			hit.Hit = true;
+			hit.Distance = (float)tHit;
+			hit.Position = position;
+			hit.Normal = GetNormal(position.x, position.z);
+			return hit;
+		}
+
+		// Move on, then climb while the ray is in a new parent square
+		t = tExit + nudge;
+		unsigned int nextX = squareAt(origin[0] + direction[0] * t, level, levelWidths[level]);
+		unsigned int nextZ = squareAt(origin[2] + direction[2] * t, level, levelHeights[level]);
+		while (level < top && ((squareX >> 1) != (nextX >> 1) || (squareZ >> 1) != (nextZ >> 1)))
+		{
+			squareX >>= 1;
+			squareZ >>= 1;
+			nextX >>= 1;
+			nextZ >>= 1;
+			level++;
+		}
+	}
+
+	return hit;
+}
+
+// --------------------------------------------------------
+// Intersects a ray (in grid space) with the bilinear surface
+// of one grid square, between tStart and tEnd.  Along the
+// ray, the height above the surface is a quadratic in t.
+// A ray already below the surface hits at tStart.
+// --------------------------------------------------------
+bool Heightfield::IntersectSquare(unsigned int x, unsigned int z, const double origin[3], const double direction[3], double tStart, double tEnd, double& tHit) const
+{
+	// Surface: h(u, v) = a + b*u + c*v + d*u*v within the square
+	double h00 = GetPoint(x, z);
+	double h10 = GetPoint(x + 1, z);
+	double h01 = GetPoint(x, z + 1);
+	double h11 = GetPoint(x + 1, z + 1);
+	double a = h00;
+	double b = h10 - h00;
+	double c = h01 - h00;
+	double d = h00 - h10 - h01 + h11;
+
+	// Ray from tStart, relative to the square's corner
+	double u = origin[0] + direction[0] * tStart - x;
+	double v = origin[2] + direction[2] * tStart - z;
+	double y = origin[1] + direction[1] * tStart;
+	double du = direction[0];
+	double dv = direction[2];
+
+	// Height above the surface at tStart + s: qa*s^2 + qb*s + qc
+	double qa = -d * du * dv;
+	double qb = direction[1] - b * du - c * dv - d * (u * dv + v * du);
+	double qc = y - (a + b * u + c * v + d * u * v);
+	if (qc <= 0.0)
+	{
+		tHit = tStart;
+		return true;
+	}
+
+	double span = tEnd - tStart;
+	double s = -1.0;
+	if (std::abs(qa) < 1e-12)
+	{
+		if (qb < 0.0)
+			s = -qc / qb;
+	}
+	else
+	{
+		double discriminant = qb * qb - 4.0 * qa * qc;
+		if (discriminant >= 0.0)
+		{
+			// Stable form of the two roots, then the first one ahead
+			double q = -0.5 * (qb + std::copysign(std::sqrt(discriminant), qb));
+			double root0 = q / qa;
+			double root1 = q != 0.0 ? qc / q : root0;
+			if (root0 > root1)
+				std::swap(root0, root1);
+			s = root0 >= 0.0 ? root0 : root1;
+		}
+	}
+
+	if (s < 0.0 || s > span)
+		return false;
+
+	tHit = tStart + s;
+	return true;
+}
+
+
+void Heightfield::GetHeights(const XMFLOAT2* positions, float* heights, size_t count) const
+{
+	GetHeightsAndNormals(positions, heights, 0, count);
+}
+
+void Heightfield::GetNormals(const XMFLOAT2* positions, XMFLOAT3* normals, size_t count) const
+{
+	GetHeightsAndNormals(positions, 0, normals, count);
+}
+
+void Heightfield::GetHeightsAndNormals(const XMFLOAT2* positions, float* heights, XMFLOAT3* normals, size_t count) const
+{
+	ParallelFor((size_t)0, count, 1, MinPositionsPerThread, 0, [&](size_t first, size_t end)
+		{
+			SampleRange(positions + first, heights ? heights + first : 0, normals ? normals + first : 0, end - first);
+		});
+}
+
+void Heightfield::Raycast(const HeightfieldRay* rays, HeightfieldHit* hits, size_t count) const
+{
+	ParallelFor((size_t)0, count, 1, 256, 0, [&](size_t first, size_t end)
+		{
+			for (size_t i = first; i < end; i++)
+				hits[i] = Raycast(rays[i]);
+		});
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+
+#include "Heightmap.h"
+
+// --------------------------------------------------------
+// Answers questions about the shape of a heightmap: the
+// height and normal at any world position, and where rays
+// hit it.
+//
+// The surface is bilinear between grid points.  Normals are
+// central differences at the grid points (matching the
+// terrain's vertex normals), interpolated bilinearly.
+// Positions off the edge of the map use the edge heights.
+// Each grid point's height and normal are stored together
+// (four floats), so a position needs four 16-byte loads,
+// and positions are sampled four at a time with SSE.
+// The terrain is solid below the surface, so a ray that
+// starts under it (or comes in under it from the side of the
+// map) hits right where it starts (or comes in).
+//
+// Raycasts march through a pyramid of maximum heights: level
+// 0 has the highest point of each grid square, and each
+// level after that the highest of 2x2 squares of the one
+// before, up to one square covering everything.  Wherever
+// the ray stays above a square's maximum it can skip the
+// whole square, so a ray usually only visits a few squares
+// per level rather than every grid square it crosses.
+// --------------------------------------------------------
+
+struct HeightfieldRay
+{
+	DirectX::XMFLOAT3 Origin;
+	DirectX::XMFLOAT3 Direction;	// Needn't be normalized
+	float MaxDistance;				// In world units
+};
+
+struct HeightfieldHit
+{
+	bool Hit;
+	float Distance;					// From the origin, in world units
+	DirectX::XMFLOAT3 Position;
+	DirectX::XMFLOAT3 Normal;
+};
+
+class Heightfield
+{
+public:
+	Heightfield(std::shared_ptr<Heightmap> heightmap);
+
+	float GetHeight(float worldX, float worldZ) const;
+	DirectX::XMFLOAT3 GetNormal(float worldX, float worldZ) const;
+	HeightfieldHit Raycast(const HeightfieldRay& ray) const;
+
+	// The same, for many points or rays at once (split between
+	// threads when there are enough of them).  Positions are
+	// world (x, z) pairs.
+	void GetHeights(const DirectX::XMFLOAT2* positions, float* heights, size_t count) const;
+	void GetNormals(const DirectX::XMFLOAT2* positions, DirectX::XMFLOAT3* normals, size_t count) const;
+	void GetHeightsAndNormals(const DirectX::XMFLOAT2* positions, float* heights, DirectX::XMFLOAT3* normals, size_t count) const;
+	void Raycast(const HeightfieldRay* rays, HeightfieldHit* hits, size_t count) const;
+
+	// Normal at a grid point (which the map has to have)
+	DirectX::XMFLOAT3 GetPointNormal(unsigned int x, unsigned int z) const;
+
+	std::shared_ptr<Heightmap> GetHeightmap() const;
+	unsigned int GetLevelCount() const;
+
+private:
+	std::shared_ptr<Heightmap> heightmap;
+	unsigned int width;		// Grid points
+	unsigned int height;
+	float xzScale;
+
+	// Height, then normal x, y and z, for each grid point (in
+	// Heightmap.h's row order)
+	std::vector<float> surface;
+
+	// Maximum heights, one array per level, in the same order
+	std::vector<std::vector<float>> maxHeights;
+	std::vector<unsigned int> levelWidths;		// In squares
+	std::vector<unsigned int> levelHeights;
+
+	float GetPoint(int x, int z) const;
+	DirectX::XMFLOAT4 SamplePoint(float worldX, float worldZ) const;
+	void SampleGroup(const DirectX::XMFLOAT2* positions, float* heights, DirectX::XMFLOAT3* normals) const;
+	void SampleRange(const DirectX::XMFLOAT2* positions, float* heights, DirectX::XMFLOAT3* normals, size_t count) const;
+	bool IntersectSquare(unsigned int x, unsigned int z, const double origin[3], const double direction[3], double tStart, double tEnd, double& tHit) const;
+};
@@ -0,0 +1,117 @@
+#include "HeightfieldVertices.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+// Rows below this many vertices aren't worth another thread
+static const unsigned int MinVerticesPerThread = 64 * 1024;
+
+
+// --------------------------------------------------------
+// Sets up one vertex from its position and the slope of the
+// terrain there.  The normal is perpendicular to both slopes,
+// and the tangent follows the x slope (U increases along x).
+// --------------------------------------------------------
+static void SetVertex(Vertex& vert, float x, float y, float z, float u, float v, float slopeX, float slopeZ)
+{
+	float normalScale = 1.0f / std::sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+	float tangentScale = 1.0f / std::sqrt(slopeX * slopeX + 1.0f);
+
+	vert.Position = DirectX::XMFLOAT3(x, y, z);
+	vert.UV = DirectX::XMFLOAT2(u, v);
+	vert.Normal = DirectX::XMFLOAT3(-slopeX * normalScale, normalScale, -slopeZ * normalScale);
+	vert.Tangent = DirectX::XMFLOAT3(tangentScale, slopeX * tangentScale, 0.0f);
+}
+
+// --------------------------------------------------------
+// Fills in one row of vertices.  The first and last columns
+// use one-sided differences, and everything in between goes
+// four at a time (with any leftovers done one by one).
+// --------------------------------------------------------
+static void BuildRow(const Heightmap& heightmap, unsigned int z, Vertex* row)
+{
+	unsigned int width = heightmap.GetWidth();
+	unsigned int height = heightmap.GetHeight();
+	float xzScale = heightmap.GetXZScale();
+
+	// Rows on either side, clamped at the edges (which makes
+	// the difference one-sided there)
+	unsigned int zDown = z > 0 ? z - 1 : z;
+	unsigned int zUp = z < height - 1 ? z + 1 : z;
+	const float* center = heightmap.GetData() + (size_t)z * width;
+	const float* down = heightmap.GetData() + (size_t)zDown * width;
+	const float* up = heightmap.GetData() + (size_t)zUp * width;
+
+	float invDX = 1.0f / (2.0f * xzScale);
+	float invDZ = 1.0f / ((zUp - zDown) * xzScale);
+	float halfWidth = width / 2.0f;
+	float posZ = (z - height / 2.0f) * xzScale;
+	float v = z / (float)height;
+
+	SetVertex(row[0], -halfWidth * xzScale, center[0], posZ, 0.0f, v,
+		(center[1] - center[0]) / xzScale,
+		(up[0] - down[0]) * invDZ);
+
+	unsigned int x = 1;
+	__m128 scaleX = _mm_set1_ps(invDX);
+	__m128 scaleZ = _mm_set1_ps(invDZ);
+	__m128 one = _mm_set1_ps(1.0f);
+	for (; x + 4 < width; x += 4)
+	{
+		__m128 slopeX = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(center + x + 1), _mm_loadu_ps(center + x - 1)), scaleX);
+		__m128 slopeZ = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)), scaleZ);
+		__m128 slopeX2 = _mm_mul_ps(slopeX, slopeX);
+
+		__m128 normalScale = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(slopeX2, _mm_mul_ps(slopeZ, slopeZ)), one)));
+		__m128 tangentScale = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(slopeX2, one)));
+
+		alignas(16) float normalX[4], normalY[4], normalZ[4], tangentX[4], tangentY[4];
+		_mm_store_ps(normalX, _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), slopeX), normalScale));
+		_mm_store_ps(normalY, normalScale);
+		_mm_store_ps(normalZ, _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), slopeZ), normalScale));
+		_mm_store_ps(tangentX, tangentScale);
+		_mm_store_ps(tangentY, _mm_mul_ps(slopeX, tangentScale));
+
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			Vertex& vert = row[x + i];
+			vert.Position = DirectX::XMFLOAT3((x + i - halfWidth) * xzScale, center[x + i], posZ);
+			vert.UV = DirectX::XMFLOAT2((x + i) / (float)width, v);
+			vert.Normal = DirectX::XMFLOAT3(normalX[i], normalY[i], normalZ[i]);
+			vert.Tangent = DirectX::XMFLOAT3(tangentX[i], tangentY[i], 0.0f);
+		}
+	}
+
+	for (; x < width - 1; x++)
+	{
+		SetVertex(row[x], (x - halfWidth) * xzScale, center[x], posZ, x / (float)width, v,
+			(center[x + 1] - center[x - 1]) * invDX,
+			(up[x] - down[x]) * invDZ);
+	}
+
+	unsigned int last = width - 1;
+	SetVertex(row[last], (last - halfWidth) * xzScale, center[last], posZ, last / (float)width, v,
+		(center[last] - center[last - 1]) / xzScale,
+		(up[last] - down[last]) * invDZ);
+}
+
+
+// --------------------------------------------------------
+// Splits the rows into one band per thread (this thread
+// takes the first) and builds them all
+// --------------------------------------------------------
+void BuildHeightfieldVertices(const Heightmap& heightmap, Vertex* verts, unsigned int threadCount)
+{
+	unsigned int width = heightmap.GetWidth();
+	unsigned int height = heightmap.GetHeight();
+	if (width < 2 || height < 2)
+		return;
+
+	ParallelFor(0u, height, width, MinVerticesPerThread, threadCount, [&](unsigned int firstRow, unsigned int endRow)
+		{
+			for (unsigned int z = firstRow; z < endRow; z++)
+				BuildRow(heightmap, z, verts + (size_t)z * width);
+		});
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Heightmap.h"
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Fills in a vertex per heightmap grid point: position,
+// UV, and a normal and tangent taken straight from the
+// slope of the heights around the point (central
+// differences, one-sided at the edges), the same way
+// TerrainVS does.
+//
+// Rows are independent, so they're split between threads,
+// and each row is done four vertices at a time with SSE.
+//
+// verts must have room for width x height vertices
+// threadCount - 0 uses every hardware thread
+// --------------------------------------------------------
+void BuildHeightfieldVertices(const Heightmap& heightmap, Vertex* verts, unsigned int threadCount = 0);
@@ -0,0 +1,72 @@
+#include "Heightmap.h"
+
+#include <fstream>
+
+Heightmap::Heightmap() :
+	width(0),
+	height(0),
+	xzScale(1.0f)
+{
+}
+
+unsigned int Heightmap::GetWidth() const { return width; }
+unsigned int Heightmap::GetHeight() const { return height; }
+float Heightmap::GetXZScale() const { return xzScale; }
+const float* Heightmap::GetData() const { return heights.data(); }
+
+
+// --------------------------------------------------------
+// Loads an 8-bit or 16-bit RAW heightmap, scaling each value
+// the same way TerrainMesh does
+//
+// path - Full path to the heightmap file
+// width - heightmap width in pixels
+// height - heightmap height in pixels
+// bitDepth - 8-bit or 16-bit height values?
+// yScale - How tall should the terrain be?
+// xzScale - How wide should the terrain be?
+// --------------------------------------------------------
+bool Heightmap::Load(const std::filesystem::path& path, unsigned int width, unsigned int height, TerrainBitDepth bitDepth, float yScale, float xzScale)
+{
+	size_t count = (size_t)width * height;
+	if (count == 0)
+		return false;
+
+	std::ifstream file(path, std::ios_base::binary);
+	if (!file)
+		return false;
+
+	std::vector<float> values(count);
+	if (bitDepth == TerrainBitDepth::BitDepth_8)
+	{
+		std::vector<unsigned char> raw(count);
+		if (!file.read((char*)raw.data(), count))
+			return false;
+
+		for (size_t i = 0; i < count; i++)
+			values[i] = (raw[i] / 255.0f) * yScale;
+	}
+	else
+	{
+		std::vector<unsigned short> raw(count);
+		if (!file.read((char*)raw.data(), count * 2)) // 2 bytes per pixel
+			return false;
+
+		for (size_t i = 0; i < count; i++)
+			values[i] = (raw[i] / 65535.0f) * yScale; // 16-bit, so max value is 65535
+	}
+
+	heights.swap(values);
+	this->width = width;
+	this->height = height;
+	this->xzScale = xzScale;
+	return true;
+}
+
+void Heightmap::SetHeights(const float* heights, unsigned int width, unsigned int height, float xzScale)
+{
+	this->heights.assign(heights, heights + (size_t)width * height);
+	this->width = width;
+	this->height = height;
+	this->xzScale = xzScale;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+enum class TerrainBitDepth
+{
+	BitDepth_8,
+	BitDepth_16
+};
+
+// --------------------------------------------------------
+// The heights of a RAW heightmap, scaled exactly the way
+// TerrainMesh scales its vertices, without any graphics
+// API objects (so terrain code that only needs the heights
+// doesn't need a device).
+//
+// Grid point (x, z) is at world position
+//   ((x - width / 2) * xzScale, height, (z - height / 2) * xzScale)
+//
+// Heights are stored in rows of x, one row per z, so point
+// (x, z) is at index z * width + x.  Every other grid of
+// terrain data (tiles, nodes, pages, texels) uses the same
+// row order, with its own width in place of the heightmap's.
+// --------------------------------------------------------
+class Heightmap
+{
+public:
+	Heightmap();
+
+	// Loads an 8 or 16-bit RAW file, returning false if it can't be read
+	bool Load(
+		const std::filesystem::path& path,
+		unsigned int width,
+		unsigned int height,
+		TerrainBitDepth bitDepth = TerrainBitDepth::BitDepth_8,
+		float yScale = 256.0f,
+		float xzScale = 1.0f);
+
+	// Copies heights (already in world units) from memory instead
+	void SetHeights(const float* heights, unsigned int width, unsigned int height, float xzScale = 1.0f);
+
+	// Grid size, in points
+	unsigned int GetWidth() const;
+	unsigned int GetHeight() const;
+	float GetXZScale() const;
+
+	// Height of a single grid point, and all of them
+	float GetValue(unsigned int x, unsigned int z) const { return heights[(size_t)z * width + x]; }
+	const float* GetData() const;
+
+	// World position of a grid point (x, z), on the x and z axes
+	float GetWorldX(float x) const { return (x - width / 2.0f) * xzScale; }
+	float GetWorldZ(float z) const { return (z - height / 2.0f) * xzScale; }
+
+private:
+	std::vector<float> heights;
+	unsigned int width;
+	unsigned int height;
+	float xzScale;
+};
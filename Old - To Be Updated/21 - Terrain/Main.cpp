@@ -1,5 +1,6 @@
 
 #include <Windows.h>
+#include <string.h>
 #include "Game.h"
 
 // --------------------------------------------------------
@@ -8,7 +9,7 @@
 int WINAPI WinMain(
 	_In_ HINSTANCE hInstance,			// The handle to this app's instance
 	_In_opt_ HINSTANCE hPrevInstance,	// A handle to the previous instance of the app (always NULL)
-	_In_ LPSTR lpCmdLine,				// Command line params
+	_In_ LPSTR lpCmdLine,				// Command line params (-generate for procedural terrain)
 	_In_ int nCmdShow)					// How the window should be shown (we ignore this)
 {
 #if defined(DEBUG) | defined(_DEBUG)
@@ -20,7 +21,7 @@ int WINAPI WinMain(
 
 	// Create the Game object using
 	// the app handle we got from WinMain
-	Game dxGame(hInstance);
+	Game dxGame(hInstance, strstr(lpCmdLine, "-generate") != 0);
 
 	// Result variable for function calls below
 	HRESULT hr = S_OK;
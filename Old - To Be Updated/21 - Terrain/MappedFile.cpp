@@ -0,0 +1,78 @@
+#include "MappedFile.h"
+
+#include <Windows.h>
+
+MappedFile::MappedFile() :
+	fileHandle(INVALID_HANDLE_VALUE),
+	mappingHandle(0),
+	data(0),
+	size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::IsOpen() const { return data != 0; }
+const unsigned char* MappedFile::GetData() const { return data; }
+size_t MappedFile::GetSize() const { return size; }
+
+
+// --------------------------------------------------------
+// Maps the whole file for reading.  Access is expected to
+// jump around (one tile here, another there), so the cache
+// manager is told not to read ahead sequentially.
+// --------------------------------------------------------
+bool MappedFile::Open(const std::filesystem::path& path)
+{
+	Close();
+
+	fileHandle = CreateFileW(
+		path.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		0,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+		0);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0 || (unsigned long long)fileSize.QuadPart > SIZE_MAX)
+	{
+		Close();
+		return false;
+	}
+
+	mappingHandle = CreateFileMappingW(fileHandle, 0, PAGE_READONLY, 0, 0, 0);
+	if (!mappingHandle)
+	{
+		Close();
+		return false;
+	}
+
+	data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+
+	size = (size_t)fileSize.QuadPart;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mappingHandle) CloseHandle(mappingHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = 0;
+	data = 0;
+	size = 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+
+// --------------------------------------------------------
+// A read-only view of an entire file, mapped into memory.
+//
+// Nothing is read up front: the OS pages the file in as
+// its bytes are first touched, and can drop those pages
+// again (they're clean, so nothing is written back) when
+// memory gets tight.
+// --------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Returns false if the file can't be opened or mapped
+	bool Open(const std::filesystem::path& path);
+	void Close();
+
+	bool IsOpen() const;
+	const unsigned char* GetData() const;
+	size_t GetSize() const;
+
+private:
+	void* fileHandle;
+	void* mappingHandle;
+	const unsigned char* data;
+	size_t size;
+};
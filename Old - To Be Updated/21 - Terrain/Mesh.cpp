@@ -223,11 +223,13 @@ unsigned int Mesh::GetIndexCount() { return numIndices; }
 // indexArray - An array of indices into the vertex array
 // numIndices - The number of indices in the index array
 // device     - The D3D device to use for buffer creation
+// calculateTangents - Whether the vertices still need tangents
 // --------------------------------------------------------
-void Mesh::CreateBuffers(Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device)
+void Mesh::CreateBuffers(Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, bool calculateTangents)
 {
 	// Calculate the tangents of each vertex first
-	CalculateTangents(vertArray, numVerts, indexArray, numIndices);
+	if (calculateTangents)
+		CalculateTangents(vertArray, numVerts, indexArray, numIndices);
 
 	// Create the vertex buffer
 	D3D11_BUFFER_DESC vbd = {};
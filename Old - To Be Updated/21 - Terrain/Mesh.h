@@ -32,8 +32,9 @@ protected:
 	// Total indices in this mesh
 	unsigned int numIndices;
 
-	// Helper for creating buffers (in the event we add more constructor overloads)
-	void CreateBuffers(Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	// Helper for creating buffers (in the event we add more constructor overloads),
+	// which can skip the tangents for vertices that already have them
+	void CreateBuffers(Vertex* vertArray, size_t numVerts, unsigned int* indexArray, size_t numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, bool calculateTangents = true);
 	void CalculateTangents(Vertex* verts, size_t numVerts, unsigned int* indices, size_t numIndices);
 };
 
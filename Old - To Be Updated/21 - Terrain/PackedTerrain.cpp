@@ -0,0 +1,173 @@
+#include "PackedTerrain.h"
+
+#include <d3dcompiler.h>
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+
+// --------------------------------------------------------
+// Packs the heightmap and creates the GPU resources
+//
+// heightmap - Heights to draw
+// vertexShaderPath - Compiled PackedTerrainVS (.cso)
+// device - DX device for resource creation
+// context - DX context for drawing
+// chunkSize - Quads across each chunk (at most 255)
+// packNormals - Store normals, or leave every normal straight up?
+// --------------------------------------------------------
+PackedTerrain::PackedTerrain(
+	std::shared_ptr<Heightmap> heightmap,
+	const std::wstring& vertexShaderPath,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int chunkSize,
+	bool packNormals)
+	:
+	heightmap(heightmap),
+	drawnChunkCount(0),
+	device(device),
+	context(context)
+{
+	chunks.Build(*heightmap, chunkSize, packNormals);
+
+	CreateShader(vertexShaderPath);
+	CreateBuffers();
+}
+
+
+// --------------------------------------------------------
+// Makes the two-slot input layout, then the shader with it
+// --------------------------------------------------------
+void PackedTerrain::CreateShader(const std::wstring& vertexShaderPath)
+{
+	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
+	D3DReadFileToBlob(vertexShaderPath.c_str(), shaderBlob.GetAddressOf());
+	if (!shaderBlob)
+		return;
+
+	D3D11_INPUT_ELEMENT_DESC layoutDesc[2] = {};
+	layoutDesc[0].SemanticName = "HEIGHT";
+	layoutDesc[0].Format = DXGI_FORMAT_R16_UNORM;
+	layoutDesc[0].InputSlot = 0;
+	layoutDesc[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+
+	layoutDesc[1].SemanticName = "NORMAL";
+	layoutDesc[1].Format = DXGI_FORMAT_R8G8_SNORM;
+	layoutDesc[1].InputSlot = 1;
+	layoutDesc[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
+	device->CreateInputLayout(
+		layoutDesc,
+		2,
+		shaderBlob->GetBufferPointer(),
+		shaderBlob->GetBufferSize(),
+		inputLayout.GetAddressOf());
+
+	packedVS = std::make_shared<SimpleVertexShader>(device, context, vertexShaderPath.c_str(), inputLayout, false);
+}
+
+
+// --------------------------------------------------------
+// Uploads the height and normal streams and the shared indices
+// --------------------------------------------------------
+void PackedTerrain::CreateBuffers()
+{
+	if (chunks.GetChunks().empty())
+		return;
+
+	const std::vector<uint16_t>& heights = chunks.GetHeights();
+	D3D11_BUFFER_DESC vbd = {};
+	vbd.Usage = D3D11_USAGE_IMMUTABLE;
+	vbd.ByteWidth = sizeof(uint16_t) * (unsigned int)heights.size();
+	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA heightData = {};
+	heightData.pSysMem = heights.data();
+	device->CreateBuffer(&vbd, &heightData, heightVB.GetAddressOf());
+
+	// Packed normals, or just one that points straight up
+	const int8_t up[4] = { 0, 0, 0, 0 };
+	const std::vector<int8_t>& normals = chunks.GetNormals();
+	vbd.ByteWidth = chunks.HasNormals() ? (unsigned int)normals.size() : sizeof(up);
+	D3D11_SUBRESOURCE_DATA normalData = {};
+	normalData.pSysMem = chunks.HasNormals() ? normals.data() : up;
+	device->CreateBuffer(&vbd, &normalData, normalVB.GetAddressOf());
+
+	const std::vector<uint16_t>& indices = chunks.GetIndices();
+	D3D11_BUFFER_DESC ibd = {};
+	ibd.Usage = D3D11_USAGE_IMMUTABLE;
+	ibd.ByteWidth = sizeof(uint16_t) * (unsigned int)indices.size();
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA indexData = {};
+	indexData.pSysMem = indices.data();
+	device->CreateBuffer(&ibd, &indexData, indexBuffer.GetAddressOf());
+}
+
+
+// --------------------------------------------------------
+// Frustum culls the chunks against their height bounds and
+// draws the rest.  Each chunk's streams are bound starting
+// at its first vertex, so the shared indices (and therefore
+// SV_VertexID) count from 0 within every chunk.
+// --------------------------------------------------------
+void PackedTerrain::Draw(std::shared_ptr<Camera> camera, std::shared_ptr<Material> material)
+{
+	drawnChunkCount = 0;
+	if (!packedVS || !heightVB)
+		return;
+
+	XMFLOAT4X4 view = camera->GetView();
+	XMFLOAT4X4 proj = camera->GetProjection();
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj)));
+	TerrainFrustum frustum = TerrainFrustum::FromViewProjection(&viewProj._11);
+
+	// Pixel shader and textures from the material, then our own vertex shader
+	Transform identity;
+	material->PrepareMaterial(&identity, camera);
+
+	float xzScale = heightmap->GetXZScale();
+	XMFLOAT2 heightmapSize((float)heightmap->GetWidth(), (float)heightmap->GetHeight());
+	packedVS->SetShader();
+	packedVS->SetMatrix4x4("view", view);
+	packedVS->SetMatrix4x4("projection", proj);
+	packedVS->SetFloat("xzScale", xzScale);
+	packedVS->SetFloat2("heightmapSize", heightmapSize);
+	packedVS->SetFloat("verticesAcross", (float)chunks.GetVerticesAcross());
+	packedVS->CopyBufferData("ExternalData");
+
+	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
+	unsigned int indexCount = (unsigned int)chunks.GetIndices().size();
+	unsigned int chunkSize = chunks.GetChunkSize();
+
+	for (const PackedTerrainChunk& chunk : chunks.GetChunks())
+	{
+		float boundsMin[3] = {
+			(chunk.X - heightmapSize.x / 2.0f) * xzScale,
+			chunk.MinHeight,
+			(chunk.Z - heightmapSize.y / 2.0f) * xzScale };
+		float boundsMax[3] = {
+			boundsMin[0] + chunkSize * xzScale,
+			chunk.MaxHeight,
+			boundsMin[2] + chunkSize * xzScale };
+		if (frustum.Classify(boundsMin, boundsMax) == 0)
+			continue;
+
+		ID3D11Buffer* buffers[2] = { heightVB.Get(), normalVB.Get() };
+		UINT strides[2] = { sizeof(uint16_t), chunks.HasNormals() ? 2u : 0u };
+		UINT offsets[2] = { chunk.FirstVertex * strides[0], chunk.FirstVertex * strides[1] };
+		context->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+
+		packedVS->SetFloat2("chunkOrigin", XMFLOAT2((float)chunk.X, (float)chunk.Z));
+		packedVS->SetFloat("heightOffset", chunk.HeightOffset);
+		packedVS->SetFloat("heightScale", chunk.HeightScale * 65535.0f);
+		packedVS->CopyBufferData("PerChunk");
+
+		context->DrawIndexed(indexCount, 0, 0);
+		drawnChunkCount++;
+	}
+}
+
+const PackedTerrainChunks& PackedTerrain::GetChunks() const { return chunks; }
+unsigned int PackedTerrain::GetDrawnChunkCount() { return drawnChunkCount; }
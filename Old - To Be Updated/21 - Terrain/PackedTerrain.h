@@ -0,0 +1,63 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+
+#include "Camera.h"
+#include "Heightmap.h"
+#include "Material.h"
+#include "PackedTerrainChunks.h"
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// Draws a heightmap from PackedTerrainChunks: two small
+// vertex streams (16-bit heights and packed normals) and a
+// single index buffer, drawn once per visible chunk.
+//
+// PackedTerrainVS rebuilds each vertex's position and UV
+// from SV_VertexID and the chunk's corner.  SimpleShader
+// can't reflect a layout that mixes SV_VertexID with buffer
+// inputs (or one using more than one slot), so the layout
+// is made here and handed to the shader.
+// --------------------------------------------------------
+class PackedTerrain
+{
+public:
+	PackedTerrain(
+		std::shared_ptr<Heightmap> heightmap,
+		const std::wstring& vertexShaderPath,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int chunkSize = 64,
+		bool packNormals = true);
+
+	// Draws the chunks in view with the material's pixel shader
+	// and textures (its vertex shader is replaced)
+	void Draw(std::shared_ptr<Camera> camera, std::shared_ptr<Material> material);
+
+	const PackedTerrainChunks& GetChunks() const;
+
+	// Stats from the last Draw()
+	unsigned int GetDrawnChunkCount();
+
+private:
+	void CreateShader(const std::wstring& vertexShaderPath);
+	void CreateBuffers();
+
+	std::shared_ptr<Heightmap> heightmap;
+	PackedTerrainChunks chunks;
+	unsigned int drawnChunkCount;
+
+	// Slot 0 is the heights, slot 1 the normals.  Without packed
+	// normals, slot 1 is a single "straight up" normal read with
+	// a stride of 0.
+	Microsoft::WRL::ComPtr<ID3D11Buffer> heightVB;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> normalVB;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
+
+	std::shared_ptr<SimpleVertexShader> packedVS;
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+};
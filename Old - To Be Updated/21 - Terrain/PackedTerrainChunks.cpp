@@ -0,0 +1,185 @@
+#include "PackedTerrainChunks.h"
+#include "TerrainGridLayout.h"
+#include "Vertex.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+PackedTerrainChunks::PackedTerrainChunks() :
+	chunkSize(0),
+	width(0),
+	height(0),
+	xzScale(1.0f)
+{
+}
+
+unsigned int PackedTerrainChunks::GetChunkSize() const { return chunkSize; }
+unsigned int PackedTerrainChunks::GetVerticesAcross() const { return chunkSize + 1; }
+unsigned int PackedTerrainChunks::GetVerticesPerChunk() const { return (chunkSize + 1) * (chunkSize + 1); }
+bool PackedTerrainChunks::HasNormals() const { return !normals.empty(); }
+const std::vector<PackedTerrainChunk>& PackedTerrainChunks::GetChunks() const { return chunks; }
+const std::vector<uint16_t>& PackedTerrainChunks::GetHeights() const { return heights; }
+const std::vector<int8_t>& PackedTerrainChunks::GetNormals() const { return normals; }
+const std::vector<uint16_t>& PackedTerrainChunks::GetIndices() const { return indices; }
+
+
+// --------------------------------------------------------
+// Quantizes every chunk's heights against the map's range,
+// encodes the normals and builds the one index buffer every
+// chunk shares
+//
+// heightmap - The heights to pack
+// chunkSize - Quads across each chunk
+// packNormals - Store a normal per vertex too?
+// --------------------------------------------------------
+void PackedTerrainChunks::Build(const Heightmap& heightmap, unsigned int chunkSize, bool packNormals)
+{
+	// More than 256 vertices across won't fit 16-bit indices, and
+	// there's no point in chunks bigger than the heightmap
+	width = heightmap.GetWidth();
+	height = heightmap.GetHeight();
+	this->chunkSize = std::clamp(chunkSize, 1u, std::clamp(std::max(width, height) - 1, 1u, 255u));
+	xzScale = heightmap.GetXZScale();
+
+	chunks.clear();
+	heights.clear();
+	normals.clear();
+	indices.clear();
+	if (width < 2 || height < 2)
+		return;
+
+	unsigned int across = GetVerticesAcross();
+	unsigned int chunksX = (width - 2) / this->chunkSize + 1;
+	unsigned int chunksZ = (height - 2) / this->chunkSize + 1;
+	heights.resize((size_t)chunksX * chunksZ * GetVerticesPerChunk());
+	if (packNormals)
+		normals.resize(heights.size() * 2);
+
+	// One quantization range for the whole map, so chunks agree on
+	// the heights along their shared borders
+	const float* data = heightmap.GetData();
+	auto range = std::minmax_element(data, data + (size_t)width * height);
+	float heightOffset = *range.first;
+	float heightScale = (*range.second - *range.first) / 65535.0f;
+
+	for (unsigned int chunkZ = 0; chunkZ < chunksZ; chunkZ++)
+	{
+		for (unsigned int chunkX = 0; chunkX < chunksX; chunkX++)
+		{
+			PackedTerrainChunk chunk = {};
+			chunk.X = chunkX * this->chunkSize;
+			chunk.Z = chunkZ * this->chunkSize;
+			chunk.FirstVertex = (unsigned int)chunks.size() * GetVerticesPerChunk();
+
+			// Range of the chunk's heights
+			chunk.MinHeight = FLT_MAX;
+			chunk.MaxHeight = -FLT_MAX;
+			for (unsigned int z = 0; z < across; z++)
+			{
+				for (unsigned int x = 0; x < across; x++)
+				{
+					float value = heightmap.GetValue(std::min(chunk.X + x, width - 1), std::min(chunk.Z + z, height - 1));
+					chunk.MinHeight = std::min(chunk.MinHeight, value);
+					chunk.MaxHeight = std::max(chunk.MaxHeight, value);
+				}
+			}
+			chunk.HeightOffset = heightOffset;
+			chunk.HeightScale = heightScale;
+
+			for (unsigned int z = 0; z < across; z++)
+			{
+				for (unsigned int x = 0; x < across; x++)
+				{
+					unsigned int gridX = std::min(chunk.X + x, width - 1);
+					unsigned int gridZ = std::min(chunk.Z + z, height - 1);
+					size_t vertex = chunk.FirstVertex + z * across + x;
+
+					float value = heightmap.GetValue(gridX, gridZ);
+					heights[vertex] = chunk.HeightScale > 0.0f ?
+						(uint16_t)std::lround((value - chunk.HeightOffset) / chunk.HeightScale) : 0;
+
+					if (!packNormals)
+						continue;
+
+					// Central differences (one-sided at the edges) give
+					// a normal of (-slopeX, 1, -slopeZ), which is then
+					// projected onto the octahedron |x| + |y| + |z| = 1
+					unsigned int left = gridX > 0 ? gridX - 1 : gridX;
+					unsigned int right = std::min(gridX + 1, width - 1);
+					unsigned int down = gridZ > 0 ? gridZ - 1 : gridZ;
+					unsigned int up = std::min(gridZ + 1, height - 1);
+					float slopeX = (heightmap.GetValue(right, gridZ) - heightmap.GetValue(left, gridZ)) / ((right - left) * xzScale);
+					float slopeZ = (heightmap.GetValue(gridX, up) - heightmap.GetValue(gridX, down)) / ((up - down) * xzScale);
+					float sum = std::abs(slopeX) + 1.0f + std::abs(slopeZ);
+					normals[vertex * 2 + 0] = (int8_t)std::lround(-slopeX / sum * 127.0f);
+					normals[vertex * 2 + 1] = (int8_t)std::lround(-slopeZ / sum * 127.0f);
+				}
+			}
+
+			chunks.push_back(chunk);
+		}
+	}
+
+	// One grid of triangles for every chunk, arranged like TerrainMesh's,
+	// in Hilbert order for the vertex cache.  The vertices stay row-major,
+	// since the vertex shader works out where they are from their IDs.
+	std::vector<unsigned int> gridIndices;
+	BuildTerrainGridIndices(across, across, TerrainGridOrder::Hilbert, gridIndices);
+	for (unsigned int index : gridIndices)
+		indices.push_back((uint16_t)index);
+}
+
+
+XMFLOAT3 PackedTerrainChunks::GetPosition(unsigned int chunk, unsigned int vertexID) const
+{
+	const PackedTerrainChunk& info = chunks[chunk];
+	unsigned int gridX = std::min(info.X + vertexID % GetVerticesAcross(), width - 1);
+	unsigned int gridZ = std::min(info.Z + vertexID / GetVerticesAcross(), height - 1);
+	return XMFLOAT3(
+		(gridX - width / 2.0f) * xzScale,
+		info.HeightOffset + heights[info.FirstVertex + vertexID] * info.HeightScale,
+		(gridZ - height / 2.0f) * xzScale);
+}
+
+XMFLOAT3 PackedTerrainChunks::GetNormal(unsigned int chunk, unsigned int vertexID) const
+{
+	if (normals.empty())
+		return XMFLOAT3(0, 1, 0);
+
+	size_t vertex = chunks[chunk].FirstVertex + vertexID;
+	float x = normals[vertex * 2 + 0] / 127.0f;
+	float z = normals[vertex * 2 + 1] / 127.0f;
+	float y = 1.0f - std::abs(x) - std::abs(z);
+	float scale = 1.0f / std::sqrt(x * x + y * y + z * z);
+	return XMFLOAT3(x * scale, y * scale, z * scale);
+}
+
+XMFLOAT2 PackedTerrainChunks::GetUV(unsigned int chunk, unsigned int vertexID) const
+{
+	const PackedTerrainChunk& info = chunks[chunk];
+	unsigned int gridX = std::min(info.X + vertexID % GetVerticesAcross(), width - 1);
+	unsigned int gridZ = std::min(info.Z + vertexID / GetVerticesAcross(), height - 1);
+	return XMFLOAT2(gridX / (float)width, gridZ / (float)height);
+}
+
+
+size_t PackedTerrainChunks::GetPackedSize() const
+{
+	return
+		heights.size() * sizeof(uint16_t) +
+		normals.size() * sizeof(int8_t) +
+		indices.size() * sizeof(uint16_t);
+}
+
+size_t PackedTerrainChunks::GetMeshSize() const
+{
+	if (width < 2 || height < 2)
+		return 0;
+
+	return
+		(size_t)width * height * sizeof(Vertex) +
+		(size_t)(width - 1) * (height - 1) * 6 * sizeof(unsigned int);
+}
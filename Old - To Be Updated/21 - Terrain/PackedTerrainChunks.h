@@ -0,0 +1,86 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "Heightmap.h"
+
+// --------------------------------------------------------
+// A heightmap cut into square chunks, packed as small as
+// a vertex can get: every vertex is just a 16-bit height,
+// plus (optionally) a 16-bit normal.
+//
+// Nothing else needs storing.  A vertex's position in its
+// chunk's grid follows from its index (vertexID % across,
+// vertexID / across), so its x, z and UV come from that and
+// the chunk's corner.  Every chunk has the same grid, so one
+// index buffer serves them all.
+//
+// Heights are quantized between the whole map's lowest and
+// highest points, not each chunk's: a vertex on the border
+// between two chunks is stored in both, and with per-chunk
+// ranges each would round it to a slightly different height,
+// opening cracks along the border.  With one range both copies
+// are bit-identical, and so are the positions the vertex
+// shader rebuilds from them.  Normals are octahedral
+// encoded into two signed bytes (heightfield normals always
+// point up, so only the upper half is needed).
+//
+// Chunks on the far edges that run off the map repeat the
+// last row/column, which only makes zero-area triangles.
+//
+// None of this needs a device - PackedTerrain uploads and
+// draws it.
+// --------------------------------------------------------
+
+struct PackedTerrainChunk
+{
+	unsigned int X;				// Grid point of the chunk's corner (smallest x and z)
+	unsigned int Z;
+	unsigned int FirstVertex;	// Of the chunk's vertices in the height/normal streams
+	float HeightOffset;			// height = HeightOffset + packed * HeightScale (the same for every chunk)
+	float HeightScale;
+	float MinHeight;			// Of the chunk's own heights, for culling
+	float MaxHeight;
+};
+
+class PackedTerrainChunks
+{
+public:
+	PackedTerrainChunks();
+
+	// Packs the heightmap in chunks of chunkSize x chunkSize quads
+	// (chunkSize + 1 vertices across must fit 16-bit indices)
+	void Build(const Heightmap& heightmap, unsigned int chunkSize = 64, bool packNormals = true);
+
+	unsigned int GetChunkSize() const;
+	unsigned int GetVerticesAcross() const;
+	unsigned int GetVerticesPerChunk() const;
+	bool HasNormals() const;
+
+	const std::vector<PackedTerrainChunk>& GetChunks() const;
+	const std::vector<uint16_t>& GetHeights() const;
+	const std::vector<int8_t>& GetNormals() const;		// Two per vertex
+	const std::vector<uint16_t>& GetIndices() const;	// Shared by every chunk
+
+	// A vertex rebuilt the way PackedTerrainVS does it
+	DirectX::XMFLOAT3 GetPosition(unsigned int chunk, unsigned int vertexID) const;
+	DirectX::XMFLOAT3 GetNormal(unsigned int chunk, unsigned int vertexID) const;
+	DirectX::XMFLOAT2 GetUV(unsigned int chunk, unsigned int vertexID) const;
+
+	// Bytes of vertex and index data, packed and as a full TerrainMesh
+	size_t GetPackedSize() const;
+	size_t GetMeshSize() const;
+
+private:
+	unsigned int chunkSize;
+	unsigned int width;			// Heightmap size, in grid points
+	unsigned int height;
+	float xzScale;
+
+	std::vector<PackedTerrainChunk> chunks;
+	std::vector<uint16_t> heights;
+	std::vector<int8_t> normals;
+	std::vector<uint16_t> indices;
+};
@@ -0,0 +1,59 @@
+#include "ShaderStructs.hlsli"
+
+// Draws one chunk of packed terrain (see PackedTerrain)
+
+cbuffer ExternalData : register(b0)
+{
+	matrix view;
+	matrix projection;
+
+	float2 heightmapSize;
+	float xzScale;
+	float verticesAcross;	// Per side of every chunk's grid
+}
+
+cbuffer PerChunk : register(b1)
+{
+	float2 chunkOrigin;		// Heightmap grid point of the chunk's corner
+	float heightOffset;		// height = heightOffset + packedHeight * heightScale
+	float heightScale;
+}
+
+struct VertexShaderInput_PackedTerrain
+{
+	float packedHeight		: HEIGHT;		// 16-bit unorm, 0 - 1 across the chunk's heights
+	float2 packedNormal		: NORMAL;		// x and z of an octahedral encoded normal
+	uint vertexID			: SV_VertexID;	// Index into the chunk's grid
+};
+
+
+// --------------------------------------------------------
+// Rebuilds the vertex from its grid position within the
+// chunk (which follows from its ID), its height and its
+// packed normal
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput_PackedTerrain input)
+{
+	VertexToPixel output;
+
+	uint across = (uint)verticesAcross;
+	float2 gridPoint = chunkOrigin + float2(input.vertexID % across, input.vertexID / across);
+	gridPoint = min(gridPoint, heightmapSize - 1.0f);
+
+	float2 xz = (gridPoint - heightmapSize / 2.0f) * xzScale;
+	float3 worldPos = float3(xz.x, heightOffset + input.packedHeight * heightScale, xz.y);
+
+	// Only the upper half of the octahedron is used, so y is
+	// whatever's left over; the tangent follows +x along the slope
+	float3 normal = float3(input.packedNormal.x, 1.0f - abs(input.packedNormal.x) - abs(input.packedNormal.y), input.packedNormal.y);
+	normal = normalize(normal);
+
+	output.screenPosition = mul(mul(projection, view), float4(worldPos, 1.0f));
+	output.worldPos = worldPos;
+	output.normal = normal;
+	output.tangent = normalize(float3(normal.y, -normal.x, 0.0f));
+	output.uv = gridPoint / heightmapSize;
+	output.posForShadow = float4(0, 0, 0, 1);
+
+	return output;
+}
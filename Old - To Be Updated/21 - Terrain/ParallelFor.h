@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Splits [first, end) into one band per thread (this thread
+// takes the first) and calls body(bandFirst, bandEnd) for
+// each, unless there's too little work for that many:
+//  - itemSize is how much work each item is (the points in
+//    a row, say, or 1)
+//  - Each thread gets at least minPerThread of that work
+//  - A threadCount of 0 means one per hardware thread
+// --------------------------------------------------------
+template<typename Index, typename Body>
+void ParallelFor(Index first, Index end, size_t itemSize, size_t minPerThread, unsigned int threadCount, const Body& body)
+{
+	if (end <= first)
+		return;
+
+	// Too little work to split needn't ask how many hardware threads there are
+	size_t count = (size_t)(end - first);
+	size_t bands = count * itemSize / minPerThread;
+	if (bands <= 1 || threadCount == 1)
+	{
+		body(first, end);
+		return;
+	}
+
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	bands = std::min(bands, (size_t)threadCount);
+
+	auto bandStart = [&](size_t band) { return (Index)(first + count * band / bands); };
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < bands; i++)
+		threads.emplace_back(body, bandStart(i), bandStart(i + 1));
+
+	body(first, bandStart(1));
+	for (auto& thread : threads)
+		thread.join();
+}
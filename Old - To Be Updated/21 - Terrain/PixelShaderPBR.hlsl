@@ -50,6 +50,9 @@ float4 main(VertexToPixel input) : SV_TARGET
 	float4 surfaceColor = Albedo.Sample(BasicSampler, input.uv);
 	surfaceColor.rgb = pow(surfaceColor.rgb, 2.2f);
 
+	// Cut out the see-through parts of textures like leaves
+	clip(surfaceColor.a - 0.4f);
+
 	// Specular color - Assuming albedo texture is actually holding specular color if metal == 1
 	// Note the use of lerp here - metal is generally 0 or 1, but might be in between
 	// because of linear texture sampling, so we want lerp the specular color to match
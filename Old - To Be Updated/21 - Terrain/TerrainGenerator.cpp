@@ -0,0 +1,482 @@
+#include "TerrainGenerator.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <vector>
+#include <emmintrin.h>
+
+// Rows below this many points aren't worth another thread
+static const size_t MinPointsPerThread = 16 * 1024;
+
+// Brings the noise's sum of octaves back to about -1 to 1
+static const float NoiseScale = 2.0f / 3.0f;
+
+
+// --------------------------------------------------------
+// Low 32 bits of four 32-bit multiplies (SSE2 only has the
+// 64-bit results of two at a time)
+// --------------------------------------------------------
+static __m128i MultiplyLow(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(
+		_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Multipliers that spread lattice coordinates across all 32 bits
+static const int PrimeX = 0x27d4eb2d;
+static const int PrimeZ = 0x165667b1;
+
+// --------------------------------------------------------
+// Scrambles four lattice corners (already multiplied by
+// their primes) and the seed into random-looking bits.  The
+// last step folds the high bits down, since the gradient is
+// picked from the low ones.
+// --------------------------------------------------------
+static __m128i Hash(__m128i scaledX, __m128i scaledZ, __m128i seed)
+{
+	__m128i hash = _mm_xor_si128(_mm_xor_si128(scaledX, scaledZ), seed);
+	hash = MultiplyLow(_mm_xor_si128(hash, _mm_srli_epi32(hash, 15)), _mm_set1_epi32(0x2c1b3c6d));
+	return _mm_xor_si128(hash, _mm_srli_epi32(hash, 16));
+}
+
+// --------------------------------------------------------
+// Dots the offset from a corner with the corner's gradient,
+// one of (+-1, +-2) and (+-2, +-1), picked by its hash
+// --------------------------------------------------------
+static __m128 Gradient(__m128i hash, __m128 dx, __m128 dz)
+{
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(hash, _mm_set1_epi32(4)), _mm_setzero_si128()));
+	__m128 u = _mm_or_ps(_mm_and_ps(swap, dx), _mm_andnot_ps(swap, dz));
+	__m128 v = _mm_or_ps(_mm_and_ps(swap, dz), _mm_andnot_ps(swap, dx));
+
+	// Low two bits flip the signs
+	__m128 signU = _mm_castsi128_ps(_mm_slli_epi32(hash, 31));
+	__m128 signV = _mm_castsi128_ps(_mm_slli_epi32(_mm_srli_epi32(hash, 1), 31));
+	return _mm_add_ps(_mm_xor_ps(u, signU), _mm_mul_ps(_mm_xor_ps(v, signV), _mm_set1_ps(2.0f)));
+}
+
+// --------------------------------------------------------
+// 6t^5 - 15t^4 + 10t^3, so the noise is smooth across corners
+// --------------------------------------------------------
+static __m128 Fade(__m128 t)
+{
+	__m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+	return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+static __m128 Lerp(__m128 a, __m128 b, __m128 t)
+{
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// --------------------------------------------------------
+// Where four points sit in the noise's lattice: their
+// corners (already multiplied by the primes), offsets from
+// those corners and fade weights.  None of it depends on
+// the seed, so noises with different seeds at the same
+// points can share it.
+// --------------------------------------------------------
+struct NoiseCell
+{
+	__m128i CornerX, CornerZ, NextX, NextZ;
+	__m128 DX, DZ, DX1, DZ1;
+	__m128 U, W;
+};
+
+static NoiseCell FindCell(__m128 x, __m128 z)
+{
+	// Floor, by truncating and fixing up negative values
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 floorX = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	__m128 floorZ = _mm_cvtepi32_ps(_mm_cvttps_epi32(z));
+	floorX = _mm_sub_ps(floorX, _mm_and_ps(_mm_cmpgt_ps(floorX, x), one));
+	floorZ = _mm_sub_ps(floorZ, _mm_and_ps(_mm_cmpgt_ps(floorZ, z), one));
+
+	// The next corner's multiple of the prime is just one prime more
+	__m128i cornerX = MultiplyLow(_mm_cvttps_epi32(floorX), _mm_set1_epi32(PrimeX));
+	__m128i cornerZ = MultiplyLow(_mm_cvttps_epi32(floorZ), _mm_set1_epi32(PrimeZ));
+	__m128i nextX = _mm_add_epi32(cornerX, _mm_set1_epi32(PrimeX));
+	__m128i nextZ = _mm_add_epi32(cornerZ, _mm_set1_epi32(PrimeZ));
+
+	__m128 dx = _mm_sub_ps(x, floorX);
+	__m128 dz = _mm_sub_ps(z, floorZ);
+	return { cornerX, cornerZ, nextX, nextZ, dx, dz, _mm_sub_ps(dx, one), _mm_sub_ps(dz, one), Fade(dx), Fade(dz) };
+}
+
+// --------------------------------------------------------
+// Gradient noise at four points
+// --------------------------------------------------------
+static __m128 Noise(const NoiseCell& cell, __m128i seed)
+{
+	__m128 g00 = Gradient(Hash(cell.CornerX, cell.CornerZ, seed), cell.DX, cell.DZ);
+	__m128 g10 = Gradient(Hash(cell.NextX, cell.CornerZ, seed), cell.DX1, cell.DZ);
+	__m128 g01 = Gradient(Hash(cell.CornerX, cell.NextZ, seed), cell.DX, cell.DZ1);
+	__m128 g11 = Gradient(Hash(cell.NextX, cell.NextZ, seed), cell.DX1, cell.DZ1);
+	return Lerp(Lerp(g00, g10, cell.U), Lerp(g01, g11, cell.U), cell.W);
+}
+
+// --------------------------------------------------------
+// Octaves of noise summed at four points, scaled back to
+// roughly -1 to 1.  Each octave has its own seed, so they
+// don't line up with each other.
+// --------------------------------------------------------
+static __m128 FractalNoise(
+	__m128 x,
+	__m128 z,
+	unsigned int seed,
+	unsigned int octaves,
+	float frequency,
+	float lacunarity,
+	float gain,
+	bool ridged)
+{
+	__m128 sum = _mm_setzero_ps();
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	float amplitude = 1.0f;
+	float totalAmplitude = 0.0f;
+	for (unsigned int i = 0; i < octaves; i++)
+	{
+		__m128 scale = _mm_set1_ps(frequency);
+		__m128 value = _mm_mul_ps(
+			Noise(FindCell(_mm_mul_ps(x, scale), _mm_mul_ps(z, scale)), _mm_set1_epi32((int)(seed + i * 0x9e3779b9u))),
+			_mm_set1_ps(NoiseScale));
+
+		// Ridges where the noise crosses zero, squared to sharpen them
+		if (ridged)
+		{
+			value = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_and_ps(value, absMask));
+			value = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(value, value), _mm_set1_ps(2.0f)), _mm_set1_ps(1.0f));
+		}
+
+		sum = _mm_add_ps(sum, _mm_mul_ps(value, _mm_set1_ps(amplitude)));
+		totalAmplitude += amplitude;
+		frequency *= lacunarity;
+		amplitude *= gain;
+	}
+
+	return totalAmplitude > 0.0f ? _mm_div_ps(sum, _mm_set1_ps(totalAmplitude)) : sum;
+}
+
+// --------------------------------------------------------
+// The two (unridged) fractal noises that push positions
+// around in x and z.  They're taken at the same points, so
+// each octave finds its cell once for both.
+// --------------------------------------------------------
+static void WarpNoise(
+	__m128 x,
+	__m128 z,
+	unsigned int seedX,
+	unsigned int seedZ,
+	unsigned int octaves,
+	float frequency,
+	float lacunarity,
+	float gain,
+	__m128& warpX,
+	__m128& warpZ)
+{
+	__m128 sumX = _mm_setzero_ps();
+	__m128 sumZ = _mm_setzero_ps();
+	float amplitude = 1.0f;
+	float totalAmplitude = 0.0f;
+	for (unsigned int i = 0; i < octaves; i++)
+	{
+		__m128 scale = _mm_set1_ps(frequency);
+		NoiseCell cell = FindCell(_mm_mul_ps(x, scale), _mm_mul_ps(z, scale));
+		__m128 valueX = _mm_mul_ps(Noise(cell, _mm_set1_epi32((int)(seedX + i * 0x9e3779b9u))), _mm_set1_ps(NoiseScale));
+		__m128 valueZ = _mm_mul_ps(Noise(cell, _mm_set1_epi32((int)(seedZ + i * 0x9e3779b9u))), _mm_set1_ps(NoiseScale));
+
+		sumX = _mm_add_ps(sumX, _mm_mul_ps(valueX, _mm_set1_ps(amplitude)));
+		sumZ = _mm_add_ps(sumZ, _mm_mul_ps(valueZ, _mm_set1_ps(amplitude)));
+		totalAmplitude += amplitude;
+		frequency *= lacunarity;
+		amplitude *= gain;
+	}
+
+	warpX = _mm_div_ps(sumX, _mm_set1_ps(totalAmplitude));
+	warpZ = _mm_div_ps(sumZ, _mm_set1_ps(totalAmplitude));
+}
+
+// --------------------------------------------------------
+// Fills in one row, four points at a time.  The last few
+// points are done in a full group of four too (with only
+// the ones in the row kept), so every point goes through
+// exactly the same math.
+// --------------------------------------------------------
+static void GenerateRow(float* row, unsigned int width, unsigned int z, const TerrainNoiseSettings& settings)
+{
+	__m128 posZ = _mm_set1_ps((float)z);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 top = _mm_set1_ps(settings.HeightScale);
+	for (unsigned int x = 0; x < width; x += 4)
+	{
+		__m128 posX = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+		__m128 sampleX = posX;
+		__m128 sampleZ = posZ;
+
+		// Push the position around with two more (unrelated) noises
+		if (settings.WarpStrength != 0.0f && settings.WarpOctaves > 0)
+		{
+			__m128 strength = _mm_set1_ps(settings.WarpStrength);
+			__m128 warpX, warpZ;
+			WarpNoise(posX, posZ, settings.Seed ^ 0x68e31da4u, settings.Seed ^ 0xb5297a4du, settings.WarpOctaves,
+				settings.WarpFrequency, settings.Lacunarity, settings.Gain, warpX, warpZ);
+			sampleX = _mm_add_ps(sampleX, _mm_mul_ps(warpX, strength));
+			sampleZ = _mm_add_ps(sampleZ, _mm_mul_ps(warpZ, strength));
+		}
+
+		__m128 value = FractalNoise(sampleX, sampleZ, settings.Seed, settings.Octaves,
+			settings.Frequency, settings.Lacunarity, settings.Gain, settings.Ridged);
+
+		// -1 to 1 becomes 0 to HeightScale
+		value = _mm_add_ps(_mm_mul_ps(value, half), half);
+		value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		value = _mm_mul_ps(value, top);
+
+		alignas(16) float values[4];
+		_mm_store_ps(values, value);
+		std::copy(values, values + std::min(4u, width - x), row + x);
+	}
+}
+
+
+void GenerateTerrainHeights(
+	float* heights,
+	unsigned int width,
+	unsigned int height,
+	const TerrainNoiseSettings& settings,
+	unsigned int threadCount)
+{
+	ParallelFor(0u, height, width, MinPointsPerThread, threadCount, [&](unsigned int firstRow, unsigned int endRow)
+		{
+			for (unsigned int z = firstRow; z < endRow; z++)
+				GenerateRow(heights + (size_t)z * width, width, z, settings);
+		});
+}
+
+
+// --------------------------------------------------------
+// Adds up what flows into a point from its neighbors, given
+// every point's outflows in the order -x, +x, -z, +z (so the
+// left neighbor's +x outflow comes here, and so on)
+// --------------------------------------------------------
+static float GatherInflow(const float* outflows, unsigned int width, unsigned int height, unsigned int x, unsigned int z)
+{
+	size_t index = (size_t)z * width + x;
+	float inflow = 0.0f;
+	if (x > 0)			inflow += outflows[(index - 1) * 4 + 1];
+	if (x < width - 1)	inflow += outflows[(index + 1) * 4 + 0];
+	if (z > 0)			inflow += outflows[(index - width) * 4 + 3];
+	if (z < height - 1)	inflow += outflows[(index + width) * 4 + 2];
+	return inflow;
+}
+
+// --------------------------------------------------------
+// Differences between a value and its four neighbors' (0
+// where there's no neighbor), in the order -x, +x, -z, +z
+// --------------------------------------------------------
+static void GetDifferences(const float* values, unsigned int width, unsigned int height, unsigned int x, unsigned int z, float differences[4])
+{
+	size_t index = (size_t)z * width + x;
+	float center = values[index];
+	differences[0] = x > 0 ? center - values[index - 1] : 0.0f;
+	differences[1] = x < width - 1 ? center - values[index + 1] : 0.0f;
+	differences[2] = z > 0 ? center - values[index - width] : 0.0f;
+	differences[3] = z < height - 1 ? center - values[index + width] : 0.0f;
+}
+
+// --------------------------------------------------------
+// Adds the water flowing in from one neighbor, along with
+// its share of that neighbor's sediment
+// --------------------------------------------------------
+static void AddInflow(const std::vector<float>& water, const std::vector<float>& sediment, const std::vector<float>& outflows,
+	size_t neighbor, int direction, float& waterIn, float& sedimentIn)
+{
+	float flow = outflows[neighbor * 4 + direction];
+	if (flow > 0.0f)
+	{
+		waterIn += flow;
+		sedimentIn += sediment[neighbor] * flow / water[neighbor];
+	}
+}
+
+
+// --------------------------------------------------------
+// Both erosions work in two passes per iteration: every
+// point's outflows to its neighbors are worked out from the
+// last iteration's values, then every point takes away its
+// own outflows and gathers its neighbors'.  Neither pass
+// writes anything another point in the same pass reads, so
+// rows can be split between threads with no effect on the
+// result.
+// --------------------------------------------------------
+void ErodeTerrainHeights(
+	float* heights,
+	unsigned int width,
+	unsigned int height,
+	float xzScale,
+	const TerrainErosionSettings& settings,
+	unsigned int threadCount)
+{
+	if (width < 2 || height < 2)
+		return;
+
+	size_t count = (size_t)width * height;
+	std::vector<float> outflows(count * 4);
+
+	// Thermal: some of each point's excess over the talus height
+	// slides downhill, split in proportion to how far over it
+	// each neighbor is
+	float talus = settings.TalusSlope * xzScale;
+	for (unsigned int iteration = 0; iteration < settings.ThermalIterations; iteration++)
+	{
+		ParallelFor(0u, height, width, MinPointsPerThread, threadCount, [&](unsigned int firstRow, unsigned int endRow)
+			{
+				for (unsigned int z = firstRow; z < endRow; z++)
+				{
+					for (unsigned int x = 0; x < width; x++)
+					{
+						float* outflow = &outflows[((size_t)z * width + x) * 4];
+						GetDifferences(heights, width, height, x, z, outflow);
+
+						float total = 0.0f;
+						float largest = 0.0f;
+						for (int i = 0; i < 4; i++)
+						{
+							outflow[i] = std::max(outflow[i] - talus, 0.0f);
+							total += outflow[i];
+							largest = std::max(largest, outflow[i]);
+						}
+
+						float moved = total > 0.0f ? settings.ThermalRate * largest / total : 0.0f;
+						for (int i = 0; i < 4; i++)
+							outflow[i] *= moved;
+					}
+				}
+			});
+
+		// Heights only change here, and only each point's own
+		ParallelFor(0u, height, width, MinPointsPerThread, threadCount, [&](unsigned int firstRow, unsigned int endRow)
+			{
+				for (unsigned int z = firstRow; z < endRow; z++)
+				{
+					for (unsigned int x = 0; x < width; x++)
+					{
+						size_t index = (size_t)z * width + x;
+						const float* outflow = &outflows[index * 4];
+						heights[index] += GatherInflow(outflows.data(), width, height, x, z) - (outflow[0] + outflow[1] + outflow[2] + outflow[3]);
+					}
+				}
+			});
+	}
+
+	// Hydraulic: rain dissolves the terrain, water flows to
+	// lower neighbors (carrying its sediment), evaporates, and
+	// drops whatever sediment it can no longer carry
+	if (settings.HydraulicIterations > 0)
+	{
+		std::vector<float> water(count, 0.0f);
+		std::vector<float> sediment(count, 0.0f);
+		std::vector<float> nextWater(count);
+		std::vector<float> nextSediment(count);
+		std::vector<float> surface(count);
+		float dissolved = settings.Rain * settings.Solubility;
+
+		for (unsigned int iteration = 0; iteration < settings.HydraulicIterations; iteration++)
+		{
+			ParallelFor(0u, height, width, MinPointsPerThread, threadCount, [&](unsigned int firstRow, unsigned int endRow)
+				{
+					for (size_t i = (size_t)firstRow * width; i < (size_t)endRow * width; i++)
+					{
+						water[i] += settings.Rain;
+						heights[i] -= dissolved;
+						sediment[i] += dissolved;
+						surface[i] = heights[i] + water[i];
+					}
+				});
+
+			// Enough water moves to level the surface with the average of
+			// the lower neighbors (if there's that much), split in
+			// proportion to how much lower each one is
+			ParallelFor(0u, height, width, MinPointsPerThread, threadCount, [&](unsigned int firstRow, unsigned int endRow)
+				{
+					for (unsigned int z = firstRow; z < endRow; z++)
+					{
+						for (unsigned int x = 0; x < width; x++)
+						{
+							size_t index = (size_t)z * width + x;
+							float* outflow = &outflows[index * 4];
+							GetDifferences(surface.data(), width, height, x, z, outflow);
+
+							float total = 0.0f;
+							int lowerCount = 1;
+							for (int i = 0; i < 4; i++)
+							{
+								outflow[i] = std::max(outflow[i], 0.0f);
+								total += outflow[i];
+								lowerCount += outflow[i] > 0.0f;
+							}
+
+							// How far the surface is above that average works out
+							// to the total of the differences over the point count
+							float moved = total > 0.0f ? std::min(water[index], total / lowerCount) / total : 0.0f;
+							for (int i = 0; i < 4; i++)
+								outflow[i] *= moved;
+						}
+					}
+				});
+
+			// Sediment goes along with the water, in proportion
+			ParallelFor(0u, height, width, MinPointsPerThread, threadCount, [&](unsigned int firstRow, unsigned int endRow)
+				{
+					for (unsigned int z = firstRow; z < endRow; z++)
+					{
+						for (unsigned int x = 0; x < width; x++)
+						{
+							size_t index = (size_t)z * width + x;
+							const float* outflow = &outflows[index * 4];
+							float waterOut = outflow[0] + outflow[1] + outflow[2] + outflow[3];
+							float waterLeft = water[index] - waterOut;
+							float sedimentLeft = water[index] > 0.0f ? sediment[index] * waterLeft / water[index] : sediment[index];
+
+							if (x > 0)			AddInflow(water, sediment, outflows, index - 1, 1, waterLeft, sedimentLeft);
+							if (x < width - 1)	AddInflow(water, sediment, outflows, index + 1, 0, waterLeft, sedimentLeft);
+							if (z > 0)			AddInflow(water, sediment, outflows, index - width, 3, waterLeft, sedimentLeft);
+							if (z < height - 1)	AddInflow(water, sediment, outflows, index + width, 2, waterLeft, sedimentLeft);
+
+							waterLeft *= 1.0f - settings.Evaporation;
+							float deposited = std::max(sedimentLeft - settings.Capacity * waterLeft, 0.0f);
+							heights[index] += deposited;
+							nextWater[index] = waterLeft;
+							nextSediment[index] = sedimentLeft - deposited;
+						}
+					}
+				});
+
+			water.swap(nextWater);
+			sediment.swap(nextSediment);
+		}
+
+		// Whatever's still being carried settles where it is
+		for (size_t i = 0; i < count; i++)
+			heights[i] += sediment[i];
+	}
+}
+
+
+void GenerateHeightmap(
+	Heightmap& heightmap,
+	unsigned int width,
+	unsigned int height,
+	const TerrainNoiseSettings& noise,
+	const TerrainErosionSettings& erosion,
+	float xzScale,
+	unsigned int threadCount)
+{
+	std::vector<float> heights((size_t)width * height);
+	GenerateTerrainHeights(heights.data(), width, height, noise, threadCount);
+	ErodeTerrainHeights(heights.data(), width, height, xzScale, erosion, threadCount);
+	heightmap.SetHeights(heights.data(), width, height, xzScale);
+}
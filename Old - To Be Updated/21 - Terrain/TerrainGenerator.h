@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Heightmap.h"
+
+// --------------------------------------------------------
+// Procedural heights, as an alternative to RAW files.
+//
+// Heights start as gradient (Perlin) noise summed over
+// several octaves (fBm), optionally ridged, and optionally
+// domain warped (looked up at positions pushed around by
+// more noise).  Erosion passes can then wear them down:
+// thermal erosion slides material off slopes steeper than
+// the talus slope, and hydraulic erosion rains on the
+// terrain, dissolving it where water flows and depositing
+// it where water slows down.
+//
+// Everything comes from the seed: the noise hashes grid
+// corners rather than using a shuffled table, and every
+// erosion step computes each point's new value from the
+// previous step's values alone.  The rows are split
+// between threads, but the result is the same (bit for
+// bit) for any thread count.
+//
+// The noise is done four points at a time with SSE2.
+// --------------------------------------------------------
+
+struct TerrainNoiseSettings
+{
+	unsigned int Seed;
+	unsigned int Octaves;		// Layers of noise, each finer than the last (6 - 8 is typical)
+	float Frequency;			// Of the first octave, in cycles per grid point (1/256 for features ~256 points apart)
+	float Lacunarity;			// Frequency multiplier per octave (usually 2)
+	float Gain;					// Amplitude multiplier per octave (usually 0.5)
+	bool Ridged;				// Sharp ridges (1 - |noise|) rather than rounded hills
+
+	float WarpStrength;			// How far (in grid points) positions are pushed around; 0 for no warping
+	float WarpFrequency;		// Of the warping noise's first octave
+	unsigned int WarpOctaves;
+
+	float HeightScale;			// World height of the highest possible point (heights go from 0 to this)
+};
+
+struct TerrainErosionSettings
+{
+	unsigned int ThermalIterations;
+	float TalusSlope;			// Steepest slope (rise over run) that doesn't crumble
+	float ThermalRate;			// How much of the excess slides each iteration (0 - 0.5)
+
+	unsigned int HydraulicIterations;
+	float Rain;					// Water added to every point per iteration, in world units
+	float Solubility;			// Terrain dissolved per unit of rain
+	float Capacity;				// Sediment each unit of water can carry
+	float Evaporation;			// Fraction of the water lost per iteration (0 - 1)
+};
+
+// Fills width x height heights (laid out like Heightmap's) with noise.
+// threadCount - 0 uses every hardware thread
+void GenerateTerrainHeights(
+	float* heights,
+	unsigned int width,
+	unsigned int height,
+	const TerrainNoiseSettings& settings,
+	unsigned int threadCount = 0);
+
+// Runs the thermal, then the hydraulic, erosion passes in place
+void ErodeTerrainHeights(
+	float* heights,
+	unsigned int width,
+	unsigned int height,
+	float xzScale,
+	const TerrainErosionSettings& settings,
+	unsigned int threadCount = 0);
+
+// Generates and erodes a whole heightmap, ready for TerrainMesh,
+// ChunkedTerrain, Heightfield or TiledHeightmap::ConvertHeightmap
+void GenerateHeightmap(
+	Heightmap& heightmap,
+	unsigned int width,
+	unsigned int height,
+	const TerrainNoiseSettings& noise,
+	const TerrainErosionSettings& erosion,
+	float xzScale = 1.0f,
+	unsigned int threadCount = 0);
@@ -0,0 +1,202 @@
+#include "TerrainGridLayout.h"
+
+#include <climits>
+#include <cstdlib>
+
+
+// --------------------------------------------------------
+// Adds a rectangle of squares in Morton order: each quarter
+// in turn (-x -z, +x -z, -x +z, +x +z), recursively.  Odd
+// sizes put the extra row/column in the first half, and
+// rectangles one square thin just split in two.
+// --------------------------------------------------------
+static void AddMortonSquares(
+	unsigned int x,
+	unsigned int z,
+	unsigned int sizeX,
+	unsigned int sizeZ,
+	unsigned int squaresX,
+	std::vector<unsigned int>& squares)
+{
+	if (sizeX == 0 || sizeZ == 0)
+		return;
+
+	if (sizeX == 1 && sizeZ == 1)
+	{
+		squares.push_back(z * squaresX + x);
+		return;
+	}
+
+	unsigned int halfX = (sizeX + 1) / 2;
+	unsigned int halfZ = (sizeZ + 1) / 2;
+	AddMortonSquares(x, z, halfX, halfZ, squaresX, squares);
+	AddMortonSquares(x + halfX, z, sizeX - halfX, halfZ, squaresX, squares);
+	AddMortonSquares(x, z + halfZ, halfX, sizeZ - halfZ, squaresX, squares);
+	AddMortonSquares(x + halfX, z + halfZ, sizeX - halfX, sizeZ - halfZ, squaresX, squares);
+}
+
+
+static int Sign(int value) { return (value > 0) - (value < 0); }
+
+// Half, rounded down (towards negative infinity, not zero)
+static int HalfFloor(int value) { return value >= 0 ? value / 2 : -((1 - value) / 2); }
+
+// --------------------------------------------------------
+// Adds a rectangle of squares along a generalized Hilbert
+// curve (Cervený's "gilbert2d").  The rectangle starts at
+// (x, z) and spans (ax, az) along its major axis, which the
+// curve ends up travelling along, and (bx, bz) across it.
+// Long rectangles are split in two along their length;
+// others into three, like a Hilbert curve's U turn.
+// --------------------------------------------------------
+static void AddHilbertSquares(
+	int x,
+	int z,
+	int ax,
+	int az,
+	int bx,
+	int bz,
+	unsigned int squaresX,
+	std::vector<unsigned int>& squares)
+{
+	int length = std::abs(ax + az);
+	int breadth = std::abs(bx + bz);
+	int stepAX = Sign(ax);
+	int stepAZ = Sign(az);
+	int stepBX = Sign(bx);
+	int stepBZ = Sign(bz);
+
+	// A single row or column is just walked along
+	if (breadth == 1 || length == 1)
+	{
+		int count = breadth == 1 ? length : breadth;
+		int stepX = breadth == 1 ? stepAX : stepBX;
+		int stepZ = breadth == 1 ? stepAZ : stepBZ;
+		for (int i = 0; i < count; i++)
+		{
+			squares.push_back(z * squaresX + x);
+			x += stepX;
+			z += stepZ;
+		}
+		return;
+	}
+
+	int ax2 = HalfFloor(ax);
+	int az2 = HalfFloor(az);
+	int bx2 = HalfFloor(bx);
+	int bz2 = HalfFloor(bz);
+	int length2 = std::abs(ax2 + az2);
+	int breadth2 = std::abs(bx2 + bz2);
+
+	if (2 * length > 3 * breadth)
+	{
+		// Prefer even halves, so each half can end where the next starts
+		if ((length2 % 2) && length > 2)
+		{
+			ax2 += stepAX;
+			az2 += stepAZ;
+		}
+
+		AddHilbertSquares(x, z, ax2, az2, bx, bz, squaresX, squares);
+		AddHilbertSquares(x + ax2, z + az2, ax - ax2, az - az2, bx, bz, squaresX, squares);
+	}
+	else
+	{
+		if ((breadth2 % 2) && breadth > 2)
+		{
+			bx2 += stepBX;
+			bz2 += stepBZ;
+		}
+
+		// Up the near side, across the whole far side, then back down
+		AddHilbertSquares(x, z, bx2, bz2, ax2, az2, squaresX, squares);
+		AddHilbertSquares(x + bx2, z + bz2, ax, az, bx - bx2, bz - bz2, squaresX, squares);
+		AddHilbertSquares(
+			x + (ax - stepAX) + (bx2 - stepBX),
+			z + (az - stepAZ) + (bz2 - stepBZ),
+			-bx2, -bz2,
+			-(ax - ax2), -(az - az2),
+			squaresX, squares);
+	}
+}
+
+
+void GetTerrainGridSquareOrder(
+	unsigned int squaresX,
+	unsigned int squaresZ,
+	TerrainGridOrder order,
+	std::vector<unsigned int>& squares)
+{
+	squares.clear();
+	if (squaresX == 0 || squaresZ == 0)
+		return;
+
+	squares.reserve((size_t)squaresX * squaresZ);
+	switch (order)
+	{
+	case TerrainGridOrder::RowMajor:
+		for (unsigned int i = 0; i < squaresX * squaresZ; i++)
+			squares.push_back(i);
+		break;
+
+	case TerrainGridOrder::Morton:
+		AddMortonSquares(0, 0, squaresX, squaresZ, squaresX, squares);
+		break;
+
+	case TerrainGridOrder::Hilbert:
+		// Along the longer side
+		if (squaresX >= squaresZ)
+			AddHilbertSquares(0, 0, (int)squaresX, 0, 0, (int)squaresZ, squaresX, squares);
+		else
+			AddHilbertSquares(0, 0, 0, (int)squaresZ, (int)squaresX, 0, squaresX, squares);
+		break;
+	}
+}
+
+
+void BuildTerrainGridIndices(
+	unsigned int vertsX,
+	unsigned int vertsZ,
+	TerrainGridOrder order,
+	std::vector<unsigned int>& indices,
+	std::vector<unsigned int>* vertexOrder)
+{
+	indices.clear();
+	if (vertexOrder)
+		vertexOrder->clear();
+	if (vertsX < 2 || vertsZ < 2)
+		return;
+
+	unsigned int squaresX = vertsX - 1;
+	std::vector<unsigned int> squares;
+	GetTerrainGridSquareOrder(squaresX, vertsZ - 1, order, squares);
+
+	indices.reserve(squares.size() * 6);
+	for (unsigned int square : squares)
+	{
+		unsigned int vertIndex = (square / squaresX) * vertsX + square % squaresX;
+		indices.push_back(vertIndex);
+		indices.push_back(vertIndex + vertsX);
+		indices.push_back(vertIndex + 1 + vertsX);
+
+		indices.push_back(vertIndex);
+		indices.push_back(vertIndex + 1 + vertsX);
+		indices.push_back(vertIndex + 1);
+	}
+
+	if (!vertexOrder)
+		return;
+
+	// Number the vertices as they're first used
+	std::vector<unsigned int> newIndices((size_t)vertsX * vertsZ, UINT_MAX);
+	vertexOrder->reserve(newIndices.size());
+	for (unsigned int& index : indices)
+	{
+		if (newIndices[index] == UINT_MAX)
+		{
+			newIndices[index] = (unsigned int)vertexOrder->size();
+			vertexOrder->push_back(index);
+		}
+		index = newIndices[index];
+	}
+}
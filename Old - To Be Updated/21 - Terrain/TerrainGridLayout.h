@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+// --------------------------------------------------------
+// Orders for the triangles (and vertices) of a terrain grid.
+//
+// Row by row, a triangle's vertices were last used a whole
+// row earlier - far more vertices ago than the GPU's post
+// transform cache holds - so almost every vertex is shaded
+// twice.  Following a space-filling curve instead keeps
+// consecutive squares close together in both directions,
+// so most vertices are still cached when they come back.
+//
+// Morton (Z) order splits the grid into quarters, and each
+// quarter into quarters, and so on.  Hilbert order does the
+// same, but turns each quarter so the path never jumps.
+// Both work for any grid size (not just powers of 2); the
+// Hilbert curve is the generalized one, which may take a
+// diagonal step on odd-sized grids.
+//
+// Reordering the vertices too (in the order the triangles
+// first use them) means the vertex fetches walk through
+// memory rather than jumping between rows.
+// --------------------------------------------------------
+
+enum class TerrainGridOrder
+{
+	RowMajor,
+	Morton,
+	Hilbert
+};
+
+// The squares of a squaresX x squaresZ grid (as z * squaresX + x)
+// in the given order.  In Morton order, each quarter of the list
+// is one quarter of the grid: (-x, -z), (+x, -z), (-x, +z), (+x, +z).
+void GetTerrainGridSquareOrder(
+	unsigned int squaresX,
+	unsigned int squaresZ,
+	TerrainGridOrder order,
+	std::vector<unsigned int>& squares);
+
+// Two triangles per square of a grid of vertsX x vertsZ vertices,
+// arranged like TerrainMesh's, with the squares in the given order.
+// If vertexOrder isn't null, the vertices are renumbered in the order
+// the triangles first use them, and (*vertexOrder)[i] is the row-major
+// vertex that becomes vertex i.
+void BuildTerrainGridIndices(
+	unsigned int vertsX,
+	unsigned int vertsZ,
+	TerrainGridOrder order,
+	std::vector<unsigned int>& indices,
+	std::vector<unsigned int>* vertexOrder = 0);
@@ -0,0 +1,277 @@
+#include "TerrainOcclusionBaker.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+// Rows below this many points aren't worth another thread
+static const size_t MinPointsPerThread = 4 * 1024;
+
+// Height of the border around the copied heights: low enough that
+// nothing past the edge ever occludes, but not so low that math
+// with it overflows
+static const float BorderHeight = -1.0e30f;
+
+// Each step is this much of the distance so far (but at least one
+// grid point), so nearby occluders are found precisely and distant
+// ones cheaply
+static const float StepGrowth = 0.125f;
+
+
+TerrainOcclusionBaker::TerrainOcclusionBaker() :
+	settings(),
+	width(0),
+	height(0),
+	xzScale(1.0f),
+	highestPoint(0.0f),
+	lastBakeCount(0),
+	padding(0),
+	paddedWidth(0),
+	sunX(0.0f),
+	sunZ(0.0f),
+	sunSlope(0.0f),
+	sunOverhead(true)
+{
+}
+
+
+// --------------------------------------------------------
+// Sets up the steps, directions and bordered heights, then
+// bakes every grid point
+// --------------------------------------------------------
+void TerrainOcclusionBaker::Bake(const Heightmap& heightmap, const TerrainOcclusionSettings& settings, unsigned int threadCount)
+{
+	this->settings = settings;
+	width = heightmap.GetWidth();
+	height = heightmap.GetHeight();
+	xzScale = heightmap.GetXZScale();
+	lastBakeCount = 0;
+	texels.assign((size_t)width * height * 2, 255);
+	if (width == 0 || height == 0)
+		return;
+
+	// Step lengths, out to the search distance
+	steps.clear();
+	float maxSteps = settings.MaxDistance / xzScale;
+	for (float t = 1.0f; t <= maxSteps; t += std::max(1.0f, t * StepGrowth))
+		steps.push_back(t);
+
+	// Directions evenly around the circle.  Nearly-zero parts are
+	// made exactly zero, or rays along the edge of the map would
+	// blend in a sliver of the border and find nothing.
+	directionX.clear();
+	directionZ.clear();
+	for (unsigned int i = 0; i < settings.DirectionCount; i++)
+	{
+		float angle = DirectX::XM_2PI * i / settings.DirectionCount;
+		float x = std::cos(angle);
+		float z = std::sin(angle);
+		directionX.push_back(std::abs(x) < 1.0e-6f ? 0.0f : x);
+		directionZ.push_back(std::abs(z) < 1.0e-6f ? 0.0f : z);
+	}
+
+	// The sun is the opposite way the light travels
+	float toSunX = -settings.SunDirection.x;
+	float toSunY = -settings.SunDirection.y;
+	float toSunZ = -settings.SunDirection.z;
+	float flatLength = std::sqrt(toSunX * toSunX + toSunZ * toSunZ);
+	sunOverhead = flatLength < 1.0e-6f;
+	sunX = sunOverhead ? 0.0f : toSunX / flatLength;
+	sunZ = sunOverhead ? 0.0f : toSunZ / flatLength;
+	sunSlope = sunOverhead ? 0.0f : toSunY / flatLength;
+
+	// Room for the longest step, plus the rest of a group of four
+	// and the extra sample bilinear filtering reads
+	float longest = steps.empty() ? 0.0f : steps.back();
+	padding = (unsigned int)std::ceil(longest) + 8;
+	paddedWidth = width + padding * 2;
+	paddedHeights.assign((size_t)paddedWidth * (height + padding * 2), BorderHeight);
+	CopyHeights(heightmap, 0, 0, width - 1, height - 1);
+
+	BakeRegion(0, 0, width - 1, height - 1, threadCount);
+}
+
+
+// --------------------------------------------------------
+// Copies in the changed heights, then re-bakes every point
+// whose rays could pass over them
+// --------------------------------------------------------
+void TerrainOcclusionBaker::Rebake(
+	const Heightmap& heightmap,
+	unsigned int minX,
+	unsigned int minZ,
+	unsigned int maxX,
+	unsigned int maxZ,
+	unsigned int threadCount)
+{
+	lastBakeCount = 0;
+	if (heightmap.GetWidth() != width || heightmap.GetHeight() != height || width == 0 || height == 0)
+		return;
+
+	maxX = std::min(maxX, width - 1);
+	maxZ = std::min(maxZ, height - 1);
+	if (minX > maxX || minZ > maxZ)
+		return;
+
+	CopyHeights(heightmap, minX, minZ, maxX, maxZ);
+
+	// A ray's samples reach one grid point past its longest step
+	unsigned int reach = (unsigned int)std::ceil(steps.empty() ? 0.0f : steps.back()) + 1;
+	BakeRegion(
+		minX > reach ? minX - reach : 0,
+		minZ > reach ? minZ - reach : 0,
+		std::min(maxX + reach, width - 1),
+		std::min(maxZ + reach, height - 1),
+		threadCount);
+}
+
+
+// --------------------------------------------------------
+// Copies part of the heightmap inside the border, and finds
+// the highest point (which lets rays stop early once nothing
+// further along could block them)
+// --------------------------------------------------------
+void TerrainOcclusionBaker::CopyHeights(const Heightmap& heightmap, unsigned int minX, unsigned int minZ, unsigned int maxX, unsigned int maxZ)
+{
+	for (unsigned int z = minZ; z <= maxZ; z++)
+	{
+		const float* source = heightmap.GetData() + (size_t)z * width;
+		std::copy(source + minX, source + maxX + 1, &paddedHeights[(size_t)(z + padding) * paddedWidth + padding + minX]);
+	}
+
+	const float* data = heightmap.GetData();
+	highestPoint = *std::max_element(data, data + (size_t)width * height);
+}
+
+
+// --------------------------------------------------------
+// Bakes a rectangle of points (inclusive), a group of four
+// along each row at a time
+// --------------------------------------------------------
+void TerrainOcclusionBaker::BakeRegion(unsigned int minX, unsigned int minZ, unsigned int maxX, unsigned int maxZ, unsigned int threadCount)
+{
+	unsigned int across = maxX - minX + 1;
+	ParallelFor(minZ, maxZ + 1, across, MinPointsPerThread, threadCount, [&](unsigned int firstRow, unsigned int endRow)
+		{
+			for (unsigned int z = firstRow; z < endRow; z++)
+				for (unsigned int x = minX; x <= maxX; x += 4)
+					BakeGroup(x, z, std::min(4u, maxX + 1 - x));
+		});
+
+	lastBakeCount = (size_t)across * (maxZ - minZ + 1);
+}
+
+
+// --------------------------------------------------------
+// Bakes up to four neighboring points in a row.  Every ray
+// from them takes the same steps in the same directions,
+// so their samples are always four neighbors in a row too.
+// --------------------------------------------------------
+void TerrainOcclusionBaker::BakeGroup(unsigned int x, unsigned int z, unsigned int count)
+{
+	const float* start = &paddedHeights[(size_t)(z + padding) * paddedWidth + padding + x];
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 highest = _mm_set1_ps(highestPoint);
+
+	// Points past the end of the row start at the highest point,
+	// so they never keep the others' rays from stopping early
+	alignas(16) float origins[4] = { highestPoint, highestPoint, highestPoint, highestPoint };
+	std::copy(start, start + count, origins);
+	__m128 origin = _mm_load_ps(origins);
+
+	// Bilinear sample of the four points' neighbors at an offset
+	// (in grid points) shared by all of them
+	auto sample = [&](float offsetX, float offsetZ)
+		{
+			float floorX = std::floor(offsetX);
+			float floorZ = std::floor(offsetZ);
+			const float* corner = start + (ptrdiff_t)floorZ * paddedWidth + (ptrdiff_t)floorX;
+			__m128 fracX = _mm_set1_ps(offsetX - floorX);
+			__m128 fracZ = _mm_set1_ps(offsetZ - floorZ);
+
+			__m128 near0 = _mm_loadu_ps(corner);
+			__m128 near1 = _mm_loadu_ps(corner + 1);
+			__m128 far0 = _mm_loadu_ps(corner + paddedWidth);
+			__m128 far1 = _mm_loadu_ps(corner + paddedWidth + 1);
+			__m128 nearRow = _mm_add_ps(near0, _mm_mul_ps(_mm_sub_ps(near1, near0), fracX));
+			__m128 farRow = _mm_add_ps(far0, _mm_mul_ps(_mm_sub_ps(far1, far0), fracX));
+			return _mm_add_ps(nearRow, _mm_mul_ps(_mm_sub_ps(farRow, nearRow), fracZ));
+		};
+
+	// Horizons: the steepest rise in each direction, then the sky
+	// visible above it in that slice, 1 - sin(elevation)
+	__m128 visibleSky = _mm_setzero_ps();
+	for (size_t d = 0; d < directionX.size(); d++)
+	{
+		__m128 steepest = _mm_setzero_ps();
+		for (float t : steps)
+		{
+			// Nothing further out can rise above the current horizon
+			__m128 distance = _mm_set1_ps(t * xzScale);
+			if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_sub_ps(highest, origin), _mm_mul_ps(steepest, distance))) == 0)
+				break;
+
+			__m128 rise = _mm_div_ps(_mm_sub_ps(sample(directionX[d] * t, directionZ[d] * t), origin), distance);
+			steepest = _mm_max_ps(steepest, rise);
+		}
+
+		__m128 sine = _mm_div_ps(steepest, _mm_sqrt_ps(_mm_add_ps(one, _mm_mul_ps(steepest, steepest))));
+		visibleSky = _mm_add_ps(visibleSky, _mm_sub_ps(one, sine));
+	}
+	__m128 occlusion = directionX.empty() ? one : _mm_div_ps(visibleSky, _mm_set1_ps((float)directionX.size()));
+
+	// Sun: how far the ray towards it stays above the terrain,
+	// relative to the penumbra's width at that distance
+	__m128 sun = one;
+	if (!sunOverhead && sunSlope <= 0.0f)
+		sun = _mm_setzero_ps();
+	else if (!sunOverhead)
+	{
+		__m128 softness = _mm_set1_ps(settings.ShadowSoftness);
+		for (float t : steps)
+		{
+			__m128 distance = _mm_set1_ps(t * xzScale);
+			__m128 rayHeight = _mm_add_ps(origin, _mm_mul_ps(_mm_set1_ps(sunSlope), distance));
+			__m128 penumbra = _mm_mul_ps(softness, distance);
+
+			// Once the ray is far enough above everything, it stays that way
+			if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(rayHeight, highest), penumbra)) == 0)
+				break;
+
+			__m128 clearance = _mm_sub_ps(rayHeight, sample(sunX * t, sunZ * t));
+			__m128 lit = settings.ShadowSoftness > 0.0f ?
+				_mm_div_ps(clearance, penumbra) :
+				_mm_and_ps(_mm_cmpge_ps(clearance, _mm_setzero_ps()), one);
+			sun = _mm_min_ps(sun, _mm_max_ps(lit, _mm_setzero_ps()));
+		}
+	}
+
+	alignas(16) float occlusionValues[4];
+	alignas(16) float sunValues[4];
+	_mm_store_ps(occlusionValues, occlusion);
+	_mm_store_ps(sunValues, sun);
+
+	uint8_t* out = &texels[((size_t)z * width + x) * 2];
+	for (unsigned int i = 0; i < count; i++)
+	{
+		out[i * 2 + 0] = (uint8_t)std::lround(std::clamp(occlusionValues[i], 0.0f, 1.0f) * 255.0f);
+		out[i * 2 + 1] = (uint8_t)std::lround(std::clamp(sunValues[i], 0.0f, 1.0f) * 255.0f);
+	}
+}
+
+
+unsigned int TerrainOcclusionBaker::GetWidth() const { return width; }
+unsigned int TerrainOcclusionBaker::GetHeight() const { return height; }
+const std::vector<uint8_t>& TerrainOcclusionBaker::GetTexels() const { return texels; }
+size_t TerrainOcclusionBaker::GetLastBakeCount() const { return lastBakeCount; }
+
+float TerrainOcclusionBaker::GetOcclusion(unsigned int x, unsigned int z) const
+{
+	return texels[((size_t)z * width + x) * 2 + 0] / 255.0f;
+}
+
+float TerrainOcclusionBaker::GetSunVisibility(unsigned int x, unsigned int z) const
+{
+	return texels[((size_t)z * width + x) * 2 + 1] / 255.0f;
+}
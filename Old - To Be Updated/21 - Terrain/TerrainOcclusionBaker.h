@@ -0,0 +1,105 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+#include "Heightmap.h"
+
+// --------------------------------------------------------
+// Bakes ambient occlusion and a sun shadow mask for every
+// heightmap grid point, ahead of time on the CPU, so the
+// terrain pixel shader only has to sample a texture.
+//
+// Occlusion comes from the horizon: rays are marched out
+// across the heights in several directions, tracking the
+// highest elevation angle seen in each, and the sky visible
+// above those horizons is averaged.  The sun mask marches
+// one more ray towards the sun, fading out wherever the
+// terrain rises above it.
+//
+// Steps get longer further from each point, and four points
+// in a row march together with SSE: at the same offset,
+// their samples are side by side in memory and share the
+// same bilinear weights.  The heights are copied with a
+// border of very low heights around them, so rays can run
+// off the edge without any bounds checks (and never find an
+// occluder there).
+//
+// After the heights change in some region, Rebake() redoes
+// only the points close enough for their rays to reach it.
+//
+// Results are two bytes per point, ready for an
+// R8G8_UNORM texture: red is ambient occlusion (1 is open
+// sky) and green is sun visibility (1 is fully lit).
+// --------------------------------------------------------
+
+struct TerrainOcclusionSettings
+{
+	unsigned int DirectionCount;		// Horizon directions around each point (8 - 16 is typical)
+	float MaxDistance;					// How far (in world units) to look for occluders
+	DirectX::XMFLOAT3 SunDirection;		// Direction the sun's light travels, like a directional Light's
+	float ShadowSoftness;				// Penumbra width, as a slope above the shadow's edge (0 for hard shadows)
+};
+
+class TerrainOcclusionBaker
+{
+public:
+	TerrainOcclusionBaker();
+
+	// Bakes every grid point
+	// threadCount - 0 uses every hardware thread
+	void Bake(const Heightmap& heightmap, const TerrainOcclusionSettings& settings, unsigned int threadCount = 0);
+
+	// Re-bakes after the heights from (minX, minZ) to (maxX, maxZ)
+	// (inclusive grid points) changed, with the heightmap still the
+	// same size and the settings the same as the last Bake()
+	void Rebake(
+		const Heightmap& heightmap,
+		unsigned int minX,
+		unsigned int minZ,
+		unsigned int maxX,
+		unsigned int maxZ,
+		unsigned int threadCount = 0);
+
+	unsigned int GetWidth() const;
+	unsigned int GetHeight() const;
+
+	// Two bytes per grid point, in Heightmap.h's row order: occlusion, then sun
+	const std::vector<uint8_t>& GetTexels() const;
+	float GetOcclusion(unsigned int x, unsigned int z) const;
+	float GetSunVisibility(unsigned int x, unsigned int z) const;
+
+	// Points baked by the last Bake() or Rebake()
+	size_t GetLastBakeCount() const;
+
+private:
+	void CopyHeights(const Heightmap& heightmap, unsigned int minX, unsigned int minZ, unsigned int maxX, unsigned int maxZ);
+	void BakeRegion(unsigned int minX, unsigned int minZ, unsigned int maxX, unsigned int maxZ, unsigned int threadCount);
+	void BakeGroup(unsigned int x, unsigned int z, unsigned int count);
+
+	TerrainOcclusionSettings settings;
+	unsigned int width;
+	unsigned int height;
+	float xzScale;
+	float highestPoint;
+	size_t lastBakeCount;
+
+	// Heights with a border wide enough for the longest step
+	std::vector<float> paddedHeights;
+	unsigned int padding;
+	unsigned int paddedWidth;
+
+	// Step lengths (in grid points) and directions, the same for every ray
+	std::vector<float> steps;
+	std::vector<float> directionX;
+	std::vector<float> directionZ;
+
+	// Towards the sun, and how steeply it rises
+	float sunX;
+	float sunZ;
+	float sunSlope;
+	bool sunOverhead;
+
+	std::vector<uint8_t> texels;
+};
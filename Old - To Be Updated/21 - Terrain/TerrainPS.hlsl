@@ -38,6 +38,9 @@ Texture2D NormalMap2			: register(t10);
 Texture2D RoughnessMap2			: register(t11);
 Texture2D MetalMap2				: register(t12);
 
+// Baked ambient occlusion (r) and sun visibility (g), one texel per grid point
+Texture2D OcclusionMap			: register(t13);
+
 SamplerState BasicSampler				: register(s0);
 
 
@@ -69,6 +72,11 @@ float4 main(VertexToPixel input) : SV_TARGET
 	// Sample splat map at standard UV scaling
 	float4 blendValues = BlendMap.Sample(BasicSampler, input.uv);
 
+	// Occlusion texel centers sit on the grid points (the vertices)
+	float2 occlusionSize;
+	OcclusionMap.GetDimensions(occlusionSize.x, occlusionSize.y);
+	float2 occlusion = OcclusionMap.Sample(BasicSampler, input.uv + 0.5f / occlusionSize).rg;
+
 	// Adjust uv scaling for other maps
 	input.uv = input.uv * uvScale + uvOffset;
 
@@ -102,8 +110,8 @@ float4 main(VertexToPixel input) : SV_TARGET
 	// because of linear texture sampling, so we want lerp the specular color to match
 	float3 specColor = lerp(F0_NON_METAL.rrr, surfaceColor, metal);
 
-	// Start off with ambient
-	float3 totalLight = ambientColor * surfaceColor;
+	// Start off with ambient, less whatever the terrain hides of the sky
+	float3 totalLight = ambientColor * surfaceColor * occlusion.r;
 
 	// Loop and handle all lights
 	for (int i = 0; i < lightCount; i++)
@@ -116,7 +124,8 @@ float4 main(VertexToPixel input) : SV_TARGET
 		switch (light.Type)
 		{
 		case LIGHT_TYPE_DIRECTIONAL:
-			totalLight += DirLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor, specColor);
+			// The first light is the sun the shadows were baked for
+			totalLight += DirLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor, specColor) * (i == 0 ? occlusion.g : 1.0f);
 			break;
 
 		case LIGHT_TYPE_POINT:
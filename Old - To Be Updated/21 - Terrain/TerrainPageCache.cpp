@@ -0,0 +1,479 @@
+#include "TerrainPageCache.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// Page table entries with this level have no page to use (which
+// only happens if the coarsest level couldn't be baked)
+static const uint8_t NoPageLevel = 255;
+
+
+TerrainPageCache::TerrainPageCache() :
+	settings{},
+	frame(0),
+	worldMinX(0),
+	worldMinZ(0),
+	worldSizeX(1),
+	worldSizeZ(1),
+	minHeight(0),
+	maxHeight(0),
+	cameraPosition{},
+	wantedPages(0),
+	pendingPages(0),
+	pageTableChanged(false),
+	bakedPages(0),
+	evictedPages(0),
+	totalBakeMs(0),
+	maxBakeMs(0),
+	lastUpdateMs(0),
+	stopping(false)
+{
+}
+
+TerrainPageCache::~TerrainPageCache()
+{
+	Stop();
+}
+
+const std::vector<TerrainPageUpload>& TerrainPageCache::GetUploads() const { return uploads; }
+const std::vector<uint8_t>& TerrainPageCache::GetPageTable() const { return pageTable; }
+bool TerrainPageCache::PageTableChanged() const { return pageTableChanged; }
+unsigned int TerrainPageCache::GetPaddedPageSize() const { return settings.PageSize + settings.PageBorder * 2; }
+unsigned int TerrainPageCache::GetAtlasSize() const { return GetPaddedPageSize() * settings.AtlasPagesAcross; }
+const TerrainPageCacheSettings& TerrainPageCache::GetSettings() const { return settings; }
+
+unsigned int TerrainPageCache::GetWantedLevel(unsigned int pageX, unsigned int pageY) const
+{
+	return wantedLevels[(size_t)pageY * settings.PagesAcross + pageX];
+}
+
+bool TerrainPageCache::IsResident(unsigned int level, unsigned int pageX, unsigned int pageY) const
+{
+	return cache.count(MakeKey(level, pageX, pageY)) > 0;
+}
+
+uint64_t TerrainPageCache::MakeKey(unsigned int level, unsigned int pageX, unsigned int pageY)
+{
+	return ((uint64_t)level << 48) | ((uint64_t)pageY << 24) | pageX;
+}
+
+
+// --------------------------------------------------------
+// Checks the settings, works out where the terrain is,
+// starts the bake threads and bakes the whole coarsest
+// level with them
+// --------------------------------------------------------
+bool TerrainPageCache::Init(
+	std::shared_ptr<TerrainSplatCompositor> compositor,
+	const Heightmap& heightmap,
+	const TerrainPageCacheSettings& settings,
+	unsigned int threadCount)
+{
+	Stop();
+	requests.clear();
+	baking.clear();
+	baked.clear();
+
+	this->compositor.reset();
+	this->settings = settings;
+	cache.clear();
+	recent.clear();
+	freeSlots.clear();
+	uploads.clear();
+	pageTable.clear();
+	wantedLevels.clear();
+	frame = 0;
+	wantedPages = 0;
+	pendingPages = 0;
+	bakedPages = 0;
+	evictedPages = 0;
+	totalBakeMs = 0;
+	maxBakeMs = 0;
+	lastUpdateMs = 0;
+
+	// Levels can't go below a single page, and slot
+	// coordinates have to fit in the page table's bytes
+	unsigned int pagesAcross = settings.PagesAcross;
+	if (!compositor || settings.PageSize == 0 || pagesAcross == 0 || (pagesAcross & (pagesAcross - 1)) != 0)
+		return false;
+	if (settings.AtlasPagesAcross == 0 || settings.AtlasPagesAcross > 256)
+		return false;
+
+	unsigned int maxLevels = 1;
+	while ((pagesAcross >> maxLevels) > 0)
+		maxLevels++;
+	this->settings.LevelCount = std::clamp(settings.LevelCount, 1u, maxLevels);
+	this->settings.MaxBakesPerUpdate = std::max(settings.MaxBakesPerUpdate, 1u);
+
+	unsigned int coarsest = this->settings.LevelCount - 1;
+	unsigned int coarsestAcross = pagesAcross >> coarsest;
+	unsigned int slotCount = settings.AtlasPagesAcross * settings.AtlasPagesAcross;
+	if (coarsestAcross * coarsestAcross > slotCount)
+		return false;
+	this->compositor = compositor;
+
+	// The mesh's uv runs from 0 at the first grid point to 1 a point past the last
+	worldMinX = heightmap.GetWorldX(0);
+	worldMinZ = heightmap.GetWorldZ(0);
+	worldSizeX = heightmap.GetWidth() * heightmap.GetXZScale();
+	worldSizeZ = heightmap.GetHeight() * heightmap.GetXZScale();
+	size_t heightCount = (size_t)heightmap.GetWidth() * heightmap.GetHeight();
+	if (heightCount > 0)
+	{
+		auto range = std::minmax_element(heightmap.GetData(), heightmap.GetData() + heightCount);
+		minHeight = *range.first;
+		maxHeight = *range.second;
+	}
+
+	for (unsigned int slot = slotCount; slot > 0; slot--)
+		freeSlots.push_back(slot - 1);
+
+	size_t entryCount = (size_t)pagesAcross * pagesAcross;
+	pageTable.assign(entryCount * 4, 0);
+	wantedLevels.assign(entryCount, 0);
+
+	if (threadCount == 0)
+		threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned int i = 0; i < threadCount; i++)
+		threads.emplace_back(&TerrainPageCache::BakeThread, this);
+
+	// With the camera infinitely far away, only the coarsest level is wanted
+	cameraPosition[0] = cameraPosition[1] = cameraPosition[2] = FLT_MAX;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (unsigned int y = 0; y < coarsestAcross; y++)
+			for (unsigned int x = 0; x < coarsestAcross; x++)
+				requests.push_back({ MakeKey(coarsest, x, y), 0.0f });
+	}
+	wake.notify_all();
+
+	WaitForBakes();
+	AddBakedPages();
+	BuildPageTable();
+	pageTableChanged = true;
+	return true;
+}
+
+// --------------------------------------------------------
+// Stops the bake threads (after any page they're working on)
+// --------------------------------------------------------
+void TerrainPageCache::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& thread : threads)
+		thread.join();
+	threads.clear();
+	stopping = false;
+}
+
+void TerrainPageCache::WaitForBakes()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [&]() { return requests.empty() && baking.empty(); });
+}
+
+
+// --------------------------------------------------------
+// Takes in the pages baked since last time, marks the pages
+// the camera wants as used, queues the most important of
+// the missing ones and updates the page table
+// --------------------------------------------------------
+void TerrainPageCache::Update(const float cameraPosition[3])
+{
+	uploads.clear();
+	if (!compositor)
+		return;
+
+	Clock::time_point start = Clock::now();
+	this->cameraPosition[0] = cameraPosition[0];
+	this->cameraPosition[1] = cameraPosition[1];
+	this->cameraPosition[2] = cameraPosition[2];
+	AddBakedPages();
+	frame++;
+
+	unsigned int coarsest = settings.LevelCount - 1;
+	unsigned int coarsestAcross = settings.PagesAcross >> coarsest;
+	std::vector<PageRequest> missing;
+	wantedPages = 0;
+	for (unsigned int y = 0; y < coarsestAcross; y++)
+		for (unsigned int x = 0; x < coarsestAcross; x++)
+			Want(coarsest, x, y, missing);
+
+	// Whatever's wanted but still not resident waits for later
+	// updates, and only pages that aren't wanted can make room
+	unsigned int wantedResident = 0;
+	for (uint64_t key : recent)
+	{
+		if (cache.find(key)->second.LastWanted != frame)
+			break;
+		wantedResident++;
+	}
+	pendingPages = wantedPages - wantedResident;
+	size_t freeableSlots = freeSlots.size() + cache.size() - wantedResident;
+
+	// Coarser levels first, as they're the fallbacks for finer
+	// ones, then closest first
+	std::sort(missing.begin(), missing.end(), [](const PageRequest& a, const PageRequest& b)
+		{
+			if ((a.Key >> 48) != (b.Key >> 48))
+				return (a.Key >> 48) > (b.Key >> 48);
+			return a.Distance < b.Distance;
+		});
+
+	// Replace the queue (the camera may have moved on from what was
+	// in it), leaving out pages the threads already have, and not
+	// baking more than there will be slots for
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto alreadyBaking = [&](const PageRequest& request)
+			{
+				return std::find(baking.begin(), baking.end(), request.Key) != baking.end() ||
+					std::any_of(baked.begin(), baked.end(), [&](const BakedPage& page) { return page.Key == request.Key; });
+			};
+		missing.erase(std::remove_if(missing.begin(), missing.end(), alreadyBaking), missing.end());
+
+		size_t inFlight = baking.size() + baked.size();
+		size_t queueSize = std::min<size_t>(settings.MaxBakesPerUpdate, freeableSlots - std::min(freeableSlots, inFlight));
+		if (missing.size() > queueSize)
+			missing.resize(queueSize);
+		requests.assign(missing.rbegin(), missing.rend());
+	}
+	wake.notify_all();
+
+	BuildPageTable();
+	lastUpdateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+
+// --------------------------------------------------------
+// Closest distance from the camera to a page's part of
+// the terrain (as a box from its lowest to highest point)
+// --------------------------------------------------------
+float TerrainPageCache::GetDistance(unsigned int level, unsigned int pageX, unsigned int pageY) const
+{
+	float pageUV = (float)(1u << level) / settings.PagesAcross;
+	float minX = worldMinX + pageX * pageUV * worldSizeX;
+	float minZ = worldMinZ + pageY * pageUV * worldSizeZ;
+	float maxX = minX + pageUV * worldSizeX;
+	float maxZ = minZ + pageUV * worldSizeZ;
+
+	float dx = std::max({ minX - cameraPosition[0], cameraPosition[0] - maxX, 0.0f });
+	float dy = std::max({ minHeight - cameraPosition[1], cameraPosition[1] - maxHeight, 0.0f });
+	float dz = std::max({ minZ - cameraPosition[2], cameraPosition[2] - maxZ, 0.0f });
+	return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+// --------------------------------------------------------
+// Whether the camera is close enough to a page to want its
+// children instead.  Level L is used from LevelDistance *
+// 2^(L - 1) out, so the resolution halves as distance doubles.
+// --------------------------------------------------------
+bool TerrainPageCache::WantsFinerLevel(unsigned int level, unsigned int pageX, unsigned int pageY) const
+{
+	return level > 0 && GetDistance(level, pageX, pageY) < std::ldexp(settings.LevelDistance, (int)level - 1);
+}
+
+// --------------------------------------------------------
+// Marks a page (and the finer ones below it the camera
+// wants) as wanted, adding those that aren't resident to
+// the missing list
+// --------------------------------------------------------
+void TerrainPageCache::Want(unsigned int level, unsigned int pageX, unsigned int pageY, std::vector<PageRequest>& missing)
+{
+	wantedPages++;
+	uint64_t key = MakeKey(level, pageX, pageY);
+	auto cached = cache.find(key);
+	if (cached != cache.end())
+	{
+		cached->second.LastWanted = frame;
+		recent.splice(recent.begin(), recent, cached->second.Recent);
+	}
+	else
+	{
+		missing.push_back({ key, GetDistance(level, pageX, pageY) });
+	}
+
+	if (WantsFinerLevel(level, pageX, pageY))
+	{
+		for (unsigned int child = 0; child < 4; child++)
+			Want(level - 1, pageX * 2 + (child & 1), pageY * 2 + (child >> 1), missing);
+	}
+}
+
+
+// --------------------------------------------------------
+// Bakes the queued pages, closest first, until Stop().  The
+// lock is released while compositing.
+// --------------------------------------------------------
+void TerrainPageCache::BakeThread()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wake.wait(lock, [&]() { return stopping || !requests.empty(); });
+		if (stopping)
+			return;
+
+		uint64_t key = requests.back().Key;
+		requests.pop_back();
+		baking.push_back(key);
+
+		lock.unlock();
+		BakedPage page = { key, {}, 0.0 };
+		Clock::time_point start = Clock::now();
+		BakePage(key, page.Upload);
+		page.BakeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		lock.lock();
+
+		baking.erase(std::find(baking.begin(), baking.end(), key));
+		baked.push_back(std::move(page));
+		finished.notify_all();
+	}
+}
+
+// --------------------------------------------------------
+// Composites one page, its border included, at its level's
+// resolution.  Only reads what's fixed between Init()s.
+// --------------------------------------------------------
+void TerrainPageCache::BakePage(uint64_t key, TerrainPageUpload& upload) const
+{
+	unsigned int level = (unsigned int)(key >> 48);
+	unsigned int pageY = (unsigned int)(key >> 24) & 0xFFFFFF;
+	unsigned int pageX = (unsigned int)key & 0xFFFFFF;
+
+	float pageUV = (float)(1u << level) / settings.PagesAcross;
+	float texelSize = pageUV / settings.PageSize;
+	float u = pageX * pageUV - settings.PageBorder * texelSize;
+	float v = pageY * pageUV - settings.PageBorder * texelSize;
+
+	unsigned int paddedSize = GetPaddedPageSize();
+	size_t pageBytes = (size_t)paddedSize * paddedSize * 4;
+	upload.AlbedoRoughness.resize(pageBytes);
+	upload.NormalMetal.resize(pageBytes);
+	compositor->Composite(u, v, texelSize, paddedSize, upload.AlbedoRoughness.data(), upload.NormalMetal.data(), (size_t)paddedSize * 4);
+}
+
+// --------------------------------------------------------
+// Finds each baked page a slot (a free one, or else the
+// least recently used page's, as long as it wasn't wanted
+// last frame) and moves it to the uploads.  Pages that
+// don't get a slot are dropped, to be asked for again.
+// --------------------------------------------------------
+void TerrainPageCache::AddBakedPages()
+{
+	std::vector<BakedPage> pages;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pages.swap(baked);
+	}
+
+	for (BakedPage& page : pages)
+	{
+		bakedPages++;
+		totalBakeMs += page.BakeMs;
+		maxBakeMs = std::max(maxBakeMs, page.BakeMs);
+		if (cache.count(page.Key))
+			continue;
+
+		unsigned int slot;
+		if (!freeSlots.empty())
+		{
+			slot = freeSlots.back();
+			freeSlots.pop_back();
+		}
+		else
+		{
+			if (recent.empty())
+				break;
+
+			auto oldest = cache.find(recent.back());
+			if (oldest->second.LastWanted == frame)
+				break;
+
+			slot = oldest->second.Slot;
+			cache.erase(oldest);
+			recent.pop_back();
+			evictedPages++;
+		}
+
+		recent.push_front(page.Key);
+		cache[page.Key] = { slot, recent.begin(), frame };
+		page.Upload.SlotX = slot % settings.AtlasPagesAcross;
+		page.Upload.SlotY = slot / settings.AtlasPagesAcross;
+		uploads.push_back(std::move(page.Upload));
+	}
+}
+
+
+// --------------------------------------------------------
+// Walks down the same quadtree as Update(), carrying the
+// finest resident page so far, and writes it into every
+// level 0 entry a page the camera doesn't split covers
+// --------------------------------------------------------
+void TerrainPageCache::FillPageTable(unsigned int level, unsigned int pageX, unsigned int pageY, uint32_t entry)
+{
+	auto cached = cache.find(MakeKey(level, pageX, pageY));
+	if (cached != cache.end())
+	{
+		unsigned int slot = cached->second.Slot;
+		entry = (slot % settings.AtlasPagesAcross) | ((slot / settings.AtlasPagesAcross) << 8) | (level << 16);
+	}
+
+	if (WantsFinerLevel(level, pageX, pageY))
+	{
+		for (unsigned int child = 0; child < 4; child++)
+			FillPageTable(level - 1, pageX * 2 + (child & 1), pageY * 2 + (child >> 1), entry);
+		return;
+	}
+
+	uint8_t bytes[4] = { (uint8_t)entry, (uint8_t)(entry >> 8), (uint8_t)(entry >> 16), 0 };
+	unsigned int span = 1u << level;
+	for (unsigned int y = pageY * span; y < (pageY + 1) * span; y++)
+	{
+		for (unsigned int x = pageX * span; x < (pageX + 1) * span; x++)
+		{
+			size_t index = (size_t)y * settings.PagesAcross + x;
+			if (std::memcmp(&pageTable[index * 4], bytes, 4) != 0)
+			{
+				std::memcpy(&pageTable[index * 4], bytes, 4);
+				pageTableChanged = true;
+			}
+			wantedLevels[index] = (uint8_t)level;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Rewrites the page table in place, noting whether any
+// entry changed (so it's only uploaded when it has to be)
+// --------------------------------------------------------
+void TerrainPageCache::BuildPageTable()
+{
+	pageTableChanged = false;
+	unsigned int coarsest = settings.LevelCount - 1;
+	unsigned int coarsestAcross = settings.PagesAcross >> coarsest;
+	for (unsigned int y = 0; y < coarsestAcross; y++)
+		for (unsigned int x = 0; x < coarsestAcross; x++)
+			FillPageTable(coarsest, x, y, (uint32_t)NoPageLevel << 16);
+}
+
+
+TerrainPageCacheStats TerrainPageCache::GetStats() const
+{
+	TerrainPageCacheStats stats = {};
+	stats.ResidentPages = (unsigned int)cache.size();
+	stats.WantedPages = wantedPages;
+	stats.PendingPages = pendingPages;
+	stats.BakedPages = bakedPages;
+	stats.EvictedPages = evictedPages;
+	stats.AverageBakeMs = bakedPages ? (float)(totalBakeMs / bakedPages) : 0.0f;
+	stats.MaxBakeMs = (float)maxBakeMs;
+	stats.LastUpdateMs = (float)lastUpdateMs;
+	return stats;
+}
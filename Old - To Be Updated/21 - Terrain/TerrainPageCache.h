@@ -0,0 +1,196 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Heightmap.h"
+#include "TerrainSplatCompositor.h"
+
+// --------------------------------------------------------
+// Decides which pages of the terrain's virtual texture are
+// baked, keeps them in the slots of a fixed size atlas, and
+// builds the page table the pixel shader finds them with.
+//
+// The virtual texture covers the terrain's uv square with
+// PagesAcross x PagesAcross pages at level 0, and half as
+// many across at each coarser level.  Pages are picked like
+// a quadtree: starting from the coarsest level, a page is
+// split into its four children while the camera is closer
+// than LevelDistance (doubling with each level) to it.
+// Every page on the way down is wanted, so each one has a
+// coarser fallback, and the coarsest level is always wanted
+// in full.
+//
+// Update() queues a few of the missing pages (coarsest and
+// then closest first) for the bake threads, which composite
+// them with the splat compositor in the background.  Pages
+// they finish are picked up by the next Update(), taking
+// free slots or ones from pages that weren't wanted last
+// frame, least recently used first.  Each page is baked
+// with a border of its neighbors' texels, so filtering
+// never reads another page.
+//
+// The page table has an entry for every level 0 page: the
+// atlas slot and level of the finest resident page covering
+// it that's no finer than the camera wants there.  It's
+// rewritten in place each Update(), noting whether any
+// entry actually changed.
+// --------------------------------------------------------
+
+struct TerrainPageCacheSettings
+{
+	unsigned int PageSize;			// Texels across each page, not counting its border
+	unsigned int PageBorder;		// Texels of border on each side of a page
+	unsigned int PagesAcross;		// Pages across the terrain at level 0 (a power of 2)
+	unsigned int LevelCount;		// Resolutions (at most enough to get down to one page)
+	unsigned int AtlasPagesAcross;	// Slots across the atlas (at most 256)
+	float LevelDistance;			// World distance from the camera to use level 0 within (doubles per level)
+	unsigned int MaxBakesPerUpdate;	// Pages queued for baking by one Update(), at most
+};
+
+// A page picked up by the last Init() or Update(), for copying into its atlas slot
+struct TerrainPageUpload
+{
+	unsigned int SlotX;
+	unsigned int SlotY;
+	std::vector<uint8_t> AlbedoRoughness;	// RGBA8, padded page size x padded page size
+	std::vector<uint8_t> NormalMetal;		// RGBA8, the same size
+};
+
+struct TerrainPageCacheStats
+{
+	unsigned int ResidentPages;
+	unsigned int WantedPages;
+	unsigned int PendingPages;		// Wanted but not resident
+	unsigned int BakedPages;		// Totals since Init()
+	unsigned int EvictedPages;
+	float AverageBakeMs;			// Time to composite a page
+	float MaxBakeMs;
+	float LastUpdateMs;				// Whole of the last Update() (baking happens on the bake threads)
+};
+
+class TerrainPageCache
+{
+public:
+	TerrainPageCache();
+	~TerrainPageCache();
+
+	// Sets up the cache over the heightmap's terrain (for its size
+	// and heights), starts the bake threads and waits for them to
+	// bake the coarsest level, returning false if the settings don't
+	// work or the atlas can't hold that level.
+	// threadCount - Threads to bake pages on, 0 for every hardware thread
+	bool Init(
+		std::shared_ptr<TerrainSplatCompositor> compositor,
+		const Heightmap& heightmap,
+		const TerrainPageCacheSettings& settings,
+		unsigned int threadCount = 0);
+
+	// Picks up the pages baked since the last Update(), works out
+	// the pages the camera (a world position) needs, queues the most
+	// important missing ones for baking and updates the page table.
+	// Call once a frame.
+	void Update(const float cameraPosition[3]);
+
+	// Blocks until the bake threads have finished every queued page
+	// (which the next Update() then picks up)
+	void WaitForBakes();
+
+	// Pages picked up by the last Init() or Update()
+	const std::vector<TerrainPageUpload>& GetUploads() const;
+
+	// PagesAcross x PagesAcross entries (in Heightmap.h's row
+	// order) of four bytes: atlas slot x and y, then level, then 0
+	const std::vector<uint8_t>& GetPageTable() const;
+	bool PageTableChanged() const;		// By the last Init() or Update()
+
+	// Level the camera wants for a level 0 page, as of the last Update()
+	unsigned int GetWantedLevel(unsigned int pageX, unsigned int pageY) const;
+	bool IsResident(unsigned int level, unsigned int pageX, unsigned int pageY) const;
+
+	unsigned int GetPaddedPageSize() const;
+	unsigned int GetAtlasSize() const;		// In texels
+	const TerrainPageCacheSettings& GetSettings() const;
+	TerrainPageCacheStats GetStats() const;
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct CachedPage
+	{
+		unsigned int Slot;
+		std::list<uint64_t>::iterator Recent;	// Position in the recently used list
+		unsigned int LastWanted;				// Frame the page was last wanted
+	};
+
+	struct PageRequest
+	{
+		uint64_t Key;
+		float Distance;
+	};
+
+	struct BakedPage
+	{
+		uint64_t Key;
+		TerrainPageUpload Upload;		// Slot not picked yet
+		double BakeMs;
+	};
+
+	static uint64_t MakeKey(unsigned int level, unsigned int pageX, unsigned int pageY);
+	float GetDistance(unsigned int level, unsigned int pageX, unsigned int pageY) const;
+	bool WantsFinerLevel(unsigned int level, unsigned int pageX, unsigned int pageY) const;
+	void Want(unsigned int level, unsigned int pageX, unsigned int pageY, std::vector<PageRequest>& missing);
+	void Stop();
+	void BakeThread();
+	void BakePage(uint64_t key, TerrainPageUpload& upload) const;
+	void AddBakedPages();
+	void FillPageTable(unsigned int level, unsigned int pageX, unsigned int pageY, uint32_t entry);
+	void BuildPageTable();
+
+	std::shared_ptr<TerrainSplatCompositor> compositor;
+	TerrainPageCacheSettings settings;
+	unsigned int frame;
+
+	// The terrain's world bounds (uv 0 - 1 in x and z) and heights
+	float worldMinX;
+	float worldMinZ;
+	float worldSizeX;
+	float worldSizeZ;
+	float minHeight;
+	float maxHeight;
+	float cameraPosition[3];
+
+	std::unordered_map<uint64_t, CachedPage> cache;
+	std::list<uint64_t> recent;				// Most recently wanted first
+	std::vector<unsigned int> freeSlots;
+	unsigned int wantedPages;
+	unsigned int pendingPages;
+
+	std::vector<TerrainPageUpload> uploads;
+	std::vector<uint8_t> pageTable;
+	std::vector<uint8_t> wantedLevels;		// For each level 0 page
+	bool pageTableChanged;
+
+	unsigned int bakedPages;
+	unsigned int evictedPages;
+	double totalBakeMs;
+	double maxBakeMs;
+	double lastUpdateMs;
+
+	// Everything below is shared with the bake threads
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	std::vector<std::thread> threads;
+	bool stopping;
+
+	std::vector<PageRequest> requests;		// Sorted so the next to bake is last
+	std::vector<uint64_t> baking;			// Taken from the requests, not finished yet
+	std::vector<BakedPage> baked;			// Finished, waiting for the next Update()
+};
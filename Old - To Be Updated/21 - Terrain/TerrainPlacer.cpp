@@ -0,0 +1,228 @@
+#include "TerrainPlacer.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+// Positions below this many aren't worth another thread
+static const size_t MinPositionsPerThread = 16 * 1024;
+
+// Positions sampled at a time when placing a range
+static const size_t PlaceBatchSize = 256;
+
+
+TerrainPlacer::TerrainPlacer(std::shared_ptr<Heightfield> heightfield) :
+	heightfield(heightfield),
+	heightmap(heightfield->GetHeightmap()),
+	width(heightmap->GetWidth()),
+	height(heightmap->GetHeight()),
+	xzScale(heightmap->GetXZScale())
+{
+}
+
+float TerrainPlacer::GetMinX() const { return -(width / 2.0f) * xzScale; }
+float TerrainPlacer::GetMinZ() const { return -(height / 2.0f) * xzScale; }
+float TerrainPlacer::GetMaxX() const { return (width - 1 - width / 2.0f) * xzScale; }
+float TerrainPlacer::GetMaxZ() const { return (height - 1 - height / 2.0f) * xzScale; }
+
+
+// --------------------------------------------------------
+// Places a range a batch at a time: the heightfield samples
+// the batch's heights and normals, which are then put
+// together with the positions
+// --------------------------------------------------------
+void TerrainPlacer::PlaceRange(const XMFLOAT2* positions, TerrainPlacement* placements, size_t count) const
+{
+	float heights[PlaceBatchSize];
+	XMFLOAT3 normals[PlaceBatchSize];
+	for (size_t first = 0; first < count; first += PlaceBatchSize)
+	{
+		size_t batch = std::min(count - first, PlaceBatchSize);
+		heightfield->GetHeightsAndNormals(positions + first, heights, normals, batch);
+		for (size_t i = 0; i < batch; i++)
+		{
+			const XMFLOAT2& position = positions[first + i];
+			placements[first + i] = { XMFLOAT3(position.x, heights[i], position.y), normals[i] };
+		}
+	}
+}
+
+
+TerrainPlacement TerrainPlacer::Place(float worldX, float worldZ) const
+{
+	XMFLOAT2 position(worldX, worldZ);
+	TerrainPlacement placement;
+	PlaceRange(&position, &placement, 1);
+	return placement;
+}
+
+void TerrainPlacer::Place(const XMFLOAT2* positions, TerrainPlacement* placements, size_t count) const
+{
+	ParallelFor((size_t)0, count, 1, MinPositionsPerThread, 0, [&](size_t first, size_t end)
+		{
+			PlaceRange(positions + first, placements + first, end - first);
+		});
+}
+
+
+// Background grid cells around a point's cell that can hold a point
+// too close to it, nearest first (the ones two away diagonally are
+// always at least Spacing away, since cells are Spacing / sqrt(2))
+static const int NearbyCells[21][2] =
+{
+	{ 0, 0 },
+	{ -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+	{ -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 },
+	{ -2, 0 }, { 2, 0 }, { 0, -2 }, { 0, 2 },
+	{ -2, -1 }, { 2, -1 }, { -2, 1 }, { 2, 1 },
+	{ -1, -2 }, { 1, -2 }, { -1, 2 }, { 1, 2 }
+};
+
+// --------------------------------------------------------
+// Scatters points with Bridson's method over a grid of cells
+// small enough to hold one point each:
+//  - Start from the first heightmap grid point that passes
+//    the masks and has room
+//  - While points are active, pick one, try candidates in
+//    the ring from Spacing to twice that around it, and
+//    keep each one that passes the masks and isn't too close
+//    to any point so far.  Points that get none are retired.
+//  - Once nothing is active, move on to the next grid point
+//
+// Spacing only needs x and z, so candidates are checked for
+// room first, and only the ones left are placed.
+// --------------------------------------------------------
+std::vector<TerrainPlacement> TerrainPlacer::Scatter(const TerrainScatterSettings& settings) const
+{
+	std::vector<TerrainPlacement> points;
+	if (width < 2 || height < 2 || !(settings.Spacing > 0.0f))
+		return points;
+
+	float minX = GetMinX();
+	float minZ = GetMinZ();
+	float maxX = GetMaxX();
+	float maxZ = GetMaxZ();
+	float cellSize = settings.Spacing / std::sqrt(2.0f);
+	int cellsX = (int)((maxX - minX) / cellSize) + 1;
+	int cellsZ = (int)((maxZ - minZ) / cellSize) + 1;
+
+	// Each cell holds its point's x and z.  Empty ones hold a spot so far
+	// away that nothing is ever too close to it, so they needn't be skipped.
+	std::vector<XMFLOAT2> cells((size_t)cellsX * cellsZ, XMFLOAT2(FLT_MAX, FLT_MAX));
+
+	float minNormalY = std::cos(settings.MaxSlope);
+	float spacingSquared = settings.Spacing * settings.Spacing;
+	std::vector<unsigned int> active;
+
+	// Whether a spot is on the map and far enough from every point so far
+	auto hasRoom = [&](float x, float z)
+		{
+			if (!(x >= minX && x <= maxX && z >= minZ && z <= maxZ))
+				return false;
+
+			int cellX = std::min((int)((x - minX) / cellSize), cellsX - 1);
+			int cellZ = std::min((int)((z - minZ) / cellSize), cellsZ - 1);
+			for (const int* offset : NearbyCells)
+			{
+				int nearX = cellX + offset[0];
+				int nearZ = cellZ + offset[1];
+				if (nearX < 0 || nearZ < 0 || nearX >= cellsX || nearZ >= cellsZ)
+					continue;
+
+				const XMFLOAT2& other = cells[(size_t)nearZ * cellsX + nearX];
+				float dx = other.x - x;
+				float dz = other.y - z;
+				if (dx * dx + dz * dz < spacingSquared)
+					return false;
+			}
+			return true;
+		};
+
+	std::mt19937 random(settings.Seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	unsigned int attempts = std::max(settings.Attempts, 1u);
+	std::vector<XMFLOAT2> candidates(attempts);
+	std::vector<TerrainPlacement> placed(attempts);
+	float turnCos = std::cos(XM_2PI / attempts);
+	float turnSin = std::sin(XM_2PI / attempts);
+
+	// Places the first few candidates that have room, and keeps the ones that
+	// pass the masks (and still have room, after the ones kept before them)
+	auto tryCandidates = [&](size_t count)
+		{
+			size_t withRoom = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				if (hasRoom(candidates[i].x, candidates[i].y))
+					candidates[withRoom++] = candidates[i];
+			}
+			PlaceRange(candidates.data(), placed.data(), withRoom);
+
+			bool kept = false;
+			for (size_t i = 0; i < withRoom; i++)
+			{
+				const TerrainPlacement& point = placed[i];
+				if (point.Position.y < settings.MinHeight || point.Position.y > settings.MaxHeight || point.Normal.y < minNormalY ||
+					!hasRoom(point.Position.x, point.Position.z))
+					continue;
+
+				int cellX = std::min((int)((point.Position.x - minX) / cellSize), cellsX - 1);
+				int cellZ = std::min((int)((point.Position.z - minZ) / cellSize), cellsZ - 1);
+				cells[(size_t)cellZ * cellsX + cellX] = XMFLOAT2(point.Position.x, point.Position.z);
+				active.push_back((unsigned int)points.size());
+				points.push_back(point);
+				kept = true;
+			}
+			return kept;
+		};
+
+	// Grid points are checked against the masks first, so only ones
+	// that might start something new get placed
+	for (unsigned int z = 0; z < height; z++)
+	{
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float pointHeight = heightmap->GetValue(x, z);
+			if (pointHeight < settings.MinHeight || pointHeight > settings.MaxHeight || heightfield->GetPointNormal(x, z).y < minNormalY)
+				continue;
+
+			candidates[0] = XMFLOAT2((x - width / 2.0f) * xzScale, (z - height / 2.0f) * xzScale);
+			if (!tryCandidates(1))
+				continue;
+
+			while (!active.empty())
+			{
+				size_t pick = std::uniform_int_distribution<size_t>(0, active.size() - 1)(random);
+				XMFLOAT3 center = points[active[pick]].Position;
+
+				// Evenly spread around the ring from a random angle (turning
+				// a direction rather than finding each one's sine and cosine),
+				// uniform over the ring's area outwards
+				float angle = unit(random) * XM_2PI;
+				float directionX = std::cos(angle);
+				float directionZ = std::sin(angle);
+				for (XMFLOAT2& candidate : candidates)
+				{
+					float radius = settings.Spacing * std::sqrt(1.0f + 3.0f * unit(random));
+					candidate = XMFLOAT2(center.x + directionX * radius, center.z + directionZ * radius);
+
+					float turnedX = directionX * turnCos - directionZ * turnSin;
+					directionZ = directionX * turnSin + directionZ * turnCos;
+					directionX = turnedX;
+				}
+
+				if (!tryCandidates(attempts))
+				{
+					active[pick] = active.back();
+					active.pop_back();
+				}
+			}
+		}
+	}
+
+	return points;
+}
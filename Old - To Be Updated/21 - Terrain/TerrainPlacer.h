@@ -0,0 +1,73 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+
+#include "Heightfield.h"
+
+// --------------------------------------------------------
+// Puts things on the terrain: finds the surface position
+// and normal under batches of world (x, z) positions (from
+// the Heightfield's sampling), and scatters points across
+// the terrain with Poisson disk sampling, for placing trees,
+// rocks, lights or the camera.
+//
+// Scattering keeps points at least Spacing apart (in x and
+// z), within a height range and under a maximum slope.  It
+// grows outwards from each accepted point (Bridson's method,
+// trying several candidates around a point at once, sampled
+// in one batch), and starts again from any heightmap grid
+// point that passes the masks and still has room, so areas
+// the masks cut off from the rest get points too.
+//
+// Like the Heightfield it uses, it needs recreating if the
+// heightmap changes.
+// --------------------------------------------------------
+
+struct TerrainPlacement
+{
+	DirectX::XMFLOAT3 Position;		// On the surface
+	DirectX::XMFLOAT3 Normal;
+};
+
+struct TerrainScatterSettings
+{
+	float Spacing;				// Closest any two points may be, in world units
+	float MinHeight;			// Heights points may be placed between
+	float MaxHeight;
+	float MaxSlope;				// Steepest surface allowed, in radians from flat
+	unsigned int Attempts;		// Candidates tried around a point before moving on (around 30)
+	unsigned int Seed;
+};
+
+class TerrainPlacer
+{
+public:
+	TerrainPlacer(std::shared_ptr<Heightfield> heightfield);
+
+	TerrainPlacement Place(float worldX, float worldZ) const;
+
+	// The same, for many positions at once (split between threads
+	// when there are enough of them).  Positions are world (x, z) pairs.
+	void Place(const DirectX::XMFLOAT2* positions, TerrainPlacement* placements, size_t count) const;
+
+	// Poisson disk points across the whole terrain, in the order they
+	// were accepted (the same every time for the same settings)
+	std::vector<TerrainPlacement> Scatter(const TerrainScatterSettings& settings) const;
+
+	// World x and z the terrain covers
+	float GetMinX() const;
+	float GetMinZ() const;
+	float GetMaxX() const;
+	float GetMaxZ() const;
+
+private:
+	void PlaceRange(const DirectX::XMFLOAT2* positions, TerrainPlacement* placements, size_t count) const;
+
+	std::shared_ptr<Heightfield> heightfield;
+	std::shared_ptr<Heightmap> heightmap;
+	unsigned int width;		// Grid points
+	unsigned int height;
+	float xzScale;
+};
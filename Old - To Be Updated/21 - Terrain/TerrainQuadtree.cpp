@@ -0,0 +1,341 @@
+#include "TerrainQuadtree.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// The coarsest LOD is never out of range, and never morphs
+static const float UnlimitedRange = 1e30f;
+
+
+// --------------------------------------------------------
+// Builds the view frustum's planes from a view * projection
+// matrix (Gribb & Hartmann).  DirectXMath matrices transform
+// row vectors, so each plane comes from the matrix's columns.
+// --------------------------------------------------------
+TerrainFrustum TerrainFrustum::FromViewProjection(const float viewProjection[16])
+{
+	const float* m = viewProjection;
+	auto column = [&](int c, int row) { return m[row * 4 + c]; };
+
+	TerrainFrustum frustum = {};
+	for (int row = 0; row < 4; row++)
+	{
+		frustum.Planes[0][row] = column(3, row) + column(0, row);	// Left
+		frustum.Planes[1][row] = column(3, row) - column(0, row);	// Right
+		frustum.Planes[2][row] = column(3, row) + column(1, row);	// Bottom
+		frustum.Planes[3][row] = column(3, row) - column(1, row);	// Top
+		frustum.Planes[4][row] = column(2, row);					// Near (depth starts at 0)
+		frustum.Planes[5][row] = column(3, row) - column(2, row);	// Far
+	}
+	return frustum;
+}
+
+
+// --------------------------------------------------------
+// Tests the corner of the box furthest along each plane's
+// normal (if it's behind the plane, the whole box is) and
+// the corner furthest against it (if it's in front, the
+// whole box is)
+// --------------------------------------------------------
+int TerrainFrustum::Classify(const float boxMin[3], const float boxMax[3]) const
+{
+	int result = 2;
+	for (int p = 0; p < 6; p++)
+	{
+		const float* plane = Planes[p];
+		float furthest = plane[3];
+		float nearest = plane[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			furthest += plane[axis] * (plane[axis] >= 0.0f ? boxMax[axis] : boxMin[axis]);
+			nearest += plane[axis] * (plane[axis] >= 0.0f ? boxMin[axis] : boxMax[axis]);
+		}
+
+		if (furthest < 0.0f)
+			return 0;
+		if (nearest < 0.0f)
+			result = 1;
+	}
+	return result;
+}
+
+
+TerrainQuadtree::TerrainQuadtree() :
+	patchSize(0),
+	lodCount(0),
+	gridWidth(0),
+	gridHeight(0),
+	xzScale(1.0f),
+	originX(0.0f),
+	originZ(0.0f)
+{
+}
+
+unsigned int TerrainQuadtree::GetPatchSize() const { return patchSize; }
+unsigned int TerrainQuadtree::GetLODCount() const { return lodCount; }
+
+unsigned int TerrainQuadtree::GetNodeCount() const
+{
+	unsigned int count = 0;
+	for (unsigned int n : nodesAcross)
+		count += n * n;
+	return count;
+}
+
+
+// --------------------------------------------------------
+// The smallest LOD 0 range that keeps neighboring patches
+// within one LOD of each other: each LOD's range has to
+// reach further than the previous one by at least the
+// diagonal of its nodes
+// --------------------------------------------------------
+float TerrainQuadtree::GetMinimumDetailDistance() const
+{
+	return 2.0f * 1.4142136f * patchSize * xzScale;
+}
+
+
+// --------------------------------------------------------
+// Builds the tree from the bottom up.  The leaves find the
+// lowest and highest heights they cover, and every other
+// node combines its 4 children.  Nodes that hang off the
+// edge of the heightmap only cover the part that's there,
+// and nodes entirely off the edge are left empty.
+// --------------------------------------------------------
+void TerrainQuadtree::Build(const Heightmap& heightmap, unsigned int patchSize)
+{
+	this->patchSize = std::max(patchSize, 2u);
+	gridWidth = heightmap.GetWidth();
+	gridHeight = heightmap.GetHeight();
+	xzScale = heightmap.GetXZScale();
+	originX = heightmap.GetWorldX(0);
+	originZ = heightmap.GetWorldZ(0);
+
+	minHeights.clear();
+	maxHeights.clear();
+	nodesAcross.clear();
+	lodCount = 0;
+	if (gridWidth < 2 || gridHeight < 2)
+		return;
+
+	// Enough LODs for one root node to cover everything
+	unsigned int quadsAcross = std::max(gridWidth, gridHeight) - 1;
+	lodCount = 1;
+	while ((this->patchSize << (lodCount - 1)) < quadsAcross && lodCount < 31)
+		lodCount++;
+
+	minHeights.resize(lodCount);
+	maxHeights.resize(lodCount);
+	nodesAcross.resize(lodCount);
+	for (unsigned int lod = 0; lod < lodCount; lod++)
+	{
+		unsigned int nodeSize = this->patchSize << lod;
+		nodesAcross[lod] = (quadsAcross + nodeSize - 1) / nodeSize;
+		minHeights[lod].assign(nodesAcross[lod] * nodesAcross[lod], FLT_MAX);
+		maxHeights[lod].assign(nodesAcross[lod] * nodesAcross[lod], -FLT_MAX);
+	}
+
+	// Leaves, from the heights themselves (including the grid points
+	// along their far edges, which they share with their neighbors)
+	for (unsigned int nz = 0; nz < nodesAcross[0]; nz++)
+	{
+		for (unsigned int nx = 0; nx < nodesAcross[0]; nx++)
+		{
+			unsigned int startX = nx * this->patchSize;
+			unsigned int startZ = nz * this->patchSize;
+			if (startX >= gridWidth - 1 || startZ >= gridHeight - 1)
+				continue;
+
+			unsigned int endX = std::min(startX + this->patchSize, gridWidth - 1);
+			unsigned int endZ = std::min(startZ + this->patchSize, gridHeight - 1);
+			float lowest = FLT_MAX;
+			float highest = -FLT_MAX;
+			for (unsigned int z = startZ; z <= endZ; z++)
+			{
+				for (unsigned int x = startX; x <= endX; x++)
+				{
+					float h = heightmap.GetValue(x, z);
+					lowest = std::min(lowest, h);
+					highest = std::max(highest, h);
+				}
+			}
+
+			minHeights[0][nz * nodesAcross[0] + nx] = lowest;
+			maxHeights[0][nz * nodesAcross[0] + nx] = highest;
+		}
+	}
+
+	// Every other LOD, from its children
+	for (unsigned int lod = 1; lod < lodCount; lod++)
+	{
+		unsigned int across = nodesAcross[lod];
+		unsigned int childAcross = nodesAcross[lod - 1];
+		for (unsigned int nz = 0; nz < across; nz++)
+		{
+			for (unsigned int nx = 0; nx < across; nx++)
+			{
+				float& lowest = minHeights[lod][nz * across + nx];
+				float& highest = maxHeights[lod][nz * across + nx];
+				for (int q = 0; q < 4; q++)
+				{
+					unsigned int cx = nx * 2 + (q & 1);
+					unsigned int cz = nz * 2 + (q >> 1);
+					if (cx >= childAcross || cz >= childAcross)
+						continue;
+
+					lowest = std::min(lowest, minHeights[lod - 1][cz * childAcross + cx]);
+					highest = std::max(highest, maxHeights[lod - 1][cz * childAcross + cx]);
+				}
+			}
+		}
+	}
+}
+
+
+// --------------------------------------------------------
+// Walks the tree from the root (see the header for how
+// nodes are picked), collecting every patch to draw
+// --------------------------------------------------------
+void TerrainQuadtree::Select(
+	const float cameraPosition[3],
+	const TerrainFrustum* frustum,
+	const TerrainLODSettings& settings,
+	std::vector<TerrainPatch>& patches) const
+{
+	patches.clear();
+	if (lodCount == 0)
+		return;
+
+	// Each LOD's range is double the last, and morphing happens
+	// over the end of each range
+	SelectionState state = {};
+	state.CameraPosition = cameraPosition;
+	state.Frustum = frustum;
+	state.Patches = &patches;
+	float previousRange = 0.0f;
+	for (unsigned int lod = 0; lod < lodCount; lod++)
+	{
+		float range = settings.DetailDistance * (float)(1u << lod);
+		state.Ranges[lod] = range;
+		state.MorphStarts[lod] = previousRange + (range - previousRange) * settings.MorphStartRatio;
+		previousRange = range;
+	}
+	state.Ranges[lodCount - 1] = UnlimitedRange;
+	state.MorphStarts[lodCount - 1] = UnlimitedRange * 0.5f;
+
+	SelectNode(state, lodCount - 1, 0, 0, false);
+}
+
+
+// --------------------------------------------------------
+// Selects a node, or its children, or some of each.  Returns
+// false if the node is too far away for its LOD, so its
+// parent needs to cover it instead.
+// --------------------------------------------------------
+bool TerrainQuadtree::SelectNode(SelectionState& state, unsigned int lod, unsigned int nodeX, unsigned int nodeZ, bool fullyVisible) const
+{
+	// Off the edge of the heightmap entirely?  Nothing to draw
+	unsigned int index = nodeZ * nodesAcross[lod] + nodeX;
+	if (minHeights[lod][index] > maxHeights[lod][index])
+		return true;
+
+	// Closest distance from the camera to anywhere in the node
+	float boundsMin[3];
+	float boundsMax[3];
+	GetNodeBounds(lod, nodeX, nodeZ, boundsMin, boundsMax);
+	float distanceSquared = 0.0f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float outside = std::max(std::max(boundsMin[axis] - state.CameraPosition[axis], state.CameraPosition[axis] - boundsMax[axis]), 0.0f);
+		distanceSquared += outside * outside;
+	}
+	float distance = sqrtf(distanceSquared);
+
+	if (distance > state.Ranges[lod])
+		return false;
+
+	// Children of a node that's entirely visible are too
+	if (state.Frustum && !fullyVisible)
+	{
+		int visibility = state.Frustum->Classify(boundsMin, boundsMax);
+		if (visibility == 0)
+			return true;
+		fullyVisible = visibility == 2;
+	}
+
+	// Nowhere close enough for finer detail?
+	if (lod == 0 || distance > state.Ranges[lod - 1])
+	{
+		AddPatch(state, lod, nodeX, nodeZ, -1);
+		return true;
+	}
+
+	// Let each child select itself (or its children), covering any
+	// that are too far away with that quarter of this node
+	unsigned int childAcross = nodesAcross[lod - 1];
+	int uncovered[4];
+	int uncoveredCount = 0;
+	for (int q = 0; q < 4; q++)
+	{
+		unsigned int childX = nodeX * 2 + (q & 1);
+		unsigned int childZ = nodeZ * 2 + (q >> 1);
+		if (childX >= childAcross || childZ >= childAcross)
+			continue;
+
+		if (!SelectNode(state, lod - 1, childX, childZ, fullyVisible))
+			uncovered[uncoveredCount++] = q;
+	}
+
+	// All four quarters together are just the whole node
+	if (uncoveredCount == 4)
+		AddPatch(state, lod, nodeX, nodeZ, -1);
+	else
+	{
+		for (int i = 0; i < uncoveredCount; i++)
+			AddPatch(state, lod, nodeX, nodeZ, uncovered[i]);
+	}
+	return true;
+}
+
+void TerrainQuadtree::AddPatch(SelectionState& state, unsigned int lod, unsigned int nodeX, unsigned int nodeZ, int quadrant) const
+{
+	unsigned int nodeSize = patchSize << lod;
+
+	TerrainPatch patch = {};
+	patch.X = nodeX * nodeSize;
+	patch.Z = nodeZ * nodeSize;
+	patch.Size = nodeSize;
+	patch.LOD = lod;
+	patch.Quadrant = quadrant;
+	patch.MorphStart = state.MorphStarts[lod];
+	patch.MorphEnd = state.Ranges[lod];
+	state.Patches->push_back(patch);
+}
+
+
+// --------------------------------------------------------
+// World-space box around a node (clipped to the heightmap)
+// --------------------------------------------------------
+void TerrainQuadtree::GetNodeBounds(unsigned int lod, unsigned int nodeX, unsigned int nodeZ, float boundsMin[3], float boundsMax[3]) const
+{
+	unsigned int nodeSize = patchSize << lod;
+	unsigned int startX = nodeX * nodeSize;
+	unsigned int startZ = nodeZ * nodeSize;
+	unsigned int endX = std::min(startX + nodeSize, gridWidth - 1);
+	unsigned int endZ = std::min(startZ + nodeSize, gridHeight - 1);
+	unsigned int index = nodeZ * nodesAcross[lod] + nodeX;
+
+	boundsMin[0] = originX + startX * xzScale;
+	boundsMin[1] = minHeights[lod][index];
+	boundsMin[2] = originZ + startZ * xzScale;
+	boundsMax[0] = originX + endX * xzScale;
+	boundsMax[1] = maxHeights[lod][index];
+	boundsMax[2] = originZ + endZ * xzScale;
+}
+
+void TerrainQuadtree::GetPatchBounds(const TerrainPatch& patch, float boundsMin[3], float boundsMax[3]) const
+{
+	unsigned int nodeSize = patchSize << patch.LOD;
+	GetNodeBounds(patch.LOD, patch.X / nodeSize, patch.Z / nodeSize, boundsMin, boundsMax);
+}
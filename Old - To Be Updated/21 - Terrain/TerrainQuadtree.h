@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+
+#include "Heightmap.h"
+
+// --------------------------------------------------------
+// Chunked level of detail for heightmap terrain (CDLOD).
+//
+// The heightmap is covered by a quadtree of square nodes.
+// Every node is drawn with the same grid of patchSize x
+// patchSize quads, so nodes higher up the tree have more
+// widely spaced vertices: LOD 0 (the leaves) uses every
+// height, LOD 1 every other height, and so on.
+//
+// Each LOD has a distance range.  Each frame, the tree is
+// walked from the root, and a node is split into its
+// children wherever the camera is close enough for the next
+// finer LOD.  Children that are too far for their own LOD
+// are covered by a quarter of the parent's grid instead.
+// Nodes outside the view frustum (tested against their
+// min/max height bounds) are skipped entirely.
+//
+// Near the far end of its range, each vertex morphs towards
+// the grid of the next coarser LOD, so it has already become
+// part of that grid by the time the coarser LOD takes over:
+// no popping, and no cracks between LODs.
+//
+// None of this uses the graphics API - ChunkedTerrain draws
+// the patches this produces.
+// --------------------------------------------------------
+
+// One square of terrain to draw, in heightmap grid points
+struct TerrainPatch
+{
+	unsigned int X;			// Grid point of the node's corner (smallest x and z)
+	unsigned int Z;
+	unsigned int Size;		// Quads across the whole node, at full detail
+	unsigned int LOD;		// 0 is full detail (vertex spacing is 2^LOD)
+	int Quadrant;			// -1 for the whole node, or which quarter: 0 (-x, -z), 1 (+x, -z), 2 (-x, +z), 3 (+x, +z)
+	float MorphStart;		// Distances from the camera over which vertices
+	float MorphEnd;			// morph to the next coarser LOD
+};
+
+// Planes bounding the view, pointing inwards
+struct TerrainFrustum
+{
+	float Planes[6][4];
+
+	// Pulls the planes out of a row-major (DirectXMath style)
+	// view * projection matrix, with depth from 0 to 1
+	static TerrainFrustum FromViewProjection(const float viewProjection[16]);
+
+	// 0 if a box is outside, 1 if it's partly inside, 2 if it's entirely inside
+	int Classify(const float boxMin[3], const float boxMax[3]) const;
+};
+
+struct TerrainLODSettings
+{
+	// Range of LOD 0, in world units.  Each coarser LOD's range is
+	// twice the previous one.  For neighboring patches to stay within
+	// one LOD of each other (so morphing can hide the seams), this
+	// must be at least GetMinimumDetailDistance().
+	float DetailDistance;
+
+	// How far through each LOD's range (0 - 1) morphing begins
+	float MorphStartRatio;
+};
+
+class TerrainQuadtree
+{
+public:
+	TerrainQuadtree();
+
+	// Builds the tree and every node's height bounds.  patchSize must
+	// be a power of 2 (at least 2).  Enough LODs are made for the root
+	// to cover the whole heightmap.
+	void Build(const Heightmap& heightmap, unsigned int patchSize = 32);
+
+	// Picks the patches to draw this frame for a camera at the given
+	// world position (no culling if frustum is null), replacing the
+	// contents of patches
+	void Select(
+		const float cameraPosition[3],
+		const TerrainFrustum* frustum,
+		const TerrainLODSettings& settings,
+		std::vector<TerrainPatch>& patches) const;
+
+	unsigned int GetPatchSize() const;
+	unsigned int GetLODCount() const;
+	unsigned int GetNodeCount() const;
+	float GetMinimumDetailDistance() const;
+
+	// World-space bounds of a patch's node
+	void GetPatchBounds(const TerrainPatch& patch, float boundsMin[3], float boundsMax[3]) const;
+
+private:
+	unsigned int patchSize;
+	unsigned int lodCount;
+	unsigned int gridWidth;		// In grid points
+	unsigned int gridHeight;
+	float xzScale;
+	float originX;				// World position of grid point (0, 0)
+	float originZ;
+
+	// Height bounds of every node, one array per LOD, with
+	// nodesAcross[lod] x nodesAcross[lod] nodes (in Heightmap.h's row order)
+	std::vector<std::vector<float>> minHeights;
+	std::vector<std::vector<float>> maxHeights;
+	std::vector<unsigned int> nodesAcross;
+
+	// Per-frame selection state
+	struct SelectionState
+	{
+		const float* CameraPosition;
+		const TerrainFrustum* Frustum;
+		float Ranges[32];
+		float MorphStarts[32];
+		std::vector<TerrainPatch>* Patches;
+	};
+
+	bool SelectNode(SelectionState& state, unsigned int lod, unsigned int nodeX, unsigned int nodeZ, bool fullyVisible) const;
+	void GetNodeBounds(unsigned int lod, unsigned int nodeX, unsigned int nodeZ, float boundsMin[3], float boundsMax[3]) const;
+	void AddPatch(SelectionState& state, unsigned int lod, unsigned int nodeX, unsigned int nodeZ, int quadrant) const;
+};
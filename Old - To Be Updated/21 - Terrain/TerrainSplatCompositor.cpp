@@ -0,0 +1,340 @@
+#include "TerrainSplatCompositor.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Entries in the table decoding gamma encoded values (0 - 255) to
+// linear, which is interpolated between
+static const unsigned int GammaTableSize = 1024;
+
+// Where one page texel samples an image along one axis: the two
+// nearest texels (as byte offsets into the image) and how much of
+// the second one to use
+struct SplatTap
+{
+	size_t Offset0;
+	size_t Offset1;
+	float Weight;
+};
+
+// Where every texel of a page samples one image
+struct SplatTaps
+{
+	const TerrainSplatImage* Image;
+	std::vector<SplatTap> Columns;
+	std::vector<SplatTap> Rows;
+};
+
+// --------------------------------------------------------
+// Converts between gamma encoded and linear values the way
+// TerrainPS does (with a power of 2.2).  Decoding is a table
+// lookup; encoding finds the byte whose range the value
+// falls in, so it rounds exactly like pow(x, 1 / 2.2) would.
+// --------------------------------------------------------
+struct GammaTables
+{
+	float Decode[GammaTableSize + 2];
+	float EncodeThresholds[255];	// Lowest linear value of bytes 1 - 255
+
+	GammaTables()
+	{
+		for (unsigned int i = 0; i <= GammaTableSize; i++)
+			Decode[i] = std::pow((float)i / GammaTableSize, 2.2f);
+		Decode[GammaTableSize + 1] = Decode[GammaTableSize];
+
+		for (unsigned int i = 0; i < 255; i++)
+			EncodeThresholds[i] = std::pow((i + 0.5f) / 255.0f, 2.2f);
+	}
+
+	// value - Gamma encoded, 0 - 255
+	float ToLinear(float value) const
+	{
+		float position = value * (GammaTableSize / 255.0f);
+		unsigned int index = (unsigned int)position;
+		return Decode[index] + (Decode[index + 1] - Decode[index]) * (position - index);
+	}
+
+	uint8_t ToGamma(float linear) const
+	{
+		return (uint8_t)(std::upper_bound(EncodeThresholds, EncodeThresholds + 255, linear) - EncodeThresholds);
+	}
+};
+
+static const GammaTables& GetGammaTables()
+{
+	static const GammaTables tables;
+	return tables;
+}
+
+static uint8_t ToByte(float value)
+{
+	return (uint8_t)(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+
+// --------------------------------------------------------
+// Works out where size texels, step apart (in uv) starting
+// at start, sample an image count texels across, wrapping
+// around at its edges.  Done in double precision, since a
+// layer tiled across the terrain can be tens of thousands
+// of texels across.
+// --------------------------------------------------------
+static void BuildTaps(
+	double start,
+	double step,
+	unsigned int size,
+	double scale,
+	double offset,
+	unsigned int count,
+	size_t stride,
+	std::vector<SplatTap>& taps)
+{
+	taps.resize(size);
+	for (unsigned int i = 0; i < size; i++)
+	{
+		double uv = (start + (i + 0.5) * step) * scale + offset;
+		double position = uv * count - 0.5;
+		double whole = std::floor(position);
+		long long index = (long long)whole % (long long)count;
+		if (index < 0)
+			index += count;
+		long long next = index + 1 == count ? 0 : index + 1;
+
+		taps[i].Offset0 = (size_t)index * stride;
+		taps[i].Offset1 = (size_t)next * stride;
+		taps[i].Weight = (float)(position - whole);
+	}
+}
+
+// --------------------------------------------------------
+// Picks a mip for a page and works out where each of the
+// page's texels samples it
+// --------------------------------------------------------
+static void BuildPageTaps(
+	const std::vector<TerrainSplatImage>& mips,
+	float u,
+	float v,
+	float texelSize,
+	unsigned int size,
+	float scaleX,
+	float scaleY,
+	float offsetX,
+	float offsetY,
+	SplatTaps& taps)
+{
+	// Image texels per page texel, and the mip with texels closest
+	// to (but no bigger than) that
+	float footprint = texelSize * std::max(std::abs(scaleX) * mips[0].Width, std::abs(scaleY) * mips[0].Height);
+	unsigned int mip = 0;
+	while (mip + 1 < mips.size() && footprint >= 2.0f)
+	{
+		footprint *= 0.5f;
+		mip++;
+	}
+
+	const TerrainSplatImage& image = mips[mip];
+	taps.Image = &image;
+	BuildTaps(u, texelSize, size, scaleX, offsetX, image.Width, image.Channels, taps.Columns);
+	BuildTaps(v, texelSize, size, scaleY, offsetY, image.Height, (size_t)image.Width * image.Channels, taps.Rows);
+}
+
+// --------------------------------------------------------
+// Bilinearly filters up to channelCount channels of the
+// page texel at (x, y), returned as 0 - 255.  Channels the
+// image doesn't have are left at 0.
+// --------------------------------------------------------
+static void Sample(const SplatTaps& taps, unsigned int x, unsigned int y, unsigned int channelCount, float* result)
+{
+	const SplatTap& column = taps.Columns[x];
+	const SplatTap& row = taps.Rows[y];
+	const uint8_t* row0 = taps.Image->Texels.data() + row.Offset0;
+	const uint8_t* row1 = taps.Image->Texels.data() + row.Offset1;
+
+	channelCount = std::min(channelCount, taps.Image->Channels);
+	for (unsigned int c = 0; c < channelCount; c++)
+	{
+		float top = row0[column.Offset0 + c] + (row0[column.Offset1 + c] - row0[column.Offset0 + c]) * column.Weight;
+		float bottom = row1[column.Offset0 + c] + (row1[column.Offset1 + c] - row1[column.Offset0 + c]) * column.Weight;
+		result[c] = top + (bottom - top) * row.Weight;
+	}
+}
+
+
+TerrainSplatCompositor::TerrainSplatCompositor() :
+	uvScaleX(1.0f),
+	uvScaleY(1.0f),
+	uvOffsetX(0.0f),
+	uvOffsetY(0.0f)
+{
+}
+
+void TerrainSplatCompositor::SetBlendMap(const TerrainSplatImage& blendMap)
+{
+	this->blendMap = BuildMipChain(blendMap);
+}
+
+bool TerrainSplatCompositor::AddLayer(const TerrainSplatLayer& layer)
+{
+	const TerrainSplatImage* images[] = { &layer.Albedo, &layer.Normals, &layer.Roughness, &layer.Metal };
+	for (const TerrainSplatImage* image : images)
+		if (image->Width == 0 || image->Height == 0 || image->Channels == 0 || image->Texels.size() < (size_t)image->Width * image->Height * image->Channels)
+			return false;
+	if (layers.size() >= MaxLayers)
+		return false;
+
+	layers.push_back({
+		BuildMipChain(layer.Albedo),
+		BuildMipChain(layer.Normals),
+		BuildMipChain(layer.Roughness),
+		BuildMipChain(layer.Metal) });
+	return true;
+}
+
+unsigned int TerrainSplatCompositor::GetLayerCount() const { return (unsigned int)layers.size(); }
+
+void TerrainSplatCompositor::SetUVTransform(float uvScaleX, float uvScaleY, float uvOffsetX, float uvOffsetY)
+{
+	this->uvScaleX = uvScaleX;
+	this->uvScaleY = uvScaleY;
+	this->uvOffsetX = uvOffsetX;
+	this->uvOffsetY = uvOffsetY;
+}
+
+
+// --------------------------------------------------------
+// Halves the image over and over (averaging 2x2 texels, or
+// fewer along an odd edge) until it's a single texel
+// --------------------------------------------------------
+TerrainSplatCompositor::MipChain TerrainSplatCompositor::BuildMipChain(const TerrainSplatImage& image)
+{
+	MipChain mips;
+	if (image.Width == 0 || image.Height == 0 || image.Channels == 0)
+		return mips;
+
+	mips.push_back(image);
+	while (mips.back().Width > 1 || mips.back().Height > 1)
+	{
+		const TerrainSplatImage& source = mips.back();
+		TerrainSplatImage mip;
+		mip.Width = std::max(source.Width / 2, 1u);
+		mip.Height = std::max(source.Height / 2, 1u);
+		mip.Channels = source.Channels;
+		mip.Texels.resize((size_t)mip.Width * mip.Height * mip.Channels);
+
+		unsigned int channels = source.Channels;
+		for (unsigned int y = 0; y < mip.Height; y++)
+		{
+			const uint8_t* row0 = &source.Texels[(size_t)std::min(y * 2, source.Height - 1) * source.Width * channels];
+			const uint8_t* row1 = &source.Texels[(size_t)std::min(y * 2 + 1, source.Height - 1) * source.Width * channels];
+			for (unsigned int x = 0; x < mip.Width; x++)
+			{
+				unsigned int x0 = std::min(x * 2, source.Width - 1) * channels;
+				unsigned int x1 = std::min(x * 2 + 1, source.Width - 1) * channels;
+				for (unsigned int c = 0; c < channels; c++)
+				{
+					unsigned int sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+					mip.Texels[((size_t)y * mip.Width + x) * channels + c] = (uint8_t)((sum + 2) / 4);
+				}
+			}
+		}
+
+		mips.push_back(std::move(mip));
+	}
+
+	return mips;
+}
+
+
+// --------------------------------------------------------
+// Blends one page.  Every image gets its mip and taps up
+// front; then each texel reads its blend weights and adds
+// up the layers that have any.
+// --------------------------------------------------------
+void TerrainSplatCompositor::Composite(
+	float u,
+	float v,
+	float texelSize,
+	unsigned int size,
+	uint8_t* albedoRoughness,
+	uint8_t* normalMetal,
+	size_t rowPitch) const
+{
+	const GammaTables& gamma = GetGammaTables();
+
+	SplatTaps blendTaps = {};
+	if (!blendMap.empty())
+		BuildPageTaps(blendMap, u, v, texelSize, size, 1.0f, 1.0f, 0.0f, 0.0f, blendTaps);
+
+	unsigned int layerCount = blendMap.empty() ? 0 : std::min((unsigned int)layers.size(), blendMap[0].Channels);
+	std::vector<SplatTaps> layerTaps(layerCount * 4);
+	for (unsigned int i = 0; i < layerCount; i++)
+	{
+		const MipChain* chains[] = { &layers[i].Albedo, &layers[i].Normals, &layers[i].Roughness, &layers[i].Metal };
+		for (unsigned int map = 0; map < 4; map++)
+			BuildPageTaps(*chains[map], u, v, texelSize, size, uvScaleX, uvScaleY, uvOffsetX, uvOffsetY, layerTaps[i * 4 + map]);
+	}
+
+	for (unsigned int y = 0; y < size; y++)
+	{
+		uint8_t* albedoRow = albedoRoughness + y * rowPitch;
+		uint8_t* normalRow = normalMetal + y * rowPitch;
+		for (unsigned int x = 0; x < size; x++)
+		{
+			float weights[MaxLayers] = {};
+			if (layerCount > 0)
+				Sample(blendTaps, x, y, layerCount, weights);
+
+			float albedo[3] = {};
+			float normal[3] = {};
+			float roughness = 0.0f;
+			float metal = 0.0f;
+			for (unsigned int i = 0; i < layerCount; i++)
+			{
+				float weight = weights[i] / 255.0f;
+				if (weight <= 0.0f)
+					continue;
+
+				float layerAlbedo[3] = {};
+				float layerNormal[3] = {};
+				float layerRoughness = 0.0f;
+				float layerMetal = 0.0f;
+				Sample(layerTaps[i * 4 + 0], x, y, 3, layerAlbedo);
+				Sample(layerTaps[i * 4 + 1], x, y, 3, layerNormal);
+				Sample(layerTaps[i * 4 + 2], x, y, 1, &layerRoughness);
+				Sample(layerTaps[i * 4 + 3], x, y, 1, &layerMetal);
+
+				for (unsigned int c = 0; c < 3; c++)
+				{
+					albedo[c] += gamma.ToLinear(layerAlbedo[c]) * weight;
+					normal[c] += (layerNormal[c] * (2.0f / 255.0f) - 1.0f) * weight;
+				}
+				roughness += layerRoughness * (weight / 255.0f);
+				metal += layerMetal * (weight / 255.0f);
+			}
+
+			// Only the normal's direction matters once it's mapped
+			float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (length > 0.0f)
+			{
+				for (float& n : normal)
+					n /= length;
+			}
+			else
+			{
+				normal[2] = 1.0f;
+			}
+
+			uint8_t* albedoTexel = albedoRow + x * 4;
+			albedoTexel[0] = gamma.ToGamma(albedo[0]);
+			albedoTexel[1] = gamma.ToGamma(albedo[1]);
+			albedoTexel[2] = gamma.ToGamma(albedo[2]);
+			albedoTexel[3] = ToByte(roughness);
+
+			uint8_t* normalTexel = normalRow + x * 4;
+			normalTexel[0] = ToByte(normal[0] * 0.5f + 0.5f);
+			normalTexel[1] = ToByte(normal[1] * 0.5f + 0.5f);
+			normalTexel[2] = ToByte(normal[2] * 0.5f + 0.5f);
+			normalTexel[3] = ToByte(metal);
+		}
+	}
+}
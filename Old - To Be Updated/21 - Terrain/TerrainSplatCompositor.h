@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// Blends the terrain's splat layers on the CPU, into pages
+// of pre-blended material for a virtual texture, so the
+// pixel shader samples one material instead of a blend map
+// and four textures for every layer.
+//
+// The math matches TerrainPS: layer i is weighted by channel
+// i of the blend map (sampled at the terrain's uv), and the
+// layers are sampled at uv * uvScale + uvOffset.  Albedo is
+// decoded to linear before blending (and stored gamma
+// encoded again, so 8 bits are still enough), and normals
+// are blended unpacked, then normalized, which is all the
+// shader would do with them anyway.
+//
+// Pages far from the camera are baked at lower resolutions,
+// so every image keeps a box filtered mip chain, and a page
+// samples the mip whose texels are closest to (but no bigger
+// than) its own, bilinearly, wrapping like the terrain's
+// sampler.  Where a page's rows and columns land in each
+// image is worked out once per page, leaving a handful of
+// lookups and multiply-adds per texel for each layer, and
+// layers with no weight are skipped entirely.
+//
+// Pages come out as two RGBA8 images: albedo and roughness,
+// then normal and metalness.
+// --------------------------------------------------------
+
+// An 8-bit image with 1 to 4 channels.  Missing channels read
+// as 0, like sampling a texture with fewer channels would.
+struct TerrainSplatImage
+{
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int Channels;
+	std::vector<uint8_t> Texels;	// Width x Height x Channels bytes, in Heightmap.h's row order
+};
+
+// One layer's textures, like TerrainPS's Albedo0, NormalMap0, RoughnessMap0 and MetalMap0
+struct TerrainSplatLayer
+{
+	TerrainSplatImage Albedo;		// Gamma encoded rgb
+	TerrainSplatImage Normals;		// Tangent space rgb, packed to 0 - 1
+	TerrainSplatImage Roughness;	// First channel
+	TerrainSplatImage Metal;		// First channel
+};
+
+class TerrainSplatCompositor
+{
+public:
+	static const unsigned int MaxLayers = 4;
+
+	TerrainSplatCompositor();
+
+	// The blend map's channels weight the layers, in order
+	void SetBlendMap(const TerrainSplatImage& blendMap);
+
+	// Returns false (and adds nothing) if there are already MaxLayers
+	// layers or one of the images is empty
+	bool AddLayer(const TerrainSplatLayer& layer);
+	unsigned int GetLayerCount() const;
+
+	// Tiling of the layers across the terrain, like the terrain material's
+	void SetUVTransform(float uvScaleX, float uvScaleY, float uvOffsetX, float uvOffsetY);
+
+	// Blends size x size texels, texelSize apart in terrain uv, with the
+	// first one's corner at (u, v) (so its center is half a texel further).
+	// Both outputs are RGBA8, rowPitch bytes from one row to the next.
+	void Composite(
+		float u,
+		float v,
+		float texelSize,
+		unsigned int size,
+		uint8_t* albedoRoughness,
+		uint8_t* normalMetal,
+		size_t rowPitch) const;
+
+private:
+	// An image followed by its mips, each half the size of the last
+	typedef std::vector<TerrainSplatImage> MipChain;
+
+	struct Layer
+	{
+		MipChain Albedo;
+		MipChain Normals;
+		MipChain Roughness;
+		MipChain Metal;
+	};
+
+	static MipChain BuildMipChain(const TerrainSplatImage& image);
+
+	MipChain blendMap;
+	std::vector<Layer> layers;
+	float uvScaleX;
+	float uvScaleY;
+	float uvOffsetX;
+	float uvOffsetY;
+};
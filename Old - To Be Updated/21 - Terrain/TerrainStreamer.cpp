@@ -0,0 +1,345 @@
+#include "TerrainStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+TerrainStreamer::TerrainStreamer() :
+	frame(0),
+	stopping(false),
+	settings{},
+	residentBytes(0),
+	loadedTiles(0),
+	evictedTiles(0),
+	fetchedTiles(0),
+	totalLoadMs(0),
+	maxLoadMs(0),
+	totalFetchMs(0),
+	maxFetchMs(0)
+{
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+	Close();
+}
+
+const TiledHeightmap& TerrainStreamer::GetHeightmap() const { return heightmap; }
+
+TerrainStreamingSettings TerrainStreamer::GetSettings()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return settings;
+}
+
+void TerrainStreamer::SetSettings(const TerrainStreamingSettings& settings)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	this->settings = settings;
+	Evict();
+}
+
+uint64_t TerrainStreamer::MakeKey(unsigned int level, unsigned int tileX, unsigned int tileZ)
+{
+	return ((uint64_t)level << 48) | ((uint64_t)tileZ << 24) | tileX;
+}
+
+
+// --------------------------------------------------------
+// Opens the tiled heightmap and starts loading in the
+// background (nothing is loaded until the first Update)
+// --------------------------------------------------------
+bool TerrainStreamer::Open(const std::filesystem::path& path, const TerrainStreamingSettings& settings)
+{
+	Close();
+	if (!heightmap.Open(path))
+		return false;
+
+	this->settings = settings;
+	frame = 0;
+	stopping = false;
+	loadedTiles = 0;
+	evictedTiles = 0;
+	fetchedTiles = 0;
+	totalLoadMs = 0;
+	maxLoadMs = 0;
+	totalFetchMs = 0;
+	maxFetchMs = 0;
+
+	thread = std::thread(&TerrainStreamer::LoadThread, this);
+	return true;
+}
+
+// --------------------------------------------------------
+// Stops the loading thread (after any tile it's working on)
+// and drops everything
+// --------------------------------------------------------
+void TerrainStreamer::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	if (thread.joinable())
+		thread.join();
+
+	cache.clear();
+	recent.clear();
+	residentBytes = 0;
+	requests.clear();
+	requestTimes.clear();
+	heightmap.Close();
+}
+
+
+// --------------------------------------------------------
+// Works out which tiles each level wants around the camera.
+// Loaded ones move to the front of the recently used list,
+// and the rest replace the load queue (so tiles the camera
+// has moved away from before they loaded are forgotten).
+// --------------------------------------------------------
+void TerrainStreamer::Update(const float cameraPosition[3])
+{
+	if (!heightmap.IsOpen())
+		return;
+
+	const TiledHeightmapHeader& header = heightmap.GetHeader();
+	float tileSize = (float)header.TileSize;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	frame++;
+
+	// Camera and radius in level 0 grid points.  Both shrink the same
+	// way in each coarser level's grid, so the radius stays the same.
+	float cameraX = cameraPosition[0] / header.XZScale + header.Width / 2.0f;
+	float cameraZ = cameraPosition[2] / header.XZScale + header.Height / 2.0f;
+	float radius = std::max(settings.Radius / header.XZScale, 1.0f);
+
+	Clock::time_point now = Clock::now();
+	std::vector<TileRequest> wanted;
+	std::unordered_map<uint64_t, Clock::time_point> wantedTimes;
+	for (unsigned int level = 0; level < header.LevelCount; level++)
+	{
+		const TiledHeightmapLevel& info = heightmap.GetLevel(level);
+		float x = cameraX / (1u << level);
+		float z = cameraZ / (1u << level);
+
+		// Range of tiles overlapping the radius (all of them for the coarsest level)
+		bool coarsest = level == header.LevelCount - 1;
+		float maxTileX = (float)(info.TilesX - 1);
+		float maxTileZ = (float)(info.TilesZ - 1);
+		float firstX = coarsest ? 0 : std::clamp(std::floor((x - radius) / tileSize), 0.0f, maxTileX);
+		float lastX = coarsest ? maxTileX : std::clamp(std::floor((x + radius) / tileSize), 0.0f, maxTileX);
+		float firstZ = coarsest ? 0 : std::clamp(std::floor((z - radius) / tileSize), 0.0f, maxTileZ);
+		float lastZ = coarsest ? maxTileZ : std::clamp(std::floor((z + radius) / tileSize), 0.0f, maxTileZ);
+
+		for (unsigned int tileZ = (unsigned int)firstZ; tileZ <= (unsigned int)lastZ; tileZ++)
+		{
+			for (unsigned int tileX = (unsigned int)firstX; tileX <= (unsigned int)lastX; tileX++)
+			{
+				// Distance from the camera to the tile, in the level's grid points
+				float dx = std::max({ tileX * tileSize - x, x - (tileX + 1) * tileSize, 0.0f });
+				float dz = std::max({ tileZ * tileSize - z, z - (tileZ + 1) * tileSize, 0.0f });
+				float distance = std::sqrt(dx * dx + dz * dz);
+				if (!coarsest && distance > radius)
+					continue;
+
+				uint64_t key = MakeKey(level, tileX, tileZ);
+				auto cached = cache.find(key);
+				if (cached != cache.end())
+				{
+					cached->second.LastWanted = frame;
+					recent.splice(recent.begin(), recent, cached->second.Recent);
+					continue;
+				}
+
+				// The coarsest level goes first, since it's the fallback everywhere
+				wanted.push_back({ key, coarsest ? -1.0f : distance / radius });
+				auto requested = requestTimes.find(key);
+				wantedTimes[key] = requested == requestTimes.end() ? now : requested->second;
+			}
+		}
+	}
+
+	// Next to load at the back: closest first, then coarser
+	// levels first, as they cover more
+	std::sort(wanted.begin(), wanted.end(), [](const TileRequest& a, const TileRequest& b)
+		{
+			if (a.Priority != b.Priority)
+				return a.Priority > b.Priority;
+			return (a.Key >> 48) < (b.Key >> 48);
+		});
+	requests.swap(wanted);
+	requestTimes.swap(wantedTimes);
+	wake.notify_one();
+}
+
+
+// --------------------------------------------------------
+// Loads the closest wanted tile, over and over, until
+// Close() stops it.  The lock is released while decoding,
+// as that's where the disk reads happen.
+// --------------------------------------------------------
+void TerrainStreamer::LoadThread()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	{
+		wake.wait(lock, [&]() { return stopping || !requests.empty(); });
+		if (stopping)
+			return;
+
+		uint64_t key = requests.back().Key;
+		requests.pop_back();
+		if (cache.count(key))
+			continue;
+
+		lock.unlock();
+		Clock::time_point start = Clock::now();
+		std::shared_ptr<TerrainTile> tile = LoadTile(key);
+		Clock::time_point end = Clock::now();
+		lock.lock();
+
+		recent.push_front(key);
+		cache[key] = { tile, recent.begin(), frame };
+		residentBytes += tile->Heights.size() * sizeof(float);
+
+		double loadMs = std::chrono::duration<double, std::milli>(end - start).count();
+		loadedTiles++;
+		totalLoadMs += loadMs;
+		maxLoadMs = std::max(maxLoadMs, loadMs);
+
+		auto requested = requestTimes.find(key);
+		if (requested != requestTimes.end())
+		{
+			double fetchMs = std::chrono::duration<double, std::milli>(end - requested->second).count();
+			fetchedTiles++;
+			totalFetchMs += fetchMs;
+			maxFetchMs = std::max(maxFetchMs, fetchMs);
+			requestTimes.erase(requested);
+		}
+
+		Evict();
+	}
+}
+
+// --------------------------------------------------------
+// Decodes a tile's samples into heights.  Reading through
+// the mapping is what pulls the tile in from disk.
+// --------------------------------------------------------
+std::shared_ptr<TerrainTile> TerrainStreamer::LoadTile(uint64_t key)
+{
+	std::shared_ptr<TerrainTile> tile = std::make_shared<TerrainTile>();
+	tile->Level = (unsigned int)(key >> 48);
+	tile->Z = (unsigned int)(key >> 24) & 0xFFFFFF;
+	tile->X = (unsigned int)key & 0xFFFFFF;
+
+	unsigned int samplesAcross = heightmap.GetTileSamplesAcross();
+	const uint16_t* samples = heightmap.GetTileSamples(tile->Level, tile->X, tile->Z);
+	tile->Heights.resize((size_t)samplesAcross * samplesAcross);
+	for (size_t i = 0; i < tile->Heights.size(); i++)
+		tile->Heights[i] = heightmap.SampleToHeight(samples[i]);
+
+	return tile;
+}
+
+// --------------------------------------------------------
+// Drops the least recently wanted tiles while over budget,
+// stopping at tiles wanted this frame (so the budget can be
+// exceeded if the radius asks for more than it allows)
+//
+// Note: the mutex must already be locked
+// --------------------------------------------------------
+void TerrainStreamer::Evict()
+{
+	while (residentBytes > settings.Budget && !recent.empty())
+	{
+		auto oldest = cache.find(recent.back());
+		if (oldest->second.LastWanted == frame)
+			break;
+
+		residentBytes -= oldest->second.Tile->Heights.size() * sizeof(float);
+		cache.erase(oldest);
+		recent.pop_back();
+		evictedTiles++;
+	}
+}
+
+
+std::shared_ptr<const TerrainTile> TerrainStreamer::GetTile(unsigned int level, unsigned int tileX, unsigned int tileZ)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return FindTile(MakeKey(level, tileX, tileZ));
+}
+
+// Note: the mutex must already be locked
+std::shared_ptr<const TerrainTile> TerrainStreamer::FindTile(uint64_t key)
+{
+	auto cached = cache.find(key);
+	return cached == cache.end() ? 0 : cached->second.Tile;
+}
+
+
+// --------------------------------------------------------
+// Bilinearly interpolates the height at a world position,
+// trying each level from the finest up until one has the
+// tile covering that position loaded
+// --------------------------------------------------------
+bool TerrainStreamer::GetHeight(float worldX, float worldZ, float& height)
+{
+	if (!heightmap.IsOpen())
+		return false;
+
+	const TiledHeightmapHeader& header = heightmap.GetHeader();
+	unsigned int tileSize = header.TileSize;
+	unsigned int samplesAcross = tileSize + 1;
+	float gridX = worldX / header.XZScale + header.Width / 2.0f;
+	float gridZ = worldZ / header.XZScale + header.Height / 2.0f;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (unsigned int level = 0; level < header.LevelCount; level++)
+	{
+		const TiledHeightmapLevel& info = heightmap.GetLevel(level);
+		float x = std::clamp(gridX / (1u << level), 0.0f, (float)(info.Width - 1));
+		float z = std::clamp(gridZ / (1u << level), 0.0f, (float)(info.Height - 1));
+		unsigned int tileX = std::min((unsigned int)x / tileSize, info.TilesX - 1);
+		unsigned int tileZ = std::min((unsigned int)z / tileSize, info.TilesZ - 1);
+
+		std::shared_ptr<const TerrainTile> tile = FindTile(MakeKey(level, tileX, tileZ));
+		if (!tile)
+			continue;
+
+		float localX = x - tileX * tileSize;
+		float localZ = z - tileZ * tileSize;
+		unsigned int x0 = std::min((unsigned int)localX, tileSize - 1);
+		unsigned int z0 = std::min((unsigned int)localZ, tileSize - 1);
+		float fx = localX - x0;
+		float fz = localZ - z0;
+
+		const float* row0 = &tile->Heights[(size_t)z0 * samplesAcross + x0];
+		const float* row1 = row0 + samplesAcross;
+		float h0 = row0[0] + (row0[1] - row0[0]) * fx;
+		float h1 = row1[0] + (row1[1] - row1[0]) * fx;
+		height = h0 + (h1 - h0) * fz;
+		return true;
+	}
+
+	return false;
+}
+
+TerrainStreamingStats TerrainStreamer::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	TerrainStreamingStats stats = {};
+	stats.ResidentTiles = (unsigned int)cache.size();
+	stats.ResidentBytes = residentBytes;
+	stats.PendingTiles = (unsigned int)requests.size();
+	stats.LoadedTiles = loadedTiles;
+	stats.EvictedTiles = evictedTiles;
+	stats.AverageLoadMs = loadedTiles ? (float)(totalLoadMs / loadedTiles) : 0.0f;
+	stats.MaxLoadMs = (float)maxLoadMs;
+	stats.AverageFetchMs = fetchedTiles ? (float)(totalFetchMs / fetchedTiles) : 0.0f;
+	stats.MaxFetchMs = (float)maxFetchMs;
+	return stats;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "TiledHeightmap.h"
+
+// --------------------------------------------------------
+// Keeps the tiles of a TiledHeightmap that are near the
+// camera in memory, loading them on a background thread.
+//
+// Each level wants the tiles within a radius of the camera,
+// doubling with each level (so every level wants about the
+// same number of tiles), and the coarsest level is always
+// wanted in full as a fallback.  Update() works out which
+// tiles are missing and queues them, closest first; the
+// loading thread decodes them from the memory mapped file.
+//
+// Loaded tiles stay in a least recently used cache until it
+// goes over budget, at which point tiles that aren't wanted
+// any more are dropped (oldest first).  The mapped file's
+// pages are left to the OS, which drops them as needed.
+// --------------------------------------------------------
+
+// One loaded tile, as world heights
+struct TerrainTile
+{
+	unsigned int Level;
+	unsigned int X;
+	unsigned int Z;
+	std::vector<float> Heights;		// Samples across x samples across, in Heightmap.h's row order
+};
+
+struct TerrainStreamingSettings
+{
+	float Radius;		// World distance from the camera to keep level 0 tiles loaded (doubles per level)
+	size_t Budget;		// Bytes of loaded tiles to keep before dropping unwanted ones
+};
+
+struct TerrainStreamingStats
+{
+	unsigned int ResidentTiles;
+	size_t ResidentBytes;
+	unsigned int PendingTiles;
+	unsigned int LoadedTiles;		// Totals since Open()
+	unsigned int EvictedTiles;
+	float AverageLoadMs;			// Time to decode a tile (including reading it from disk)
+	float MaxLoadMs;
+	float AverageFetchMs;			// Time from a tile first being wanted until it's loaded
+	float MaxFetchMs;
+};
+
+class TerrainStreamer
+{
+public:
+	TerrainStreamer();
+	~TerrainStreamer();
+
+	// Opens a tiled heightmap and starts the loading thread
+	bool Open(const std::filesystem::path& path, const TerrainStreamingSettings& settings);
+	void Close();
+
+	// Queues the tiles the camera (a world position) needs
+	// and marks the loaded ones as used.  Call once a frame.
+	void Update(const float cameraPosition[3]);
+
+	// A loaded tile, or null if it isn't loaded (yet)
+	std::shared_ptr<const TerrainTile> GetTile(unsigned int level, unsigned int tileX, unsigned int tileZ);
+
+	// Height at a world position from the finest loaded tile
+	// covering it, or false if none is loaded
+	bool GetHeight(float worldX, float worldZ, float& height);
+
+	TerrainStreamingStats GetStats();
+	const TiledHeightmap& GetHeightmap() const;
+
+	// The loading thread reads the settings too, so they're
+	// copied in and out under the lock.  A smaller budget takes
+	// effect right away; a new radius on the next Update().
+	TerrainStreamingSettings GetSettings();
+	void SetSettings(const TerrainStreamingSettings& settings);
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct CachedTile
+	{
+		std::shared_ptr<const TerrainTile> Tile;
+		std::list<uint64_t>::iterator Recent;	// Position in the recently used list
+		unsigned int LastWanted;				// Frame the tile was last wanted
+	};
+
+	struct TileRequest
+	{
+		uint64_t Key;
+		float Priority;		// Lower loads sooner
+	};
+
+	static uint64_t MakeKey(unsigned int level, unsigned int tileX, unsigned int tileZ);
+	std::shared_ptr<const TerrainTile> FindTile(uint64_t key);
+	std::shared_ptr<TerrainTile> LoadTile(uint64_t key);
+	void LoadThread();
+	void Evict();
+
+	TiledHeightmap heightmap;
+	unsigned int frame;
+
+	// Everything below is shared with the loading thread
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::thread thread;
+	bool stopping;
+
+	TerrainStreamingSettings settings;
+
+	std::unordered_map<uint64_t, CachedTile> cache;
+	std::list<uint64_t> recent;							// Most recently wanted first
+	size_t residentBytes;
+
+	std::vector<TileRequest> requests;					// Sorted so the next to load is last
+	std::unordered_map<uint64_t, Clock::time_point> requestTimes;
+
+	unsigned int loadedTiles;
+	unsigned int evictedTiles;
+	unsigned int fetchedTiles;
+	double totalLoadMs;
+	double maxLoadMs;
+	double totalFetchMs;
+	double maxFetchMs;
+};
@@ -0,0 +1,84 @@
+#include "ShaderStructs.hlsli"
+
+// Draws one patch of chunked LOD terrain (see ChunkedTerrain)
+
+cbuffer ExternalData : register(b0)
+{
+	matrix view;
+	matrix projection;
+
+	float3 cameraPosition;
+	float xzScale;
+
+	float2 heightmapSize;
+	float patchGridSize;	// Quads across the patch grid
+}
+
+cbuffer PerPatch : register(b1)
+{
+	float2 patchOrigin;		// Heightmap grid point of the patch's corner
+	float patchScale;		// Grid points per patch grid vertex (2^LOD)
+	float2 morphRange;		// Distances over which vertices morph to the next LOD
+}
+
+Texture2D Heightmap				: register(t0);
+SamplerState HeightSampler		: register(s0);
+
+struct VertexShaderInput_TerrainPatch
+{
+	float2 gridPosition		: POSITION;	// Integer coordinates within the patch grid
+};
+
+
+// Height at a (possibly fractional) heightmap grid point
+float SampleHeight(float2 gridPoint)
+{
+	return Heightmap.SampleLevel(HeightSampler, (gridPoint + 0.5f) / heightmapSize, 0).r;
+}
+
+// World position of a heightmap grid point, matching TerrainMesh
+float3 GridToWorld(float2 gridPoint)
+{
+	float2 xz = (gridPoint - heightmapSize / 2.0f) * xzScale;
+	return float3(xz.x, SampleHeight(gridPoint), xz.y);
+}
+
+
+// --------------------------------------------------------
+// Places the vertex on the heightmap, then morphs it towards
+// the next coarser LOD's grid based on its distance from the
+// camera.  Odd vertices slide onto their even neighbors, so
+// fully morphed patches match the coarser patches next to them.
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput_TerrainPatch input)
+{
+	VertexToPixel output;
+
+	// Unmorphed position decides how far to morph
+	float2 gridPoint = patchOrigin + input.gridPosition * patchScale;
+	float3 worldPos = GridToWorld(gridPoint);
+	float morph = saturate((distance(worldPos, cameraPosition) - morphRange.x) / (morphRange.y - morphRange.x));
+
+	float2 oddOffset = frac(input.gridPosition * 0.5f) * 2.0f;
+	gridPoint = patchOrigin + (input.gridPosition - oddOffset * morph) * patchScale;
+	gridPoint = min(gridPoint, heightmapSize - 1.0f);
+	worldPos = GridToWorld(gridPoint);
+
+	// Normal from the slope of the heights around this point,
+	// with the tangent following +x (the direction U increases)
+	float heightLeft = SampleHeight(gridPoint - float2(1, 0));
+	float heightRight = SampleHeight(gridPoint + float2(1, 0));
+	float heightDown = SampleHeight(gridPoint - float2(0, 1));
+	float heightUp = SampleHeight(gridPoint + float2(0, 1));
+	float slopeX = (heightRight - heightLeft) / (2.0f * xzScale);
+	float slopeZ = (heightUp - heightDown) / (2.0f * xzScale);
+
+	output.screenPosition = mul(mul(projection, view), float4(worldPos, 1.0f));
+	output.worldPos = worldPos;
+	output.normal = normalize(float3(-slopeX, 1.0f, -slopeZ));
+	output.tangent = normalize(float3(1.0f, slopeX, 0.0f));
+	output.uv = gridPoint / heightmapSize;
+	output.posForShadow = float4(0, 0, 0, 1);
+
+	return output;
+}
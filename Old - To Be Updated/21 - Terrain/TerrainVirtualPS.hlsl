@@ -0,0 +1,113 @@
+
+#include "ShaderStructs.hlsli"
+#include "Lighting.hlsli"
+
+
+cbuffer ExternalData : register(b0)
+{
+	// Scene related
+	Light lights[MAX_LIGHTS];
+	int lightCount;
+
+	float3 ambientColor;
+
+	// Camera related
+	float3 cameraPosition;
+
+	// Virtual texture layout (see TerrainPageCache)
+	float pagesAcross;		// Page table entries across (pages at level 0)
+	float pageSize;			// Texels across a page, not counting its border
+	float pageBorder;		// Texels of border on each side of a page
+	float atlasSize;		// Texels across each atlas
+}
+
+// Texture related resources
+Texture2D<uint4> PageTable			: register(t0);		// Atlas slot x and y, then level
+Texture2D AlbedoRoughnessAtlas		: register(t1);		// Gamma encoded albedo, roughness
+Texture2D NormalMetalAtlas			: register(t2);		// Packed tangent space normal, metalness
+
+// Baked ambient occlusion (r) and sun visibility (g), one texel per grid point
+Texture2D OcclusionMap				: register(t3);
+
+SamplerState PageSampler			: register(s0);
+SamplerState BasicSampler			: register(s1);
+
+
+// --------------------------------------------------------
+// The entry point (main method) for our pixel shader
+// --------------------------------------------------------
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	// Clean up un-normalized normals
+	input.normal = normalize(input.normal);
+	input.tangent = normalize(input.tangent);
+
+	// Occlusion texel centers sit on the grid points (the vertices)
+	float2 occlusionSize;
+	OcclusionMap.GetDimensions(occlusionSize.x, occlusionSize.y);
+	float2 occlusion = OcclusionMap.Sample(BasicSampler, input.uv + 0.5f / occlusionSize).rg;
+
+	// Find the page covering this pixel (which may be a coarser
+	// one than the camera wants, if that isn't baked yet)
+	uint2 entryCoord = min((uint2)(saturate(input.uv) * pagesAcross), (uint)pagesAcross - 1);
+	uint4 entry = PageTable.Load(int3(entryCoord, 0));
+	if (entry.z == 255)
+		return float4(0, 0, 0, 1);
+
+	// Where the pixel is within the page, then within the atlas.  Texture
+	// coordinate derivatives come from the terrain's uv, since the atlas
+	// coordinates jump from one page to the next.
+	float pagesAtLevel = pagesAcross / (float)(1u << entry.z);
+	float2 inPage = input.uv * pagesAtLevel - (float2)(entryCoord >> entry.z);
+	float paddedPageSize = pageSize + 2.0f * pageBorder;
+	float2 atlasUV = (entry.xy * paddedPageSize + pageBorder + inPage * pageSize) / atlasSize;
+	float uvToAtlas = pagesAtLevel * pageSize / atlasSize;
+	float2 atlasDX = ddx(input.uv) * uvToAtlas;
+	float2 atlasDY = ddy(input.uv) * uvToAtlas;
+
+	float4 albedoRoughness = AlbedoRoughnessAtlas.SampleGrad(PageSampler, atlasUV, atlasDX, atlasDY);
+	float4 normalMetal = NormalMetalAtlas.SampleGrad(PageSampler, atlasUV, atlasDX, atlasDY);
+
+	// Apply normal mapping
+	input.normal = NormalMapping(normalMetal.rgb * 2.0f - 1.0f, input.normal, input.tangent);
+
+	float3 surfaceColor = pow(albedoRoughness.rgb, 2.2f);
+	float roughness = albedoRoughness.a;
+	float metal = normalMetal.a;
+
+	// Specular color - Assuming albedo texture is actually holding specular color if metal == 1
+	// Note the use of lerp here - metal is generally 0 or 1, but might be in between
+	// because of linear texture sampling, so we want lerp the specular color to match
+	float3 specColor = lerp(F0_NON_METAL.rrr, surfaceColor, metal);
+
+	// Start off with ambient, less whatever the terrain hides of the sky
+	float3 totalLight = ambientColor * surfaceColor * occlusion.r;
+
+	// Loop and handle all lights
+	for (int i = 0; i < lightCount; i++)
+	{
+		// Grab this light and normalize the direction (just in case)
+		Light light = lights[i];
+		light.Direction = normalize(light.Direction);
+
+		// Run the correct lighting calculation based on the light's type
+		switch (light.Type)
+		{
+		case LIGHT_TYPE_DIRECTIONAL:
+			// The first light is the sun the shadows were baked for
+			totalLight += DirLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor, specColor) * (i == 0 ? occlusion.g : 1.0f);
+			break;
+
+		case LIGHT_TYPE_POINT:
+			totalLight += PointLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor, specColor);
+			break;
+
+		case LIGHT_TYPE_SPOT:
+			totalLight += SpotLightPBR(light, input.normal, input.worldPos, cameraPosition, roughness, metal, surfaceColor, specColor);
+			break;
+		}
+	}
+
+	// Should have the complete light contribution at this point.  Just need to gamma correct
+	return float4(pow(totalLight, 1.0f / 2.2f), 1);
+}
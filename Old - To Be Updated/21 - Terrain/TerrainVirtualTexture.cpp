@@ -0,0 +1,202 @@
+#include "TerrainVirtualTexture.h"
+
+#include <algorithm>
+
+// Most anisotropy the page sampler uses.  Its taps spread further
+// from the sample point the more it's allowed, so it's also kept to
+// the width of the page border.
+static const unsigned int MaxPageAnisotropy = 8;
+
+
+// --------------------------------------------------------
+// Creates the atlases and page table for the cache's
+// settings and copies over whatever it has baked so far
+//
+// pageCache - An initialized page cache
+// device - DX device for resource creation
+// context - DX context for uploading pages
+// --------------------------------------------------------
+TerrainVirtualTexture::TerrainVirtualTexture(
+	std::shared_ptr<TerrainPageCache> pageCache,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	:
+	pageCache(pageCache),
+	device(device),
+	context(context)
+{
+	CreateResources();
+	Upload();
+}
+
+
+void TerrainVirtualTexture::CreateResources()
+{
+	const TerrainPageCacheSettings& settings = pageCache->GetSettings();
+	if (settings.PagesAcross == 0)
+		return;
+
+	// The atlases are updated a page at a time, so they can't be immutable
+	D3D11_TEXTURE2D_DESC atlasDesc = {};
+	atlasDesc.Width = pageCache->GetAtlasSize();
+	atlasDesc.Height = pageCache->GetAtlasSize();
+	atlasDesc.MipLevels = 1;
+	atlasDesc.ArraySize = 1;
+	atlasDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	atlasDesc.SampleDesc.Count = 1;
+	atlasDesc.Usage = D3D11_USAGE_DEFAULT;
+	atlasDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	device->CreateTexture2D(&atlasDesc, 0, albedoRoughnessAtlas.GetAddressOf());
+	device->CreateTexture2D(&atlasDesc, 0, normalMetalAtlas.GetAddressOf());
+	device->CreateShaderResourceView(albedoRoughnessAtlas.Get(), 0, albedoRoughnessSRV.GetAddressOf());
+	device->CreateShaderResourceView(normalMetalAtlas.Get(), 0, normalMetalSRV.GetAddressOf());
+
+	// Page table entries are read with Load(), as integers
+	D3D11_TEXTURE2D_DESC tableDesc = atlasDesc;
+	tableDesc.Width = settings.PagesAcross;
+	tableDesc.Height = settings.PagesAcross;
+	tableDesc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+	device->CreateTexture2D(&tableDesc, 0, pageTable.GetAddressOf());
+	device->CreateShaderResourceView(pageTable.Get(), 0, pageTableSRV.GetAddressOf());
+
+	D3D11_SAMPLER_DESC sampDesc = {};
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.Filter = D3D11_FILTER_ANISOTROPIC;
+	sampDesc.MaxAnisotropy = std::clamp(settings.PageBorder, 1u, MaxPageAnisotropy);
+	sampDesc.MaxLOD = 0;
+	device->CreateSamplerState(&sampDesc, pageSampler.GetAddressOf());
+}
+
+
+// --------------------------------------------------------
+// Copies each newly baked page into its slot, then the
+// page table (which is small enough to copy whole)
+// --------------------------------------------------------
+void TerrainVirtualTexture::Upload()
+{
+	if (!pageTable)
+		return;
+
+	unsigned int paddedSize = pageCache->GetPaddedPageSize();
+	for (const TerrainPageUpload& page : pageCache->GetUploads())
+	{
+		D3D11_BOX box = {};
+		box.left = page.SlotX * paddedSize;
+		box.top = page.SlotY * paddedSize;
+		box.right = box.left + paddedSize;
+		box.bottom = box.top + paddedSize;
+		box.back = 1;
+		context->UpdateSubresource(albedoRoughnessAtlas.Get(), 0, &box, page.AlbedoRoughness.data(), paddedSize * 4, 0);
+		context->UpdateSubresource(normalMetalAtlas.Get(), 0, &box, page.NormalMetal.data(), paddedSize * 4, 0);
+	}
+
+	if (pageCache->PageTableChanged())
+		context->UpdateSubresource(pageTable.Get(), 0, 0, pageCache->GetPageTable().data(), pageCache->GetSettings().PagesAcross * 4, 0);
+}
+
+
+void TerrainVirtualTexture::AddToMaterial(std::shared_ptr<Material> material)
+{
+	material->AddTextureSRV("PageTable", pageTableSRV);
+	material->AddTextureSRV("AlbedoRoughnessAtlas", albedoRoughnessSRV);
+	material->AddTextureSRV("NormalMetalAtlas", normalMetalSRV);
+	material->AddSampler("PageSampler", pageSampler);
+
+	const TerrainPageCacheSettings& settings = pageCache->GetSettings();
+	std::shared_ptr<SimplePixelShader> ps = material->GetPixelShader();
+	ps->SetFloat("pagesAcross", (float)settings.PagesAcross);
+	ps->SetFloat("pageSize", (float)settings.PageSize);
+	ps->SetFloat("pageBorder", (float)settings.PageBorder);
+	ps->SetFloat("atlasSize", (float)pageCache->GetAtlasSize());
+}
+
+
+// --------------------------------------------------------
+// Copies the texture's top mip to a staging texture, then
+// repacks its rows as tightly packed 8-bit channels
+// --------------------------------------------------------
+TerrainSplatImage TerrainVirtualTexture::ReadTexture(
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv,
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	TerrainSplatImage image = {};
+	if (!srv)
+		return image;
+
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	srv->GetResource(resource.GetAddressOf());
+	if (FAILED(resource.As(&texture)))
+		return image;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->GetDesc(&desc);
+
+	// Channels, bytes per channel, and whether red and blue are swapped
+	unsigned int channels = 0;
+	unsigned int channelBytes = 1;
+	bool bgr = false;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		channels = 4;
+		break;
+
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		channels = 4;
+		bgr = true;
+		break;
+
+	case DXGI_FORMAT_R8G8_UNORM: channels = 2; break;
+	case DXGI_FORMAT_R8_UNORM: channels = 1; break;
+	case DXGI_FORMAT_R16G16B16A16_UNORM: channels = 4; channelBytes = 2; break;
+	case DXGI_FORMAT_R16_UNORM: channels = 1; channelBytes = 2; break;
+	default: return image;
+	}
+
+	D3D11_TEXTURE2D_DESC stagingDesc = desc;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.ArraySize = 1;
+	stagingDesc.SampleDesc.Count = 1;
+	stagingDesc.SampleDesc.Quality = 0;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(device->CreateTexture2D(&stagingDesc, 0, staging.GetAddressOf())))
+		return image;
+	context->CopySubresourceRegion(staging.Get(), 0, 0, 0, 0, texture.Get(), 0, 0);
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped)))
+		return image;
+
+	image.Width = desc.Width;
+	image.Height = desc.Height;
+	image.Channels = channels;
+	image.Texels.resize((size_t)desc.Width * desc.Height * channels);
+	for (unsigned int y = 0; y < desc.Height; y++)
+	{
+		const uint8_t* row = (const uint8_t*)mapped.pData + (size_t)y * mapped.RowPitch;
+		uint8_t* texels = &image.Texels[(size_t)y * desc.Width * channels];
+		for (unsigned int i = 0; i < desc.Width * channels; i++)
+		{
+			// Little endian, so a 16-bit value's high byte is its second
+			unsigned int channel = i % channels;
+			unsigned int source = bgr && channel != 1 && channel != 3 ? i - channel + (2 - channel) : i;
+			texels[i] = row[source * channelBytes + channelBytes - 1];
+		}
+	}
+
+	context->Unmap(staging.Get(), 0);
+	return image;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+
+#include "Material.h"
+#include "TerrainPageCache.h"
+#include "TerrainSplatCompositor.h"
+
+// --------------------------------------------------------
+// The GPU side of the terrain's virtual texture: two atlas
+// textures holding the resident pages (albedo + roughness,
+// then normal + metalness) and the page table, all kept up
+// to date with a TerrainPageCache.
+//
+// TerrainVirtualPS looks up each pixel's page table entry,
+// works out where that page sits in the atlases, and samples
+// them once each, in place of TerrainPS's blend map and
+// twelve layer textures.
+//
+// Pages have no mips, since the cache already picks pages
+// at about one texel per pixel.  Anisotropic filtering can
+// still reach a few texels past a page's edge, so the
+// sampler's anisotropy is kept within the page border.
+// --------------------------------------------------------
+class TerrainVirtualTexture
+{
+public:
+	TerrainVirtualTexture(
+		std::shared_ptr<TerrainPageCache> pageCache,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Copies the pages the cache baked in its last Init() or Update()
+	// (and the page table, if it changed) to the GPU
+	void Upload();
+
+	// Gives a material using TerrainVirtualPS the atlases, page table
+	// and sampler, and sets the shader's page layout values
+	void AddToMaterial(std::shared_ptr<Material> material);
+
+	// Copies the top mip of a texture back to the CPU, for the
+	// splat compositor.  Handles 8-bit formats (and 16-bit ones,
+	// cut down to 8 bits); anything else comes back empty.
+	static TerrainSplatImage ReadTexture(
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv,
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+private:
+	void CreateResources();
+
+	std::shared_ptr<TerrainPageCache> pageCache;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> albedoRoughnessAtlas;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> normalMetalAtlas;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> pageTable;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedoRoughnessSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normalMetalSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> pageTableSRV;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> pageSampler;
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+};
@@ -0,0 +1,101 @@
+#include "Heightfield.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Queries per second for a 1025x1025 heightfield: heights,
+// normals and raycasts, one at a time and batched (which
+// splits them between threads).  Rays are the kind the demo
+// casts - from camera height, down at the ground at
+// anything from a grazing angle to straight down.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+template<typename Func>
+static void Time(const char* label, size_t count, Func func)
+{
+	auto start = Clock::now();
+	func();
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	std::printf("%-24s %8.2f M queries/s (%.1f ns each)\n", label, count / seconds / 1e6, seconds * 1e9 / count);
+}
+
+int main()
+{
+	const unsigned int size = 1025;
+	const float xzScale = 1.0f;
+	std::vector<float> heights(size * size);
+	for (unsigned int z = 0; z < size; z++)
+		for (unsigned int x = 0; x < size; x++)
+			heights[z * size + x] =
+				40.0f * std::sin(x * 0.011f) * std::cos(z * 0.013f) +
+				8.0f * std::sin(x * 0.07f + z * 0.05f) +
+				1.5f * std::sin(x * 0.31f) * std::sin(z * 0.27f);
+
+	auto heightmap = std::make_shared<Heightmap>();
+	heightmap->SetHeights(heights.data(), size, size, xzScale);
+
+	auto start = Clock::now();
+	Heightfield field(heightmap);
+	std::printf("Surface and pyramid of %u levels built in %.2f ms\n", field.GetLevelCount(),
+		std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> across(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	const size_t pointCount = 4000000;
+	std::vector<XMFLOAT2> positions(pointCount);
+	for (XMFLOAT2& position : positions)
+		position = XMFLOAT2(across(rng), across(rng));
+
+	const size_t rayCount = 200000;
+	std::vector<HeightfieldRay> rays(rayCount);
+	for (HeightfieldRay& ray : rays)
+	{
+		float angle = unit(rng) * XM_2PI;
+		float drop = 0.02f + unit(rng) * unit(rng) * 3.0f;
+		ray.Origin = XMFLOAT3(across(rng), 60.0f, across(rng));
+		ray.Direction = XMFLOAT3(std::cos(angle), -drop, std::sin(angle));
+		ray.MaxDistance = 2000.0f;
+	}
+
+	std::vector<float> results(pointCount);
+	std::vector<XMFLOAT3> normals(pointCount);
+	std::vector<HeightfieldHit> hits(rayCount);
+	float sink = 0.0f;
+
+	Time("GetHeight", pointCount, [&]() {
+		for (size_t i = 0; i < pointCount; i++)
+			results[i] = field.GetHeight(positions[i].x, positions[i].y); });
+	Time("GetHeights (batched)", pointCount, [&]() {
+		field.GetHeights(positions.data(), results.data(), pointCount); });
+	sink += results[pointCount / 2];
+
+	Time("GetNormal", pointCount, [&]() {
+		for (size_t i = 0; i < pointCount; i++)
+			normals[i] = field.GetNormal(positions[i].x, positions[i].y); });
+	Time("GetNormals (batched)", pointCount, [&]() {
+		field.GetNormals(positions.data(), normals.data(), pointCount); });
+	sink += normals[pointCount / 2].y;
+
+	Time("Raycast", rayCount, [&]() {
+		for (size_t i = 0; i < rayCount; i++)
+			hits[i] = field.Raycast(rays[i]); });
+	Time("Raycast (batched)", rayCount, [&]() {
+		field.Raycast(rays.data(), hits.data(), rayCount); });
+
+	size_t hitCount = 0;
+	for (const HeightfieldHit& hit : hits)
+		hitCount += hit.Hit;
+	std::printf("%zu of %zu rays hit (%g)\n", hitCount, rayCount, sink);
+	return 0;
+}
@@ -0,0 +1,496 @@
+#include "Heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Checks Heightfield's height, normal and raycast queries.
+//
+// Raycasts are checked against a brute-force loop over every
+// triangle of the surface.  On a heightmap made of a function
+// of x plus a function of z, every grid square's bilinear
+// surface is flat, so two triangles per square match it
+// exactly.  Other heightmaps are split into many triangles
+// per square, which match it closely enough for steep rays.
+// The terrain is solid under the surface, so the reference
+// also counts a ray coming in under the surface from the side
+// of the map as hitting where it comes in.  Rays along grid
+// lines, rays starting under the surface and rays straight
+// down are checked on their own.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static bool Close(float a, float b, float tolerance)
+{
+	return std::fabs(a - b) <= tolerance * (1.0f + std::fabs(a) + std::fabs(b));
+}
+
+// A heightmap whose squares are all flat: f(x) + g(z)
+static std::shared_ptr<Heightmap> MakeFlatSquares(unsigned int width, unsigned int height, float xzScale, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> bump(-0.5f, 0.5f);
+	std::vector<float> alongX(width);
+	std::vector<float> alongZ(height);
+	for (unsigned int x = 0; x < width; x++)
+		alongX[x] = 2.0f * std::sin(x * 0.7f) + bump(rng);
+	for (unsigned int z = 0; z < height; z++)
+		alongZ[z] = 1.5f * std::cos(z * 0.45f) + bump(rng);
+
+	std::vector<float> heights(width * height);
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			heights[z * width + x] = alongX[x] + alongZ[z];
+
+	auto heightmap = std::make_shared<Heightmap>();
+	heightmap->SetHeights(heights.data(), width, height, xzScale);
+	return heightmap;
+}
+
+// Hills and noise, with properly curved squares
+static std::shared_ptr<Heightmap> MakeHills(unsigned int width, unsigned int height, float xzScale, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> bump(-0.4f, 0.4f);
+	std::vector<float> heights(width * height);
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			heights[z * width + x] = 3.0f * std::sin(x * 0.5f) * std::cos(z * 0.4f) + bump(rng);
+
+	auto heightmap = std::make_shared<Heightmap>();
+	heightmap->SetHeights(heights.data(), width, height, xzScale);
+	return heightmap;
+}
+
+// Height of the bilinear surface at a grid position
+static double Bilinear(const Heightmap& map, double x, double z)
+{
+	unsigned int x0 = std::min((unsigned int)x, map.GetWidth() - 2);
+	unsigned int z0 = std::min((unsigned int)z, map.GetHeight() - 2);
+	double fx = x - x0;
+	double fz = z - z0;
+	double h0 = map.GetValue(x0, z0) * (1 - fx) + map.GetValue(x0 + 1, z0) * fx;
+	double h1 = map.GetValue(x0, z0 + 1) * (1 - fx) + map.GetValue(x0 + 1, z0 + 1) * fx;
+	return h0 * (1 - fz) + h1 * fz;
+}
+
+
+// --------------------------------------------------------
+// The reference raycast: every triangle, nearest hit wins.
+// Each grid square is split into split x split pieces, each
+// two triangles with their corners on the bilinear surface.
+// --------------------------------------------------------
+static bool IntersectTriangle(const double origin[3], const double direction[3], const double a[3], const double b[3], const double c[3], double& t)
+{
+	double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	double p[3] = {
+		direction[1] * ac[2] - direction[2] * ac[1],
+		direction[2] * ac[0] - direction[0] * ac[2],
+		direction[0] * ac[1] - direction[1] * ac[0] };
+	double determinant = ab[0] * p[0] + ab[1] * p[1] + ab[2] * p[2];
+	if (std::fabs(determinant) < 1e-14)
+		return false;
+
+	double inverse = 1.0 / determinant;
+	double s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+	double u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+	if (u < -1e-9 || u > 1.0 + 1e-9)
+		return false;
+
+	double q[3] = {
+		s[1] * ab[2] - s[2] * ab[1],
+		s[2] * ab[0] - s[0] * ab[2],
+		s[0] * ab[1] - s[1] * ab[0] };
+	double v = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+	if (v < -1e-9 || u + v > 1.0 + 1e-9)
+		return false;
+
+	t = (ac[0] * q[0] + ac[1] * q[1] + ac[2] * q[2]) * inverse;
+	return t >= 0.0;
+}
+
+static HeightfieldHit ReferenceRaycast(const Heightmap& map, const HeightfieldRay& ray, unsigned int split)
+{
+	double length = std::sqrt((double)ray.Direction.x * ray.Direction.x + (double)ray.Direction.y * ray.Direction.y + (double)ray.Direction.z * ray.Direction.z);
+	double origin[3] = { ray.Origin.x, ray.Origin.y, ray.Origin.z };
+	double direction[3] = { ray.Direction.x / length, ray.Direction.y / length, ray.Direction.z / length };
+
+	auto corner = [&](double x, double z, double p[3]) {
+		p[0] = map.GetWorldX(0) + x * map.GetXZScale();
+		p[1] = Bilinear(map, x, z);
+		p[2] = map.GetWorldZ(0) + z * map.GetXZScale(); };
+
+	HeightfieldHit hit = {};
+	double nearest = ray.MaxDistance;
+
+	// Coming in from the side, under the surface
+	double minX = map.GetWorldX(0), maxX = map.GetWorldX((float)map.GetWidth() - 1);
+	double minZ = map.GetWorldZ(0), maxZ = map.GetWorldZ((float)map.GetHeight() - 1);
+	double tEntry = 0.0;
+	double tExit = ray.MaxDistance;
+	double low[2] = { minX, minZ };
+	double high[2] = { maxX, maxZ };
+	for (int axis = 0; axis < 2; axis++)
+	{
+		double o = origin[axis * 2];
+		double d = direction[axis * 2];
+		if (d == 0.0)
+		{
+			if (o < low[axis] || o > high[axis])
+				return hit;
+			continue;
+		}
+		double t0 = (low[axis] - o) / d;
+		double t1 = (high[axis] - o) / d;
+		tEntry = std::max(tEntry, std::min(t0, t1));
+		tExit = std::min(tExit, std::max(t0, t1));
+	}
+	if (tEntry > tExit)
+		return hit;
+	if (tEntry > 0.0)
+	{
+		double x = (origin[0] + direction[0] * tEntry - minX) / map.GetXZScale();
+		double z = (origin[2] + direction[2] * tEntry - minZ) / map.GetXZScale();
+		x = std::clamp(x, 0.0, map.GetWidth() - 1.0);
+		z = std::clamp(z, 0.0, map.GetHeight() - 1.0);
+		if (origin[1] + direction[1] * tEntry <= Bilinear(map, x, z))
+		{
+			hit.Hit = true;
+			hit.Distance = (float)tEntry;
+			return hit;
+		}
+	}
+
+	for (unsigned int z = 0; z < map.GetHeight() - 1; z++)
+		for (unsigned int x = 0; x < map.GetWidth() - 1; x++)
+			for (unsigned int j = 0; j < split; j++)
+				for (unsigned int i = 0; i < split; i++)
+				{
+					double x0 = x + (double)i / split, x1 = x + (double)(i + 1) / split;
+					double z0 = z + (double)j / split, z1 = z + (double)(j + 1) / split;
+					double p00[3], p10[3], p01[3], p11[3];
+					corner(x0, z0, p00);
+					corner(x1, z0, p10);
+					corner(x0, z1, p01);
+					corner(x1, z1, p11);
+
+					double t;
+					if (IntersectTriangle(origin, direction, p00, p01, p11, t) && t <= nearest)
+					{
+						nearest = t;
+						hit.Hit = true;
+					}
+					if (IntersectTriangle(origin, direction, p00, p11, p10, t) && t <= nearest)
+					{
+						nearest = t;
+						hit.Hit = true;
+					}
+				}
+
+	if (hit.Hit)
+		hit.Distance = (float)nearest;
+	return hit;
+}
+
+static int rayFailures = 0;
+
+static void CheckRay(const Heightfield& field, const HeightfieldRay& ray, unsigned int split, float tolerance, const char* label)
+{
+	const Heightmap& map = *field.GetHeightmap();
+	HeightfieldHit hit = field.Raycast(ray);
+	HeightfieldHit expected = ReferenceRaycast(map, ray, split);
+
+	bool ok = hit.Hit == expected.Hit && (!hit.Hit || std::fabs(hit.Distance - expected.Distance) <= tolerance);
+	if (ok && hit.Hit)
+	{
+		// The hit is on the surface, where the ray is at that distance
+		float length = std::sqrt(ray.Direction.x * ray.Direction.x + ray.Direction.y * ray.Direction.y + ray.Direction.z * ray.Direction.z);
+		ok = Close(hit.Position.x, ray.Origin.x + ray.Direction.x / length * hit.Distance, 1e-4f) &&
+			Close(hit.Position.z, ray.Origin.z + ray.Direction.z / length * hit.Distance, 1e-4f) &&
+			Close(hit.Position.y, field.GetHeight(hit.Position.x, hit.Position.z), 1e-3f);
+	}
+
+	if (!ok)
+	{
+		// Only report the first few, so one bug doesn't bury the rest
+		if (rayFailures++ < 10)
+			std::printf("%s: ray from (%g, %g, %g) along (%g, %g, %g) hit %d at %g, expected %d at %g\n",
+				label, ray.Origin.x, ray.Origin.y, ray.Origin.z, ray.Direction.x, ray.Direction.y, ray.Direction.z,
+				(int)hit.Hit, hit.Distance, (int)expected.Hit, expected.Distance);
+		failures++;
+	}
+}
+
+// Random rays: mostly steeply down from above, some coming in from
+// off the side of the map, and some that are bound to miss
+static void CheckRandomRays(const Heightfield& field, unsigned int split, float tolerance, int count, unsigned int seed, const char* label)
+{
+	const Heightmap& map = *field.GetHeightmap();
+	float minX = map.GetWorldX(0), maxX = map.GetWorldX((float)map.GetWidth() - 1);
+	float minZ = map.GetWorldZ(0), maxZ = map.GetWorldZ((float)map.GetHeight() - 1);
+	const float* data = map.GetData();
+	float top = *std::max_element(data, data + map.GetWidth() * map.GetHeight());
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> sideways(-1.0f, 1.0f);
+	for (int i = 0; i < count; i++)
+	{
+		HeightfieldRay ray;
+		ray.MaxDistance = 500.0f;
+		int kind = i % 4;
+		if (kind < 2)
+		{
+			ray.Origin = XMFLOAT3(minX + unit(rng) * (maxX - minX), top + 0.5f + unit(rng) * 5.0f, minZ + unit(rng) * (maxZ - minZ));
+			ray.Direction = XMFLOAT3(sideways(rng), -1.0f - unit(rng) * 2.0f, sideways(rng));
+		}
+		else if (kind == 2)
+		{
+			ray.Origin = XMFLOAT3(minX - 5.0f, top + 2.0f, minZ + unit(rng) * (maxZ - minZ));
+			ray.Direction = XMFLOAT3(1.0f, -0.2f - unit(rng) * 0.3f, sideways(rng) * 0.3f);
+		}
+		else
+		{
+			// Up, or short of the ground
+			ray.Origin = XMFLOAT3(minX + unit(rng) * (maxX - minX), top + 1.0f, minZ + unit(rng) * (maxZ - minZ));
+			ray.Direction = XMFLOAT3(sideways(rng), unit(rng) < 0.5f ? 0.5f : -1.0f, sideways(rng));
+			ray.MaxDistance = ray.Direction.y > 0 ? 500.0f : 0.5f;
+		}
+		CheckRay(field, ray, split, tolerance, label);
+	}
+}
+
+
+// --------------------------------------------------------
+// Rays that are easy to get wrong
+// --------------------------------------------------------
+static void CheckSpecialRays(const Heightfield& field, unsigned int split, float tolerance, const char* label)
+{
+	const Heightmap& map = *field.GetHeightmap();
+	unsigned int width = map.GetWidth();
+	unsigned int height = map.GetHeight();
+	const float* data = map.GetData();
+	float top = *std::max_element(data, data + width * height);
+
+	// Along grid lines, in both directions and both ways along them,
+	// descending slowly so they cross many squares first
+	for (unsigned int line : { 0u, 5u, width / 2 })
+	{
+		HeightfieldRay ray;
+		ray.MaxDistance = 1000.0f;
+		ray.Origin = XMFLOAT3(map.GetWorldX((float)line), top + 1.0f, map.GetWorldZ(-3.0f));
+		ray.Direction = XMFLOAT3(0.0f, -0.15f, 1.0f);
+		CheckRay(field, ray, split, tolerance, label);
+
+		ray.Origin = XMFLOAT3(map.GetWorldX(width + 2.0f), top + 1.0f, map.GetWorldZ((float)std::min(line, height - 1)));
+		ray.Direction = XMFLOAT3(-1.0f, -0.15f, 0.0f);
+		CheckRay(field, ray, split, tolerance, label);
+	}
+
+	// Along a square's diagonal
+	{
+		HeightfieldRay ray;
+		ray.MaxDistance = 1000.0f;
+		ray.Origin = XMFLOAT3(map.GetWorldX(-2.0f), top + 1.0f, map.GetWorldZ(-2.0f));
+		ray.Direction = XMFLOAT3(1.0f, -0.2f, 1.0f);
+		CheckRay(field, ray, split, tolerance, label);
+	}
+
+	// Starting under the surface: hits right where it starts, even
+	// pointing up
+	for (float up : { -1.0f, 0.0f, 1.0f })
+	{
+		float x = map.GetWorldX(width / 3.0f + 0.25f);
+		float z = map.GetWorldZ(height / 2.0f + 0.6f);
+		HeightfieldRay ray = { XMFLOAT3(x, field.GetHeight(x, z) - 0.5f, z), XMFLOAT3(0.3f, up, 0.2f), 100.0f };
+		HeightfieldHit hit = field.Raycast(ray);
+		CHECK(hit.Hit);
+		CHECK(hit.Distance == 0.0f);
+		CHECK(hit.Position.x == x && hit.Position.z == z);
+	}
+
+	// Straight down: on a grid point, in the middle of a square, on an
+	// edge between squares and on the map's far corner
+	float gridPoints[][2] = {
+		{ 7.0f, 4.0f },
+		{ 3.5f, 2.25f },
+		{ 6.0f, 8.7f },
+		{ width - 1.0f, height - 1.0f } };
+	for (auto& point : gridPoints)
+	{
+		float x = map.GetWorldX(point[0]);
+		float z = map.GetWorldZ(point[1]);
+		float ground = (float)Bilinear(map, point[0], point[1]);
+		HeightfieldRay ray = { XMFLOAT3(x, top + 3.0f, z), XMFLOAT3(0.0f, -1.0f, 0.0f), 100.0f };
+		HeightfieldHit hit = field.Raycast(ray);
+		CHECK(hit.Hit);
+		CHECK(Close(hit.Distance, top + 3.0f - ground, 1e-5f));
+		CHECK(hit.Position.x == x && hit.Position.z == z);
+		CHECK(Close(hit.Position.y, ground, 1e-5f));
+
+		// And with too short a reach
+		ray.MaxDistance = hit.Distance * 0.99f;
+		CHECK(!field.Raycast(ray).Hit);
+	}
+
+	// Level, just above the highest point, and off the map entirely
+	{
+		HeightfieldRay ray = { XMFLOAT3(map.GetWorldX(-1.0f), top + 1e-3f, map.GetWorldZ(2.5f)), XMFLOAT3(1.0f, 0.0f, 0.0f), 1000.0f };
+		CHECK(!field.Raycast(ray).Hit);
+		ray.Origin = XMFLOAT3(map.GetWorldX(-10.0f), top - 100.0f, map.GetWorldZ(-10.0f));
+		ray.Direction = XMFLOAT3(-1.0f, 0.0f, 0.0f);
+		CHECK(!field.Raycast(ray).Hit);
+	}
+}
+
+
+// --------------------------------------------------------
+// Heights and normals against the grid, and the batched
+// versions against the single ones
+// --------------------------------------------------------
+static void CheckHeightsAndNormals(const Heightfield& field)
+{
+	const Heightmap& map = *field.GetHeightmap();
+	unsigned int width = map.GetWidth();
+	unsigned int height = map.GetHeight();
+	float xzScale = map.GetXZScale();
+
+	// Exact at grid points, bilinear between, clamped off the edges
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			CHECK(Close(field.GetHeight(map.GetWorldX((float)x), map.GetWorldZ((float)z)), map.GetValue(x, z), 1e-5f));
+
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (int i = 0; i < 2000; i++)
+	{
+		float x = unit(rng) * (width - 1);
+		float z = unit(rng) * (height - 1);
+		CHECK(Close(field.GetHeight(map.GetWorldX(x), map.GetWorldZ(z)), (float)Bilinear(map, x, z), 1e-4f));
+	}
+	CHECK(field.GetHeight(map.GetWorldX(-20.0f), map.GetWorldZ(-20.0f)) == map.GetValue(0, 0));
+	CHECK(Close(field.GetHeight(map.GetWorldX(width + 20.0f), map.GetWorldZ(2.0f)), map.GetValue(width - 1, 2), 1e-5f));
+
+	// Normals at grid points: central differences inside, one-sided at the edges
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+		{
+			unsigned int left = x > 0 ? x - 1 : 0;
+			unsigned int right = std::min(x + 1, width - 1);
+			unsigned int down = z > 0 ? z - 1 : 0;
+			unsigned int up = std::min(z + 1, height - 1);
+			float slopeX = (map.GetValue(right, z) - map.GetValue(left, z)) / ((right - left) * xzScale);
+			float slopeZ = (map.GetValue(x, up) - map.GetValue(x, down)) / ((up - down) * xzScale);
+			float length = std::sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+
+			XMFLOAT3 normal = field.GetNormal(map.GetWorldX((float)x), map.GetWorldZ((float)z));
+			CHECK(Close(normal.x, -slopeX / length, 1e-5f));
+			CHECK(Close(normal.y, 1.0f / length, 1e-5f));
+			CHECK(Close(normal.z, -slopeZ / length, 1e-5f));
+		}
+
+	// Unit length everywhere in between
+	for (int i = 0; i < 2000; i++)
+	{
+		XMFLOAT3 normal = field.GetNormal(map.GetWorldX(unit(rng) * (width - 1)), map.GetWorldZ(unit(rng) * (height - 1)));
+		CHECK(Close(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z, 1.0f, 1e-5f));
+		CHECK(normal.y > 0.0f);
+	}
+
+	// Batches (big enough to be split between threads, and an odd size)
+	// give the same answers as single queries, including off the map
+	const size_t count = 100003;
+	std::vector<XMFLOAT2> positions(count);
+	for (XMFLOAT2& position : positions)
+		position = XMFLOAT2(map.GetWorldX(unit(rng) * (width + 4) - 2), map.GetWorldZ(unit(rng) * (height + 4) - 2));
+
+	std::vector<float> heights(count);
+	std::vector<XMFLOAT3> normals(count);
+	field.GetHeights(positions.data(), heights.data(), count);
+	field.GetNormals(positions.data(), normals.data(), count);
+
+	int mismatches = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		XMFLOAT3 normal = field.GetNormal(positions[i].x, positions[i].y);
+		if (!Close(heights[i], field.GetHeight(positions[i].x, positions[i].y), 1e-5f) ||
+			!Close(normals[i].x, normal.x, 1e-5f) || !Close(normals[i].y, normal.y, 1e-5f) || !Close(normals[i].z, normal.z, 1e-5f))
+			mismatches++;
+	}
+	CHECK(mismatches == 0);
+}
+
+static void CheckBatchedRaycasts(const Heightfield& field)
+{
+	const Heightmap& map = *field.GetHeightmap();
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	const size_t count = 1001;
+	std::vector<HeightfieldRay> rays(count);
+	for (HeightfieldRay& ray : rays)
+	{
+		ray.Origin = XMFLOAT3(map.GetWorldX(unit(rng) * map.GetWidth()), 10.0f, map.GetWorldZ(unit(rng) * map.GetHeight()));
+		ray.Direction = XMFLOAT3(unit(rng) - 0.5f, -1.0f, unit(rng) - 0.5f);
+		ray.MaxDistance = 100.0f;
+	}
+
+	std::vector<HeightfieldHit> hits(count);
+	field.Raycast(rays.data(), hits.data(), count);
+	int mismatches = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		HeightfieldHit single = field.Raycast(rays[i]);
+		if (single.Hit != hits[i].Hit || single.Distance != hits[i].Distance)
+			mismatches++;
+	}
+	CHECK(mismatches == 0);
+}
+
+int main()
+{
+	// Flat squares: the triangle loop is exact
+	{
+		Heightfield field(MakeFlatSquares(33, 29, 1.5f, 1));
+		CheckHeightsAndNormals(field);
+		CheckRandomRays(field, 1, 1e-3f, 400, 2, "flat squares");
+		CheckSpecialRays(field, 1, 1e-3f, "flat squares");
+		CheckBatchedRaycasts(field);
+	}
+
+	// Curved squares, finely split
+	{
+		Heightfield field(MakeHills(24, 21, 2.0f, 3));
+		CheckHeightsAndNormals(field);
+		CheckRandomRays(field, 12, 2e-2f, 200, 4, "hills");
+		CheckSpecialRays(field, 12, 2e-2f, "hills");
+		CheckBatchedRaycasts(field);
+	}
+
+	// The smallest map there is: one square
+	{
+		Heightfield field(MakeHills(2, 2, 1.0f, 5));
+		CHECK(field.GetLevelCount() == 1);
+		CheckRandomRays(field, 12, 2e-2f, 40, 6, "one square");
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All heightfield tests passed\n");
+	return 0;
+}
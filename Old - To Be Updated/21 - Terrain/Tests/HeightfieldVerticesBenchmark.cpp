@@ -0,0 +1,54 @@
+#include "HeightfieldVertices.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// How long BuildHeightfieldVertices() takes for the demo's
+// 513x513 heightmap and a 4097x4097 one, on 1 thread and on
+// 2, 4, ... up to every hardware thread.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+int main()
+{
+	const unsigned int sizes[] = { 513, 4097 };
+	unsigned int maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (unsigned int size : sizes)
+	{
+		std::vector<float> heights((size_t)size * size);
+		for (unsigned int z = 0; z < size; z++)
+			for (unsigned int x = 0; x < size; x++)
+				heights[(size_t)z * size + x] = 40.0f * std::sin(x * 0.011f) * std::cos(z * 0.013f) + 8.0f * std::sin(x * 0.07f + z * 0.05f);
+
+		Heightmap heightmap;
+		heightmap.SetHeights(heights.data(), size, size, 0.75f);
+		std::vector<Vertex> verts((size_t)size * size);
+
+		// Warm up (and touch every page of the output)
+		BuildHeightfieldVertices(heightmap, verts.data(), 1);
+
+		int runs = size < 1000 ? 200 : 5;
+		for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+		{
+			auto start = Clock::now();
+			for (int run = 0; run < runs; run++)
+				BuildHeightfieldVertices(heightmap, verts.data(), threads);
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+
+			double vertices = (double)size * size;
+			std::printf("%ux%u, %2u thread(s): %8.3f ms, %6.1f M vertices/s (%.2f ns each)\n",
+				size, size, threads, ms, vertices / ms / 1e3, ms * 1e6 / vertices);
+
+			if (threads == maxThreads)
+				break;
+		}
+	}
+	return 0;
+}
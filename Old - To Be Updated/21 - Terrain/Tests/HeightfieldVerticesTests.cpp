@@ -0,0 +1,149 @@
+#include "HeightfieldVertices.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Checks BuildHeightfieldVertices(), whose rows are done
+// four vertices at a time with SSE, against a scalar
+// version written out here one vertex at a time (the same
+// operations, so every vertex must be bit-identical) on
+// widths that leave every number of leftover columns, and
+// with any number of threads.  Normals must also be unit
+// length and close to the true normals of a smooth surface.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// Central differences inside, one-sided at the edges
+static Vertex ReferenceVertex(const Heightmap& heightmap, unsigned int x, unsigned int z)
+{
+	unsigned int width = heightmap.GetWidth();
+	unsigned int height = heightmap.GetHeight();
+	float xzScale = heightmap.GetXZScale();
+
+	unsigned int zDown = z > 0 ? z - 1 : z;
+	unsigned int zUp = z < height - 1 ? z + 1 : z;
+	float invDZ = 1.0f / ((zUp - zDown) * xzScale);
+	float slopeZ = (heightmap.GetValue(x, zUp) - heightmap.GetValue(x, zDown)) * invDZ;
+
+	float slopeX;
+	if (x == 0)
+		slopeX = (heightmap.GetValue(1, z) - heightmap.GetValue(0, z)) / xzScale;
+	else if (x == width - 1)
+		slopeX = (heightmap.GetValue(x, z) - heightmap.GetValue(x - 1, z)) / xzScale;
+	else
+		slopeX = (heightmap.GetValue(x + 1, z) - heightmap.GetValue(x - 1, z)) * (1.0f / (2.0f * xzScale));
+
+	float normalScale = 1.0f / std::sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+	float tangentScale = 1.0f / std::sqrt(slopeX * slopeX + 1.0f);
+
+	Vertex vert;
+	vert.Position = XMFLOAT3((x - width / 2.0f) * xzScale, heightmap.GetValue(x, z), (z - height / 2.0f) * xzScale);
+	vert.UV = XMFLOAT2(x / (float)width, z / (float)height);
+	vert.Normal = XMFLOAT3(-slopeX * normalScale, normalScale, -slopeZ * normalScale);
+	vert.Tangent = XMFLOAT3(tangentScale, slopeX * tangentScale, 0.0f);
+	return vert;
+}
+
+static Heightmap MakeTerrain(unsigned int width, unsigned int height, float xzScale, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> bumps(-2.0f, 2.0f);
+	std::vector<float> heights((size_t)width * height);
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			heights[(size_t)z * width + x] = 20.0f * std::sin(x * 0.09f) * std::cos(z * 0.07f) + bumps(rng);
+
+	Heightmap heightmap;
+	heightmap.SetHeights(heights.data(), width, height, xzScale);
+	return heightmap;
+}
+
+static void CheckAgainstScalar(unsigned int width, unsigned int height, float xzScale, unsigned int threadCount)
+{
+	Heightmap heightmap = MakeTerrain(width, height, xzScale, width * 31 + height);
+	std::vector<Vertex> verts((size_t)width * height);
+	BuildHeightfieldVertices(heightmap, verts.data(), threadCount);
+
+	int mismatches = 0;
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+		{
+			Vertex expected = ReferenceVertex(heightmap, x, z);
+			if (memcmp(&verts[(size_t)z * width + x], &expected, sizeof(Vertex)) != 0)
+				mismatches++;
+		}
+	CHECK(mismatches == 0);
+	if (mismatches)
+		std::printf("  %u x %u, %u thread(s): %d vertices differ\n", width, height, threadCount, mismatches);
+}
+
+// A gentle slope in both directions, whose normals are known
+static void CheckSmoothNormals()
+{
+	const unsigned int size = 200;
+	const float xzScale = 0.5f;
+	std::vector<float> heights(size * size);
+	for (unsigned int z = 0; z < size; z++)
+		for (unsigned int x = 0; x < size; x++)
+			heights[z * size + x] = 10.0f * std::sin(x * xzScale * 0.05f) + 5.0f * std::cos(z * xzScale * 0.04f);
+
+	Heightmap heightmap;
+	heightmap.SetHeights(heights.data(), size, size, xzScale);
+	std::vector<Vertex> verts(size * size);
+	BuildHeightfieldVertices(heightmap, verts.data());
+
+	float worstLength = 0.0f;
+	float worstAngle = 0.0f;
+	for (unsigned int z = 1; z < size - 1; z++)
+		for (unsigned int x = 1; x < size - 1; x++)
+		{
+			const XMFLOAT3& n = verts[z * size + x].Normal;
+			worstLength = std::max(worstLength, std::abs(std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z) - 1.0f));
+
+			// Derivatives of the surface, in world units
+			float dx = 0.5f * std::cos(x * xzScale * 0.05f);
+			float dz = -0.2f * std::sin(z * xzScale * 0.04f);
+			float length = std::sqrt(dx * dx + dz * dz + 1.0f);
+			float dot = (-dx * n.x + n.y - dz * n.z) / length;
+			worstAngle = std::max(worstAngle, std::acos(std::min(dot, 1.0f)));
+		}
+	CHECK(worstLength < 1e-5f);
+	CHECK(worstAngle < 1e-3f);
+}
+
+int main()
+{
+	// Every width from 2 (no SSE at all) up past a few groups of four
+	for (unsigned int width = 2; width <= 14; width++)
+		for (unsigned int height : { 2u, 3u, 5u })
+			CheckAgainstScalar(width, height, 1.0f, 1);
+
+	// Big enough to be split between threads
+	for (unsigned int threadCount : { 1u, 2u, 3u, 0u })
+	{
+		CheckAgainstScalar(513, 513, 0.75f, threadCount);
+		CheckAgainstScalar(1023, 301, 2.0f, threadCount);
+	}
+
+	CheckSmoothNormals();
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All heightfield vertices tests passed\n");
+	return 0;
+}
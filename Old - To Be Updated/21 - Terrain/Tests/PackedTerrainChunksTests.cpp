@@ -0,0 +1,197 @@
+#include "PackedTerrainChunks.h"
+#include "HeightfieldVertices.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Checks PackedTerrainChunks without a GPU: every vertex
+// rebuilt the way PackedTerrainVS does it against the full
+// vertices BuildHeightfieldVertices() makes for TerrainMesh,
+// the one shared index buffer, and that vertices chunks
+// share along their borders come out bit-identical in each
+// (so the surface can't crack).  Prints how much smaller
+// the packed data is than a full mesh.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static void Check(const char* label, const Heightmap& heightmap, unsigned int chunkSize, bool packNormals)
+{
+	PackedTerrainChunks packed;
+	packed.Build(heightmap, chunkSize, packNormals);
+
+	unsigned int width = heightmap.GetWidth();
+	unsigned int height = heightmap.GetHeight();
+	std::vector<Vertex> expected((size_t)width * height);
+	BuildHeightfieldVertices(heightmap, expected.data(), 1);
+
+	unsigned int across = packed.GetVerticesAcross();
+	unsigned int size = packed.GetChunkSize();
+	const std::vector<uint16_t>& indices = packed.GetIndices();
+	const std::vector<PackedTerrainChunk>& chunks = packed.GetChunks();
+	CHECK(packed.HasNormals() == packNormals);
+
+	// One grid's worth of triangles, all inside a chunk's vertices
+	CHECK(indices.size() == (size_t)size * size * 6);
+	for (uint16_t index : indices)
+		CHECK(index < packed.GetVerticesPerChunk());
+
+	// Each of the chunk grid's squares is covered by exactly two
+	// triangles, split from (x, z) to (x + 1, z + 1) like TerrainMesh
+	std::vector<int> squareTriangles((size_t)size * size, 0);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		unsigned int minX = across, minZ = across, maxX = 0, maxZ = 0;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned int x = indices[i + corner] % across;
+			unsigned int z = indices[i + corner] / across;
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minZ = std::min(minZ, z);
+			maxZ = std::max(maxZ, z);
+		}
+		CHECK(maxX == minX + 1 && maxZ == minZ + 1);
+		squareTriangles[minZ * size + minX]++;
+
+		bool usesDiagonal = false;
+		for (int corner = 0; corner < 3; corner++)
+		{
+			unsigned int a = indices[i + corner];
+			unsigned int b = indices[i + (corner + 1) % 3];
+			usesDiagonal |= (a == minZ * across + minX && b == (minZ + 1) * across + minX + 1) ||
+				(b == minZ * across + minX && a == (minZ + 1) * across + minX + 1);
+		}
+		CHECK(usesDiagonal);
+	}
+	for (int count : squareTriangles)
+		CHECK(count == 2);
+
+	// Every vertex against the full mesh's, and every copy of a grid
+	// point (in neighbouring chunks) against the first one seen
+	struct Rebuilt { XMFLOAT3 Position; XMFLOAT3 Normal; XMFLOAT2 UV; };
+	std::vector<Rebuilt> firstSeen((size_t)width * height);
+	std::vector<char> seen((size_t)width * height, 0);
+	unsigned int sharedCopies = 0;
+	double maxHeightError = 0.0;
+	double maxNormalDegrees = 0.0;
+	for (unsigned int c = 0; c < (unsigned int)chunks.size(); c++)
+	{
+		const PackedTerrainChunk& chunk = chunks[c];
+		CHECK(chunk.HeightOffset == chunks[0].HeightOffset && chunk.HeightScale == chunks[0].HeightScale);
+
+		for (unsigned int v = 0; v < packed.GetVerticesPerChunk(); v++)
+		{
+			unsigned int gridX = std::min(chunk.X + v % across, width - 1);
+			unsigned int gridZ = std::min(chunk.Z + v / across, height - 1);
+			size_t point = (size_t)gridZ * width + gridX;
+			const Vertex& full = expected[point];
+
+			Rebuilt vertex = { packed.GetPosition(c, v), packed.GetNormal(c, v), packed.GetUV(c, v) };
+			CHECK(vertex.Position.x == full.Position.x && vertex.Position.z == full.Position.z);
+			CHECK(vertex.UV.x == full.UV.x && vertex.UV.y == full.UV.y);
+			CHECK(vertex.Position.y >= chunk.MinHeight - 1e-3f && vertex.Position.y <= chunk.MaxHeight + 1e-3f);
+
+			double heightError = std::fabs(vertex.Position.y - full.Position.y);
+			CHECK(heightError <= chunk.HeightScale * 0.5 + 1e-5 * (1.0 + std::fabs(full.Position.y)));
+			maxHeightError = std::max(maxHeightError, heightError);
+
+			if (packNormals)
+			{
+				double cosine = vertex.Normal.x * full.Normal.x + vertex.Normal.y * full.Normal.y + vertex.Normal.z * full.Normal.z;
+				maxNormalDegrees = std::max(maxNormalDegrees, std::acos(std::min(1.0, cosine)) * 180.0 / 3.14159265358979);
+			}
+			else
+				CHECK(vertex.Normal.x == 0.0f && vertex.Normal.y == 1.0f && vertex.Normal.z == 0.0f);
+
+			if (!seen[point])
+			{
+				seen[point] = 1;
+				firstSeen[point] = vertex;
+				continue;
+			}
+
+			sharedCopies++;
+			if (std::memcmp(&firstSeen[point], &vertex, sizeof(Rebuilt)) != 0)
+			{
+				std::printf("%s: grid point (%u, %u) differs between chunks\n", label, gridX, gridZ);
+				failures++;
+				return;
+			}
+		}
+	}
+	for (char wasSeen : seen)
+		CHECK(wasSeen);
+	if (packNormals)
+		CHECK(maxNormalDegrees < 1.5);
+
+	std::printf("%-8s %5ux%-5u chunks of %3u, normals %-3s: %5zu chunks, packed %7.2f MB vs mesh %7.2f MB (%4.1fx smaller), "
+		"%u shared border vertices, max height error %.5f, max normal error %.2f degrees\n",
+		label, width, height, size, packNormals ? "on" : "off", chunks.size(),
+		packed.GetPackedSize() / 1048576.0, packed.GetMeshSize() / 1048576.0,
+		(double)packed.GetMeshSize() / packed.GetPackedSize(),
+		sharedCopies, maxHeightError, maxNormalDegrees);
+}
+
+static Heightmap MakeHills(unsigned int width, unsigned int height, float xzScale)
+{
+	std::vector<float> heights((size_t)width * height);
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			heights[(size_t)z * width + x] = 40.0f * std::sin(x * 0.013f) * std::cos(z * 0.021f) + 5.0f * std::sin(x * 0.2f + z * 0.17f);
+
+	Heightmap heightmap;
+	heightmap.SetHeights(heights.data(), width, height, xzScale);
+	return heightmap;
+}
+
+int main()
+{
+	// The demo's heightmap, as the demo loads it
+	Heightmap asset;
+	if (asset.Load(ASSETS_DIR "/Heightmaps/terrain_513x513.r16", 513, 513, TerrainBitDepth::BitDepth_16, 100.0f, 0.75f))
+	{
+		Check("asset", asset, 64, true);
+		Check("asset", asset, 64, false);
+		Check("asset", asset, 32, true);
+		Check("asset", asset, 255, true);
+	}
+	else
+	{
+		std::printf("Couldn't load terrain_513x513.r16\n");
+		failures++;
+	}
+
+	// Sizes that aren't a multiple of the chunk size (so the far chunks
+	// run off the map), the smallest map, a flat map (which can't be
+	// quantized at all) and a big one
+	Check("ragged", MakeHills(300, 201, 1.3f), 64, true);
+	Check("tiny", MakeHills(2, 2, 1.0f), 64, true);
+	{
+		std::vector<float> flat(97 * 97, 3.0f);
+		Heightmap heightmap;
+		heightmap.SetHeights(flat.data(), 97, 97);
+		Check("flat", heightmap, 16, true);
+	}
+	Check("large", MakeHills(2049, 2049, 1.0f), 64, true);
+	Check("large", MakeHills(2049, 2049, 1.0f), 64, false);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All packed terrain chunk tests passed\n");
+	return 0;
+}
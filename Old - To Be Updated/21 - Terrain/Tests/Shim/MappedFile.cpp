@@ -0,0 +1,71 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --------------------------------------------------------
+// MappedFile.cpp with mmap() in place of the Windows file
+// mapping calls, so the tiled heightmap and the streamer
+// also build where Windows isn't available.  Only used
+// outside of Windows (see CMakeLists.txt).  The mapping
+// keeps the file's pages alive on its own, so the file is
+// closed as soon as it's mapped and neither handle is used.
+// --------------------------------------------------------
+
+MappedFile::MappedFile() :
+	fileHandle(0),
+	mappingHandle(0),
+	data(0),
+	size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::IsOpen() const { return data != 0; }
+const unsigned char* MappedFile::GetData() const { return data; }
+size_t MappedFile::GetSize() const { return size; }
+
+
+// --------------------------------------------------------
+// Maps the whole file for reading, telling the kernel
+// access will jump around so it doesn't read ahead
+// --------------------------------------------------------
+bool MappedFile::Open(const std::filesystem::path& path)
+{
+	Close();
+
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat status = {};
+	if (fstat(file, &status) != 0 || status.st_size <= 0)
+	{
+		close(file);
+		return false;
+	}
+
+	void* mapping = mmap(0, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapping == MAP_FAILED)
+		return false;
+
+	madvise(mapping, (size_t)status.st_size, MADV_RANDOM);
+	data = (const unsigned char*)mapping;
+	size = (size_t)status.st_size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data) munmap((void*)data, size);
+
+	data = 0;
+	size = 0;
+}
@@ -0,0 +1,275 @@
+#include "TerrainGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks the terrain generator: the SSE2 noise against a
+// plain scalar version written from the description in
+// TerrainGenerator.h (odd widths, negative warped positions,
+// ridged and not), that the noise stays in range, that
+// generation and erosion come out bit-identical for any
+// thread count, and that erosion keeps the terrain's mass
+// while wearing down its slopes.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+// --------------------------------------------------------
+// Scalar reference noise, one point at a time
+// --------------------------------------------------------
+static uint32_t Hash(int32_t x, int32_t z, uint32_t seed)
+{
+	uint32_t hash = ((uint32_t)x * 0x27d4eb2du) ^ ((uint32_t)z * 0x165667b1u);
+	hash ^= seed;
+	hash = (hash ^ (hash >> 15)) * 0x2c1b3c6du;
+	return hash ^ (hash >> 16);
+}
+
+static float Gradient(uint32_t hash, float dx, float dz)
+{
+	float u = (hash & 4) ? dz : dx;
+	float v = (hash & 4) ? dx : dz;
+	if (hash & 1) u = -u;
+	if (hash & 2) v = -v;
+	return u + 2 * v;
+}
+
+static float Fade(float t)
+{
+	return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+static float Noise(float x, float z, uint32_t seed)
+{
+	float floorX = std::floor(x);
+	float floorZ = std::floor(z);
+	int cornerX = (int)floorX;
+	int cornerZ = (int)floorZ;
+	float dx = x - floorX;
+	float dz = z - floorZ;
+
+	float g00 = Gradient(Hash(cornerX, cornerZ, seed), dx, dz);
+	float g10 = Gradient(Hash(cornerX + 1, cornerZ, seed), dx - 1, dz);
+	float g01 = Gradient(Hash(cornerX, cornerZ + 1, seed), dx, dz - 1);
+	float g11 = Gradient(Hash(cornerX + 1, cornerZ + 1, seed), dx - 1, dz - 1);
+
+	float u = Fade(dx);
+	float near = g00 + (g10 - g00) * u;
+	float far = g01 + (g11 - g01) * u;
+	return near + (far - near) * Fade(dz);
+}
+
+static float FractalNoise(float x, float z, uint32_t seed, unsigned int octaves, float frequency, float lacunarity, float gain, bool ridged)
+{
+	float sum = 0.0f;
+	float amplitude = 1.0f;
+	float totalAmplitude = 0.0f;
+	for (unsigned int i = 0; i < octaves; i++)
+	{
+		float value = Noise(x * frequency, z * frequency, seed + i * 0x9e3779b9u) * (2.0f / 3.0f);
+		if (ridged)
+		{
+			value = 1.0f - std::fabs(value);
+			value = value * value * 2.0f - 1.0f;
+		}
+		sum += value * amplitude;
+		totalAmplitude += amplitude;
+		frequency *= lacunarity;
+		amplitude *= gain;
+	}
+	return totalAmplitude > 0.0f ? sum / totalAmplitude : sum;
+}
+
+static void ReferenceHeights(float* heights, unsigned int width, unsigned int height, const TerrainNoiseSettings& settings)
+{
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float sampleX = (float)x;
+			float sampleZ = (float)z;
+			if (settings.WarpStrength != 0.0f && settings.WarpOctaves > 0)
+			{
+				sampleX += FractalNoise((float)x, (float)z, settings.Seed ^ 0x68e31da4u, settings.WarpOctaves,
+					settings.WarpFrequency, settings.Lacunarity, settings.Gain, false) * settings.WarpStrength;
+				sampleZ += FractalNoise((float)x, (float)z, settings.Seed ^ 0xb5297a4du, settings.WarpOctaves,
+					settings.WarpFrequency, settings.Lacunarity, settings.Gain, false) * settings.WarpStrength;
+			}
+			float value = FractalNoise(sampleX, sampleZ, settings.Seed, settings.Octaves,
+				settings.Frequency, settings.Lacunarity, settings.Gain, settings.Ridged);
+			heights[(size_t)z * width + x] = std::clamp(value * 0.5f + 0.5f, 0.0f, 1.0f) * settings.HeightScale;
+		}
+}
+
+// --------------------------------------------------------
+// Measurements of a heightmap
+// --------------------------------------------------------
+static double Sum(const std::vector<float>& heights)
+{
+	double sum = 0.0;
+	for (float h : heights)
+		sum += h;
+	return sum;
+}
+
+// Fraction of neighboring (x or z) steps that rise more than the slope
+static double SteepFraction(const std::vector<float>& heights, unsigned int width, unsigned int height, float slope)
+{
+	size_t steep = 0;
+	size_t steps = 0;
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+		{
+			float h = heights[(size_t)z * width + x];
+			if (x + 1 < width) { steps++; steep += std::fabs(heights[(size_t)z * width + x + 1] - h) > slope; }
+			if (z + 1 < height) { steps++; steep += std::fabs(heights[(size_t)(z + 1) * width + x] - h) > slope; }
+		}
+	return (double)steep / steps;
+}
+
+static const TerrainNoiseSettings DemoNoise = {
+	.Seed = 1234, .Octaves = 7, .Frequency = 1.0f / 256, .Lacunarity = 2.0f, .Gain = 0.5f, .Ridged = false,
+	.WarpStrength = 40.0f, .WarpFrequency = 1.0f / 512, .WarpOctaves = 3, .HeightScale = 100.0f };
+
+static const TerrainErosionSettings DemoErosion = {
+	.ThermalIterations = 20, .TalusSlope = 0.6f, .ThermalRate = 0.4f,
+	.HydraulicIterations = 30, .Rain = 0.01f, .Solubility = 0.05f, .Capacity = 0.05f, .Evaporation = 0.1f };
+
+int main()
+{
+	// Vector noise against the scalar version, with a width that
+	// isn't a multiple of four and high enough frequencies that the
+	// warp pushes positions below zero
+	for (bool ridged : { false, true })
+	{
+		const unsigned int width = 131;
+		const unsigned int height = 77;
+		TerrainNoiseSettings settings = DemoNoise;
+		settings.Ridged = ridged;
+		settings.Frequency = 1.0f / 16;
+		settings.WarpFrequency = 1.0f / 32;
+
+		std::vector<float> heights((size_t)width * height);
+		std::vector<float> expected(heights.size());
+		GenerateTerrainHeights(heights.data(), width, height, settings, 1);
+		ReferenceHeights(expected.data(), width, height, settings);
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < heights.size(); i++)
+			maxError = std::max(maxError, std::fabs(heights[i] - expected[i]));
+		std::printf("SSE2 noise vs scalar (%s): max difference %g\n", ridged ? "ridged" : "fBm", maxError);
+		CHECK(maxError < 1e-3f);
+	}
+
+	// One octave should only rarely need clamping into 0 - HeightScale
+	{
+		const unsigned int size = 1024;
+		TerrainNoiseSettings settings = DemoNoise;
+		settings.Octaves = 1;
+		settings.WarpStrength = 0.0f;
+		settings.HeightScale = 1.0f;
+		settings.Frequency = 1.0f / 8;
+
+		std::vector<float> heights((size_t)size * size);
+		GenerateTerrainHeights(heights.data(), size, size, settings, 1);
+		size_t clamped = 0;
+		for (float h : heights)
+			clamped += (h <= 0.0f || h >= 1.0f);
+		CHECK(clamped * 1000 < heights.size());
+	}
+
+	// Generation and erosion on their own and together, for any
+	// thread count, bit for bit - and a different seed does change it
+	{
+		const unsigned int width = 517;
+		const unsigned int height = 389;
+		const size_t bytes = sizeof(float) * width * height;
+
+		std::vector<float> generated((size_t)width * height);
+		GenerateTerrainHeights(generated.data(), width, height, DemoNoise, 1);
+		std::vector<float> eroded = generated;
+		ErodeTerrainHeights(eroded.data(), width, height, 0.75f, DemoErosion, 1);
+		Heightmap whole;
+		GenerateHeightmap(whole, width, height, DemoNoise, DemoErosion, 0.75f, 1);
+		CHECK(std::memcmp(whole.GetData(), eroded.data(), bytes) == 0);
+
+		for (unsigned int threads : { 2u, 3u, 4u, 7u, 16u, 0u })
+		{
+			std::vector<float> heights(generated.size());
+			GenerateTerrainHeights(heights.data(), width, height, DemoNoise, threads);
+			CHECK(std::memcmp(heights.data(), generated.data(), bytes) == 0);
+
+			ErodeTerrainHeights(heights.data(), width, height, 0.75f, DemoErosion, threads);
+			CHECK(std::memcmp(heights.data(), eroded.data(), bytes) == 0);
+
+			Heightmap heightmap;
+			GenerateHeightmap(heightmap, width, height, DemoNoise, DemoErosion, 0.75f, threads);
+			CHECK(std::memcmp(heightmap.GetData(), eroded.data(), bytes) == 0);
+			CHECK(heightmap.GetWidth() == width && heightmap.GetHeight() == height && heightmap.GetXZScale() == 0.75f);
+		}
+
+		TerrainNoiseSettings reseeded = DemoNoise;
+		reseeded.Seed++;
+		std::vector<float> heights(generated.size());
+		GenerateTerrainHeights(heights.data(), width, height, reseeded, 1);
+		CHECK(std::memcmp(heights.data(), generated.data(), bytes) != 0);
+	}
+
+	// Erosion moves material around without making or losing any:
+	// thermal erosion flattens slopes steeper than the talus slope,
+	// then hydraulic erosion changes the surface further
+	{
+		const unsigned int size = 300;
+		TerrainNoiseSettings settings = DemoNoise;
+		settings.Ridged = true;
+		settings.Frequency = 1.0f / 64;
+		settings.HeightScale = 15.0f;
+		std::vector<float> heights((size_t)size * size);
+		GenerateTerrainHeights(heights.data(), size, size, settings, 1);
+
+		TerrainErosionSettings thermal = DemoErosion;
+		thermal.ThermalIterations = 200;
+		thermal.HydraulicIterations = 0;
+		double massBefore = Sum(heights);
+		double steepBefore = SteepFraction(heights, size, size, thermal.TalusSlope * 1.1f);
+		ErodeTerrainHeights(heights.data(), size, size, 1.0f, thermal, 2);
+		double massAfter = Sum(heights);
+		double steepAfter = SteepFraction(heights, size, size, thermal.TalusSlope * 1.1f);
+		std::printf("Thermal erosion: mass %.3f -> %.3f, steeper than talus %.2f%% -> %.2f%%\n",
+			massBefore, massAfter, steepBefore * 100, steepAfter * 100);
+		CHECK(std::fabs(massAfter - massBefore) / massBefore < 1e-5);
+		CHECK(steepAfter < steepBefore * 0.2);
+
+		TerrainErosionSettings hydraulic = DemoErosion;
+		hydraulic.ThermalIterations = 0;
+		hydraulic.HydraulicIterations = 200;
+		std::vector<float> washed = heights;
+		ErodeTerrainHeights(washed.data(), size, size, 1.0f, hydraulic, 3);
+		double massWashed = Sum(washed);
+		double change = 0.0;
+		for (size_t i = 0; i < washed.size(); i++)
+		{
+			CHECK(std::isfinite(washed[i]));
+			change += std::fabs(washed[i] - heights[i]);
+		}
+		std::printf("Hydraulic erosion: mass %.3f -> %.3f, mean change %.4f\n", massAfter, massWashed, change / washed.size());
+		CHECK(std::fabs(massWashed - massAfter) / massAfter < 1e-4);
+		CHECK(change > 0.0);
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All terrain generator tests passed\n");
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include "TerrainGridLayout.h"
+#include "meshoptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// --------------------------------------------------------
+// How long BuildTerrainGridIndices() takes in each order
+// (with and without renumbering the vertices) for the demo's
+// 513x513 mesh and bigger ones, next to what each order's
+// indices cost the post-transform cache.  For comparison,
+// meshoptimizer's general-purpose vertex cache optimizer is
+// run on the row-major indices too.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+static const char* OrderNames[] = { "row-major", "Morton", "Hilbert" };
+
+static double Milliseconds(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void PrintCacheRatios(const std::vector<unsigned int>& indices, unsigned int vertexCount)
+{
+	std::printf("ACMR %.3f (16 entries), %.3f (32 entries)\n",
+		meshopt_analyzeVertexCache(indices.data(), indices.size(), vertexCount, 16, 0, 0).acmr,
+		meshopt_analyzeVertexCache(indices.data(), indices.size(), vertexCount, 32, 0, 0).acmr);
+}
+
+int main()
+{
+	const unsigned int sizes[] = { 513, 1025, 4097 };
+	for (unsigned int verts : sizes)
+	{
+		const unsigned int vertexCount = verts * verts;
+		const double triangles = 2.0 * (verts - 1) * (verts - 1);
+		const int runs = verts < 1000 ? 20 : verts < 2000 ? 5 : 1;
+		std::vector<unsigned int> indices;
+		std::vector<unsigned int> vertexOrder;
+
+		for (int order = 0; order < 3; order++)
+		{
+			for (bool renumber : { false, true })
+			{
+				// Best of several runs, after one to size the vectors
+				BuildTerrainGridIndices(verts, verts, (TerrainGridOrder)order, indices, renumber ? &vertexOrder : 0);
+				double best = 1e30;
+				for (int run = 0; run < runs; run++)
+				{
+					auto start = Clock::now();
+					BuildTerrainGridIndices(verts, verts, (TerrainGridOrder)order, indices, renumber ? &vertexOrder : 0);
+					best = std::min(best, Milliseconds(start));
+				}
+
+				std::printf("%4ux%-4u %-9s %-11s: %8.2f ms (%5.1f ns per triangle), ",
+					verts, verts, OrderNames[order], renumber ? "+ vertices" : "", best, best * 1e6 / triangles);
+				PrintCacheRatios(indices, vertexCount);
+			}
+		}
+
+		BuildTerrainGridIndices(verts, verts, TerrainGridOrder::RowMajor, indices);
+		std::vector<unsigned int> optimized(indices.size());
+		auto start = Clock::now();
+		meshopt_optimizeVertexCache(optimized.data(), indices.data(), indices.size(), vertexCount);
+		double ms = Milliseconds(start);
+		std::printf("%4ux%-4u %-21s: %8.2f ms (%5.1f ns per triangle), ",
+			verts, verts, "meshopt optimizer", ms, ms * 1e6 / triangles);
+		PrintCacheRatios(optimized, vertexCount);
+	}
+	return 0;
+}
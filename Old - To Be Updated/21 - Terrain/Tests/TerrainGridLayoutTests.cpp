@@ -0,0 +1,157 @@
+#include "TerrainGridLayout.h"
+#include "meshoptimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks the terrain grid layouts without a GPU: every
+// order visits each square once (Hilbert only ever stepping
+// to a neighbor, Morton filling whole quarters at a time),
+// the reordered indices make exactly the row-major mesh's
+// triangles, and reordered vertices are numbered in the
+// order the triangles first use them.  Then measures the
+// average cache miss ratio (vertices shaded per triangle)
+// through meshoptimizer's FIFO post-transform cache model,
+// which is what the curve orders are for.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static const char* OrderNames[] = { "row-major", "Morton", "Hilbert" };
+
+static void CheckSquareOrder(unsigned int squaresX, unsigned int squaresZ, TerrainGridOrder order)
+{
+	std::vector<unsigned int> squares;
+	GetTerrainGridSquareOrder(squaresX, squaresZ, order, squares);
+	CHECK(squares.size() == (size_t)squaresX * squaresZ);
+
+	std::vector<char> seen(squares.size(), 0);
+	for (unsigned int square : squares)
+	{
+		CHECK(square < squares.size());
+		if (square < squares.size())
+		{
+			CHECK(!seen[square]);
+			seen[square] = 1;
+		}
+	}
+
+	// Hilbert steps to a neighboring square (diagonally only on odd sizes)
+	if (order == TerrainGridOrder::Hilbert)
+	{
+		for (size_t i = 1; i < squares.size(); i++)
+		{
+			int dx = std::abs((int)(squares[i] % squaresX) - (int)(squares[i - 1] % squaresX));
+			int dz = std::abs((int)(squares[i] / squaresX) - (int)(squares[i - 1] / squaresX));
+			CHECK(dx <= 1 && dz <= 1);
+			if (squaresX == squaresZ && squaresX % 2 == 0)
+				CHECK(dx + dz == 1);
+		}
+	}
+
+	// Morton fills (-x, -z), (+x, -z), (-x, +z), (+x, +z) quarters in turn
+	if (order == TerrainGridOrder::Morton && squaresX % 2 == 0 && squaresZ % 2 == 0)
+	{
+		size_t quarter = squares.size() / 4;
+		for (size_t i = 0; i < squares.size(); i++)
+		{
+			unsigned int x = squares[i] % squaresX;
+			unsigned int z = squares[i] / squaresX;
+			CHECK((x >= squaresX / 2) + 2u * (z >= squaresZ / 2) == i / quarter);
+		}
+	}
+}
+
+static void CheckTriangles(unsigned int vertsX, unsigned int vertsZ, TerrainGridOrder order)
+{
+	std::vector<unsigned int> rowMajor, indices, vertexOrder;
+	BuildTerrainGridIndices(vertsX, vertsZ, TerrainGridOrder::RowMajor, rowMajor);
+	BuildTerrainGridIndices(vertsX, vertsZ, order, indices, &vertexOrder);
+	CHECK(indices.size() == rowMajor.size());
+	CHECK(vertexOrder.size() == (size_t)vertsX * vertsZ);
+
+	std::vector<char> seen(vertexOrder.size(), 0);
+	for (unsigned int vertex : vertexOrder)
+	{
+		CHECK(vertex < vertexOrder.size());
+		if (vertex < vertexOrder.size())
+		{
+			CHECK(!seen[vertex]);
+			seen[vertex] = 1;
+		}
+	}
+
+	// Each index is either one already used or the next new one
+	unsigned int nextNew = 0;
+	for (unsigned int index : indices)
+	{
+		CHECK(index <= nextNew);
+		if (index == nextNew)
+			nextNew++;
+	}
+
+	// Same triangles (same winding) as row-major, back in row-major vertices
+	std::set<std::array<unsigned int, 3>> expected, actual;
+	for (size_t i = 0; i < rowMajor.size(); i += 3)
+		expected.insert({ rowMajor[i], rowMajor[i + 1], rowMajor[i + 2] });
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		if (indices[i] < vertexOrder.size() && indices[i + 1] < vertexOrder.size() && indices[i + 2] < vertexOrder.size())
+			actual.insert({ vertexOrder[indices[i]], vertexOrder[indices[i + 1]], vertexOrder[indices[i + 2]] });
+	CHECK(expected == actual);
+	CHECK(expected.size() == (size_t)(vertsX - 1) * (vertsZ - 1) * 2);
+}
+
+int main()
+{
+	const unsigned int sizes[][2] = {
+		{ 1, 1 }, { 1, 7 }, { 7, 1 }, { 2, 2 }, { 3, 5 }, { 8, 8 }, { 32, 32 }, { 31, 17 },
+		{ 17, 31 }, { 64, 16 }, { 100, 3 }, { 255, 255 }, { 511, 511 }, { 512, 512 } };
+	for (const auto& size : sizes)
+		for (TerrainGridOrder order : { TerrainGridOrder::RowMajor, TerrainGridOrder::Morton, TerrainGridOrder::Hilbert })
+		{
+			CheckSquareOrder(size[0], size[1], order);
+			CheckTriangles(size[0] + 1, size[1] + 1, order);
+		}
+
+	// A single column of vertices has no squares
+	std::vector<unsigned int> none;
+	BuildTerrainGridIndices(1, 5, TerrainGridOrder::Hilbert, none);
+	CHECK(none.empty());
+
+	// Cache behavior of the demo's 513x513 mesh.  Row-major misses
+	// about once per triangle (every vertex is shaded twice), while
+	// both curves get most of the way to the 0.5 minimum.
+	const unsigned int verts = 513;
+	for (unsigned int cacheSize : { 16u, 32u })
+	{
+		double ratios[3];
+		for (int order = 0; order < 3; order++)
+		{
+			std::vector<unsigned int> indices;
+			BuildTerrainGridIndices(verts, verts, (TerrainGridOrder)order, indices);
+			ratios[order] = meshopt_analyzeVertexCache(indices.data(), indices.size(), verts * verts, cacheSize, 0, 0).acmr;
+			std::printf("%ux%u, %2u entry cache, %-9s: %.3f vertices shaded per triangle\n",
+				verts, verts, cacheSize, OrderNames[order], ratios[order]);
+		}
+		CHECK(ratios[0] > 0.95);
+		for (int order = 1; order < 3; order++)
+			CHECK(ratios[order] < (cacheSize == 16 ? 0.8 : 0.7));
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All terrain grid layout tests passed\n");
+	return 0;
+}
@@ -0,0 +1,223 @@
+#include "TerrainOcclusionBaker.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks TerrainOcclusionBaker on shapes with known answers:
+// a flat plane sees the whole sky and is never shadowed, and
+// a ramp ending in a cliff shadows the flat ground behind it
+// for exactly height / sun slope.  Then, on the demo's
+// heightmap, checks every thread count bakes the same bytes,
+// and that rebaking an edit gives the same bytes as a full
+// bake of the edited heights.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static Heightmap MakeHeightmap(const std::vector<float>& heights, unsigned int width, unsigned int height, float xzScale)
+{
+	Heightmap heightmap;
+	heightmap.SetHeights(heights.data(), width, height, xzScale);
+	return heightmap;
+}
+
+static void FlatPlaneIsOpenAndLit()
+{
+	const unsigned int width = 37;
+	const unsigned int height = 21;
+	Heightmap heightmap = MakeHeightmap(std::vector<float>((size_t)width * height, 5.0f), width, height, 0.75f);
+
+	TerrainOcclusionSettings settings = { .DirectionCount = 16, .MaxDistance = 20.0f, .SunDirection = DirectX::XMFLOAT3(1, -1, 1), .ShadowSoftness = 0.05f };
+	TerrainOcclusionBaker baker;
+	baker.Bake(heightmap, settings, 1);
+	CHECK(baker.GetWidth() == width);
+	CHECK(baker.GetHeight() == height);
+	CHECK(baker.GetTexels().size() == (size_t)width * height * 2);
+	CHECK(baker.GetLastBakeCount() == (size_t)width * height);
+
+	// Every point, including along the edges and in the last
+	// partial group of each row
+	bool allOpen = true;
+	bool allLit = true;
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+		{
+			allOpen = allOpen && baker.GetOcclusion(x, z) == 1.0f;
+			allLit = allLit && baker.GetSunVisibility(x, z) == 1.0f;
+		}
+	CHECK(allOpen);
+	CHECK(allLit);
+
+	// Straight overhead is lit too, and a sun below the horizon lights nothing
+	settings.SunDirection = DirectX::XMFLOAT3(0, -1, 0);
+	baker.Bake(heightmap, settings, 1);
+	CHECK(baker.GetSunVisibility(0, 0) == 1.0f && baker.GetSunVisibility(18, 10) == 1.0f);
+
+	settings.SunDirection = DirectX::XMFLOAT3(1, 0.2f, 0);
+	baker.Bake(heightmap, settings, 1);
+	CHECK(baker.GetSunVisibility(0, 0) == 0.0f && baker.GetSunVisibility(18, 10) == 0.0f);
+	CHECK(baker.GetOcclusion(18, 10) == 1.0f);
+}
+
+static void RampShadowEndsWhereExpected()
+{
+	// Every row: a plane rising from 0 to 3 over columns 0 - 30,
+	// then a sheer drop to flat ground at 0
+	const unsigned int width = 64;
+	const unsigned int height = 9;
+	const unsigned int crest = 30;
+	const float crestHeight = 3.0f;
+	std::vector<float> heights((size_t)width * height);
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			heights[(size_t)z * width + x] = x <= crest ? crestHeight * x / crest : 0.0f;
+	Heightmap heightmap = MakeHeightmap(heights, width, height, 1.0f);
+
+	// Light travels down the ramp's far side, rising 0.5 per unit
+	// towards the sun, so the cliff's shadow is 3 / 0.5 = 6 long
+	const float sunSlope = 0.5f;
+	const unsigned int shadowLength = (unsigned int)(crestHeight / sunSlope);
+	TerrainOcclusionSettings settings = { .DirectionCount = 8, .MaxDistance = 40.0f, .SunDirection = DirectX::XMFLOAT3(1, -sunSlope, 0), .ShadowSoftness = 0.0f };
+	TerrainOcclusionBaker baker;
+	baker.Bake(heightmap, settings, 1);
+
+	for (unsigned int z = 0; z < height; z++)
+	{
+		// The ramp faces the sun
+		for (unsigned int x = 0; x <= crest; x++)
+			CHECK(baker.GetSunVisibility(x, z) == 1.0f);
+
+		// Shadowed behind the cliff, then lit (skipping the point
+		// exactly on the boundary, where the ray grazes the crest)
+		for (unsigned int x = crest + 1; x < crest + shadowLength; x++)
+			CHECK(baker.GetSunVisibility(x, z) == 0.0f);
+		for (unsigned int x = crest + shadowLength + 1; x < width; x++)
+			CHECK(baker.GetSunVisibility(x, z) == 1.0f);
+	}
+
+	// The cliff blocks some sky right behind it, less further away,
+	// and the crest sees more than the foot of the ramp
+	CHECK(baker.GetOcclusion(crest + 1, 4) < baker.GetOcclusion(crest + 10, 4));
+	CHECK(baker.GetOcclusion(crest + 10, 4) < 1.0f);
+	CHECK(baker.GetOcclusion(crest, 4) > baker.GetOcclusion(1, 4));
+
+	// A sun lower than the ramp's tilt leaves it in its own shadow,
+	// apart from the last column, whose ray leaves the map at once
+	settings.SunDirection = DirectX::XMFLOAT3(-1, -0.05f, 0);
+	baker.Bake(heightmap, settings, 1);
+	for (unsigned int x = 1; x < crest; x++)
+		CHECK(baker.GetSunVisibility(x, 4) == 0.0f);
+	CHECK(baker.GetSunVisibility(width - 1, 4) == 1.0f);
+
+	settings.SunDirection = DirectX::XMFLOAT3(-1, -0.2f, 0);
+	baker.Bake(heightmap, settings, 1);
+	for (unsigned int x = 1; x < crest; x++)
+		CHECK(baker.GetSunVisibility(x, 4) == 1.0f);
+}
+
+static void SameAcrossThreadCounts(const Heightmap& heightmap, const TerrainOcclusionSettings& settings)
+{
+	TerrainOcclusionBaker reference;
+	reference.Bake(heightmap, settings, 1);
+
+	for (unsigned int threads : { 2u, 3u, 7u, 0u })
+	{
+		TerrainOcclusionBaker baker;
+		baker.Bake(heightmap, settings, threads);
+		CHECK(baker.GetTexels() == reference.GetTexels());
+	}
+
+	// Some of it must actually be shadowed and occluded
+	size_t shadowed = 0;
+	size_t occluded = 0;
+	for (size_t i = 0; i < reference.GetTexels().size(); i += 2)
+	{
+		occluded += reference.GetTexels()[i] < 255;
+		shadowed += reference.GetTexels()[i + 1] < 255;
+	}
+	CHECK(occluded > 0);
+	CHECK(shadowed > 0);
+}
+
+static void RebakeMatchesFullBake(const Heightmap& heightmap, const TerrainOcclusionSettings& settings, unsigned int minX, unsigned int minZ, unsigned int maxX, unsigned int maxZ, float raise)
+{
+	unsigned int width = heightmap.GetWidth();
+	unsigned int height = heightmap.GetHeight();
+	std::vector<float> heights(heightmap.GetData(), heightmap.GetData() + (size_t)width * height);
+	for (unsigned int z = minZ; z <= maxZ; z++)
+		for (unsigned int x = minX; x <= maxX; x++)
+			heights[(size_t)z * width + x] += raise * std::sin((x - minX + 1.0f) / (maxX - minX + 2) * 3.14159f) * std::sin((z - minZ + 1.0f) / (maxZ - minZ + 2) * 3.14159f);
+	Heightmap edited = MakeHeightmap(heights, width, height, heightmap.GetXZScale());
+
+	TerrainOcclusionBaker rebaked;
+	rebaked.Bake(heightmap, settings, 0);
+	rebaked.Rebake(edited, minX, minZ, maxX, maxZ, 0);
+
+	TerrainOcclusionBaker full;
+	full.Bake(edited, settings, 0);
+	CHECK(rebaked.GetTexels() == full.GetTexels());
+	CHECK(rebaked.GetLastBakeCount() > (size_t)(maxX - minX + 1) * (maxZ - minZ + 1));
+	CHECK(rebaked.GetLastBakeCount() <= (size_t)width * height);
+}
+
+static void RebakeIgnoresBadRegions(const Heightmap& heightmap, const TerrainOcclusionSettings& settings)
+{
+	TerrainOcclusionBaker baker;
+	baker.Bake(heightmap, settings, 0);
+	std::vector<uint8_t> before = baker.GetTexels();
+
+	// A different size, or an empty region, bakes nothing
+	Heightmap smaller = MakeHeightmap(std::vector<float>(64 * 64, 0.0f), 64, 64, heightmap.GetXZScale());
+	baker.Rebake(smaller, 0, 0, 10, 10, 0);
+	CHECK(baker.GetLastBakeCount() == 0);
+	baker.Rebake(heightmap, 20, 20, 10, 10, 0);
+	CHECK(baker.GetLastBakeCount() == 0);
+	CHECK(baker.GetTexels() == before);
+
+	// Rebaking unchanged heights changes nothing
+	baker.Rebake(heightmap, 100, 100, 5000, 5000, 0);
+	CHECK(baker.GetLastBakeCount() > 0);
+	CHECK(baker.GetTexels() == before);
+}
+
+int main()
+{
+	FlatPlaneIsOpenAndLit();
+	RampShadowEndsWhereExpected();
+
+	Heightmap heightmap;
+	if (!heightmap.Load(ASSETS_DIR "/Heightmaps/terrain_513x513.r16", 513, 513, TerrainBitDepth::BitDepth_16, 100.0f, 0.75f))
+	{
+		std::printf("Couldn't load terrain_513x513.r16\n");
+		return 1;
+	}
+
+	// The demo's settings, with a short search so the full bakes are quick
+	TerrainOcclusionSettings settings = { .DirectionCount = 8, .MaxDistance = 30.0f, .SunDirection = DirectX::XMFLOAT3(1, -1, 1), .ShadowSoftness = 0.05f };
+	SameAcrossThreadCounts(heightmap, settings);
+
+	// A bump in the middle, a pit, a pit over the highest point
+	// (so rays stop early in different places), and edits against
+	// the edges and corners
+	RebakeMatchesFullBake(heightmap, settings, 300, 200, 323, 223, 30.0f);
+	RebakeMatchesFullBake(heightmap, settings, 100, 350, 140, 360, -40.0f);
+	RebakeMatchesFullBake(heightmap, settings, 300, 150, 323, 170, -40.0f);
+	RebakeMatchesFullBake(heightmap, settings, 0, 0, 15, 15, 60.0f);
+	RebakeMatchesFullBake(heightmap, settings, 490, 250, 512, 270, 25.0f);
+	RebakeMatchesFullBake(heightmap, settings, 505, 505, 512, 512, -10.0f);
+	RebakeIgnoresBadRegions(heightmap, settings);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All terrain occlusion baker tests passed\n");
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include "TerrainOcclusionBaker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Time to bake the demo's 513x513 heightmap with the demo's
+// settings (and with half the directions), on one thread
+// and on every hardware thread, and to rebake after
+// editing a 24x24 patch of it.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double Milliseconds(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main()
+{
+	Heightmap heightmap;
+	if (!heightmap.Load(ASSETS_DIR "/Heightmaps/terrain_513x513.r16", 513, 513, TerrainBitDepth::BitDepth_16, 100.0f, 0.75f))
+	{
+		std::printf("Couldn't load terrain_513x513.r16\n");
+		return 1;
+	}
+
+	const unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	TerrainOcclusionSettings settings = { .DirectionCount = 16, .MaxDistance = 100.0f, .SunDirection = DirectX::XMFLOAT3(1, -1, 1), .ShadowSoftness = 0.05f };
+	TerrainOcclusionBaker baker;
+	for (unsigned int directions : { 8u, 16u })
+	{
+		settings.DirectionCount = directions;
+		for (unsigned int threads : { 1u, hardwareThreads })
+		{
+			auto start = Clock::now();
+			baker.Bake(heightmap, settings, threads);
+			double ms = Milliseconds(start);
+			std::printf("Bake 513x513, %2u directions, %2u thread(s): %7.1f ms (%.0f ns per point)\n",
+				directions, threads, ms, ms * 1e6 / baker.GetLastBakeCount());
+		}
+	}
+
+	// Raise a bump in the middle of the map and rebake just around it
+	std::vector<float> heights(heightmap.GetData(), heightmap.GetData() + 513 * 513);
+	for (unsigned int z = 200; z < 224; z++)
+		for (unsigned int x = 300; x < 324; x++)
+			heights[z * 513 + x] += 30.0f * std::sin((x - 300) / 23.0f * 3.14159f) * std::sin((z - 200) / 23.0f * 3.14159f);
+	Heightmap edited;
+	edited.SetHeights(heights.data(), 513, 513, 0.75f);
+
+	for (unsigned int threads : { 1u, hardwareThreads })
+	{
+		baker.Bake(heightmap, settings, threads);
+		auto start = Clock::now();
+		baker.Rebake(edited, 300, 200, 323, 223, threads);
+		double ms = Milliseconds(start);
+		std::printf("Rebake a 24x24 edit,        %2u thread(s): %7.1f ms (%zu points, %.1f%% of the map)\n",
+			threads, ms, baker.GetLastBakeCount(), 100.0 * baker.GetLastBakeCount() / (513 * 513));
+	}
+	return 0;
+}
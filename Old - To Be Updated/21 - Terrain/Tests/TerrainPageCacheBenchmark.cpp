@@ -0,0 +1,103 @@
+#include "TerrainPageCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Costs of the terrain's virtual texture with the demo's
+// settings (136x136 texel pages, 64x64 of them at level 0):
+// compositing one page at a few levels, then the frame's
+// part - Update() - with the camera still and with it
+// flying over the terrain while the bake threads keep up
+// in the background.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double Milliseconds(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static TerrainSplatImage RandomImage(unsigned int size, unsigned int channels, unsigned int seed)
+{
+	TerrainSplatImage image = { size, size, channels, std::vector<uint8_t>((size_t)size * size * channels) };
+	std::mt19937 rng(seed);
+	for (uint8_t& texel : image.Texels)
+		texel = (uint8_t)(rng() & 255);
+	return image;
+}
+
+int main()
+{
+	// Like the demo's material: a 1024 blend map and three layers of 1024 textures
+	auto start = Clock::now();
+	auto compositor = std::make_shared<TerrainSplatCompositor>();
+	compositor->SetBlendMap(RandomImage(1024, 4, 1));
+	for (unsigned int i = 0; i < 3; i++)
+		compositor->AddLayer({ RandomImage(1024, 4, 10 * i + 2), RandomImage(1024, 4, 10 * i + 3), RandomImage(1024, 1, 10 * i + 4), RandomImage(128, 4, 10 * i + 5) });
+	compositor->SetUVTransform(20, 20, 0, 0);
+	std::printf("Compositor setup (mip chains):  %7.1f ms\n", Milliseconds(start));
+
+	std::vector<uint8_t> albedoRoughness(136 * 136 * 4), normalMetal(136 * 136 * 4);
+	for (unsigned int level : { 0u, 3u, 6u })
+	{
+		float texelSize = (float)(1u << level) / 64 / 128;
+		double best = 1e30;
+		for (int run = 0; run < 5; run++)
+		{
+			start = Clock::now();
+			compositor->Composite(0.37f, 0.41f, texelSize, 136, albedoRoughness.data(), normalMetal.data(), 136 * 4);
+			best = std::min(best, Milliseconds(start));
+		}
+		std::printf("Bake a level %u page:            %7.2f ms (%.0f ns per texel)\n", level, best, best * 1e6 / (136 * 136));
+	}
+
+	std::vector<float> heights(513 * 513, 10.0f);
+	Heightmap heightmap;
+	heightmap.SetHeights(heights.data(), 513, 513, 0.75f);
+	TerrainPageCache pages;
+	start = Clock::now();
+	pages.Init(compositor, heightmap, { 128, 4, 64, 7, 16, 16.0f, 4 });
+	std::printf("Init (coarsest page):           %7.1f ms\n", Milliseconds(start));
+
+	// Settle with the camera in the middle, then time updates with nothing to do
+	const float middle[3] = { 0.0f, 30.0f, 0.0f };
+	int updates = 0;
+	start = Clock::now();
+	do
+	{
+		pages.WaitForBakes();
+		pages.Update(middle);
+		updates++;
+	} while (pages.GetStats().PendingPages > 0);
+	std::printf("Camera in the middle: %u pages wanted, baked in %.0f ms over %d updates\n",
+		pages.GetStats().WantedPages, Milliseconds(start), updates);
+
+	double idle = 1e30;
+	for (int run = 0; run < 100; run++)
+	{
+		pages.Update(middle);
+		idle = std::min(idle, (double)pages.GetStats().LastUpdateMs);
+	}
+	std::printf("Update() with nothing to bake:  %7.3f ms\n", idle);
+
+	// Fly over at about 20 units a second, at 60 frames a second
+	double worst = 0.0;
+	double total = 0.0;
+	const int frames = 600;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		float camera[3] = { -190.0f + frame * 0.33f, 20.0f, -150.0f + frame * 0.25f };
+		pages.Update(camera);
+		worst = std::max(worst, (double)pages.GetStats().LastUpdateMs);
+		total += pages.GetStats().LastUpdateMs;
+	}
+	TerrainPageCacheStats stats = pages.GetStats();
+	std::printf("Update() while flying:          %7.3f ms average, %.3f ms worst (%u pages baked, %.2f ms each)\n",
+		total / frames, worst, stats.BakedPages, stats.AverageBakeMs);
+	return 0;
+}
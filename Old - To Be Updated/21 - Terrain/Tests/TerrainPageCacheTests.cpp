@@ -0,0 +1,227 @@
+#include "TerrainPageCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks the virtual texture's page cache: settings it has
+// to turn down, that Init() leaves the coarsest level ready,
+// that baked pages match the compositor's output for them
+// and only show up at the next Update(), and that after
+// every Update() the page table points each entry at the
+// finest resident page no finer than wanted, with no slot
+// shared between pages.  Then flies the camera around with
+// too small an atlas, and with the bake threads behind.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static TerrainSplatImage RandomImage(unsigned int size, unsigned int channels, unsigned int seed)
+{
+	TerrainSplatImage image = { size, size, channels, std::vector<uint8_t>((size_t)size * size * channels) };
+	std::mt19937 rng(seed);
+	for (uint8_t& texel : image.Texels)
+		texel = (uint8_t)(rng() & 255);
+	return image;
+}
+
+// --------------------------------------------------------
+// Every entry: a resident page, no finer than wanted (and
+// exactly as fine, once nothing is pending), with nothing
+// finer resident that it should have used, and each slot
+// belonging to one page
+// --------------------------------------------------------
+static void CheckPageTable(const TerrainPageCache& pages, bool settled)
+{
+	const TerrainPageCacheSettings& settings = pages.GetSettings();
+	const std::vector<uint8_t>& table = pages.GetPageTable();
+	CHECK(table.size() == (size_t)settings.PagesAcross * settings.PagesAcross * 4);
+
+	std::map<std::pair<unsigned int, unsigned int>, std::tuple<unsigned int, unsigned int, unsigned int>> slotOwners;
+	for (unsigned int y = 0; y < settings.PagesAcross; y++)
+		for (unsigned int x = 0; x < settings.PagesAcross; x++)
+		{
+			const uint8_t* entry = &table[((size_t)y * settings.PagesAcross + x) * 4];
+			unsigned int level = entry[2];
+			unsigned int wanted = pages.GetWantedLevel(x, y);
+			CHECK(level < settings.LevelCount && level >= wanted);
+			if (settled)
+				CHECK(level == wanted);
+			CHECK(pages.IsResident(level, x >> level, y >> level));
+			for (unsigned int finer = wanted; finer < level; finer++)
+				CHECK(!pages.IsResident(finer, x >> finer, y >> finer));
+
+			CHECK(entry[0] < settings.AtlasPagesAcross && entry[1] < settings.AtlasPagesAcross && entry[3] == 0);
+			auto slot = std::make_pair((unsigned int)entry[0], (unsigned int)entry[1]);
+			auto owner = std::make_tuple(level, x >> level, y >> level);
+			auto existing = slotOwners.find(slot);
+			if (existing == slotOwners.end())
+				slotOwners[slot] = owner;
+			else
+				CHECK(existing->second == owner);
+		}
+}
+
+static void CheckUploadSlots(const TerrainPageCache& pages)
+{
+	std::set<std::pair<unsigned int, unsigned int>> slots;
+	for (const TerrainPageUpload& upload : pages.GetUploads())
+		CHECK(slots.insert({ upload.SlotX, upload.SlotY }).second);
+}
+
+// --------------------------------------------------------
+// Waits for the bake threads and takes in what they baked,
+// until nothing the camera wants is missing
+// --------------------------------------------------------
+static int Settle(TerrainPageCache& pages, const float camera[3])
+{
+	int updates = 0;
+	do
+	{
+		pages.WaitForBakes();
+		pages.Update(camera);
+		CheckUploadSlots(pages);
+		CheckPageTable(pages, false);
+		updates++;
+	} while (pages.GetStats().PendingPages > 0 && updates < 1000);
+	return updates;
+}
+
+int main()
+{
+	auto compositor = std::make_shared<TerrainSplatCompositor>();
+	compositor->SetBlendMap(RandomImage(512, 4, 1));
+	for (unsigned int i = 0; i < 3; i++)
+		compositor->AddLayer({ RandomImage(256, 4, 10 * i + 2), RandomImage(256, 4, 10 * i + 3), RandomImage(256, 1, 10 * i + 4), RandomImage(64, 4, 10 * i + 5) });
+	compositor->SetUVTransform(20, 20, 0, 0);
+
+	std::vector<float> heights(513 * 513);
+	for (size_t i = 0; i < heights.size(); i++)
+		heights[i] = (float)((i * 7919) % 100);
+	Heightmap heightmap;
+	heightmap.SetHeights(heights.data(), 513, 513, 0.75f);
+
+	// Pages of 32 texels (plus 4 of border) over a 64 x 64 page terrain,
+	// in a 16 x 16 atlas, baking up to 4 pages an update
+	const TerrainPageCacheSettings settings = { 32, 4, 64, 7, 16, 16.0f, 4 };
+	TerrainPageCache pages;
+	CHECK(!pages.Init(compositor, heightmap, { 32, 4, 48, 7, 16, 16.0f, 4 }));		// Not a power of 2
+	CHECK(!pages.Init(0, heightmap, settings));
+	CHECK(!pages.Init(compositor, heightmap, { 32, 4, 64, 3, 2, 16.0f, 4 }));		// 16 x 16 coarsest pages don't fit
+	CHECK(pages.Init(compositor, heightmap, { 32, 4, 64, 99, 16, 16.0f, 4 }));
+	CHECK(pages.GetSettings().LevelCount == 7);
+
+	// Init() leaves the single coarsest page resident and ready to upload
+	CHECK(pages.Init(compositor, heightmap, settings, 1));
+	CHECK(pages.GetUploads().size() == 1 && pages.GetStats().ResidentPages == 1 && pages.PageTableChanged());
+	CHECK(pages.GetPaddedPageSize() == 40 && pages.GetAtlasSize() == 640);
+	CheckPageTable(pages, true);
+	{
+		const TerrainPageUpload& upload = pages.GetUploads()[0];
+		std::vector<uint8_t> albedoRoughness(40 * 40 * 4), normalMetal(40 * 40 * 4);
+		float texelSize = 1.0f / 32;
+		compositor->Composite(-4 * texelSize, -4 * texelSize, texelSize, 40, albedoRoughness.data(), normalMetal.data(), 160);
+		CHECK(upload.AlbedoRoughness == albedoRoughness && upload.NormalMetal == normalMetal);
+	}
+
+	// Down near a corner, the first Update() only queues pages, and the
+	// next picks up the four baked (coarsest first) in the meantime
+	const float corner[3] = { -150.0f, 60.0f, -150.0f };
+	const uint8_t* tableData = pages.GetPageTable().data();
+	pages.Update(corner);
+	CHECK(pages.GetUploads().empty());
+	pages.WaitForBakes();
+	pages.Update(corner);
+	CHECK(pages.GetUploads().size() == 4);
+	CHECK(pages.PageTableChanged());
+	CheckUploadSlots(pages);
+	CheckPageTable(pages, false);
+	TerrainPageCacheStats stats = pages.GetStats();
+	CHECK(stats.PendingPages == stats.WantedPages - stats.ResidentPages);
+
+	int updates = Settle(pages, corner);
+	stats = pages.GetStats();
+	std::printf("Camera at a corner: %u pages wanted, all resident after %d more updates\n", stats.WantedPages, updates);
+	CHECK(stats.PendingPages == 0);
+	CheckPageTable(pages, true);
+	CHECK(pages.GetWantedLevel(7, 7) == 0);
+	CHECK(pages.GetWantedLevel(63, 63) >= 4);
+
+	// With nothing new, the table is unchanged - and still the same buffer
+	pages.WaitForBakes();
+	pages.Update(corner);
+	CHECK(pages.GetUploads().empty() && !pages.PageTableChanged());
+	CHECK(pages.GetPageTable().data() == tableData);
+
+	// Fly diagonally across, more than the 256 slot atlas can hold
+	unsigned int maxResident = 0;
+	for (int step = 0; step <= 200; step++)
+	{
+		float camera[3] = { -190.0f + step * 1.9f, 20.0f, -190.0f + step * 1.9f };
+		pages.WaitForBakes();
+		pages.Update(camera);
+		CheckUploadSlots(pages);
+		CheckPageTable(pages, false);
+		maxResident = std::max(maxResident, pages.GetStats().ResidentPages);
+	}
+	stats = pages.GetStats();
+	std::printf("Flight: %u pages baked, %u evicted, at most %u resident\n", stats.BakedPages, stats.EvictedPages, maxResident);
+	CHECK(stats.EvictedPages > 0 && maxResident <= 256);
+
+	// And back, without waiting for the bake threads at all
+	for (int step = 200; step >= 0; step--)
+	{
+		float camera[3] = { -190.0f + step * 1.9f, 20.0f, -190.0f + step * 1.9f };
+		pages.Update(camera);
+		CheckUploadSlots(pages);
+		CheckPageTable(pages, false);
+	}
+	Settle(pages, corner);
+	CheckPageTable(pages, true);
+	CHECK(pages.GetPageTable().data() == tableData);
+
+	// An atlas of 9 slots, with far more pages wanted: the wanted pages
+	// fill it, and they don't push each other out
+	{
+		TerrainPageCache tiny;
+		CHECK(tiny.Init(compositor, heightmap, { 32, 4, 64, 7, 3, 50.0f, 100 }, 1));
+		tiny.Update(corner);
+		tiny.WaitForBakes();
+		tiny.Update(corner);
+		stats = tiny.GetStats();
+		std::printf("9 slot atlas: %u pages wanted, %u resident\n", stats.WantedPages, stats.ResidentPages);
+		CHECK(stats.ResidentPages == 9 && stats.PendingPages == stats.WantedPages - 9 && stats.EvictedPages == 0);
+		CheckPageTable(tiny, false);
+		tiny.WaitForBakes();
+		tiny.Update(corner);
+		CHECK(tiny.GetUploads().empty() && tiny.GetStats().EvictedPages == 0);
+	}
+
+	// However many threads bake them, the same pages end up used
+	{
+		TerrainPageCache one, four;
+		CHECK(one.Init(compositor, heightmap, settings, 1));
+		CHECK(four.Init(compositor, heightmap, { 32, 4, 64, 7, 16, 16.0f, 16 }, 4));
+		Settle(one, corner);
+		Settle(four, corner);
+		for (size_t i = 2; i < one.GetPageTable().size(); i += 4)
+			CHECK(one.GetPageTable()[i] == four.GetPageTable()[i]);
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All page cache tests passed\n");
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include "TerrainPlacer.h"
+
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Placements per second on the demo's 513x513 heightmap:
+// a million positions one at a time and batched (which
+// splits them between threads), then how long the demo's
+// tree scatter takes and how many points it places.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+template<typename Func>
+static void Time(const char* label, size_t count, Func func)
+{
+	auto start = Clock::now();
+	func();
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	std::printf("%-24s %8.2f M placements/s (%.1f ns each)\n", label, count / seconds / 1e6, seconds * 1e9 / count);
+}
+
+int main()
+{
+	auto heightmap = std::make_shared<Heightmap>();
+	if (!heightmap->Load(ASSETS_DIR "/Heightmaps/terrain_513x513.r16", 513, 513, TerrainBitDepth::BitDepth_16, 100.0f, 0.75f))
+	{
+		std::printf("Couldn't load terrain_513x513.r16\n");
+		return 1;
+	}
+
+	auto start = Clock::now();
+	TerrainPlacer placer(std::make_shared<Heightfield>(heightmap));
+	std::printf("Placer built in %.2f ms\n", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> acrossX(placer.GetMinX(), placer.GetMaxX());
+	std::uniform_real_distribution<float> acrossZ(placer.GetMinZ(), placer.GetMaxZ());
+
+	const size_t count = 1000000;
+	std::vector<XMFLOAT2> positions(count);
+	for (XMFLOAT2& position : positions)
+		position = XMFLOAT2(acrossX(rng), acrossZ(rng));
+
+	std::vector<TerrainPlacement> placements(count);
+	float sink = 0.0f;
+
+	Time("Place", count, [&]() {
+		for (size_t i = 0; i < count; i++)
+			placements[i] = placer.Place(positions[i].x, positions[i].y); });
+	sink += placements[count / 2].Position.y;
+
+	Time("Place (batched)", count, [&]() {
+		placer.Place(positions.data(), placements.data(), count); });
+	sink += placements[count / 2].Normal.y;
+
+	// The demo's trees
+	start = Clock::now();
+	std::vector<TerrainPlacement> trees = placer.Scatter({
+		.Spacing = 10.0f, .MinHeight = 2.0f, .MaxHeight = 40.0f, .MaxSlope = XM_PI / 6, .Attempts = 30, .Seed = 1 });
+	std::printf("Scattered %zu trees in %.2f ms (%g)\n", trees.size(),
+		std::chrono::duration<double, std::milli>(Clock::now() - start).count(), sink);
+	return 0;
+}
@@ -0,0 +1,169 @@
+#include "TerrainPlacer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Checks the terrain placer: placements are exactly the
+// heightfield's heights and normals, one at a time or
+// batched (big enough to be split between threads, and an
+// odd size), and scattered points are on the map, inside
+// the height and slope masks, never closer than the
+// spacing, the same every time for the same seed, and
+// dense enough that the masks' area is well covered.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static std::shared_ptr<Heightmap> MakeHills(unsigned int width, unsigned int height, float xzScale)
+{
+	std::vector<float> heights((size_t)width * height);
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			heights[(size_t)z * width + x] = 40.0f * std::sin(x * 0.031f) * std::cos(z * 0.023f) + 25.0f * std::sin((x + z) * 0.11f) + 50.0f;
+
+	auto heightmap = std::make_shared<Heightmap>();
+	heightmap->SetHeights(heights.data(), width, height, xzScale);
+	return heightmap;
+}
+
+static void CheckPlacements(const TerrainPlacer& placer, const Heightfield& field)
+{
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> acrossX(placer.GetMinX() - 5.0f, placer.GetMaxX() + 5.0f);
+	std::uniform_real_distribution<float> acrossZ(placer.GetMinZ() - 5.0f, placer.GetMaxZ() + 5.0f);
+
+	const size_t count = 100003;
+	std::vector<XMFLOAT2> positions(count);
+	for (XMFLOAT2& position : positions)
+		position = XMFLOAT2(acrossX(rng), acrossZ(rng));
+
+	std::vector<TerrainPlacement> placements(count);
+	placer.Place(positions.data(), placements.data(), count);
+
+	int mismatches = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		TerrainPlacement single = placer.Place(positions[i].x, positions[i].y);
+		float height = field.GetHeight(positions[i].x, positions[i].y);
+		XMFLOAT3 normal = field.GetNormal(positions[i].x, positions[i].y);
+		if (std::memcmp(&single, &placements[i], sizeof(TerrainPlacement)) != 0 ||
+			single.Position.x != positions[i].x || single.Position.z != positions[i].y ||
+			single.Position.y != height || std::memcmp(&single.Normal, &normal, sizeof(XMFLOAT3)) != 0)
+			mismatches++;
+	}
+	CHECK(mismatches == 0);
+}
+
+static void CheckScatter(const TerrainPlacer& placer, const TerrainScatterSettings& settings)
+{
+	std::vector<TerrainPlacement> points = placer.Scatter(settings);
+	CHECK(!points.empty());
+
+	float minNormalY = std::cos(settings.MaxSlope);
+	for (const TerrainPlacement& point : points)
+	{
+		CHECK(point.Position.x >= placer.GetMinX() && point.Position.x <= placer.GetMaxX());
+		CHECK(point.Position.z >= placer.GetMinZ() && point.Position.z <= placer.GetMaxZ());
+		CHECK(point.Position.y >= settings.MinHeight && point.Position.y <= settings.MaxHeight);
+		CHECK(point.Normal.y >= minNormalY);
+	}
+
+	// No two closer than the spacing (checked against a coarse grid of buckets)
+	float bucketSize = settings.Spacing;
+	int bucketsX = (int)((placer.GetMaxX() - placer.GetMinX()) / bucketSize) + 1;
+	int bucketsZ = (int)((placer.GetMaxZ() - placer.GetMinZ()) / bucketSize) + 1;
+	std::vector<std::vector<size_t>> buckets((size_t)bucketsX * bucketsZ);
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		int x = (int)((points[i].Position.x - placer.GetMinX()) / bucketSize);
+		int z = (int)((points[i].Position.z - placer.GetMinZ()) / bucketSize);
+		buckets[(size_t)z * bucketsX + x].push_back(i);
+	}
+
+	int tooClose = 0;
+	for (size_t i = 0; i < points.size(); i++)
+	{
+		int x = (int)((points[i].Position.x - placer.GetMinX()) / bucketSize);
+		int z = (int)((points[i].Position.z - placer.GetMinZ()) / bucketSize);
+		for (int nearZ = std::max(z - 1, 0); nearZ <= std::min(z + 1, bucketsZ - 1); nearZ++)
+			for (int nearX = std::max(x - 1, 0); nearX <= std::min(x + 1, bucketsX - 1); nearX++)
+				for (size_t j : buckets[(size_t)nearZ * bucketsX + nearX])
+				{
+					float dx = points[j].Position.x - points[i].Position.x;
+					float dz = points[j].Position.z - points[i].Position.z;
+					if (j != i && dx * dx + dz * dz < settings.Spacing * settings.Spacing)
+						tooClose++;
+				}
+	}
+	CHECK(tooClose == 0);
+
+	// The same points every time
+	std::vector<TerrainPlacement> again = placer.Scatter(settings);
+	CHECK(again.size() == points.size() && std::memcmp(again.data(), points.data(), points.size() * sizeof(TerrainPlacement)) == 0);
+
+	// Poisson disk sampling packs a point into roughly every 1.5 to 2
+	// spacings squared of what the masks allow, so with no masks the
+	// whole map should be well covered
+	if (settings.MinHeight == -FLT_MAX && settings.MaxHeight == FLT_MAX && settings.MaxSlope >= XM_PI / 2)
+	{
+		double area = (double)(placer.GetMaxX() - placer.GetMinX()) * (placer.GetMaxZ() - placer.GetMinZ());
+		double perPoint = area / points.size() / (settings.Spacing * settings.Spacing);
+		std::printf("Unmasked scatter: %zu points, %.2f spacings squared each\n", points.size(), perPoint);
+		CHECK(perPoint > 1.0 && perPoint < 2.2);
+	}
+	else
+		std::printf("Masked scatter: %zu points\n", points.size());
+}
+
+int main()
+{
+	auto heightmap = MakeHills(301, 257, 0.5f);
+	auto field = std::make_shared<Heightfield>(heightmap);
+	TerrainPlacer placer(field);
+	CheckPlacements(placer, *field);
+
+	CheckScatter(placer, { .Spacing = 2.0f, .MinHeight = -FLT_MAX, .MaxHeight = FLT_MAX, .MaxSlope = XM_PI, .Attempts = 30, .Seed = 1 });
+	CheckScatter(placer, { .Spacing = 1.5f, .MinHeight = 30.0f, .MaxHeight = 70.0f, .MaxSlope = 0.6f, .Attempts = 30, .Seed = 2 });
+
+	// A different seed changes the points
+	{
+		TerrainScatterSettings settings = { .Spacing = 2.0f, .MinHeight = -FLT_MAX, .MaxHeight = FLT_MAX, .MaxSlope = XM_PI, .Attempts = 30, .Seed = 1 };
+		std::vector<TerrainPlacement> first = placer.Scatter(settings);
+		settings.Seed = 9;
+		std::vector<TerrainPlacement> second = placer.Scatter(settings);
+		CHECK(first.size() != second.size() || std::memcmp(first.data(), second.data(), first.size() * sizeof(TerrainPlacement)) != 0);
+	}
+
+	// Masks nothing passes, no spacing, and a map too small to have a
+	// surface give no points; placing on the last is flat ground
+	CHECK(placer.Scatter({ .Spacing = 2.0f, .MinHeight = 1000.0f, .MaxHeight = 2000.0f, .MaxSlope = XM_PI, .Attempts = 30, .Seed = 1 }).empty());
+	CHECK(placer.Scatter({ .Spacing = 0.0f, .MinHeight = -FLT_MAX, .MaxHeight = FLT_MAX, .MaxSlope = XM_PI, .Attempts = 30, .Seed = 1 }).empty());
+	{
+		TerrainPlacer tiny(std::make_shared<Heightfield>(MakeHills(1, 1, 1.0f)));
+		CHECK(tiny.Scatter({ .Spacing = 2.0f, .MinHeight = -FLT_MAX, .MaxHeight = FLT_MAX, .MaxSlope = XM_PI, .Attempts = 30, .Seed = 1 }).empty());
+		TerrainPlacement placement = tiny.Place(3.0f, 4.0f);
+		CHECK(placement.Position.x == 3.0f && placement.Position.y == 0.0f && placement.Position.z == 4.0f);
+		CHECK(placement.Normal.x == 0.0f && placement.Normal.y == 1.0f && placement.Normal.z == 0.0f);
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All terrain placer tests passed\n");
+	return 0;
+}
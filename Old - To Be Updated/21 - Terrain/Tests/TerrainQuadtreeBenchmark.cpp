@@ -0,0 +1,107 @@
+#include "TerrainQuadtree.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// --------------------------------------------------------
+// Quadtree build and per-frame selection times on the
+// demo's 513x513 heightmap, for a few patch sizes, with a
+// camera flying a circle over the terrain - once without
+// culling, and once with a frustum looking along the path.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+// Row-major left-handed look-at * perspective (as XMMatrixLookToLH
+// times XMMatrixPerspectiveFovLH), depth from 0 to 1
+static void ViewProjection(const float eye[3], const float forward[3], float result[16])
+{
+	const float fovY = 1.0f, aspect = 16.0f / 9.0f, nearZ = 0.1f, farZ = 1000.0f;
+
+	float length = std::sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+	float z[3] = { forward[0] / length, forward[1] / length, forward[2] / length };
+	float x[3] = { z[2], 0.0f, -z[0] };
+	length = std::sqrt(x[0] * x[0] + x[2] * x[2]);
+	x[0] /= length;
+	x[2] /= length;
+	float y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+	float view[16] = {
+		x[0], y[0], z[0], 0.0f,
+		x[1], y[1], z[1], 0.0f,
+		x[2], y[2], z[2], 0.0f,
+		-(x[0] * eye[0] + x[1] * eye[1] + x[2] * eye[2]),
+		-(y[0] * eye[0] + y[1] * eye[1] + y[2] * eye[2]),
+		-(z[0] * eye[0] + z[1] * eye[1] + z[2] * eye[2]), 1.0f };
+
+	float yScale = 1.0f / std::tan(fovY * 0.5f);
+	float depth = farZ / (farZ - nearZ);
+	float projection[16] = {
+		yScale / aspect, 0.0f, 0.0f, 0.0f,
+		0.0f, yScale, 0.0f, 0.0f,
+		0.0f, 0.0f, depth, 1.0f,
+		0.0f, 0.0f, -nearZ * depth, 0.0f };
+
+	for (int row = 0; row < 4; row++)
+		for (int col = 0; col < 4; col++)
+		{
+			result[row * 4 + col] = 0.0f;
+			for (int k = 0; k < 4; k++)
+				result[row * 4 + col] += view[row * 4 + k] * projection[k * 4 + col];
+		}
+}
+
+int main()
+{
+	Heightmap heightmap;
+	if (!heightmap.Load(ASSETS_DIR "/Heightmaps/terrain_513x513.r16", 513, 513, TerrainBitDepth::BitDepth_16, 100.0f, 0.75f))
+	{
+		std::printf("Couldn't load terrain_513x513.r16\n");
+		return 1;
+	}
+
+	const unsigned int patchSizes[] = { 8, 16, 32, 64 };
+	const int frames = 20000;
+	for (unsigned int patchSize : patchSizes)
+	{
+		TerrainQuadtree tree;
+		auto start = Clock::now();
+		tree.Build(heightmap, patchSize);
+		double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		std::printf("Patch size %2u: %u LODs, %u nodes, built in %.2f ms\n", patchSize, tree.GetLODCount(), tree.GetNodeCount(), buildMs);
+
+		TerrainLODSettings settings = {};
+		settings.DetailDistance = tree.GetMinimumDetailDistance();
+		settings.MorphStartRatio = 0.66f;
+
+		std::vector<TerrainPatch> patches;
+		for (int cull = 0; cull < 2; cull++)
+		{
+			size_t patchCount = 0;
+			start = Clock::now();
+			for (int frame = 0; frame < frames; frame++)
+			{
+				// Around a circle, 60 units up, looking ahead and a little down
+				float angle = frame * 6.2831853f / frames;
+				float position[3] = { 120.0f * std::cos(angle), 60.0f, 120.0f * std::sin(angle) };
+				float forward[3] = { -std::sin(angle), -0.3f, std::cos(angle) };
+
+				TerrainFrustum frustum;
+				if (cull)
+				{
+					float viewProjection[16];
+					ViewProjection(position, forward, viewProjection);
+					frustum = TerrainFrustum::FromViewProjection(viewProjection);
+				}
+
+				tree.Select(position, cull ? &frustum : 0, settings, patches);
+				patchCount += patches.size();
+			}
+			double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / frames;
+			std::printf("  %-10s %8.2f us per selection, %7.1f patches on average\n", cull ? "Culled" : "Unculled", us, (double)patchCount / frames);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,310 @@
+#include "TerrainQuadtree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks the quadtree's patch selection on heightmaps that
+// aren't powers of 2 (or even square), from cameras all over
+// (and above) the map:
+//  - Without culling, the patches cover every grid square
+//    exactly once, and none of them lie entirely off the map
+//  - Squares that share an edge are never more than one LOD
+//    apart, as long as the detail distance is at least the
+//    tree's minimum
+//  - With culling, no patch is outside the frustum, every
+//    square whose box is at least partly inside is still
+//    covered exactly once, at the LOD it had without culling
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static Heightmap MakeHills(unsigned int width, unsigned int height, float xzScale)
+{
+	std::vector<float> heights((size_t)width * height);
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			heights[(size_t)z * width + x] = 30.0f * std::sin(x * 0.05f) * std::cos(z * 0.037f) + 10.0f * std::sin((x + z) * 0.21f);
+
+	Heightmap heightmap;
+	heightmap.SetHeights(heights.data(), width, height, xzScale);
+	return heightmap;
+}
+
+// Which grid squares (not points) a patch covers, before clipping to the map
+static void PatchSquares(const TerrainPatch& patch, unsigned int& x0, unsigned int& z0, unsigned int& size)
+{
+	x0 = patch.X;
+	z0 = patch.Z;
+	size = patch.Size;
+	if (patch.Quadrant >= 0)
+	{
+		size /= 2;
+		x0 += (patch.Quadrant & 1) * size;
+		z0 += (patch.Quadrant >> 1) * size;
+	}
+}
+
+// LOD covering each grid square (in Heightmap.h's row order), or -1
+// for none, counting every square covered more than once as a failure
+static std::vector<int> Coverage(const Heightmap& map, const std::vector<TerrainPatch>& patches)
+{
+	unsigned int squaresX = map.GetWidth() - 1;
+	unsigned int squaresZ = map.GetHeight() - 1;
+	std::vector<int> lods((size_t)squaresX * squaresZ, -1);
+	int overlaps = 0;
+	int offMap = 0;
+	for (const TerrainPatch& patch : patches)
+	{
+		unsigned int x0, z0, size;
+		PatchSquares(patch, x0, z0, size);
+		if (x0 >= squaresX || z0 >= squaresZ)
+		{
+			offMap++;
+			continue;
+		}
+
+		for (unsigned int z = z0; z < std::min(z0 + size, squaresZ); z++)
+			for (unsigned int x = x0; x < std::min(x0 + size, squaresX); x++)
+			{
+				int& lod = lods[(size_t)z * squaresX + x];
+				if (lod >= 0)
+					overlaps++;
+				lod = (int)patch.LOD;
+			}
+	}
+	CHECK(overlaps == 0);
+	CHECK(offMap == 0);
+	return lods;
+}
+
+// Row-major (DirectXMath style) left-handed look-at * perspective
+// matrix, with depth from 0 to 1
+static void ViewProjection(const float eye[3], const float forward[3], float fovY, float aspect, float nearZ, float farZ, float result[16])
+{
+	float length = std::sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+	float z[3] = { forward[0] / length, forward[1] / length, forward[2] / length };
+
+	// x = up cross z, y = z cross x
+	float x[3] = { z[2], 0.0f, -z[0] };
+	length = std::sqrt(x[0] * x[0] + x[2] * x[2]);
+	x[0] /= length;
+	x[2] /= length;
+	float y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+
+	float view[16] = {
+		x[0], y[0], z[0], 0.0f,
+		x[1], y[1], z[1], 0.0f,
+		x[2], y[2], z[2], 0.0f,
+		-(x[0] * eye[0] + x[1] * eye[1] + x[2] * eye[2]),
+		-(y[0] * eye[0] + y[1] * eye[1] + y[2] * eye[2]),
+		-(z[0] * eye[0] + z[1] * eye[1] + z[2] * eye[2]), 1.0f };
+
+	float yScale = 1.0f / std::tan(fovY * 0.5f);
+	float depth = farZ / (farZ - nearZ);
+	float projection[16] = {
+		yScale / aspect, 0.0f, 0.0f, 0.0f,
+		0.0f, yScale, 0.0f, 0.0f,
+		0.0f, 0.0f, depth, 1.0f,
+		0.0f, 0.0f, -nearZ * depth, 0.0f };
+
+	for (int row = 0; row < 4; row++)
+		for (int col = 0; col < 4; col++)
+		{
+			result[row * 4 + col] = 0.0f;
+			for (int k = 0; k < 4; k++)
+				result[row * 4 + col] += view[row * 4 + k] * projection[k * 4 + col];
+		}
+}
+
+// Box around one grid square, from its 4 corner heights
+static void SquareBounds(const Heightmap& map, unsigned int x, unsigned int z, float boundsMin[3], float boundsMax[3])
+{
+	float heights[4] = { map.GetValue(x, z), map.GetValue(x + 1, z), map.GetValue(x, z + 1), map.GetValue(x + 1, z + 1) };
+	boundsMin[0] = map.GetWorldX((float)x);
+	boundsMin[1] = *std::min_element(heights, heights + 4);
+	boundsMin[2] = map.GetWorldZ((float)z);
+	boundsMax[0] = map.GetWorldX((float)x + 1);
+	boundsMax[1] = *std::max_element(heights, heights + 4);
+	boundsMax[2] = map.GetWorldZ((float)z + 1);
+}
+
+static void CheckMap(unsigned int width, unsigned int height, unsigned int patchSize, float xzScale, unsigned int seed)
+{
+	Heightmap map = MakeHills(width, height, xzScale);
+	TerrainQuadtree tree;
+	tree.Build(map, patchSize);
+	CHECK(tree.GetPatchSize() == patchSize);
+	CHECK(tree.GetLODCount() > 0);
+	CHECK((patchSize << (tree.GetLODCount() - 1)) >= std::max(width, height) - 1);
+
+	unsigned int squaresX = width - 1;
+	unsigned int squaresZ = height - 1;
+	float minX = map.GetWorldX(0);
+	float maxX = map.GetWorldX((float)squaresX);
+	float minZ = map.GetWorldZ(0);
+	float maxZ = map.GetWorldZ((float)squaresZ);
+	float margin = 0.25f * std::max(maxX - minX, maxZ - minZ);
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> acrossX(minX - margin, maxX + margin);
+	std::uniform_real_distribution<float> acrossZ(minZ - margin, maxZ + margin);
+	std::uniform_real_distribution<float> above(-50.0f, 200.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	std::vector<TerrainPatch> patches;
+	std::vector<TerrainPatch> culledPatches;
+	size_t totalPatches = 0;
+	size_t totalCulledPatches = 0;
+	for (int camera = 0; camera < 24; camera++)
+	{
+		float position[3] = { acrossX(rng), above(rng), acrossZ(rng) };
+		TerrainLODSettings settings = {};
+		settings.DetailDistance = tree.GetMinimumDetailDistance() * (1.0f + (camera % 3) * 0.5f);
+		settings.MorphStartRatio = 0.66f;
+
+		// Every square, exactly once
+		tree.Select(position, 0, settings, patches);
+		std::vector<int> lods = Coverage(map, patches);
+		int uncovered = 0;
+		int lodJumps = 0;
+		for (unsigned int z = 0; z < squaresZ; z++)
+			for (unsigned int x = 0; x < squaresX; x++)
+			{
+				int lod = lods[(size_t)z * squaresX + x];
+				if (lod < 0)
+				{
+					uncovered++;
+					continue;
+				}
+
+				// Neighbors to the +x and +z sides
+				if (x + 1 < squaresX && std::abs(lod - lods[(size_t)z * squaresX + x + 1]) > 1)
+					lodJumps++;
+				if (z + 1 < squaresZ && std::abs(lod - lods[(size_t)(z + 1) * squaresX + x]) > 1)
+					lodJumps++;
+			}
+		CHECK(uncovered == 0);
+		CHECK(lodJumps == 0);
+
+		// Morphing finishes right where each LOD's range ends
+		for (const TerrainPatch& patch : patches)
+		{
+			CHECK(patch.LOD < tree.GetLODCount());
+			CHECK(patch.MorphStart < patch.MorphEnd);
+		}
+
+		// Culled: a subset, with anything in view still covered the same way
+		float forward[3] = { unit(rng), unit(rng) * 0.5f - 0.3f, unit(rng) };
+		if (forward[0] == 0.0f && forward[2] == 0.0f)
+			forward[0] = 1.0f;
+		float viewProjection[16];
+		ViewProjection(position, forward, 1.0f, 1.5f, 0.1f, 0.5f * (maxX - minX + maxZ - minZ), viewProjection);
+		TerrainFrustum frustum = TerrainFrustum::FromViewProjection(viewProjection);
+
+		tree.Select(position, &frustum, settings, culledPatches);
+		CHECK(culledPatches.size() <= patches.size());
+		totalPatches += patches.size();
+		totalCulledPatches += culledPatches.size();
+		std::vector<int> culledLODs = Coverage(map, culledPatches);
+		int culledOutside = 0;
+		for (const TerrainPatch& patch : culledPatches)
+		{
+			float boundsMin[3];
+			float boundsMax[3];
+			tree.GetPatchBounds(patch, boundsMin, boundsMax);
+			if (frustum.Classify(boundsMin, boundsMax) == 0)
+				culledOutside++;
+		}
+		CHECK(culledOutside == 0);
+
+		int missing = 0;
+		int changedLOD = 0;
+		for (unsigned int z = 0; z < squaresZ; z++)
+			for (unsigned int x = 0; x < squaresX; x++)
+			{
+				int lod = culledLODs[(size_t)z * squaresX + x];
+				if (lod >= 0 && lod != lods[(size_t)z * squaresX + x])
+					changedLOD++;
+
+				float boundsMin[3];
+				float boundsMax[3];
+				SquareBounds(map, x, z, boundsMin, boundsMax);
+				if (lod < 0 && frustum.Classify(boundsMin, boundsMax) != 0)
+					missing++;
+			}
+		CHECK(missing == 0);
+		CHECK(changedLOD == 0);
+	}
+
+	// Some cameras must have been looking away from something
+	CHECK(totalCulledPatches < totalPatches);
+}
+
+static void CheckFrustumClassify()
+{
+	// Looking down +z from the origin, 90 degrees across, depth 1 - 100
+	float eye[3] = { 0.0f, 0.0f, 0.0f };
+	float forward[3] = { 0.0f, 0.0f, 1.0f };
+	float viewProjection[16];
+	ViewProjection(eye, forward, 3.14159265f / 2, 1.0f, 1.0f, 100.0f, viewProjection);
+	TerrainFrustum frustum = TerrainFrustum::FromViewProjection(viewProjection);
+
+	float insideMin[3] = { -1.0f, -1.0f, 10.0f };
+	float insideMax[3] = { 1.0f, 1.0f, 12.0f };
+	CHECK(frustum.Classify(insideMin, insideMax) == 2);
+
+	float behindMin[3] = { -1.0f, -1.0f, -12.0f };
+	float behindMax[3] = { 1.0f, 1.0f, -10.0f };
+	CHECK(frustum.Classify(behindMin, behindMax) == 0);
+
+	float beyondMin[3] = { -1.0f, -1.0f, 101.0f };
+	float beyondMax[3] = { 1.0f, 1.0f, 105.0f };
+	CHECK(frustum.Classify(beyondMin, beyondMax) == 0);
+
+	float leftMin[3] = { -30.0f, -1.0f, 10.0f };
+	float leftMax[3] = { -20.0f, 1.0f, 12.0f };
+	CHECK(frustum.Classify(leftMin, leftMax) == 0);
+
+	float straddleMin[3] = { -30.0f, -1.0f, 10.0f };
+	float straddleMax[3] = { 0.0f, 1.0f, 12.0f };
+	CHECK(frustum.Classify(straddleMin, straddleMax) == 1);
+}
+
+int main()
+{
+	CheckFrustumClassify();
+
+	// Odd sizes: wide, tall, and barely there
+	CheckMap(300, 129, 32, 1.0f, 1);
+	CheckMap(300, 129, 8, 0.5f, 2);
+	CheckMap(65, 1025, 16, 2.0f, 3);
+	CheckMap(65, 1025, 64, 1.0f, 4);
+	CheckMap(3, 7, 2, 1.0f, 5);
+	CheckMap(3, 7, 4, 3.0f, 6);
+
+	// Too small for a single square: nothing to draw
+	Heightmap line = MakeHills(1, 9, 1.0f);
+	TerrainQuadtree tree;
+	tree.Build(line, 4);
+	std::vector<TerrainPatch> patches(3);
+	float position[3] = { 0.0f, 0.0f, 0.0f };
+	tree.Select(position, 0, { 10.0f, 0.5f }, patches);
+	CHECK(tree.GetLODCount() == 0);
+	CHECK(patches.empty());
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All terrain quadtree tests passed\n");
+	return 0;
+}
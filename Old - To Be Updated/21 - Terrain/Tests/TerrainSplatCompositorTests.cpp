@@ -0,0 +1,239 @@
+#include "TerrainSplatCompositor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks the splat compositor against TerrainPS's math done
+// in doubles straight from the full size images: a page
+// fine enough to sample every image's top mip, the same
+// across the blend map's wrapping edge, constant layers at
+// every resolution (which have to come out exact), no blend
+// map at all, and a page coarse enough that it has to be
+// the images' average.
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static TerrainSplatImage RandomImage(unsigned int width, unsigned int height, unsigned int channels, unsigned int seed)
+{
+	TerrainSplatImage image = { width, height, channels, std::vector<uint8_t>((size_t)width * height * channels) };
+	std::mt19937 rng(seed);
+	for (uint8_t& texel : image.Texels)
+		texel = (uint8_t)(rng() & 255);
+	return image;
+}
+
+static TerrainSplatImage ConstantImage(unsigned int width, unsigned int height, const std::vector<uint8_t>& texel)
+{
+	TerrainSplatImage image = { width, height, (unsigned int)texel.size(), {} };
+	for (size_t i = 0; i < (size_t)width * height; i++)
+		image.Texels.insert(image.Texels.end(), texel.begin(), texel.end());
+	return image;
+}
+
+// --------------------------------------------------------
+// Bilinear, wrapping sample of one channel, like the
+// terrain's sampler on the top mip
+// --------------------------------------------------------
+static double Sample(const TerrainSplatImage& image, double u, double v, unsigned int channel)
+{
+	if (channel >= image.Channels)
+		return 0.0;
+
+	double x = u * image.Width - 0.5;
+	double y = v * image.Height - 0.5;
+	double floorX = std::floor(x);
+	double floorY = std::floor(y);
+	auto texel = [&](long long texelX, long long texelY)
+		{
+			texelX %= (long long)image.Width;
+			texelY %= (long long)image.Height;
+			if (texelX < 0) texelX += image.Width;
+			if (texelY < 0) texelY += image.Height;
+			return image.Texels[((size_t)texelY * image.Width + texelX) * image.Channels + channel] / 255.0;
+		};
+
+	double tx = x - floorX;
+	double ty = y - floorY;
+	long long left = (long long)floorX;
+	long long top = (long long)floorY;
+	double upper = texel(left, top) * (1 - tx) + texel(left + 1, top) * tx;
+	double lower = texel(left, top + 1) * (1 - tx) + texel(left + 1, top + 1) * tx;
+	return upper * (1 - ty) + lower * ty;
+}
+
+struct Scene
+{
+	TerrainSplatImage BlendMap;
+	std::vector<TerrainSplatLayer> Layers;
+	float UVScale;
+	float UVOffsetX;
+	float UVOffsetY;
+};
+
+// --------------------------------------------------------
+// TerrainPS's blend at one uv, as the 8 output bytes
+// --------------------------------------------------------
+static void Reference(const Scene& scene, double u, double v, int result[8])
+{
+	double albedo[3] = {};
+	double normal[3] = {};
+	double roughness = 0.0;
+	double metal = 0.0;
+	for (unsigned int i = 0; i < scene.Layers.size() && i < scene.BlendMap.Channels; i++)
+	{
+		const TerrainSplatLayer& layer = scene.Layers[i];
+		double weight = Sample(scene.BlendMap, u, v, i);
+		double layerU = u * scene.UVScale + scene.UVOffsetX;
+		double layerV = v * scene.UVScale + scene.UVOffsetY;
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			albedo[c] += std::pow(Sample(layer.Albedo, layerU, layerV, c), 2.2) * weight;
+			normal[c] += (Sample(layer.Normals, layerU, layerV, c) * 2 - 1) * weight;
+		}
+		roughness += Sample(layer.Roughness, layerU, layerV, 0) * weight;
+		metal += Sample(layer.Metal, layerU, layerV, 0) * weight;
+	}
+
+	double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	for (unsigned int c = 0; c < 3; c++)
+		normal[c] = length > 0 ? normal[c] / length : (c == 2 ? 1.0 : 0.0);
+
+	for (unsigned int c = 0; c < 3; c++)
+	{
+		result[c] = (int)std::round(std::clamp(std::pow(albedo[c], 1 / 2.2), 0.0, 1.0) * 255);
+		result[4 + c] = (int)std::round(std::clamp(normal[c] * 0.5 + 0.5, 0.0, 1.0) * 255);
+	}
+	result[3] = (int)std::round(std::clamp(roughness, 0.0, 1.0) * 255);
+	result[7] = (int)std::round(std::clamp(metal, 0.0, 1.0) * 255);
+}
+
+// --------------------------------------------------------
+// A size x size page against the reference, returning the
+// worst error in any byte
+// --------------------------------------------------------
+static int CompareToReference(const TerrainSplatCompositor& compositor, const Scene& scene, float u, float v, float texelSize, unsigned int size)
+{
+	std::vector<uint8_t> albedoRoughness((size_t)size * size * 4);
+	std::vector<uint8_t> normalMetal((size_t)size * size * 4);
+	compositor.Composite(u, v, texelSize, size, albedoRoughness.data(), normalMetal.data(), (size_t)size * 4);
+
+	int maxError = 0;
+	for (unsigned int y = 0; y < size; y++)
+		for (unsigned int x = 0; x < size; x++)
+		{
+			int expected[8];
+			Reference(scene, u + (x + 0.5) * (double)texelSize, v + (y + 0.5) * (double)texelSize, expected);
+			size_t texel = ((size_t)y * size + x) * 4;
+			for (int c = 0; c < 4; c++)
+			{
+				maxError = std::max(maxError, std::abs(albedoRoughness[texel + c] - expected[c]));
+				maxError = std::max(maxError, std::abs(normalMetal[texel + c] - expected[4 + c]));
+			}
+		}
+	return maxError;
+}
+
+int main()
+{
+	// A blend map whose first three channels add up to about one,
+	// like a painted splat map, and three layers of noise
+	Scene scene = { RandomImage(1024, 1024, 4, 7), {}, 20.0f, 0.1f, -0.3f };
+	for (size_t i = 0; i < scene.BlendMap.Texels.size(); i += 4)
+	{
+		uint8_t* texel = &scene.BlendMap.Texels[i];
+		int sum = texel[0] + texel[1] + texel[2] + 1;
+		for (int c = 0; c < 3; c++)
+			texel[c] = (uint8_t)(texel[c] * 255 / sum);
+	}
+	for (unsigned int i = 0; i < 3; i++)
+		scene.Layers.push_back({
+			RandomImage(1024, 1024, 4, 10 * i + 1),
+			RandomImage(1024, 1024, 4, 10 * i + 2),
+			RandomImage(1024, 1024, 1, 10 * i + 3),
+			RandomImage(128, 128, 4, 10 * i + 4) });
+
+	TerrainSplatCompositor compositor;
+	compositor.SetBlendMap(scene.BlendMap);
+	for (const TerrainSplatLayer& layer : scene.Layers)
+		CHECK(compositor.AddLayer(layer));
+	CHECK(compositor.GetLayerCount() == 3);
+	CHECK(!compositor.AddLayer({}));
+	compositor.SetUVTransform(scene.UVScale, scene.UVScale, scene.UVOffsetX, scene.UVOffsetY);
+
+	// Texels small enough for every image's top mip, in the
+	// middle of the terrain and across the blend map's edges
+	int middleError = CompareToReference(compositor, scene, 0.3f, 0.95f, 1.0f / 32768, 40);
+	int edgeError = CompareToReference(compositor, scene, 0.9995f, -0.0005f, 1.0f / 32768, 40);
+	std::printf("Fine page vs reference: max error %d (middle), %d (across the edges)\n", middleError, edgeError);
+	CHECK(middleError <= 2);
+	CHECK(edgeError <= 2);
+
+	// Constant layers under a constant blend are exact at any resolution
+	{
+		TerrainSplatCompositor flat;
+		flat.SetBlendMap(ConstantImage(64, 64, { 255, 0, 0 }));
+		CHECK(flat.AddLayer({ ConstantImage(16, 16, { 200, 100, 50, 255 }), ConstantImage(8, 8, { 128, 128, 255 }), ConstantImage(4, 4, { 77 }), ConstantImage(2, 2, { 250 }) }));
+		CHECK(flat.AddLayer({ ConstantImage(16, 16, { 0, 0, 0, 255 }), ConstantImage(8, 8, { 0, 0, 0 }), ConstantImage(4, 4, { 0 }), ConstantImage(2, 2, { 0 }) }));
+
+		std::vector<uint8_t> albedoRoughness(16 * 4), normalMetal(16 * 4);
+		for (float texelSize : { 1e-5f, 1e-3f, 0.1f, 1.0f })
+		{
+			flat.Composite(0.2f, 0.7f, texelSize, 4, albedoRoughness.data(), normalMetal.data(), 16);
+			for (int i = 0; i < 16; i++)
+			{
+				CHECK(albedoRoughness[i * 4] == 200 && albedoRoughness[i * 4 + 1] == 100 && albedoRoughness[i * 4 + 2] == 50 && albedoRoughness[i * 4 + 3] == 77);
+				CHECK(normalMetal[i * 4] == 128 && normalMetal[i * 4 + 1] == 128 && normalMetal[i * 4 + 2] == 255 && normalMetal[i * 4 + 3] == 250);
+			}
+		}
+	}
+
+	// Nothing to blend: black, with normals straight up
+	{
+		TerrainSplatCompositor empty;
+		std::vector<uint8_t> albedoRoughness(4 * 4), normalMetal(4 * 4);
+		empty.Composite(0, 0, 0.1f, 2, albedoRoughness.data(), normalMetal.data(), 8);
+		CHECK(albedoRoughness[0] == 0 && albedoRoughness[3] == 0);
+		CHECK(normalMetal[0] == 128 && normalMetal[1] == 128 && normalMetal[2] == 255);
+	}
+
+	// A 4x4 page over the whole terrain samples mips small enough that
+	// its roughness averages out to the weighted average of the images
+	{
+		std::vector<uint8_t> albedoRoughness(16 * 4), normalMetal(16 * 4);
+		compositor.Composite(0, 0, 1.0f / 4, 4, albedoRoughness.data(), normalMetal.data(), 16);
+		double pageMean = 0.0;
+		for (int i = 0; i < 16; i++)
+			pageMean += albedoRoughness[i * 4 + 3] / 16.0;
+
+		double expectedMean = 0.0;
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			double roughness = 0.0;
+			for (uint8_t texel : scene.Layers[i].Roughness.Texels)
+				roughness += texel;
+			double weight = 0.0;
+			for (size_t j = i; j < scene.BlendMap.Texels.size(); j += 4)
+				weight += scene.BlendMap.Texels[j];
+			expectedMean += roughness / scene.Layers[i].Roughness.Texels.size() * weight / (scene.BlendMap.Texels.size() / 4) / 255;
+		}
+		std::printf("Whole terrain page: mean roughness %.2f, images' weighted mean %.2f\n", pageMean, expectedMean);
+		CHECK(std::fabs(pageMean - expectedMean) < 3.0);
+	}
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All splat compositor tests passed\n");
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include "TerrainStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Tile fetch latency on a synthetic 16385 x 16385 tiled
+// heightmap (written to the temp directory first, about
+// 700 MB).  First, single level 0 tiles decoded straight
+// from the mapping in random order, touching each tile's
+// pages for the first time and then again.  Then the
+// streamer, with a camera flying diagonally across the map
+// for 10 seconds at a few speeds and updating every 16 ms,
+// reporting how long tiles took from first being wanted to
+// being loaded.
+//
+// The file was only just written, so most of it is likely
+// still in the OS's file cache - these are best case times
+// for the disk, but the real cost of mapping and decoding.
+// --------------------------------------------------------
+
+using Clock = std::chrono::high_resolution_clock;
+
+static void PrintLatencies(const char* label, std::vector<double>& ms)
+{
+	std::sort(ms.begin(), ms.end());
+	double total = 0.0;
+	for (double m : ms)
+		total += m;
+	std::printf("%-24s %5zu tiles: average %.3f ms, median %.3f ms, 99th %.3f ms, max %.3f ms\n",
+		label, ms.size(), total / ms.size(), ms[ms.size() / 2], ms[ms.size() * 99 / 100], ms.back());
+}
+
+int main()
+{
+	const unsigned int size = 16385;
+	const float xzScale = 2.0f;
+	std::filesystem::path path = std::filesystem::temp_directory_path() / "TerrainStreamerBenchmark_16k.thm";
+
+	auto start = Clock::now();
+	if (!TiledHeightmap::Write(path, size, size, [](unsigned int x, unsigned int z) { return (uint16_t)((x * 7 + z * 13) ^ (x >> 3)); }, 256, 500.0f, xzScale))
+	{
+		std::printf("Couldn't write %s\n", path.string().c_str());
+		return 1;
+	}
+	std::printf("Wrote %.0f MB in %.2f s\n", std::filesystem::file_size(path) / (1024.0 * 1024.0),
+		std::chrono::duration<double>(Clock::now() - start).count());
+
+	// Decoding single tiles, as the streamer's loading thread does
+	{
+		TiledHeightmap map;
+		if (!map.Open(path))
+		{
+			std::printf("Couldn't open %s\n", path.string().c_str());
+			return 1;
+		}
+
+		const TiledHeightmapLevel& level0 = map.GetLevel(0);
+		std::vector<unsigned int> order(level0.TilesX * level0.TilesZ);
+		for (unsigned int i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::shuffle(order.begin(), order.end(), std::mt19937(1));
+		order.resize(1000);
+
+		unsigned int samplesAcross = map.GetTileSamplesAcross();
+		std::vector<float> heights((size_t)samplesAcross * samplesAcross);
+		float sink = 0.0f;
+		for (int pass = 0; pass < 2; pass++)
+		{
+			std::vector<double> ms;
+			for (unsigned int tile : order)
+			{
+				auto tileStart = Clock::now();
+				const uint16_t* samples = map.GetTileSamples(0, tile % level0.TilesX, tile / level0.TilesX);
+				for (size_t i = 0; i < heights.size(); i++)
+					heights[i] = map.SampleToHeight(samples[i]);
+				ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - tileStart).count());
+				sink += heights[tile % heights.size()];
+			}
+			PrintLatencies(pass == 0 ? "Decode (first touch)" : "Decode (mapped)", ms);
+		}
+		std::printf("(%g)\n", sink);
+	}
+
+	// Flying from one corner towards the other
+	const float speeds[] = { 100.0f, 500.0f, 2500.0f };
+	for (float speed : speeds)
+	{
+		TerrainStreamer streamer;
+		streamer.Open(path, { .Radius = 600.0f, .Budget = 64 * 1024 * 1024 });
+
+		float half = (size - 1) * xzScale / 2.0f;
+		float position[3] = { -half * 0.9f, 100.0f, -half * 0.9f };
+		float step = speed * 0.016f / 1.4142136f;
+		unsigned int frames = 0;
+		start = Clock::now();
+		while (position[0] < half * 0.9f && frames < 625)
+		{
+			streamer.Update(position);
+			position[0] += step;
+			position[2] += step;
+			frames++;
+			std::this_thread::sleep_until(start + std::chrono::microseconds(16000) * frames);
+		}
+
+		TerrainStreamingStats stats = streamer.GetStats();
+		std::printf("Flying at %6.0f units/s, %4u frames: %5u loaded, %5u evicted, %3u pending, fetch average %.2f ms (max %.2f), load average %.3f ms (max %.3f)\n",
+			speed, frames, stats.LoadedTiles, stats.EvictedTiles, stats.PendingTiles,
+			stats.AverageFetchMs, stats.MaxFetchMs, stats.AverageLoadMs, stats.MaxLoadMs);
+	}
+
+	std::filesystem::remove(path);
+	return 0;
+}
@@ -0,0 +1,275 @@
+#include "TerrainStreamer.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks tiled heightmaps and the streamer on a synthetic
+// 16385 x 16385 map (16k quads across, well past anything
+// that fits in memory as floats).  Its samples are x + 2z,
+// so every level and every tile can be checked exactly, and
+// bilinear heights are exact at any position on any level.
+//  - Every level's size, tile counts and sample ranges match
+//  - Tiles hold exactly the level 0 samples they came from
+//  - The streamer loads the tiles around the camera, answers
+//    heights from whatever is loaded, and stays in budget
+//  - A small odd-sized map converts exactly, and files that
+//    are cut short or aren't tiled heightmaps are rejected
+// --------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static const unsigned int BigSize = 16385;
+static const unsigned int BigTileSize = 256;
+
+static uint16_t BigSample(unsigned int x, unsigned int z) { return (uint16_t)(x + 2 * z); }
+
+// Every tile of every level against the samples it came from
+static void CheckTiles(const TiledHeightmap& map, const TiledHeightmap::SampleFunction& sample, unsigned int tilesPerLevel, unsigned int seed)
+{
+	const TiledHeightmapHeader& header = map.GetHeader();
+	unsigned int samplesAcross = map.GetTileSamplesAcross();
+	std::mt19937 rng(seed);
+
+	for (unsigned int level = 0; level < header.LevelCount; level++)
+	{
+		const TiledHeightmapLevel& info = map.GetLevel(level);
+		CHECK(info.Width == (header.Width - 1 + (1u << level) - 1) / (1u << level) + 1);
+		CHECK(info.Height == (header.Height - 1 + (1u << level) - 1) / (1u << level) + 1);
+		CHECK((info.TilesX - 1) * header.TileSize < info.Width - 1 && info.TilesX * header.TileSize >= info.Width - 1);
+		CHECK((info.TilesZ - 1) * header.TileSize < info.Height - 1 && info.TilesZ * header.TileSize >= info.Height - 1);
+
+		// Every tile on small levels, a random few on big ones
+		unsigned int tileCount = info.TilesX * info.TilesZ;
+		unsigned int checks = std::min(tileCount, tilesPerLevel);
+		int mismatches = 0;
+		for (unsigned int i = 0; i < checks; i++)
+		{
+			unsigned int tile = checks == tileCount ? i : rng() % tileCount;
+			unsigned int tileX = tile % info.TilesX;
+			unsigned int tileZ = tile / info.TilesX;
+			const uint16_t* samples = map.GetTileSamples(level, tileX, tileZ);
+			CHECK(map.GetTile(level, tileX, tileZ).Offset % TiledHeightmap::TileAlignment == 0);
+
+			uint16_t lowest = 65535;
+			uint16_t highest = 0;
+			for (unsigned int z = 0; z < samplesAcross; z++)
+			{
+				unsigned int levelZ = std::min(tileZ * header.TileSize + z, info.Height - 1);
+				for (unsigned int x = 0; x < samplesAcross; x++)
+				{
+					unsigned int levelX = std::min(tileX * header.TileSize + x, info.Width - 1);
+					uint16_t expected = sample(std::min(levelX << level, header.Width - 1), std::min(levelZ << level, header.Height - 1));
+					uint16_t value = samples[(size_t)z * samplesAcross + x];
+					if (value != expected)
+						mismatches++;
+					lowest = std::min(lowest, value);
+					highest = std::max(highest, value);
+				}
+			}
+			CHECK(map.GetTile(level, tileX, tileZ).MinSample == lowest);
+			CHECK(map.GetTile(level, tileX, tileZ).MaxSample == highest);
+		}
+		CHECK(mismatches == 0);
+	}
+
+	// One tile covers the last level
+	const TiledHeightmapLevel& last = map.GetLevel(header.LevelCount - 1);
+	CHECK(last.TilesX == 1 && last.TilesZ == 1);
+}
+
+// Updates the streamer until it has nothing left to load
+static bool Settle(TerrainStreamer& streamer, const float camera[3])
+{
+	for (int attempt = 0; attempt < 2000; attempt++)
+	{
+		streamer.Update(camera);
+		if (streamer.GetStats().PendingTiles == 0)
+		{
+			// The last tile may still be decoding
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			streamer.Update(camera);
+			if (streamer.GetStats().PendingTiles == 0)
+				return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+static void CheckStreaming(const std::filesystem::path& path)
+{
+	const float xzScale = 2.0f;
+	const float yScale = 500.0f;
+	TerrainStreamer streamer;
+
+	// Room for about 60 tiles, more than any one position wants
+	const size_t budget = 16 * 1024 * 1024;
+	CHECK(streamer.Open(path, { .Radius = 600.0f, .Budget = budget }));
+	const TiledHeightmapHeader& header = streamer.GetHeightmap().GetHeader();
+
+	// World position of a level 0 grid point, and its height (exact anywhere)
+	auto worldX = [&](float x) { return (x - header.Width / 2.0f) * xzScale; };
+	auto worldZ = [&](float z) { return (z - header.Height / 2.0f) * xzScale; };
+	auto expectedHeight = [&](float x, float z) { return (x + 2 * z) / 65535.0f * yScale; };
+
+	std::mt19937 rng(9);
+	std::uniform_real_distribution<float> across(0.0f, (float)(BigSize - 1));
+	for (int move = 0; move < 6; move++)
+	{
+		float gridX = across(rng);
+		float gridZ = across(rng);
+		float camera[3] = { worldX(gridX), 100.0f, worldZ(gridZ) };
+		CHECK(Settle(streamer, camera));
+
+		// The level 0 tile under the camera is in
+		unsigned int tileX = std::min((unsigned int)gridX / BigTileSize, streamer.GetHeightmap().GetLevel(0).TilesX - 1);
+		unsigned int tileZ = std::min((unsigned int)gridZ / BigTileSize, streamer.GetHeightmap().GetLevel(0).TilesZ - 1);
+		std::shared_ptr<const TerrainTile> tile = streamer.GetTile(0, tileX, tileZ);
+		CHECK(tile != 0);
+		if (tile)
+		{
+			CHECK(tile->Level == 0 && tile->X == tileX && tile->Z == tileZ);
+			CHECK(tile->Heights.size() == (size_t)(BigTileSize + 1) * (BigTileSize + 1));
+			CHECK(tile->Heights[0] == expectedHeight((float)(tileX * BigTileSize), (float)(tileZ * BigTileSize)));
+		}
+
+		// Heights near the camera and far away (from a coarser level)
+		// are both exact, within float rounding
+		int wrong = 0;
+		for (int i = 0; i < 200; i++)
+		{
+			float x = i < 100 ? std::clamp(gridX + (rng() % 400) - 200.0f, 0.0f, BigSize - 1.0f) : across(rng);
+			float z = i < 100 ? std::clamp(gridZ + (rng() % 400) - 200.0f, 0.0f, BigSize - 1.0f) : across(rng);
+			float height = -1.0f;
+			if (!streamer.GetHeight(worldX(x), worldZ(z), height) || std::abs(height - expectedHeight(x, z)) > 0.01f)
+				wrong++;
+		}
+		CHECK(wrong == 0);
+
+		// The coarsest level is always in, everywhere
+		CHECK(streamer.GetTile(header.LevelCount - 1, 0, 0) != 0);
+	}
+
+	// Moving around wanted more than the budget, so some were dropped
+	TerrainStreamingStats stats = streamer.GetStats();
+	CHECK(stats.LoadedTiles > 0);
+	CHECK(stats.EvictedTiles > 0);
+	CHECK(stats.ResidentBytes <= budget);
+	CHECK(stats.MaxFetchMs >= stats.AverageFetchMs);
+
+	// With no budget, only what the camera wants right now stays
+	// (a corner, so less than anywhere else)
+	streamer.SetSettings({ .Radius = 600.0f, .Budget = 1 });
+	float corner[3] = { worldX(0), 0.0f, worldZ(0) };
+	CHECK(Settle(streamer, corner));
+	TerrainStreamingStats cornerStats = streamer.GetStats();
+	CHECK(cornerStats.EvictedTiles > stats.EvictedTiles);
+	CHECK(cornerStats.ResidentBytes < stats.ResidentBytes);
+	CHECK(streamer.GetTile(0, 0, 0) != 0);
+
+	streamer.Close();
+	float height;
+	CHECK(!streamer.GetHeight(0, 0, height));
+}
+
+static void CheckSmallMap(const std::filesystem::path& path)
+{
+	// Odd sizes, so the edge tiles repeat the last row and column
+	const unsigned int width = 101;
+	const unsigned int height = 37;
+	std::vector<float> heights((size_t)width * height);
+	for (unsigned int z = 0; z < height; z++)
+		for (unsigned int x = 0; x < width; x++)
+			heights[(size_t)z * width + x] = 50.0f + 40.0f * std::sin(x * 0.3f) * std::cos(z * 0.2f);
+
+	Heightmap heightmap;
+	heightmap.SetHeights(heights.data(), width, height, 0.5f);
+	CHECK(TiledHeightmap::ConvertHeightmap(heightmap, path, 16, 100.0f));
+
+	TiledHeightmap map;
+	CHECK(map.Open(path));
+	CHECK(map.GetHeader().Width == width && map.GetHeader().Height == height);
+	CHECK(map.GetHeader().XZScale == 0.5f);
+	float toSample = 65535.0f / 100.0f;
+	CheckTiles(map, [&](unsigned int x, unsigned int z) {
+		return (uint16_t)std::lround(heightmap.GetValue(x, z) * toSample); }, 1000, 3);
+
+	// Round trips within half a sample
+	float worst = 0.0f;
+	const TiledHeightmapLevel& level0 = map.GetLevel(0);
+	for (unsigned int z = 0; z + 1 < height; z++)
+		for (unsigned int x = 0; x + 1 < width; x++)
+		{
+			unsigned int tileX = std::min(x / 16, level0.TilesX - 1);
+			unsigned int tileZ = std::min(z / 16, level0.TilesZ - 1);
+			uint16_t s = map.GetTileSamples(0, tileX, tileZ)[(z - tileZ * 16) * 17 + (x - tileX * 16)];
+			worst = std::max(worst, std::abs(map.SampleToHeight(s) - heightmap.GetValue(x, z)));
+		}
+	CHECK(worst <= 0.5f / 65535.0f * 100.0f + 1e-4f);
+	map.Close();
+	CHECK(!map.IsOpen());
+
+	// Cut short (past the last tile's padding), or not a tiled heightmap at all
+	std::vector<char> bytes;
+	{
+		std::ifstream file(path, std::ios::binary);
+		bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+	std::filesystem::path broken = path;
+	broken += ".broken";
+	{
+		std::ofstream file(broken, std::ios::binary | std::ios::trunc);
+		file.write(bytes.data(), bytes.size() - TiledHeightmap::TileAlignment);
+	}
+	CHECK(!map.Open(broken));
+	{
+		bytes[0] = 'X';
+		std::ofstream file(broken, std::ios::binary | std::ios::trunc);
+		file.write(bytes.data(), bytes.size());
+	}
+	CHECK(!map.Open(broken));
+	CHECK(!map.Open(path.parent_path() / "TiledHeightmapTests_Missing.thm"));
+	CHECK(!map.IsOpen());
+	std::filesystem::remove(broken);
+}
+
+int main()
+{
+	std::filesystem::path small = std::filesystem::temp_directory_path() / "TiledHeightmapTests_Small.thm";
+	CheckSmallMap(small);
+	std::filesystem::remove(small);
+
+	// About 700 MB on disk, written straight from the sample function
+	std::filesystem::path big = std::filesystem::temp_directory_path() / "TiledHeightmapTests_16k.thm";
+	CHECK(TiledHeightmap::Write(big, BigSize, BigSize, BigSample, BigTileSize, 500.0f, 2.0f));
+	{
+		TiledHeightmap map;
+		CHECK(map.Open(big));
+		if (map.IsOpen())
+		{
+			CHECK(map.GetHeader().LevelCount == 7);
+			CHECK(map.GetLevel(0).TilesX == 64 && map.GetLevel(0).TilesZ == 64);
+			CheckTiles(map, BigSample, 64, 1);
+		}
+	}
+	CheckStreaming(big);
+	std::filesystem::remove(big);
+
+	if (failures > 0)
+	{
+		std::printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+
+	std::printf("All tiled heightmap tests passed\n");
+	return 0;
+}
@@ -0,0 +1,313 @@
+#include "TiledHeightmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// Size of a level, in grid points: every (2^level)th point of
+// level 0, plus the last one so the whole map is still covered
+static unsigned int LevelSize(unsigned int size, unsigned int level)
+{
+	return ((size - 1 + (1u << level) - 1) >> level) + 1;
+}
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+
+TiledHeightmap::TiledHeightmap() :
+	header{},
+	levels(0),
+	tiles(0)
+{
+}
+
+bool TiledHeightmap::IsOpen() const { return file.IsOpen(); }
+const TiledHeightmapHeader& TiledHeightmap::GetHeader() const { return header; }
+const TiledHeightmapLevel& TiledHeightmap::GetLevel(unsigned int level) const { return levels[level]; }
+unsigned int TiledHeightmap::GetTileSamplesAcross() const { return header.TileSize + 1; }
+
+const TiledHeightmapTile& TiledHeightmap::GetTile(unsigned int level, unsigned int tileX, unsigned int tileZ) const
+{
+	return tiles[levels[level].FirstTile + tileZ * levels[level].TilesX + tileX];
+}
+
+const uint16_t* TiledHeightmap::GetTileSamples(unsigned int level, unsigned int tileX, unsigned int tileZ) const
+{
+	return (const uint16_t*)(file.GetData() + GetTile(level, tileX, tileZ).Offset);
+}
+
+
+// --------------------------------------------------------
+// Writes a tiled heightmap, one tile at a time
+//
+// path - Where to write the tiled file
+// width - Level 0 width in grid points
+// height - Level 0 height in grid points
+// sample - Gives the 16-bit sample at any level 0 grid point
+// tileSize - Quads across each tile
+// yScale - World height of a sample of 65535
+// xzScale - World distance between level 0 grid points
+// --------------------------------------------------------
+bool TiledHeightmap::Write(
+	const std::filesystem::path& path,
+	unsigned int width,
+	unsigned int height,
+	const SampleFunction& sample,
+	unsigned int tileSize,
+	float yScale,
+	float xzScale)
+{
+	if (width < 2 || height < 2 || tileSize == 0)
+		return false;
+
+	TiledHeightmapHeader fileHeader = {};
+	memcpy(fileHeader.Magic, "THMP", 4);
+	fileHeader.Version = Version;
+	fileHeader.Width = width;
+	fileHeader.Height = height;
+	fileHeader.TileSize = tileSize;
+	fileHeader.YScale = yScale;
+	fileHeader.XZScale = xzScale;
+
+	// Halve the levels until one tile covers everything
+	std::vector<TiledHeightmapLevel> fileLevels;
+	unsigned int tileCount = 0;
+	while (true)
+	{
+		unsigned int level = (unsigned int)fileLevels.size();
+		TiledHeightmapLevel info = {};
+		info.Width = LevelSize(width, level);
+		info.Height = LevelSize(height, level);
+		info.TilesX = (info.Width - 2) / tileSize + 1;
+		info.TilesZ = (info.Height - 2) / tileSize + 1;
+		info.FirstTile = tileCount;
+		fileLevels.push_back(info);
+		tileCount += info.TilesX * info.TilesZ;
+
+		if (info.TilesX == 1 && info.TilesZ == 1)
+			break;
+	}
+	fileHeader.LevelCount = (uint32_t)fileLevels.size();
+
+	// Every tile takes the same (aligned) space, right after the tables
+	unsigned int samplesAcross = tileSize + 1;
+	uint64_t tileBytes = (uint64_t)samplesAcross * samplesAcross * sizeof(uint16_t);
+	uint64_t tileStride = AlignUp(tileBytes, TileAlignment);
+	uint64_t tableOffset = sizeof(TiledHeightmapHeader) + sizeof(TiledHeightmapLevel) * fileLevels.size();
+	uint64_t dataOffset = AlignUp(tableOffset + sizeof(TiledHeightmapTile) * tileCount, TileAlignment);
+
+	std::vector<TiledHeightmapTile> fileTiles(tileCount);
+	for (unsigned int i = 0; i < tileCount; i++)
+		fileTiles[i].Offset = dataOffset + tileStride * i;
+
+	std::ofstream out(path, std::ios_base::binary | std::ios_base::trunc);
+	if (!out)
+		return false;
+
+	// Tables first (the tile table is rewritten once the
+	// sample ranges are known), then padding up to the tiles
+	out.write((const char*)&fileHeader, sizeof(fileHeader));
+	out.write((const char*)fileLevels.data(), sizeof(TiledHeightmapLevel) * fileLevels.size());
+	out.write((const char*)fileTiles.data(), sizeof(TiledHeightmapTile) * fileTiles.size());
+
+	std::vector<char> padding(TileAlignment, 0);
+	out.write(padding.data(), dataOffset - (uint64_t)out.tellp());
+
+	std::vector<uint16_t> tileSamples((size_t)samplesAcross * samplesAcross);
+	for (unsigned int level = 0; level < fileLevels.size(); level++)
+	{
+		const TiledHeightmapLevel& info = fileLevels[level];
+		for (unsigned int tileZ = 0; tileZ < info.TilesZ; tileZ++)
+		{
+			for (unsigned int tileX = 0; tileX < info.TilesX; tileX++)
+			{
+				uint16_t minSample = 65535;
+				uint16_t maxSample = 0;
+				for (unsigned int z = 0; z < samplesAcross; z++)
+				{
+					// Level grid point, then the level 0 point it came from
+					unsigned int levelZ = std::min(tileZ * tileSize + z, info.Height - 1);
+					unsigned int sourceZ = std::min(levelZ << level, height - 1);
+					for (unsigned int x = 0; x < samplesAcross; x++)
+					{
+						unsigned int levelX = std::min(tileX * tileSize + x, info.Width - 1);
+						unsigned int sourceX = std::min(levelX << level, width - 1);
+
+						uint16_t value = sample(sourceX, sourceZ);
+						tileSamples[(size_t)z * samplesAcross + x] = value;
+						minSample = std::min(minSample, value);
+						maxSample = std::max(maxSample, value);
+					}
+				}
+
+				TiledHeightmapTile& tile = fileTiles[info.FirstTile + tileZ * info.TilesX + tileX];
+				tile.MinSample = minSample;
+				tile.MaxSample = maxSample;
+
+				out.write((const char*)tileSamples.data(), tileBytes);
+				out.write(padding.data(), tileStride - tileBytes);
+			}
+		}
+	}
+
+	out.seekp(tableOffset);
+	out.write((const char*)fileTiles.data(), sizeof(TiledHeightmapTile) * fileTiles.size());
+	return out.good();
+}
+
+
+// --------------------------------------------------------
+// Converts a RAW heightmap to a tiled one.  The RAW file is
+// memory mapped rather than loaded, so it can be far larger
+// than would comfortably fit in memory.
+//
+// rawPath - Full path to the RAW heightmap
+// width - heightmap width in pixels
+// height - heightmap height in pixels
+// bitDepth - 8-bit or 16-bit height values?
+// tiledPath - Where to write the tiled file
+// tileSize - Quads across each tile
+// yScale - How tall should the terrain be?
+// xzScale - How wide should the terrain be?
+// --------------------------------------------------------
+bool TiledHeightmap::ConvertRaw(
+	const std::filesystem::path& rawPath,
+	unsigned int width,
+	unsigned int height,
+	TerrainBitDepth bitDepth,
+	const std::filesystem::path& tiledPath,
+	unsigned int tileSize,
+	float yScale,
+	float xzScale)
+{
+	MappedFile raw;
+	if (!raw.Open(rawPath))
+		return false;
+
+	size_t bytesPerSample = bitDepth == TerrainBitDepth::BitDepth_8 ? 1 : 2;
+	if (raw.GetSize() < (size_t)width * height * bytesPerSample)
+		return false;
+
+	const unsigned char* data = raw.GetData();
+	if (bitDepth == TerrainBitDepth::BitDepth_8)
+	{
+		// 8-bit values stretched to 16 bits (255 becomes 65535),
+		// so heights come out exactly as TerrainMesh's would
+		return Write(tiledPath, width, height,
+			[&](unsigned int x, unsigned int z) { return (uint16_t)(data[(size_t)z * width + x] * 257); },
+			tileSize, yScale, xzScale);
+	}
+
+	return Write(tiledPath, width, height,
+		[&](unsigned int x, unsigned int z) { return ((const uint16_t*)data)[(size_t)z * width + x]; },
+		tileSize, yScale, xzScale);
+}
+
+
+// --------------------------------------------------------
+// Converts a heightmap that's already in memory, quantizing
+// its heights to 16 bits
+//
+// heightmap - The heights (and xz scale) to convert
+// tiledPath - Where to write the tiled file
+// tileSize - Quads across each tile
+// yScale - Height of the highest sample
+// --------------------------------------------------------
+bool TiledHeightmap::ConvertHeightmap(
+	const Heightmap& heightmap,
+	const std::filesystem::path& tiledPath,
+	unsigned int tileSize,
+	float yScale)
+{
+	float toSample = yScale > 0.0f ? 65535.0f / yScale : 0.0f;
+	return Write(tiledPath, heightmap.GetWidth(), heightmap.GetHeight(),
+		[&](unsigned int x, unsigned int z) { return (uint16_t)std::lround(std::clamp(heightmap.GetValue(x, z) * toSample, 0.0f, 65535.0f)); },
+		tileSize, yScale, heightmap.GetXZScale());
+}
+
+
+// --------------------------------------------------------
+// Maps a tiled heightmap, checking that its tables match its
+// size so nothing past the end of the file is ever read
+// --------------------------------------------------------
+bool TiledHeightmap::Open(const std::filesystem::path& path)
+{
+	Close();
+	if (!file.Open(path))
+		return false;
+
+	const unsigned char* data = file.GetData();
+	size_t size = file.GetSize();
+	if (size < sizeof(TiledHeightmapHeader))
+	{
+		Close();
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.Magic, "THMP", 4) != 0 ||
+		header.Version != Version ||
+		header.Width < 2 || header.Height < 2 ||
+		header.TileSize == 0 || header.LevelCount == 0 || header.LevelCount > 32)
+	{
+		Close();
+		return false;
+	}
+
+	uint64_t tableOffset = sizeof(TiledHeightmapHeader) + sizeof(TiledHeightmapLevel) * (uint64_t)header.LevelCount;
+	if (size < tableOffset)
+	{
+		Close();
+		return false;
+	}
+	levels = (const TiledHeightmapLevel*)(data + sizeof(TiledHeightmapHeader));
+
+	uint64_t tileCount = 0;
+	for (unsigned int level = 0; level < header.LevelCount; level++)
+	{
+		const TiledHeightmapLevel& info = levels[level];
+		if (info.FirstTile != tileCount ||
+			info.Width != LevelSize(header.Width, level) ||
+			info.Height != LevelSize(header.Height, level) ||
+			info.TilesX != (info.Width - 2) / header.TileSize + 1 ||
+			info.TilesZ != (info.Height - 2) / header.TileSize + 1)
+		{
+			Close();
+			return false;
+		}
+		tileCount += (uint64_t)info.TilesX * info.TilesZ;
+	}
+
+	if (size < tableOffset + sizeof(TiledHeightmapTile) * tileCount)
+	{
+		Close();
+		return false;
+	}
+	tiles = (const TiledHeightmapTile*)(data + tableOffset);
+
+	uint64_t samplesAcross = header.TileSize + 1;
+	uint64_t tileBytes = samplesAcross * samplesAcross * sizeof(uint16_t);
+	for (uint64_t i = 0; i < tileCount; i++)
+	{
+		if (tiles[i].Offset % alignof(uint16_t) != 0 || tiles[i].Offset > size || size - tiles[i].Offset < tileBytes)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void TiledHeightmap::Close()
+{
+	file.Close();
+	header = {};
+	levels = 0;
+	tiles = 0;
+}
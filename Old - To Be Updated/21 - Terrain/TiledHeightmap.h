@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+#include "Heightmap.h"
+#include "MappedFile.h"
+
+// --------------------------------------------------------
+// A heightmap split into fixed-size tiles, with a pyramid
+// of coarser levels, stored so any one tile can be read
+// without touching the rest of the file.
+//
+// Level 0 holds every height; each level after that keeps
+// every other grid point of the one before, until a single
+// tile covers the whole map.  A tile is TileSize quads
+// across, so it holds (TileSize + 1) x (TileSize + 1)
+// 16-bit samples and shares its edge samples with its
+// neighbors (edge tiles repeat the map's last row/column).
+//
+// File layout:
+//   TiledHeightmapHeader
+//   TiledHeightmapLevel[LevelCount]
+//   TiledHeightmapTile[every tile of every level]
+//   Tile samples, each tile starting on a TileAlignment
+//   boundary (level by level, and both tiles and samples
+//   in rows, as in Heightmap.h)
+//
+// The tables are small enough to read up front, and the
+// tile data is meant to be memory mapped (see MappedFile).
+// --------------------------------------------------------
+
+struct TiledHeightmapHeader
+{
+	char Magic[4];			// "THMP"
+	uint32_t Version;
+	uint32_t Width;			// Level 0 size, in grid points
+	uint32_t Height;
+	uint32_t TileSize;		// Quads across each tile
+	uint32_t LevelCount;
+	float YScale;			// World height of a sample of 65535
+	float XZScale;			// World distance between level 0 grid points
+};
+
+struct TiledHeightmapLevel
+{
+	uint32_t Width;			// In grid points
+	uint32_t Height;
+	uint32_t TilesX;
+	uint32_t TilesZ;
+	uint32_t FirstTile;		// Index of the level's first tile in the tile table
+	uint32_t Padding;
+};
+
+struct TiledHeightmapTile
+{
+	uint64_t Offset;		// Of the samples, from the start of the file
+	uint16_t MinSample;		// Range of the tile's samples, so bounds
+	uint16_t MaxSample;		// don't need the tile itself
+	uint32_t Padding;
+};
+
+class TiledHeightmap
+{
+public:
+	static const uint32_t Version = 1;
+	static const unsigned int TileAlignment = 4096;
+
+	// Gives the 16-bit sample at a level 0 grid point
+	typedef std::function<uint16_t(unsigned int x, unsigned int z)> SampleFunction;
+
+	// Writes a tiled heightmap of the given size, asking for
+	// each sample as it's needed (so the source never has to
+	// be in memory all at once)
+	static bool Write(
+		const std::filesystem::path& path,
+		unsigned int width,
+		unsigned int height,
+		const SampleFunction& sample,
+		unsigned int tileSize = 256,
+		float yScale = 256.0f,
+		float xzScale = 1.0f);
+
+	// Converts an 8 or 16-bit RAW heightmap (as TerrainMesh loads)
+	static bool ConvertRaw(
+		const std::filesystem::path& rawPath,
+		unsigned int width,
+		unsigned int height,
+		TerrainBitDepth bitDepth,
+		const std::filesystem::path& tiledPath,
+		unsigned int tileSize = 256,
+		float yScale = 256.0f,
+		float xzScale = 1.0f);
+
+	// Converts heights already in memory (such as generated ones),
+	// clamping them to 0 - yScale
+	static bool ConvertHeightmap(
+		const Heightmap& heightmap,
+		const std::filesystem::path& tiledPath,
+		unsigned int tileSize = 256,
+		float yScale = 256.0f);
+
+	TiledHeightmap();
+
+	// Maps a tiled heightmap and checks its tables, returning
+	// false if it can't be opened or isn't a valid file
+	bool Open(const std::filesystem::path& path);
+	void Close();
+	bool IsOpen() const;
+
+	const TiledHeightmapHeader& GetHeader() const;
+	const TiledHeightmapLevel& GetLevel(unsigned int level) const;
+	const TiledHeightmapTile& GetTile(unsigned int level, unsigned int tileX, unsigned int tileZ) const;
+
+	// The tile's samples, straight from the mapped file (the
+	// first access to each page reads it from disk)
+	const uint16_t* GetTileSamples(unsigned int level, unsigned int tileX, unsigned int tileZ) const;
+
+	// Samples across each tile (TileSize + 1)
+	unsigned int GetTileSamplesAcross() const;
+
+	// World height of a sample
+	float SampleToHeight(uint16_t sample) const { return (sample / 65535.0f) * header.YScale; }
+
+private:
+	MappedFile file;
+	TiledHeightmapHeader header;
+	const TiledHeightmapLevel* levels;
+	const TiledHeightmapTile* tiles;
+};